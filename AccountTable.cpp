@@ -0,0 +1,424 @@
+#include "pch.h"
+#include "AccountTable.h"
+#include "SecretFingerprint.h"
+#include <dpapi.h>
+#include <sddl.h>
+
+#pragma comment(lib, "crypt32.lib")
+
+// 所有实例中 SID 解析失败的账户累计数
+static volatile LONG s_cUnresolvedAccounts = 0;
+
+AccountTable::AccountTable() :
+    _rgEntries(nullptr),
+    _cEntries(0),
+    _cEntriesMax(0),
+    _cUsernameKeys(0),
+    _rgAliases(nullptr),
+    _cAliases(0),
+    _pszStrings(nullptr),
+    _cchStrings(0),
+    _cchStringsMax(0),
+    _pbSecrets(nullptr),
+    _cbSecrets(0),
+    _cbSecretsMax(0),
+    _rgdwBuckets(nullptr),
+    _cBuckets(0)
+{
+}
+
+AccountTable::~AccountTable()
+{
+    if (_rgEntries)
+    {
+        CoTaskMemFree(_rgEntries);
+        _rgEntries = nullptr;
+    }
+    if (_rgAliases)
+    {
+        CoTaskMemFree(_rgAliases);
+        _rgAliases = nullptr;
+    }
+    if (_pszStrings)
+    {
+        CoTaskMemFree(_pszStrings);
+        _pszStrings = nullptr;
+    }
+    if (_pbSecrets)
+    {
+        SecureZeroMemory(_pbSecrets, _cbSecretsMax);
+        CoTaskMemFree(_pbSecrets);
+        _pbSecrets = nullptr;
+    }
+    if (_rgdwBuckets)
+    {
+        CoTaskMemFree(_rgdwBuckets);
+        _rgdwBuckets = nullptr;
+    }
+}
+
+// FNV-1a
+DWORD AccountTable::_Hash(PCWSTR psz, size_t cch)
+{
+    DWORD dwHash = 2166136261u;
+    for (size_t i = 0; i < cch; i++)
+    {
+        dwHash = (dwHash ^ (DWORD)psz[i]) * 16777619u;
+    }
+    return dwHash;
+}
+
+HRESULT AccountTable::_AppendString(PCWSTR psz, size_t cch, DWORD* pich)
+{
+    if (cch > USHRT_MAX)
+    {
+        return E_INVALIDARG;
+    }
+
+    DWORD cchNeeded = _cchStrings + (DWORD)cch + 1;
+    if (cchNeeded > _cchStringsMax)
+    {
+        DWORD cchMax = max(cchNeeded, max(_cchStringsMax * 2, (DWORD)256));
+        PWSTR pszNew = (PWSTR)CoTaskMemRealloc(_pszStrings, cchMax * sizeof(WCHAR));
+        if (!pszNew)
+        {
+            return E_OUTOFMEMORY;
+        }
+        _pszStrings = pszNew;
+        _cchStringsMax = cchMax;
+    }
+
+    *pich = _cchStrings;
+    CopyMemory(_pszStrings + _cchStrings, psz, cch * sizeof(WCHAR));
+    _pszStrings[_cchStrings + cch] = L'\0';
+    _cchStrings = cchNeeded;
+    return S_OK;
+}
+
+// 密码连同结尾 NUL 按块大小补齐后原地加密
+HRESULT AccountTable::_AppendSecret(PCWSTR pszPassword, DWORD* phSecret, DWORD* pcbSecret)
+{
+    size_t cbPassword = (wcslen(pszPassword) + 1) * sizeof(WCHAR);
+    DWORD cbSecret = (DWORD)((cbPassword + CRYPTPROTECTMEMORY_BLOCK_SIZE - 1) & ~(size_t)(CRYPTPROTECTMEMORY_BLOCK_SIZE - 1));
+
+    DWORD cbNeeded = _cbSecrets + cbSecret;
+    if (cbNeeded > _cbSecretsMax)
+    {
+        DWORD cbMax = max(cbNeeded, max(_cbSecretsMax * 2, (DWORD)512));
+        BYTE* pbNew = (BYTE*)CoTaskMemAlloc(cbMax);
+        if (!pbNew)
+        {
+            return E_OUTOFMEMORY;
+        }
+        if (_pbSecrets)
+        {
+            CopyMemory(pbNew, _pbSecrets, _cbSecrets);
+            SecureZeroMemory(_pbSecrets, _cbSecretsMax);
+            CoTaskMemFree(_pbSecrets);
+        }
+        _pbSecrets = pbNew;
+        _cbSecretsMax = cbMax;
+    }
+
+    BYTE* pbSecret = _pbSecrets + _cbSecrets;
+    ZeroMemory(pbSecret, cbSecret);
+    CopyMemory(pbSecret, pszPassword, cbPassword);
+    if (!CryptProtectMemory(pbSecret, cbSecret, CRYPTPROTECTMEMORY_SAME_PROCESS))
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        SecureZeroMemory(pbSecret, cbSecret);
+        return hr;
+    }
+
+    *phSecret = _cbSecrets;
+    *pcbSecret = cbSecret;
+    _cbSecrets = cbNeeded;
+    return S_OK;
+}
+
+void AccountTable::_InsertBucket(DWORD dwIndex)
+{
+    const ACCOUNT_ENTRY& entry = _rgEntries[dwIndex];
+    DWORD dwMask = _cBuckets - 1;
+    DWORD i = _Hash(_pszStrings + entry.ichKey, entry.cchKey) & dwMask;
+    while (_rgdwBuckets[i])
+    {
+        i = (i + 1) & dwMask;
+    }
+    _rgdwBuckets[i] = dwIndex + 1;
+}
+
+// 保持装载因子不超过 1/2
+HRESULT AccountTable::_GrowBuckets()
+{
+    DWORD cBuckets = _cBuckets ? _cBuckets * 2 : 16;
+    DWORD* rgdwBuckets = (DWORD*)CoTaskMemAlloc(cBuckets * sizeof(DWORD));
+    if (!rgdwBuckets)
+    {
+        return E_OUTOFMEMORY;
+    }
+    ZeroMemory(rgdwBuckets, cBuckets * sizeof(DWORD));
+
+    if (_rgdwBuckets)
+    {
+        CoTaskMemFree(_rgdwBuckets);
+    }
+    _rgdwBuckets = rgdwBuckets;
+    _cBuckets = cBuckets;
+
+    for (DWORD i = 0; i < _cEntries; i++)
+    {
+        _InsertBucket(i);
+    }
+    return S_OK;
+}
+
+HRESULT AccountTable::_FindKey(PCWSTR pszKey, size_t cchKey, DWORD* pdwIndex) const
+{
+    if (!_cBuckets)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    DWORD dwMask = _cBuckets - 1;
+    for (DWORD i = _Hash(pszKey, cchKey) & dwMask; _rgdwBuckets[i]; i = (i + 1) & dwMask)
+    {
+        const ACCOUNT_ENTRY& entry = _rgEntries[_rgdwBuckets[i] - 1];
+        if ((entry.cchKey == cchKey) && (wmemcmp(_pszStrings + entry.ichKey, pszKey, cchKey) == 0))
+        {
+            *pdwIndex = _rgdwBuckets[i] - 1;
+            return S_OK;
+        }
+    }
+    return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+}
+
+HRESULT AccountTable::_FindAlias(PCWSTR pszSid, size_t cchSid, DWORD* pdwIndex) const
+{
+    for (DWORD i = 0; i < _cAliases; i++)
+    {
+        const ACCOUNT_SID_ALIAS& alias = _rgAliases[i];
+        if ((alias.cchSid == cchSid) && (wmemcmp(_pszStrings + alias.ichSid, pszSid, cchSid) == 0))
+        {
+            *pdwIndex = alias.dwIndex;
+            return S_OK;
+        }
+    }
+    return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+}
+
+HRESULT AccountTable::Find(PCWSTR pszKey, DWORD* pdwIndex) const
+{
+    if (!pszKey)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    size_t cchKey = wcslen(pszKey);
+    HRESULT hr = _FindKey(pszKey, cchKey, pdwIndex);
+    if (FAILED(hr) && _cAliases)
+    {
+        hr = _FindAlias(pszKey, cchKey, pdwIndex);
+    }
+    return hr;
+}
+
+LONG AccountTable::GetUnresolvedAccounts()
+{
+    return ReadAcquire(&s_cUnresolvedAccounts);
+}
+
+HRESULT AccountTable::AddAccountWithSid(PCWSTR pszSid, PCWSTR pszUsername, PCWSTR pszPassword)
+{
+    if (!pszUsername || !*pszUsername || !pszPassword)
+    {
+        return E_INVALIDARG;
+    }
+
+    PCWSTR pszKey = (pszSid && *pszSid) ? pszSid : pszUsername;
+    size_t cchKey = wcslen(pszKey);
+    DWORD dwExisting = 0;
+    if (SUCCEEDED(_FindKey(pszKey, cchKey, &dwExisting)))
+    {
+        return S_FALSE;
+    }
+
+    if (_cEntries == _cEntriesMax)
+    {
+        DWORD cEntriesMax = _cEntriesMax ? _cEntriesMax * 2 : 8;
+        ACCOUNT_ENTRY* rgEntries = (ACCOUNT_ENTRY*)CoTaskMemRealloc(_rgEntries, cEntriesMax * sizeof(ACCOUNT_ENTRY));
+        if (!rgEntries)
+        {
+            return E_OUTOFMEMORY;
+        }
+        _rgEntries = rgEntries;
+        _cEntriesMax = cEntriesMax;
+    }
+    if ((_cEntries + 1) * 2 > _cBuckets)
+    {
+        HRESULT hr = _GrowBuckets();
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    // 以用户名为键时键和用户名共用一份字符串
+    ACCOUNT_ENTRY entry = { 0 };
+    size_t cchUsername = wcslen(pszUsername);
+    bool fUsernameKey = (pszKey == pszUsername);
+    HRESULT hr = _AppendString(pszKey, cchKey, &entry.ichKey);
+    if (SUCCEEDED(hr))
+    {
+        if (fUsernameKey)
+        {
+            entry.ichUsername = entry.ichKey;
+        }
+        else
+        {
+            hr = _AppendString(pszUsername, cchUsername, &entry.ichUsername);
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = _AppendSecret(pszPassword, &entry.hSecret, &entry.cbSecret);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = SecretFingerprint(pszPassword, wcslen(pszPassword), &entry.ullStamp);
+    }
+    if (SUCCEEDED(hr))
+    {
+        entry.cchKey = (WORD)cchKey;
+        entry.cchUsername = (WORD)cchUsername;
+        _rgEntries[_cEntries] = entry;
+        _InsertBucket(_cEntries);
+        _cEntries++;
+        if (fUsernameKey)
+        {
+            _cUsernameKeys++;
+        }
+    }
+    return hr;
+}
+
+HRESULT AccountTable::AddAccount(PCWSTR pszUsername, PCWSTR pszPassword)
+{
+    if (!pszUsername || !*pszUsername)
+    {
+        return E_INVALIDARG;
+    }
+
+    // 解析失败（例如域控制器不可达）时以用户名为键，登录场景仍可使用；
+    // 读取完成时 ResolveUsernameKeys 再解析一次。失败计入指标，便于发现配置了无法解析的账户
+    PWSTR pszSid = nullptr;
+    BYTE rgbSid[SECURITY_MAX_SID_SIZE];
+    DWORD cbSid = sizeof(rgbSid);
+    WCHAR szDomain[256];
+    DWORD cchDomain = ARRAYSIZE(szDomain);
+    SID_NAME_USE sidNameUse;
+    if (LookupAccountNameW(nullptr, pszUsername, rgbSid, &cbSid, szDomain, &cchDomain, &sidNameUse))
+    {
+        ConvertSidToStringSidW(rgbSid, &pszSid);
+    }
+
+    HRESULT hr = AddAccountWithSid(pszSid, pszUsername, pszPassword);
+    if (!pszSid && (hr == S_OK))
+    {
+        InterlockedIncrement(&s_cUnresolvedAccounts);
+    }
+    if (pszSid)
+    {
+        LocalFree(pszSid);
+    }
+    return hr;
+}
+
+// 添加时未能解析 SID 的账户（例如域控制器当时不可达）以用户名为键，解锁场景按锁定用户的 SID 查找会错过它。
+// 读取完成时在读取线程上再解析一次，Find 只比较记录下的 SID，不在 LogonUI 线程上调用 LSA
+HRESULT AccountTable::ResolveUsernameKeys()
+{
+    if (!_cUsernameKeys || _rgAliases)
+    {
+        return S_OK;
+    }
+
+    _rgAliases = (ACCOUNT_SID_ALIAS*)CoTaskMemAlloc(_cUsernameKeys * sizeof(ACCOUNT_SID_ALIAS));
+    if (!_rgAliases)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = S_OK;
+    for (DWORD i = 0; (i < _cEntries) && SUCCEEDED(hr); i++)
+    {
+        const ACCOUNT_ENTRY& entry = _rgEntries[i];
+        if (entry.ichKey != entry.ichUsername)
+        {
+            continue;
+        }
+
+        // ".\用户名" 表示本机账户，不带域的名称由 LookupAccountNameW 先在本机查找
+        PCWSTR pszUsername = _pszStrings + entry.ichUsername;
+        if ((pszUsername[0] == L'.') && (pszUsername[1] == L'\\'))
+        {
+            pszUsername += 2;
+        }
+
+        BYTE rgbSid[SECURITY_MAX_SID_SIZE];
+        DWORD cbSid = sizeof(rgbSid);
+        WCHAR szDomain[256];
+        DWORD cchDomain = ARRAYSIZE(szDomain);
+        SID_NAME_USE sidNameUse;
+        PWSTR pszSid = nullptr;
+        if (!LookupAccountNameW(nullptr, pszUsername, rgbSid, &cbSid, szDomain, &cchDomain, &sidNameUse) ||
+            !ConvertSidToStringSidW(rgbSid, &pszSid))
+        {
+            continue;
+        }
+
+        // 已有以该 SID 为键（或先解析出该 SID）的账户时先添加者优先
+        size_t cchSid = wcslen(pszSid);
+        DWORD dwExisting = 0;
+        if (FAILED(_FindKey(pszSid, cchSid, &dwExisting)) && FAILED(_FindAlias(pszSid, cchSid, &dwExisting)))
+        {
+            ACCOUNT_SID_ALIAS alias = { 0 };
+            hr = _AppendString(pszSid, cchSid, &alias.ichSid);
+            if (SUCCEEDED(hr))
+            {
+                alias.cchSid = (WORD)cchSid;
+                alias.dwIndex = i;
+                _rgAliases[_cAliases++] = alias;
+            }
+        }
+        LocalFree(pszSid);
+    }
+    return hr;
+}
+
+HRESULT AccountTable::UnsealPassword(DWORD dwIndex, SecretString* pPassword) const
+{
+    pPassword->Free();
+    if (dwIndex >= _cEntries)
+    {
+        return E_INVALIDARG;
+    }
+
+    // 加密块已包含结尾 NUL，缓冲区恰好为一个加密块大小
+    const ACCOUNT_ENTRY& entry = _rgEntries[dwIndex];
+    HRESULT hr = pPassword->Allocate(entry.cbSecret / sizeof(WCHAR) - 1);
+    if (SUCCEEDED(hr))
+    {
+        CopyMemory(pPassword->Get(), _pbSecrets + entry.hSecret, entry.cbSecret);
+        if (CryptUnprotectMemory(pPassword->Get(), entry.cbSecret, CRYPTPROTECTMEMORY_SAME_PROCESS))
+        {
+            pPassword->UpdateLength();
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            pPassword->Free();
+        }
+    }
+    return hr;
+}
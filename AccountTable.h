@@ -0,0 +1,91 @@
+#pragma once
+
+#include "pch.h"
+#include "SecretArena.h"
+
+// 账户表条目，所有字段都是偏移量，不持有指针
+struct ACCOUNT_ENTRY
+{
+    DWORD ichKey;           // 账户键（SID 字符串，无法解析 SID 时为用户名）在字符缓冲区中的偏移
+    DWORD ichUsername;      // 用户名在字符缓冲区中的偏移；以用户名为键时与 ichKey 相同
+    WORD cchKey;
+    WORD cchUsername;
+    DWORD hSecret;          // 密封密码句柄：加密块在密文缓冲区中的偏移
+    DWORD cbSecret;         // 加密块大小（CRYPTPROTECTMEMORY_BLOCK_SIZE 的倍数）
+    ULONGLONG ullStamp;     // 密码指纹（SecretFingerprint），密码变化时随之变化
+};
+
+// 以用户名为键的条目在 ResolveUsernameKeys 中解析出的 SID
+struct ACCOUNT_SID_ALIAS
+{
+    DWORD ichSid;           // SID 字符串在字符缓冲区中的偏移
+    WORD cchSid;
+    DWORD dwIndex;          // 对应的条目序号
+};
+
+// 自动解锁账户表
+// 所有账户的键和用户名依次存放在一块连续的字符缓冲区中（均以 NUL 结尾，可直接返回视图），
+// 密码经 CryptProtectMemory 加密后存放在另一块连续缓冲区中，条目只保存偏移量。
+// 按账户键查找使用开放寻址哈希表，为 O(1)。
+class AccountTable
+{
+public:
+    AccountTable();
+    ~AccountTable();
+
+    // 添加账户，通过 LookupAccountNameW 解析 SID；键已存在时忽略（先添加者优先）。
+    // 解析失败（例如域控制器不可达）时以用户名为键照常添加，登录场景仍可使用，并计入 GetUnresolvedAccounts
+    HRESULT AddAccount(PCWSTR pszUsername, PCWSTR pszPassword);
+
+    // 添加账户，SID 由调用方提供（pszSid 为 nullptr 或空串时以用户名为键）
+    HRESULT AddAccountWithSid(PCWSTR pszSid, PCWSTR pszUsername, PCWSTR pszPassword);
+
+    // 全部账户添加完成后在读取线程上调用一次：对以用户名为键的账户再通过 LookupAccountNameW 解析 SID，
+    // 记录 SID → 条目的映射，解锁场景按锁定用户的 SID 即可找到它们。仍无法解析的账户只能按用户名查找
+    HRESULT ResolveUsernameKeys();
+
+    DWORD GetCount() const { return _cEntries; }
+
+    // 返回指向内部缓冲区的视图，生命周期与账户表相同
+    PCWSTR GetKey(DWORD dwIndex) const { return _pszStrings + _rgEntries[dwIndex].ichKey; }
+    PCWSTR GetUsername(DWORD dwIndex) const { return _pszStrings + _rgEntries[dwIndex].ichUsername; }
+    ULONGLONG GetStamp(DWORD dwIndex) const { return _rgEntries[dwIndex].ullStamp; }
+
+    // 按账户键查找，未找到返回 HRESULT_FROM_WIN32(ERROR_NOT_FOUND)。
+    // 键未命中时再查 ResolveUsernameKeys 记录的 SID 映射；不调用 LSA，可在 LogonUI 线程上调用
+    HRESULT Find(PCWSTR pszKey, DWORD* pdwIndex) const;
+
+    // 进程内所有账户表因 SID 解析失败而以用户名为键的账户累计数
+    static LONG GetUnresolvedAccounts();
+
+    // 解密密码到机密字符串中
+    HRESULT UnsealPassword(DWORD dwIndex, SecretString* pPassword) const;
+
+private:
+    HRESULT _FindKey(PCWSTR pszKey, size_t cchKey, DWORD* pdwIndex) const;
+    HRESULT _FindAlias(PCWSTR pszSid, size_t cchSid, DWORD* pdwIndex) const;
+    HRESULT _AppendString(PCWSTR psz, size_t cch, DWORD* pich);
+    HRESULT _AppendSecret(PCWSTR pszPassword, DWORD* phSecret, DWORD* pcbSecret);
+    HRESULT _GrowBuckets();
+    void _InsertBucket(DWORD dwIndex);
+    static DWORD _Hash(PCWSTR psz, size_t cch);
+
+    ACCOUNT_ENTRY* _rgEntries;
+    DWORD _cEntries;
+    DWORD _cEntriesMax;
+    DWORD _cUsernameKeys;   // 以用户名为键的条目数，为 0 时 ResolveUsernameKeys 无事可做
+
+    ACCOUNT_SID_ALIAS* _rgAliases;  // 条目很少，逐个比较
+    DWORD _cAliases;
+
+    PWSTR _pszStrings;
+    DWORD _cchStrings;
+    DWORD _cchStringsMax;
+
+    BYTE* _pbSecrets;
+    DWORD _cbSecrets;
+    DWORD _cbSecretsMax;
+
+    DWORD* _rgdwBuckets;    // 条目序号 + 1，0 表示空槽
+    DWORD _cBuckets;        // 2 的幂
+};
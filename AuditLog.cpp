@@ -0,0 +1,422 @@
+#include "pch.h"
+#include "AuditLog.h"
+#include "ConfigFormat.h"
+#include "ConfigFile.h"
+#include <sddl.h>
+
+// 队列槽位：llSequence 等于位置时空闲，等于位置 + 1 时已写入待读取，
+// 读取后设为位置 + AUDIT_QUEUE_SIZE，留给下一轮的生产者
+struct AUDIT_SLOT
+{
+    volatile LONG64 llSequence;
+    AUDIT_RECORD record;
+};
+
+volatile LONG g_fAuditEnabled = FALSE;
+
+static AUDIT_SLOT g_rgAuditSlots[AUDIT_QUEUE_SIZE];
+static volatile LONG64 g_llAuditTail = 0;           // 生产者竞争的写入位置，同时是已入队的总数
+static LONG64 g_llAuditHead = 0;                    // 只由持有 g_auditWriterLock 的写入方访问
+static volatile LONG64 g_cAuditDropped = 0;         // 尚未写入 AUDIT_KIND_DROPPED 记录的丢弃数
+static volatile LONG64 g_cAuditDroppedReported = 0;
+static volatile LONG64 g_cAuditWritten = 0;
+static volatile LONG64 g_cAuditBatches = 0;
+static volatile LONG g_fAuditWakePending = FALSE;
+static volatile LONG g_fAuditInitialized = FALSE;
+static volatile LONG g_fAuditStarted = FALSE;
+
+static SRWLOCK g_auditWriterLock = SRWLOCK_INIT;
+static AUDIT_RECORD g_rgAuditBatch[AUDIT_QUEUE_SIZE + 1];  // 多一条留给 AUDIT_KIND_DROPPED
+static HANDLE g_hAuditEvent = nullptr;
+static HANDLE g_hAuditWait = nullptr;
+static WCHAR g_szAuditPath[MAX_PATH];
+static WCHAR g_szAuditStem[MAX_PATH];               // 去掉扩展名的路径，用于轮转文件名
+static LONGLONG g_llAuditFrequency = 1;
+static DWORD g_dwAuditSessionId = 0;
+
+static DWORD QpcToMicroseconds(LONGLONG llBegin, LONGLONG llEnd)
+{
+    if (!llBegin || (llEnd <= llBegin))
+    {
+        return 0;
+    }
+    ULONGLONG ullUs = (ULONGLONG)(llEnd - llBegin) * 1000000 / g_llAuditFrequency;
+    return (ullUs > MAXDWORD) ? MAXDWORD : (DWORD)ullUs;
+}
+
+static void FillAuditRecord(AUDIT_RECORD* pRecord, WORD wKind)
+{
+    ZeroMemory(pRecord, sizeof(*pRecord));
+    FILETIME ft;
+    GetSystemTimePreciseAsFileTime(&ft);
+    pRecord->wKind = wKind;
+    pRecord->ullTime = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    pRecord->dwProcessId = GetCurrentProcessId();
+    pRecord->dwSessionId = g_dwAuditSessionId;
+    pRecord->dwThreadId = GetCurrentThreadId();
+}
+
+bool AuditLogRecordResult(DWORD dwScenario, PCWSTR pszAccount, NTSTATUS ntsStatus, NTSTATUS ntsSubstatus,
+    LONGLONG llCreated, LONGLONG llSerialized, LONGLONG llReported)
+{
+    if (!g_fAuditEnabled)
+    {
+        return false;
+    }
+
+    // 认领一个空闲槽位；槽位仍待读取说明队列已满，直接丢弃而不是等待写入方
+    LONG64 llPos = ReadAcquire64(&g_llAuditTail);
+    AUDIT_SLOT* pSlot;
+    for (;;)
+    {
+        pSlot = &g_rgAuditSlots[llPos & (AUDIT_QUEUE_SIZE - 1)];
+        LONG64 llDiff = ReadAcquire64(&pSlot->llSequence) - llPos;
+        if (llDiff == 0)
+        {
+            LONG64 llPrev = InterlockedCompareExchange64(&g_llAuditTail, llPos + 1, llPos);
+            if (llPrev == llPos)
+            {
+                break;
+            }
+            llPos = llPrev;
+        }
+        else if (llDiff < 0)
+        {
+            InterlockedIncrement64(&g_cAuditDropped);
+            return false;
+        }
+        else
+        {
+            llPos = ReadAcquire64(&g_llAuditTail);
+        }
+    }
+
+    AUDIT_RECORD* pRecord = &pSlot->record;
+    FillAuditRecord(pRecord, AUDIT_KIND_RESULT);
+    pRecord->wScenario = (WORD)dwScenario;
+    pRecord->ullSequence = (ULONGLONG)llPos + 1;
+    pRecord->ntsStatus = ntsStatus;
+    pRecord->ntsSubstatus = ntsSubstatus;
+    pRecord->dwSerializeUs = QpcToMicroseconds(llCreated, llSerialized);
+    pRecord->dwLogonUs = QpcToMicroseconds(llSerialized, llReported);
+    if (pszAccount)
+    {
+        // 超长时截断，结果总以 NUL 结尾
+        StringCchCopyW(pRecord->szAccount, ARRAYSIZE(pRecord->szAccount), pszAccount);
+    }
+    WriteRelease64(&pSlot->llSequence, llPos + 1);
+
+    // 写入方空闲时才唤醒；同一批中的其余记录不再触发系统调用
+    if (!ReadAcquire(&g_fAuditWakePending) && !InterlockedExchange(&g_fAuditWakePending, TRUE))
+    {
+        SetEvent(g_hAuditEvent);
+    }
+    return true;
+}
+
+static DWORD AuditRecordCrc(const AUDIT_RECORD* pRecord)
+{
+    return ConfigCrc32((const BYTE*)pRecord + sizeof(pRecord->dwCrc32), sizeof(*pRecord) - sizeof(pRecord->dwCrc32));
+}
+
+bool AuditRecordIsValid(const AUDIT_RECORD* pRecord)
+{
+    return (pRecord->dwCrc32 == AuditRecordCrc(pRecord)) &&
+        ((pRecord->wKind == AUDIT_KIND_RESULT) || (pRecord->wKind == AUDIT_KIND_DROPPED));
+}
+
+// 按入队顺序取出已写完的记录；遇到仍在写入的槽位即停止，留到下一批
+static DWORD DrainAuditQueue(AUDIT_RECORD* prgRecords, DWORD cMax)
+{
+    DWORD cRecords = 0;
+    while (cRecords < cMax)
+    {
+        AUDIT_SLOT* pSlot = &g_rgAuditSlots[g_llAuditHead & (AUDIT_QUEUE_SIZE - 1)];
+        if (ReadAcquire64(&pSlot->llSequence) != g_llAuditHead + 1)
+        {
+            break;
+        }
+        prgRecords[cRecords++] = pSlot->record;
+        WriteRelease64(&pSlot->llSequence, g_llAuditHead + AUDIT_QUEUE_SIZE);
+        g_llAuditHead++;
+    }
+    return cRecords;
+}
+
+// audit.log -> audit.1.log -> … -> audit.<AUDIT_FILE_KEEP>.log，最旧的一个被覆盖
+static void RotateAuditFiles()
+{
+    WCHAR szFrom[MAX_PATH];
+    WCHAR szTo[MAX_PATH];
+    for (DWORD i = AUDIT_FILE_KEEP; i >= 1; i--)
+    {
+        if (i == 1)
+        {
+            StringCchCopyW(szFrom, ARRAYSIZE(szFrom), g_szAuditPath);
+        }
+        else
+        {
+            StringCchPrintfW(szFrom, ARRAYSIZE(szFrom), L"%s.%lu.log", g_szAuditStem, i - 1);
+        }
+        if (SUCCEEDED(StringCchPrintfW(szTo, ARRAYSIZE(szTo), L"%s.%lu.log", g_szAuditStem, i)))
+        {
+            MoveFileExW(szFrom, szTo, MOVEFILE_REPLACE_EXISTING);
+        }
+    }
+}
+
+static HANDLE OpenAuditFile()
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, FALSE };
+    // 与配置文件相同：只允许 SYSTEM 和管理员访问
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(CONFIG_FILE_SDDL, SDDL_REVISION_1, &sa.lpSecurityDescriptor, nullptr))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+    HANDLE hFile = CreateFileW(g_szAuditPath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, &sa, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LocalFree(sa.lpSecurityDescriptor);
+    return hFile;
+}
+
+// 打开日志文件并定位到最后一条完整记录之后；文件已满、不是审计日志或所有者不是 SYSTEM / 管理员时先轮转
+static HRESULT OpenAuditFileForAppend(DWORD cbAppend, HANDLE* phFile)
+{
+    for (DWORD iAttempt = 0; iAttempt < 2; iAttempt++)
+    {
+        HANDLE hFile = OpenAuditFile();
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        // 普通用户抢先创建的文件：OPEN_ALWAYS 不会替换它的所有者和 DACL，改名移走后新建
+        HRESULT hrOwner = ConfigCheckFileOwner(hFile);
+        if (FAILED(hrOwner))
+        {
+            CloseHandle(hFile);
+            if (iAttempt == 0)
+            {
+                RotateAuditFiles();
+                continue;
+            }
+            return hrOwner;
+        }
+
+        LARGE_INTEGER liSize;
+        AUDIT_FILE_HEADER header = { 0 };
+        DWORD cbRead = 0;
+        if (!GetFileSizeEx(hFile, &liSize) ||
+            ((liSize.QuadPart >= (LONGLONG)sizeof(header)) && !ReadFile(hFile, &header, sizeof(header), &cbRead, nullptr)))
+        {
+            HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+            CloseHandle(hFile);
+            return hr;
+        }
+
+        HRESULT hr = S_OK;
+        LARGE_INTEGER liEnd;
+        if (liSize.QuadPart < (LONGLONG)sizeof(header))
+        {
+            // 新文件（或连文件头都没写完）
+            FILETIME ft;
+            GetSystemTimeAsFileTime(&ft);
+            header.dwMagic = AUDIT_FILE_MAGIC;
+            header.wVersion = AUDIT_FILE_VERSION;
+            header.cbRecord = sizeof(AUDIT_RECORD);
+            header.ullCreated = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+            liEnd.QuadPart = 0;
+            DWORD cbWritten = 0;
+            if (!SetFilePointerEx(hFile, liEnd, nullptr, FILE_BEGIN) || !SetEndOfFile(hFile) ||
+                !WriteFile(hFile, &header, sizeof(header), &cbWritten, nullptr))
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+            liEnd.QuadPart = sizeof(header);
+        }
+        else if ((header.dwMagic != AUDIT_FILE_MAGIC) || (header.cbRecord != sizeof(AUDIT_RECORD)) ||
+            (liSize.QuadPart + cbAppend > AUDIT_FILE_MAX_SIZE))
+        {
+            CloseHandle(hFile);
+            if (iAttempt == 0)
+            {
+                RotateAuditFiles();
+                continue;
+            }
+            return HRESULT_FROM_WIN32(ERROR_FILE_CORRUPT);
+        }
+        else
+        {
+            // 截掉上次中断时写了一半的记录，保证后续记录仍然对齐
+            liEnd.QuadPart = sizeof(header) +
+                (liSize.QuadPart - sizeof(header)) / sizeof(AUDIT_RECORD) * sizeof(AUDIT_RECORD);
+            if (!SetFilePointerEx(hFile, liEnd, nullptr, FILE_BEGIN) ||
+                ((liEnd.QuadPart != liSize.QuadPart) && !SetEndOfFile(hFile)))
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+        }
+
+        if (FAILED(hr))
+        {
+            CloseHandle(hFile);
+            return hr;
+        }
+        *phFile = hFile;
+        return S_OK;
+    }
+    return E_UNEXPECTED;
+}
+
+// 一批记录一次写入、一次 FlushFileBuffers
+static HRESULT WriteAuditBatch(AUDIT_RECORD* prgRecords, DWORD cRecords)
+{
+    for (DWORD i = 0; i < cRecords; i++)
+    {
+        prgRecords[i].dwCrc32 = AuditRecordCrc(&prgRecords[i]);
+    }
+
+    DWORD cb = cRecords * sizeof(AUDIT_RECORD);
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HRESULT hr = OpenAuditFileForAppend(cb, &hFile);
+    if (SUCCEEDED(hr))
+    {
+        DWORD cbWritten = 0;
+        if (!WriteFile(hFile, prgRecords, cb, &cbWritten, nullptr) || (cbWritten != cb) || !FlushFileBuffers(hFile))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+        CloseHandle(hFile);
+    }
+    return hr;
+}
+
+void AuditLogFlush()
+{
+    if (!g_fAuditEnabled)
+    {
+        return;
+    }
+
+    AcquireSRWLockExclusive(&g_auditWriterLock);
+    // 先清除唤醒标志再读取队列：之后入队的记录要么在本批中，要么会重新唤醒写入方
+    InterlockedExchange(&g_fAuditWakePending, FALSE);
+    for (;;)
+    {
+        DWORD cRecords = 0;
+        LONG64 cDropped = InterlockedExchange64(&g_cAuditDropped, 0);
+        if (cDropped)
+        {
+            FillAuditRecord(&g_rgAuditBatch[0], AUDIT_KIND_DROPPED);
+            g_rgAuditBatch[0].cDropped = (cDropped > MAXDWORD) ? MAXDWORD : (DWORD)cDropped;
+            cRecords = 1;
+        }
+        DWORD cResults = DrainAuditQueue(&g_rgAuditBatch[cRecords], AUDIT_QUEUE_SIZE);
+        cRecords += cResults;
+        if (!cRecords)
+        {
+            break;
+        }
+
+        if (FAILED(WriteAuditBatch(g_rgAuditBatch, cRecords)))
+        {
+            // 写入失败的记录计入丢弃数，下次写入时说明；本次不再重试，避免磁盘故障时空转
+            InterlockedExchangeAdd64(&g_cAuditDropped, cDropped + cResults);
+            break;
+        }
+        InterlockedExchangeAdd64(&g_cAuditDroppedReported, cDropped);
+        InterlockedExchangeAdd64(&g_cAuditWritten, cResults);
+        InterlockedIncrement64(&g_cAuditBatches);
+    }
+    ReleaseSRWLockExclusive(&g_auditWriterLock);
+}
+
+void AuditLogGetStats(AUDIT_STATS* pStats)
+{
+    pStats->cEnqueued = ReadAcquire64(&g_llAuditTail);
+    pStats->cDropped = ReadAcquire64(&g_cAuditDroppedReported) + ReadAcquire64(&g_cAuditDropped);
+    pStats->cWritten = ReadAcquire64(&g_cAuditWritten);
+    pStats->cBatches = ReadAcquire64(&g_cAuditBatches);
+}
+
+static void CALLBACK AuditWriteCallback(PVOID pvContext, BOOLEAN fTimedOut)
+{
+    UNREFERENCED_PARAMETER(pvContext);
+    UNREFERENCED_PARAMETER(fTimedOut);
+    AuditLogFlush();
+}
+
+HRESULT AuditLogStart(PCWSTR pszPath)
+{
+    if (InterlockedCompareExchange(&g_fAuditStarted, TRUE, FALSE))
+    {
+        return S_FALSE;
+    }
+
+    HRESULT hr = S_OK;
+    if (!ExpandEnvironmentStringsW(pszPath, g_szAuditPath, ARRAYSIZE(g_szAuditPath)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = StringCchCopyW(g_szAuditStem, ARRAYSIZE(g_szAuditStem), g_szAuditPath);
+    }
+    if (SUCCEEDED(hr))
+    {
+        PathRemoveExtensionW(g_szAuditStem);
+
+        // 确保目录存在；打开失败会在写入时报告
+        ConfigCreateParentDirectory(g_szAuditPath);
+
+        LARGE_INTEGER liFrequency;
+        QueryPerformanceFrequency(&liFrequency);
+        g_llAuditFrequency = liFrequency.QuadPart;
+        ProcessIdToSessionId(GetCurrentProcessId(), &g_dwAuditSessionId);
+        for (LONG64 i = 0; i < AUDIT_QUEUE_SIZE; i++)
+        {
+            g_rgAuditSlots[i].llSequence = i;
+        }
+
+        // 自动重置事件，由队列从空变为非空的生产者触发
+        g_hAuditEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        if (!g_hAuditEvent)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    if (SUCCEEDED(hr) &&
+        !RegisterWaitForSingleObject(&g_hAuditWait, g_hAuditEvent, AuditWriteCallback, nullptr, INFINITE, WT_EXECUTELONGFUNCTION))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+        g_hAuditWait = nullptr;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        InterlockedExchange(&g_fAuditEnabled, TRUE);
+    }
+    return hr;
+}
+
+void AuditLogInitialize()
+{
+    if (InterlockedCompareExchange(&g_fAuditInitialized, TRUE, FALSE))
+    {
+        return;
+    }
+
+    DWORD dwEnabled = 0;
+    DWORD cbEnabled = sizeof(dwEnabled);
+    if ((RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"AuditEnabled", RRF_RT_REG_DWORD, nullptr, &dwEnabled, &cbEnabled) != ERROR_SUCCESS) ||
+        !dwEnabled)
+    {
+        return;
+    }
+
+    // 写入回调在线程池中运行，开启审计时固定 DLL，避免回调期间被卸载
+    HMODULE hModule = nullptr;
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+        (LPCWSTR)&AuditLogInitialize, &hModule);
+
+    AuditLogStart(AUDIT_FILE_PATH);
+}
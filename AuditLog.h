@@ -0,0 +1,88 @@
+#pragma once
+
+#include "pch.h"
+
+// 自动解锁审计日志
+//
+// 每次 ReportResult 生成一条定长 AUDIT_RECORD，写入无锁的多生产者单消费者队列后立即返回，
+// 解锁路径上不加锁、不分配内存、不做磁盘 I/O。后台写入线程把队列中的记录成批追加到 AUDIT_FILE_PATH，
+// 每批只调用一次 FlushFileBuffers（组提交）；写入期间到达的记录归入下一批。
+// 文件超过 AUDIT_FILE_MAX_SIZE 时依次轮转为 audit.1.log … audit.<AUDIT_FILE_KEEP>.log。
+//
+// 文件格式：AUDIT_FILE_HEADER 后紧跟定长 AUDIT_RECORD，每条记录带 CRC-32，
+// 读取方跳过校验失败的记录；写了一半的尾部记录在下次追加前被截掉。
+// 队列满时丢弃新记录并计数，下一批写入时追加一条 AUDIT_KIND_DROPPED 记录说明丢弃的条数。
+// 由 HKLM\SOFTWARE\WinUnlock\AuditEnabled（DWORD）开启；tools\auditdump.cpp 过滤并导出记录。
+
+#define AUDIT_FILE_MAGIC        0x55415557      // "WUAU"
+#define AUDIT_FILE_VERSION      1
+#define AUDIT_FILE_PATH         L"%ProgramData%\\WinUnlock\\audit.log"
+#define AUDIT_FILE_MAX_SIZE     (4 * 1024 * 1024)
+#define AUDIT_FILE_KEEP         4
+
+// 队列容量，必须是 2 的幂
+#define AUDIT_QUEUE_SIZE        256
+
+#define AUDIT_ACCOUNT_CCH       64
+
+// wKind
+#define AUDIT_KIND_RESULT       1               // 一次自动提交的结果
+#define AUDIT_KIND_DROPPED      2               // 队列满时丢弃的记录数，见 cDropped
+
+struct AUDIT_FILE_HEADER
+{
+    DWORD dwMagic;
+    WORD wVersion;
+    WORD cbRecord;
+    ULONGLONG ullCreated;   // UTC FILETIME
+};
+
+struct AUDIT_RECORD
+{
+    DWORD dwCrc32;          // ConfigCrc32，覆盖本字段之后的全部内容
+    WORD wKind;
+    WORD wScenario;         // CREDENTIAL_PROVIDER_USAGE_SCENARIO
+    ULONGLONG ullSequence;  // 进程内递增序号
+    ULONGLONG ullTime;      // UTC FILETIME
+    LONG ntsStatus;
+    LONG ntsSubstatus;
+    DWORD dwProcessId;
+    DWORD dwSessionId;
+    DWORD dwThreadId;
+    DWORD dwSerializeUs;    // 磁贴创建到 GetSerialization 返回凭据
+    DWORD dwLogonUs;        // GetSerialization 返回凭据到 ReportResult
+    DWORD cDropped;
+    DWORD rgdwReserved[2];
+    WCHAR szAccount[AUDIT_ACCOUNT_CCH];     // 账户键（SID 字符串或用户名），超长时截断
+};
+
+static_assert(sizeof(AUDIT_FILE_HEADER) == 16, "header layout is part of the file format");
+static_assert(sizeof(AUDIT_RECORD) == 192, "record layout is part of the file format");
+
+struct AUDIT_STATS
+{
+    LONG64 cEnqueued;
+    LONG64 cDropped;
+    LONG64 cWritten;
+    LONG64 cBatches;        // 每批一次 FlushFileBuffers
+};
+
+extern volatile LONG g_fAuditEnabled;
+
+// 读取 AuditEnabled 配置并启动写入线程，只在首次调用时生效
+void AuditLogInitialize();
+
+// 不读取配置，直接写入 pszPath（可含环境变量）；供工具测试和性能测试使用
+HRESULT AuditLogStart(PCWSTR pszPath);
+
+// 记录一次自动提交的结果，时间参数为 QueryPerformanceCounter 值；队列满时返回 false
+bool AuditLogRecordResult(DWORD dwScenario, PCWSTR pszAccount, NTSTATUS ntsStatus, NTSTATUS ntsSubstatus,
+    LONGLONG llCreated, LONGLONG llSerialized, LONGLONG llReported);
+
+// 在调用线程上写出队列中的全部记录
+void AuditLogFlush();
+
+void AuditLogGetStats(AUDIT_STATS* pStats);
+
+// 校验一条从文件读出的记录
+bool AuditRecordIsValid(const AUDIT_RECORD* pRecord);
@@ -0,0 +1,327 @@
+#include "pch.h"
+#include "ConfigFile.h"
+#include "ConfigSeal.h"
+#include <wincrypt.h>
+#include <aclapi.h>
+#include <sddl.h>
+
+#pragma comment(lib, "crypt32.lib")
+#pragma comment(lib, "advapi32.lib")
+
+// 附加熵，避免其他本机范围的 DPAPI 数据被当作配置密码解封
+static const BYTE c_rgbEntropy[] = { 'W', 'i', 'n', 'U', 'n', 'l', 'o', 'c', 'k', '.', 'C', 'o', 'n', 'f', 'i', 'g' };
+
+// 读取方正映射旧文件时改名会失败，短暂重试
+#define CONFIG_SAVE_RETRIES     10
+#define CONFIG_SAVE_RETRY_MS    50
+
+HRESULT GetConfigFilePath(PWSTR pszPath, size_t cchPath)
+{
+    DWORD cch = ExpandEnvironmentStringsW(CONFIG_FILE_PATH, pszPath, (DWORD)cchPath);
+    if (!cch)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return (cch <= cchPath) ? S_OK : HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+}
+
+// 目录已存在时不修改其 DACL，其中的文件由 ConfigCheckFileOwner 逐个检查
+HRESULT ConfigCreateParentDirectory(PCWSTR pszPath)
+{
+    WCHAR szDir[MAX_PATH];
+    HRESULT hr = StringCchCopyW(szDir, ARRAYSIZE(szDir), pszPath);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    PathRemoveFileSpecW(szDir);
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, FALSE };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(CONFIG_FILE_SDDL, SDDL_REVISION_1, &sa.lpSecurityDescriptor, nullptr))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    DWORD dwError = CreateDirectoryW(szDir, &sa) ? ERROR_SUCCESS : GetLastError();
+    LocalFree(sa.lpSecurityDescriptor);
+    return (dwError == ERROR_ALREADY_EXISTS) ? S_FALSE : HRESULT_FROM_WIN32(dwError);
+}
+
+// 与 SharedCache 的区段所有者检查相同
+HRESULT ConfigCheckFileOwner(HANDLE hFile)
+{
+    PSID pOwner = nullptr;
+    PSECURITY_DESCRIPTOR pSD = nullptr;
+    DWORD dwError = GetSecurityInfo(hFile, SE_FILE_OBJECT, OWNER_SECURITY_INFORMATION, &pOwner, nullptr, nullptr, nullptr, &pSD);
+    if (dwError != ERROR_SUCCESS)
+    {
+        return HRESULT_FROM_WIN32(dwError);
+    }
+    bool fTrusted = pOwner && (IsWellKnownSid(pOwner, WinLocalSystemSid) || IsWellKnownSid(pOwner, WinBuiltinAdministratorsSid));
+    LocalFree(pSD);
+    return fTrusted ? S_OK : HRESULT_FROM_WIN32(ERROR_INVALID_OWNER);
+}
+
+// ConfigFile
+
+ConfigFile::ConfigFile() :
+    _hFile(nullptr),
+    _hMapping(nullptr),
+    _pbView(nullptr),
+    _cbView(0)
+{
+}
+
+ConfigFile::~ConfigFile()
+{
+    Close();
+}
+
+void ConfigFile::Close()
+{
+    _view.Detach();
+    if (_pbView)
+    {
+        UnmapViewOfFile(_pbView);
+        _pbView = nullptr;
+        _cbView = 0;
+    }
+    if (_hMapping)
+    {
+        CloseHandle(_hMapping);
+        _hMapping = nullptr;
+    }
+    if (_hFile)
+    {
+        CloseHandle(_hFile);
+        _hFile = nullptr;
+    }
+}
+
+HRESULT ConfigFile::Open(PCWSTR pszPath)
+{
+    Close();
+
+    // 不共享写入：映射期间内容不会被改写，校验结果一直有效
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    _hFile = hFile;
+
+    // 本机范围的 DPAPI 任何本机进程都能密封，内容本身证明不了来源：只信任 SYSTEM 和管理员写入的文件
+    HRESULT hr = ConfigCheckFileOwner(_hFile);
+    LARGE_INTEGER liSize = { 0 };
+    if (SUCCEEDED(hr) && !GetFileSizeEx(_hFile, &liSize))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (SUCCEEDED(hr) && ((liSize.QuadPart < (LONGLONG)sizeof(CONFIG_FILE_HEADER)) || (liSize.QuadPart > CONFIG_FILE_MAX_SIZE)))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _hMapping = CreateFileMappingW(_hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!_hMapping)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        _pbView = (const BYTE*)MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (!_pbView)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = _view.Attach(_pbView, (size_t)liSize.QuadPart);
+        _cbView = (DWORD)liSize.QuadPart;
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+    return hr;
+}
+
+// 密封与解封
+
+HRESULT ConfigSealSecret(PCWSTR pszSecret, BYTE** ppbSealed, DWORD* pcbSealed)
+{
+    *ppbSealed = nullptr;
+    *pcbSealed = 0;
+
+    DATA_BLOB blobIn = { (DWORD)(wcslen(pszSecret) * sizeof(WCHAR)), (BYTE*)pszSecret };
+    DATA_BLOB blobEntropy = { sizeof(c_rgbEntropy), (BYTE*)c_rgbEntropy };
+    DATA_BLOB blobOut = { 0, nullptr };
+    if (!CryptProtectData(&blobIn, nullptr, &blobEntropy, nullptr, nullptr,
+        CRYPTPROTECT_LOCAL_MACHINE | CRYPTPROTECT_UI_FORBIDDEN, &blobOut))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    *ppbSealed = blobOut.pbData;
+    *pcbSealed = blobOut.cbData;
+    return S_OK;
+}
+
+HRESULT ConfigUnsealSecret(const BYTE* pbSealed, DWORD cbSealed, SecretString* pSecret)
+{
+    // 批量部署生成的账户以主机密钥密封
+    if (ConfigIsHostSealed(pbSealed, cbSealed))
+    {
+        BYTE rgbHostKey[CONFIG_HOST_KEY_SIZE];
+        HRESULT hr = ConfigReadHostKey(rgbHostKey);
+        if (SUCCEEDED(hr))
+        {
+            hr = ConfigHostUnseal(rgbHostKey, pbSealed, cbSealed, pSecret);
+            SecureZeroMemory(rgbHostKey, sizeof(rgbHostKey));
+        }
+        return hr;
+    }
+
+    DATA_BLOB blobIn = { cbSealed, (BYTE*)pbSealed };
+    DATA_BLOB blobEntropy = { sizeof(c_rgbEntropy), (BYTE*)c_rgbEntropy };
+    DATA_BLOB blobOut = { 0, nullptr };
+    if (!CryptUnprotectData(&blobIn, nullptr, &blobEntropy, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &blobOut))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    if (!(blobOut.cbData % sizeof(WCHAR)))
+    {
+        hr = pSecret->Assign((PCWSTR)blobOut.pbData, blobOut.cbData / sizeof(WCHAR));
+    }
+    SecureZeroMemory(blobOut.pbData, blobOut.cbData);
+    LocalFree(blobOut.pbData);
+    return hr;
+}
+
+// 保存
+
+HRESULT ConfigFileSave(PCWSTR pszPath, const BYTE* pb, DWORD cb)
+{
+    HRESULT hr = ConfigCreateParentDirectory(pszPath);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    WCHAR szTemp[MAX_PATH];
+    hr = StringCchPrintfW(szTemp, ARRAYSIZE(szTemp), L"%s.%lu.tmp", pszPath, GetCurrentProcessId());
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // 临时文件总是新建：覆盖已有文件会保留它原来的所有者和 DACL，改名后成为配置文件
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, FALSE };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(CONFIG_FILE_SDDL, SDDL_REVISION_1, &sa.lpSecurityDescriptor, nullptr))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    DeleteFileW(szTemp);
+    HANDLE hFile = CreateFileW(szTemp, GENERIC_WRITE, 0, &sa, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+    LocalFree(sa.lpSecurityDescriptor);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    DWORD cbWritten = 0;
+    if (!WriteFile(hFile, pb, cb, &cbWritten, nullptr) || (cbWritten != cb) || !FlushFileBuffers(hFile))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    CloseHandle(hFile);
+
+    // 改名是原子的：读取方看到的要么是旧文件，要么是完整的新文件
+    for (DWORD i = 0; SUCCEEDED(hr); i++)
+    {
+        if (MoveFileExW(szTemp, pszPath, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            break;
+        }
+        DWORD dwError = GetLastError();
+        if ((i + 1 < CONFIG_SAVE_RETRIES) && ((dwError == ERROR_ACCESS_DENIED) || (dwError == ERROR_SHARING_VIOLATION)))
+        {
+            Sleep(CONFIG_SAVE_RETRY_MS);
+            continue;
+        }
+        hr = HRESULT_FROM_WIN32(dwError);
+    }
+
+    if (FAILED(hr))
+    {
+        DeleteFileW(szTemp);
+    }
+    return hr;
+}
+
+extern "C" HRESULT WINAPI WinUnlockSaveConfig(PCWSTR pszUsername, PCWSTR pszPassword, BOOL fAutoUnlockEnabled)
+{
+    if (!pszUsername || !*pszUsername)
+    {
+        return E_INVALIDARG;
+    }
+
+    WCHAR szPath[MAX_PATH];
+    HRESULT hr = GetConfigFilePath(szPath, ARRAYSIZE(szPath));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ConfigBuilder builder;
+    builder.SetFlags(fAutoUnlockEnabled ? CONFIG_FLAG_AUTO_UNLOCK_ENABLED : 0);
+
+    BYTE* pbSealed = nullptr;
+    DWORD cbSealed = 0;
+    hr = ConfigSealSecret(pszPassword ? pszPassword : L"", &pbSealed, &cbSealed);
+    if (SUCCEEDED(hr))
+    {
+        hr = builder.AddAccount(pszUsername, L"", pbSealed, cbSealed);
+        LocalFree(pbSealed);
+    }
+
+    // 其余账户的密封数据原样保留，不需要解封
+    ULONGLONG ullSerial = 0;
+    ConfigFile existing;
+    if (SUCCEEDED(hr) && SUCCEEDED(existing.Open(szPath)))
+    {
+        const ConfigView& view = existing.GetView();
+        ullSerial = view.GetSerial();
+        for (DWORD i = 0; (i < view.GetAccountCount()) && SUCCEEDED(hr); i++)
+        {
+            CONFIG_ACCOUNT_VIEW account;
+            view.GetAccount(i, &account);
+            if (_wcsicmp(account.pszUsername, pszUsername) != 0)
+            {
+                hr = builder.AddAccount(account.pszUsername, account.pszSid, account.pbSealed, account.cbSealed);
+            }
+        }
+        existing.Close();
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        builder.SetSerial(ullSerial + 1);
+
+        BYTE* pb = nullptr;
+        DWORD cb = 0;
+        hr = builder.Build(&pb, &cb);
+        if (SUCCEEDED(hr))
+        {
+            hr = ConfigFileSave(szPath, pb, cb);
+            SecureZeroMemory(pb, cb);
+            CoTaskMemFree(pb);
+        }
+    }
+    return hr;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "pch.h"
+#include "ConfigFormat.h"
+#include "SecretArena.h"
+
+// 二进制配置文件默认位置
+#define CONFIG_FILE_PATH L"%ProgramData%\\WinUnlock\\config.bin"
+
+// 展开默认配置文件路径
+HRESULT GetConfigFilePath(PWSTR pszPath, size_t cchPath);
+
+// %ProgramData%\WinUnlock 目录及其中的配置、密钥、审计和跟踪文件只允许 SYSTEM 和管理员访问
+#define CONFIG_FILE_SDDL L"D:P(A;;FA;;;SY)(A;;FA;;;BA)"
+
+// 创建 pszPath 所在的目录并设置受保护的 CONFIG_FILE_SDDL；目录已存在时返回 S_FALSE
+HRESULT ConfigCreateParentDirectory(PCWSTR pszPath);
+
+// 已打开文件的所有者必须是 SYSTEM 或管理员，否则返回 HRESULT_FROM_WIN32(ERROR_INVALID_OWNER)：
+// 普通用户抢先创建的文件，其 DACL 由该用户决定，内容也不可信
+HRESULT ConfigCheckFileOwner(HANDLE hFile);
+
+// 映射的配置文件
+// Open 只读映射整个文件并一次校验，之后 GetView 返回的视图直接指向映射内存；
+// 映射期间保存方无法替换文件，调用方应在读完后尽快 Close。
+class ConfigFile
+{
+public:
+    ConfigFile();
+    ~ConfigFile();
+
+    HRESULT Open(PCWSTR pszPath);
+    void Close();
+
+    const ConfigView& GetView() const { return _view; }
+
+    // 已校验的文件原样内容，供跨会话共享缓存发布（见 SharedCache.h）
+    const BYTE* GetData() const { return _pbView; }
+    DWORD GetSize() const { return _cbView; }
+
+private:
+    HANDLE _hFile;
+    HANDLE _hMapping;
+    const BYTE* _pbView;
+    DWORD _cbView;
+    ConfigView _view;
+};
+
+// 用 DPAPI（本机范围）密封密码，结果用 LocalFree 释放
+HRESULT ConfigSealSecret(PCWSTR pszSecret, BYTE** ppbSealed, DWORD* pcbSealed);
+
+// 解封 ConfigSealSecret 或 ConfigHostSeal（见 ConfigSeal.h）的结果，后者使用本机已部署的主机密钥
+HRESULT ConfigUnsealSecret(const BYTE* pbSealed, DWORD cbSealed, SecretString* pSecret);
+
+// 原子替换配置文件：写入同目录下的临时文件后改名，文件只允许 SYSTEM 和管理员访问
+HRESULT ConfigFileSave(PCWSTR pszPath, const BYTE* pb, DWORD cb);
+
+// 供配置工具调用：以 pszUsername 替换同名账户，保留其余账户，序号加一后保存到默认位置
+extern "C" HRESULT WINAPI WinUnlockSaveConfig(PCWSTR pszUsername, PCWSTR pszPassword, BOOL fAutoUnlockEnabled);
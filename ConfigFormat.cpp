@@ -0,0 +1,445 @@
+#include "pch.h"
+#include "ConfigFormat.h"
+#include <stddef.h>
+
+// CRC-32 查表（slice-by-8），编译期生成
+struct CRC32_TABLES
+{
+    DWORD rgdw[8][256];
+};
+
+static constexpr CRC32_TABLES MakeCrc32Tables()
+{
+    CRC32_TABLES tables = {};
+    for (DWORD i = 0; i < 256; i++)
+    {
+        DWORD dw = i;
+        for (int k = 0; k < 8; k++)
+        {
+            dw = (dw >> 1) ^ ((dw & 1) ? 0xEDB88320 : 0);
+        }
+        tables.rgdw[0][i] = dw;
+    }
+    for (DWORD i = 0; i < 256; i++)
+    {
+        for (int t = 1; t < 8; t++)
+        {
+            DWORD dwPrev = tables.rgdw[t - 1][i];
+            tables.rgdw[t][i] = (dwPrev >> 8) ^ tables.rgdw[0][dwPrev & 0xff];
+        }
+    }
+    return tables;
+}
+
+static constexpr CRC32_TABLES c_crc32 = MakeCrc32Tables();
+
+DWORD ConfigCrc32(const BYTE* pb, size_t cb, DWORD dwCrc)
+{
+    const auto& t = c_crc32.rgdw;
+    dwCrc = ~dwCrc;
+    while (cb >= 8)
+    {
+        DWORD dwLo = dwCrc ^ (pb[0] | (pb[1] << 8) | (pb[2] << 16) | ((DWORD)pb[3] << 24));
+        DWORD dwHi = pb[4] | (pb[5] << 8) | (pb[6] << 16) | ((DWORD)pb[7] << 24);
+        dwCrc = t[7][dwLo & 0xff] ^ t[6][(dwLo >> 8) & 0xff] ^ t[5][(dwLo >> 16) & 0xff] ^ t[4][dwLo >> 24] ^
+                t[3][dwHi & 0xff] ^ t[2][(dwHi >> 8) & 0xff] ^ t[1][(dwHi >> 16) & 0xff] ^ t[0][dwHi >> 24];
+        pb += 8;
+        cb -= 8;
+    }
+    while (cb--)
+    {
+        dwCrc = (dwCrc >> 8) ^ t[0][(dwCrc ^ *pb++) & 0xff];
+    }
+    return ~dwCrc;
+}
+
+// 校验和覆盖的起点：cbFile 字段
+static const size_t c_ibCrcStart = offsetof(CONFIG_FILE_HEADER, cbFile);
+
+// ConfigView
+
+ConfigView::ConfigView() :
+    _pHeader(nullptr),
+    _rgRecords(nullptr),
+    _pszStrings(nullptr),
+    _pbBlobs(nullptr)
+{
+}
+
+void ConfigView::Detach()
+{
+    _pHeader = nullptr;
+    _rgRecords = nullptr;
+    _pszStrings = nullptr;
+    _pbBlobs = nullptr;
+}
+
+// 字符串位于字符串区内且恰好在 cch 处结束
+static bool IsValidString(PCWSTR pszStrings, ULONGLONG cchStrings, DWORD ich, DWORD cch)
+{
+    return ((ULONGLONG)ich + cch < cchStrings) && (pszStrings[(ULONGLONG)ich + cch] == L'\0');
+}
+
+HRESULT ConfigView::Attach(const BYTE* pb, size_t cb)
+{
+    Detach();
+    const HRESULT hrInvalid = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+    // 映射视图按页对齐；要求 8 字节对齐以便直接访问头部和记录
+    if (!pb || (((ULONG_PTR)pb) & 7) || (cb < sizeof(CONFIG_FILE_HEADER)) || (cb > CONFIG_FILE_MAX_SIZE))
+    {
+        return hrInvalid;
+    }
+
+    const CONFIG_FILE_HEADER* pHeader = (const CONFIG_FILE_HEADER*)pb;
+    if ((pHeader->dwMagic != CONFIG_FILE_MAGIC) || (pHeader->wVersion != CONFIG_FILE_VERSION) ||
+        (pHeader->cbHeader < sizeof(CONFIG_FILE_HEADER)) || (pHeader->cbHeader % 4) || (pHeader->cbFile != cb))
+    {
+        return hrInvalid;
+    }
+    if (ConfigCrc32(pb + c_ibCrcStart, cb - c_ibCrcStart) != pHeader->dwCrc32)
+    {
+        return hrInvalid;
+    }
+
+    // 各区范围（64 位运算避免溢出）
+    ULONGLONG ibRecordsEnd = pHeader->ibRecords + (ULONGLONG)pHeader->cRecords * sizeof(CONFIG_RECORD);
+    if ((pHeader->ibRecords < pHeader->cbHeader) || (pHeader->ibRecords % 4) || (ibRecordsEnd > cb) ||
+        (pHeader->cAccounts > pHeader->cRecords) ||
+        (pHeader->ibStrings % 4) || (pHeader->cbStrings % sizeof(WCHAR)) ||
+        ((ULONGLONG)pHeader->ibStrings + pHeader->cbStrings > cb) ||
+        ((ULONGLONG)pHeader->ibBlobs + pHeader->cbBlobs > cb))
+    {
+        return hrInvalid;
+    }
+
+    const CONFIG_RECORD* rgRecords = (const CONFIG_RECORD*)(pb + pHeader->ibRecords);
+    PCWSTR pszStrings = (PCWSTR)(pb + pHeader->ibStrings);
+    ULONGLONG cchStrings = pHeader->cbStrings / sizeof(WCHAR);
+    for (DWORD i = 0; i < pHeader->cRecords; i++)
+    {
+        const CONFIG_RECORD& record = rgRecords[i];
+        bool fAccount = (i < pHeader->cAccounts);
+        if (fAccount ? (record.wType != CRT_ACCOUNT) : ((record.wType != CRT_DWORD) && (record.wType != CRT_STRING)))
+        {
+            return hrInvalid;
+        }
+        if (!record.cchName || !IsValidString(pszStrings, cchStrings, record.ichName, record.cchName))
+        {
+            return hrInvalid;
+        }
+        if ((record.wType != CRT_DWORD) && !IsValidString(pszStrings, cchStrings, record.ichValue, record.cchValue))
+        {
+            return hrInvalid;
+        }
+        if (fAccount && (!record.cbBlob || ((ULONGLONG)record.ibBlob + record.cbBlob > pHeader->cbBlobs)))
+        {
+            return hrInvalid;
+        }
+    }
+
+    _pHeader = pHeader;
+    _rgRecords = rgRecords;
+    _pszStrings = pszStrings;
+    _pbBlobs = pb + pHeader->ibBlobs;
+    return S_OK;
+}
+
+void ConfigView::GetAccount(DWORD dwIndex, CONFIG_ACCOUNT_VIEW* pAccount) const
+{
+    const CONFIG_RECORD& record = _rgRecords[dwIndex];
+    pAccount->pszUsername = _String(record.ichName);
+    pAccount->pszSid = _String(record.ichValue);
+    pAccount->pbSealed = _pbBlobs + record.ibBlob;
+    pAccount->cbSealed = record.cbBlob;
+}
+
+const CONFIG_RECORD* ConfigView::_FindValue(PCWSTR pszName, WORD wType) const
+{
+    for (DWORD i = _pHeader->cAccounts; i < _pHeader->cRecords; i++)
+    {
+        if ((_rgRecords[i].wType == wType) && (_wcsicmp(_String(_rgRecords[i].ichName), pszName) == 0))
+        {
+            return &_rgRecords[i];
+        }
+    }
+    return nullptr;
+}
+
+HRESULT ConfigView::FindDword(PCWSTR pszName, DWORD* pdwValue) const
+{
+    const CONFIG_RECORD* pRecord = _FindValue(pszName, CRT_DWORD);
+    if (!pRecord)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+    *pdwValue = pRecord->dwValue;
+    return S_OK;
+}
+
+HRESULT ConfigView::FindString(PCWSTR pszName, PCWSTR* ppszValue) const
+{
+    const CONFIG_RECORD* pRecord = _FindValue(pszName, CRT_STRING);
+    if (!pRecord)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+    *ppszValue = _String(pRecord->ichValue);
+    return S_OK;
+}
+
+// ConfigBuilder
+
+ConfigBuilder::ConfigBuilder() :
+    _dwFlags(0),
+    _ullSerial(0),
+    _rgAccounts(nullptr),
+    _cAccounts(0),
+    _cAccountsMax(0),
+    _rgValues(nullptr),
+    _cValues(0),
+    _cValuesMax(0),
+    _pszStrings(nullptr),
+    _cchStrings(0),
+    _cchStringsMax(0),
+    _pbBlobs(nullptr),
+    _cbBlobs(0),
+    _cbBlobsMax(0)
+{
+}
+
+ConfigBuilder::~ConfigBuilder()
+{
+    CoTaskMemFree(_rgAccounts);
+    CoTaskMemFree(_rgValues);
+    CoTaskMemFree(_pszStrings);
+    if (_pbBlobs)
+    {
+        SecureZeroMemory(_pbBlobs, _cbBlobsMax);
+        CoTaskMemFree(_pbBlobs);
+    }
+}
+
+HRESULT ConfigBuilder::_AddRecord(CONFIG_RECORD** prgRecords, DWORD* pcRecords, DWORD* pcMax, const CONFIG_RECORD& record)
+{
+    if (*pcRecords == *pcMax)
+    {
+        DWORD cMax = *pcMax ? *pcMax * 2 : 8;
+        CONFIG_RECORD* rgRecords = (CONFIG_RECORD*)CoTaskMemRealloc(*prgRecords, cMax * sizeof(CONFIG_RECORD));
+        if (!rgRecords)
+        {
+            return E_OUTOFMEMORY;
+        }
+        *prgRecords = rgRecords;
+        *pcMax = cMax;
+    }
+    (*prgRecords)[(*pcRecords)++] = record;
+    return S_OK;
+}
+
+HRESULT ConfigBuilder::_AppendString(PCWSTR psz, DWORD* pich, DWORD* pcch)
+{
+    size_t cch = psz ? wcslen(psz) : 0;
+    if (cch >= CONFIG_FILE_MAX_SIZE / sizeof(WCHAR) - _cchStrings)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+    if (_cchStrings + cch + 1 > _cchStringsMax)
+    {
+        DWORD cchMax = max(_cchStringsMax * 2, _cchStrings + (DWORD)cch + 1);
+        cchMax = max(cchMax, (DWORD)256);
+        PWSTR pszStrings = (PWSTR)CoTaskMemRealloc(_pszStrings, cchMax * sizeof(WCHAR));
+        if (!pszStrings)
+        {
+            return E_OUTOFMEMORY;
+        }
+        _pszStrings = pszStrings;
+        _cchStringsMax = cchMax;
+    }
+    if (cch)
+    {
+        CopyMemory(_pszStrings + _cchStrings, psz, cch * sizeof(WCHAR));
+    }
+    _pszStrings[_cchStrings + cch] = L'\0';
+    *pich = _cchStrings;
+    *pcch = (DWORD)cch;
+    _cchStrings += (DWORD)cch + 1;
+    return S_OK;
+}
+
+// 不用 CoTaskMemRealloc：旧缓冲区中的密封数据需要先清零再释放
+HRESULT ConfigBuilder::_AppendBlob(const BYTE* pb, DWORD cb, DWORD* pib)
+{
+    if (cb >= CONFIG_FILE_MAX_SIZE - _cbBlobs)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+    if (_cbBlobs + cb > _cbBlobsMax)
+    {
+        DWORD cbMax = max(max(_cbBlobsMax * 2, _cbBlobs + cb), (DWORD)1024);
+        BYTE* pbBlobs = (BYTE*)CoTaskMemAlloc(cbMax);
+        if (!pbBlobs)
+        {
+            return E_OUTOFMEMORY;
+        }
+        if (_pbBlobs)
+        {
+            CopyMemory(pbBlobs, _pbBlobs, _cbBlobs);
+            SecureZeroMemory(_pbBlobs, _cbBlobsMax);
+            CoTaskMemFree(_pbBlobs);
+        }
+        _pbBlobs = pbBlobs;
+        _cbBlobsMax = cbMax;
+    }
+    CopyMemory(_pbBlobs + _cbBlobs, pb, cb);
+    *pib = _cbBlobs;
+    _cbBlobs += cb;
+    return S_OK;
+}
+
+HRESULT ConfigBuilder::AddAccount(PCWSTR pszUsername, PCWSTR pszSid, const BYTE* pbSealed, DWORD cbSealed)
+{
+    if (!pszUsername || !*pszUsername || !pbSealed || !cbSealed)
+    {
+        return E_INVALIDARG;
+    }
+
+    CONFIG_RECORD record = { 0 };
+    record.wType = CRT_ACCOUNT;
+    HRESULT hr = _AppendString(pszUsername, &record.ichName, &record.cchName);
+    if (SUCCEEDED(hr))
+    {
+        hr = _AppendString(pszSid, &record.ichValue, &record.cchValue);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = _AppendBlob(pbSealed, cbSealed, &record.ibBlob);
+        record.cbBlob = cbSealed;
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = _AddRecord(&_rgAccounts, &_cAccounts, &_cAccountsMax, record);
+    }
+    return hr;
+}
+
+HRESULT ConfigBuilder::SetDword(PCWSTR pszName, DWORD dwValue)
+{
+    if (!pszName || !*pszName)
+    {
+        return E_INVALIDARG;
+    }
+
+    // 同名设置值只保留最后一次
+    for (DWORD i = 0; i < _cValues; i++)
+    {
+        if ((_rgValues[i].wType == CRT_DWORD) && (_wcsicmp(_pszStrings + _rgValues[i].ichName, pszName) == 0))
+        {
+            _rgValues[i].dwValue = dwValue;
+            return S_OK;
+        }
+    }
+
+    CONFIG_RECORD record = { 0 };
+    record.wType = CRT_DWORD;
+    record.dwValue = dwValue;
+    HRESULT hr = _AppendString(pszName, &record.ichName, &record.cchName);
+    if (SUCCEEDED(hr))
+    {
+        hr = _AddRecord(&_rgValues, &_cValues, &_cValuesMax, record);
+    }
+    return hr;
+}
+
+HRESULT ConfigBuilder::SetString(PCWSTR pszName, PCWSTR pszValue)
+{
+    if (!pszName || !*pszName)
+    {
+        return E_INVALIDARG;
+    }
+
+    CONFIG_RECORD record = { 0 };
+    record.wType = CRT_STRING;
+    HRESULT hr = _AppendString(pszValue, &record.ichValue, &record.cchValue);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    for (DWORD i = 0; i < _cValues; i++)
+    {
+        if ((_rgValues[i].wType == CRT_STRING) && (_wcsicmp(_pszStrings + _rgValues[i].ichName, pszName) == 0))
+        {
+            _rgValues[i].ichValue = record.ichValue;
+            _rgValues[i].cchValue = record.cchValue;
+            return S_OK;
+        }
+    }
+
+    hr = _AppendString(pszName, &record.ichName, &record.cchName);
+    if (SUCCEEDED(hr))
+    {
+        hr = _AddRecord(&_rgValues, &_cValues, &_cValuesMax, record);
+    }
+    return hr;
+}
+
+HRESULT ConfigBuilder::Build(BYTE** ppb, DWORD* pcb)
+{
+    *ppb = nullptr;
+    *pcb = 0;
+
+    DWORD cRecords = _cAccounts + _cValues;
+    ULONGLONG ibRecords = sizeof(CONFIG_FILE_HEADER);
+    ULONGLONG ibStrings = ibRecords + (ULONGLONG)cRecords * sizeof(CONFIG_RECORD);
+    ULONGLONG cbStrings = (ULONGLONG)_cchStrings * sizeof(WCHAR);
+    ULONGLONG ibBlobs = (ibStrings + cbStrings + 3) & ~3ULL;
+    ULONGLONG cbFile = ibBlobs + _cbBlobs;
+    if (cbFile > CONFIG_FILE_MAX_SIZE)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+
+    BYTE* pb = (BYTE*)CoTaskMemAlloc((SIZE_T)cbFile);
+    if (!pb)
+    {
+        return E_OUTOFMEMORY;
+    }
+    ZeroMemory(pb, (SIZE_T)cbFile);
+
+    CONFIG_FILE_HEADER* pHeader = (CONFIG_FILE_HEADER*)pb;
+    pHeader->dwMagic = CONFIG_FILE_MAGIC;
+    pHeader->wVersion = CONFIG_FILE_VERSION;
+    pHeader->cbHeader = sizeof(CONFIG_FILE_HEADER);
+    pHeader->cbFile = (DWORD)cbFile;
+    pHeader->dwFlags = _dwFlags;
+    pHeader->cRecords = cRecords;
+    pHeader->cAccounts = _cAccounts;
+    pHeader->ibRecords = (DWORD)ibRecords;
+    pHeader->ibStrings = (DWORD)ibStrings;
+    pHeader->cbStrings = (DWORD)cbStrings;
+    pHeader->ibBlobs = (DWORD)ibBlobs;
+    pHeader->cbBlobs = _cbBlobs;
+    pHeader->ullSerial = _ullSerial;
+
+    if (_cAccounts)
+    {
+        CopyMemory(pb + ibRecords, _rgAccounts, _cAccounts * sizeof(CONFIG_RECORD));
+    }
+    if (_cValues)
+    {
+        CopyMemory(pb + ibRecords + _cAccounts * sizeof(CONFIG_RECORD), _rgValues, _cValues * sizeof(CONFIG_RECORD));
+    }
+    if (cbStrings)
+    {
+        CopyMemory(pb + ibStrings, _pszStrings, (SIZE_T)cbStrings);
+    }
+    if (_cbBlobs)
+    {
+        CopyMemory(pb + ibBlobs, _pbBlobs, _cbBlobs);
+    }
+    pHeader->dwCrc32 = ConfigCrc32(pb + c_ibCrcStart, (size_t)cbFile - c_ibCrcStart);
+
+    *ppb = pb;
+    *pcb = (DWORD)cbFile;
+    return S_OK;
+}
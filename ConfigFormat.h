@@ -0,0 +1,151 @@
+#pragma once
+
+#include "pch.h"
+
+// 二进制配置格式
+//
+// 整个文件一次映射、一次遍历完成校验，之后所有字符串和密封数据都直接指向映射内存（零复制）。
+// 布局（小端，各区按 4 字节对齐）：
+//
+//   CONFIG_FILE_HEADER
+//   CONFIG_RECORD[cRecords]     前 cAccounts 条为账户，其余为设置值
+//   字符串区                    UTF-16，每个字符串以 NUL 结尾
+//   密封数据区                  DPAPI（本机范围）或主机密钥（见 ConfigSeal.h）加密的密码
+//
+// dwCrc32 覆盖从 cbFile 字段开始到文件末尾的全部内容。
+// 解析和构建只依赖内存缓冲区，文件映射和加解密见 ConfigFile.h。
+
+#define CONFIG_FILE_MAGIC       0x46435557      // "WUCF"
+#define CONFIG_FILE_VERSION     1
+#define CONFIG_FILE_MAX_SIZE    (4 * 1024 * 1024)
+
+// dwFlags
+#define CONFIG_FLAG_AUTO_UNLOCK_ENABLED 0x00000001
+
+struct CONFIG_FILE_HEADER
+{
+    DWORD dwMagic;
+    WORD wVersion;
+    WORD cbHeader;          // 读取方按此跳过后续版本追加的字段
+    DWORD dwCrc32;
+    DWORD cbFile;
+    DWORD dwFlags;
+    DWORD cRecords;
+    DWORD cAccounts;
+    DWORD ibRecords;
+    DWORD ibStrings;
+    DWORD cbStrings;
+    DWORD ibBlobs;
+    DWORD cbBlobs;
+    ULONGLONG ullSerial;    // 每次保存加一
+};
+
+enum CONFIG_RECORD_TYPE
+{
+    CRT_ACCOUNT = 1,        // szName 用户名，szValue SID（可为空），blob 密封密码
+    CRT_DWORD = 2,          // szName 名称，dwValue 值
+    CRT_STRING = 3,         // szName 名称，szValue 值
+};
+
+// 定长记录，字符串以字符为单位相对字符串区偏移，密封数据以字节为单位相对密封数据区偏移
+struct CONFIG_RECORD
+{
+    WORD wType;
+    WORD wFlags;
+    DWORD ichName;
+    DWORD cchName;
+    DWORD ichValue;
+    DWORD cchValue;
+    DWORD dwValue;
+    DWORD ibBlob;
+    DWORD cbBlob;
+};
+
+static_assert(sizeof(CONFIG_FILE_HEADER) == 56, "header layout is part of the file format");
+static_assert(sizeof(CONFIG_RECORD) == 32, "record layout is part of the file format");
+
+// 账户视图，指针指向配置缓冲区，生命周期与缓冲区相同
+struct CONFIG_ACCOUNT_VIEW
+{
+    PCWSTR pszUsername;
+    PCWSTR pszSid;          // 未配置时为空串
+    const BYTE* pbSealed;
+    DWORD cbSealed;
+};
+
+// 标准 CRC-32（IEEE 802.3，反射多项式 0xEDB88320）
+DWORD ConfigCrc32(const BYTE* pb, size_t cb, DWORD dwCrc = 0);
+
+// 只读配置视图：Attach 一次性校验全部头部、记录和偏移，成功后访问方法不再做边界检查
+class ConfigView
+{
+public:
+    ConfigView();
+
+    // 校验并附加到缓冲区（不复制），失败返回 HRESULT_FROM_WIN32(ERROR_INVALID_DATA)
+    HRESULT Attach(const BYTE* pb, size_t cb);
+    void Detach();
+
+    bool IsAttached() const { return _pHeader != nullptr; }
+    DWORD GetFlags() const { return _pHeader->dwFlags; }
+    ULONGLONG GetSerial() const { return _pHeader->ullSerial; }
+
+    DWORD GetAccountCount() const { return _pHeader->cAccounts; }
+    void GetAccount(DWORD dwIndex, CONFIG_ACCOUNT_VIEW* pAccount) const;
+
+    // 按名称查找设置值（不区分大小写），未找到返回 HRESULT_FROM_WIN32(ERROR_NOT_FOUND)
+    HRESULT FindDword(PCWSTR pszName, DWORD* pdwValue) const;
+    HRESULT FindString(PCWSTR pszName, PCWSTR* ppszValue) const;
+
+private:
+    const CONFIG_RECORD* _FindValue(PCWSTR pszName, WORD wType) const;
+    PCWSTR _String(DWORD ich) const { return _pszStrings + ich; }
+
+    const CONFIG_FILE_HEADER* _pHeader;
+    const CONFIG_RECORD* _rgRecords;
+    PCWSTR _pszStrings;
+    const BYTE* _pbBlobs;
+};
+
+// 配置构建器：收集账户和设置值，生成完整的配置文件内容
+class ConfigBuilder
+{
+public:
+    ConfigBuilder();
+    ~ConfigBuilder();
+
+    void SetFlags(DWORD dwFlags) { _dwFlags = dwFlags; }
+    void SetSerial(ULONGLONG ullSerial) { _ullSerial = ullSerial; }
+
+    // pbSealed 为已密封的密码，原样写入
+    HRESULT AddAccount(PCWSTR pszUsername, PCWSTR pszSid, const BYTE* pbSealed, DWORD cbSealed);
+    HRESULT SetDword(PCWSTR pszName, DWORD dwValue);
+    HRESULT SetString(PCWSTR pszName, PCWSTR pszValue);
+
+    // 生成文件内容，调用方用 CoTaskMemFree 释放
+    HRESULT Build(BYTE** ppb, DWORD* pcb);
+
+private:
+    HRESULT _AddRecord(CONFIG_RECORD** prgRecords, DWORD* pcRecords, DWORD* pcMax, const CONFIG_RECORD& record);
+    HRESULT _AppendString(PCWSTR psz, DWORD* pich, DWORD* pcch);
+    HRESULT _AppendBlob(const BYTE* pb, DWORD cb, DWORD* pib);
+
+    DWORD _dwFlags;
+    ULONGLONG _ullSerial;
+
+    CONFIG_RECORD* _rgAccounts;
+    DWORD _cAccounts;
+    DWORD _cAccountsMax;
+
+    CONFIG_RECORD* _rgValues;
+    DWORD _cValues;
+    DWORD _cValuesMax;
+
+    PWSTR _pszStrings;
+    DWORD _cchStrings;
+    DWORD _cchStringsMax;
+
+    BYTE* _pbBlobs;
+    DWORD _cbBlobs;
+    DWORD _cbBlobsMax;
+};
@@ -0,0 +1,260 @@
+#include "pch.h"
+#include "ConfigSeal.h"
+#include "ConfigFile.h"
+#include <bcrypt.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+// 派生标签，区分主机密钥与主密钥的其他用途
+static const BYTE c_rgbHostKeyLabel[] = { 'W', 'i', 'n', 'U', 'n', 'l', 'o', 'c', 'k', '.', 'H', 'o', 's', 't', 'K', 'e', 'y' };
+
+// 密码长度上限（字符），与注册表来源一致的合理范围
+#define CONFIG_HOST_SEAL_MAX_SECRET 1024
+
+// 算法句柄进程内共享，首次使用时打开；BCrypt 算法句柄可以被多个线程同时使用
+static INIT_ONCE s_initSeal = INIT_ONCE_STATIC_INIT;
+static BCRYPT_ALG_HANDLE s_hAesAlg = nullptr;
+static BCRYPT_ALG_HANDLE s_hHmacAlg = nullptr;
+
+static BOOL CALLBACK InitializeSeal(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(pvParameter);
+    UNREFERENCED_PARAMETER(ppvContext);
+
+    if (!BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&s_hHmacAlg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG)))
+    {
+        return FALSE;
+    }
+    if (BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&s_hAesAlg, BCRYPT_AES_ALGORITHM, nullptr, 0)))
+    {
+        if (BCRYPT_SUCCESS(BCryptSetProperty(s_hAesAlg, BCRYPT_CHAINING_MODE, (PUCHAR)BCRYPT_CHAIN_MODE_GCM, sizeof(BCRYPT_CHAIN_MODE_GCM), 0)))
+        {
+            return TRUE;
+        }
+        BCryptCloseAlgorithmProvider(s_hAesAlg, 0);
+        s_hAesAlg = nullptr;
+    }
+    BCryptCloseAlgorithmProvider(s_hHmacAlg, 0);
+    s_hHmacAlg = nullptr;
+    return FALSE;
+}
+
+static HRESULT EnsureSealInitialized()
+{
+    return InitOnceExecuteOnce(&s_initSeal, InitializeSeal, nullptr, nullptr) ? S_OK : E_FAIL;
+}
+
+bool ConfigIsHostSealed(const BYTE* pbSealed, DWORD cbSealed)
+{
+    // DPAPI 数据以版本号 1 开头，不会与标记冲突；密封数据区不保证对齐，按字节读取
+    DWORD dwMagic = 0;
+    if (cbSealed < sizeof(CONFIG_HOST_SEAL_HEADER))
+    {
+        return false;
+    }
+    CopyMemory(&dwMagic, pbSealed, sizeof(dwMagic));
+    return dwMagic == CONFIG_HOST_SEAL_MAGIC;
+}
+
+HRESULT ConfigDeriveHostKey(const BYTE* pbMasterKey, DWORD cbMasterKey, PCWSTR pszHost, BYTE* pbHostKey)
+{
+    if (cbMasterKey < CONFIG_MASTER_KEY_MIN_SIZE)
+    {
+        return E_INVALIDARG;
+    }
+
+    // 主机名不区分大小写：只折叠 ASCII 字母，结果与区域设置无关
+    WCHAR szHost[CONFIG_HOST_NAME_MAX + 1];
+    HRESULT hr = StringCchCopyW(szHost, ARRAYSIZE(szHost), pszHost);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+    DWORD cchHost = 0;
+    for (; szHost[cchHost]; cchHost++)
+    {
+        if ((szHost[cchHost] >= L'a') && (szHost[cchHost] <= L'z'))
+        {
+            szHost[cchHost] -= L'a' - L'A';
+        }
+    }
+    if (!cchHost)
+    {
+        return E_INVALIDARG;
+    }
+
+    hr = EnsureSealInitialized();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    BCRYPT_HASH_HANDLE hHash = nullptr;
+    NTSTATUS status = BCryptCreateHash(s_hHmacAlg, &hHash, nullptr, 0, (PUCHAR)pbMasterKey, cbMasterKey, 0);
+    if (BCRYPT_SUCCESS(status))
+    {
+        status = BCryptHashData(hHash, (PUCHAR)c_rgbHostKeyLabel, sizeof(c_rgbHostKeyLabel), 0);
+        if (BCRYPT_SUCCESS(status))
+        {
+            status = BCryptHashData(hHash, (PUCHAR)szHost, cchHost * sizeof(WCHAR), 0);
+        }
+        if (BCRYPT_SUCCESS(status))
+        {
+            status = BCryptFinishHash(hHash, pbHostKey, CONFIG_HOST_KEY_SIZE, 0);
+        }
+        BCryptDestroyHash(hHash);
+    }
+    return BCRYPT_SUCCESS(status) ? S_OK : HRESULT_FROM_NT(status);
+}
+
+HRESULT ConfigHostSeal(const BYTE* pbHostKey, PCWSTR pszSecret, BYTE** ppbSealed, DWORD* pcbSealed)
+{
+    *ppbSealed = nullptr;
+    *pcbSealed = 0;
+
+    size_t cchSecret = wcslen(pszSecret);
+    if (cchSecret > CONFIG_HOST_SEAL_MAX_SECRET)
+    {
+        return E_INVALIDARG;
+    }
+    HRESULT hr = EnsureSealInitialized();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    DWORD cbCipher = (DWORD)(cchSecret * sizeof(WCHAR));
+    DWORD cbSealed = sizeof(CONFIG_HOST_SEAL_HEADER) + cbCipher;
+    BYTE* pbSealed = (BYTE*)CoTaskMemAlloc(cbSealed);
+    if (!pbSealed)
+    {
+        return E_OUTOFMEMORY;
+    }
+    CONFIG_HOST_SEAL_HEADER* pHeader = (CONFIG_HOST_SEAL_HEADER*)pbSealed;
+    pHeader->dwMagic = CONFIG_HOST_SEAL_MAGIC;
+
+    // 每次密封使用新的随机数，同一主机密钥下不会重复
+    NTSTATUS status = BCryptGenRandom(nullptr, pHeader->rgbNonce, sizeof(pHeader->rgbNonce), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+    if (BCRYPT_SUCCESS(status))
+    {
+        BCRYPT_KEY_HANDLE hKey = nullptr;
+        status = BCryptGenerateSymmetricKey(s_hAesAlg, &hKey, nullptr, 0, (PUCHAR)pbHostKey, CONFIG_HOST_KEY_SIZE, 0);
+        if (BCRYPT_SUCCESS(status))
+        {
+            BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+            BCRYPT_INIT_AUTH_MODE_INFO(info);
+            info.pbNonce = pHeader->rgbNonce;
+            info.cbNonce = sizeof(pHeader->rgbNonce);
+            info.pbAuthData = (PUCHAR)&pHeader->dwMagic;
+            info.cbAuthData = sizeof(pHeader->dwMagic);
+            info.pbTag = pHeader->rgbTag;
+            info.cbTag = sizeof(pHeader->rgbTag);
+
+            ULONG cbResult = 0;
+            status = BCryptEncrypt(hKey, (PUCHAR)pszSecret, cbCipher, &info, nullptr, 0,
+                pbSealed + sizeof(CONFIG_HOST_SEAL_HEADER), cbCipher, &cbResult, 0);
+            BCryptDestroyKey(hKey);
+        }
+    }
+    if (!BCRYPT_SUCCESS(status))
+    {
+        CoTaskMemFree(pbSealed);
+        return HRESULT_FROM_NT(status);
+    }
+
+    *ppbSealed = pbSealed;
+    *pcbSealed = cbSealed;
+    return S_OK;
+}
+
+HRESULT ConfigHostUnseal(const BYTE* pbHostKey, const BYTE* pbSealed, DWORD cbSealed, SecretString* pSecret)
+{
+    if (!ConfigIsHostSealed(pbSealed, cbSealed) || ((cbSealed - sizeof(CONFIG_HOST_SEAL_HEADER)) % sizeof(WCHAR)))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    HRESULT hr = EnsureSealInitialized();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // 密封数据可能未对齐，先复制头部
+    CONFIG_HOST_SEAL_HEADER header;
+    CopyMemory(&header, pbSealed, sizeof(header));
+    DWORD cbCipher = cbSealed - sizeof(CONFIG_HOST_SEAL_HEADER);
+    hr = pSecret->Allocate(cbCipher / sizeof(WCHAR));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    BCRYPT_KEY_HANDLE hKey = nullptr;
+    NTSTATUS status = BCryptGenerateSymmetricKey(s_hAesAlg, &hKey, nullptr, 0, (PUCHAR)pbHostKey, CONFIG_HOST_KEY_SIZE, 0);
+    if (BCRYPT_SUCCESS(status))
+    {
+        BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO info;
+        BCRYPT_INIT_AUTH_MODE_INFO(info);
+        info.pbNonce = header.rgbNonce;
+        info.cbNonce = sizeof(header.rgbNonce);
+        info.pbAuthData = (PUCHAR)&header.dwMagic;
+        info.cbAuthData = sizeof(header.dwMagic);
+        info.pbTag = header.rgbTag;
+        info.cbTag = sizeof(header.rgbTag);
+
+        ULONG cbResult = 0;
+        status = BCryptDecrypt(hKey, (PUCHAR)(pbSealed + sizeof(CONFIG_HOST_SEAL_HEADER)), cbCipher, &info, nullptr, 0,
+            (PUCHAR)pSecret->Get(), cbCipher, &cbResult, 0);
+        BCryptDestroyKey(hKey);
+    }
+    if (!BCRYPT_SUCCESS(status))
+    {
+        pSecret->Free();
+        return HRESULT_FROM_NT(status);
+    }
+    pSecret->UpdateLength();
+    return S_OK;
+}
+
+HRESULT ConfigReadHostKey(BYTE* pbHostKey)
+{
+    WCHAR szPath[MAX_PATH];
+    DWORD cch = ExpandEnvironmentStringsW(CONFIG_HOST_KEY_PATH, szPath, ARRAYSIZE(szPath));
+    if (!cch || (cch > ARRAYSIZE(szPath)))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    HANDLE hFile = CreateFileW(szPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // 密钥文件只能由 SYSTEM 或管理员创建
+    HRESULT hr = ConfigCheckFileOwner(hFile);
+    if (FAILED(hr))
+    {
+        CloseHandle(hFile);
+        return hr;
+    }
+
+    LARGE_INTEGER liSize;
+    DWORD cbRead = 0;
+    if (!GetFileSizeEx(hFile, &liSize) || !ReadFile(hFile, pbHostKey, CONFIG_HOST_KEY_SIZE, &cbRead, nullptr))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if ((liSize.QuadPart != CONFIG_HOST_KEY_SIZE) || (cbRead != CONFIG_HOST_KEY_SIZE))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    CloseHandle(hFile);
+
+    if (FAILED(hr))
+    {
+        SecureZeroMemory(pbHostKey, CONFIG_HOST_KEY_SIZE);
+    }
+    return hr;
+}
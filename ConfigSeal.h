@@ -0,0 +1,49 @@
+#pragma once
+
+#include "pch.h"
+#include "SecretArena.h"
+
+// 主机密钥密封
+//
+// 批量部署时配置文件由 tools\provision.cpp 在部署机上为每台主机生成，DPAPI 无法替其他计算机加密，
+// 因此这类账户的密码改用主机密钥以 AES-256-GCM 密封：
+//
+//   主机密钥 = HMAC-SHA256(主密钥, "WinUnlock.HostKey" || 主机名（ASCII 大写，UTF-16）)
+//
+// 主密钥只保存在部署机上；主机密钥随配置文件一同部署到 CONFIG_HOST_KEY_PATH（只允许 SYSTEM 和管理员访问）。
+// 密封数据以 CONFIG_HOST_SEAL_MAGIC 开头，读取方据此区分主机密钥密封和 DPAPI 密封，
+// 两种账户可以出现在同一个配置文件中。部署工具和 DLL 使用同一份代码，格式不会分叉。
+
+#define CONFIG_HOST_KEY_PATH        L"%ProgramData%\\WinUnlock\\host.key"
+#define CONFIG_HOST_KEY_SIZE        32
+#define CONFIG_MASTER_KEY_MIN_SIZE  32
+#define CONFIG_HOST_NAME_MAX        255
+
+#define CONFIG_HOST_SEAL_MAGIC      0x53485557      // "WUHS"
+#define CONFIG_HOST_SEAL_NONCE_SIZE 12
+#define CONFIG_HOST_SEAL_TAG_SIZE   16
+
+// 密封数据头，后接与密码等长的密文（UTF-16，不含结尾 NUL）；dwMagic 同时作为附加认证数据
+struct CONFIG_HOST_SEAL_HEADER
+{
+    DWORD dwMagic;
+    BYTE rgbNonce[CONFIG_HOST_SEAL_NONCE_SIZE];
+    BYTE rgbTag[CONFIG_HOST_SEAL_TAG_SIZE];
+};
+
+static_assert(sizeof(CONFIG_HOST_SEAL_HEADER) == 32, "sealed layout is part of the file format");
+
+// 密封数据是否为主机密钥密封（否则为 DPAPI）
+bool ConfigIsHostSealed(const BYTE* pbSealed, DWORD cbSealed);
+
+// 由主密钥和主机名派生主机密钥（CONFIG_HOST_KEY_SIZE 字节）
+HRESULT ConfigDeriveHostKey(const BYTE* pbMasterKey, DWORD cbMasterKey, PCWSTR pszHost, BYTE* pbHostKey);
+
+// 以主机密钥密封密码，结果用 CoTaskMemFree 释放；可在多个线程上同时调用
+HRESULT ConfigHostSeal(const BYTE* pbHostKey, PCWSTR pszSecret, BYTE** ppbSealed, DWORD* pcbSealed);
+
+// 解封 ConfigHostSeal 的结果，密钥不符或数据被改动时返回失败
+HRESULT ConfigHostUnseal(const BYTE* pbHostKey, const BYTE* pbSealed, DWORD cbSealed, SecretString* pSecret);
+
+// 读取本机已部署的主机密钥
+HRESULT ConfigReadHostKey(BYTE* pbHostKey);
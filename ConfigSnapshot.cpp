@@ -0,0 +1,280 @@
+#include "pch.h"
+#include "ConfigSnapshot.h"
+#include "ConfigWatch.h"
+#include "CredentialCache.h"
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+
+// 读取方登记的纪元，0 表示空闲；每个槽位独占一条缓存行，读取方之间不争用
+struct DECLSPEC_CACHEALIGN CONFIG_EPOCH_SLOT
+{
+    volatile LONG64 llEpoch;
+};
+
+static CONFIG_EPOCH_SLOT g_rgEpochSlots[CONFIG_EPOCH_SLOTS];
+static DECLSPEC_CACHEALIGN volatile LONG64 g_llEpoch = 1;
+static ConfigSnapshot* volatile g_pCurrent = nullptr;
+
+// 发布锁只在替换快照和回收时使用，读取方从不等待它
+static SRWLOCK g_lockPublish = SRWLOCK_INIT;
+static ConfigSnapshot* g_pRetired = nullptr;
+static volatile LONG g_cRetired = 0;
+static volatile LONG64 g_cPublished = 0;
+static volatile LONG64 g_cReclaimed = 0;
+
+// FetchDeadlineMs（DWORD），未配置或超出范围时使用默认值
+static DWORD ReadFetchDeadline()
+{
+    DWORD dwDeadline = 0;
+    DWORD cbDeadline = sizeof(dwDeadline);
+    if ((RegGetValueW(HKEY_LOCAL_MACHINE, c_szConfigKey, L"FetchDeadlineMs", RRF_RT_REG_DWORD, nullptr, &dwDeadline, &cbDeadline) != ERROR_SUCCESS) ||
+        (dwDeadline < CREDENTIAL_FETCH_DEADLINE_MIN_MS) || (dwDeadline > CREDENTIAL_FETCH_DEADLINE_MAX_MS))
+    {
+        dwDeadline = CREDENTIAL_PREFETCH_WAIT_MS;
+    }
+    return dwDeadline;
+}
+
+ConfigSnapshot::ConfigSnapshot() :
+    _cRef(1),
+    _dwGeneration(0),
+    _dwFetchDeadlineMs(CREDENTIAL_PREFETCH_WAIT_MS),
+    _lAlive(TRUE),
+    _pNextRetired(nullptr),
+    _llRetireEpoch(0)
+{
+}
+
+ConfigSnapshot::~ConfigSnapshot()
+{
+    WriteRelease(&_lAlive, FALSE);
+}
+
+ULONG ConfigSnapshot::AddRef()
+{
+    return InterlockedIncrement(&_cRef);
+}
+
+ULONG ConfigSnapshot::Release()
+{
+    LONG cRef = InterlockedDecrement(&_cRef);
+    if (!cRef)
+    {
+        delete this;
+    }
+    return cRef;
+}
+
+HRESULT ConfigSnapshot::Create(DWORD dwGeneration, DWORD dwFetchDeadlineMs, PCWSTR pszzPolicy, ConfigSnapshot** ppSnapshot)
+{
+    *ppSnapshot = new(std::nothrow) ConfigSnapshot();
+    if (!*ppSnapshot)
+    {
+        return E_OUTOFMEMORY;
+    }
+    (*ppSnapshot)->_dwGeneration = dwGeneration;
+    (*ppSnapshot)->_dwFetchDeadlineMs = dwFetchDeadlineMs;
+    (*ppSnapshot)->_policy.Compile(pszzPolicy);
+    return S_OK;
+}
+
+// 未配置 UnlockPolicy 时不设策略；读取失败时策略拒绝所有自动解锁
+HRESULT ConfigSnapshot::Load(ConfigSnapshot** ppSnapshot)
+{
+    *ppSnapshot = nullptr;
+
+    DWORD dwGeneration = 0;
+    DWORD cbGeneration = sizeof(dwGeneration);
+    if (RegGetValueW(HKEY_LOCAL_MACHINE, c_szConfigKey, CONFIG_GENERATION_VALUE, RRF_RT_REG_DWORD, nullptr, &dwGeneration, &cbGeneration) != ERROR_SUCCESS)
+    {
+        dwGeneration = 0;
+    }
+
+    PCWSTR pszzPolicy = nullptr;
+    PWSTR pszzBuffer = nullptr;
+    DWORD cbPolicy = 0;
+    LSTATUS ls = RegGetValueW(HKEY_LOCAL_MACHINE, c_szConfigKey, L"UnlockPolicy", RRF_RT_REG_MULTI_SZ, nullptr, nullptr, &cbPolicy);
+    if ((ls == ERROR_SUCCESS) && (cbPolicy >= 2 * sizeof(WCHAR)))
+    {
+        pszzPolicy = L"default deny\0";
+        pszzBuffer = (PWSTR)CoTaskMemAlloc(cbPolicy + 2 * sizeof(WCHAR));
+        if (pszzBuffer)
+        {
+            ZeroMemory(pszzBuffer, cbPolicy + 2 * sizeof(WCHAR));
+            if (RegGetValueW(HKEY_LOCAL_MACHINE, c_szConfigKey, L"UnlockPolicy", RRF_RT_REG_MULTI_SZ, nullptr, pszzBuffer, &cbPolicy) == ERROR_SUCCESS)
+            {
+                pszzPolicy = pszzBuffer;
+            }
+        }
+    }
+
+    HRESULT hr = Create(dwGeneration, ReadFetchDeadline(), pszzPolicy, ppSnapshot);
+    CoTaskMemFree(pszzBuffer);
+    return hr;
+}
+
+// 释放回收队列中纪元不晚于所有在读线程的快照。
+// 读取方先登记纪元再读取指针，发布方先替换指针再增加纪元：
+// 登记的纪元不小于 _llRetireEpoch 的读取方一定读到的是替换后的指针
+void ConfigSnapshot::_Reclaim()
+{
+    LONG64 llMinEpoch = MAXLONG64;
+    for (DWORD i = 0; i < CONFIG_EPOCH_SLOTS; i++)
+    {
+        LONG64 llEpoch = ReadAcquire64(&g_rgEpochSlots[i].llEpoch);
+        if (llEpoch && (llEpoch < llMinEpoch))
+        {
+            llMinEpoch = llEpoch;
+        }
+    }
+
+    ConfigSnapshot** ppLink = &g_pRetired;
+    while (*ppLink)
+    {
+        ConfigSnapshot* pSnapshot = *ppLink;
+        if (pSnapshot->_llRetireEpoch <= llMinEpoch)
+        {
+            *ppLink = pSnapshot->_pNextRetired;
+            InterlockedDecrement(&g_cRetired);
+            InterlockedIncrement64(&g_cReclaimed);
+            pSnapshot->Release();
+        }
+        else
+        {
+            ppLink = &pSnapshot->_pNextRetired;
+        }
+    }
+}
+
+// 按线程号选起始槽位，减少不同线程争用同一槽位
+ConfigReadScope::ConfigReadScope()
+{
+    _dwSlot = (GetCurrentThreadId() >> 2) % CONFIG_EPOCH_SLOTS;
+    for (DWORD cProbes = 1; ; cProbes++)
+    {
+        LONG64 llEpoch = ReadAcquire64(&g_llEpoch);
+        if (InterlockedCompareExchange64(&g_rgEpochSlots[_dwSlot].llEpoch, llEpoch, 0) == 0)
+        {
+            break;
+        }
+        _dwSlot = (_dwSlot + 1) % CONFIG_EPOCH_SLOTS;
+        if (!(cProbes % CONFIG_EPOCH_SLOTS))
+        {
+            YieldProcessor();
+        }
+    }
+}
+
+// 离开时顺便回收；拿不到发布锁说明发布方正在回收，直接返回，读取方不等待
+ConfigReadScope::~ConfigReadScope()
+{
+    WriteRelease64(&g_rgEpochSlots[_dwSlot].llEpoch, 0);
+    if (ReadAcquire(&g_cRetired) && TryAcquireSRWLockExclusive(&g_lockPublish))
+    {
+        ConfigSnapshot::_Reclaim();
+        ReleaseSRWLockExclusive(&g_lockPublish);
+    }
+}
+
+const ConfigSnapshot* ConfigReadScope::Get()
+{
+    ConfigSnapshot* pSnapshot = (ConfigSnapshot*)ReadPointerAcquire((PVOID volatile*)&g_pCurrent);
+    if (!pSnapshot)
+    {
+        // 首次使用：加载后只在仍为空时发布，落后的一方丢弃自己的快照
+        ConfigSnapshot* pLoaded = nullptr;
+        if (FAILED(ConfigSnapshot::Load(&pLoaded)))
+        {
+            return nullptr;
+        }
+        pSnapshot = (ConfigSnapshot*)InterlockedCompareExchangePointer((PVOID volatile*)&g_pCurrent, pLoaded, nullptr);
+        if (pSnapshot)
+        {
+            pLoaded->Release();
+        }
+        else
+        {
+            InterlockedIncrement64(&g_cPublished);
+            pSnapshot = pLoaded;
+        }
+    }
+    return pSnapshot;
+}
+
+ConfigSnapshot* ConfigSnapshotAcquire()
+{
+    ConfigReadScope scope;
+    ConfigSnapshot* pSnapshot = const_cast<ConfigSnapshot*>(scope.Get());
+    if (pSnapshot)
+    {
+        pSnapshot->AddRef();
+    }
+    return pSnapshot;
+}
+
+void ConfigSnapshotPublish(ConfigSnapshot* pSnapshot)
+{
+    AcquireSRWLockExclusive(&g_lockPublish);
+    ConfigSnapshot* pOld = (ConfigSnapshot*)InterlockedExchangePointer((PVOID volatile*)&g_pCurrent, pSnapshot);
+    LONG64 llEpoch = InterlockedIncrement64(&g_llEpoch);
+    InterlockedIncrement64(&g_cPublished);
+    if (pOld)
+    {
+        pOld->_llRetireEpoch = llEpoch;
+        pOld->_pNextRetired = g_pRetired;
+        g_pRetired = pOld;
+        InterlockedIncrement(&g_cRetired);
+    }
+    ConfigSnapshot::_Reclaim();
+    ReleaseSRWLockExclusive(&g_lockPublish);
+}
+
+HRESULT ConfigSnapshotReload(bool fForce)
+{
+    ConfigSnapshot* pSnapshot = nullptr;
+    HRESULT hr = ConfigSnapshot::Load(&pSnapshot);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (!fForce)
+    {
+        ConfigReadScope scope;
+        const ConfigSnapshot* pCurrent = scope.Get();
+        if (pCurrent && (pCurrent->GetGeneration() == pSnapshot->GetGeneration()))
+        {
+            pSnapshot->Release();
+            return S_FALSE;
+        }
+    }
+
+    ConfigSnapshotPublish(pSnapshot);
+    return S_OK;
+}
+
+void ConfigSnapshotGetStats(CONFIG_SNAPSHOT_STATS* pStats)
+{
+    pStats->llEpoch = ReadAcquire64(&g_llEpoch);
+    pStats->cPublished = ReadAcquire64(&g_cPublished);
+    pStats->cReclaimed = ReadAcquire64(&g_cReclaimed);
+    pStats->cRetired = (DWORD)ReadAcquire(&g_cRetired);
+}
+
+void ConfigSnapshotCleanup()
+{
+    AcquireSRWLockExclusive(&g_lockPublish);
+    ConfigSnapshot* pCurrent = (ConfigSnapshot*)InterlockedExchangePointer((PVOID volatile*)&g_pCurrent, nullptr);
+    if (pCurrent)
+    {
+        pCurrent->Release();
+    }
+    while (g_pRetired)
+    {
+        ConfigSnapshot* pSnapshot = g_pRetired;
+        g_pRetired = pSnapshot->_pNextRetired;
+        pSnapshot->Release();
+    }
+    g_cRetired = 0;
+    ReleaseSRWLockExclusive(&g_lockPublish);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "pch.h"
+#include "UnlockPolicy.h"
+
+// 进程内共享的配置快照
+//
+// LogonUI 为每个使用场景（多会话主机上还按会话）各创建一个提供程序，它们共用同一份只读配置：
+// 快照创建后不再修改，由 ConfigSnapshotReload 在配置保存后（见 ConfigWatch.h）整体替换。
+// 读取方进入 ConfigReadScope 后用一次原子读取拿到当前快照，不加锁、不增加引用计数；
+// 替换时旧快照按纪元回收：发布新快照后全局纪元加一，旧快照等到所有读取方都离开更早的纪元后才释放。
+// 需要在作用域之外继续使用时调用 ConfigSnapshotAcquire 取得带引用计数的快照。
+
+// 读取方登记纪元的槽位数，同时进行读取的线程超过此数时后来者自旋等待空槽
+#define CONFIG_EPOCH_SLOTS  64
+
+class ConfigSnapshot
+{
+public:
+    // pszzPolicy 为 UnlockPolicy 源文本（可为 nullptr），编译失败时策略拒绝所有自动解锁
+    static HRESULT Create(DWORD dwGeneration, DWORD dwFetchDeadlineMs, PCWSTR pszzPolicy, ConfigSnapshot** ppSnapshot);
+
+    // 从 HKLM\SOFTWARE\WinUnlock 读取 Generation、FetchDeadlineMs 和 UnlockPolicy
+    static HRESULT Load(ConfigSnapshot** ppSnapshot);
+
+    ULONG AddRef();
+    ULONG Release();
+
+    DWORD GetGeneration() const { return _dwGeneration; }
+    DWORD GetFetchDeadline() const { return _dwFetchDeadlineMs; }
+    const UnlockPolicy& GetPolicy() const { return _policy; }
+
+    // 诊断：已释放的快照在此处写入 0，压力测试据此检查释放过早
+    bool IsAlive() const { return ReadAcquire(&_lAlive) != 0; }
+
+private:
+    ConfigSnapshot();
+    ~ConfigSnapshot();
+
+    // 释放已无读取方的旧快照，调用方持有发布锁
+    static void _Reclaim();
+
+    LONG _cRef;
+    DWORD _dwGeneration;
+    DWORD _dwFetchDeadlineMs;
+    UnlockPolicy _policy;
+    volatile LONG _lAlive;
+    ConfigSnapshot* _pNextRetired;  // 回收队列，只在发布锁下访问
+    LONG64 _llRetireEpoch;          // 被替换后的纪元，所有读取方的纪元都不小于它时可以释放
+
+    friend class ConfigReadScope;
+    friend void ConfigSnapshotPublish(ConfigSnapshot* pSnapshot);
+    friend void ConfigSnapshotCleanup();
+};
+
+struct CONFIG_SNAPSHOT_STATS
+{
+    LONG64 llEpoch;             // 当前全局纪元
+    LONG64 cPublished;          // 累计发布的快照数
+    LONG64 cReclaimed;          // 累计回收的旧快照数
+    DWORD cRetired;             // 已被替换、等待读取方离开的快照数
+};
+
+// 读取作用域：构造时登记当前纪元，析构时撤销；作用域内 Get 返回的快照一直有效。
+// 作用域应只覆盖一次方法调用内的读取，不可跨越等待
+class ConfigReadScope
+{
+public:
+    ConfigReadScope();
+    ~ConfigReadScope();
+
+    // 当前快照，首次使用时从注册表加载；加载失败时为使用默认值的快照，内存不足时为 nullptr
+    const ConfigSnapshot* Get();
+
+private:
+    ConfigReadScope(const ConfigReadScope&);
+    ConfigReadScope& operator=(const ConfigReadScope&);
+
+    DWORD _dwSlot;
+};
+
+// 取得当前快照并增加引用计数（调用方 Release）；内存不足时返回 nullptr
+ConfigSnapshot* ConfigSnapshotAcquire();
+
+// 发布新快照（接管调用方的引用），旧快照进入回收队列；随后回收已无读取方的旧快照
+void ConfigSnapshotPublish(ConfigSnapshot* pSnapshot);
+
+// 重新读取注册表；Generation 与当前快照相同且 fForce 为 false 时不替换并返回 S_FALSE
+HRESULT ConfigSnapshotReload(bool fForce = false);
+
+void ConfigSnapshotGetStats(CONFIG_SNAPSHOT_STATS* pStats);
+
+// DLL 卸载时释放当前快照和回收队列，调用时不应再有读取方
+void ConfigSnapshotCleanup();
@@ -0,0 +1,190 @@
+#include "pch.h"
+#include "ConfigWatch.h"
+#include "CredentialProvider.h"
+
+#ifndef REG_NOTIFY_THREAD_AGNOSTIC
+#define REG_NOTIFY_THREAD_AGNOSTIC 0x10000000L
+#endif
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+
+ConfigWatcher::ConfigWatcher() :
+    _pfnChanged(nullptr),
+    _pvContext(nullptr),
+    _dwDebounceMs(CONFIG_WATCH_DEBOUNCE_MS),
+    _hKey(nullptr),
+    _hChangeEvent(nullptr),
+    _pWait(nullptr),
+    _pTimer(nullptr),
+    _lPendingGeneration(0),
+    _lNotifiedGeneration(0)
+{
+    InitializeSRWLock(&_lock);
+}
+
+ConfigWatcher::~ConfigWatcher()
+{
+    Stop();
+    _Close();
+}
+
+void ConfigWatcher::_Close()
+{
+    if (_pWait)
+    {
+        CloseThreadpoolWait(_pWait);
+        _pWait = nullptr;
+    }
+    if (_pTimer)
+    {
+        CloseThreadpoolTimer(_pTimer);
+        _pTimer = nullptr;
+    }
+    if (_hChangeEvent)
+    {
+        CloseHandle(_hChangeEvent);
+        _hChangeEvent = nullptr;
+    }
+    if (_hKey)
+    {
+        RegCloseKey(_hKey);
+        _hKey = nullptr;
+    }
+}
+
+HRESULT ConfigWatcher::Start(PFN_CONFIG_CHANGED pfnChanged, void* pvContext, DWORD dwDebounceMs)
+{
+    if (_pfnChanged)
+    {
+        return S_FALSE;
+    }
+
+    if (!_hKey)
+    {
+        LSTATUS ls = RegOpenKeyExW(HKEY_LOCAL_MACHINE, c_szConfigKey, 0, KEY_NOTIFY | KEY_QUERY_VALUE, &_hKey);
+        if (ls != ERROR_SUCCESS)
+        {
+            _hKey = nullptr;
+            return (ls == ERROR_FILE_NOT_FOUND) ? S_FALSE : HRESULT_FROM_WIN32(ls);
+        }
+
+        _hChangeEvent = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+        TP_CALLBACK_ENVIRON env;
+        InitializeThreadpoolEnvironment(&env);
+        SetThreadpoolCallbackLibrary(&env, g_hinst);
+        _pWait = CreateThreadpoolWait(s_WaitCallback, this, &env);
+        _pTimer = CreateThreadpoolTimer(s_TimerCallback, this, &env);
+        DestroyThreadpoolEnvironment(&env);
+        if (!_hChangeEvent || !_pWait || !_pTimer)
+        {
+            HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+            _Close();
+            return hr;
+        }
+    }
+
+    DWORD dwGeneration = _ReadGeneration();
+    InterlockedExchange(&_lPendingGeneration, (LONG)dwGeneration);
+    InterlockedExchange(&_lNotifiedGeneration, (LONG)dwGeneration);
+
+    AcquireSRWLockExclusive(&_lock);
+    _pfnChanged = pfnChanged;
+    _pvContext = pvContext;
+    _dwDebounceMs = dwDebounceMs;
+    HRESULT hr = _Arm();
+    if (FAILED(hr))
+    {
+        _pfnChanged = nullptr;
+        _pvContext = nullptr;
+    }
+    ReleaseSRWLockExclusive(&_lock);
+    return hr;
+}
+
+// 先取排他锁清除回调：此后等待回调不会再重新注册，计时器回调不会再调用 pfnChanged；
+// 再撤销等待和计时器并等待正在执行的回调结束
+void ConfigWatcher::Stop()
+{
+    AcquireSRWLockExclusive(&_lock);
+    _pfnChanged = nullptr;
+    _pvContext = nullptr;
+    ReleaseSRWLockExclusive(&_lock);
+
+    if (_pWait)
+    {
+        SetThreadpoolWait(_pWait, nullptr, nullptr);
+        WaitForThreadpoolWaitCallbacks(_pWait, TRUE);
+    }
+    if (_pTimer)
+    {
+        SetThreadpoolTimer(_pTimer, nullptr, 0, 0);
+        WaitForThreadpoolTimerCallbacks(_pTimer, TRUE);
+    }
+}
+
+// 注册一次值变化通知并等待事件；通知只触发一次，每次回调都要重新注册。调用方持有 _lock
+HRESULT ConfigWatcher::_Arm()
+{
+    LSTATUS ls = RegNotifyChangeKeyValue(_hKey, FALSE, REG_NOTIFY_CHANGE_LAST_SET | REG_NOTIFY_THREAD_AGNOSTIC,
+        _hChangeEvent, TRUE);
+    if (ls != ERROR_SUCCESS)
+    {
+        return HRESULT_FROM_WIN32(ls);
+    }
+    SetThreadpoolWait(_pWait, _hChangeEvent, nullptr);
+    return S_OK;
+}
+
+// Generation 未配置时视为 0
+DWORD ConfigWatcher::_ReadGeneration()
+{
+    DWORD dwGeneration = 0;
+    DWORD cbGeneration = sizeof(dwGeneration);
+    if (RegGetValueW(_hKey, nullptr, CONFIG_GENERATION_VALUE, RRF_RT_REG_DWORD, nullptr, &dwGeneration, &cbGeneration) != ERROR_SUCCESS)
+    {
+        dwGeneration = 0;
+    }
+    return dwGeneration;
+}
+
+// 键下有值被写入（线程池线程）：先重新注册，处理期间的写入不会漏掉；
+// Generation 变化时把计时器推后到防抖期满，期间再次保存只会继续推后
+void CALLBACK ConfigWatcher::s_WaitCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_WAIT pWait, TP_WAIT_RESULT waitResult)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pWait);
+    UNREFERENCED_PARAMETER(waitResult);
+    ConfigWatcher* pWatcher = static_cast<ConfigWatcher*>(pvContext);
+
+    AcquireSRWLockShared(&pWatcher->_lock);
+    if (pWatcher->_pfnChanged && SUCCEEDED(pWatcher->_Arm()))
+    {
+        DWORD dwGeneration = pWatcher->_ReadGeneration();
+        if (InterlockedExchange(&pWatcher->_lPendingGeneration, (LONG)dwGeneration) != (LONG)dwGeneration)
+        {
+            ULARGE_INTEGER uliDue;
+            uliDue.QuadPart = (ULONGLONG)(-((LONGLONG)pWatcher->_dwDebounceMs * 10000));
+            FILETIME ftDue;
+            ftDue.dwLowDateTime = uliDue.LowPart;
+            ftDue.dwHighDateTime = uliDue.HighPart;
+            SetThreadpoolTimer(pWatcher->_pTimer, &ftDue, 0, 0);
+        }
+    }
+    ReleaseSRWLockShared(&pWatcher->_lock);
+}
+
+// 防抖期满（线程池线程）：以最新的 Generation 调用回调
+void CALLBACK ConfigWatcher::s_TimerCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_TIMER pTimer)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pTimer);
+    ConfigWatcher* pWatcher = static_cast<ConfigWatcher*>(pvContext);
+
+    AcquireSRWLockShared(&pWatcher->_lock);
+    DWORD dwGeneration = (DWORD)pWatcher->_lPendingGeneration;
+    if (pWatcher->_pfnChanged && (InterlockedExchange(&pWatcher->_lNotifiedGeneration, (LONG)dwGeneration) != (LONG)dwGeneration))
+    {
+        pWatcher->_pfnChanged(pWatcher->_pvContext, dwGeneration);
+    }
+    ReleaseSRWLockShared(&pWatcher->_lock);
+}
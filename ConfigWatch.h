@@ -0,0 +1,53 @@
+#pragma once
+
+#include <windows.h>
+
+// 配置变更通知
+//
+// 配置工具保存时先写入全部配置值，最后把 HKLM\SOFTWARE\WinUnlock\Generation（DWORD）加一。
+// 提供程序监听该键的值变化（RegNotifyChangeKeyValue + 线程池等待），只有 Generation 变化才视为一次保存，
+// 写入中途的其他值变化不会触发重新加载；连续保存在 CONFIG_WATCH_DEBOUNCE_MS 内合并为一次回调（尾沿触发）。
+// 回调在线程池线程上执行，参数为最新的 Generation。
+
+#define CONFIG_GENERATION_VALUE     L"Generation"
+#define CONFIG_WATCH_DEBOUNCE_MS    250
+
+// 配置已保存时调用，在线程池线程上执行
+typedef void (CALLBACK *PFN_CONFIG_CHANGED)(void* pvContext, DWORD dwGeneration);
+
+// 配置变更监听器，由提供程序独占持有
+class ConfigWatcher
+{
+public:
+    ConfigWatcher();
+    ~ConfigWatcher();
+
+    // 开始监听；配置键不存在时返回 S_FALSE，已在监听时返回 S_FALSE。
+    // dwDebounceMs 为 0 时每次保存立即回调
+    HRESULT Start(PFN_CONFIG_CHANGED pfnChanged, void* pvContext, DWORD dwDebounceMs = CONFIG_WATCH_DEBOUNCE_MS);
+
+    // 停止监听并清除回调，返回后不会再调用回调
+    void Stop();
+
+    // 最近一次回调（或开始监听时）的 Generation
+    DWORD GetGeneration() const { return (DWORD)_lNotifiedGeneration; }
+
+private:
+    static void CALLBACK s_WaitCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_WAIT pWait, TP_WAIT_RESULT waitResult);
+    static void CALLBACK s_TimerCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_TIMER pTimer);
+
+    HRESULT _Arm();
+    DWORD _ReadGeneration();
+    void _Close();
+
+    SRWLOCK _lock;              // 保护回调；Stop 取排他锁，回调在共享锁下调用
+    PFN_CONFIG_CHANGED _pfnChanged;
+    void* _pvContext;
+    DWORD _dwDebounceMs;
+    HKEY _hKey;
+    HANDLE _hChangeEvent;       // 自动重置事件，由 RegNotifyChangeKeyValue 触发
+    PTP_WAIT _pWait;
+    PTP_TIMER _pTimer;
+    volatile LONG _lPendingGeneration;  // 等待防抖到期的 Generation
+    volatile LONG _lNotifiedGeneration;
+};
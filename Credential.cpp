@@ -1,21 +1,63 @@
 #include "pch.h"
 #include "Credential.h"
+#include "AuditLog.h"
+#include "ConfigSnapshot.h"
+#include "CredentialProvider.h"
+#include "KerbLogonPacker.h"
+#include "LatencyTrace.h"
+#include "Metrics.h"
+#include "ResultCache.h"
+#include "SharedCache.h"
+#include "TileImage.h"
 #include <lm.h>
 #include <ntsecapi.h>
 
 #pragma comment(lib, "netapi32.lib")
 #pragma comment(lib, "secur32.lib")
 
+// 每个账户一个磁贴，空闲链表保留常见账户数即可，多出的对象仍从堆分配
+#define CREDENTIAL_POOL_MAX 16
+
+static ObjectPool<sizeof(WinUnlockCredential), CREDENTIAL_POOL_MAX> s_credentialPool;
+
+void* WinUnlockCredential::operator new(size_t cb, const std::nothrow_t&) noexcept
+{
+    return (cb == sizeof(WinUnlockCredential)) ? s_credentialPool.Alloc() : nullptr;
+}
+
+void WinUnlockCredential::operator delete(void* pv) noexcept
+{
+    s_credentialPool.Free(pv);
+}
+
+void WinUnlockCredential::operator delete(void* pv, const std::nothrow_t&) noexcept
+{
+    s_credentialPool.Free(pv);
+}
+
+void WinUnlockCredential::GetPoolStats(OBJECT_POOL_STATS* pStats)
+{
+    s_credentialPool.GetStats(pStats);
+}
+
 WinUnlockCredential::WinUnlockCredential() :
     _cRef(1),
     _cpus(CPUS_INVALID),
+    _pProvider(nullptr),
     _pcpce(nullptr),
+    _fDelivering(FALSE),
+    _pCache(nullptr),
+    _pStrings(nullptr),
+    _pSignal(nullptr),
     _pszUserSid(nullptr),
     _pszQualifiedUserName(nullptr),
-    _bAutoSubmit(false)
+    _ullSubmittedStamp(0),
+    _llCreated(0),
+    _llSerialized(0)
 {
-    ZeroMemory(_rgFieldDescriptors, sizeof(_rgFieldDescriptors));
-    ZeroMemory(_rgFieldIDs, sizeof(_rgFieldIDs));
+    // 凭据对象由 LogonUI 直接持有，也须计入 DLL 引用计数，否则提供程序释放后 DllCanUnloadNow 会过早返回 S_OK
+    DllAddRef();
+    InitializeSRWLock(&_eventsLock);
 }
 
 WinUnlockCredential::~WinUnlockCredential()
@@ -30,6 +72,17 @@ WinUnlockCredential::~WinUnlockCredential()
         CoTaskMemFree(_pszQualifiedUserName);
         _pszQualifiedUserName = nullptr;
     }
+    if (_pCache)
+    {
+        _pCache->Release();
+        _pCache = nullptr;
+    }
+    if (_pSignal)
+    {
+        _pSignal->Release();
+        _pSignal = nullptr;
+    }
+    DllRelease();
 }
 
 // IUnknown
@@ -56,131 +109,144 @@ IFACEMETHODIMP WinUnlockCredential::QueryInterface(REFIID riid, void** ppv)
     return QISearch(this, qit, riid, ppv);
 }
 
-HRESULT WinUnlockCredential::Initialize(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, const CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* rgFieldDescriptors, const FIELDID* rgFieldIDs)
+HRESULT WinUnlockCredential::Initialize(WinUnlockProvider* pProvider, CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, CredentialCache* pCache, const STRING_TABLE* pStrings, UnlockSignal* pSignal, PCWSTR pszUserSid, PCWSTR pszUserName)
 {
     HRESULT hr = S_OK;
+    AcquireSRWLockExclusive(&_eventsLock);
+    _pProvider = pProvider;
+    ReleaseSRWLockExclusive(&_eventsLock);
     _cpus = cpus;
-
-    if (rgFieldDescriptors)
+    _pStrings = pStrings;
+    if (g_fAuditEnabled)
     {
-        CopyMemory(_rgFieldDescriptors, rgFieldDescriptors, sizeof(_rgFieldDescriptors));
+        LARGE_INTEGER li;
+        QueryPerformanceCounter(&li);
+        _llCreated = li.QuadPart;
     }
 
-    if (rgFieldIDs)
+    hr = SHStrDupW(pszUserSid, &_pszUserSid);
+    if (SUCCEEDED(hr))
     {
-        CopyMemory(_rgFieldIDs, rgFieldIDs, sizeof(_rgFieldIDs));
+        hr = SHStrDupW(pszUserName, &_pszQualifiedUserName);
     }
-    else
+    if (FAILED(hr))
     {
-        // 默认字段ID映射
-        _rgFieldIDs[SFI_TILEIMAGE] = FIELDID_NONE;
-        _rgFieldIDs[SFI_LARGE_TEXT] = FIELDID_NONE;
-        _rgFieldIDs[SFI_SMALL_TEXT] = FIELDID_NONE;
-        _rgFieldIDs[SFI_SUBMIT_BUTTON] = FIELDID_NONE;
+        return hr;
     }
 
-    // 初始化字段描述符
-    _rgFieldDescriptors[SFI_TILEIMAGE].cpft = CPFT_TILE_IMAGE;
-    _rgFieldDescriptors[SFI_TILEIMAGE].dwFieldID = SFI_TILEIMAGE;
-    _rgFieldDescriptors[SFI_TILEIMAGE].pszLabel = nullptr;
-    _rgFieldDescriptors[SFI_TILEIMAGE].guidFieldType = GUID_TILE_IMAGE;
-
-    _rgFieldDescriptors[SFI_LARGE_TEXT].cpft = CPFT_LARGE_TEXT;
-    _rgFieldDescriptors[SFI_LARGE_TEXT].dwFieldID = SFI_LARGE_TEXT;
-    _rgFieldDescriptors[SFI_LARGE_TEXT].pszLabel = nullptr;
-    _rgFieldDescriptors[SFI_LARGE_TEXT].guidFieldType = GUID_LARGE_TEXT;
-
-    _rgFieldDescriptors[SFI_SMALL_TEXT].cpft = CPFT_SMALL_TEXT;
-    _rgFieldDescriptors[SFI_SMALL_TEXT].dwFieldID = SFI_SMALL_TEXT;
-    _rgFieldDescriptors[SFI_SMALL_TEXT].pszLabel = nullptr;
-    _rgFieldDescriptors[SFI_SMALL_TEXT].guidFieldType = GUID_SMALL_TEXT;
+    // 与提供程序共享凭据快照
+    if (_pCache)
+    {
+        _pCache->Release();
+    }
+    _pCache = pCache;
+    if (_pCache)
+    {
+        _pCache->AddRef();
+    }
 
-    _rgFieldDescriptors[SFI_SUBMIT_BUTTON].cpft = CPFT_SUBMIT_BUTTON;
-    _rgFieldDescriptors[SFI_SUBMIT_BUTTON].dwFieldID = SFI_SUBMIT_BUTTON;
-    _rgFieldDescriptors[SFI_SUBMIT_BUTTON].pszLabel = nullptr;
-    _rgFieldDescriptors[SFI_SUBMIT_BUTTON].guidFieldType = GUID_SUBMIT_BUTTON;
+    if (_pSignal)
+    {
+        _pSignal->Release();
+    }
+    _pSignal = pSignal;
+    if (_pSignal)
+    {
+        _pSignal->AddRef();
+    }
 
     return hr;
 }
 
+void WinUnlockCredential::DetachProvider()
+{
+    AcquireSRWLockExclusive(&_eventsLock);
+    _pProvider = nullptr;
+    ReleaseSRWLockExclusive(&_eventsLock);
+}
+
 IFACEMETHODIMP WinUnlockCredential::Advise(ICredentialProviderCredentialEvents* pcpce)
 {
-    if (_pcpce != nullptr)
+    TRACE_SCOPE(TM_CREDENTIAL_ADVISE);
+    if (pcpce)
     {
-        _pcpce->Release();
+        pcpce->AddRef();
     }
+    AcquireSRWLockExclusive(&_eventsLock);
+    ICredentialProviderCredentialEvents* pcpceOld = _pcpce;
     _pcpce = pcpce;
-    if (_pcpce != nullptr)
+    ReleaseSRWLockExclusive(&_eventsLock);
+    if (pcpceOld)
     {
-        _pcpce->AddRef();
+        pcpceOld->Release();
     }
+
+    // 未接收器期间投递的事件在此补发
+    _DeliverEvents();
     return S_OK;
 }
 
 IFACEMETHODIMP WinUnlockCredential::UnAdvise()
 {
-    if (_pcpce)
+    TRACE_SCOPE(TM_CREDENTIAL_UNADVISE);
+    AcquireSRWLockExclusive(&_eventsLock);
+    ICredentialProviderCredentialEvents* pcpceOld = _pcpce;
+    _pcpce = nullptr;
+    ReleaseSRWLockExclusive(&_eventsLock);
+    if (pcpceOld)
     {
-        _pcpce->Release();
-        _pcpce = nullptr;
+        pcpceOld->Release();
     }
     return S_OK;
 }
 
 IFACEMETHODIMP WinUnlockCredential::SetSelected(BOOL* pbAutoLogon)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_SETSELECTED);
+    METRICS_SCOPE(MH_SETSELECTED);
     *pbAutoLogon = FALSE;
 
-    // 检查是否可以自动解锁
-    PWSTR pszUsername = nullptr;
-    PWSTR pszPassword = nullptr;
-    HRESULT hr = _GetAutoUnlockCredentials(&pszUsername, &pszPassword);
-    if (SUCCEEDED(hr) && pszUsername && pszPassword)
+    // 检查是否可以自动解锁（复用快照，无需复制凭据，并参考最近的登录结果和解锁策略）；启用外部信号时还需已收到信号。
+    // 快照未在期限内就绪时转入 Fetching，由线程池线程等待结果并更新磁贴
+    HRESULT hr = CanAutoUnlock();
+    if (SUCCEEDED(hr) && (!_pSignal || _pSignal->IsPending()))
     {
-        *pbAutoLogon = TRUE;
-        _bAutoSubmit = TRUE;
+        *pbAutoLogon = _state.TransitionTo(CS_READY) || (_state.Get() == CS_READY);
     }
-
-    if (pszUsername)
+    else if (hr == E_PENDING)
     {
-        CoTaskMemFree(pszUsername);
+        _BeginFetch();
     }
-    if (pszPassword)
+    else if (!_state.Transition(CS_READY, CS_IDLE))
     {
-        CoTaskMemFree(pszPassword);
+        _state.Transition(CS_DONE, CS_IDLE);
     }
 
+    _DeliverEvents();
     return S_OK;
 }
 
 IFACEMETHODIMP WinUnlockCredential::SetDeselected()
 {
-    _bAutoSubmit = FALSE;
+    TRACE_SCOPE(TM_CREDENTIAL_SETDESELECTED);
+    CREDENTIAL_STATE previous;
+    if (_state.TransitionTo(CS_IDLE, &previous) && (previous == CS_FETCHING))
+    {
+        _events.PostFieldString(SFI_SMALL_TEXT, _pszQualifiedUserName);
+    }
+    _DeliverEvents();
     return S_OK;
 }
 
 IFACEMETHODIMP WinUnlockCredential::GetFieldState(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_STATE* pcpfs, CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE* pcpfis)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_GETFIELDSTATE);
     HRESULT hr = E_INVALIDARG;
 
     if (pcpfs && pcpfis && (dwFieldID < SFI_NUM_FIELDS))
     {
-        *pcpfs = CPFS_DISPLAY_IN_SELECTED_TILE;
-        *pcpfis = CPFIS_NONE;
-
-        switch (dwFieldID)
-        {
-        case SFI_TILEIMAGE:
-            *pcpfs = CPFS_DISPLAY_IN_BOTH;
-            break;
-        case SFI_LARGE_TEXT:
-        case SFI_SMALL_TEXT:
-            *pcpfs = CPFS_DISPLAY_IN_SELECTED_TILE;
-            break;
-        case SFI_SUBMIT_BUTTON:
-            *pcpfs = CPFS_DISPLAY_IN_SELECTED_TILE;
-            break;
-        }
+        *pcpfs = c_rgFieldTable[dwFieldID].cpfs;
+        *pcpfis = c_rgFieldTable[dwFieldID].cpfis;
         hr = S_OK;
     }
     return hr;
@@ -188,30 +254,25 @@ IFACEMETHODIMP WinUnlockCredential::GetFieldState(DWORD dwFieldID, CREDENTIAL_PR
 
 IFACEMETHODIMP WinUnlockCredential::GetStringValue(DWORD dwFieldID, LPWSTR* ppsz)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_GETSTRINGVALUE);
     HRESULT hr = E_INVALIDARG;
 
     if (ppsz && (dwFieldID < SFI_NUM_FIELDS))
     {
         *ppsz = nullptr;
-        size_t cch = 0;
-        PWSTR psz = nullptr;
 
-        switch (dwFieldID)
+        // 小字显示账户名（正在读取凭据时显示提示），其余文本来自当前语言的字符串表
+        if ((dwFieldID == SFI_SMALL_TEXT) && (_state.Get() == CS_FETCHING))
         {
-        case SFI_LARGE_TEXT:
-            hr = SHStrDupW(L"自动解锁", &psz);
-            break;
-        case SFI_SMALL_TEXT:
-            hr = SHStrDupW(L"使用预配置的凭据自动解锁系统", &psz);
-            break;
-        default:
-            hr = E_INVALIDARG;
-            break;
+            hr = StringTableCoAllocCopy(_pStrings, STR_CREDENTIALS_LOADING, ppsz);
         }
-
-        if (SUCCEEDED(hr))
+        else if ((dwFieldID == SFI_SMALL_TEXT) && _pszQualifiedUserName)
+        {
+            hr = SHStrDupW(_pszQualifiedUserName, ppsz);
+        }
+        else if (c_rgFieldTable[dwFieldID].stringId != STR_NONE)
         {
-            *ppsz = psz;
+            hr = StringTableCoAllocCopy(_pStrings, c_rgFieldTable[dwFieldID].stringId, ppsz);
         }
     }
     return hr;
@@ -219,17 +280,23 @@ IFACEMETHODIMP WinUnlockCredential::GetStringValue(DWORD dwFieldID, LPWSTR* ppsz
 
 IFACEMETHODIMP WinUnlockCredential::GetBitmapValue(DWORD dwFieldID, HBITMAP* phbmp)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_GETBITMAPVALUE);
     HRESULT hr = E_INVALIDARG;
     if (phbmp && (dwFieldID == SFI_TILEIMAGE))
     {
-        *phbmp = nullptr;
-        hr = S_OK;
+        // 未配置图像时返回空位图，LogonUI 显示默认头像
+        hr = TileImageCreateBitmap(phbmp);
+        if (hr == S_FALSE)
+        {
+            hr = S_OK;
+        }
     }
     return hr;
 }
 
 IFACEMETHODIMP WinUnlockCredential::GetCheckboxValue(DWORD dwFieldID, BOOL* pbChecked, LPWSTR* ppszLabel)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_GETCHECKBOXVALUE);
     UNREFERENCED_PARAMETER(dwFieldID);
     UNREFERENCED_PARAMETER(pbChecked);
     UNREFERENCED_PARAMETER(ppszLabel);
@@ -238,17 +305,36 @@ IFACEMETHODIMP WinUnlockCredential::GetCheckboxValue(DWORD dwFieldID, BOOL* pbCh
 
 IFACEMETHODIMP WinUnlockCredential::GetSubmitButtonValue(DWORD dwFieldID, DWORD* pdwAdjacentTo)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_GETSUBMITBUTTONVALUE);
     HRESULT hr = E_INVALIDARG;
-    if (pdwAdjacentTo && (dwFieldID == SFI_SUBMIT_BUTTON))
+    if (pdwAdjacentTo && (dwFieldID < SFI_NUM_FIELDS) && (c_rgFieldTable[dwFieldID].cpft == CPFT_SUBMIT_BUTTON))
     {
-        *pdwAdjacentTo = SFI_SMALL_TEXT;
+        *pdwAdjacentTo = c_rgFieldTable[dwFieldID].dwAdjacentTo;
         hr = S_OK;
     }
     return hr;
 }
 
+// 磁贴没有组合框字段
+IFACEMETHODIMP WinUnlockCredential::GetComboBoxValueCount(DWORD dwFieldID, DWORD* pcItems, DWORD* pdwSelectedItem)
+{
+    UNREFERENCED_PARAMETER(dwFieldID);
+    UNREFERENCED_PARAMETER(pcItems);
+    UNREFERENCED_PARAMETER(pdwSelectedItem);
+    return E_NOTIMPL;
+}
+
+IFACEMETHODIMP WinUnlockCredential::GetComboBoxValueAt(DWORD dwFieldID, DWORD dwItem, LPWSTR* ppszItem)
+{
+    UNREFERENCED_PARAMETER(dwFieldID);
+    UNREFERENCED_PARAMETER(dwItem);
+    UNREFERENCED_PARAMETER(ppszItem);
+    return E_NOTIMPL;
+}
+
 IFACEMETHODIMP WinUnlockCredential::SetStringValue(DWORD dwFieldID, LPCWSTR psz)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_SETSTRINGVALUE);
     UNREFERENCED_PARAMETER(dwFieldID);
     UNREFERENCED_PARAMETER(psz);
     return E_NOTIMPL;
@@ -256,88 +342,199 @@ IFACEMETHODIMP WinUnlockCredential::SetStringValue(DWORD dwFieldID, LPCWSTR psz)
 
 IFACEMETHODIMP WinUnlockCredential::SetCheckboxValue(DWORD dwFieldID, BOOL bChecked)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_SETCHECKBOXVALUE);
     UNREFERENCED_PARAMETER(dwFieldID);
     UNREFERENCED_PARAMETER(bChecked);
     return E_NOTIMPL;
 }
 
+IFACEMETHODIMP WinUnlockCredential::SetComboBoxSelectedValue(DWORD dwFieldID, DWORD dwSelectedItem)
+{
+    UNREFERENCED_PARAMETER(dwFieldID);
+    UNREFERENCED_PARAMETER(dwSelectedItem);
+    return E_NOTIMPL;
+}
+
 IFACEMETHODIMP WinUnlockCredential::CommandLinkClicked(DWORD dwFieldID)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_COMMANDLINKCLICKED);
     UNREFERENCED_PARAMETER(dwFieldID);
     return E_NOTIMPL;
 }
 
+// 查询 Negotiate 认证包编号，结果在进程内缓存
+static HRESULT RetrieveNegotiateAuthPackage(ULONG* pulAuthPackage)
+{
+    static ULONG s_ulAuthPackage = 0;
+    static volatile LONG s_fResolved = FALSE;
+
+    if (s_fResolved)
+    {
+        *pulAuthPackage = s_ulAuthPackage;
+        return S_OK;
+    }
+
+    HANDLE hLsa = nullptr;
+    NTSTATUS status = LsaConnectUntrusted(&hLsa);
+    HRESULT hr = HRESULT_FROM_NT(status);
+    if (SUCCEEDED(hr))
+    {
+        char szNegotiate[] = "Negotiate";
+        LSA_STRING lsaszPackageName;
+        lsaszPackageName.Buffer = szNegotiate;
+        lsaszPackageName.Length = (USHORT)(sizeof(szNegotiate) - 1);
+        lsaszPackageName.MaximumLength = (USHORT)sizeof(szNegotiate);
+
+        ULONG ulAuthPackage = 0;
+        status = LsaLookupAuthenticationPackage(hLsa, &lsaszPackageName, &ulAuthPackage);
+        hr = HRESULT_FROM_NT(status);
+        if (SUCCEEDED(hr))
+        {
+            s_ulAuthPackage = ulAuthPackage;
+            InterlockedExchange(&s_fResolved, TRUE);
+            *pulAuthPackage = ulAuthPackage;
+        }
+        LsaDeregisterLogonProcess(hLsa);
+    }
+    return hr;
+}
+
+// 外部信号尚未到达时的状态文字
+static void SetWaitingForSignal(const STRING_TABLE* pStrings, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon)
+{
+    if (ppszOptionalStatusText)
+    {
+        StringTableCoAllocCopy(pStrings, STR_WAITING_FOR_SIGNAL, ppszOptionalStatusText);
+    }
+    if (pcpsiOptionalStatusIcon)
+    {
+        *pcpsiOptionalStatusIcon = CPSI_NONE;
+    }
+}
+
 IFACEMETHODIMP WinUnlockCredential::GetSerialization(CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr, CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon)
 {
+    TRACE_SCOPE(TM_CREDENTIAL_GETSERIALIZATION);
+    METRICS_SCOPE(MH_GETSERIALIZATION);
     HRESULT hr = E_UNEXPECTED;
     *pcpgsr = CPGSR_NO_CREDENTIAL_NOT_FINISHED;
 
-    PWSTR pszUsername = nullptr;
-    PWSTR pszPassword = nullptr;
+    // 启用外部信号时每个信号只换取一次序列化，未收到信号则保持磁贴等待；
+    // 这里只检查，序列化成功后才消费，读取或打包失败时信号留给下一次提交
+    if (_pSignal && !_pSignal->IsPending())
+    {
+        SetWaitingForSignal(_pStrings, ppszOptionalStatusText, pcpsiOptionalStatusIcon);
+        return S_OK;
+    }
 
-    hr = _GetAutoUnlockCredentials(&pszUsername, &pszPassword);
-    if (SUCCEEDED(hr) && pszUsername && pszPassword)
+    // 另一次读取正在等待凭据来源时不重复提交
+    if (_state.TransitionTo(CS_SUBMITTING))
+    {
+        hr = S_OK;
+    }
+    else
     {
-        // 准备序列化凭据
-        DWORD cbUsername = (DWORD)((wcslen(pszUsername) + 1) * sizeof(WCHAR));
-        DWORD cbPassword = (DWORD)((wcslen(pszPassword) + 1) * sizeof(WCHAR));
-        DWORD cbSerialization = sizeof(KERB_INTERACTIVE_UNLOCK_LOGON) + cbUsername + cbPassword;
+        hr = (_state.Get() == CS_FETCHING) ? E_PENDING : E_UNEXPECTED;
+    }
 
-        BYTE* pbSerialization = (BYTE*)CoTaskMemAlloc(cbSerialization);
-        if (pbSerialization)
-        {
-            ZeroMemory(pbSerialization, cbSerialization);
-
-            KERB_INTERACTIVE_UNLOCK_LOGON* pkiul = (KERB_INTERACTIVE_UNLOCK_LOGON*)pbSerialization;
-            pkiul->Logon.MessageType = KerbInteractiveUnlockLogon;
-            pkiul->Logon.LogonDomainName.Length = 0;
-            pkiul->Logon.LogonDomainName.MaximumLength = 0;
-            pkiul->Logon.LogonDomainName.Buffer = nullptr;
-
-            // 设置用户名
-            BYTE* pbTemp = pbSerialization + sizeof(KERB_INTERACTIVE_UNLOCK_LOGON);
-            pkiul->Logon.UserName.Length = (USHORT)cbUsername - sizeof(WCHAR);
-            pkiul->Logon.UserName.MaximumLength = (USHORT)cbUsername;
-            pkiul->Logon.UserName.Buffer = (PWSTR)pbTemp;
-            CopyMemory(pbTemp, pszUsername, cbUsername);
-
-            // 设置密码
-            pbTemp += cbUsername;
-            pkiul->Logon.Password.Length = (USHORT)cbPassword - sizeof(WCHAR);
-            pkiul->Logon.Password.MaximumLength = (USHORT)cbPassword;
-            pkiul->Logon.Password.Buffer = (PWSTR)pbTemp;
-            CopyMemory(pbTemp, pszPassword, cbPassword);
-
-            // 填充序列化结构
-            pcpcs->clsidCredentialProvider = CLSID_WinUnlockProvider;
-            pcpcs->rgbSerialization = pbSerialization;
-            pcpcs->cbSerialization = cbSerialization;
-            pcpcs->ulAuthenticationPackage = 0; // 使用默认认证包
-
-            *pcpgsr = CPGSR_RETURN_CREDENTIAL_FINISHED;
-            hr = S_OK;
-        }
-        else
+    SecretString username;
+    SecretString password;
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _GetAutoUnlockCredentials(username, password);
+        if (hr == E_PENDING)
         {
-            hr = E_OUTOFMEMORY;
+            _BeginFetch();
+            _DeliverEvents();
         }
     }
-
-    if (pszUsername)
+    if (hr == E_PENDING)
     {
-        CoTaskMemFree(pszUsername);
+        // 凭据来源未在期限内返回：读取在后台继续，结果缓存后下次提交即可使用
+        if (ppszOptionalStatusText)
+        {
+            StringTableCoAllocCopy(_pStrings, STR_CREDENTIALS_LOADING, ppszOptionalStatusText);
+        }
+        if (pcpsiOptionalStatusIcon)
+        {
+            *pcpsiOptionalStatusIcon = CPSI_WARNING;
+        }
+        return S_OK;
     }
-    if (pszPassword)
+    if (SUCCEEDED(hr))
     {
-        CoTaskMemFree(pszPassword);
+        // 拆分 "域\用户名"；UPN（user@domain）的域为空，由 Kerberos 按后缀解析；其余未指定域时使用本机名
+        KERB_PACK_STRING domain;
+        KERB_PACK_STRING user;
+        WCHAR szComputerName[MAX_COMPUTERNAME_LENGTH + 1];
+        PCWSTR pszUsername = username.Get();
+        PCWSTR pszSeparator = wcschr(pszUsername, L'\\');
+        if (pszSeparator)
+        {
+            domain = KerbPackString(pszUsername, pszSeparator - pszUsername);
+            user = KerbPackString(pszSeparator + 1, username.Length() - (pszSeparator + 1 - pszUsername));
+        }
+        else if (wcschr(pszUsername, L'@'))
+        {
+            domain = KerbPackString(nullptr, 0);
+            user = KerbPackString(pszUsername, username.Length());
+        }
+        else
+        {
+            DWORD cchComputerName = ARRAYSIZE(szComputerName);
+            if (!GetComputerNameW(szComputerName, &cchComputerName))
+            {
+                cchComputerName = 0;
+            }
+            domain = KerbPackString(szComputerName, cchComputerName);
+            user = KerbPackString(pszUsername, username.Length());
+        }
+
+        ULONG ulAuthPackage = 0;
+        hr = RetrieveNegotiateAuthPackage(&ulAuthPackage);
+        if (SUCCEEDED(hr))
+        {
+            BYTE* pbSerialization = nullptr;
+            DWORD cbSerialization = 0;
+            hr = KerbLogonPack<KERB_INTERACTIVE_UNLOCK_LOGON>(KerbLogonMessageType(_cpus),
+                domain, user, KerbPackString(password.Get(), password.Length()), &pbSerialization, &cbSerialization);
+            if (SUCCEEDED(hr) && _pSignal && !_pSignal->Consume())
+            {
+                // 信号在读取凭据期间过期或已被另一磁贴使用：丢弃序列化，回到等待信号
+                SecureZeroMemory(pbSerialization, cbSerialization);
+                CoTaskMemFree(pbSerialization);
+                _state.Transition(CS_SUBMITTING, CS_IDLE);
+                SetWaitingForSignal(_pStrings, ppszOptionalStatusText, pcpsiOptionalStatusIcon);
+                return S_OK;
+            }
+            if (SUCCEEDED(hr))
+            {
+                // 填充序列化结构
+                pcpcs->clsidCredentialProvider = CLSID_WinUnlockProvider;
+                pcpcs->rgbSerialization = pbSerialization;
+                pcpcs->cbSerialization = cbSerialization;
+                pcpcs->ulAuthenticationPackage = ulAuthPackage;
+
+                *pcpgsr = CPGSR_RETURN_CREDENTIAL_FINISHED;
+                LatencyTraceScenarioEnd(_cpus);
+                if (g_fAuditEnabled)
+                {
+                    LARGE_INTEGER li;
+                    QueryPerformanceCounter(&li);
+                    _llSerialized = li.QuadPart;
+                }
+            }
+        }
     }
 
     if (FAILED(hr))
     {
+        _state.TransitionTo(CS_FAILED);
         *pcpgsr = CPGSR_NO_CREDENTIAL_NOT_FINISHED;
         if (ppszOptionalStatusText)
         {
-            SHStrDupW(L"无法获取自动解锁凭据", ppszOptionalStatusText);
+            StringTableCoAllocCopy(_pStrings, STR_SERIALIZATION_FAILED, ppszOptionalStatusText);
         }
         if (pcpsiOptionalStatusIcon)
         {
@@ -350,83 +547,157 @@ IFACEMETHODIMP WinUnlockCredential::GetSerialization(CREDENTIAL_PROVIDER_GET_SER
 
 IFACEMETHODIMP WinUnlockCredential::ReportResult(NTSTATUS ntsStatus, NTSTATUS ntsSubstatus, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon)
 {
-    UNREFERENCED_PARAMETER(ntsStatus);
-    UNREFERENCED_PARAMETER(ntsSubstatus);
+    TRACE_SCOPE(TM_CREDENTIAL_REPORTRESULT);
     UNREFERENCED_PARAMETER(ppszOptionalStatusText);
     UNREFERENCED_PARAMETER(pcpsiOptionalStatusIcon);
+
+    // 记录本次提交的结果；连续失败或账户被锁定后 CanAutoUnlock 不再允许自动提交，
+    // 直到退避结束或管理员更新了密码
+    ULONGLONG ullNow = GetTickCount64();
+    ResultCache::GetDefault()->RecordResult(_pszUserSid, _ullSubmittedStamp, ntsStatus, ntsSubstatus, ullNow);
+
+    // 会话主机上同步给其余会话，同一凭据不在每个会话各被拒绝一次
+    SharedCache* pShared = SharedCache::GetDefault();
+    ULONGLONG ullRetryTick = 0;
+    bool fBlocked = false;
+    if (pShared && ResultCache::GetDefault()->GetDecision(_pszUserSid, &ullRetryTick, &fBlocked))
+    {
+        ConfigReadScope scope;
+        const ConfigSnapshot* pConfig = scope.Get();
+        pShared->PublishDecision(ResultCache::HashKey(_pszUserSid), pConfig ? pConfig->GetGeneration() : 0, ullRetryTick, fBlocked, ullNow);
+    }
+    MetricsRecordResult(_cpus, ResultCache::Classify(ntsStatus, ntsSubstatus));
+
+    // 审计记录只入队，由后台线程写入文件
+    if (g_fAuditEnabled)
+    {
+        LARGE_INTEGER li;
+        QueryPerformanceCounter(&li);
+        AuditLogRecordResult(_cpus, _pszUserSid, ntsStatus, ntsSubstatus, _llCreated, _llSerialized, li.QuadPart);
+    }
+    _state.Transition(CS_SUBMITTING, (ntsStatus < 0) ? CS_FAILED : CS_DONE);
+    _DeliverEvents();
     return S_OK;
 }
 
 HRESULT WinUnlockCredential::CanAutoUnlock()
 {
-    PWSTR pszUsername = nullptr;
-    PWSTR pszPassword = nullptr;
-    HRESULT hr = _GetAutoUnlockCredentials(&pszUsername, &pszPassword);
-    
-    if (pszUsername)
+    HRESULT hr = E_UNEXPECTED;
+    if (_pCache)
     {
-        CoTaskMemFree(pszUsername);
+        hr = _pCache->CanAutoUnlock(_pszUserSid, _pSignal && _pSignal->IsPending(), _pCache->GetFetchDeadline());
     }
-    if (pszPassword)
+    return hr;
+}
+
+// 获取自动解锁凭据
+// 凭据由提供程序共享的快照缓存按账户键查找，同一场景内不会重复读取存储
+HRESULT WinUnlockCredential::_GetAutoUnlockCredentials(SecretString& username, SecretString& password)
+{
+    HRESULT hr = E_UNEXPECTED;
+    if (_pCache)
     {
-        CoTaskMemFree(pszPassword);
+        hr = _pCache->GetCredentials(_pszUserSid, username, password, &_ullSubmittedStamp, _pCache->GetFetchDeadline());
     }
-    
     return hr;
 }
 
-// 获取自动解锁凭据
-// 注意：这是一个示例实现，实际使用时应该从安全存储中读取凭据
-HRESULT WinUnlockCredential::_GetAutoUnlockCredentials(PWSTR* ppszUsername, PWSTR* ppszPassword)
+// 快照未在期限内就绪：转入 Fetching 并在线程池中继续等待，磁贴小字先显示“正在读取”。
+// 已在等待时返回 S_FALSE
+HRESULT WinUnlockCredential::_BeginFetch()
+{
+    if (!_pCache || !_state.TransitionTo(CS_FETCHING))
+    {
+        return S_FALSE;
+    }
+    PWSTR pszLoading = nullptr;
+    if (SUCCEEDED(StringTableCoAllocCopy(_pStrings, STR_CREDENTIALS_LOADING, &pszLoading)))
+    {
+        _events.PostFieldString(SFI_SMALL_TEXT, pszLoading);
+        CoTaskMemFree(pszLoading);
+    }
+
+    // 回调期间持有本对象的引用，并通过回调库保证 DLL 不会在回调返回前被卸载；
+    // 提供程序可能先于本磁贴释放，回调结束时才在锁内取它的引用
+    AddRef();
+    TP_CALLBACK_ENVIRON env;
+    InitializeThreadpoolEnvironment(&env);
+    SetThreadpoolCallbackLibrary(&env, g_hinst);
+    BOOL fSubmitted = TrySubmitThreadpoolCallback(s_FetchCallback, this, &env);
+    DestroyThreadpoolEnvironment(&env);
+
+    if (!fSubmitted)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        _state.Transition(CS_FETCHING, CS_IDLE);
+        _events.PostFieldString(SFI_SMALL_TEXT, _pszQualifiedUserName);
+        Release();
+        return hr;
+    }
+    return S_OK;
+}
+
+// 线程池线程：等待快照就绪后离开 Fetching（可以自动解锁时为 Ready，否则为 Idle），并把恢复磁贴小字的事件入队。
+// 本线程不调用事件接收器，只请求提供程序通知 LogonUI 重新枚举：
+// LogonUI 线程上的 GetCredentialCount / SetSelected 投递事件，SetSelected 看到 Ready 即自动提交
+void CALLBACK WinUnlockCredential::s_FetchCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
 {
-    HRESULT hr = E_FAIL;
+    UNREFERENCED_PARAMETER(pInstance);
+    WinUnlockCredential* pCredential = static_cast<WinUnlockCredential*>(pvContext);
 
-    // 方法1: 从注册表读取（仅用于演示，实际应使用更安全的方法）
-    HKEY hKey = nullptr;
-    LONG lResult = RegOpenKeyExW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", 0, KEY_READ, &hKey);
-    if (lResult == ERROR_SUCCESS)
+    HRESULT hr = pCredential->_pCache->CanAutoUnlock(pCredential->_pszUserSid, pCredential->_pSignal && pCredential->_pSignal->IsPending(), INFINITE);
+    if (pCredential->_state.Transition(CS_FETCHING, SUCCEEDED(hr) ? CS_READY : CS_IDLE))
     {
-        WCHAR szUsername[256] = { 0 };
-        WCHAR szPassword[256] = { 0 };
-        DWORD dwType = REG_SZ;
-        DWORD dwSize = sizeof(szUsername);
+        pCredential->_events.PostFieldString(SFI_SMALL_TEXT, pCredential->_pszQualifiedUserName);
 
-        if (RegQueryValueExW(hKey, L"Username", nullptr, &dwType, (LPBYTE)szUsername, &dwSize) == ERROR_SUCCESS)
+        // 持锁期间提供程序的 _ReleaseTiles 无法越过 DetachProvider，对象一定有效；
+        // 引用计数已为 0 时它正在析构，不再通知
+        AcquireSRWLockShared(&pCredential->_eventsLock);
+        WinUnlockProvider* pProvider = pCredential->_pProvider;
+        if (pProvider && !pProvider->TryAddRef())
         {
-            dwSize = sizeof(szPassword);
-            if (RegQueryValueExW(hKey, L"Password", nullptr, &dwType, (LPBYTE)szPassword, &dwSize) == ERROR_SUCCESS)
-            {
-                hr = SHStrDupW(szUsername, ppszUsername);
-                if (SUCCEEDED(hr))
-                {
-                    hr = SHStrDupW(szPassword, ppszPassword);
-                }
-            }
+            pProvider = nullptr;
+        }
+        ReleaseSRWLockShared(&pCredential->_eventsLock);
+        if (pProvider)
+        {
+            pProvider->NotifyCredentialsChanged();
+            pProvider->Release();
         }
-        RegCloseKey(hKey);
     }
+    pCredential->Release();
+}
+
+// 在锁内取得事件接收器的引用，调用方负责 Release
+ICredentialProviderCredentialEvents* WinUnlockCredential::_AcquireEvents()
+{
+    AcquireSRWLockShared(&_eventsLock);
+    ICredentialProviderCredentialEvents* pcpce = _pcpce;
+    if (pcpce)
+    {
+        pcpce->AddRef();
+    }
+    ReleaseSRWLockShared(&_eventsLock);
+    return pcpce;
+}
 
-    // 方法2: 如果注册表中没有，尝试从当前登录用户获取（仅用于解锁场景）
-    if (FAILED(hr) && (_cpus == CPUS_UNLOCK_WORKSTATION))
+// 投递排队的事件，只在 LogonUI 线程上调用。同一时间只有一个线程投递（队列的唯一消费者），其余线程直接返回；
+// 投递方释放标志后再检查一次队列，避免其间新投递的事件滞留
+void WinUnlockCredential::_DeliverEvents()
+{
+    while (_events.HasPending() && !InterlockedCompareExchange(&_fDelivering, TRUE, FALSE))
     {
-        // 获取当前锁定的用户名
-        WCHAR szCurrentUser[256] = { 0 };
-        DWORD dwSize = sizeof(szCurrentUser) / sizeof(WCHAR);
-        if (GetUserNameW(szCurrentUser, &dwSize))
+        ICredentialProviderCredentialEvents* pcpce = _AcquireEvents();
+        if (pcpce)
         {
-            // 这里应该从安全存储中读取密码
-            // 为了演示，我们假设密码已配置
-            // 实际实现应该使用 Windows Credential Manager 或 DPAPI 加密存储
-            hr = SHStrDupW(szCurrentUser, ppszUsername);
-            if (SUCCEEDED(hr))
-            {
-                // 注意：实际应用中，密码应该从加密存储中读取
-                // 这里仅作为示例，实际不应硬编码
-                hr = SHStrDupW(L"", ppszPassword); // 空密码仅用于演示
-            }
+            _events.Deliver(this, pcpce);
+            pcpce->Release();
+        }
+        InterlockedExchange(&_fDelivering, FALSE);
+        if (!pcpce)
+        {
+            // 尚无接收器：事件留在队列中，Advise 时补发
+            break;
         }
     }
-
-    return hr;
 }
-
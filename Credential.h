@@ -1,16 +1,13 @@
 #pragma once
 
 #include "pch.h"
+#include "CredentialCache.h"
+#include "CredentialState.h"
+#include "FieldTable.h"
+#include "ObjectPool.h"
+#include "UnlockSignal.h"
 
-// 字段索引定义
-enum FIELDID
-{
-    SFI_TILEIMAGE = 0,
-    SFI_LARGE_TEXT,
-    SFI_SMALL_TEXT,
-    SFI_SUBMIT_BUTTON,
-    SFI_NUM_FIELDS
-};
+class WinUnlockProvider;
 
 class WinUnlockCredential : public ICredentialProviderCredential
 {
@@ -30,8 +27,11 @@ public:
     IFACEMETHODIMP GetBitmapValue(DWORD dwFieldID, HBITMAP* phbmp);
     IFACEMETHODIMP GetCheckboxValue(DWORD dwFieldID, BOOL* pbChecked, LPWSTR* ppszLabel);
     IFACEMETHODIMP GetSubmitButtonValue(DWORD dwFieldID, DWORD* pdwAdjacentTo);
+    IFACEMETHODIMP GetComboBoxValueCount(DWORD dwFieldID, DWORD* pcItems, DWORD* pdwSelectedItem);
+    IFACEMETHODIMP GetComboBoxValueAt(DWORD dwFieldID, DWORD dwItem, LPWSTR* ppszItem);
     IFACEMETHODIMP SetStringValue(DWORD dwFieldID, LPCWSTR psz);
     IFACEMETHODIMP SetCheckboxValue(DWORD dwFieldID, BOOL bChecked);
+    IFACEMETHODIMP SetComboBoxSelectedValue(DWORD dwFieldID, DWORD dwSelectedItem);
     IFACEMETHODIMP CommandLinkClicked(DWORD dwFieldID);
     IFACEMETHODIMP GetSerialization(CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr, CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon);
     IFACEMETHODIMP ReportResult(NTSTATUS ntsStatus, NTSTATUS ntsSubstatus, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon);
@@ -39,19 +39,54 @@ public:
     WinUnlockCredential();
     ~WinUnlockCredential();
 
-    HRESULT Initialize(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, const CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* rgFieldDescriptors, const FIELDID* rgFieldIDs);
+    // pszUserSid 为账户键（SID 字符串或用户名），pszUserName 用于磁贴显示；
+    // 字段布局来自共享的 c_rgFieldTable，pStrings 为提供程序选定语言的字符串表；
+    // pSignal 不为 nullptr 时只在收到外部解锁信号后自动提交；
+    // pProvider 为所属提供程序，后台读取完成时由它通知 LogonUI 重新查询
+    HRESULT Initialize(WinUnlockProvider* pProvider, CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, CredentialCache* pCache, const STRING_TABLE* pStrings, UnlockSignal* pSignal, PCWSTR pszUserSid, PCWSTR pszUserName);
     HRESULT CanAutoUnlock();
 
+    CREDENTIAL_STATE GetState() const { return _state.Get(); }
+
+    // 提供程序释放磁贴前调用：LogonUI 可能比提供程序更久地持有磁贴，之后不再通知提供程序
+    void DetachProvider();
+
+    // 把排队的事件交给接收器，只在 LogonUI 线程上调用（提供程序的 GetCredentialCount 也会调用）
+    void DeliverEvents() { _DeliverEvents(); }
+
+    // 对象内存从空闲链表分配（见 ObjectPool.h）
+    static void* operator new(size_t cb, const std::nothrow_t&) noexcept;
+    static void operator delete(void* pv) noexcept;
+    static void operator delete(void* pv, const std::nothrow_t&) noexcept;
+    static void GetPoolStats(OBJECT_POOL_STATS* pStats);
+
 protected:
     LONG _cRef;
-    CREDENTIAL_PROVIDER_USAGE_SCENARIO _cpus;
+    CREDENTIAL_PROVIDER_USAGE_SCENARIO _cpus;   // Initialize 之后不再改变
+    WinUnlockProvider* _pProvider;              // 不持有引用（提供程序持有本磁贴）；在 _eventsLock 下读写，DetachProvider 后为 nullptr
+
+    // Advise / UnAdvise 在 _eventsLock 下替换接收器，DetachProvider 在该锁下清空 _pProvider。线程池线程只通过 _events 投递并请求提供程序通知 LogonUI，
+    // 由 LogonUI 线程上的 Advise / SetSelected / GetCredentialCount 等入口在锁外调用接收器
+    SRWLOCK _eventsLock;
     ICredentialProviderCredentialEvents* _pcpce;
-    CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR _rgFieldDescriptors[SFI_NUM_FIELDS];
-    FIELDID _rgFieldIDs[SFI_NUM_FIELDS];
+    CredentialEventQueue _events;
+    volatile LONG _fDelivering;
+
+    CredentialStateMachine _state;
+    CredentialCache* _pCache;
+    const STRING_TABLE* _pStrings;
+    UnlockSignal* _pSignal;
     PWSTR _pszUserSid;
     PWSTR _pszQualifiedUserName;
-    bool _bAutoSubmit;
-    
-    HRESULT _GetAutoUnlockCredentials(PWSTR* ppszUsername, PWSTR* ppszPassword);
+    ULONGLONG _ullSubmittedStamp;   // 最近一次序列化的密码指纹，ReportResult 按它记录结果
+    LONGLONG _llCreated;            // 审计用 QPC 时间戳：磁贴创建、最近一次返回序列化
+    LONGLONG _llSerialized;
+
+    static void CALLBACK s_FetchCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext);
+
+    HRESULT _GetAutoUnlockCredentials(SecretString& username, SecretString& password);
+    HRESULT _BeginFetch();
+    ICredentialProviderCredentialEvents* _AcquireEvents();
+    void _DeliverEvents();
 };
 
@@ -0,0 +1,486 @@
+#include "pch.h"
+#include "CredentialCache.h"
+#include "ConfigSnapshot.h"
+#include "CredentialProvider.h"
+#include "LatencyTrace.h"
+#include "Metrics.h"
+#include "ResultCache.h"
+#include "SharedCache.h"
+
+// 所有实例累计错过期限的次数
+static volatile LONG s_cMissedDeadlines = 0;
+
+CredentialCache::CredentialCache(ICredentialSource* pSource) :
+    _cRef(1),
+    _pSource(pSource),
+    _cpus(CPUS_INVALID),
+    _fValid(false),
+    _hrSnapshot(E_FAIL),
+    _pAccounts(nullptr),
+    _lGeneration(0),
+    _fReloadRequested(FALSE),
+    _hPrefetchDone(nullptr),
+    _fPrefetching(FALSE),
+    _pfnPrefetchComplete(nullptr),
+    _pvPrefetchContext(nullptr)
+{
+    InitializeSRWLock(&_lock);
+    InitializeSRWLock(&_sourceLock);
+}
+
+CredentialCache::~CredentialCache()
+{
+    _ClearSnapshot();
+    if (_pSource)
+    {
+        delete _pSource;
+        _pSource = nullptr;
+    }
+    if (_hPrefetchDone)
+    {
+        CloseHandle(_hPrefetchDone);
+        _hPrefetchDone = nullptr;
+    }
+}
+
+ULONG CredentialCache::AddRef()
+{
+    return InterlockedIncrement(&_cRef);
+}
+
+ULONG CredentialCache::Release()
+{
+    LONG cRef = InterlockedDecrement(&_cRef);
+    if (!cRef)
+        delete this;
+    return cRef;
+}
+
+void CredentialCache::SetUsageScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus)
+{
+    AcquireSRWLockExclusive(&_lock);
+    if (cpus != _cpus)
+    {
+        _ClearSnapshot();
+        _cpus = cpus;
+    }
+    ReleaseSRWLockExclusive(&_lock);
+}
+
+HRESULT CredentialCache::BeginPrefetch(PFN_CREDENTIAL_PREFETCH_COMPLETE pfnComplete, void* pvContext)
+{
+    // 预取状态和完成回调都在 _lock 下修改；读取本身在锁外进行，持锁时间很短
+    AcquireSRWLockExclusive(&_lock);
+    HRESULT hr = S_OK;
+    if (!_hPrefetchDone)
+    {
+        _hPrefetchDone = CreateEventW(nullptr, TRUE, TRUE, nullptr);
+        if (!_hPrefetchDone)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    if (SUCCEEDED(hr) && _fPrefetching)
+    {
+        // 同一时间只允许一个预取；正在进行的预取没有回调时接上本次的回调
+        if (pfnComplete && !_pfnPrefetchComplete)
+        {
+            _pfnPrefetchComplete = pfnComplete;
+            _pvPrefetchContext = pvContext;
+        }
+        else
+        {
+            hr = S_FALSE;
+        }
+    }
+    else if (SUCCEEDED(hr))
+    {
+        // 先复位事件，等待方看到 _fPrefetching 时事件一定未触发
+        ResetEvent(_hPrefetchDone);
+        InterlockedExchange(&_fPrefetching, TRUE);
+        _pfnPrefetchComplete = pfnComplete;
+        _pvPrefetchContext = pvContext;
+
+        // 回调期间持有引用，并通过回调库保证 DLL 不会在回调返回前被卸载
+        AddRef();
+        TP_CALLBACK_ENVIRON env;
+        InitializeThreadpoolEnvironment(&env);
+        SetThreadpoolCallbackLibrary(&env, g_hinst);
+        BOOL fSubmitted = TrySubmitThreadpoolCallback(s_PrefetchCallback, this, &env);
+        DestroyThreadpoolEnvironment(&env);
+
+        if (!fSubmitted)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            _pfnPrefetchComplete = nullptr;
+            _pvPrefetchContext = nullptr;
+            InterlockedExchange(&_fPrefetching, FALSE);
+            SetEvent(_hPrefetchDone);
+            Release();
+        }
+    }
+    ReleaseSRWLockExclusive(&_lock);
+    return hr;
+}
+
+void CALLBACK CredentialCache::s_PrefetchCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    CredentialCache* pCache = static_cast<CredentialCache*>(pvContext);
+
+    pCache->_Refresh();
+
+    AcquireSRWLockExclusive(&pCache->_lock);
+    HRESULT hr = pCache->_hrSnapshot;
+    PFN_CREDENTIAL_PREFETCH_COMPLETE pfnComplete = pCache->_pfnPrefetchComplete;
+    void* pvCompleteContext = pCache->_pvPrefetchContext;
+    pCache->_pfnPrefetchComplete = nullptr;
+    pCache->_pvPrefetchContext = nullptr;
+    InterlockedExchange(&pCache->_fPrefetching, FALSE);
+    SetEvent(pCache->_hPrefetchDone);
+    ReleaseSRWLockExclusive(&pCache->_lock);
+
+    if (pfnComplete)
+    {
+        pfnComplete(pvCompleteContext, hr);
+    }
+    pCache->Release();
+}
+
+HRESULT CredentialCache::_WaitForPrefetch(DWORD dwTimeoutMs)
+{
+    if (ReadAcquire(&_fPrefetching) && (WaitForSingleObject(_hPrefetchDone, dwTimeoutMs) != WAIT_OBJECT_0))
+    {
+        return E_PENDING;
+    }
+    return S_OK;
+}
+
+void CredentialCache::_ClearSnapshot()
+{
+    if (_pAccounts)
+    {
+        delete _pAccounts;
+        _pAccounts = nullptr;
+    }
+    _hrSnapshot = E_FAIL;
+    _fValid = false;
+}
+
+// 在线程池线程上读取来源，完成后在 _lock 下一次性替换快照。
+// 来源只在 _sourceLock 下访问；读取期间使用场景已切换时按新场景重读
+void CredentialCache::_Refresh()
+{
+    TRACE_SCOPE(TM_SOURCE_FETCH);
+    METRICS_SCOPE(MH_SOURCE_FETCH);
+    AcquireSRWLockExclusive(&_sourceLock);
+    InterlockedExchange(&_fReloadRequested, FALSE);
+    for (;;)
+    {
+        AcquireSRWLockShared(&_lock);
+        CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus = _cpus;
+        ReleaseSRWLockShared(&_lock);
+
+        AccountTable* pAccounts = new(std::nothrow) AccountTable();
+        HRESULT hr = pAccounts ? _pSource->LoadAccounts(cpus, pAccounts) : E_OUTOFMEMORY;
+        if (FAILED(hr))
+        {
+            MetricsRecordFetchFailure();
+        }
+
+        AcquireSRWLockExclusive(&_lock);
+        bool fCurrent = (cpus == _cpus);
+        if (fCurrent)
+        {
+            _ClearSnapshot();
+            _pAccounts = pAccounts;
+            _hrSnapshot = pAccounts ? hr : E_OUTOFMEMORY;
+            _lGeneration++;
+            _fValid = true;
+        }
+        ReleaseSRWLockExclusive(&_lock);
+
+        if (fCurrent)
+        {
+            break;
+        }
+        delete pAccounts;
+    }
+    ReleaseSRWLockExclusive(&_sourceLock);
+}
+
+void CredentialCache::Invalidate()
+{
+    InterlockedExchange(&_fReloadRequested, TRUE);
+}
+
+DWORD CredentialCache::GetFetchDeadline() const
+{
+    ConfigReadScope scope;
+    const ConfigSnapshot* pConfig = scope.Get();
+    return pConfig ? pConfig->GetFetchDeadline() : CREDENTIAL_PREFETCH_WAIT_MS;
+}
+
+// 快照是否需要重新读取；正在读取时也视为需要（等待该次读取完成）
+bool CredentialCache::_IsStale()
+{
+    AcquireSRWLockShared(&_lock);
+    bool fValid = _fValid;
+    ReleaseSRWLockShared(&_lock);
+    if (!fValid || _fReloadRequested)
+    {
+        return true;
+    }
+
+    if (!TryAcquireSRWLockExclusive(&_sourceLock))
+    {
+        return true;
+    }
+    bool fChanged = _pSource->HasChanged();
+    ReleaseSRWLockExclusive(&_sourceLock);
+    return fChanged;
+}
+
+// 确保快照可用且未过期。读取一律在线程池中进行，调用线程最多等待 dwTimeoutMs：
+// 超时返回 E_PENDING，读取在后台继续，结果留给下一次调用；dwTimeoutMs 不为 0 时计入错过期限的次数
+HRESULT CredentialCache::_EnsureSnapshot(DWORD dwTimeoutMs)
+{
+    if (!_pSource)
+    {
+        return E_UNEXPECTED;
+    }
+
+    LARGE_INTEGER liStart;
+    QueryPerformanceCounter(&liStart);
+    ULONGLONG ullStart = GetTickCount64();
+
+    HRESULT hr = _WaitForPrefetch(dwTimeoutMs);
+    if (SUCCEEDED(hr) && _IsStale())
+    {
+        hr = BeginPrefetch(nullptr, nullptr);
+        if (SUCCEEDED(hr))
+        {
+            DWORD dwRemaining = dwTimeoutMs;
+            if (dwTimeoutMs != INFINITE)
+            {
+                ULONGLONG ullElapsed = GetTickCount64() - ullStart;
+                dwRemaining = (ullElapsed < dwTimeoutMs) ? (DWORD)(dwTimeoutMs - ullElapsed) : 0;
+            }
+            hr = _WaitForPrefetch(dwRemaining);
+        }
+    }
+
+    if ((hr == E_PENDING) && dwTimeoutMs)
+    {
+        InterlockedIncrement(&s_cMissedDeadlines);
+        if (g_fTraceEnabled)
+        {
+            LARGE_INTEGER liEnd;
+            QueryPerformanceCounter(&liEnd);
+            LatencyTraceRecord(TM_SOURCE_DEADLINE_MISSED, liStart.QuadPart, liEnd.QuadPart);
+        }
+    }
+    return hr;
+}
+
+LONG CredentialCache::GetMissedDeadlines()
+{
+    return ReadAcquire(&s_cMissedDeadlines);
+}
+
+HRESULT CredentialCache::GetAccountCount(DWORD* pcAccounts, LONG* plGeneration, DWORD dwTimeoutMs)
+{
+    *pcAccounts = 0;
+    *plGeneration = 0;
+    HRESULT hr = _EnsureSnapshot(dwTimeoutMs);
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockShared(&_lock);
+        hr = _GetSnapshotResult();
+        if (SUCCEEDED(hr))
+        {
+            *pcAccounts = _pAccounts->GetCount();
+        }
+        *plGeneration = _lGeneration;
+        ReleaseSRWLockShared(&_lock);
+    }
+    return hr;
+}
+
+HRESULT CredentialCache::GetAccountAt(LONG lGeneration, DWORD dwIndex, PWSTR* ppszKey, PWSTR* ppszUsername)
+{
+    *ppszKey = nullptr;
+    *ppszUsername = nullptr;
+
+    // 不触发重新读取，保证序号与调用方取得的代数对应
+    AcquireSRWLockShared(&_lock);
+    HRESULT hr = E_CHANGED_STATE;
+    if (_fValid && (lGeneration == _lGeneration))
+    {
+        hr = E_BOUNDS;
+        if (SUCCEEDED(_hrSnapshot) && (dwIndex < _pAccounts->GetCount()))
+        {
+            hr = SHStrDupW(_pAccounts->GetKey(dwIndex), ppszKey);
+            if (SUCCEEDED(hr))
+            {
+                hr = SHStrDupW(_pAccounts->GetUsername(dwIndex), ppszUsername);
+                if (FAILED(hr))
+                {
+                    CoTaskMemFree(*ppszKey);
+                    *ppszKey = nullptr;
+                }
+            }
+        }
+    }
+    ReleaseSRWLockShared(&_lock);
+    return hr;
+}
+
+HRESULT CredentialCache::FindAccount(PCWSTR pszKey, PWSTR* ppszUsername, DWORD dwTimeoutMs)
+{
+    if (ppszUsername)
+    {
+        *ppszUsername = nullptr;
+    }
+
+    HRESULT hr = _EnsureSnapshot(dwTimeoutMs);
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockShared(&_lock);
+        hr = _GetSnapshotResult();
+        if (SUCCEEDED(hr))
+        {
+            DWORD dwIndex = 0;
+            hr = _pAccounts->Find(pszKey, &dwIndex);
+            if (SUCCEEDED(hr) && ppszUsername)
+            {
+                hr = SHStrDupW(_pAccounts->GetUsername(dwIndex), ppszUsername);
+            }
+        }
+        ReleaseSRWLockShared(&_lock);
+    }
+    return hr;
+}
+
+// 已安装快照的读取结果，调用方持有 _lock；_EnsureSnapshot 返回后场景可能已切换，此时快照尚未就绪
+HRESULT CredentialCache::_GetSnapshotResult()
+{
+    return _fValid ? _hrSnapshot : E_PENDING;
+}
+
+// 按当前场景和本地时间对账户求值解锁策略，调用方持有 _lock
+HRESULT CredentialCache::_CheckPolicy(PCWSTR pszKey, DWORD dwIndex, bool fSignaled)
+{
+    ConfigReadScope scope;
+    const ConfigSnapshot* pConfig = scope.Get();
+    if (!pConfig)
+    {
+        return E_OUTOFMEMORY;
+    }
+    const UnlockPolicy& policy = pConfig->GetPolicy();
+    if (!policy.IsConfigured())
+    {
+        return S_OK;
+    }
+
+    SYSTEMTIME st;
+    GetLocalTime(&st);
+
+    UNLOCK_POLICY_CONTEXT context;
+    context.ullKeyHash = UnlockPolicy::HashName(pszKey);
+    context.ullUserHash = UnlockPolicy::HashName(_pAccounts->GetUsername(dwIndex));
+    context.dwScenario = _cpus;
+    context.dwDayOfWeek = st.wDayOfWeek;
+    context.dwMinuteOfDay = st.wHour * 60 + st.wMinute;
+    context.cRecentUnlocks = ResultCache::GetDefault()->CountRecentUnlocks(pszKey, GetTickCount64());
+    context.fSignaled = fSignaled;
+
+    switch (policy.Evaluate(context))
+    {
+    case UPD_ALLOW:
+        return S_OK;
+    case UPD_RATE_LIMITED:
+        return HRESULT_FROM_WIN32(ERROR_RETRY);
+    case UPD_SIGNAL_REQUIRED:
+        return HRESULT_FROM_WIN32(ERROR_NOT_READY);
+    case UPD_DENY:
+    default:
+        return HRESULT_FROM_WIN32(ERROR_ACCESS_DISABLED_BY_POLICY);
+    }
+}
+
+HRESULT CredentialCache::CanAutoUnlock(PCWSTR pszKey, bool fSignaled, DWORD dwTimeoutMs)
+{
+    HRESULT hr = _EnsureSnapshot(dwTimeoutMs);
+    if (SUCCEEDED(hr))
+    {
+        AcquireSRWLockShared(&_lock);
+        hr = _GetSnapshotResult();
+        if (SUCCEEDED(hr))
+        {
+            DWORD dwIndex = 0;
+            hr = _pAccounts->Find(pszKey, &dwIndex);
+            if (SUCCEEDED(hr))
+            {
+                ULONGLONG ullNow = GetTickCount64();
+                hr = ResultCache::GetDefault()->CanAutoSubmit(pszKey, _pAccounts->GetStamp(dwIndex), ullNow);
+                SharedCache* pShared = SharedCache::GetDefault();
+                if (SUCCEEDED(hr) && pShared)
+                {
+                    ConfigReadScope scope;
+                    const ConfigSnapshot* pConfig = scope.Get();
+                    hr = pShared->CheckDecision(ResultCache::HashKey(pszKey), pConfig ? pConfig->GetGeneration() : 0, ullNow);
+                }
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = _CheckPolicy(pszKey, dwIndex, fSignaled);
+            }
+        }
+        ReleaseSRWLockShared(&_lock);
+    }
+    return hr;
+}
+
+HRESULT CredentialCache::GetCredentials(PCWSTR pszKey, SecretString& username, SecretString& password, ULONGLONG* pullStamp, DWORD dwTimeoutMs)
+{
+    username.Free();
+    password.Free();
+    if (pullStamp)
+    {
+        *pullStamp = 0;
+    }
+
+    HRESULT hr = _EnsureSnapshot(dwTimeoutMs);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    AcquireSRWLockShared(&_lock);
+    hr = _GetSnapshotResult();
+    if (SUCCEEDED(hr))
+    {
+        DWORD dwIndex = 0;
+        hr = _pAccounts->Find(pszKey, &dwIndex);
+        if (SUCCEEDED(hr))
+        {
+            hr = username.Assign(_pAccounts->GetUsername(dwIndex));
+            if (SUCCEEDED(hr))
+            {
+                hr = _pAccounts->UnsealPassword(dwIndex, &password);
+                if (FAILED(hr))
+                {
+                    username.Free();
+                }
+                else if (pullStamp)
+                {
+                    *pullStamp = _pAccounts->GetStamp(dwIndex);
+                }
+            }
+        }
+    }
+    ReleaseSRWLockShared(&_lock);
+    return hr;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "pch.h"
+#include "CredentialSource.h"
+#include "UnlockPolicy.h"
+
+// LogonUI 线程等待预取结果的上限（毫秒），超过后先按“不自动解锁”呈现磁贴。
+// 可由 HKLM\SOFTWARE\WinUnlock\FetchDeadlineMs（DWORD）在下列范围内覆盖
+#define CREDENTIAL_PREFETCH_WAIT_MS         100
+#define CREDENTIAL_FETCH_DEADLINE_MIN_MS    10
+#define CREDENTIAL_FETCH_DEADLINE_MAX_MS    5000
+
+// 预取完成回调，在线程池线程上调用
+typedef void (CALLBACK *PFN_CREDENTIAL_PREFETCH_COMPLETE)(void* pvContext, HRESULT hr);
+
+// 账户快照缓存
+// 每个提供程序持有一份，同一使用场景内只读取一次凭据来源，
+// 之后仅在来源报告存储已变更时才重新读取，每次重新读取都会使代数加一。
+// 提供程序与其创建的凭据对象共享同一实例，因此使用引用计数管理生命周期。
+// 凭据来源只在线程池线程上读取（BeginPrefetch 或按需触发），读取完成后在 _lock 下一次性替换快照；
+// LogonUI 线程只等待到期限为止，来源卡住时不会阻塞界面，迟到的结果留给下一次调用。
+class CredentialCache
+{
+public:
+    // 接管 pSource 的所有权
+    CredentialCache(ICredentialSource* pSource);
+
+    ULONG AddRef();
+    ULONG Release();
+
+    // 切换使用场景，丢弃上一场景的快照
+    void SetUsageScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus);
+
+    // 在线程池中读取快照，完成后调用 pfnComplete（可为 nullptr）。
+    // 已有读取在进行时返回 S_FALSE；若该次读取没有回调，则接上 pfnComplete 并返回 S_OK
+    HRESULT BeginPrefetch(PFN_CREDENTIAL_PREFETCH_COMPLETE pfnComplete, void* pvContext);
+
+    // 配置已变更：使下一次访问重新读取快照
+    void Invalidate();
+
+    // 调用方应传给 dwTimeoutMs 的期限（毫秒），取自进程内共享的配置快照（见 ConfigSnapshot.h）
+    DWORD GetFetchDeadline() const;
+
+    // 进程内所有实例错过期限的累计次数
+    static LONG GetMissedDeadlines();
+
+    // 以下带 dwTimeoutMs 的方法在快照需要（重新）读取时最多等待 dwTimeoutMs，超时返回 E_PENDING
+
+    // 快照中的账户数及快照代数
+    HRESULT GetAccountCount(DWORD* pcAccounts, LONG* plGeneration, DWORD dwTimeoutMs = INFINITE);
+
+    // 按序号复制账户键和用户名（调用方用 CoTaskMemFree 释放）；
+    // 快照已重新读取（代数不一致）时返回 E_CHANGED_STATE
+    HRESULT GetAccountAt(LONG lGeneration, DWORD dwIndex, PWSTR* ppszKey, PWSTR* ppszUsername);
+
+    // 按账户键（SID 字符串或用户名）查找账户，ppszUsername 可为 nullptr
+    HRESULT FindAccount(PCWSTR pszKey, PWSTR* ppszUsername, DWORD dwTimeoutMs = INFINITE);
+
+    // 快照中是否有该账户的可用凭据，最近的登录结果（ResultCache）允许自动提交，且解锁策略允许；
+    // fSignaled 为是否已收到外部解锁信号。策略拒绝时返回 HRESULT_FROM_WIN32(ERROR_ACCESS_DISABLED_BY_POLICY)
+    HRESULT CanAutoUnlock(PCWSTR pszKey, bool fSignaled, DWORD dwTimeoutMs = INFINITE);
+
+    // 复制该账户的凭据到机密字符串中，pullStamp（可为 nullptr）返回密码指纹，供 ReportResult 记录结果
+    HRESULT GetCredentials(PCWSTR pszKey, SecretString& username, SecretString& password, ULONGLONG* pullStamp = nullptr, DWORD dwTimeoutMs = INFINITE);
+
+private:
+    ~CredentialCache();
+
+    static void CALLBACK s_PrefetchCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext);
+
+    HRESULT _WaitForPrefetch(DWORD dwTimeoutMs);
+    HRESULT _EnsureSnapshot(DWORD dwTimeoutMs);
+    bool _IsStale();
+    void _Refresh();
+    HRESULT _GetSnapshotResult();
+    void _ClearSnapshot();
+    HRESULT _CheckPolicy(PCWSTR pszKey, DWORD dwIndex, bool fSignaled);
+
+    LONG _cRef;
+    SRWLOCK _lock;          // 保护快照和预取状态
+    SRWLOCK _sourceLock;    // 串行化对 _pSource 的访问，读取期间一直持有
+    ICredentialSource* _pSource;
+    CREDENTIAL_PROVIDER_USAGE_SCENARIO _cpus;
+    bool _fValid;
+    HRESULT _hrSnapshot;
+    AccountTable* _pAccounts;
+    LONG _lGeneration;
+    volatile LONG _fReloadRequested;    // Invalidate 后置位，下一次读取开始时清除
+
+    // 预取状态：_hPrefetchDone 为手动重置事件，预取进行中时处于未触发状态
+    HANDLE _hPrefetchDone;
+    volatile LONG _fPrefetching;
+    PFN_CREDENTIAL_PREFETCH_COMPLETE _pfnPrefetchComplete;
+    void* _pvPrefetchContext;
+};
@@ -1,27 +1,95 @@
 #include "pch.h"
 #include "CredentialProvider.h"
+#include "AuditLog.h"
+#include "ConfigSnapshot.h"
+#include "LatencyTrace.h"
+#include "Metrics.h"
+#include "SharedCache.h"
+#include "TileImage.h"
+#include <sddl.h>
+#include <wtsapi32.h>
+
+#pragma comment(lib, "wtsapi32.lib")
+
+// 同时存在的提供程序通常只有一两个（每个使用场景一个）
+#define PROVIDER_POOL_MAX 4
+
+static ObjectPool<sizeof(WinUnlockProvider), PROVIDER_POOL_MAX> s_providerPool;
+
+void* WinUnlockProvider::operator new(size_t cb, const std::nothrow_t&) noexcept
+{
+    return (cb == sizeof(WinUnlockProvider)) ? s_providerPool.Alloc() : nullptr;
+}
+
+void WinUnlockProvider::operator delete(void* pv) noexcept
+{
+    s_providerPool.Free(pv);
+}
+
+void WinUnlockProvider::operator delete(void* pv, const std::nothrow_t&) noexcept
+{
+    s_providerPool.Free(pv);
+}
+
+void WinUnlockProvider::GetPoolStats(OBJECT_POOL_STATS* pStats)
+{
+    s_providerPool.GetStats(pStats);
+}
 
 WinUnlockProvider::WinUnlockProvider() :
     _cRef(1),
     _cpus(CPUS_INVALID),
     _pcpe(nullptr),
     _upAdviseContext(0),
-    _pCredential(nullptr),
+    _pCache(nullptr),
+    _pSignal(nullptr),
+    _pConfigWatch(nullptr),
+    _pStrings(nullptr),
+    _pszLockedUserSid(nullptr),
+    _rgpCredentials(nullptr),
+    _cTiles(0),
+    _lTilesGeneration(0),
     _dwFieldIDToSetFocus(0),
     _dwSetSerializationCred(CREDENTIAL_PROVIDER_NO_DEFAULT),
-    _bAutoSubmit(false)
+    _bAutoSubmit(false),
+    _fPrefetchLate(FALSE),
+    _fConfigReloadPending(FALSE)
 {
     DllAddRef();
-    ZeroMemory(_rgFieldDescriptors, sizeof(_rgFieldDescriptors));
+    InitializeSRWLock(&_lockEvents);
+    LatencyTraceInitialize();
+    AuditLogInitialize();
+    MetricsInitialize();
+    SharedCacheInitialize();
 }
 
 WinUnlockProvider::~WinUnlockProvider()
 {
-    if (_pCredential)
+    // 先停止监听，之后不会再有信号回调访问本对象
+    if (_pSignal)
     {
-        _pCredential->Release();
-        _pCredential = nullptr;
+        _pSignal->Stop();
+        _pSignal->Release();
+        _pSignal = nullptr;
     }
+    if (_pConfigWatch)
+    {
+        delete _pConfigWatch;
+        _pConfigWatch = nullptr;
+    }
+    _ReleaseTiles();
+    if (_pszLockedUserSid)
+    {
+        CoTaskMemFree(_pszLockedUserSid);
+        _pszLockedUserSid = nullptr;
+    }
+    if (_pCache)
+    {
+        _pCache->Release();
+        _pCache = nullptr;
+    }
+    // 一次登录/解锁流程结束，把本轮跟踪记录写入文件
+    LatencyTraceQueueDump();
     DllRelease();
 }
 
@@ -49,15 +117,124 @@ IFACEMETHODIMP WinUnlockProvider::QueryInterface(REFIID riid, void** ppv)
     return QISearch(this, qit, riid, ppv);
 }
 
+// 查询 LogonUI 所在会话的登录用户 SID，即解锁场景下锁定会话的所有者
+static HRESULT GetSessionUserSid(PWSTR* ppszSid)
+{
+    *ppszSid = nullptr;
+
+    DWORD dwSessionId = 0;
+    if (!ProcessIdToSessionId(GetCurrentProcessId(), &dwSessionId))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HANDLE hToken = nullptr;
+    if (!WTSQueryUserToken(dwSessionId, &hToken))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    DWORD_PTR rgTokenUser[(sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE) / sizeof(DWORD_PTR) + 1];
+    DWORD cbTokenUser = 0;
+    if (GetTokenInformation(hToken, TokenUser, rgTokenUser, sizeof(rgTokenUser), &cbTokenUser))
+    {
+        PWSTR pszSid = nullptr;
+        if (ConvertSidToStringSidW(((TOKEN_USER*)rgTokenUser)->User.Sid, &pszSid))
+        {
+            hr = SHStrDupW(pszSid, ppszSid);
+            LocalFree(pszSid);
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    else
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    CloseHandle(hToken);
+    return hr;
+}
+
 // ICredentialProvider
 IFACEMETHODIMP WinUnlockProvider::SetUsageScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, DWORD dwFlags)
 {
+    TRACE_SCOPE(TM_PROVIDER_SETUSAGESCENARIO);
+    LatencyTraceScenarioBegin(cpus);
     HRESULT hr = E_INVALIDARG;
 
     if ((cpus == CPUS_LOGON) || (cpus == CPUS_UNLOCK_WORKSTATION))
     {
         _cpus = cpus;
         hr = S_OK;
+        _ReleaseTiles();
+
+        // 磁贴文本使用用户界面语言；失败时字符串表回退到简体中文
+        StringTableSelect(GetUserDefaultUILanguage(), &_pStrings);
+
+        // 解锁场景只为锁定会话的所有者呈现磁贴；查询失败时不呈现任何磁贴
+        if (_pszLockedUserSid)
+        {
+            CoTaskMemFree(_pszLockedUserSid);
+            _pszLockedUserSid = nullptr;
+        }
+        if (cpus == CPUS_UNLOCK_WORKSTATION)
+        {
+            GetSessionUserSid(&_pszLockedUserSid);
+        }
+
+        // 每个场景一份凭据快照，由凭据来源的变更通知负责失效
+        if (!_pCache)
+        {
+            ICredentialSource* pSource = nullptr;
+            hr = CreateConfiguredCredentialSource(&pSource);
+            if (SUCCEEDED(hr))
+            {
+                _pCache = new(std::nothrow) CredentialCache(pSource);
+                if (!_pCache)
+                {
+                    delete pSource;
+                    hr = E_OUTOFMEMORY;
+                }
+            }
+        }
+        if (_pCache)
+        {
+            _pCache->SetUsageScenario(cpus);
+
+            // 场景确定后立即在后台读取凭据，LogonUI 线程无需等待存储
+            InterlockedExchange(&_fPrefetchLate, FALSE);
+            AddRef();
+            if (_pCache->BeginPrefetch(s_PrefetchComplete, this) != S_OK)
+            {
+                Release();
+            }
+
+            // 磁贴图像同样在后台解码，GetBitmapValue 只从缓存创建位图
+            TileImageWarmup();
+        }
+
+        // 配置了 SignalKey 时监听外部解锁信号，收到后通知 LogonUI 重新枚举并自动提交
+        if (!_pSignal)
+        {
+            UnlockSignal::CreateFromRegistry(&_pSignal);
+        }
+        if (_pSignal)
+        {
+            _pSignal->Start(s_UnlockSignaled, this);
+        }
+
+        // 配置工具保存后在后台重新加载，并通知 LogonUI 重新枚举，磁贴无需重新锁定即可更新
+        if (_pCache && !_pConfigWatch)
+        {
+            _pConfigWatch = new(std::nothrow) ConfigWatcher();
+        }
+        if (_pConfigWatch)
+        {
+            _pConfigWatch->Start(s_ConfigChanged, this);
+        }
     }
 
     return hr;
@@ -65,12 +242,15 @@ IFACEMETHODIMP WinUnlockProvider::SetUsageScenario(CREDENTIAL_PROVIDER_USAGE_SCE
 
 IFACEMETHODIMP WinUnlockProvider::SetSerialization(const CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs)
 {
+    TRACE_SCOPE(TM_PROVIDER_SETSERIALIZATION);
     UNREFERENCED_PARAMETER(pcpcs);
     return E_NOTIMPL;
 }
 
 IFACEMETHODIMP WinUnlockProvider::Advise(ICredentialProviderEvents* pcpe, UINT_PTR upAdviseContext)
 {
+    TRACE_SCOPE(TM_PROVIDER_ADVISE);
+    AcquireSRWLockExclusive(&_lockEvents);
     if (_pcpe != nullptr)
     {
         _pcpe->Release();
@@ -81,39 +261,104 @@ IFACEMETHODIMP WinUnlockProvider::Advise(ICredentialProviderEvents* pcpe, UINT_P
     {
         _pcpe->AddRef();
     }
+    ReleaseSRWLockExclusive(&_lockEvents);
     return S_OK;
 }
 
 IFACEMETHODIMP WinUnlockProvider::UnAdvise()
 {
+    TRACE_SCOPE(TM_PROVIDER_UNADVISE);
+    AcquireSRWLockExclusive(&_lockEvents);
     if (_pcpe)
     {
         _pcpe->Release();
         _pcpe = nullptr;
     }
     _upAdviseContext = 0;
+    ReleaseSRWLockExclusive(&_lockEvents);
     return S_OK;
 }
 
 IFACEMETHODIMP WinUnlockProvider::GetFieldDescriptorCount(DWORD* pdwCount)
 {
+    TRACE_SCOPE(TM_PROVIDER_GETFIELDDESCRIPTORCOUNT);
     *pdwCount = SFI_NUM_FIELDS;
     return S_OK;
 }
 
 IFACEMETHODIMP WinUnlockProvider::GetFieldDescriptorAt(DWORD dwIndex, CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR** ppcpfd)
 {
+    TRACE_SCOPE(TM_PROVIDER_GETFIELDDESCRIPTORAT);
     HRESULT hr = E_INVALIDARG;
-    if (ppcpfd && (dwIndex < SFI_NUM_FIELDS))
+    if (ppcpfd)
     {
-        *ppcpfd = &_rgFieldDescriptors[dwIndex];
-        hr = S_OK;
+        hr = FieldDescriptorCoAllocCopy(dwIndex, ppcpfd);
+    }
+    return hr;
+}
+
+// 按当前快照计算磁贴数：登录场景每个账户一个磁贴，解锁场景只有锁定用户一个
+HRESULT WinUnlockProvider::_QueryCredentialCount(DWORD* pcTiles, LONG* plGeneration, DWORD dwTimeoutMs)
+{
+    *pcTiles = 0;
+    HRESULT hr = _pCache->GetAccountCount(pcTiles, plGeneration, dwTimeoutMs);
+    if (SUCCEEDED(hr) && (_cpus == CPUS_UNLOCK_WORKSTATION))
+    {
+        *pcTiles = 0;
+        if (_pszLockedUserSid && SUCCEEDED(_pCache->FindAccount(_pszLockedUserSid, nullptr, 0)))
+        {
+            *pcTiles = 1;
+        }
     }
     return hr;
 }
 
+// 快照代数或磁贴数变化时丢弃旧的凭据对象，只分配指针数组，凭据对象在 GetCredentialAt 中创建
+HRESULT WinUnlockProvider::_UpdateTiles(DWORD cTiles, LONG lGeneration)
+{
+    if ((cTiles == _cTiles) && (lGeneration == _lTilesGeneration))
+    {
+        return S_OK;
+    }
+
+    _ReleaseTiles();
+    if (cTiles)
+    {
+        _rgpCredentials = (WinUnlockCredential**)CoTaskMemAlloc(cTiles * sizeof(WinUnlockCredential*));
+        if (!_rgpCredentials)
+        {
+            return E_OUTOFMEMORY;
+        }
+        ZeroMemory(_rgpCredentials, cTiles * sizeof(WinUnlockCredential*));
+    }
+    _cTiles = cTiles;
+    _lTilesGeneration = lGeneration;
+    return S_OK;
+}
+
+void WinUnlockProvider::_ReleaseTiles()
+{
+    if (_rgpCredentials)
+    {
+        for (DWORD i = 0; i < _cTiles; i++)
+        {
+            if (_rgpCredentials[i])
+            {
+                // LogonUI 可能仍持有磁贴，之后它的后台读取不再回调本对象
+                _rgpCredentials[i]->DetachProvider();
+                _rgpCredentials[i]->Release();
+            }
+        }
+        CoTaskMemFree(_rgpCredentials);
+        _rgpCredentials = nullptr;
+    }
+    _cTiles = 0;
+}
+
 IFACEMETHODIMP WinUnlockProvider::GetCredentialCount(DWORD* pdwCount, DWORD* pdwDefault, BOOL* pbAutoLogonWithDefault)
 {
+    TRACE_SCOPE(TM_PROVIDER_GETCREDENTIALCOUNT);
+    METRICS_SCOPE(MH_GETCREDENTIALCOUNT);
     HRESULT hr = S_OK;
 
     if (!pdwCount || !pdwDefault || !pbAutoLogonWithDefault)
@@ -121,47 +366,222 @@ IFACEMETHODIMP WinUnlockProvider::GetCredentialCount(DWORD* pdwCount, DWORD* pdw
         return E_INVALIDARG;
     }
 
-    *pdwCount = 1;
-    *pdwDefault = 0;
+    *pdwCount = 0;
+    *pdwDefault = CREDENTIAL_PROVIDER_NO_DEFAULT;
     *pbAutoLogonWithDefault = FALSE;
 
-    // 创建凭据对象
-    if (!_pCredential)
+    if (!_pCache)
+    {
+        return E_UNEXPECTED;
+    }
+
+    // 预取未在限定时间内完成时先不呈现磁贴，
+    // 由预取完成回调通过 CredentialsChanged 让 LogonUI 重新查询
+    DWORD cTiles = 0;
+    LONG lGeneration = 0;
+    HRESULT hrCount = _QueryCredentialCount(&cTiles, &lGeneration, _pCache->GetFetchDeadline());
+    if (hrCount == E_PENDING)
     {
-        _pCredential = new(std::nothrow) WinUnlockCredential();
-        if (_pCredential)
+        InterlockedExchange(&_fPrefetchLate, TRUE);
+
+        // 预取可能恰好在设置标志之前完成，此时由本线程直接取结果
+        hrCount = _QueryCredentialCount(&cTiles, &lGeneration, 0);
+        if ((hrCount != E_PENDING) && !InterlockedExchange(&_fPrefetchLate, FALSE))
         {
-            hr = _pCredential->Initialize(_cpus, _rgFieldDescriptors, nullptr);
-            if (SUCCEEDED(hr))
-            {
-                // 检查是否可以自动解锁
-                if (SUCCEEDED(_pCredential->CanAutoUnlock()))
-                {
-                    *pbAutoLogonWithDefault = TRUE;
-                }
-            }
+            // 回调已经清除标志并会发出通知
+            hrCount = E_PENDING;
         }
-        else
+    }
+    if (FAILED(hrCount))
+    {
+        cTiles = 0;
+    }
+
+    hr = _UpdateTiles(cTiles, lGeneration);
+
+    // 磁贴的后台读取只把事件入队并请求重新枚举，在 LogonUI 线程上补发
+    for (DWORD i = 0; SUCCEEDED(hr) && (i < _cTiles); i++)
+    {
+        if (_rgpCredentials[i])
         {
-            hr = E_OUTOFMEMORY;
+            _rgpCredentials[i]->DeliverEvents();
         }
     }
 
+    if (SUCCEEDED(hr) && _cTiles)
+    {
+        // 只有一个磁贴时自动登录；登录场景有多个账户时由用户选择；
+        // 启用外部信号时还需已收到信号，最近登录失败而退避或停止自动提交、或解锁策略不允许时也不自动登录
+        *pdwCount = _cTiles;
+        *pdwDefault = 0;
+        *pbAutoLogonWithDefault = (_cTiles == 1) && (!_pSignal || _pSignal->IsPending()) &&
+            SUCCEEDED(_CanAutoSubmitDefault());
+    }
+
     return hr;
 }
 
+// 默认磁贴（序号 0）的账户能否自动提交，只在快照已就绪时调用
+HRESULT WinUnlockProvider::_CanAutoSubmitDefault()
+{
+    bool fSignaled = _pSignal && _pSignal->IsPending();
+    if (_cpus == CPUS_UNLOCK_WORKSTATION)
+    {
+        return _pCache->CanAutoUnlock(_pszLockedUserSid, fSignaled, 0);
+    }
+
+    PWSTR pszKey = nullptr;
+    PWSTR pszUserName = nullptr;
+    HRESULT hr = _pCache->GetAccountAt(_lTilesGeneration, 0, &pszKey, &pszUserName);
+    if (SUCCEEDED(hr))
+    {
+        hr = _pCache->CanAutoUnlock(pszKey, fSignaled, 0);
+    }
+    CoTaskMemFree(pszKey);
+    CoTaskMemFree(pszUserName);
+    return hr;
+}
+
+void CALLBACK WinUnlockProvider::s_PrefetchComplete(void* pvContext, HRESULT hr)
+{
+    WinUnlockProvider* pProvider = static_cast<WinUnlockProvider*>(pvContext);
+    pProvider->_OnPrefetchComplete(hr);
+    pProvider->Release();
+}
+
+// 预取完成（线程池线程）：若 LogonUI 已放弃等待且读到了账户，或这是配置变更后的重新读取
+// （读取失败也要通知，例如配置关闭了自动解锁），通知其重新枚举凭据
+void WinUnlockProvider::_OnPrefetchComplete(HRESULT hr)
+{
+    bool fLate = InterlockedExchange(&_fPrefetchLate, FALSE) && SUCCEEDED(hr);
+    bool fConfigChanged = InterlockedExchange(&_fConfigReloadPending, FALSE) != FALSE;
+    if (fLate || fConfigChanged)
+    {
+        NotifyCredentialsChanged();
+    }
+}
+
+// 收到外部解锁信号（线程池线程）：Stop 返回前本对象一定有效
+void CALLBACK WinUnlockProvider::s_UnlockSignaled(void* pvContext)
+{
+    static_cast<WinUnlockProvider*>(pvContext)->NotifyCredentialsChanged();
+}
+
+// 配置已保存（线程池线程，已经过防抖）：Stop 返回前本对象一定有效。
+// 回调在监听器的锁下调用，这里不等待读取：只在后台开始重新读取，完成后由 _OnPrefetchComplete 通知
+// LogonUI 重新查询，此时快照已是新配置
+void CALLBACK WinUnlockProvider::s_ConfigChanged(void* pvContext, DWORD dwGeneration)
+{
+    WinUnlockProvider* pProvider = static_cast<WinUnlockProvider*>(pvContext);
+
+    // 配置快照进程内共享，各提供程序都会收到通知，Generation 已是最新时不重复加载
+    ConfigSnapshotReload();
+    pProvider->_pCache->Invalidate();
+    MetricsRecordConfigReload(dwGeneration);
+
+    // 已有预取在进行时由它完成时通知；它读到的若是旧配置，Invalidate 保证 LogonUI 下一次查询仍会重新读取
+    // 析构函数中的 Stop 可能正在等待本回调，此时引用计数已为 0，不能再取引用
+    if (!pProvider->TryAddRef())
+    {
+        return;
+    }
+    InterlockedExchange(&pProvider->_fConfigReloadPending, TRUE);
+    HRESULT hr = pProvider->_pCache->BeginPrefetch(s_PrefetchComplete, pProvider);
+    if (hr != S_OK)
+    {
+        pProvider->Release();
+        if (FAILED(hr) && InterlockedExchange(&pProvider->_fConfigReloadPending, FALSE))
+        {
+            // 无法在后台读取：立即通知，由 GetCredentialCount 按期限读取
+            pProvider->NotifyCredentialsChanged();
+        }
+    }
+}
+
+bool WinUnlockProvider::TryAddRef()
+{
+    LONG cRef = ReadAcquire(&_cRef);
+    while (cRef)
+    {
+        LONG cPrevious = InterlockedCompareExchange(&_cRef, cRef + 1, cRef);
+        if (cPrevious == cRef)
+        {
+            return true;
+        }
+        cRef = cPrevious;
+    }
+    return false;
+}
+
+void WinUnlockProvider::NotifyCredentialsChanged()
+{
+    AcquireSRWLockShared(&_lockEvents);
+    ICredentialProviderEvents* pcpe = _pcpe;
+    UINT_PTR upAdviseContext = _upAdviseContext;
+    if (pcpe)
+    {
+        pcpe->AddRef();
+    }
+    ReleaseSRWLockShared(&_lockEvents);
+
+    if (pcpe)
+    {
+        pcpe->CredentialsChanged(upAdviseContext);
+        pcpe->Release();
+    }
+}
+
 IFACEMETHODIMP WinUnlockProvider::GetCredentialAt(DWORD dwIndex, ICredentialProviderCredential** ppcpc)
 {
+    TRACE_SCOPE(TM_PROVIDER_GETCREDENTIALAT);
     HRESULT hr = E_INVALIDARG;
-    if ((dwIndex == 0) && ppcpc)
+    if ((dwIndex < _cTiles) && ppcpc)
     {
-        if (_pCredential)
+        hr = S_OK;
+        if (!_rgpCredentials[dwIndex])
         {
-            hr = _pCredential->QueryInterface(IID_PPV_ARGS(ppcpc));
+            PWSTR pszKey = nullptr;
+            PWSTR pszUserName = nullptr;
+            if (_cpus == CPUS_UNLOCK_WORKSTATION)
+            {
+                hr = _pCache->FindAccount(_pszLockedUserSid, &pszUserName, _pCache->GetFetchDeadline());
+                if (SUCCEEDED(hr))
+                {
+                    hr = SHStrDupW(_pszLockedUserSid, &pszKey);
+                }
+            }
+            else
+            {
+                hr = _pCache->GetAccountAt(_lTilesGeneration, dwIndex, &pszKey, &pszUserName);
+            }
+
+            if (SUCCEEDED(hr))
+            {
+                WinUnlockCredential* pCredential = new(std::nothrow) WinUnlockCredential();
+                if (pCredential)
+                {
+                    hr = pCredential->Initialize(this, _cpus, _pCache, _pStrings, _pSignal, pszKey, pszUserName);
+                    if (SUCCEEDED(hr))
+                    {
+                        _rgpCredentials[dwIndex] = pCredential;
+                    }
+                    else
+                    {
+                        pCredential->Release();
+                    }
+                }
+                else
+                {
+                    hr = E_OUTOFMEMORY;
+                }
+            }
+            CoTaskMemFree(pszKey);
+            CoTaskMemFree(pszUserName);
         }
-        else
+
+        if (SUCCEEDED(hr))
         {
-            hr = E_UNEXPECTED;
+            hr = _rgpCredentials[dwIndex]->QueryInterface(IID_PPV_ARGS(ppcpc));
         }
     }
     return hr;
@@ -8,6 +8,9 @@
 #include <unknwn.h>
 #include <winternl.h>
 
+// 系统 credentialprovider.h 已包含时跳过本地接口定义，避免重复定义
+#ifndef __credentialprovider_h__
+
 // NTSTATUS definition
 #ifndef NTSTATUS
 typedef LONG NTSTATUS;
@@ -81,12 +84,6 @@ typedef enum _CREDENTIAL_PROVIDER_STATUS_ICON
 // Constants
 #define CREDENTIAL_PROVIDER_NO_DEFAULT ((DWORD)-1)
 
-// GUIDs
-DEFINE_GUID(GUID_TILE_IMAGE, 0x2d837775, 0x8de1, 0x4e3e, 0xb2, 0x98, 0x55, 0xfc, 0x6e, 0xec, 0x0c, 0x0a);
-DEFINE_GUID(GUID_LARGE_TEXT, 0xe7179c38, 0xbd07, 0x4708, 0x8c, 0x8c, 0x8b, 0xcb, 0x40, 0xc3, 0x97, 0x50);
-DEFINE_GUID(GUID_SMALL_TEXT, 0x6f45dc1e, 0x5384, 0x457a, 0xbc, 0xc7, 0x4f, 0x95, 0x0f, 0x0e, 0x3e, 0xfb);
-DEFINE_GUID(GUID_SUBMIT_BUTTON, 0x30574de6, 0x3532, 0x4830, 0xbd, 0x23, 0x08, 0x34, 0x72, 0xbd, 0x58, 0x93);
-
 // Structures
 typedef struct _CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR
 {
@@ -109,7 +106,7 @@ typedef struct _CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION
 #define INTERFACE ICredentialProviderEvents
 DECLARE_INTERFACE_(ICredentialProviderEvents, IUnknown)
 {
-    STDMETHOD(OnCredentialsChanged)(THIS_ UINT_PTR upAdviseContext) PURE;
+    STDMETHOD(CredentialsChanged)(THIS_ UINT_PTR upAdviseContext) PURE;
 };
 #undef INTERFACE
 
@@ -143,8 +140,11 @@ DECLARE_INTERFACE_(ICredentialProviderCredential, IUnknown)
     STDMETHOD(GetBitmapValue)(THIS_ DWORD dwFieldID, HBITMAP* phbmp) PURE;
     STDMETHOD(GetCheckboxValue)(THIS_ DWORD dwFieldID, BOOL* pbChecked, LPWSTR* ppszLabel) PURE;
     STDMETHOD(GetSubmitButtonValue)(THIS_ DWORD dwFieldID, DWORD* pdwAdjacentTo) PURE;
+    STDMETHOD(GetComboBoxValueCount)(THIS_ DWORD dwFieldID, DWORD* pcItems, DWORD* pdwSelectedItem) PURE;
+    STDMETHOD(GetComboBoxValueAt)(THIS_ DWORD dwFieldID, DWORD dwItem, LPWSTR* ppszItem) PURE;
     STDMETHOD(SetStringValue)(THIS_ DWORD dwFieldID, LPCWSTR psz) PURE;
     STDMETHOD(SetCheckboxValue)(THIS_ DWORD dwFieldID, BOOL bChecked) PURE;
+    STDMETHOD(SetComboBoxSelectedValue)(THIS_ DWORD dwFieldID, DWORD dwSelectedItem) PURE;
     STDMETHOD(CommandLinkClicked)(THIS_ DWORD dwFieldID) PURE;
     STDMETHOD(GetSerialization)(THIS_ CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr, CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon) PURE;
     STDMETHOD(ReportResult)(THIS_ NTSTATUS ntsStatus, NTSTATUS ntsSubstatus, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon) PURE;
@@ -165,3 +165,89 @@ DECLARE_INTERFACE_(ICredentialProvider, IUnknown)
     STDMETHOD(GetCredentialAt)(THIS_ DWORD dwIndex, ICredentialProviderCredential** ppcpc) PURE;
 };
 #undef INTERFACE
+
+#endif // __credentialprovider_h__
+
+// ---------------------------------------------------------------------------
+// WinUnlock 凭据提供程序
+// ---------------------------------------------------------------------------
+
+#include "Credential.h"
+#include "ConfigWatch.h"
+#include "CredentialCache.h"
+#include "ObjectPool.h"
+#include "UnlockSignal.h"
+
+// {A1B2C3D4-E5F6-7890-ABCD-EF1234567891}
+__declspec(selectany) extern const CLSID CLSID_WinUnlockProvider =
+    { 0xa1b2c3d4, 0xe5f6, 0x7890, { 0xab, 0xcd, 0xef, 0x12, 0x34, 0x56, 0x78, 0x91 } };
+
+// DLL 引用计数和模块句柄（dllmain.cpp）
+void DllAddRef();
+void DllRelease();
+extern HINSTANCE g_hinst;
+
+class WinUnlockProvider : public ICredentialProvider
+{
+public:
+    // IUnknown
+    IFACEMETHODIMP_(ULONG) AddRef();
+    IFACEMETHODIMP_(ULONG) Release();
+    IFACEMETHODIMP QueryInterface(REFIID riid, void** ppv);
+
+    // ICredentialProvider
+    IFACEMETHODIMP SetUsageScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, DWORD dwFlags);
+    IFACEMETHODIMP SetSerialization(const CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs);
+    IFACEMETHODIMP Advise(ICredentialProviderEvents* pcpe, UINT_PTR upAdviseContext);
+    IFACEMETHODIMP UnAdvise();
+    IFACEMETHODIMP GetFieldDescriptorCount(DWORD* pdwCount);
+    IFACEMETHODIMP GetFieldDescriptorAt(DWORD dwIndex, CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR** ppcpfd);
+    IFACEMETHODIMP GetCredentialCount(DWORD* pdwCount, DWORD* pdwDefault, BOOL* pbAutoLogonWithDefault);
+    IFACEMETHODIMP GetCredentialAt(DWORD dwIndex, ICredentialProviderCredential** ppcpc);
+
+    WinUnlockProvider();
+
+    // 通知 LogonUI 重新枚举凭据（ICredentialProviderEvents::CredentialsChanged），可在任意线程上调用
+    void NotifyCredentialsChanged();
+
+    // 引用计数不为 0 时加一并返回 true；为 0 表示对象正在析构，不能再取引用
+    bool TryAddRef();
+
+    // 对象内存从空闲链表分配（见 ObjectPool.h）
+    static void* operator new(size_t cb, const std::nothrow_t&) noexcept;
+    static void operator delete(void* pv) noexcept;
+    static void operator delete(void* pv, const std::nothrow_t&) noexcept;
+    static void GetPoolStats(OBJECT_POOL_STATS* pStats);
+
+protected:
+    ~WinUnlockProvider();
+
+private:
+    static void CALLBACK s_PrefetchComplete(void* pvContext, HRESULT hr);
+    void _OnPrefetchComplete(HRESULT hr);
+    static void CALLBACK s_UnlockSignaled(void* pvContext);
+    static void CALLBACK s_ConfigChanged(void* pvContext, DWORD dwGeneration);
+    HRESULT _QueryCredentialCount(DWORD* pcTiles, LONG* plGeneration, DWORD dwTimeoutMs);
+    HRESULT _UpdateTiles(DWORD cTiles, LONG lGeneration);
+    void _ReleaseTiles();
+    HRESULT _CanAutoSubmitDefault();
+
+    LONG _cRef;
+    SRWLOCK _lockEvents;        // 保护 _pcpe / _upAdviseContext，预取完成回调在线程池线程上访问
+    CREDENTIAL_PROVIDER_USAGE_SCENARIO _cpus;
+    ICredentialProviderEvents* _pcpe;
+    UINT_PTR _upAdviseContext;
+    CredentialCache* _pCache;
+    UnlockSignal* _pSignal;                 // 配置了 SignalKey 时监听外部解锁信号，否则为 nullptr
+    ConfigWatcher* _pConfigWatch;           // 监听配置工具的保存，重新加载后通知 LogonUI
+    const STRING_TABLE* _pStrings;          // 按用户界面语言选定，DLL 卸载前一直有效
+    PWSTR _pszLockedUserSid;                // 解锁场景下锁定会话所属用户的 SID
+    WinUnlockCredential** _rgpCredentials;  // 每个磁贴一个，在 GetCredentialAt 中按需创建
+    DWORD _cTiles;
+    LONG _lTilesGeneration;                 // 磁贴对应的账户快照代数
+    DWORD _dwFieldIDToSetFocus;
+    DWORD _dwSetSerializationCred;
+    bool _bAutoSubmit;
+    volatile LONG _fPrefetchLate;   // GetCredentialCount 未等到预取结果，完成时需通知 LogonUI
+    volatile LONG _fConfigReloadPending;    // 配置变更后已开始重新读取，完成时需通知 LogonUI
+};
@@ -0,0 +1,736 @@
+#include "pch.h"
+#include "CredentialSource.h"
+#include "ConfigFile.h"
+#include "SharedCache.h"
+#include "Vault.h"
+#include <wincrypt.h>
+
+#pragma comment(lib, "crypt32.lib")
+
+#ifndef REG_NOTIFY_THREAD_AGNOSTIC
+#define REG_NOTIFY_THREAD_AGNOSTIC 0x10000000L
+#endif
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+
+// 解析依次存放的 "用户名\0密码\0" 并追加到账户表，结尾不完整的一组视为数据损坏
+static HRESULT AddAccountPairs(PCWSTR pch, size_t cch, AccountTable* pTable)
+{
+    HRESULT hr = S_OK;
+    while ((cch > 0) && *pch && SUCCEEDED(hr))
+    {
+        size_t cchUser = wcsnlen(pch, cch);
+        if (cchUser + 1 >= cch)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        PCWSTR pszPass = pch + cchUser + 1;
+        size_t cchPass = wcsnlen(pszPass, cch - cchUser - 1);
+        if (cchPass >= cch - cchUser - 1)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        hr = pTable->AddAccount(pch, pszPass);
+        pch = pszPass + cchPass + 1;
+        cch -= cchUser + cchPass + 2;
+    }
+    return hr;
+}
+
+// CredentialSourceBase
+
+CredentialSourceBase::CredentialSourceBase()
+{
+    ZeroMemory(&_latency, sizeof(_latency));
+}
+
+HRESULT CredentialSourceBase::LoadAccounts(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable)
+{
+    static LARGE_INTEGER s_liFrequency = { 0 };
+    if (!s_liFrequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&s_liFrequency);
+    }
+
+    DWORD cAccounts = pTable->GetCount();
+
+    LARGE_INTEGER liStart;
+    LARGE_INTEGER liEnd;
+    QueryPerformanceCounter(&liStart);
+    HRESULT hr = _Load(cpus, pTable);
+
+    // 仍在读取线程上：为以用户名为键的账户建立 SID 映射，Find 不再调用 LSA。
+    // 失败只影响解锁场景按 SID 找到这些账户，按用户名仍可使用
+    pTable->ResolveUsernameKeys();
+    QueryPerformanceCounter(&liEnd);
+
+    // 部分账户读取失败不影响已读到的账户；一个都没有时视为失败
+    if (pTable->GetCount() > cAccounts)
+    {
+        hr = S_OK;
+    }
+    else if (SUCCEEDED(hr))
+    {
+        hr = E_FAIL;
+    }
+
+    ULONGLONG ullMicroseconds = (ULONGLONG)(liEnd.QuadPart - liStart.QuadPart) * 1000000 / (ULONGLONG)s_liFrequency.QuadPart;
+    _latency.cLookups++;
+    _latency.ullLastMicroseconds = ullMicroseconds;
+    _latency.ullTotalMicroseconds += ullMicroseconds;
+    return hr;
+}
+
+void CredentialSourceBase::GetLatency(CREDENTIAL_SOURCE_LATENCY* pLatency)
+{
+    *pLatency = _latency;
+}
+
+// RegistryCredentialSource
+
+RegistryCredentialSource::RegistryCredentialSource() :
+    _hKey(nullptr),
+    _hChangeEvent(nullptr),
+    _fArmed(false)
+{
+}
+
+RegistryCredentialSource::~RegistryCredentialSource()
+{
+    if (_hKey)
+    {
+        RegCloseKey(_hKey);
+        _hKey = nullptr;
+    }
+    if (_hChangeEvent)
+    {
+        CloseHandle(_hChangeEvent);
+        _hChangeEvent = nullptr;
+    }
+}
+
+// 在读取数值之前挂上变更通知，保证读取之后发生的修改一定会被发现
+HRESULT RegistryCredentialSource::_ArmChangeNotification()
+{
+    if (!_hChangeEvent)
+    {
+        _hChangeEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (!_hChangeEvent)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    ResetEvent(_hChangeEvent);
+    LONG lResult = RegNotifyChangeKeyValue(_hKey, TRUE,
+        REG_NOTIFY_CHANGE_NAME | REG_NOTIFY_CHANGE_LAST_SET | REG_NOTIFY_THREAD_AGNOSTIC,
+        _hChangeEvent, TRUE);
+    _fArmed = (lResult == ERROR_SUCCESS);
+    return HRESULT_FROM_WIN32(lResult);
+}
+
+bool RegistryCredentialSource::HasChanged()
+{
+    // 配置项不存在或无法监视时无法得知变化，每次都重新读取
+    if (!_hKey || !_fArmed)
+    {
+        return true;
+    }
+    return WaitForSingleObject(_hChangeEvent, 0) == WAIT_OBJECT_0;
+}
+
+// 读取一个键下的 Username / Password；pszSidValue 不为 nullptr 时同时读取该值作为账户键
+HRESULT RegistryCredentialSource::_LoadAccountKey(HKEY hKey, PCWSTR pszSidValue, AccountTable* pTable)
+{
+    HRESULT hr = E_FAIL;
+    WCHAR szUsername[256] = { 0 };
+    WCHAR szPassword[256] = { 0 };
+    DWORD dwType = REG_SZ;
+    DWORD dwSize = sizeof(szUsername) - sizeof(WCHAR);
+
+    if (RegQueryValueExW(hKey, L"Username", nullptr, &dwType, (LPBYTE)szUsername, &dwSize) == ERROR_SUCCESS)
+    {
+        dwSize = sizeof(szPassword) - sizeof(WCHAR);
+        if (RegQueryValueExW(hKey, L"Password", nullptr, &dwType, (LPBYTE)szPassword, &dwSize) == ERROR_SUCCESS)
+        {
+            WCHAR szSid[256] = { 0 };
+            dwSize = sizeof(szSid) - sizeof(WCHAR);
+            if (pszSidValue &&
+                (RegQueryValueExW(hKey, pszSidValue, nullptr, &dwType, (LPBYTE)szSid, &dwSize) == ERROR_SUCCESS) &&
+                (dwType == REG_SZ) && szSid[0])
+            {
+                hr = pTable->AddAccountWithSid(szSid, szUsername, szPassword);
+            }
+            else
+            {
+                hr = pTable->AddAccount(szUsername, szPassword);
+            }
+        }
+    }
+    SecureZeroMemory(szPassword, sizeof(szPassword));
+    return hr;
+}
+
+HRESULT RegistryCredentialSource::_Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable)
+{
+    UNREFERENCED_PARAMETER(cpus);
+    HRESULT hr = E_FAIL;
+
+    // 从注册表读取（仅用于演示，实际应使用更安全的方法）
+    if (!_hKey)
+    {
+        if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, c_szConfigKey, 0, KEY_READ, &_hKey) != ERROR_SUCCESS)
+        {
+            _hKey = nullptr;
+        }
+    }
+
+    if (_hKey)
+    {
+        if (!_fArmed || WaitForSingleObject(_hChangeEvent, 0) == WAIT_OBJECT_0)
+        {
+            _ArmChangeNotification();
+        }
+
+        // 顶层的 Username / Password 兼容单账户配置
+        hr = _LoadAccountKey(_hKey, nullptr, pTable);
+
+        HKEY hAccounts = nullptr;
+        if (RegOpenKeyExW(_hKey, L"Accounts", 0, KEY_READ, &hAccounts) == ERROR_SUCCESS)
+        {
+            WCHAR szSubKey[256];
+            for (DWORD i = 0; ; i++)
+            {
+                DWORD cchSubKey = ARRAYSIZE(szSubKey);
+                LONG lResult = RegEnumKeyExW(hAccounts, i, szSubKey, &cchSubKey, nullptr, nullptr, nullptr, nullptr);
+                if (lResult == ERROR_MORE_DATA)
+                {
+                    continue;
+                }
+                if (lResult != ERROR_SUCCESS)
+                {
+                    break;
+                }
+
+                HKEY hAccount = nullptr;
+                if (RegOpenKeyExW(hAccounts, szSubKey, 0, KEY_READ, &hAccount) == ERROR_SUCCESS)
+                {
+                    // 单个账户配置错误不影响其余账户
+                    _LoadAccountKey(hAccount, L"Sid", pTable);
+                    RegCloseKey(hAccount);
+                }
+            }
+            RegCloseKey(hAccounts);
+        }
+    }
+
+    return hr;
+}
+
+// CurrentUserCredentialSource
+
+HRESULT CurrentUserCredentialSource::_Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable)
+{
+    HRESULT hr = E_FAIL;
+
+    // 仅用于解锁场景
+    if (cpus == CPUS_UNLOCK_WORKSTATION)
+    {
+        // 获取当前锁定的用户名
+        WCHAR szCurrentUser[256] = { 0 };
+        DWORD dwSize = sizeof(szCurrentUser) / sizeof(WCHAR);
+        if (GetUserNameW(szCurrentUser, &dwSize))
+        {
+            // 这里应该从安全存储中读取密码
+            // 实际实现应该使用 Windows Credential Manager 或 DPAPI 加密存储
+            hr = pTable->AddAccount(szCurrentUser, L""); // 空密码仅用于演示
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    return hr;
+}
+
+// VaultFileCredentialSource
+
+VaultFileCredentialSource::VaultFileCredentialSource(PCWSTR pszPath) :
+    _cbFile(0),
+    _fStamped(false)
+{
+    StringCchCopyW(_szPath, ARRAYSIZE(_szPath), pszPath);
+    ZeroMemory(&_ftLastWrite, sizeof(_ftLastWrite));
+}
+
+bool VaultFileCredentialSource::_GetFileStamp(FILETIME* pftLastWrite, ULONGLONG* pcbFile)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExW(_szPath, GetFileExInfoStandard, &fad))
+    {
+        return false;
+    }
+    *pftLastWrite = fad.ftLastWriteTime;
+    *pcbFile = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    return true;
+}
+
+bool VaultFileCredentialSource::HasChanged()
+{
+    FILETIME ftLastWrite;
+    ULONGLONG cbFile = 0;
+    bool fExists = _GetFileStamp(&ftLastWrite, &cbFile);
+    if (!_fStamped || !fExists)
+    {
+        return fExists != _fStamped;
+    }
+    return (CompareFileTime(&ftLastWrite, &_ftLastWrite) != 0) || (cbFile != _cbFile);
+}
+
+HRESULT VaultFileCredentialSource::_Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable)
+{
+    UNREFERENCED_PARAMETER(cpus);
+
+    // 先记录文件时间戳，读取之后的修改会被 HasChanged 发现
+    _fStamped = _GetFileStamp(&_ftLastWrite, &_cbFile);
+    if (!_fStamped)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+    if ((_cbFile == 0) || (_cbFile > VAULT_FILE_MAX_SIZE))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    HANDLE hFile = CreateFileW(_szPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = E_OUTOFMEMORY;
+    BYTE* pbFile = (BYTE*)CoTaskMemAlloc((SIZE_T)_cbFile);
+    if (pbFile)
+    {
+        DWORD cbRead = 0;
+        if (!ReadFile(hFile, pbFile, (DWORD)_cbFile, &cbRead, nullptr) || (cbRead != _cbFile))
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_READ_FAULT);
+        }
+        else if (VaultIsSealed(pbFile, cbRead))
+        {
+            // 口令保险库：一次派生密钥，全部账户一次解密
+            BYTE rgbPassphrase[VAULT_PASSPHRASE_MAX];
+            DWORD cbPassphrase = 0;
+            hr = VaultReadPassphrase(rgbPassphrase, &cbPassphrase);
+            if (SUCCEEDED(hr))
+            {
+                SecretString accounts;
+                DWORD cchAccounts = 0;
+                hr = VaultOpen(rgbPassphrase, cbPassphrase, pbFile, cbRead, &accounts, &cchAccounts);
+                if (SUCCEEDED(hr))
+                {
+                    hr = AddAccountPairs(accounts.Get(), cchAccounts, pTable);
+                }
+                SecureZeroMemory(rgbPassphrase, sizeof(rgbPassphrase));
+            }
+        }
+        else
+        {
+            DATA_BLOB blobIn = { cbRead, pbFile };
+            DATA_BLOB blobOut = { 0, nullptr };
+            if (CryptUnprotectData(&blobIn, nullptr, nullptr, nullptr, nullptr, CRYPTPROTECT_UI_FORBIDDEN, &blobOut))
+            {
+                // 内容是成对的以 NUL 结尾的 UTF-16 字符串
+                hr = AddAccountPairs((PCWSTR)blobOut.pbData, blobOut.cbData / sizeof(WCHAR), pTable);
+                SecureZeroMemory(blobOut.pbData, blobOut.cbData);
+                LocalFree(blobOut.pbData);
+            }
+            else
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+        }
+        CoTaskMemFree(pbFile);
+    }
+    CloseHandle(hFile);
+    return hr;
+}
+
+// ConfigFileCredentialSource
+
+ConfigFileCredentialSource::ConfigFileCredentialSource(PCWSTR pszPath) :
+    _cbFile(0),
+    _fStamped(false)
+{
+    StringCchCopyW(_szPath, ARRAYSIZE(_szPath), pszPath);
+    ZeroMemory(&_ftLastWrite, sizeof(_ftLastWrite));
+}
+
+bool ConfigFileCredentialSource::_GetFileStamp(FILETIME* pftLastWrite, ULONGLONG* pcbFile)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExW(_szPath, GetFileExInfoStandard, &fad))
+    {
+        return false;
+    }
+    *pftLastWrite = fad.ftLastWriteTime;
+    *pcbFile = ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+    return true;
+}
+
+bool ConfigFileCredentialSource::HasChanged()
+{
+    FILETIME ftLastWrite;
+    ULONGLONG cbFile = 0;
+    bool fExists = _GetFileStamp(&ftLastWrite, &cbFile);
+    if (!_fStamped || !fExists)
+    {
+        return fExists != _fStamped;
+    }
+    return (CompareFileTime(&ftLastWrite, &_ftLastWrite) != 0) || (cbFile != _cbFile);
+}
+
+HRESULT ConfigFileCredentialSource::_Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable)
+{
+    UNREFERENCED_PARAMETER(cpus);
+
+    // 先记录文件时间戳，读取之后的修改会被 HasChanged 发现
+    _fStamped = _GetFileStamp(&_ftLastWrite, &_cbFile);
+    if (!_fStamped)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    }
+
+    // 跨会话共享缓存中的内容与文件时间戳一致时直接使用，不再打开文件；
+    // 否则读取文件并发布给其余会话（见 SharedCache.h）
+    ULARGE_INTEGER uliLastWrite;
+    uliLastWrite.LowPart = _ftLastWrite.dwLowDateTime;
+    uliLastWrite.HighPart = _ftLastWrite.dwHighDateTime;
+    SharedCache* pShared = SharedCache::GetDefault();
+    BYTE* pbShared = nullptr;
+    ConfigView sharedView;
+    if (pShared)
+    {
+        DWORD cbShared = 0;
+        ULONGLONG ullWriteTime = 0;
+        ULONGLONG cbFile = 0;
+        if (SUCCEEDED(pShared->ReadConfig(&pbShared, &cbShared, &ullWriteTime, &cbFile)) &&
+            ((ullWriteTime != uliLastWrite.QuadPart) || (cbFile != _cbFile) || FAILED(sharedView.Attach(pbShared, cbShared))))
+        {
+            CoTaskMemFree(pbShared);
+            pbShared = nullptr;
+        }
+    }
+
+    // 映射只保持到读完账户为止，不妨碍配置工具替换文件
+    ConfigFile file;
+    if (!pbShared)
+    {
+        HRESULT hrOpen = file.Open(_szPath);
+        if (FAILED(hrOpen))
+        {
+            return hrOpen;
+        }
+        // 打开前文件可能已被替换，大小与时间戳不符时不发布
+        if (pShared && (file.GetSize() == _cbFile))
+        {
+            pShared->PublishConfig(uliLastWrite.QuadPart, _cbFile, file.GetData(), file.GetSize());
+        }
+    }
+
+    HRESULT hr = _LoadAccounts(pbShared ? sharedView : file.GetView(), pTable);
+    if (pbShared)
+    {
+        sharedView.Detach();
+        CoTaskMemFree(pbShared);
+    }
+    return hr;
+}
+
+HRESULT ConfigFileCredentialSource::_LoadAccounts(const ConfigView& view, AccountTable* pTable)
+{
+    if (!(view.GetFlags() & CONFIG_FLAG_AUTO_UNLOCK_ENABLED))
+    {
+        return E_AUTO_UNLOCK_DISABLED;
+    }
+
+    HRESULT hr = E_FAIL;
+    for (DWORD i = 0; i < view.GetAccountCount(); i++)
+    {
+        CONFIG_ACCOUNT_VIEW account;
+        view.GetAccount(i, &account);
+
+        // 单个账户无法解封不影响其余账户
+        SecretString password;
+        HRESULT hrAccount = ConfigUnsealSecret(account.pbSealed, account.cbSealed, &password);
+        if (SUCCEEDED(hrAccount))
+        {
+            hrAccount = account.pszSid[0] ?
+                pTable->AddAccountWithSid(account.pszSid, account.pszUsername, password.Get()) :
+                pTable->AddAccount(account.pszUsername, password.Get());
+        }
+        if (FAILED(hr))
+        {
+            hr = hrAccount;
+        }
+    }
+    return hr;
+}
+
+// MemoryCredentialSource
+
+MemoryCredentialSource::MemoryCredentialSource() :
+    _pszPairs(nullptr),
+    _cchPairs(0),
+    _lGeneration(0),
+    _lFetchedGeneration(-1)
+{
+}
+
+MemoryCredentialSource::~MemoryCredentialSource()
+{
+    _Clear();
+}
+
+void MemoryCredentialSource::_Clear()
+{
+    if (_pszPairs)
+    {
+        SecureZeroMemory(_pszPairs, _cchPairs * sizeof(WCHAR));
+        CoTaskMemFree(_pszPairs);
+        _pszPairs = nullptr;
+    }
+    _cchPairs = 0;
+}
+
+HRESULT MemoryCredentialSource::SetCredentials(PCWSTR pszUsername, PCWSTR pszPassword)
+{
+    HRESULT hr = S_OK;
+    _Clear();
+    if (pszUsername)
+    {
+        hr = AddAccount(pszUsername, pszPassword);
+    }
+    else
+    {
+        InterlockedIncrement(&_lGeneration);
+    }
+    return hr;
+}
+
+HRESULT MemoryCredentialSource::AddAccount(PCWSTR pszUsername, PCWSTR pszPassword)
+{
+    if (!pszUsername || !*pszUsername)
+    {
+        return E_INVALIDARG;
+    }
+    if (!pszPassword)
+    {
+        pszPassword = L"";
+    }
+
+    size_t cchUser = wcslen(pszUsername) + 1;
+    size_t cchPass = wcslen(pszPassword) + 1;
+    PWSTR pszPairs = (PWSTR)CoTaskMemAlloc((_cchPairs + cchUser + cchPass) * sizeof(WCHAR));
+    if (!pszPairs)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // 不用 CoTaskMemRealloc，旧缓冲区中的密码需要先清零再释放
+    if (_pszPairs)
+    {
+        CopyMemory(pszPairs, _pszPairs, _cchPairs * sizeof(WCHAR));
+    }
+    CopyMemory(pszPairs + _cchPairs, pszUsername, cchUser * sizeof(WCHAR));
+    CopyMemory(pszPairs + _cchPairs + cchUser, pszPassword, cchPass * sizeof(WCHAR));
+
+    size_t cchPairs = _cchPairs + cchUser + cchPass;
+    _Clear();
+    _pszPairs = pszPairs;
+    _cchPairs = cchPairs;
+    InterlockedIncrement(&_lGeneration);
+    return S_OK;
+}
+
+bool MemoryCredentialSource::HasChanged()
+{
+    return _lFetchedGeneration != _lGeneration;
+}
+
+HRESULT MemoryCredentialSource::_Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable)
+{
+    UNREFERENCED_PARAMETER(cpus);
+    _lFetchedGeneration = _lGeneration;
+
+    HRESULT hr = E_FAIL;
+    if (_pszPairs)
+    {
+        hr = AddAccountPairs(_pszPairs, _cchPairs, pTable);
+    }
+    return hr;
+}
+
+// ChainedCredentialSource
+
+ChainedCredentialSource::ChainedCredentialSource() :
+    _cSources(0)
+{
+    ZeroMemory(_rgSources, sizeof(_rgSources));
+}
+
+ChainedCredentialSource::~ChainedCredentialSource()
+{
+    for (DWORD i = 0; i < _cSources; i++)
+    {
+        delete _rgSources[i];
+        _rgSources[i] = nullptr;
+    }
+    _cSources = 0;
+}
+
+HRESULT ChainedCredentialSource::Append(ICredentialSource* pSource)
+{
+    if (!pSource)
+    {
+        return E_INVALIDARG;
+    }
+    if (_cSources >= MAX_SOURCES)
+    {
+        delete pSource;
+        return E_BOUNDS;
+    }
+    _rgSources[_cSources++] = pSource;
+    return S_OK;
+}
+
+bool ChainedCredentialSource::HasChanged()
+{
+    // 任一来源变更都可能改变胜出的结果
+    bool fChanged = false;
+    for (DWORD i = 0; i < _cSources; i++)
+    {
+        if (_rgSources[i]->HasChanged())
+        {
+            fChanged = true;
+        }
+    }
+    return fChanged;
+}
+
+HRESULT ChainedCredentialSource::_Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable)
+{
+    HRESULT hr = E_FAIL;
+    for (DWORD i = 0; (i < _cSources) && FAILED(hr) && (hr != E_AUTO_UNLOCK_DISABLED); i++)
+    {
+        hr = _rgSources[i]->LoadAccounts(cpus, pTable);
+    }
+    return hr;
+}
+
+// 按名称创建单个来源
+static ICredentialSource* CreateCredentialSourceByName(HKEY hKey, PCWSTR pszName)
+{
+    ICredentialSource* pSource = nullptr;
+    if (_wcsicmp(pszName, L"config") == 0)
+    {
+        WCHAR szPath[MAX_PATH];
+        if (SUCCEEDED(GetConfigFilePath(szPath, ARRAYSIZE(szPath))))
+        {
+            pSource = new(std::nothrow) ConfigFileCredentialSource(szPath);
+        }
+    }
+    else if (_wcsicmp(pszName, L"registry") == 0)
+    {
+        pSource = new(std::nothrow) RegistryCredentialSource();
+    }
+    else if (_wcsicmp(pszName, L"currentuser") == 0)
+    {
+        pSource = new(std::nothrow) CurrentUserCredentialSource();
+    }
+    else if (_wcsicmp(pszName, L"vault") == 0)
+    {
+        // 保险库路径：VaultPath，默认 VAULT_FILE_DEFAULT_PATH
+        WCHAR szRaw[MAX_PATH] = VAULT_FILE_DEFAULT_PATH;
+        WCHAR szPath[MAX_PATH] = { 0 };
+        DWORD cbRaw = sizeof(szRaw) - sizeof(WCHAR);
+        if (hKey)
+        {
+            DWORD dwType = REG_SZ;
+            WCHAR szValue[MAX_PATH] = { 0 };
+            if ((RegQueryValueExW(hKey, L"VaultPath", nullptr, &dwType, (LPBYTE)szValue, &cbRaw) == ERROR_SUCCESS) &&
+                ((dwType == REG_SZ) || (dwType == REG_EXPAND_SZ)) && szValue[0])
+            {
+                StringCchCopyW(szRaw, ARRAYSIZE(szRaw), szValue);
+            }
+        }
+        if (ExpandEnvironmentStringsW(szRaw, szPath, ARRAYSIZE(szPath)))
+        {
+            pSource = new(std::nothrow) VaultFileCredentialSource(szPath);
+        }
+    }
+    else if (_wcsicmp(pszName, L"memory") == 0)
+    {
+        pSource = new(std::nothrow) MemoryCredentialSource();
+    }
+    return pSource;
+}
+
+HRESULT CreateConfiguredCredentialSource(ICredentialSource** ppSource)
+{
+    *ppSource = nullptr;
+
+    ChainedCredentialSource* pChain = new(std::nothrow) ChainedCredentialSource();
+    if (!pChain)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HKEY hKey = nullptr;
+    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, c_szConfigKey, 0, KEY_READ, &hKey) != ERROR_SUCCESS)
+    {
+        hKey = nullptr;
+    }
+
+    // CredentialSources: REG_MULTI_SZ，例如 config / vault / registry / currentuser
+    WCHAR szNames[512] = { 0 };
+    DWORD cbNames = sizeof(szNames) - 2 * sizeof(WCHAR);
+    DWORD dwType = REG_MULTI_SZ;
+    if (!hKey ||
+        (RegQueryValueExW(hKey, L"CredentialSources", nullptr, &dwType, (LPBYTE)szNames, &cbNames) != ERROR_SUCCESS) ||
+        (dwType != REG_MULTI_SZ) || !szNames[0])
+    {
+        ZeroMemory(szNames, sizeof(szNames));
+        StringCchCopyW(szNames, ARRAYSIZE(szNames), L"config");
+        StringCchCopyW(szNames + 7, ARRAYSIZE(szNames) - 7, L"registry");
+        StringCchCopyW(szNames + 16, ARRAYSIZE(szNames) - 16, L"currentuser");
+    }
+
+    HRESULT hr = S_OK;
+    for (PCWSTR pszName = szNames; *pszName && SUCCEEDED(hr); pszName += wcslen(pszName) + 1)
+    {
+        ICredentialSource* pSource = CreateCredentialSourceByName(hKey, pszName);
+        if (pSource)
+        {
+            hr = pChain->Append(pSource);
+        }
+    }
+
+    if (hKey)
+    {
+        RegCloseKey(hKey);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppSource = pChain;
+    }
+    else
+    {
+        delete pChain;
+    }
+    return hr;
+}
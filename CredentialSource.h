@@ -0,0 +1,197 @@
+#pragma once
+
+#include "pch.h"
+#include "AccountTable.h"
+#include "ConfigFormat.h"
+
+// 凭据来源耗时统计（微秒）
+struct CREDENTIAL_SOURCE_LATENCY
+{
+    ULONG cLookups;
+    ULONGLONG ullLastMicroseconds;
+    ULONGLONG ullTotalMicroseconds;
+};
+
+// 来源确认自动解锁已被关闭（配置文件清除了 CONFIG_FLAG_AUTO_UNLOCK_ENABLED）。
+// 这是终止结果：来源链不再尝试后面的来源，关闭之后注册表中残留的旧密码也不会生效
+#define E_AUTO_UNLOCK_DISABLED MAKE_HRESULT(SEVERITY_ERROR, FACILITY_ITF, 0x0201)
+
+// 凭据来源接口
+// 负责读取自动解锁账户，并报告底层存储自上次读取以来是否发生变化，
+// CredentialCache 据此决定是否需要重新读取
+class ICredentialSource
+{
+public:
+    virtual ~ICredentialSource() {}
+
+    // 来源名称，与配置项 CredentialSources 中的名称一致
+    virtual PCWSTR GetName() = 0;
+
+    // 读取账户并追加到 pTable，至少追加一个账户时才返回成功
+    virtual HRESULT LoadAccounts(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) = 0;
+
+    // 自上次 LoadAccounts 以来存储是否已变更
+    virtual bool HasChanged() = 0;
+
+    // 本来源自身的读取耗时
+    virtual void GetLatency(CREDENTIAL_SOURCE_LATENCY* pLatency) = 0;
+};
+
+// 凭据来源基类：统一统计每次读取的耗时，派生类只需实现 _Load
+class CredentialSourceBase : public ICredentialSource
+{
+public:
+    CredentialSourceBase();
+
+    HRESULT LoadAccounts(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) final;
+    void GetLatency(CREDENTIAL_SOURCE_LATENCY* pLatency) override;
+
+protected:
+    virtual HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) = 0;
+
+private:
+    CREDENTIAL_SOURCE_LATENCY _latency;
+};
+
+// 注册表凭据来源：HKLM\SOFTWARE\WinUnlock 下的 Username / Password，
+// 以及 Accounts 下每个子项中的 Username / Password / Sid（Sid 可选，未配置时按用户名解析）
+// 通过 RegNotifyChangeKeyValue 监视整个配置子树，仅在配置变更后才需要重新读取
+class RegistryCredentialSource : public CredentialSourceBase
+{
+public:
+    RegistryCredentialSource();
+    ~RegistryCredentialSource();
+
+    PCWSTR GetName() override { return L"registry"; }
+    bool HasChanged() override;
+
+protected:
+    HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override;
+
+private:
+    HRESULT _ArmChangeNotification();
+    static HRESULT _LoadAccountKey(HKEY hKey, PCWSTR pszSidValue, AccountTable* pTable);
+
+    HKEY _hKey;
+    HANDLE _hChangeEvent;
+    bool _fArmed;
+};
+
+// 当前用户凭据来源：仅用于解锁场景，用户名取自 GetUserNameW，密码为空（仅用于演示）
+class CurrentUserCredentialSource : public CredentialSourceBase
+{
+public:
+    PCWSTR GetName() override { return L"currentuser"; }
+    bool HasChanged() override { return false; }
+
+protected:
+    HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override;
+};
+
+// 加密保险库文件凭据来源
+// 文件内容为 DPAPI（本机范围）加密的一组或多组 "用户名\0密码\0" UTF-16 字符串，
+// 或以口令保护的保险库（见 Vault.h，口令来自 VAULT_PASSPHRASE_PATH）；
+// 通过比较文件最后写入时间和大小判断是否变更
+class VaultFileCredentialSource : public CredentialSourceBase
+{
+public:
+    VaultFileCredentialSource(PCWSTR pszPath);
+
+    PCWSTR GetName() override { return L"vault"; }
+    bool HasChanged() override;
+
+protected:
+    HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override;
+
+private:
+    bool _GetFileStamp(FILETIME* pftLastWrite, ULONGLONG* pcbFile);
+    static HRESULT _LoadAccounts(const ConfigView& view, AccountTable* pTable);
+
+    WCHAR _szPath[MAX_PATH];
+    FILETIME _ftLastWrite;
+    ULONGLONG _cbFile;
+    bool _fStamped;
+};
+
+// 二进制配置文件凭据来源：读取配置工具保存的 config.bin（见 ConfigFormat.h），
+// 一次映射读出全部账户；配置关闭自动解锁时不提供账户。通过文件最后写入时间和大小判断是否变更
+class ConfigFileCredentialSource : public CredentialSourceBase
+{
+public:
+    ConfigFileCredentialSource(PCWSTR pszPath);
+
+    PCWSTR GetName() override { return L"config"; }
+    bool HasChanged() override;
+
+protected:
+    HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override;
+
+private:
+    bool _GetFileStamp(FILETIME* pftLastWrite, ULONGLONG* pcbFile);
+    static HRESULT _LoadAccounts(const ConfigView& view, AccountTable* pTable);
+
+    WCHAR _szPath[MAX_PATH];
+    FILETIME _ftLastWrite;
+    ULONGLONG _cbFile;
+    bool _fStamped;
+};
+
+// 内存凭据来源：账户由调用方直接设置，用于测试和嵌入场景
+class MemoryCredentialSource : public CredentialSourceBase
+{
+public:
+    MemoryCredentialSource();
+    ~MemoryCredentialSource();
+
+    PCWSTR GetName() override { return L"memory"; }
+    bool HasChanged() override;
+
+    // 设置唯一的账户，pszUsername 为 nullptr 时清除所有账户
+    HRESULT SetCredentials(PCWSTR pszUsername, PCWSTR pszPassword);
+
+    // 追加账户
+    HRESULT AddAccount(PCWSTR pszUsername, PCWSTR pszPassword);
+
+protected:
+    HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override;
+
+private:
+    void _Clear();
+
+    // 依次存放的 "用户名\0密码\0"
+    PWSTR _pszPairs;
+    size_t _cchPairs;
+    LONG _lGeneration;
+    LONG _lFetchedGeneration;
+};
+
+// 链式凭据来源：按顺序尝试各来源，第一个读到账户的来源胜出；
+// 某个来源返回 E_AUTO_UNLOCK_DISABLED 时就此停止，整条链返回该结果
+class ChainedCredentialSource : public CredentialSourceBase
+{
+public:
+    static const DWORD MAX_SOURCES = 8;
+
+    ChainedCredentialSource();
+    ~ChainedCredentialSource();
+
+    PCWSTR GetName() override { return L"chain"; }
+    bool HasChanged() override;
+
+    // 追加来源并接管其所有权
+    HRESULT Append(ICredentialSource* pSource);
+
+    DWORD GetSourceCount() const { return _cSources; }
+    ICredentialSource* GetSourceAt(DWORD dwIndex) const { return (dwIndex < _cSources) ? _rgSources[dwIndex] : nullptr; }
+
+protected:
+    HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override;
+
+private:
+    ICredentialSource* _rgSources[MAX_SOURCES];
+    DWORD _cSources;
+};
+
+// 按配置项 HKLM\SOFTWARE\WinUnlock\CredentialSources（REG_MULTI_SZ）构建来源链，
+// 未配置时为 config -> registry -> currentuser
+HRESULT CreateConfiguredCredentialSource(ICredentialSource** ppSource);
@@ -0,0 +1,147 @@
+#include "pch.h"
+#include "CredentialState.h"
+#include <malloc.h>
+
+// 每个状态允许转换到的状态（位掩码）
+#define CS_BIT(state) (1u << (state))
+
+static const DWORD c_rgdwValidTransitions[CS_NUM_STATES] =
+{
+    /* CS_IDLE       */ CS_BIT(CS_FETCHING) | CS_BIT(CS_READY) | CS_BIT(CS_SUBMITTING),
+    /* CS_FETCHING   */ CS_BIT(CS_IDLE) | CS_BIT(CS_READY),
+    /* CS_READY      */ CS_BIT(CS_IDLE) | CS_BIT(CS_SUBMITTING),
+    /* CS_SUBMITTING */ CS_BIT(CS_IDLE) | CS_BIT(CS_FETCHING) | CS_BIT(CS_DONE) | CS_BIT(CS_FAILED),
+    /* CS_DONE       */ CS_BIT(CS_IDLE) | CS_BIT(CS_FETCHING) | CS_BIT(CS_READY) | CS_BIT(CS_SUBMITTING),
+    /* CS_FAILED     */ CS_BIT(CS_IDLE) | CS_BIT(CS_FETCHING) | CS_BIT(CS_READY) | CS_BIT(CS_SUBMITTING),
+};
+
+// CredentialStateMachine
+
+bool CredentialStateMachine::IsValidTransition(CREDENTIAL_STATE from, CREDENTIAL_STATE to)
+{
+    return (from < CS_NUM_STATES) && (to < CS_NUM_STATES) && (c_rgdwValidTransitions[from] & CS_BIT(to));
+}
+
+bool CredentialStateMachine::Transition(CREDENTIAL_STATE from, CREDENTIAL_STATE to)
+{
+    return IsValidTransition(from, to) && (InterlockedCompareExchange(&_lState, to, from) == (LONG)from);
+}
+
+bool CredentialStateMachine::TransitionTo(CREDENTIAL_STATE to, CREDENTIAL_STATE* pPrevious)
+{
+    for (;;)
+    {
+        CREDENTIAL_STATE from = Get();
+        if (pPrevious)
+        {
+            *pPrevious = from;
+        }
+        if (!IsValidTransition(from, to))
+        {
+            return false;
+        }
+        if (InterlockedCompareExchange(&_lState, to, from) == (LONG)from)
+        {
+            return true;
+        }
+    }
+}
+
+// CredentialEventQueue
+
+CredentialEventQueue::CredentialEventQueue()
+{
+    InitializeSListHead(&_head);
+}
+
+CredentialEventQueue::~CredentialEventQueue()
+{
+    Deliver(nullptr, nullptr);
+}
+
+HRESULT CredentialEventQueue::PostFieldString(DWORD dwFieldID, PCWSTR psz)
+{
+    return _Post(CET_FIELD_STRING, dwFieldID, 0, psz ? psz : L"");
+}
+
+HRESULT CredentialEventQueue::PostFieldState(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_STATE cpfs)
+{
+    return _Post(CET_FIELD_STATE, dwFieldID, cpfs, nullptr);
+}
+
+HRESULT CredentialEventQueue::PostFieldInteractiveState(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE cpfis)
+{
+    return _Post(CET_FIELD_INTERACTIVE_STATE, dwFieldID, cpfis, nullptr);
+}
+
+HRESULT CredentialEventQueue::_Post(CREDENTIAL_EVENT_TYPE type, DWORD dwFieldID, DWORD dwValue, PCWSTR psz)
+{
+    size_t cch = psz ? wcslen(psz) : 0;
+    if (cch >= STRSAFE_MAX_CCH)
+    {
+        return E_INVALIDARG;
+    }
+
+    // SLIST 节点须按 MEMORY_ALLOCATION_ALIGNMENT 对齐
+    CREDENTIAL_EVENT* pEvent = (CREDENTIAL_EVENT*)_aligned_malloc(sizeof(CREDENTIAL_EVENT) + cch * sizeof(WCHAR), MEMORY_ALLOCATION_ALIGNMENT);
+    if (!pEvent)
+    {
+        return E_OUTOFMEMORY;
+    }
+    pEvent->type = type;
+    pEvent->dwFieldID = dwFieldID;
+    pEvent->dwValue = dwValue;
+    pEvent->szValue[0] = L'\0';
+    if (psz)
+    {
+        CopyMemory(pEvent->szValue, psz, (cch + 1) * sizeof(WCHAR));
+    }
+
+    InterlockedPushEntrySList(&_head, &pEvent->entry);
+    return S_OK;
+}
+
+// SLIST 是后进先出的，取出后反转为投递顺序
+CREDENTIAL_EVENT* CredentialEventQueue::_Reverse(PSLIST_ENTRY pEntry)
+{
+    PSLIST_ENTRY pReversed = nullptr;
+    while (pEntry)
+    {
+        PSLIST_ENTRY pNext = pEntry->Next;
+        pEntry->Next = pReversed;
+        pReversed = pEntry;
+        pEntry = pNext;
+    }
+    return (CREDENTIAL_EVENT*)pReversed;
+}
+
+void CredentialEventQueue::_Free(CREDENTIAL_EVENT* pEvent)
+{
+    _aligned_free(pEvent);
+}
+
+void CredentialEventQueue::Deliver(ICredentialProviderCredential* pcpc, ICredentialProviderCredentialEvents* pcpce)
+{
+    CREDENTIAL_EVENT* pEvent = _Reverse(InterlockedFlushSList(&_head));
+    while (pEvent)
+    {
+        CREDENTIAL_EVENT* pNext = (CREDENTIAL_EVENT*)pEvent->entry.Next;
+        if (pcpce)
+        {
+            switch (pEvent->type)
+            {
+            case CET_FIELD_STRING:
+                pcpce->SetFieldString(pcpc, pEvent->dwFieldID, pEvent->szValue);
+                break;
+            case CET_FIELD_STATE:
+                pcpce->SetFieldState(pcpc, pEvent->dwFieldID, (CREDENTIAL_PROVIDER_FIELD_STATE)pEvent->dwValue);
+                break;
+            case CET_FIELD_INTERACTIVE_STATE:
+                pcpce->SetFieldInteractiveState(pcpc, pEvent->dwFieldID, (CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE)pEvent->dwValue);
+                break;
+            }
+        }
+        _Free(pEvent);
+        pEvent = pNext;
+    }
+}
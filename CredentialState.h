@@ -0,0 +1,91 @@
+#pragma once
+
+#include "pch.h"
+
+// 凭据状态机
+//
+//   Idle        -> Fetching / Ready / Submitting
+//   Fetching    -> Ready / Idle                       凭据来源未在期限内返回，线程池线程继续等待
+//   Ready       -> Submitting / Idle                  凭据可用且允许自动提交（SetSelected 返回 *pbAutoLogon = TRUE）
+//   Submitting  -> Done / Failed / Fetching / Idle    GetSerialization 已开始序列化，等待 ReportResult
+//   Done        -> Ready / Submitting / Fetching / Idle  LogonUI 复用磁贴（再次锁定后重新选中）时重新开始
+//   Failed      -> Ready / Submitting / Fetching / Idle
+//
+// 所有转换都是对一个 LONG 的原子比较交换，LogonUI 线程和线程池线程可以同时驱动；
+// 不在上表中的转换一律失败，状态不变。任何状态都可以回到 Idle（SetDeselected）。
+enum CREDENTIAL_STATE
+{
+    CS_IDLE = 0,
+    CS_FETCHING,
+    CS_READY,
+    CS_SUBMITTING,
+    CS_DONE,
+    CS_FAILED,
+    CS_NUM_STATES
+};
+
+class CredentialStateMachine
+{
+public:
+    CredentialStateMachine() : _lState(CS_IDLE) {}
+
+    CREDENTIAL_STATE Get() const { return (CREDENTIAL_STATE)_lState; }
+
+    // 当前状态为 from 时转换到 to；状态已被其他线程改变或转换不合法时返回 false
+    bool Transition(CREDENTIAL_STATE from, CREDENTIAL_STATE to);
+
+    // 从当前状态转换到 to，pPrevious（可为 nullptr）返回转换前的状态；转换不合法时返回 false
+    bool TransitionTo(CREDENTIAL_STATE to, CREDENTIAL_STATE* pPrevious = nullptr);
+
+    static bool IsValidTransition(CREDENTIAL_STATE from, CREDENTIAL_STATE to);
+
+private:
+    volatile LONG _lState;
+};
+
+// 凭据事件队列
+//
+// 线程池线程不能直接调用 ICredentialProviderCredentialEvents：LogonUI 可能正同时 Advise / UnAdvise，
+// 多个线程的字段更新也会交错。事件先投递到无锁队列（SLIST，任意线程可投递），
+// 再由同一时间唯一的消费者按投递顺序交给事件接收器。
+
+enum CREDENTIAL_EVENT_TYPE
+{
+    CET_FIELD_STRING = 0,           // SetFieldString
+    CET_FIELD_STATE,                // SetFieldState
+    CET_FIELD_INTERACTIVE_STATE,    // SetFieldInteractiveState
+};
+
+struct CREDENTIAL_EVENT
+{
+    SLIST_ENTRY entry;              // 必须是第一个成员，按 MEMORY_ALLOCATION_ALIGNMENT 对齐
+    CREDENTIAL_EVENT_TYPE type;
+    DWORD dwFieldID;
+    DWORD dwValue;                  // CET_FIELD_STATE / CET_FIELD_INTERACTIVE_STATE
+    WCHAR szValue[1];               // CET_FIELD_STRING，按实际长度分配
+};
+
+class CredentialEventQueue
+{
+public:
+    CredentialEventQueue();
+    ~CredentialEventQueue();
+
+    // 以下投递方法可在任意线程上调用
+    HRESULT PostFieldString(DWORD dwFieldID, PCWSTR psz);
+    HRESULT PostFieldState(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_STATE cpfs);
+    HRESULT PostFieldInteractiveState(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE cpfis);
+
+    bool HasPending() { return QueryDepthSList(&_head) != 0; }
+
+    // 取出当前所有事件并按投递顺序交给 pcpce（为 nullptr 时丢弃）。
+    // 同一时间只能有一个线程调用，由调用方保证
+    void Deliver(ICredentialProviderCredential* pcpc, ICredentialProviderCredentialEvents* pcpce);
+
+private:
+    HRESULT _Post(CREDENTIAL_EVENT_TYPE type, DWORD dwFieldID, DWORD dwValue, PCWSTR psz);
+    static CREDENTIAL_EVENT* _Reverse(PSLIST_ENTRY pEntry);
+    static void _Free(CREDENTIAL_EVENT* pEvent);
+
+    SLIST_HEADER _head;
+};
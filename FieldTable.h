@@ -0,0 +1,142 @@
+#pragma once
+
+#include "pch.h"
+#include "StringTable.h"
+#include <utility>
+
+// 磁贴字段布局
+//
+// 每个字段的类型、GUID、标签、显示状态、交互状态、提交按钮相邻字段和默认文本
+// 由 FieldTraits<> 特化描述，编译期展开为只读的 c_rgFieldTable，
+// 提供程序和所有凭据对象共享这一份表，不再逐实例复制或在 switch 中硬编码。
+// 新增字段只需在 FIELDID 中追加枚举值并补充对应的 FieldTraits 特化。
+
+// 字段类型 GUID
+__declspec(selectany) extern const GUID GUID_TILE_IMAGE =
+    { 0x2d837775, 0x8de1, 0x4e3e, { 0xb2, 0x98, 0x55, 0xfc, 0x6e, 0xec, 0x0c, 0x0a } };
+__declspec(selectany) extern const GUID GUID_LARGE_TEXT =
+    { 0xe7179c38, 0xbd07, 0x4708, { 0x8c, 0x8c, 0x8b, 0xcb, 0x40, 0xc3, 0x97, 0x50 } };
+__declspec(selectany) extern const GUID GUID_SMALL_TEXT =
+    { 0x6f45dc1e, 0x5384, 0x457a, { 0xbc, 0xc7, 0x4f, 0x95, 0x0f, 0x0e, 0x3e, 0xfb } };
+__declspec(selectany) extern const GUID GUID_SUBMIT_BUTTON =
+    { 0x30574de6, 0x3532, 0x4830, { 0xbd, 0x23, 0x08, 0x34, 0x72, 0xbd, 0x58, 0x93 } };
+
+// 字段索引定义
+enum FIELDID
+{
+    SFI_TILEIMAGE = 0,
+    SFI_LARGE_TEXT,
+    SFI_SMALL_TEXT,
+    SFI_SUBMIT_BUTTON,
+    SFI_NUM_FIELDS
+};
+
+struct FIELD_DEFINITION
+{
+    FIELDID fieldId;
+    CREDENTIAL_PROVIDER_FIELD_TYPE cpft;
+    const GUID* pguidFieldType;
+    PCWSTR pszLabel;
+    CREDENTIAL_PROVIDER_FIELD_STATE cpfs;
+    CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE cpfis;
+    DWORD dwAdjacentTo;     // 仅提交按钮使用：显示在哪个字段旁边
+    STRINGID stringId;      // GetStringValue 返回的本地化文本，STR_NONE 表示无
+};
+
+template <FIELDID id>
+struct FieldTraits;
+
+template <>
+struct FieldTraits<SFI_TILEIMAGE>
+{
+    static constexpr FIELD_DEFINITION c_def = { SFI_TILEIMAGE, CPFT_TILE_IMAGE, &GUID_TILE_IMAGE, nullptr, CPFS_DISPLAY_IN_BOTH, CPFIS_NONE, 0, STR_NONE };
+};
+
+template <>
+struct FieldTraits<SFI_LARGE_TEXT>
+{
+    static constexpr FIELD_DEFINITION c_def = { SFI_LARGE_TEXT, CPFT_LARGE_TEXT, &GUID_LARGE_TEXT, nullptr, CPFS_DISPLAY_IN_SELECTED_TILE, CPFIS_NONE, 0, STR_TILE_TITLE };
+};
+
+template <>
+struct FieldTraits<SFI_SMALL_TEXT>
+{
+    static constexpr FIELD_DEFINITION c_def = { SFI_SMALL_TEXT, CPFT_SMALL_TEXT, &GUID_SMALL_TEXT, nullptr, CPFS_DISPLAY_IN_SELECTED_TILE, CPFIS_NONE, 0, STR_TILE_DESCRIPTION };
+};
+
+template <>
+struct FieldTraits<SFI_SUBMIT_BUTTON>
+{
+    static constexpr FIELD_DEFINITION c_def = { SFI_SUBMIT_BUTTON, CPFT_SUBMIT_BUTTON, &GUID_SUBMIT_BUTTON, nullptr, CPFS_DISPLAY_IN_SELECTED_TILE, CPFIS_NONE, SFI_SMALL_TEXT, STR_NONE };
+};
+
+template <size_t... rgIndex>
+constexpr auto MakeFieldTable(std::index_sequence<rgIndex...>)
+{
+    struct FIELD_TABLE
+    {
+        FIELD_DEFINITION rgFields[sizeof...(rgIndex)];
+    };
+    return FIELD_TABLE{ { FieldTraits<static_cast<FIELDID>(rgIndex)>::c_def... } };
+}
+
+inline constexpr auto c_fieldTable = MakeFieldTable(std::make_index_sequence<SFI_NUM_FIELDS>());
+inline constexpr const FIELD_DEFINITION (&c_rgFieldTable)[SFI_NUM_FIELDS] = c_fieldTable.rgFields;
+
+// 表与 FIELDID 必须一致：条目数相同、按枚举值排列、提交按钮的相邻字段存在且不是它自己
+constexpr bool FieldTableIsConsistent()
+{
+    for (size_t i = 0; i < SFI_NUM_FIELDS; i++)
+    {
+        if (c_rgFieldTable[i].fieldId != static_cast<FIELDID>(i))
+        {
+            return false;
+        }
+        if ((c_rgFieldTable[i].cpft == CPFT_SUBMIT_BUTTON) &&
+            ((c_rgFieldTable[i].dwAdjacentTo >= SFI_NUM_FIELDS) || (c_rgFieldTable[i].dwAdjacentTo == i)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static_assert(ARRAYSIZE(c_rgFieldTable) == SFI_NUM_FIELDS, "field table size must match FIELDID");
+static_assert(FieldTableIsConsistent(), "field table must be ordered by FIELDID with valid submit adjacency");
+
+// 为 GetFieldDescriptorAt 生成描述符副本，LogonUI 用 CoTaskMemFree 释放描述符及其标签
+inline HRESULT FieldDescriptorCoAllocCopy(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR** ppcpfd)
+{
+    *ppcpfd = nullptr;
+    if (dwFieldID >= SFI_NUM_FIELDS)
+    {
+        return E_INVALIDARG;
+    }
+
+    const FIELD_DEFINITION& def = c_rgFieldTable[dwFieldID];
+    CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* pcpfd = (CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR*)CoTaskMemAlloc(sizeof(*pcpfd));
+    if (!pcpfd)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = S_OK;
+    pcpfd->dwFieldID = dwFieldID;
+    pcpfd->cpft = def.cpft;
+    pcpfd->guidFieldType = *def.pguidFieldType;
+    pcpfd->pszLabel = nullptr;
+    if (def.pszLabel)
+    {
+        hr = SHStrDupW(def.pszLabel, &pcpfd->pszLabel);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *ppcpfd = pcpfd;
+    }
+    else
+    {
+        CoTaskMemFree(pcpfd);
+    }
+    return hr;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "pch.h"
+
+// KERB_INTERACTIVE_LOGON / KERB_INTERACTIVE_UNLOCK_LOGON 打包
+//
+// LSA 期望序列化缓冲区中 UNICODE_STRING::Buffer 保存相对缓冲区起始处的偏移，
+// 而不是进程内的绝对指针。布局为：
+//
+//   [TLogon 结构][域名][用户名][密码]
+//
+// 字符串不带结尾 NUL，Length == MaximumLength。整个结果只有一次 CoTaskMemAlloc，
+// 除结构头外不做多余的清零。
+
+// 按结构类型定位内嵌的 KERB_INTERACTIVE_LOGON
+template <typename TLogon>
+struct KerbLogonTraits;
+
+template <>
+struct KerbLogonTraits<KERB_INTERACTIVE_LOGON>
+{
+    static KERB_INTERACTIVE_LOGON* Logon(KERB_INTERACTIVE_LOGON* p) { return p; }
+};
+
+template <>
+struct KerbLogonTraits<KERB_INTERACTIVE_UNLOCK_LOGON>
+{
+    static KERB_INTERACTIVE_LOGON* Logon(KERB_INTERACTIVE_UNLOCK_LOGON* p) { return &p->Logon; }
+};
+
+// 已知长度的字符串，避免打包时重复 wcslen
+struct KERB_PACK_STRING
+{
+    PCWSTR psz;
+    size_t cch;
+};
+
+inline KERB_PACK_STRING KerbPackString(PCWSTR psz)
+{
+    KERB_PACK_STRING s = { psz, psz ? wcslen(psz) : 0 };
+    return s;
+}
+
+inline KERB_PACK_STRING KerbPackString(PCWSTR psz, size_t cch)
+{
+    KERB_PACK_STRING s = { psz, cch };
+    return s;
+}
+
+// 根据使用场景选择 Kerberos 消息类型
+inline KERB_LOGON_SUBMIT_TYPE KerbLogonMessageType(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus)
+{
+    return (cpus == CPUS_UNLOCK_WORKSTATION) ? KerbWorkstationUnlockLogon : KerbInteractiveLogon;
+}
+
+// 计算打包后的精确大小，任一字符串超出 UNICODE_STRING 上限时返回 FALSE
+inline BOOL KerbLogonPackSize(size_t cbHeader, const KERB_PACK_STRING& domain, const KERB_PACK_STRING& user, const KERB_PACK_STRING& password, DWORD* pcb)
+{
+    const size_t cchMax = USHRT_MAX / sizeof(WCHAR);
+    if ((domain.cch > cchMax) || (user.cch > cchMax) || (password.cch > cchMax))
+    {
+        return FALSE;
+    }
+    *pcb = (DWORD)(cbHeader + (domain.cch + user.cch + password.cch) * sizeof(WCHAR));
+    return TRUE;
+}
+
+// 将字符串写入 pbNext，并以相对 pbBase 的偏移填写 UNICODE_STRING
+inline BYTE* KerbLogonPackUnicodeString(const KERB_PACK_STRING& s, BYTE* pbBase, BYTE* pbNext, UNICODE_STRING* pus)
+{
+    USHORT cb = (USHORT)(s.cch * sizeof(WCHAR));
+    pus->Length = cb;
+    pus->MaximumLength = cb;
+    pus->Buffer = cb ? (PWSTR)(ULONG_PTR)(pbNext - pbBase) : nullptr;
+    if (cb)
+    {
+        CopyMemory(pbNext, s.psz, cb);
+    }
+    return pbNext + cb;
+}
+
+// 打包到调用方提供的缓冲区，cb 必须等于 KerbLogonPackSize 的结果
+template <typename TLogon>
+void KerbLogonPackInto(KERB_LOGON_SUBMIT_TYPE messageType, const KERB_PACK_STRING& domain, const KERB_PACK_STRING& user, const KERB_PACK_STRING& password, BYTE* pb)
+{
+    TLogon* pHeader = (TLogon*)pb;
+    ZeroMemory(pHeader, sizeof(TLogon));
+
+    KERB_INTERACTIVE_LOGON* pkil = KerbLogonTraits<TLogon>::Logon(pHeader);
+    pkil->MessageType = messageType;
+
+    BYTE* pbNext = pb + sizeof(TLogon);
+    pbNext = KerbLogonPackUnicodeString(domain, pb, pbNext, &pkil->LogonDomainName);
+    pbNext = KerbLogonPackUnicodeString(user, pb, pbNext, &pkil->UserName);
+    KerbLogonPackUnicodeString(password, pb, pbNext, &pkil->Password);
+}
+
+// 打包到新分配的 CoTaskMem 缓冲区，调用方负责 CoTaskMemFree
+template <typename TLogon>
+HRESULT KerbLogonPack(KERB_LOGON_SUBMIT_TYPE messageType, const KERB_PACK_STRING& domain, const KERB_PACK_STRING& user, const KERB_PACK_STRING& password, BYTE** prgb, DWORD* pcb)
+{
+    *prgb = nullptr;
+    *pcb = 0;
+
+    DWORD cb = 0;
+    if (!KerbLogonPackSize(sizeof(TLogon), domain, user, password, &cb))
+    {
+        return E_INVALIDARG;
+    }
+
+    BYTE* pb = (BYTE*)CoTaskMemAlloc(cb);
+    if (!pb)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    KerbLogonPackInto<TLogon>(messageType, domain, user, password, pb);
+    *prgb = pb;
+    *pcb = cb;
+    return S_OK;
+}
@@ -0,0 +1,245 @@
+#include "pch.h"
+#include "LatencyTrace.h"
+#include "ConfigFile.h"
+#include <sddl.h>
+
+// 环形缓冲区槽位：llSequence 为 0 表示从未写入，TRACE_SLOT_BUSY 表示正在写入，否则为写入序号 + 1
+#define TRACE_SLOT_BUSY (-1)
+
+struct TRACE_SLOT
+{
+    volatile LONG64 llSequence;
+    TRACE_RECORD record;
+};
+
+volatile LONG g_fTraceEnabled = FALSE;
+
+static TRACE_SLOT g_rgTraceSlots[TRACE_RING_SIZE];
+static volatile LONG64 g_llTraceNext = 0;
+static volatile LONG g_fTraceInitialized = FALSE;
+static volatile LONG g_fTraceDumpQueued = FALSE;
+static HANDLE g_hTraceDumpEvent = nullptr;
+static HANDLE g_hTraceDumpWait = nullptr;
+
+// 各使用场景的开始时间，0 表示没有未结束的区间
+static volatile LONG64 g_rgllScenarioStart[3] = { 0 };
+
+void LatencyTraceRecord(TRACE_METHOD method, LONGLONG llEnter, LONGLONG llExit)
+{
+    LONG64 llIndex = InterlockedIncrement64(&g_llTraceNext) - 1;
+    TRACE_SLOT* pSlot = &g_rgTraceSlots[llIndex & (TRACE_RING_SIZE - 1)];
+
+    // 写入方被抢占期间其他线程可能已绕回同一槽位：先把槽位标记为正在写入，抢到的一方独占写入；
+    // 槽位正被写入或已有更新的记录时丢弃本条，否则两方交错写入的半条记录会带着完整的序列号被读出
+    LONG64 llSequence = InterlockedCompareExchange64(&pSlot->llSequence, 0, 0);
+    if ((llSequence == TRACE_SLOT_BUSY) || (llSequence > llIndex) ||
+        (InterlockedCompareExchange64(&pSlot->llSequence, TRACE_SLOT_BUSY, llSequence) != llSequence))
+    {
+        return;
+    }
+    pSlot->record.llEnter = llEnter;
+    pSlot->record.llExit = llExit;
+    pSlot->record.dwThreadId = GetCurrentThreadId();
+    pSlot->record.wMethod = (WORD)method;
+    pSlot->record.wReserved = 0;
+    InterlockedExchange64(&pSlot->llSequence, llIndex + 1);
+}
+
+// 只跟踪登录和解锁两种场景
+static bool TraceScenarioSpan(DWORD dwScenario, TRACE_METHOD* pMethod)
+{
+    if (dwScenario == CPUS_LOGON)
+    {
+        *pMethod = TM_SPAN_LOGON_TO_SERIALIZATION;
+        return true;
+    }
+    if (dwScenario == CPUS_UNLOCK_WORKSTATION)
+    {
+        *pMethod = TM_SPAN_UNLOCK_TO_SERIALIZATION;
+        return true;
+    }
+    return false;
+}
+
+void LatencyTraceScenarioBegin(DWORD dwScenario)
+{
+    TRACE_METHOD method;
+    if (g_fTraceEnabled && TraceScenarioSpan(dwScenario, &method))
+    {
+        LARGE_INTEGER li;
+        QueryPerformanceCounter(&li);
+        InterlockedExchange64(&g_rgllScenarioStart[dwScenario], li.QuadPart);
+    }
+}
+
+void LatencyTraceScenarioEnd(DWORD dwScenario)
+{
+    TRACE_METHOD method;
+    if (g_fTraceEnabled && TraceScenarioSpan(dwScenario, &method))
+    {
+        LONGLONG llStart = InterlockedExchange64(&g_rgllScenarioStart[dwScenario], 0);
+        if (llStart)
+        {
+            LARGE_INTEGER li;
+            QueryPerformanceCounter(&li);
+            LatencyTraceRecord(method, llStart, li.QuadPart);
+        }
+    }
+}
+
+DWORD LatencyTraceSnapshot(TRACE_RECORD* prgRecords)
+{
+    LONG64 llEnd = InterlockedCompareExchange64(&g_llTraceNext, 0, 0);
+    LONG64 llBegin = (llEnd > TRACE_RING_SIZE) ? (llEnd - TRACE_RING_SIZE) : 0;
+
+    DWORD cRecords = 0;
+    for (LONG64 llIndex = llBegin; llIndex < llEnd; llIndex++)
+    {
+        TRACE_SLOT* pSlot = &g_rgTraceSlots[llIndex & (TRACE_RING_SIZE - 1)];
+        LONG64 llBefore = InterlockedCompareExchange64(&pSlot->llSequence, 0, 0);
+        TRACE_RECORD record = pSlot->record;
+        LONG64 llAfter = InterlockedCompareExchange64(&pSlot->llSequence, 0, 0);
+        if ((llBefore == llIndex + 1) && (llAfter == llBefore))
+        {
+            prgRecords[cRecords++] = record;
+        }
+    }
+    return cRecords;
+}
+
+// 跟踪记录含账户键，文件只允许 SYSTEM 和管理员访问。CREATE_ALWAYS 覆盖已有文件时保留其所有者和 DACL，
+// 普通用户抢先创建的文件先删除再新建
+static HANDLE OpenTraceFile(PCWSTR pszPath)
+{
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, FALSE };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(CONFIG_FILE_SDDL, SDDL_REVISION_1, &sa.lpSecurityDescriptor, nullptr))
+    {
+        return INVALID_HANDLE_VALUE;
+    }
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_WRITE, 0, &sa, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if ((hFile != INVALID_HANDLE_VALUE) && FAILED(ConfigCheckFileOwner(hFile)))
+    {
+        CloseHandle(hFile);
+        hFile = INVALID_HANDLE_VALUE;
+        if (DeleteFileW(pszPath))
+        {
+            hFile = CreateFileW(pszPath, GENERIC_WRITE, 0, &sa, CREATE_NEW, FILE_ATTRIBUTE_NORMAL, nullptr);
+        }
+        else
+        {
+            SetLastError(ERROR_INVALID_OWNER);
+        }
+    }
+    DWORD dwError = GetLastError();
+    LocalFree(sa.lpSecurityDescriptor);
+    SetLastError(dwError);
+    return hFile;
+}
+
+static HRESULT WriteTraceFile()
+{
+    TRACE_RECORD* prgRecords = (TRACE_RECORD*)HeapAlloc(GetProcessHeap(), 0, sizeof(TRACE_RECORD) * TRACE_RING_SIZE);
+    if (!prgRecords)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    TRACE_FILE_HEADER header = { 0 };
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    header.dwMagic = TRACE_FILE_MAGIC;
+    header.wVersion = TRACE_FILE_VERSION;
+    header.cbRecord = sizeof(TRACE_RECORD);
+    header.llFrequency = liFrequency.QuadPart;
+    header.cRecords = LatencyTraceSnapshot(prgRecords);
+
+    HRESULT hr = S_OK;
+    WCHAR szPath[MAX_PATH];
+    if (!ExpandEnvironmentStringsW(TRACE_FILE_PATH, szPath, ARRAYSIZE(szPath)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ConfigCreateParentDirectory(szPath);
+        HANDLE hFile = OpenTraceFile(szPath);
+        if (hFile != INVALID_HANDLE_VALUE)
+        {
+            DWORD cbWritten = 0;
+            DWORD cbRecords = header.cRecords * sizeof(TRACE_RECORD);
+            if (!WriteFile(hFile, &header, sizeof(header), &cbWritten, nullptr) ||
+                !WriteFile(hFile, prgRecords, cbRecords, &cbWritten, nullptr))
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+            }
+            CloseHandle(hFile);
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+
+    HeapFree(GetProcessHeap(), 0, prgRecords);
+    return hr;
+}
+
+static void CALLBACK TraceDumpCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pvContext);
+    WriteTraceFile();
+    InterlockedExchange(&g_fTraceDumpQueued, FALSE);
+}
+
+void LatencyTraceQueueDump()
+{
+    if (g_fTraceEnabled && !InterlockedExchange(&g_fTraceDumpQueued, TRUE))
+    {
+        if (!TrySubmitThreadpoolCallback(TraceDumpCallback, nullptr, nullptr))
+        {
+            InterlockedExchange(&g_fTraceDumpQueued, FALSE);
+        }
+    }
+}
+
+static void CALLBACK TraceDumpEventCallback(PVOID pvContext, BOOLEAN fTimedOut)
+{
+    UNREFERENCED_PARAMETER(pvContext);
+    UNREFERENCED_PARAMETER(fTimedOut);
+    LatencyTraceQueueDump();
+}
+
+void LatencyTraceInitialize()
+{
+    if (InterlockedCompareExchange(&g_fTraceInitialized, TRUE, FALSE))
+    {
+        return;
+    }
+
+    DWORD dwEnabled = 0;
+    DWORD cbEnabled = sizeof(dwEnabled);
+    if ((RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"TraceEnabled", RRF_RT_REG_DWORD, nullptr, &dwEnabled, &cbEnabled) != ERROR_SUCCESS) ||
+        !dwEnabled)
+    {
+        return;
+    }
+
+    // 转储回调在线程池中运行，开启跟踪时固定 DLL，避免回调期间被卸载
+    HMODULE hModule = nullptr;
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+        (LPCWSTR)&LatencyTraceInitialize, &hModule);
+
+    // 自动重置事件，每次触发转储一次
+    g_hTraceDumpEvent = CreateEventW(nullptr, FALSE, FALSE, TRACE_DUMP_EVENT);
+    if (g_hTraceDumpEvent)
+    {
+        if (!RegisterWaitForSingleObject(&g_hTraceDumpWait, g_hTraceDumpEvent, TraceDumpEventCallback, nullptr, INFINITE, WT_EXECUTEDEFAULT))
+        {
+            g_hTraceDumpWait = nullptr;
+        }
+    }
+
+    InterlockedExchange(&g_fTraceEnabled, TRUE);
+}
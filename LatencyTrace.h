@@ -0,0 +1,192 @@
+#pragma once
+
+#include <windows.h>
+
+// 方法调用耗时跟踪
+//
+// 每次调用在退出时向固定大小的环形缓冲区写入一条记录（进入/退出的 QPC 时间戳），
+// 写入路径不加锁、不分配内存，槽位正被另一线程写入时丢弃该条记录。
+// 跟踪由 HKLM\SOFTWARE\WinUnlock\TraceEnabled（DWORD）开启，关闭时每次调用只多一次分支判断。
+// 缓冲区在提供程序释放后或收到 Global\WinUnlockTraceDump 事件时写入 TRACE_FILE_PATH，
+// 由 tools\tracedump.cpp 解析并输出各方法的耗时分位数。
+
+enum TRACE_METHOD
+{
+    // ICredentialProvider
+    TM_PROVIDER_SETUSAGESCENARIO = 0,
+    TM_PROVIDER_SETSERIALIZATION,
+    TM_PROVIDER_ADVISE,
+    TM_PROVIDER_UNADVISE,
+    TM_PROVIDER_GETFIELDDESCRIPTORCOUNT,
+    TM_PROVIDER_GETFIELDDESCRIPTORAT,
+    TM_PROVIDER_GETCREDENTIALCOUNT,
+    TM_PROVIDER_GETCREDENTIALAT,
+
+    // ICredentialProviderCredential
+    TM_CREDENTIAL_ADVISE,
+    TM_CREDENTIAL_UNADVISE,
+    TM_CREDENTIAL_SETSELECTED,
+    TM_CREDENTIAL_SETDESELECTED,
+    TM_CREDENTIAL_GETFIELDSTATE,
+    TM_CREDENTIAL_GETSTRINGVALUE,
+    TM_CREDENTIAL_GETBITMAPVALUE,
+    TM_CREDENTIAL_GETCHECKBOXVALUE,
+    TM_CREDENTIAL_GETSUBMITBUTTONVALUE,
+    TM_CREDENTIAL_SETSTRINGVALUE,
+    TM_CREDENTIAL_SETCHECKBOXVALUE,
+    TM_CREDENTIAL_COMMANDLINKCLICKED,
+    TM_CREDENTIAL_GETSERIALIZATION,
+    TM_CREDENTIAL_REPORTRESULT,
+
+    // 内部
+    TM_SOURCE_FETCH,
+
+    // 区间：SetUsageScenario 进入到 GetSerialization 返回凭据
+    TM_SPAN_LOGON_TO_SERIALIZATION,
+    TM_SPAN_UNLOCK_TO_SERIALIZATION,
+
+    // 内部：等待凭据读取超过期限（进入到放弃等待），追加在末尾以保持已有编号不变
+    TM_SOURCE_DEADLINE_MISSED,
+
+    TM_NUM_METHODS
+};
+
+inline PCSTR TraceMethodName(DWORD dwMethod)
+{
+    static const PCSTR c_rgszNames[TM_NUM_METHODS] =
+    {
+        "Provider::SetUsageScenario",
+        "Provider::SetSerialization",
+        "Provider::Advise",
+        "Provider::UnAdvise",
+        "Provider::GetFieldDescriptorCount",
+        "Provider::GetFieldDescriptorAt",
+        "Provider::GetCredentialCount",
+        "Provider::GetCredentialAt",
+        "Credential::Advise",
+        "Credential::UnAdvise",
+        "Credential::SetSelected",
+        "Credential::SetDeselected",
+        "Credential::GetFieldState",
+        "Credential::GetStringValue",
+        "Credential::GetBitmapValue",
+        "Credential::GetCheckboxValue",
+        "Credential::GetSubmitButtonValue",
+        "Credential::SetStringValue",
+        "Credential::SetCheckboxValue",
+        "Credential::CommandLinkClicked",
+        "Credential::GetSerialization",
+        "Credential::ReportResult",
+        "Source::Fetch",
+        "Span::Logon->Serialization",
+        "Span::Unlock->Serialization",
+        "Source::DeadlineMissed",
+    };
+    return (dwMethod < TM_NUM_METHODS) ? c_rgszNames[dwMethod] : "?";
+}
+
+// 跟踪文件格式：TRACE_FILE_HEADER 后紧跟 cRecords 条 TRACE_RECORD（按写入顺序）
+#define TRACE_FILE_MAGIC    0x52545557  // 'WUTR'
+#define TRACE_FILE_VERSION  1
+#define TRACE_FILE_PATH     L"%ProgramData%\\WinUnlock\\trace.bin"
+#define TRACE_DUMP_EVENT    L"Global\\WinUnlockTraceDump"
+
+#pragma pack(push, 8)
+struct TRACE_FILE_HEADER
+{
+    DWORD dwMagic;
+    WORD wVersion;
+    WORD cbRecord;
+    LONGLONG llFrequency;   // QueryPerformanceFrequency
+    DWORD cRecords;
+    DWORD dwReserved;
+};
+
+struct TRACE_RECORD
+{
+    LONGLONG llEnter;
+    LONGLONG llExit;
+    DWORD dwThreadId;
+    WORD wMethod;
+    WORD wReserved;
+};
+#pragma pack(pop)
+
+// 读取跟踪文件时校验文件头：魔数、版本、记录大小与本程序一致，计数器频率有效
+inline bool TraceFileHeaderIsValid(const TRACE_FILE_HEADER& header)
+{
+    return (header.dwMagic == TRACE_FILE_MAGIC) && (header.wVersion == TRACE_FILE_VERSION) &&
+        (header.cbRecord == sizeof(TRACE_RECORD)) && (header.llFrequency > 0);
+}
+
+// 已按升序排列的耗时的分位数（p 取 0 到 1，按最近秩取值）；空集合返回 0。
+// tracedump、unlocksignal 和 logonsim 输出的 p50/p90/p99 都由此计算
+inline double TracePercentile(const double* prgSorted, size_t cValues, double p)
+{
+    if (!cValues)
+    {
+        return 0;
+    }
+    if (p <= 0)
+    {
+        return prgSorted[0];
+    }
+    size_t i = (size_t)(p * (cValues - 1) + 0.5);
+    return prgSorted[(i < cValues) ? i : (cValues - 1)];
+}
+
+// 环形缓冲区容量，必须是 2 的幂
+#define TRACE_RING_SIZE 4096
+
+extern volatile LONG g_fTraceEnabled;
+
+// 读取 TraceEnabled 配置并注册转储事件，只在首次调用时生效
+void LatencyTraceInitialize();
+
+// 写入一条记录
+void LatencyTraceRecord(TRACE_METHOD method, LONGLONG llEnter, LONGLONG llExit);
+
+// 按写入顺序复制仍然有效的记录（prgRecords 至少容纳 TRACE_RING_SIZE 条），返回条数；
+// 正在写入或已被覆盖的槽位会被跳过
+DWORD LatencyTraceSnapshot(TRACE_RECORD* prgRecords);
+
+// 在线程池中把当前缓冲区写入跟踪文件
+void LatencyTraceQueueDump();
+
+// 记录使用场景（CPUS_LOGON / CPUS_UNLOCK_WORKSTATION）的开始时间
+void LatencyTraceScenarioBegin(DWORD dwScenario);
+
+// GetSerialization 返回凭据时调用，写入一条“场景到序列化”区间记录；
+// 每次 Begin 之后只记录第一次
+void LatencyTraceScenarioEnd(DWORD dwScenario);
+
+// 作用域跟踪：构造时记录进入时间，析构时写入记录
+class TraceScope
+{
+public:
+    TraceScope(TRACE_METHOD method) : _method(method), _llEnter(0)
+    {
+        if (g_fTraceEnabled)
+        {
+            LARGE_INTEGER li;
+            QueryPerformanceCounter(&li);
+            _llEnter = li.QuadPart;
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (_llEnter)
+        {
+            LARGE_INTEGER li;
+            QueryPerformanceCounter(&li);
+            LatencyTraceRecord(_method, _llEnter, li.QuadPart);
+        }
+    }
+
+private:
+    TRACE_METHOD _method;
+    LONGLONG _llEnter;
+};
+
+#define TRACE_SCOPE(method) TraceScope _traceScope(method)
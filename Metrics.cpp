@@ -0,0 +1,361 @@
+#include "pch.h"
+#include "Metrics.h"
+#include "CredentialCache.h"
+#include "AccountTable.h"
+#include <sddl.h>
+
+// 本机 SYSTEM 和管理员完全控制；本地服务、网络服务账户（常见的采集代理）可读，
+// 另需 FILE_WRITE_ATTRIBUTES 才能把客户端切换为消息读取模式
+static const WCHAR c_szMetricsPipeSddl[] = L"D:P(A;;GA;;;SY)(A;;GA;;;BA)(A;;0x120189;;;LS)(A;;0x120189;;;NS)";
+
+struct METRICS_HISTOGRAM_DATA
+{
+    volatile LONG64 rgllBuckets[METRICS_HISTOGRAM_BUCKETS];
+    volatile LONG64 llSumUs;
+};
+
+struct METRICS_HISTOGRAM_INFO
+{
+    PCSTR pszName;
+    PCSTR pszHelp;
+    PCSTR pszLabels;        // 不含 le，可以为空串
+};
+
+static const METRICS_HISTOGRAM_INFO c_rgHistogramInfo[MH_NUM_HISTOGRAMS] =
+{
+    { "winunlock_method_duration_seconds", "Time spent in credential provider methods.", "method=\"GetCredentialCount\"" },
+    { "winunlock_method_duration_seconds", "Time spent in credential provider methods.", "method=\"SetSelected\"" },
+    { "winunlock_method_duration_seconds", "Time spent in credential provider methods.", "method=\"GetSerialization\"" },
+    { "winunlock_source_fetch_duration_seconds", "Time spent loading accounts from the credential source.", "" },
+};
+
+static const PCSTR c_rgszScenarioNames[MS_NUM_SCENARIOS] = { "logon", "unlock", "other" };
+static const PCSTR c_rgszResultNames[] = { "success", "credential", "permanent", "transient" };
+
+volatile LONG g_fMetricsEnabled = FALSE;
+
+static METRICS_HISTOGRAM_DATA g_rgHistograms[MH_NUM_HISTOGRAMS];
+static volatile LONG64 g_rgllResults[MS_NUM_SCENARIOS][ARRAYSIZE(c_rgszResultNames)];
+static volatile LONG64 g_llFetchFailures = 0;
+static volatile LONG64 g_llConfigReloads = 0;
+static volatile LONG g_lConfigGeneration = 0;
+static volatile LONG g_fMetricsInitialized = FALSE;
+static LONGLONG g_llMetricsFrequency = 1;
+
+DWORD MetricsBucketIndex(ULONGLONG ullMicroseconds)
+{
+    if (ullMicroseconds < 4)
+    {
+        return (DWORD)ullMicroseconds;
+    }
+    if (ullMicroseconds >= (1ULL << (METRICS_MAX_EXPONENT + 1)))
+    {
+        return METRICS_HISTOGRAM_BUCKETS - 1;
+    }
+    DWORD dwExponent;
+    BitScanReverse(&dwExponent, (DWORD)ullMicroseconds);
+    return (dwExponent - 1) * 4 + (DWORD)((ullMicroseconds >> (dwExponent - 2)) & 3);
+}
+
+ULONGLONG MetricsBucketBound(DWORD dwBucket)
+{
+    if (dwBucket < 4)
+    {
+        return dwBucket + 1;
+    }
+    DWORD dwExponent = dwBucket / 4 + 1;
+    return (ULONGLONG)(5 + dwBucket % 4) << (dwExponent - 2);
+}
+
+void MetricsRecordDuration(METRIC_HISTOGRAM histogram, LONGLONG llTicks)
+{
+    ULONGLONG ullUs = (llTicks > 0) ? (ULONGLONG)llTicks * 1000000 / g_llMetricsFrequency : 0;
+    METRICS_HISTOGRAM_DATA* pData = &g_rgHistograms[histogram];
+    InterlockedIncrement64(&pData->rgllBuckets[MetricsBucketIndex(ullUs)]);
+    InterlockedExchangeAdd64(&pData->llSumUs, (LONG64)ullUs);
+}
+
+void MetricsRecordResult(DWORD dwScenario, RESULT_KIND kind)
+{
+    if (g_fMetricsEnabled && ((DWORD)kind < ARRAYSIZE(c_rgszResultNames)))
+    {
+        METRIC_SCENARIO scenario = (dwScenario == CPUS_LOGON) ? MS_LOGON :
+            (dwScenario == CPUS_UNLOCK_WORKSTATION) ? MS_UNLOCK : MS_OTHER;
+        InterlockedIncrement64(&g_rgllResults[scenario][kind]);
+    }
+}
+
+void MetricsRecordFetchFailure()
+{
+    if (g_fMetricsEnabled)
+    {
+        InterlockedIncrement64(&g_llFetchFailures);
+    }
+}
+
+void MetricsRecordConfigReload(DWORD dwGeneration)
+{
+    if (g_fMetricsEnabled)
+    {
+        InterlockedExchange(&g_lConfigGeneration, (LONG)dwGeneration);
+        InterlockedIncrement64(&g_llConfigReloads);
+    }
+}
+
+static HRESULT AppendText(PSTR* ppsz, size_t* pcchRemaining, PCSTR pszFormat, ...)
+{
+    va_list args;
+    va_start(args, pszFormat);
+    HRESULT hr = StringCchVPrintfExA(*ppsz, *pcchRemaining, ppsz, pcchRemaining, 0, pszFormat, args);
+    va_end(args);
+    return hr;
+}
+
+static HRESULT RenderHistogram(PSTR* ppsz, size_t* pcchRemaining, DWORD dwHistogram, PCSTR pszPreviousName)
+{
+    const METRICS_HISTOGRAM_INFO* pInfo = &c_rgHistogramInfo[dwHistogram];
+    const METRICS_HISTOGRAM_DATA* pData = &g_rgHistograms[dwHistogram];
+    PCSTR pszSeparator = pInfo->pszLabels[0] ? "," : "";
+
+    HRESULT hr = S_OK;
+    if (!pszPreviousName || (strcmp(pszPreviousName, pInfo->pszName) != 0))
+    {
+        hr = AppendText(ppsz, pcchRemaining, "# HELP %s %s\n# TYPE %s histogram\n", pInfo->pszName, pInfo->pszHelp, pInfo->pszName);
+    }
+
+    // 桶是累计的；最后一桶还包含超出范围的值，只作为 +Inf 输出
+    LONG64 llCount = 0;
+    for (DWORD i = 0; SUCCEEDED(hr) && (i < METRICS_HISTOGRAM_BUCKETS - 1); i++)
+    {
+        llCount += ReadAcquire64(&pData->rgllBuckets[i]);
+        hr = AppendText(ppsz, pcchRemaining, "%s_bucket{%s%sle=\"%.9g\"} %lld\n", pInfo->pszName, pInfo->pszLabels, pszSeparator,
+            (double)MetricsBucketBound(i) / 1e6, llCount);
+    }
+    if (SUCCEEDED(hr))
+    {
+        llCount += ReadAcquire64(&pData->rgllBuckets[METRICS_HISTOGRAM_BUCKETS - 1]);
+        hr = AppendText(ppsz, pcchRemaining, "%s_bucket{%s%sle=\"+Inf\"} %lld\n", pInfo->pszName, pInfo->pszLabels, pszSeparator, llCount);
+    }
+    if (SUCCEEDED(hr))
+    {
+        PCSTR pszOpen = pInfo->pszLabels[0] ? "{" : "";
+        PCSTR pszClose = pInfo->pszLabels[0] ? "}" : "";
+        hr = AppendText(ppsz, pcchRemaining, "%s_sum%s%s%s %.6f\n%s_count%s%s%s %lld\n",
+            pInfo->pszName, pszOpen, pInfo->pszLabels, pszClose, (double)ReadAcquire64(&pData->llSumUs) / 1e6,
+            pInfo->pszName, pszOpen, pInfo->pszLabels, pszClose, llCount);
+    }
+    return hr;
+}
+
+HRESULT MetricsRender(PSTR pszText, size_t cchText, size_t* pcch)
+{
+    *pcch = 0;
+    PSTR psz = pszText;
+    size_t cchRemaining = cchText;
+    HRESULT hr = S_OK;
+
+    for (DWORD i = 0; SUCCEEDED(hr) && (i < MH_NUM_HISTOGRAMS); i++)
+    {
+        hr = RenderHistogram(&psz, &cchRemaining, i, i ? c_rgHistogramInfo[i - 1].pszName : nullptr);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        hr = AppendText(&psz, &cchRemaining, "# HELP winunlock_results_total Logon results reported to the credential provider.\n"
+            "# TYPE winunlock_results_total counter\n");
+    }
+    for (DWORD i = 0; SUCCEEDED(hr) && (i < MS_NUM_SCENARIOS); i++)
+    {
+        for (DWORD j = 0; SUCCEEDED(hr) && (j < ARRAYSIZE(c_rgszResultNames)); j++)
+        {
+            hr = AppendText(&psz, &cchRemaining, "winunlock_results_total{scenario=\"%s\",result=\"%s\"} %lld\n",
+                c_rgszScenarioNames[i], c_rgszResultNames[j], ReadAcquire64(&g_rgllResults[i][j]));
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = AppendText(&psz, &cchRemaining,
+            "# HELP winunlock_source_fetch_failures_total Credential source loads that failed.\n"
+            "# TYPE winunlock_source_fetch_failures_total counter\n"
+            "winunlock_source_fetch_failures_total %lld\n"
+            "# HELP winunlock_source_deadline_missed_total Credential fetches that did not finish within FetchDeadlineMs.\n"
+            "# TYPE winunlock_source_deadline_missed_total counter\n"
+            "winunlock_source_deadline_missed_total %ld\n"
+            "# HELP winunlock_source_unresolved_accounts_total Accounts whose SID could not be resolved and are keyed by user name.\n"
+            "# TYPE winunlock_source_unresolved_accounts_total counter\n"
+            "winunlock_source_unresolved_accounts_total %ld\n",
+            ReadAcquire64(&g_llFetchFailures), CredentialCache::GetMissedDeadlines(), AccountTable::GetUnresolvedAccounts());
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = AppendText(&psz, &cchRemaining,
+            "# HELP winunlock_config_reloads_total Configuration reloads triggered by a saved Generation.\n"
+            "# TYPE winunlock_config_reloads_total counter\n"
+            "winunlock_config_reloads_total %lld\n"
+            "# HELP winunlock_config_generation Generation of the most recently reloaded configuration.\n"
+            "# TYPE winunlock_config_generation gauge\n"
+            "winunlock_config_generation %lu\n",
+            ReadAcquire64(&g_llConfigReloads), (DWORD)ReadAcquire(&g_lConfigGeneration));
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        *pcch = cchText - cchRemaining;
+    }
+    return hr;
+}
+
+// 等待一次重叠 I/O 完成；超时时取消 I/O 并等它结束，OVERLAPPED 才能复用
+static HRESULT WaitForPipeIo(HANDLE hPipe, OVERLAPPED* pov, BOOL fCompleted, DWORD dwTimeoutMs, DWORD* pcbTransferred)
+{
+    *pcbTransferred = 0;
+    if (!fCompleted)
+    {
+        DWORD dwError = GetLastError();
+        if (dwError != ERROR_IO_PENDING)
+        {
+            return HRESULT_FROM_WIN32(dwError);
+        }
+        if (WaitForSingleObject(pov->hEvent, dwTimeoutMs) != WAIT_OBJECT_0)
+        {
+            CancelIoEx(hPipe, pov);
+            GetOverlappedResult(hPipe, pov, pcbTransferred, TRUE);
+            *pcbTransferred = 0;
+            return HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+        }
+    }
+
+    if (!GetOverlappedResult(hPipe, pov, pcbTransferred, FALSE))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return S_OK;
+}
+
+// 全部文本作为一条消息写出，然后等待采集方关闭连接：断开管道会丢弃对方尚未读取的数据
+static HRESULT ServeMetricsClient(HANDLE hPipe, OVERLAPPED* pov, PSTR pszText)
+{
+    size_t cch = 0;
+    HRESULT hr = MetricsRender(pszText, METRICS_TEXT_MAX, &cch);
+    DWORD cb = 0;
+    if (SUCCEEDED(hr))
+    {
+        ResetEvent(pov->hEvent);
+        hr = WaitForPipeIo(hPipe, pov, WriteFile(hPipe, pszText, (DWORD)cch, nullptr, pov), METRICS_IO_TIMEOUT_MS, &cb);
+    }
+    if (SUCCEEDED(hr))
+    {
+        BYTE bIgnored;
+        ResetEvent(pov->hEvent);
+        hr = WaitForPipeIo(hPipe, pov, ReadFile(hPipe, &bIgnored, sizeof(bIgnored), nullptr, pov), METRICS_IO_TIMEOUT_MS, &cb);
+        if (hr == HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE))
+        {
+            hr = S_OK;
+        }
+    }
+    return hr;
+}
+
+// 单实例管道，逐个连接处理；DLL 已固定，监听在进程生命周期内一直进行，空闲时不占用 CPU
+static void CALLBACK MetricsListenCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pvContext);
+
+    DWORD dwSessionId = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &dwSessionId);
+    WCHAR szPipeName[64];
+    StringCchPrintfW(szPipeName, ARRAYSIZE(szPipeName), METRICS_PIPE_FORMAT, dwSessionId);
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, FALSE };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(c_szMetricsPipeSddl, SDDL_REVISION_1, &sa.lpSecurityDescriptor, nullptr))
+    {
+        return;
+    }
+    HANDLE hPipe = CreateNamedPipeW(szPipeName,
+        PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+        1, METRICS_TEXT_MAX, 16, 0, &sa);
+    LocalFree(sa.lpSecurityDescriptor);
+    if (hPipe == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    PSTR pszText = (PSTR)HeapAlloc(GetProcessHeap(), 0, METRICS_TEXT_MAX);
+    OVERLAPPED ov = { 0 };
+    ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    while (pszText && ov.hEvent)
+    {
+        ResetEvent(ov.hEvent);
+        BOOL fConnected = ConnectNamedPipe(hPipe, &ov);
+        DWORD dwError = fConnected ? ERROR_SUCCESS : GetLastError();
+        HRESULT hr = S_OK;
+        if (dwError == ERROR_IO_PENDING)
+        {
+            DWORD cb = 0;
+            hr = WaitForPipeIo(hPipe, &ov, FALSE, INFINITE, &cb);
+        }
+        else if (dwError == ERROR_NO_DATA)
+        {
+            // 采集方连接后已经关闭
+            hr = S_FALSE;
+        }
+        else if ((dwError != ERROR_SUCCESS) && (dwError != ERROR_PIPE_CONNECTED))
+        {
+            break;
+        }
+
+        if (hr == S_OK)
+        {
+            ServeMetricsClient(hPipe, &ov, pszText);
+        }
+        DisconnectNamedPipe(hPipe);
+    }
+
+    if (ov.hEvent)
+    {
+        CloseHandle(ov.hEvent);
+    }
+    if (pszText)
+    {
+        HeapFree(GetProcessHeap(), 0, pszText);
+    }
+    CloseHandle(hPipe);
+}
+
+void MetricsInitialize()
+{
+    if (InterlockedCompareExchange(&g_fMetricsInitialized, TRUE, FALSE))
+    {
+        return;
+    }
+
+    DWORD dwEnabled = 0;
+    DWORD cbEnabled = sizeof(dwEnabled);
+    if ((RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"MetricsEnabled", RRF_RT_REG_DWORD, nullptr, &dwEnabled, &cbEnabled) != ERROR_SUCCESS) ||
+        !dwEnabled)
+    {
+        return;
+    }
+
+    // 监听在线程池中一直运行，开启指标时固定 DLL
+    HMODULE hModule = nullptr;
+    GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS | GET_MODULE_HANDLE_EX_FLAG_PIN,
+        (LPCWSTR)&MetricsInitialize, &hModule);
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    g_llMetricsFrequency = liFrequency.QuadPart;
+
+    TP_CALLBACK_ENVIRON env;
+    InitializeThreadpoolEnvironment(&env);
+    SetThreadpoolCallbackRunsLong(&env);
+    BOOL fSubmitted = TrySubmitThreadpoolCallback(MetricsListenCallback, nullptr, &env);
+    DestroyThreadpoolEnvironment(&env);
+
+    if (fSubmitted)
+    {
+        InterlockedExchange(&g_fMetricsEnabled, TRUE);
+    }
+}
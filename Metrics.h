@@ -0,0 +1,95 @@
+#pragma once
+
+#include "pch.h"
+#include "ResultCache.h"
+
+// 本机指标端点
+//
+// 进程内保存无锁计数器和按对数分桶的耗时直方图（每个 2 的幂区间再分 4 个子桶，相对误差不超过 25%），
+// 记录时只有两次 Interlocked 加法，不加锁、不分配内存，LogonUI 线程上不会等待。
+// 由 HKLM\SOFTWARE\WinUnlock\MetricsEnabled（DWORD）开启后，在命名管道 METRICS_PIPE_FORMAT 上提供
+// Prometheus 文本格式（0.0.4）的指标：每个连接收到一条包含全部文本的消息，读完后由采集方关闭连接。
+// 生成文本只读取计数器，采集在独立的线程池线程上进行，不会阻塞 LogonUI；tools\metricsscrape.cpp 可用于手工查看。
+
+#define METRICS_PIPE_FORMAT         L"\\\\.\\pipe\\WinUnlock.Metrics.%lu"
+#define METRICS_IO_TIMEOUT_MS       2000    // 单次读写的超时，防止采集方占住管道
+#define METRICS_TEXT_MAX            (128 * 1024)
+
+// 直方图：值 < 4 微秒各占一桶，之后每个 [2^e, 2^(e+1)) 分 4 桶；超过 2^(METRICS_MAX_EXPONENT+1) 微秒（约 33 秒）计入最后一桶
+#define METRICS_MAX_EXPONENT        24
+#define METRICS_HISTOGRAM_BUCKETS   (METRICS_MAX_EXPONENT * 4)
+
+enum METRIC_HISTOGRAM
+{
+    MH_GETCREDENTIALCOUNT = 0,
+    MH_SETSELECTED,
+    MH_GETSERIALIZATION,
+    MH_SOURCE_FETCH,
+
+    MH_NUM_HISTOGRAMS
+};
+
+// 按使用场景区分的结果计数
+enum METRIC_SCENARIO
+{
+    MS_LOGON = 0,
+    MS_UNLOCK,
+    MS_OTHER,
+
+    MS_NUM_SCENARIOS
+};
+
+extern volatile LONG g_fMetricsEnabled;
+
+// 读取 MetricsEnabled 配置并开始监听，只在首次调用时生效
+void MetricsInitialize();
+
+// 记录一次耗时，llTicks 为 QueryPerformanceCounter 差值
+void MetricsRecordDuration(METRIC_HISTOGRAM histogram, LONGLONG llTicks);
+
+// 记录 ReportResult 收到的结果（按 ResultCache::Classify 分类）
+void MetricsRecordResult(DWORD dwScenario, RESULT_KIND kind);
+
+// 记录一次凭据来源读取失败
+void MetricsRecordFetchFailure();
+
+// 记录一次配置重新加载（已在后台开始读取），dwGeneration 为配置工具写入的 Generation
+void MetricsRecordConfigReload(DWORD dwGeneration);
+
+// 生成 Prometheus 文本，pcch 返回字符数（不含结尾 NUL）
+HRESULT MetricsRender(PSTR pszText, size_t cchText, size_t* pcch);
+
+// 桶序号及其上界（微秒，不含）；供工具和采集方核对分桶
+DWORD MetricsBucketIndex(ULONGLONG ullMicroseconds);
+ULONGLONG MetricsBucketBound(DWORD dwBucket);
+
+// 作用域计时：构造时记录开始时间，析构时写入直方图
+class MetricsScope
+{
+public:
+    MetricsScope(METRIC_HISTOGRAM histogram) : _histogram(histogram), _llStart(0)
+    {
+        if (g_fMetricsEnabled)
+        {
+            LARGE_INTEGER li;
+            QueryPerformanceCounter(&li);
+            _llStart = li.QuadPart;
+        }
+    }
+
+    ~MetricsScope()
+    {
+        if (_llStart)
+        {
+            LARGE_INTEGER li;
+            QueryPerformanceCounter(&li);
+            MetricsRecordDuration(_histogram, li.QuadPart - _llStart);
+        }
+    }
+
+private:
+    METRIC_HISTOGRAM _histogram;
+    LONGLONG _llStart;
+};
+
+#define METRICS_SCOPE(histogram) MetricsScope _metricsScope(histogram)
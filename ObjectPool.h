@@ -0,0 +1,112 @@
+#pragma once
+
+#include "pch.h"
+#include <malloc.h>
+
+// 对象空闲链表
+//
+// LogonUI 每次锁定/解锁都会重新创建提供程序和凭据对象。这些类的 operator new / delete
+// 从固定大小的空闲链表取还内存块，稳定运行后创建和释放对象不再进入堆分配器。
+// 链表是无锁的 SLIST，最多保留 cMax 块，多出的直接还给堆；DLL 卸载时（静态对象析构）全部释放。
+
+struct OBJECT_POOL_STATS
+{
+    LONG cHeapAllocs;   // 从堆分配的次数
+    LONG cPoolHits;     // 从空闲链表取得的次数
+    LONG cLive;         // 尚未释放的对象数
+};
+
+template <size_t cbBlock, USHORT cMax>
+class ObjectPool
+{
+public:
+    ObjectPool() :
+        _cHeapAllocs(0),
+        _cPoolHits(0),
+        _cLive(0)
+    {
+        InitializeSListHead(&_head);
+    }
+
+    ~ObjectPool()
+    {
+        Trim();
+    }
+
+    // 块按 MEMORY_ALLOCATION_ALIGNMENT 对齐，可以直接容纳含 SLIST_HEADER 的对象
+    void* Alloc()
+    {
+        void* pv = InterlockedPopEntrySList(&_head);
+        if (pv)
+        {
+            InterlockedIncrement(&_cPoolHits);
+        }
+        else
+        {
+            pv = _aligned_malloc(c_cbAlloc, MEMORY_ALLOCATION_ALIGNMENT);
+            if (!pv)
+            {
+                return nullptr;
+            }
+            InterlockedIncrement(&_cHeapAllocs);
+        }
+        InterlockedIncrement(&_cLive);
+        return pv;
+    }
+
+    void Free(void* pv)
+    {
+        if (!pv)
+        {
+            return;
+        }
+        InterlockedDecrement(&_cLive);
+
+        // 深度只是近似值，并发释放时最多多保留几块
+        if (QueryDepthSList(&_head) < cMax)
+        {
+            InterlockedPushEntrySList(&_head, (PSLIST_ENTRY)pv);
+        }
+        else
+        {
+            _aligned_free(pv);
+        }
+    }
+
+    // 释放所有空闲块
+    void Trim()
+    {
+        PSLIST_ENTRY pEntry = InterlockedFlushSList(&_head);
+        while (pEntry)
+        {
+            PSLIST_ENTRY pNext = pEntry->Next;
+            _aligned_free(pEntry);
+            pEntry = pNext;
+        }
+    }
+
+    void GetStats(OBJECT_POOL_STATS* pStats) const
+    {
+        pStats->cHeapAllocs = _cHeapAllocs;
+        pStats->cPoolHits = _cPoolHits;
+        pStats->cLive = _cLive;
+    }
+
+private:
+    static const size_t c_cbAlloc = (cbBlock > sizeof(SLIST_ENTRY)) ? cbBlock : sizeof(SLIST_ENTRY);
+
+    SLIST_HEADER _head;
+    volatile LONG _cHeapAllocs;
+    volatile LONG _cPoolHits;
+    volatile LONG _cLive;
+};
+
+// 对象统计，供 tools\comsoak.cpp 检查引用计数泄漏和每轮的堆分配次数
+struct WINUNLOCK_OBJECT_STATS
+{
+    LONG cDllRefs;                      // DllCanUnloadNow 依据的 DLL 引用计数
+    OBJECT_POOL_STATS providers;
+    OBJECT_POOL_STATS credentials;
+};
+
+extern "C" HRESULT WINAPI WinUnlockGetObjectStats(WINUNLOCK_OBJECT_STATS* pStats);
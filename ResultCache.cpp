@@ -0,0 +1,274 @@
+#include "pch.h"
+#include "ResultCache.h"
+
+// ntstatus.h 与 windows.h 同时包含需要额外的宏处理，这里只定义用到的状态码
+#define RC_STATUS_NO_LOGON_SERVERS          ((NTSTATUS)0xC000005EL)
+#define RC_STATUS_WRONG_PASSWORD            ((NTSTATUS)0xC000006AL)
+#define RC_STATUS_LOGON_FAILURE             ((NTSTATUS)0xC000006DL)
+#define RC_STATUS_ACCOUNT_RESTRICTION       ((NTSTATUS)0xC000006EL)
+#define RC_STATUS_PASSWORD_EXPIRED          ((NTSTATUS)0xC0000071L)
+#define RC_STATUS_ACCOUNT_DISABLED          ((NTSTATUS)0xC0000072L)
+#define RC_STATUS_NO_SUCH_USER              ((NTSTATUS)0xC0000064L)
+#define RC_STATUS_ACCOUNT_EXPIRED           ((NTSTATUS)0xC0000193L)
+#define RC_STATUS_PASSWORD_MUST_CHANGE      ((NTSTATUS)0xC0000224L)
+#define RC_STATUS_ACCOUNT_LOCKED_OUT        ((NTSTATUS)0xC0000234L)
+
+static ResultCache s_resultCache;
+
+ResultCache::ResultCache()
+{
+    InitializeSRWLock(&_lock);
+    ZeroMemory(_rgEntries, sizeof(_rgEntries));
+}
+
+ResultCache* ResultCache::GetDefault()
+{
+    return &s_resultCache;
+}
+
+RESULT_KIND ResultCache::Classify(NTSTATUS ntsStatus, NTSTATUS ntsSubstatus)
+{
+    if (ntsStatus >= 0)
+    {
+        return RK_SUCCESS;
+    }
+
+    // STATUS_LOGON_FAILURE / STATUS_ACCOUNT_RESTRICTION 的具体原因在子状态中
+    NTSTATUS nts = ntsStatus;
+    if (((nts == RC_STATUS_LOGON_FAILURE) || (nts == RC_STATUS_ACCOUNT_RESTRICTION)) && (ntsSubstatus < 0))
+    {
+        nts = ntsSubstatus;
+    }
+
+    switch (nts)
+    {
+    case RC_STATUS_LOGON_FAILURE:
+    case RC_STATUS_WRONG_PASSWORD:
+    case RC_STATUS_NO_SUCH_USER:
+        return RK_CREDENTIAL;
+
+    case RC_STATUS_ACCOUNT_LOCKED_OUT:
+    case RC_STATUS_ACCOUNT_DISABLED:
+    case RC_STATUS_ACCOUNT_EXPIRED:
+    case RC_STATUS_PASSWORD_EXPIRED:
+    case RC_STATUS_PASSWORD_MUST_CHANGE:
+        return RK_PERMANENT;
+
+    case RC_STATUS_NO_LOGON_SERVERS:
+    default:
+        return RK_TRANSIENT;
+    }
+}
+
+// FNV-1a，ASCII 字母不区分大小写（账户键可能是用户名）
+ULONGLONG ResultCache::HashKey(PCWSTR pszKey)
+{
+    ULONGLONG ullHash = 14695981039346656037ULL;
+    for (PCWSTR pch = pszKey; *pch; pch++)
+    {
+        WCHAR ch = *pch;
+        if ((ch >= L'a') && (ch <= L'z'))
+        {
+            ch = ch - L'a' + L'A';
+        }
+        ullHash ^= ch;
+        ullHash *= 1099511628211ULL;
+    }
+    return ullHash ? ullHash : 1;
+}
+
+// 线性探测，表很小且固定，探测次数有上限
+RESULT_ENTRY* ResultCache::_Find(ULONGLONG ullKeyHash)
+{
+    DWORD dwStart = (DWORD)(ullKeyHash % RESULT_CACHE_SLOTS);
+    for (DWORD i = 0; i < RESULT_CACHE_SLOTS; i++)
+    {
+        RESULT_ENTRY* pEntry = &_rgEntries[(dwStart + i) % RESULT_CACHE_SLOTS];
+        if (pEntry->ullKeyHash == ullKeyHash)
+        {
+            return pEntry;
+        }
+        if (!pEntry->ullKeyHash)
+        {
+            break;
+        }
+    }
+    return nullptr;
+}
+
+RESULT_ENTRY* ResultCache::_FindOrAllocate(ULONGLONG ullKeyHash)
+{
+    RESULT_ENTRY* pEntry = _Find(ullKeyHash);
+    if (pEntry)
+    {
+        return pEntry;
+    }
+
+    // 优先使用探测序列上的第一个空槽，表满时淘汰最久未更新的记录
+    DWORD dwStart = (DWORD)(ullKeyHash % RESULT_CACHE_SLOTS);
+    RESULT_ENTRY* pOldest = nullptr;
+    for (DWORD i = 0; i < RESULT_CACHE_SLOTS; i++)
+    {
+        RESULT_ENTRY* pCandidate = &_rgEntries[(dwStart + i) % RESULT_CACHE_SLOTS];
+        if (!pCandidate->ullKeyHash)
+        {
+            pOldest = pCandidate;
+            break;
+        }
+        if (!pOldest || (pCandidate->ullUpdateTick < pOldest->ullUpdateTick))
+        {
+            pOldest = pCandidate;
+        }
+    }
+
+    ZeroMemory(pOldest, sizeof(*pOldest));
+    pOldest->ullKeyHash = ullKeyHash;
+    return pOldest;
+}
+
+void ResultCache::RecordResult(PCWSTR pszKey, ULONGLONG ullStamp, NTSTATUS ntsStatus, NTSTATUS ntsSubstatus, ULONGLONG ullNow)
+{
+    if (!pszKey)
+    {
+        return;
+    }
+
+    ULONGLONG ullKeyHash = HashKey(pszKey);
+    RESULT_KIND kind = Classify(ntsStatus, ntsSubstatus);
+
+    AcquireSRWLockExclusive(&_lock);
+    if (kind == RK_SUCCESS)
+    {
+        // 清除失败记录，保留槽位以统计最近的成功次数
+        RESULT_ENTRY* pEntry = _FindOrAllocate(ullKeyHash);
+        pEntry->cFailures = 0;
+        pEntry->fBlocked = false;
+        pEntry->ullRetryTick = 0;
+        pEntry->ntsLastStatus = ntsStatus;
+        pEntry->ntsLastSubstatus = ntsSubstatus;
+        pEntry->ullUpdateTick = ullNow;
+        pEntry->rgullUnlockTicks[pEntry->iNextUnlock] = ullNow ? ullNow : 1;
+        pEntry->iNextUnlock = (pEntry->iNextUnlock + 1) % RESULT_CACHE_RECENT_UNLOCKS;
+    }
+    else
+    {
+        RESULT_ENTRY* pEntry = _FindOrAllocate(ullKeyHash);
+        if (pEntry->ullStamp != ullStamp)
+        {
+            // 密码已变化，之前的失败不再计入
+            pEntry->cFailures = 0;
+            pEntry->fBlocked = false;
+            pEntry->ullStamp = ullStamp;
+        }
+
+        DWORD cBackoffs = 0;
+        if (kind == RK_CREDENTIAL)
+        {
+            pEntry->cFailures++;
+            cBackoffs = pEntry->cFailures;
+            if (pEntry->cFailures >= RESULT_CACHE_MAX_FAILURES)
+            {
+                pEntry->fBlocked = true;
+            }
+        }
+        else if (kind == RK_PERMANENT)
+        {
+            pEntry->fBlocked = true;
+        }
+        else
+        {
+            cBackoffs = pEntry->cFailures + 1;
+        }
+
+        ULONGLONG ullBackoff = RESULT_CACHE_BACKOFF_MS;
+        for (DWORD i = 1; (i < cBackoffs) && (ullBackoff < RESULT_CACHE_BACKOFF_MAX_MS); i++)
+        {
+            ullBackoff *= 2;
+        }
+        pEntry->ullRetryTick = ullNow + min(ullBackoff, (ULONGLONG)RESULT_CACHE_BACKOFF_MAX_MS);
+        pEntry->ntsLastStatus = ntsStatus;
+        pEntry->ntsLastSubstatus = ntsSubstatus;
+        pEntry->ullUpdateTick = ullNow;
+    }
+    ReleaseSRWLockExclusive(&_lock);
+}
+
+HRESULT ResultCache::CanAutoSubmit(PCWSTR pszKey, ULONGLONG ullStamp, ULONGLONG ullNow)
+{
+    if (!pszKey)
+    {
+        return E_INVALIDARG;
+    }
+
+    ULONGLONG ullKeyHash = HashKey(pszKey);
+    HRESULT hr = S_OK;
+
+    AcquireSRWLockShared(&_lock);
+    RESULT_ENTRY* pEntry = _Find(ullKeyHash);
+    if (pEntry && (pEntry->ullStamp == ullStamp))
+    {
+        if (pEntry->fBlocked)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE);
+        }
+        else if (ullNow < pEntry->ullRetryTick)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_RETRY);
+        }
+    }
+    ReleaseSRWLockShared(&_lock);
+    return hr;
+}
+
+bool ResultCache::GetDecision(PCWSTR pszKey, ULONGLONG* pullRetryTick, bool* pfBlocked)
+{
+    *pullRetryTick = 0;
+    *pfBlocked = false;
+    if (!pszKey)
+    {
+        return false;
+    }
+
+    ULONGLONG ullKeyHash = HashKey(pszKey);
+
+    AcquireSRWLockShared(&_lock);
+    RESULT_ENTRY* pEntry = _Find(ullKeyHash);
+    if (pEntry)
+    {
+        *pullRetryTick = pEntry->ullRetryTick;
+        *pfBlocked = pEntry->fBlocked;
+    }
+    ReleaseSRWLockShared(&_lock);
+    return pEntry != nullptr;
+}
+
+DWORD ResultCache::CountRecentUnlocks(PCWSTR pszKey, ULONGLONG ullNow)
+{
+    if (!pszKey)
+    {
+        return 0;
+    }
+
+    ULONGLONG ullKeyHash = HashKey(pszKey);
+    DWORD cUnlocks = 0;
+
+    AcquireSRWLockShared(&_lock);
+    RESULT_ENTRY* pEntry = _Find(ullKeyHash);
+    if (pEntry)
+    {
+        for (DWORD i = 0; i < RESULT_CACHE_RECENT_UNLOCKS; i++)
+        {
+            ULONGLONG ullTick = pEntry->rgullUnlockTicks[i];
+            cUnlocks += (ullTick && (ullNow - ullTick < RESULT_CACHE_RECENT_WINDOW_MS)) ? 1 : 0;
+        }
+    }
+    ReleaseSRWLockShared(&_lock);
+    return cUnlocks;
+}
+
+void ResultCache::Reset()
+{
+    AcquireSRWLockExclusive(&_lock);
+    ZeroMemory(_rgEntries, sizeof(_rgEntries));
+    ReleaseSRWLockExclusive(&_lock);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "pch.h"
+
+// 连续因凭据错误失败达到此次数后停止自动提交，直到存储的密码变化
+#define RESULT_CACHE_MAX_FAILURES   3
+
+// 失败后的退避时间：首次 RESULT_CACHE_BACKOFF_MS，之后每次加倍，最长 RESULT_CACHE_BACKOFF_MAX_MS
+#define RESULT_CACHE_BACKOFF_MS     (15 * 1000)
+#define RESULT_CACHE_BACKOFF_MAX_MS (30 * 60 * 1000)
+
+// 每个账户保留的最近成功登录时刻数，供解锁策略的 maxperhour 统计（见 UnlockPolicy.h）
+#define RESULT_CACHE_RECENT_UNLOCKS 16
+#define RESULT_CACHE_RECENT_WINDOW_MS (60 * 60 * 1000)
+
+// 同时跟踪的账户数，超过时淘汰最久未更新的记录
+#define RESULT_CACHE_SLOTS          32
+
+// 登录结果的分类
+enum RESULT_KIND
+{
+    RK_SUCCESS = 0,
+    RK_CREDENTIAL,      // 密码错误等：计入连续失败次数并退避
+    RK_PERMANENT,       // 账户锁定、禁用、密码过期等：立即停止自动提交，直到密码变化
+    RK_TRANSIENT,       // 域控制器不可达等：只退避，不计入失败次数
+};
+
+struct RESULT_ENTRY
+{
+    ULONGLONG ullKeyHash;   // 账户键的哈希，0 表示空槽
+    ULONGLONG ullStamp;     // 记录失败时的密码指纹，与当前指纹不同时记录作废
+    ULONGLONG ullRetryTick; // 退避结束的时刻（GetTickCount64）
+    ULONGLONG ullUpdateTick;
+    NTSTATUS ntsLastStatus;
+    NTSTATUS ntsLastSubstatus;
+    DWORD cFailures;        // 连续 RK_CREDENTIAL 次数
+    bool fBlocked;          // 已停止自动提交
+    DWORD iNextUnlock;      // rgullUnlockTicks 中下一个写入位置
+    ULONGLONG rgullUnlockTicks[RESULT_CACHE_RECENT_UNLOCKS];   // 最近成功登录的时刻，0 表示空
+};
+
+// 登录结果缓存
+// 由 ReportResult 记录每个账户的登录结果，GetCredentialCount 和 SetSelected 在自动提交前查询，
+// 避免密码过期或被修改后反复提交错误凭据（每次都要经过 LSA，并可能触发账户锁定）。
+// 记录按账户键和密码指纹区分，管理员更新密码后旧记录自动作废。
+// 状态保存在进程内共享的固定大小表中，查询为 O(1)；时间由调用方传入，便于注入状态码单独验证状态机。
+class ResultCache
+{
+public:
+    ResultCache();
+
+    // 进程内共享实例：LogonUI 在一次锁屏期间可能多次创建提供程序
+    static ResultCache* GetDefault();
+
+    // 把 ReportResult 收到的状态码归类
+    static RESULT_KIND Classify(NTSTATUS ntsStatus, NTSTATUS ntsSubstatus);
+
+    // 记录一次登录结果，成功时清除该账户的失败记录并记下成功的时刻
+    void RecordResult(PCWSTR pszKey, ULONGLONG ullStamp, NTSTATUS ntsStatus, NTSTATUS ntsSubstatus, ULONGLONG ullNow);
+
+    // 是否允许自动提交：S_OK 允许；退避中返回 HRESULT_FROM_WIN32(ERROR_RETRY)；
+    // 已停止自动提交返回 HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE)
+    HRESULT CanAutoSubmit(PCWSTR pszKey, ULONGLONG ullStamp, ULONGLONG ullNow);
+
+    // 该账户当前的退避到期时刻和是否已停止自动提交，供跨会话共享（见 SharedCache.h）；没有记录时返回 false
+    bool GetDecision(PCWSTR pszKey, ULONGLONG* pullRetryTick, bool* pfBlocked);
+
+    // 最近 RESULT_CACHE_RECENT_WINDOW_MS 内该账户成功登录的次数，最多 RESULT_CACHE_RECENT_UNLOCKS
+    DWORD CountRecentUnlocks(PCWSTR pszKey, ULONGLONG ullNow);
+
+    // 清除所有记录
+    void Reset();
+
+    // 账户键的哈希（FNV-1a，ASCII 字母不区分大小写），各进程结果相同
+    static ULONGLONG HashKey(PCWSTR pszKey);
+
+private:
+    RESULT_ENTRY* _Find(ULONGLONG ullKeyHash);
+    RESULT_ENTRY* _FindOrAllocate(ULONGLONG ullKeyHash);
+
+    SRWLOCK _lock;
+    RESULT_ENTRY _rgEntries[RESULT_CACHE_SLOTS];
+};
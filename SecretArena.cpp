@@ -0,0 +1,185 @@
+#include "pch.h"
+#include "SecretArena.h"
+
+// 每个分配按 16 字节（CRYPTPROTECTMEMORY_BLOCK_SIZE）对齐
+#define SECRET_ARENA_ALIGN 16
+
+static SecretArena s_arena;
+
+SecretArena::SecretArena() :
+    _pbBase(nullptr),
+    _cbSize(0),
+    _cbUsed(0),
+    _cLive(0),
+    _fInitialized(false)
+{
+    InitializeSRWLock(&_lock);
+}
+
+SecretArena::~SecretArena()
+{
+    if (_pbBase)
+    {
+        SecureZeroMemory(_pbBase, _cbSize);
+        VirtualUnlock(_pbBase, _cbSize);
+        VirtualFree(_pbBase, 0, MEM_RELEASE);
+        _pbBase = nullptr;
+    }
+}
+
+SecretArena* SecretArena::GetDefault()
+{
+    return &s_arena;
+}
+
+// 调用方持有排他锁；失败只尝试一次，之后直接退回进程堆
+HRESULT SecretArena::_EnsureInitialized()
+{
+    if (_fInitialized)
+    {
+        return _pbBase ? S_OK : E_OUTOFMEMORY;
+    }
+    _fInitialized = true;
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    SIZE_T cbSize = (SECRET_ARENA_SIZE + si.dwPageSize - 1) & ~((SIZE_T)si.dwPageSize - 1);
+
+    BYTE* pbBase = (BYTE*)VirtualAlloc(nullptr, cbSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!pbBase)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (!VirtualLock(pbBase, cbSize))
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        VirtualFree(pbBase, 0, MEM_RELEASE);
+        return hr;
+    }
+
+    _pbBase = pbBase;
+    _cbSize = cbSize;
+    return S_OK;
+}
+
+PWSTR SecretArena::Alloc(size_t cch)
+{
+    SIZE_T cb = (cch * sizeof(WCHAR) + SECRET_ARENA_ALIGN - 1) & ~(SIZE_T)(SECRET_ARENA_ALIGN - 1);
+    PWSTR psz = nullptr;
+
+    AcquireSRWLockExclusive(&_lock);
+    if (SUCCEEDED(_EnsureInitialized()) && (cb <= _cbSize - _cbUsed))
+    {
+        psz = (PWSTR)(_pbBase + _cbUsed);
+        _cbUsed += cb;
+        _cLive++;
+    }
+    ReleaseSRWLockExclusive(&_lock);
+    return psz;
+}
+
+void SecretArena::Free(PWSTR psz, size_t cch)
+{
+    if (!psz)
+    {
+        return;
+    }
+
+    SecureZeroMemory(psz, cch * sizeof(WCHAR));
+
+    AcquireSRWLockExclusive(&_lock);
+    if (_cLive && !--_cLive)
+    {
+        // 已使用部分在各分配释放时均已清零，这里再整体清一次以覆盖对齐填充
+        SecureZeroMemory(_pbBase, _cbUsed);
+        _cbUsed = 0;
+    }
+    ReleaseSRWLockExclusive(&_lock);
+}
+
+// SecretString
+
+SecretString::SecretString() :
+    _psz(nullptr),
+    _cch(0),
+    _cchAlloc(0),
+    _fHeap(false)
+{
+}
+
+SecretString::~SecretString()
+{
+    Free();
+}
+
+void SecretString::Free()
+{
+    if (_psz)
+    {
+        if (_fHeap)
+        {
+            SecureZeroMemory(_psz, _cchAlloc * sizeof(WCHAR));
+            CoTaskMemFree(_psz);
+        }
+        else
+        {
+            SecretArena::GetDefault()->Free(_psz, _cchAlloc);
+        }
+        _psz = nullptr;
+    }
+    _cch = 0;
+    _cchAlloc = 0;
+    _fHeap = false;
+}
+
+HRESULT SecretString::Allocate(size_t cch)
+{
+    Free();
+    if (cch >= STRSAFE_MAX_CCH)
+    {
+        return E_INVALIDARG;
+    }
+
+    size_t cchAlloc = cch + 1;
+    PWSTR psz = SecretArena::GetDefault()->Alloc(cchAlloc);
+    if (!psz)
+    {
+        psz = (PWSTR)CoTaskMemAlloc(cchAlloc * sizeof(WCHAR));
+        if (!psz)
+        {
+            return E_OUTOFMEMORY;
+        }
+        ZeroMemory(psz, cchAlloc * sizeof(WCHAR));
+        _fHeap = true;
+    }
+
+    _psz = psz;
+    _cchAlloc = cchAlloc;
+    _cch = 0;
+    return S_OK;
+}
+
+HRESULT SecretString::Assign(PCWSTR psz)
+{
+    return Assign(psz, psz ? wcslen(psz) : 0);
+}
+
+HRESULT SecretString::Assign(PCWSTR psz, size_t cch)
+{
+    HRESULT hr = Allocate(cch);
+    if (SUCCEEDED(hr))
+    {
+        if (cch)
+        {
+            CopyMemory(_psz, psz, cch * sizeof(WCHAR));
+        }
+        _psz[cch] = L'\0';
+        _cch = cch;
+    }
+    return hr;
+}
+
+void SecretString::UpdateLength()
+{
+    _cch = _psz ? wcsnlen(_psz, _cchAlloc) : 0;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "pch.h"
+
+// 机密区大小（字节），按页对齐后整体 VirtualLock
+#define SECRET_ARENA_SIZE (16 * 1024)
+
+// 机密内存区
+// 进程内共享的一块固定大小、锁定在物理内存中的区域，专门存放用户名和密码等机密字符串，
+// 避免机密被换出到页面文件或残留在已释放的堆块中。
+// 分配为简单的指针递增；每个分配释放时立即清零，所有分配都释放后整体复位。
+// 区域用尽时退回到进程堆，释放时同样先清零。
+class SecretArena
+{
+public:
+    SecretArena();
+    ~SecretArena();
+
+    // 进程内共享实例，首次分配时才保留并锁定内存
+    static SecretArena* GetDefault();
+
+    // 分配 cch 个字符（已清零），区域不可用或已用尽时返回 nullptr
+    PWSTR Alloc(size_t cch);
+
+    // 清零并释放 Alloc 返回的缓冲区
+    void Free(PWSTR psz, size_t cch);
+
+private:
+    HRESULT _EnsureInitialized();
+
+    SRWLOCK _lock;
+    BYTE* _pbBase;
+    SIZE_T _cbSize;
+    SIZE_T _cbUsed;
+    DWORD _cLive;
+    bool _fInitialized;
+};
+
+// 机密字符串
+// 缓冲区来自 SecretArena，析构或重新赋值时清零；不可复制，按引用传递。
+class SecretString
+{
+public:
+    SecretString();
+    ~SecretString();
+
+    // 分配 cch 个字符的缓冲区（另加结尾 NUL），原有内容先清零释放
+    HRESULT Allocate(size_t cch);
+
+    // 复制字符串
+    HRESULT Assign(PCWSTR psz);
+    HRESULT Assign(PCWSTR psz, size_t cch);
+
+    // 缓冲区被直接写入后重新计算长度
+    void UpdateLength();
+
+    void Free();
+
+    PWSTR Get() const { return _psz; }
+    size_t Length() const { return _cch; }
+    bool IsEmpty() const { return !_psz; }
+
+private:
+    SecretString(const SecretString&);
+    SecretString& operator=(const SecretString&);
+
+    PWSTR _psz;
+    size_t _cch;        // 字符串长度
+    size_t _cchAlloc;   // 缓冲区字符数（含结尾 NUL）
+    bool _fHeap;        // 机密区用尽时来自进程堆
+};
@@ -0,0 +1,56 @@
+#include "pch.h"
+#include "SecretFingerprint.h"
+#include <bcrypt.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+static INIT_ONCE s_initFingerprint = INIT_ONCE_STATIC_INIT;
+static BCRYPT_ALG_HANDLE s_hFingerprintAlg = nullptr;
+static BYTE s_rgbFingerprintKey[32];
+
+static BOOL CALLBACK InitializeFingerprint(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(pvParameter);
+    UNREFERENCED_PARAMETER(ppvContext);
+
+    if (!BCRYPT_SUCCESS(BCryptGenRandom(nullptr, s_rgbFingerprintKey, sizeof(s_rgbFingerprintKey), BCRYPT_USE_SYSTEM_PREFERRED_RNG)))
+    {
+        return FALSE;
+    }
+    return BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&s_hFingerprintAlg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG));
+}
+
+HRESULT SecretFingerprint(PCWSTR psz, size_t cch, ULONGLONG* pullFingerprint)
+{
+    *pullFingerprint = 0;
+    if (!InitOnceExecuteOnce(&s_initFingerprint, InitializeFingerprint, nullptr, nullptr))
+    {
+        return E_FAIL;
+    }
+    if (cch * sizeof(WCHAR) > MAXULONG)
+    {
+        return E_INVALIDARG;
+    }
+
+    BYTE rgbMac[32];
+    BCRYPT_HASH_HANDLE hHash = nullptr;
+    NTSTATUS status = BCryptCreateHash(s_hFingerprintAlg, &hHash, nullptr, 0, s_rgbFingerprintKey, sizeof(s_rgbFingerprintKey), 0);
+    if (BCRYPT_SUCCESS(status))
+    {
+        status = BCryptHashData(hHash, (PUCHAR)psz, (ULONG)(cch * sizeof(WCHAR)), 0);
+        if (BCRYPT_SUCCESS(status))
+        {
+            status = BCryptFinishHash(hHash, rgbMac, sizeof(rgbMac), 0);
+        }
+        BCryptDestroyHash(hHash);
+    }
+    if (!BCRYPT_SUCCESS(status))
+    {
+        return HRESULT_FROM_NT(status);
+    }
+
+    CopyMemory(pullFingerprint, rgbMac, sizeof(*pullFingerprint));
+    SecureZeroMemory(rgbMac, sizeof(rgbMac));
+    return S_OK;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "pch.h"
+
+// 机密指纹：以进程内随机密钥计算的 HMAC-SHA256 截断为 64 位，
+// 只用于判断机密是否变化，不能在进程之间比较，也无法反推出机密
+HRESULT SecretFingerprint(PCWSTR psz, size_t cch, ULONGLONG* pullFingerprint);
@@ -0,0 +1,377 @@
+#include "pch.h"
+#include "SharedCache.h"
+#include <aclapi.h>
+#include <sddl.h>
+
+// 只允许 SYSTEM 和管理员访问：配置区虽然是密封数据，但决策区可被用来阻止其余会话自动解锁
+static const WCHAR c_szSectionSddl[] = L"D:P(A;;GA;;;SY)(A;;GA;;;BA)";
+
+static volatile LONG g_fSharedCacheInitialized = FALSE;
+static SharedCache* volatile g_pSharedCache = nullptr;
+
+SharedCache::SharedCache() :
+    _hSection(nullptr),
+    _pHeader(nullptr),
+    _pbConfig(nullptr),
+    _cConfigHits(0),
+    _cConfigMisses(0),
+    _cReadRetries(0),
+    _cReadAbandoned(0),
+    _cWritesSkipped(0)
+{
+}
+
+SharedCache::~SharedCache()
+{
+    Close();
+}
+
+SharedCache* SharedCache::GetDefault()
+{
+    return (SharedCache*)ReadPointerAcquire((PVOID volatile*)&g_pSharedCache);
+}
+
+// 区段所有者必须是 SYSTEM 或管理员，否则可能是普通进程抢先创建、内容不可信
+static bool IsTrustedOwner(HANDLE hSection)
+{
+    PSID pOwner = nullptr;
+    PSECURITY_DESCRIPTOR pSD = nullptr;
+    if (GetSecurityInfo(hSection, SE_KERNEL_OBJECT, OWNER_SECURITY_INFORMATION, &pOwner, nullptr, nullptr, nullptr, &pSD) != ERROR_SUCCESS)
+    {
+        return false;
+    }
+    bool fTrusted = pOwner && (IsWellKnownSid(pOwner, WinLocalSystemSid) || IsWellKnownSid(pOwner, WinBuiltinAdministratorsSid));
+    LocalFree(pSD);
+    return fTrusted;
+}
+
+HRESULT SharedCache::Open(PCWSTR pszName, bool fRequireTrustedOwner)
+{
+    Close();
+
+    PSECURITY_DESCRIPTOR pSD = nullptr;
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(c_szSectionSddl, SDDL_REVISION_1, &pSD, nullptr))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), pSD, FALSE };
+    _hSection = CreateFileMappingW(INVALID_HANDLE_VALUE, &sa, PAGE_READWRITE, 0, (DWORD)SHARED_CACHE_SECTION_SIZE, pszName);
+    DWORD dwError = GetLastError();
+    LocalFree(pSD);
+    if (!_hSection)
+    {
+        return HRESULT_FROM_WIN32(dwError);
+    }
+    bool fCreated = (dwError != ERROR_ALREADY_EXISTS);
+
+    HRESULT hr = S_OK;
+    if (!fCreated && fRequireTrustedOwner && !IsTrustedOwner(_hSection))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_OWNER);
+    }
+    if (SUCCEEDED(hr))
+    {
+        _pHeader = (SHARED_CACHE_HEADER*)MapViewOfFile(_hSection, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, SHARED_CACHE_SECTION_SIZE);
+        if (!_pHeader)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        _pbConfig = (BYTE*)(_pHeader + 1);
+        if (fCreated)
+        {
+            // 新区段内容全为 0，序号和写锁已是初始状态；魔数最后写入，其余进程据此判断是否可用
+            _pHeader->dwVersion = SHARED_CACHE_VERSION;
+            _pHeader->cbSection = (DWORD)SHARED_CACHE_SECTION_SIZE;
+            WriteRelease((volatile LONG*)&_pHeader->dwMagic, SHARED_CACHE_MAGIC);
+        }
+        else if ((ReadAcquire((volatile LONG*)&_pHeader->dwMagic) == SHARED_CACHE_MAGIC) &&
+            ((_pHeader->dwVersion != SHARED_CACHE_VERSION) || (_pHeader->cbSection != SHARED_CACHE_SECTION_SIZE)))
+        {
+            // 其他版本的 DLL 创建的区段，布局不同，不使用
+            hr = HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH);
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+    return hr;
+}
+
+void SharedCache::Close()
+{
+    if (_pHeader)
+    {
+        UnmapViewOfFile(_pHeader);
+        _pHeader = nullptr;
+        _pbConfig = nullptr;
+    }
+    if (_hSection)
+    {
+        CloseHandle(_hSection);
+        _hSection = nullptr;
+    }
+}
+
+// 创建方可能还在初始化
+bool SharedCache::_IsReady() const
+{
+    return _pHeader && ((DWORD)ReadAcquire((volatile LONG*)&_pHeader->dwMagic) == SHARED_CACHE_MAGIC);
+}
+
+// 写锁的值为获取时刻，持有过久时以 CAS 接管；pllToken 返回本次获取的值，释放时只清除自己的锁。
+// 持有者可能在本次读取时刻之后才获取，只有持有时刻更早时才比较，避免差值下溢被误判为过期
+bool SharedCache::_TryLockWriter(LONG64* pllToken)
+{
+    ULONGLONG ullNow = GetTickCount64();
+    LONG64 llToken = (LONG64)(ullNow ? ullNow : 1);
+    LONG64 llHeld = InterlockedCompareExchange64(&_pHeader->llWriteLock, llToken, 0);
+    if (llHeld && (ullNow > (ULONGLONG)llHeld) && (ullNow - (ULONGLONG)llHeld > SHARED_CACHE_WRITE_LOCK_STALE_MS))
+    {
+        llHeld = (InterlockedCompareExchange64(&_pHeader->llWriteLock, llToken, llHeld) == llHeld) ? 0 : llHeld;
+    }
+    if (llHeld)
+    {
+        InterlockedIncrement64(&_cWritesSkipped);
+        return false;
+    }
+    *pllToken = llToken;
+    return true;
+}
+
+void SharedCache::_UnlockWriter(LONG64 llToken)
+{
+    InterlockedCompareExchange64(&_pHeader->llWriteLock, 0, llToken);
+}
+
+// 序号改为奇数后才开始写入。基于当前值 | 1 再加 2，上一个写入方中途退出留下奇数时，
+// 新的奇数也与读取方之前见过的任何值不同
+LONG SharedCache::_BeginWrite(volatile LONG* plSequence)
+{
+    LONG lSequence = (ReadAcquire(plSequence) | 1) + 2;
+    InterlockedExchange(plSequence, lSequence);
+    return lSequence;
+}
+
+void SharedCache::_EndWrite(volatile LONG* plSequence, LONG lSequence)
+{
+    InterlockedExchange(plSequence, lSequence + 1);
+}
+
+HRESULT SharedCache::ReadConfig(BYTE** ppb, DWORD* pcb, ULONGLONG* pullWriteTime, ULONGLONG* pcbFile)
+{
+    *ppb = nullptr;
+    *pcb = 0;
+    if (!_IsReady())
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_READY);
+    }
+
+    for (DWORD i = 0; i < SHARED_CACHE_READ_RETRIES; i++)
+    {
+        LONG lBefore = ReadAcquire(&_pHeader->lConfigSequence);
+        if (!(lBefore & 1))
+        {
+            DWORD cb = *(volatile DWORD*)&_pHeader->cbConfig;
+            ULONGLONG ullWriteTime = *(volatile ULONGLONG*)&_pHeader->ullConfigWriteTime;
+            ULONGLONG cbFile = *(volatile ULONGLONG*)&_pHeader->cbConfigFile;
+            BYTE* pb = nullptr;
+            if (cb && (cb <= SHARED_CACHE_CONFIG_MAX))
+            {
+                pb = (BYTE*)CoTaskMemAlloc(cb);
+                if (!pb)
+                {
+                    return E_OUTOFMEMORY;
+                }
+                CopyMemory(pb, _pbConfig, cb);
+            }
+            MemoryBarrier();
+            if (ReadNoFence(&_pHeader->lConfigSequence) == lBefore)
+            {
+                if (!pb)
+                {
+                    InterlockedIncrement64(&_cConfigMisses);
+                    return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+                }
+                InterlockedIncrement64(&_cConfigHits);
+                *ppb = pb;
+                *pcb = cb;
+                *pullWriteTime = ullWriteTime;
+                *pcbFile = cbFile;
+                return S_OK;
+            }
+            CoTaskMemFree(pb);
+        }
+        InterlockedIncrement64(&_cReadRetries);
+        YieldProcessor();
+    }
+    InterlockedIncrement64(&_cReadAbandoned);
+    return E_PENDING;
+}
+
+HRESULT SharedCache::PublishConfig(ULONGLONG ullWriteTime, ULONGLONG cbFile, const BYTE* pb, DWORD cb)
+{
+    if (!_IsReady())
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_READY);
+    }
+    if (!cb || (cb > SHARED_CACHE_CONFIG_MAX))
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+
+    LONG64 llToken;
+    if (!_TryLockWriter(&llToken))
+    {
+        return E_PENDING;
+    }
+
+    // 持有写锁时内容不会变化，可以直接比较
+    HRESULT hr = S_FALSE;
+    if ((_pHeader->cbConfig != cb) || (_pHeader->ullConfigWriteTime != ullWriteTime) || (_pHeader->cbConfigFile != cbFile))
+    {
+        LONG lSequence = _BeginWrite(&_pHeader->lConfigSequence);
+        CopyMemory(_pbConfig, pb, cb);
+        _pHeader->cbConfig = cb;
+        _pHeader->ullConfigWriteTime = ullWriteTime;
+        _pHeader->cbConfigFile = cbFile;
+        _pHeader->ullConfigRefreshTick = GetTickCount64();
+        _pHeader->dwRefresherProcessId = GetCurrentProcessId();
+        _EndWrite(&_pHeader->lConfigSequence, lSequence);
+        hr = S_OK;
+    }
+    _UnlockWriter(llToken);
+    return hr;
+}
+
+void SharedCache::PublishDecision(ULONGLONG ullKeyHash, DWORD dwGeneration, ULONGLONG ullRetryTick, bool fBlocked, ULONGLONG ullNow)
+{
+    LONG64 llToken;
+    if (!ullKeyHash || !_IsReady() || !_TryLockWriter(&llToken))
+    {
+        return;
+    }
+
+    SHARED_CACHE_DECISION* pTarget = nullptr;
+    for (DWORD i = 0; i < SHARED_CACHE_DECISIONS; i++)
+    {
+        SHARED_CACHE_DECISION* pCandidate = &_pHeader->rgDecisions[i];
+        if (pCandidate->ullKeyHash == ullKeyHash)
+        {
+            pTarget = pCandidate;
+            break;
+        }
+        if (!pTarget || (pCandidate->ullUpdateTick < pTarget->ullUpdateTick))
+        {
+            pTarget = pCandidate;
+        }
+    }
+
+    LONG lSequence = _BeginWrite(&_pHeader->lDecisionSequence);
+    pTarget->ullKeyHash = ullKeyHash;
+    pTarget->ullRetryTick = ullRetryTick;
+    pTarget->ullUpdateTick = ullNow;
+    pTarget->dwGeneration = dwGeneration;
+    pTarget->fBlocked = fBlocked;
+    _EndWrite(&_pHeader->lDecisionSequence, lSequence);
+    _UnlockWriter(llToken);
+}
+
+HRESULT SharedCache::ReadDecision(ULONGLONG ullKeyHash, SHARED_CACHE_DECISION* pDecision)
+{
+    ZeroMemory(pDecision, sizeof(*pDecision));
+    if (!ullKeyHash || !_IsReady())
+    {
+        return S_FALSE;
+    }
+
+    for (DWORD i = 0; i < SHARED_CACHE_READ_RETRIES; i++)
+    {
+        LONG lBefore = ReadAcquire(&_pHeader->lDecisionSequence);
+        if (!(lBefore & 1))
+        {
+            SHARED_CACHE_DECISION decision = {};
+            for (DWORD j = 0; j < SHARED_CACHE_DECISIONS; j++)
+            {
+                if (*(volatile ULONGLONG*)&_pHeader->rgDecisions[j].ullKeyHash == ullKeyHash)
+                {
+                    CopyMemory(&decision, &_pHeader->rgDecisions[j], sizeof(decision));
+                    break;
+                }
+            }
+            MemoryBarrier();
+            if (ReadNoFence(&_pHeader->lDecisionSequence) == lBefore)
+            {
+                if (decision.ullKeyHash != ullKeyHash)
+                {
+                    return S_FALSE;
+                }
+                *pDecision = decision;
+                return S_OK;
+            }
+        }
+        InterlockedIncrement64(&_cReadRetries);
+        YieldProcessor();
+    }
+    InterlockedIncrement64(&_cReadAbandoned);
+    return E_PENDING;
+}
+
+HRESULT SharedCache::CheckDecision(ULONGLONG ullKeyHash, DWORD dwGeneration, ULONGLONG ullNow)
+{
+    SHARED_CACHE_DECISION decision;
+    if ((ReadDecision(ullKeyHash, &decision) != S_OK) || (decision.dwGeneration != dwGeneration))
+    {
+        return S_OK;
+    }
+    if (decision.fBlocked && (ullNow - decision.ullUpdateTick < SHARED_CACHE_BLOCK_MAX_MS))
+    {
+        return HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE);
+    }
+    return (ullNow < decision.ullRetryTick) ? HRESULT_FROM_WIN32(ERROR_RETRY) : S_OK;
+}
+
+void SharedCache::GetStats(SHARED_CACHE_STATS* pStats)
+{
+    pStats->cConfigHits = ReadAcquire64(&_cConfigHits);
+    pStats->cConfigMisses = ReadAcquire64(&_cConfigMisses);
+    pStats->cReadRetries = ReadAcquire64(&_cReadRetries);
+    pStats->cReadAbandoned = ReadAcquire64(&_cReadAbandoned);
+    pStats->cWritesSkipped = ReadAcquire64(&_cWritesSkipped);
+}
+
+void SharedCacheInitialize()
+{
+    if (InterlockedCompareExchange(&g_fSharedCacheInitialized, TRUE, FALSE))
+    {
+        return;
+    }
+
+    DWORD dwEnabled = 0;
+    DWORD cbEnabled = sizeof(dwEnabled);
+    if ((RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"SharedCacheEnabled", RRF_RT_REG_DWORD, nullptr, &dwEnabled, &cbEnabled) != ERROR_SUCCESS) ||
+        !dwEnabled)
+    {
+        return;
+    }
+
+    SharedCache* pCache = new(std::nothrow) SharedCache();
+    if (pCache && SUCCEEDED(pCache->Open(SHARED_CACHE_SECTION_NAME, true)))
+    {
+        InterlockedExchangePointer((PVOID volatile*)&g_pSharedCache, pCache);
+    }
+    else
+    {
+        delete pCache;
+    }
+}
+
+void SharedCacheCleanup()
+{
+    SharedCache* pCache = (SharedCache*)InterlockedExchangePointer((PVOID volatile*)&g_pSharedCache, nullptr);
+    delete pCache;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include "pch.h"
+
+// 跨会话共享缓存（远程桌面会话主机）
+//
+// 会话主机上每个会话的 LogonUI 各自加载本 DLL，锁定时各自读取配置文件和凭据来源。
+// 由 HKLM\SOFTWARE\WinUnlock\SharedCacheEnabled（DWORD）开启后，本机所有会话共用一个命名内存区段
+// （只允许 SYSTEM 和管理员访问，打开已有区段时还要求其所有者为二者之一）：
+//   配置区  config.bin 的原样内容及其文件时间戳。密码仍是密封的，各会话自行解封；
+//           时间戳与文件一致时 ConfigFileCredentialSource 直接从这里复制，不再打开和校验文件
+//   决策区  每个账户最近一次自动提交的结果（退避到期时刻、是否已停止），按配置 Generation 作废；
+//           一个会话中被拒绝的凭据不会在其余会话中各提交一次，避免触发账户锁定
+//
+// 两个区各有一个序号（seqlock）：写入方先把序号改为奇数，写完再改为偶数；读取方复制前后各读一次序号，
+// 为奇数或前后不一致时重试，最多 SHARED_CACHE_READ_RETRIES 次后放弃并回退到自己的来源，从不等待锁。
+// 写入方之间用区段内的写锁互斥，只尝试获取、拿不到就放弃本次写入，因此同一时刻只有一个刷新者；
+// 写锁被持有超过 SHARED_CACHE_WRITE_LOCK_STALE_MS 时视为持有者已退出，可以接管。
+// 布局只含定长字段、不含指针，各进程映射地址不同也能直接使用。
+
+#define SHARED_CACHE_SECTION_NAME       L"Global\\WinUnlock.SharedCache"
+#define SHARED_CACHE_MAGIC              0x43535557      // "WUSC"
+#define SHARED_CACHE_VERSION            1
+#define SHARED_CACHE_CONFIG_MAX         (256 * 1024)    // 更大的配置文件不缓存
+#define SHARED_CACHE_DECISIONS          64
+#define SHARED_CACHE_READ_RETRIES       64
+#define SHARED_CACHE_WRITE_LOCK_STALE_MS 1000
+
+// 已停止自动提交的决策最长保留时间：密码通过不递增 Generation 的方式更新时，其余会话最终也会恢复
+#define SHARED_CACHE_BLOCK_MAX_MS       (30 * 60 * 1000)
+
+struct SHARED_CACHE_DECISION
+{
+    ULONGLONG ullKeyHash;       // ResultCache::HashKey(账户键)，0 表示空槽
+    ULONGLONG ullRetryTick;     // 退避结束的时刻（GetTickCount64，本机各会话一致）
+    ULONGLONG ullUpdateTick;
+    DWORD dwGeneration;         // 记录时的配置 Generation，与当前不同时作废
+    DWORD fBlocked;
+};
+
+struct SHARED_CACHE_HEADER
+{
+    DWORD dwMagic;              // 创建方初始化完成后最后写入
+    DWORD dwVersion;
+    DWORD cbSection;
+    DWORD dwReserved;
+    volatile LONG64 llWriteLock;    // 0 表示空闲，否则为持有者获取时的 GetTickCount64
+
+    // 配置区，受 lConfigSequence 保护
+    volatile LONG lConfigSequence;
+    DWORD cbConfig;             // 0 表示尚无内容
+    ULONGLONG ullConfigWriteTime;   // config.bin 的最后写入时间（FILETIME）
+    ULONGLONG cbConfigFile;
+    ULONGLONG ullConfigRefreshTick;
+    DWORD dwRefresherProcessId;
+
+    // 决策区，受 lDecisionSequence 保护
+    volatile LONG lDecisionSequence;
+    SHARED_CACHE_DECISION rgDecisions[SHARED_CACHE_DECISIONS];
+
+    // 其后为 SHARED_CACHE_CONFIG_MAX 字节的配置内容
+};
+
+static_assert(sizeof(SHARED_CACHE_DECISION) == 32, "decision layout is shared between processes");
+static_assert(sizeof(SHARED_CACHE_HEADER) == 64 + SHARED_CACHE_DECISIONS * 32, "header layout is shared between processes");
+
+#define SHARED_CACHE_SECTION_SIZE       (sizeof(SHARED_CACHE_HEADER) + SHARED_CACHE_CONFIG_MAX)
+
+struct SHARED_CACHE_STATS
+{
+    LONG64 cConfigHits;
+    LONG64 cConfigMisses;       // 尚无内容或时间戳不一致
+    LONG64 cReadRetries;        // 读取时遇到写入而重试的次数
+    LONG64 cReadAbandoned;      // 重试次数用尽而回退的次数
+    LONG64 cWritesSkipped;      // 没拿到写锁而放弃的写入
+};
+
+class SharedCache
+{
+public:
+    SharedCache();
+    ~SharedCache();
+
+    // 进程内共享实例；未开启或区段不可用时返回 nullptr
+    static SharedCache* GetDefault();
+
+    // 创建或打开区段。fRequireTrustedOwner 时拒绝所有者不是 SYSTEM 或管理员的已有区段（防止抢先创建）
+    HRESULT Open(PCWSTR pszName, bool fRequireTrustedOwner);
+    void Close();
+
+    // 复制配置内容（调用方用 CoTaskMemFree 释放）及其文件时间戳；尚无内容返回 HRESULT_FROM_WIN32(ERROR_NOT_FOUND)，
+    // 重试次数用尽返回 E_PENDING
+    HRESULT ReadConfig(BYTE** ppb, DWORD* pcb, ULONGLONG* pullWriteTime, ULONGLONG* pcbFile);
+
+    // 以新的文件内容替换配置区；时间戳相同时返回 S_FALSE，没拿到写锁时返回 E_PENDING
+    HRESULT PublishConfig(ULONGLONG ullWriteTime, ULONGLONG cbFile, const BYTE* pb, DWORD cb);
+
+    // 记录账户的自动提交结果，表满时淘汰最久未更新的记录；没拿到写锁时放弃
+    void PublishDecision(ULONGLONG ullKeyHash, DWORD dwGeneration, ULONGLONG ullRetryTick, bool fBlocked, ULONGLONG ullNow);
+
+    // 复制账户的决策记录；没有记录返回 S_FALSE，重试次数用尽返回 E_PENDING
+    HRESULT ReadDecision(ULONGLONG ullKeyHash, SHARED_CACHE_DECISION* pDecision);
+
+    // 其余会话的结果是否允许自动提交，返回值同 ResultCache::CanAutoSubmit；读取放弃时按允许处理
+    HRESULT CheckDecision(ULONGLONG ullKeyHash, DWORD dwGeneration, ULONGLONG ullNow);
+
+    // 本进程的读写统计
+    void GetStats(SHARED_CACHE_STATS* pStats);
+
+    // 诊断工具使用：区段头部（只读）
+    const SHARED_CACHE_HEADER* GetHeader() const { return _pHeader; }
+
+private:
+    bool _IsReady() const;
+    bool _TryLockWriter(LONG64* pllToken);
+    void _UnlockWriter(LONG64 llToken);
+    static LONG _BeginWrite(volatile LONG* plSequence);
+    static void _EndWrite(volatile LONG* plSequence, LONG lSequence);
+
+    HANDLE _hSection;
+    SHARED_CACHE_HEADER* _pHeader;
+    BYTE* _pbConfig;
+    volatile LONG64 _cConfigHits;
+    volatile LONG64 _cConfigMisses;
+    volatile LONG64 _cReadRetries;
+    volatile LONG64 _cReadAbandoned;
+    volatile LONG64 _cWritesSkipped;
+};
+
+// 读取 SharedCacheEnabled 配置并打开区段，只在首次调用时生效
+void SharedCacheInitialize();
+
+// DLL 卸载时关闭区段
+void SharedCacheCleanup();
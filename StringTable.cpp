@@ -0,0 +1,190 @@
+#include "pch.h"
+#include "StringTable.h"
+#include "CredentialProvider.h"
+
+// 已加载的语言；回退得到的语言也记录一条，指向实际加载的表
+#define STRING_TABLE_MAX_ENTRIES 16
+
+struct STRING_TABLE_ENTRY
+{
+    LANGID langid;
+    STRING_TABLE* pTable;
+};
+
+static const LANGID c_langidDefault = MAKELANGID(LANG_CHINESE, SUBLANG_CHINESE_SIMPLIFIED);
+
+static SRWLOCK s_lock = SRWLOCK_INIT;
+static STRING_TABLE_ENTRY s_rgEntries[STRING_TABLE_MAX_ENTRIES];
+static DWORD s_cEntries = 0;
+
+// 从资源解析一种语言的字符串块
+// 块内依次为 16 条 [WORD 长度][不带 NUL 的字符]，先计算总长度再复制，整张表只分配一次
+static HRESULT LoadStringTable(LANGID langid, STRING_TABLE** ppTable)
+{
+    *ppTable = nullptr;
+
+    HRSRC hrsrc = FindResourceExW(g_hinst, RT_STRING, MAKEINTRESOURCEW(IDS_STRING_BASE / 16 + 1), langid);
+    if (!hrsrc)
+    {
+        return HRESULT_FROM_WIN32(ERROR_RESOURCE_LANG_NOT_FOUND);
+    }
+    HGLOBAL hResource = LoadResource(g_hinst, hrsrc);
+    const WORD* pwBlock = hResource ? (const WORD*)LockResource(hResource) : nullptr;
+    if (!pwBlock)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    const WORD* pwEnd = pwBlock + SizeofResource(g_hinst, hrsrc) / sizeof(WORD);
+
+    size_t cchTotal = 0;
+    const WORD* pw = pwBlock;
+    for (int i = 0; i < STR_NUM_STRINGS; i++)
+    {
+        if ((pw >= pwEnd) || (*pw > pwEnd - pw - 1))
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        cchTotal += *pw + 1;
+        pw += 1 + *pw;
+    }
+
+    STRING_TABLE* pTable = (STRING_TABLE*)CoTaskMemAlloc(sizeof(STRING_TABLE) + cchTotal * sizeof(WCHAR));
+    if (!pTable)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pTable->langid = langid;
+    PWSTR pch = (PWSTR)(pTable + 1);
+    pw = pwBlock;
+    for (int i = 0; i < STR_NUM_STRINGS; i++)
+    {
+        WORD cch = *pw;
+        CopyMemory(pch, pw + 1, cch * sizeof(WCHAR));
+        pch[cch] = L'\0';
+        pTable->rgpsz[i] = pch;
+        pTable->rgcch[i] = cch;
+        pch += cch + 1;
+        pw += 1 + cch;
+    }
+
+    *ppTable = pTable;
+    return S_OK;
+}
+
+// 调用方持有锁
+static STRING_TABLE* FindStringTable(LANGID langid)
+{
+    for (DWORD i = 0; i < s_cEntries; i++)
+    {
+        if (s_rgEntries[i].langid == langid)
+        {
+            return s_rgEntries[i].pTable;
+        }
+    }
+    return nullptr;
+}
+
+// 调用方持有排他锁；表已满时不记录，调用方仍可使用已加载的表（仅回退项会丢失）
+static void AddStringTableEntry(LANGID langid, STRING_TABLE* pTable)
+{
+    if (s_cEntries < STRING_TABLE_MAX_ENTRIES)
+    {
+        s_rgEntries[s_cEntries].langid = langid;
+        s_rgEntries[s_cEntries].pTable = pTable;
+        s_cEntries++;
+    }
+}
+
+HRESULT StringTableSelect(LANGID langid, const STRING_TABLE** ppTable)
+{
+    *ppTable = nullptr;
+
+    // 常见情况：该语言已加载
+    AcquireSRWLockShared(&s_lock);
+    STRING_TABLE* pTable = FindStringTable(langid);
+    ReleaseSRWLockShared(&s_lock);
+    if (pTable)
+    {
+        *ppTable = pTable;
+        return S_OK;
+    }
+
+    const LANGID rglangid[] =
+    {
+        langid,
+        MAKELANGID(PRIMARYLANGID(langid), SUBLANG_DEFAULT),
+        c_langidDefault,
+    };
+
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_RESOURCE_LANG_NOT_FOUND);
+    AcquireSRWLockExclusive(&s_lock);
+    for (size_t i = 0; (i < ARRAYSIZE(rglangid)) && !pTable; i++)
+    {
+        pTable = FindStringTable(rglangid[i]);
+        if (!pTable && (s_cEntries < STRING_TABLE_MAX_ENTRIES))
+        {
+            hr = LoadStringTable(rglangid[i], &pTable);
+            if (SUCCEEDED(hr))
+            {
+                AddStringTableEntry(rglangid[i], pTable);
+            }
+        }
+    }
+    if (pTable)
+    {
+        // 记住回退结果，下次同一语言直接命中
+        if ((pTable->langid != langid) && !FindStringTable(langid))
+        {
+            AddStringTableEntry(langid, pTable);
+        }
+        *ppTable = pTable;
+        hr = S_OK;
+    }
+    ReleaseSRWLockExclusive(&s_lock);
+    return hr;
+}
+
+HRESULT StringTableCoAllocCopy(const STRING_TABLE* pTable, STRINGID id, PWSTR* ppsz)
+{
+    *ppsz = nullptr;
+    if ((id < 0) || (id >= STR_NUM_STRINGS))
+    {
+        return E_INVALIDARG;
+    }
+    if (!pTable)
+    {
+        HRESULT hr = StringTableSelect(c_langidDefault, &pTable);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+    }
+
+    size_t cb = (pTable->rgcch[id] + 1) * sizeof(WCHAR);
+    PWSTR psz = (PWSTR)CoTaskMemAlloc(cb);
+    if (!psz)
+    {
+        return E_OUTOFMEMORY;
+    }
+    CopyMemory(psz, pTable->rgpsz[id], cb);
+    *ppsz = psz;
+    return S_OK;
+}
+
+void StringTableCleanup()
+{
+    AcquireSRWLockExclusive(&s_lock);
+    // 回退项与实际加载项共享同一张表，只在实际加载项上释放。
+    // 回退项总是在它引用的表之后加入，倒序遍历才不会读取已释放的表
+    for (DWORD i = s_cEntries; i-- > 0; )
+    {
+        if (s_rgEntries[i].pTable->langid == s_rgEntries[i].langid)
+        {
+            CoTaskMemFree(s_rgEntries[i].pTable);
+        }
+        s_rgEntries[i].pTable = nullptr;
+    }
+    s_cEntries = 0;
+    ReleaseSRWLockExclusive(&s_lock);
+}
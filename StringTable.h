@@ -0,0 +1,40 @@
+#pragma once
+
+#include "pch.h"
+#include "resource.h"
+
+// 本地化字符串表
+//
+// 字符串保存在 winunlock.rc 的 STRINGTABLE 中，每种语言一个字符串块。
+// 每种语言在第一次被选中时从资源解析一次，所有字符串连同结尾 NUL 依次存放在同一块内存中，
+// 之后只读共享直到 DLL 卸载，GetStringValue 等调用只需最后一次 CoTaskMem 复制。
+
+// 字符串编号，对应资源 ID IDS_STRING_BASE + 编号
+enum STRINGID
+{
+    STR_NONE = -1,
+    STR_TILE_TITLE = IDS_TILE_TITLE - IDS_STRING_BASE,
+    STR_TILE_DESCRIPTION = IDS_TILE_DESCRIPTION - IDS_STRING_BASE,
+    STR_SERIALIZATION_FAILED = IDS_SERIALIZATION_FAILED - IDS_STRING_BASE,
+    STR_WAITING_FOR_SIGNAL = IDS_WAITING_FOR_SIGNAL - IDS_STRING_BASE,
+    STR_CREDENTIALS_LOADING = IDS_CREDENTIALS_LOADING - IDS_STRING_BASE,
+    STR_NUM_STRINGS
+};
+
+static_assert((IDS_STRING_BASE % 16 == 0) && (STR_NUM_STRINGS <= 16), "strings must fit in one resource string block");
+
+struct STRING_TABLE
+{
+    LANGID langid;
+    PCWSTR rgpsz[STR_NUM_STRINGS];
+    WORD rgcch[STR_NUM_STRINGS];
+};
+
+// 按界面语言选择字符串表；资源中没有该语言时依次回退到同一主语言的默认子语言和简体中文
+HRESULT StringTableSelect(LANGID langid, const STRING_TABLE** ppTable);
+
+// 复制字符串，调用方用 CoTaskMemFree 释放；pTable 为 nullptr 时使用简体中文
+HRESULT StringTableCoAllocCopy(const STRING_TABLE* pTable, STRINGID id, PWSTR* ppsz);
+
+// 释放所有已加载的表，仅在 DLL 卸载时调用
+void StringTableCleanup();
@@ -0,0 +1,269 @@
+#include "pch.h"
+#include "TileImage.h"
+#include "TileScaler.h"
+#include "CredentialProvider.h"
+#include <wincodec.h>
+
+#pragma comment(lib, "windowscodecs.lib")
+
+// 缓存的 DPI 档位：100%、125%、150%、175%、200%、250%、300%
+static const UINT c_rgDpiScales[] = { 96, 120, 144, 168, 192, 240, 288 };
+
+// 源图像边长上限，超过时不解码，避免在锁屏路径上处理超大文件
+#define TILE_IMAGE_MAX_SOURCE 4096
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+static const WCHAR c_szDefaultImage[] = L"%ProgramData%\\WinUnlock\\tile.png";
+
+struct TILE_SCALED_IMAGE
+{
+    UINT cSize;
+    DWORD* pPixels;     // cSize x cSize，32 位预乘 BGRA，自上而下
+};
+
+// 解码和缩放结果在 DLL 卸载前只写一次，之后只读
+static SRWLOCK s_lock = SRWLOCK_INIT;
+static bool s_fDecoded = false;     // 已尝试解码；失败也不再重试
+static DWORD* s_pSource = nullptr;
+static UINT s_cxSource = 0;
+static UINT s_cySource = 0;
+static TILE_SCALED_IMAGE s_rgScaled[ARRAYSIZE(c_rgDpiScales)];
+
+static void GetTileImagePath(PWSTR pszPath, DWORD cchPath)
+{
+    WCHAR szRaw[MAX_PATH];
+    StringCchCopyW(szRaw, ARRAYSIZE(szRaw), c_szDefaultImage);
+
+    HKEY hKey = nullptr;
+    if (RegOpenKeyExW(HKEY_LOCAL_MACHINE, c_szConfigKey, 0, KEY_READ, &hKey) == ERROR_SUCCESS)
+    {
+        WCHAR szValue[MAX_PATH] = { 0 };
+        DWORD cbValue = sizeof(szValue) - sizeof(WCHAR);
+        DWORD dwType = REG_SZ;
+        if ((RegQueryValueExW(hKey, L"TileImage", nullptr, &dwType, (LPBYTE)szValue, &cbValue) == ERROR_SUCCESS) &&
+            ((dwType == REG_SZ) || (dwType == REG_EXPAND_SZ)) && szValue[0])
+        {
+            StringCchCopyW(szRaw, ARRAYSIZE(szRaw), szValue);
+        }
+        RegCloseKey(hKey);
+    }
+
+    if (!ExpandEnvironmentStringsW(szRaw, pszPath, cchPath))
+    {
+        pszPath[0] = L'\0';
+    }
+}
+
+// 用 WIC 解码第一帧并转换为 32 位预乘 BGRA
+static HRESULT DecodeTileImage(PCWSTR pszPath, DWORD** ppPixels, UINT* pcx, UINT* pcy)
+{
+    *ppPixels = nullptr;
+
+    IWICImagingFactory* pFactory = nullptr;
+    HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&pFactory));
+    if (SUCCEEDED(hr))
+    {
+        IWICBitmapDecoder* pDecoder = nullptr;
+        hr = pFactory->CreateDecoderFromFilename(pszPath, nullptr, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &pDecoder);
+        if (SUCCEEDED(hr))
+        {
+            IWICBitmapFrameDecode* pFrame = nullptr;
+            hr = pDecoder->GetFrame(0, &pFrame);
+            if (SUCCEEDED(hr))
+            {
+                IWICBitmapSource* pConverted = nullptr;
+                hr = WICConvertBitmapSource(GUID_WICPixelFormat32bppPBGRA, pFrame, &pConverted);
+                if (SUCCEEDED(hr))
+                {
+                    UINT cx = 0;
+                    UINT cy = 0;
+                    hr = pConverted->GetSize(&cx, &cy);
+                    if (SUCCEEDED(hr) && (!cx || !cy || (cx > TILE_IMAGE_MAX_SOURCE) || (cy > TILE_IMAGE_MAX_SOURCE)))
+                    {
+                        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                    }
+                    if (SUCCEEDED(hr))
+                    {
+                        UINT cbPixels = cx * cy * sizeof(DWORD);
+                        DWORD* pPixels = (DWORD*)CoTaskMemAlloc(cbPixels);
+                        hr = pPixels ? pConverted->CopyPixels(nullptr, cx * sizeof(DWORD), cbPixels, (BYTE*)pPixels) : E_OUTOFMEMORY;
+                        if (SUCCEEDED(hr))
+                        {
+                            *ppPixels = pPixels;
+                            *pcx = cx;
+                            *pcy = cy;
+                        }
+                        else
+                        {
+                            CoTaskMemFree(pPixels);
+                        }
+                    }
+                    pConverted->Release();
+                }
+                pFrame->Release();
+            }
+            pDecoder->Release();
+        }
+        pFactory->Release();
+    }
+    return hr;
+}
+
+// 当前显示器 DPI 对应的档位：取不小于 DPI 的最小档位
+static UINT GetTileScaleIndex()
+{
+    UINT uDpi = 96;
+    HDC hdc = GetDC(nullptr);
+    if (hdc)
+    {
+        uDpi = (UINT)GetDeviceCaps(hdc, LOGPIXELSY);
+        ReleaseDC(nullptr, hdc);
+    }
+
+    for (UINT i = 0; i < ARRAYSIZE(c_rgDpiScales); i++)
+    {
+        if (uDpi <= c_rgDpiScales[i])
+        {
+            return i;
+        }
+    }
+    return ARRAYSIZE(c_rgDpiScales) - 1;
+}
+
+// 取得某一档位的缩放结果，必要时解码源图像并缩放；未配置图像时返回 S_FALSE
+static HRESULT GetScaledTileImage(UINT uScale, const TILE_SCALED_IMAGE** ppImage)
+{
+    *ppImage = nullptr;
+
+    // 常见情况：已缓存
+    AcquireSRWLockShared(&s_lock);
+    bool fCached = (s_rgScaled[uScale].pPixels != nullptr);
+    bool fNoImage = s_fDecoded && !s_pSource;
+    ReleaseSRWLockShared(&s_lock);
+    if (fCached)
+    {
+        *ppImage = &s_rgScaled[uScale];
+        return S_OK;
+    }
+    if (fNoImage)
+    {
+        return S_FALSE;
+    }
+
+    HRESULT hr = S_OK;
+    AcquireSRWLockExclusive(&s_lock);
+    if (!s_fDecoded)
+    {
+        s_fDecoded = true;
+        WCHAR szPath[MAX_PATH];
+        GetTileImagePath(szPath, ARRAYSIZE(szPath));
+        if (!szPath[0] || FAILED(DecodeTileImage(szPath, &s_pSource, &s_cxSource, &s_cySource)))
+        {
+            s_pSource = nullptr;
+        }
+    }
+
+    if (!s_pSource)
+    {
+        hr = S_FALSE;
+    }
+    else if (!s_rgScaled[uScale].pPixels)
+    {
+        UINT cSize = MulDiv(TILE_IMAGE_BASE_SIZE, c_rgDpiScales[uScale], 96);
+        DWORD* pPixels = (DWORD*)CoTaskMemAlloc((size_t)cSize * cSize * sizeof(DWORD));
+        hr = pPixels ? TileScaleSquare(s_pSource, s_cxSource, s_cySource, s_cxSource, cSize, pPixels) : E_OUTOFMEMORY;
+        if (SUCCEEDED(hr))
+        {
+            s_rgScaled[uScale].cSize = cSize;
+            s_rgScaled[uScale].pPixels = pPixels;
+        }
+        else
+        {
+            CoTaskMemFree(pPixels);
+        }
+    }
+    ReleaseSRWLockExclusive(&s_lock);
+
+    if (hr == S_OK)
+    {
+        *ppImage = &s_rgScaled[uScale];
+    }
+    return hr;
+}
+
+static void CALLBACK TileImageWarmupCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pvContext);
+
+    HRESULT hrInit = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    const TILE_SCALED_IMAGE* pImage = nullptr;
+    GetScaledTileImage(GetTileScaleIndex(), &pImage);
+    if (SUCCEEDED(hrInit))
+    {
+        CoUninitialize();
+    }
+}
+
+void TileImageWarmup()
+{
+    AcquireSRWLockShared(&s_lock);
+    bool fDecoded = s_fDecoded;
+    ReleaseSRWLockShared(&s_lock);
+    if (fDecoded)
+    {
+        return;
+    }
+
+    TP_CALLBACK_ENVIRON env;
+    InitializeThreadpoolEnvironment(&env);
+    SetThreadpoolCallbackLibrary(&env, g_hinst);
+    TrySubmitThreadpoolCallback(TileImageWarmupCallback, nullptr, &env);
+    DestroyThreadpoolEnvironment(&env);
+}
+
+HRESULT TileImageCreateBitmap(HBITMAP* phbmp)
+{
+    *phbmp = nullptr;
+
+    const TILE_SCALED_IMAGE* pImage = nullptr;
+    HRESULT hr = GetScaledTileImage(GetTileScaleIndex(), &pImage);
+    if (hr != S_OK)
+    {
+        return SUCCEEDED(hr) ? hr : S_FALSE;
+    }
+
+    BITMAPINFO bmi;
+    ZeroMemory(&bmi, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = (LONG)pImage->cSize;
+    bmi.bmiHeader.biHeight = -(LONG)pImage->cSize;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    void* pvBits = nullptr;
+    HBITMAP hbmp = CreateDIBSection(nullptr, &bmi, DIB_RGB_COLORS, &pvBits, nullptr, 0);
+    if (!hbmp)
+    {
+        return E_OUTOFMEMORY;
+    }
+    CopyMemory(pvBits, pImage->pPixels, (size_t)pImage->cSize * pImage->cSize * sizeof(DWORD));
+    *phbmp = hbmp;
+    return S_OK;
+}
+
+void TileImageCleanup()
+{
+    AcquireSRWLockExclusive(&s_lock);
+    for (UINT i = 0; i < ARRAYSIZE(s_rgScaled); i++)
+    {
+        CoTaskMemFree(s_rgScaled[i].pPixels);
+        s_rgScaled[i].pPixels = nullptr;
+        s_rgScaled[i].cSize = 0;
+    }
+    CoTaskMemFree(s_pSource);
+    s_pSource = nullptr;
+    s_fDecoded = false;
+    ReleaseSRWLockExclusive(&s_lock);
+}
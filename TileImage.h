@@ -0,0 +1,22 @@
+#pragma once
+
+#include "pch.h"
+
+// 磁贴图像
+//
+// 管理员通过 HKLM\SOFTWARE\WinUnlock\TileImage 指定图像文件（BMP、PNG 等 WIC 支持的格式），
+// 未配置时使用 %ProgramData%\WinUnlock\tile.png。图像在 DLL 生命周期内只解码一次，
+// 按显示器 DPI 缩放后的像素也只计算一次并缓存，之后只读共享；
+// GetBitmapValue 每次只需从缓存创建一个新的 HBITMAP（LogonUI 负责释放）。
+
+// 96 DPI 下的磁贴边长，其余 DPI 按比例放大
+#define TILE_IMAGE_BASE_SIZE 192
+
+// 在线程池中提前解码并缩放当前 DPI 的图像
+void TileImageWarmup();
+
+// 创建当前 DPI 的磁贴位图；未配置图像或解码失败时 *phbmp 为 nullptr 并返回 S_FALSE
+HRESULT TileImageCreateBitmap(HBITMAP* phbmp);
+
+// 释放解码和缩放缓存，仅在 DLL 卸载时调用
+void TileImageCleanup();
@@ -0,0 +1,199 @@
+#include "pch.h"
+#include "TileScaler.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define TILE_SCALER_SSE2
+#include <emmintrin.h>
+#endif
+
+static inline DWORD AverageChannels(DWORD a, DWORD b)
+{
+    // 与 _mm_avg_epu8 相同：逐字节 (a + b + 1) >> 1
+    return (a | b) - (((a ^ b) >> 1) & 0x7f7f7f7f);
+}
+
+// 2x2 平均减半，先垂直后水平，与 SSE2 路径的舍入完全一致。
+// 允许 pDst 与 pSrc 指向同一缓冲区：写入位置总不超过本次及之后的读取位置
+static void HalveSquare(const DWORD* pSrc, UINT cSrc, UINT cxStride, DWORD* pDst)
+{
+    UINT cDst = cSrc / 2;
+    for (UINT y = 0; y < cDst; y++)
+    {
+        const DWORD* pRow0 = pSrc + (size_t)(2 * y) * cxStride;
+        const DWORD* pRow1 = pRow0 + cxStride;
+        DWORD* pOut = pDst + (size_t)y * cDst;
+        UINT x = 0;
+#ifdef TILE_SCALER_SSE2
+        for (; x + 4 <= cDst; x += 4)
+        {
+            __m128i v0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(pRow0 + 2 * x)), _mm_loadu_si128((const __m128i*)(pRow1 + 2 * x)));
+            __m128i v1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(pRow0 + 2 * x + 4)), _mm_loadu_si128((const __m128i*)(pRow1 + 2 * x + 4)));
+            __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(v0), _mm_castsi128_ps(v1), _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_si128((__m128i*)(pOut + x), _mm_avg_epu8(even, odd));
+        }
+#endif
+        for (; x < cDst; x++)
+        {
+            DWORD dwLeft = AverageChannels(pRow0[2 * x], pRow1[2 * x]);
+            DWORD dwRight = AverageChannels(pRow0[2 * x + 1], pRow1[2 * x + 1]);
+            pOut[x] = AverageChannels(dwLeft, dwRight);
+        }
+    }
+}
+
+// 双线性插值采样位置：目标像素中心映射回源坐标，rgIndex 为左（上）侧源像素，
+// rgWeight 为右（下）侧源像素的权重（0..256）
+static void ComputeTaps(UINT cSrc, UINT cDst, UINT* rgIndex, UINT* rgWeight)
+{
+    for (UINT i = 0; i < cDst; i++)
+    {
+        LONGLONG llPos = (((LONGLONG)(2 * i + 1) * cSrc) << 16) / (2 * (LONGLONG)cDst) - 0x8000;
+        if (llPos < 0)
+        {
+            llPos = 0;
+        }
+
+        UINT uIndex = (UINT)(llPos >> 16);
+        UINT uWeight = (UINT)((llPos >> 8) & 0xff);
+        if (uIndex >= cSrc - 1)
+        {
+            uIndex = cSrc - 2;
+            uWeight = 256;
+        }
+        rgIndex[i] = uIndex;
+        rgWeight[i] = uWeight;
+    }
+}
+
+static inline DWORD BlendPixel(DWORD dw0, DWORD dw1, UINT uWeight)
+{
+    DWORD dwResult = 0;
+    for (UINT uShift = 0; uShift < 32; uShift += 8)
+    {
+        UINT c = (((dw0 >> uShift) & 0xff) * (256 - uWeight) + ((dw1 >> uShift) & 0xff) * uWeight) >> 8;
+        dwResult |= (DWORD)c << uShift;
+    }
+    return dwResult;
+}
+
+// 垂直插值：两行整行按同一权重混合
+static void BlendRows(const DWORD* pRow0, const DWORD* pRow1, UINT cx, UINT uWeight, DWORD* pOut)
+{
+    UINT x = 0;
+#ifdef TILE_SCALER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w0 = _mm_set1_epi16((short)(256 - uWeight));
+    const __m128i w1 = _mm_set1_epi16((short)uWeight);
+    for (; x + 4 <= cx; x += 4)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i*)(pRow0 + x));
+        __m128i b = _mm_loadu_si128((const __m128i*)(pRow1 + x));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), w1));
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(a, zero), w0), _mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), w1));
+        _mm_storeu_si128((__m128i*)(pOut + x), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+#endif
+    for (; x < cx; x++)
+    {
+        pOut[x] = BlendPixel(pRow0[x], pRow1[x], uWeight);
+    }
+}
+
+// 水平插值：每个目标像素取相邻两个源像素
+static void ScaleRow(const DWORD* pRow, const UINT* rgIndex, const UINT* rgWeight, UINT cDst, DWORD* pOut)
+{
+#ifdef TILE_SCALER_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (UINT x = 0; x < cDst; x++)
+    {
+        short w1 = (short)rgWeight[x];
+        short w0 = (short)(256 - rgWeight[x]);
+        __m128i p = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pRow + rgIndex[x])), zero);
+        __m128i m = _mm_mullo_epi16(p, _mm_set_epi16(w1, w1, w1, w1, w0, w0, w0, w0));
+        m = _mm_srli_epi16(_mm_add_epi16(m, _mm_srli_si128(m, 8)), 8);
+        pOut[x] = (DWORD)_mm_cvtsi128_si32(_mm_packus_epi16(m, m));
+    }
+#else
+    for (UINT x = 0; x < cDst; x++)
+    {
+        pOut[x] = BlendPixel(pRow[rgIndex[x]], pRow[rgIndex[x] + 1], rgWeight[x]);
+    }
+#endif
+}
+
+HRESULT TileScaleSquare(const DWORD* pSrc, UINT cxSrc, UINT cySrc, UINT cxStride, UINT cDst, DWORD* pDst)
+{
+    if (!pSrc || !pDst || !cxSrc || !cySrc || !cDst || (cxStride < cxSrc))
+    {
+        return E_INVALIDARG;
+    }
+
+    // 居中裁剪为正方形
+    UINT cSide = min(cxSrc, cySrc);
+    const DWORD* pSquare = pSrc + (size_t)((cySrc - cSide) / 2) * cxStride + (cxSrc - cSide) / 2;
+    UINT cStride = cxStride;
+
+    // 逐级减半直到边长不足目标的两倍，之后的双线性插值不会跳过源像素；
+    // 第一级写入工作缓冲区，之后各级在工作缓冲区内原地进行
+    DWORD* pWork = nullptr;
+    if (cSide / 2 >= cDst)
+    {
+        UINT cHalf = cSide / 2;
+        pWork = (DWORD*)CoTaskMemAlloc((size_t)cHalf * cHalf * sizeof(DWORD));
+        if (!pWork)
+        {
+            return E_OUTOFMEMORY;
+        }
+        do
+        {
+            HalveSquare(pSquare, cSide, cStride, pWork);
+            pSquare = pWork;
+            cSide /= 2;
+            cStride = cSide;
+        } while (cSide / 2 >= cDst);
+    }
+
+    HRESULT hr = S_OK;
+    if (cSide == cDst)
+    {
+        for (UINT y = 0; y < cDst; y++)
+        {
+            CopyMemory(pDst + (size_t)y * cDst, pSquare + (size_t)y * cStride, cDst * sizeof(DWORD));
+        }
+    }
+    else if (cSide == 1)
+    {
+        for (size_t i = 0; i < (size_t)cDst * cDst; i++)
+        {
+            pDst[i] = pSquare[0];
+        }
+    }
+    else
+    {
+        // 正方形的水平和垂直采样位置相同，共用一组
+        UINT* rgTaps = (UINT*)CoTaskMemAlloc((size_t)cDst * 2 * sizeof(UINT));
+        DWORD* pRow = (DWORD*)CoTaskMemAlloc((size_t)cSide * sizeof(DWORD));
+        if (rgTaps && pRow)
+        {
+            UINT* rgIndex = rgTaps;
+            UINT* rgWeight = rgTaps + cDst;
+            ComputeTaps(cSide, cDst, rgIndex, rgWeight);
+            for (UINT y = 0; y < cDst; y++)
+            {
+                const DWORD* pRow0 = pSquare + (size_t)rgIndex[y] * cStride;
+                BlendRows(pRow0, pRow0 + cStride, cSide, rgWeight[y], pRow);
+                ScaleRow(pRow, rgIndex, rgWeight, cDst, pDst + (size_t)y * cDst);
+            }
+        }
+        else
+        {
+            hr = E_OUTOFMEMORY;
+        }
+        CoTaskMemFree(rgTaps);
+        CoTaskMemFree(pRow);
+    }
+
+    CoTaskMemFree(pWork);
+    return hr;
+}
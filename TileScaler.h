@@ -0,0 +1,12 @@
+#pragma once
+
+#include "pch.h"
+
+// 磁贴图像缩放
+//
+// 像素格式为 32 位 BGRA（预乘 Alpha），行与行之间按 cxStride 个像素排列。
+// 源图像先居中裁剪为正方形，缩小超过一半时先逐级 2x2 平均减半，最后用双线性插值缩放到目标边长。
+// x86/x64 使用 SSE2，其余平台使用等价的标量实现。
+
+// 缩放到 cDst x cDst，pDst 按 cDst 个像素一行紧密排列
+HRESULT TileScaleSquare(const DWORD* pSrc, UINT cxSrc, UINT cySrc, UINT cxStride, UINT cDst, DWORD* pDst);
@@ -0,0 +1,477 @@
+#include "pch.h"
+#include "UnlockPolicy.h"
+
+#define MINUTES_PER_DAY     (24 * 60)
+#define ALL_DAYS            0x7f
+#define ALL_SCENARIOS       0xffffffff
+
+enum POLICY_LINE_KIND
+{
+    PLK_EMPTY = 0,
+    PLK_RULE,
+    PLK_DEFAULT_ALLOW,
+    PLK_DEFAULT_DENY,
+};
+
+static const PCWSTR c_rgszDays[] = { L"sun", L"mon", L"tue", L"wed", L"thu", L"fri", L"sat" };
+
+static bool IsBlank(WCHAR ch)
+{
+    return (ch == L' ') || (ch == L'\t');
+}
+
+static WCHAR FoldCase(WCHAR ch)
+{
+    return ((ch >= L'A') && (ch <= L'Z')) ? (WCHAR)(ch - L'A' + L'a') : ch;
+}
+
+// 比较长度为 cch 的片段与小写关键字，ASCII 不区分大小写
+static bool TokenEquals(PCWSTR pch, size_t cch, PCWSTR pszKeyword)
+{
+    size_t i = 0;
+    for (; (i < cch) && pszKeyword[i]; i++)
+    {
+        if (FoldCase(pch[i]) != pszKeyword[i])
+        {
+            return false;
+        }
+    }
+    return (i == cch) && !pszKeyword[i];
+}
+
+// 取下一个以空白分隔的记号，行尾或遇到 # 时返回 false
+static bool NextToken(PCWSTR* ppsz, PCWSTR* ppchToken, size_t* pcchToken)
+{
+    PCWSTR psz = *ppsz;
+    while (IsBlank(*psz))
+    {
+        psz++;
+    }
+    if (!*psz || (*psz == L'#'))
+    {
+        *ppsz = psz;
+        return false;
+    }
+
+    PCWSTR pchToken = psz;
+    while (*psz && !IsBlank(*psz))
+    {
+        psz++;
+    }
+    *ppchToken = pchToken;
+    *pcchToken = psz - pchToken;
+    *ppsz = psz;
+    return true;
+}
+
+static ULONGLONG HashNameN(PCWSTR pch, size_t cch)
+{
+    ULONGLONG ullHash = 14695981039346656037ULL;
+    for (size_t i = 0; i < cch; i++)
+    {
+        ullHash ^= FoldCase(pch[i]);
+        ullHash *= 1099511628211ULL;
+    }
+    return ullHash ? ullHash : 1;
+}
+
+// 解析不超过 dwMax 的十进制数，整个片段都必须是数字
+static bool ParseNumber(PCWSTR pch, size_t cch, DWORD dwMax, DWORD* pdwValue)
+{
+    if (!cch || (cch > 5))
+    {
+        return false;
+    }
+    DWORD dwValue = 0;
+    for (size_t i = 0; i < cch; i++)
+    {
+        if ((pch[i] < L'0') || (pch[i] > L'9'))
+        {
+            return false;
+        }
+        dwValue = dwValue * 10 + (pch[i] - L'0');
+    }
+    if (dwValue > dwMax)
+    {
+        return false;
+    }
+    *pdwValue = dwValue;
+    return true;
+}
+
+static bool ParseDay(PCWSTR pch, size_t cch, DWORD* pdwDay)
+{
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgszDays); i++)
+    {
+        if (TokenEquals(pch, cch, c_rgszDays[i]))
+        {
+            *pdwDay = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// mon,wed,fri 或 mon-fri，范围可以跨越周末（fri-mon）
+static bool ParseDays(PCWSTR pch, size_t cch, DWORD* pdwMask)
+{
+    DWORD dwMask = 0;
+    size_t i = 0;
+    while (i < cch)
+    {
+        size_t iEnd = i;
+        while ((iEnd < cch) && (pch[iEnd] != L','))
+        {
+            iEnd++;
+        }
+
+        size_t iDash = i;
+        while ((iDash < iEnd) && (pch[iDash] != L'-'))
+        {
+            iDash++;
+        }
+
+        DWORD dwFirst = 0;
+        DWORD dwLast = 0;
+        if (!ParseDay(pch + i, iDash - i, &dwFirst))
+        {
+            return false;
+        }
+        dwLast = dwFirst;
+        if ((iDash < iEnd) && !ParseDay(pch + iDash + 1, iEnd - iDash - 1, &dwLast))
+        {
+            return false;
+        }
+        for (DWORD dwDay = dwFirst; ; dwDay = (dwDay + 1) % 7)
+        {
+            dwMask |= 1u << dwDay;
+            if (dwDay == dwLast)
+            {
+                break;
+            }
+        }
+
+        i = iEnd + 1;
+    }
+    *pdwMask = dwMask;
+    return dwMask != 0;
+}
+
+// HH:MM，fAllowEndOfDay 时允许 24:00
+static bool ParseClock(PCWSTR pch, size_t cch, bool fAllowEndOfDay, WORD* pwMinute)
+{
+    size_t iColon = 0;
+    while ((iColon < cch) && (pch[iColon] != L':'))
+    {
+        iColon++;
+    }
+    DWORD dwHour = 0;
+    DWORD dwMinute = 0;
+    if ((iColon == cch) || (cch - iColon != 3) ||
+        !ParseNumber(pch, iColon, 24, &dwHour) || !ParseNumber(pch + iColon + 1, 2, 59, &dwMinute))
+    {
+        return false;
+    }
+    DWORD dwValue = dwHour * 60 + dwMinute;
+    if (dwValue > (fAllowEndOfDay ? (DWORD)MINUTES_PER_DAY : (DWORD)MINUTES_PER_DAY - 1))
+    {
+        return false;
+    }
+    *pwMinute = (WORD)dwValue;
+    return true;
+}
+
+static bool ParseTimeRange(PCWSTR pch, size_t cch, WORD* pwStart, WORD* pwEnd)
+{
+    size_t iDash = 0;
+    while ((iDash < cch) && (pch[iDash] != L'-'))
+    {
+        iDash++;
+    }
+    return (iDash < cch) &&
+        ParseClock(pch, iDash, false, pwStart) &&
+        ParseClock(pch + iDash + 1, cch - iDash - 1, true, pwEnd) &&
+        (*pwStart != *pwEnd);
+}
+
+static HRESULT CompileLine(PCWSTR pszLine, UNLOCK_POLICY_RULE* pRule, POLICY_LINE_KIND* pKind)
+{
+    const HRESULT hrInvalid = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    *pKind = PLK_EMPTY;
+
+    PCWSTR psz = pszLine;
+    PCWSTR pch = nullptr;
+    size_t cch = 0;
+    if (!NextToken(&psz, &pch, &cch))
+    {
+        return S_OK;
+    }
+
+    if (TokenEquals(pch, cch, L"default"))
+    {
+        if (!NextToken(&psz, &pch, &cch))
+        {
+            return hrInvalid;
+        }
+        if (TokenEquals(pch, cch, L"allow"))
+        {
+            *pKind = PLK_DEFAULT_ALLOW;
+        }
+        else if (TokenEquals(pch, cch, L"deny"))
+        {
+            *pKind = PLK_DEFAULT_DENY;
+        }
+        else
+        {
+            return hrInvalid;
+        }
+        return NextToken(&psz, &pch, &cch) ? hrInvalid : S_OK;
+    }
+
+    UNLOCK_POLICY_RULE rule = { 0 };
+    rule.dwScenarioMask = ALL_SCENARIOS;
+    rule.dwDayMask = ALL_DAYS;
+    rule.wStartMinute = 0;
+    rule.wEndMinute = MINUTES_PER_DAY;
+    if (TokenEquals(pch, cch, L"allow"))
+    {
+        rule.wFlags = UPF_ALLOW;
+    }
+    else if (!TokenEquals(pch, cch, L"deny"))
+    {
+        return hrInvalid;
+    }
+
+    while (NextToken(&psz, &pch, &cch))
+    {
+        if (TokenEquals(pch, cch, L"signal"))
+        {
+            rule.wFlags |= UPF_REQUIRE_SIGNAL;
+            continue;
+        }
+
+        // 其余关键字都带一个参数
+        PCWSTR pchKeyword = pch;
+        size_t cchKeyword = cch;
+        if (!NextToken(&psz, &pch, &cch))
+        {
+            return hrInvalid;
+        }
+
+        if (TokenEquals(pchKeyword, cchKeyword, L"account"))
+        {
+            rule.ullAccountHash = TokenEquals(pch, cch, L"*") ? 0 : HashNameN(pch, cch);
+        }
+        else if (TokenEquals(pchKeyword, cchKeyword, L"scenario"))
+        {
+            if (TokenEquals(pch, cch, L"logon"))
+            {
+                rule.dwScenarioMask = 1u << CPUS_LOGON;
+            }
+            else if (TokenEquals(pch, cch, L"unlock"))
+            {
+                rule.dwScenarioMask = 1u << CPUS_UNLOCK_WORKSTATION;
+            }
+            else if (TokenEquals(pch, cch, L"any"))
+            {
+                rule.dwScenarioMask = ALL_SCENARIOS;
+            }
+            else
+            {
+                return hrInvalid;
+            }
+        }
+        else if (TokenEquals(pchKeyword, cchKeyword, L"days"))
+        {
+            if (!ParseDays(pch, cch, &rule.dwDayMask))
+            {
+                return hrInvalid;
+            }
+        }
+        else if (TokenEquals(pchKeyword, cchKeyword, L"time"))
+        {
+            if (!ParseTimeRange(pch, cch, &rule.wStartMinute, &rule.wEndMinute))
+            {
+                return hrInvalid;
+            }
+        }
+        else if (TokenEquals(pchKeyword, cchKeyword, L"maxperhour"))
+        {
+            DWORD dwMax = 0;
+            if (!ParseNumber(pch, cch, UNLOCK_POLICY_MAX_PER_HOUR, &dwMax) || !dwMax)
+            {
+                return hrInvalid;
+            }
+            rule.wMaxPerHour = (WORD)dwMax;
+        }
+        else
+        {
+            return hrInvalid;
+        }
+    }
+
+    *pRule = rule;
+    *pKind = PLK_RULE;
+    return S_OK;
+}
+
+UnlockPolicy::UnlockPolicy() :
+    _rgRules(nullptr),
+    _cRules(0),
+    _fDefaultAllow(false),
+    _fConfigured(false)
+{
+}
+
+UnlockPolicy::~UnlockPolicy()
+{
+    Clear();
+}
+
+void UnlockPolicy::Clear()
+{
+    CoTaskMemFree(_rgRules);
+    _rgRules = nullptr;
+    _cRules = 0;
+    _fDefaultAllow = false;
+    _fConfigured = false;
+}
+
+void UnlockPolicy::Swap(UnlockPolicy& other)
+{
+    UNLOCK_POLICY_RULE* rgRules = _rgRules;
+    DWORD cRules = _cRules;
+    bool fDefaultAllow = _fDefaultAllow;
+    bool fConfigured = _fConfigured;
+
+    _rgRules = other._rgRules;
+    _cRules = other._cRules;
+    _fDefaultAllow = other._fDefaultAllow;
+    _fConfigured = other._fConfigured;
+
+    other._rgRules = rgRules;
+    other._cRules = cRules;
+    other._fDefaultAllow = fDefaultAllow;
+    other._fConfigured = fConfigured;
+}
+
+ULONGLONG UnlockPolicy::HashName(PCWSTR pszName)
+{
+    return HashNameN(pszName, pszName ? wcslen(pszName) : 0);
+}
+
+HRESULT UnlockPolicy::Compile(PCWSTR pszzSource, DWORD* pdwErrorLine)
+{
+    if (pdwErrorLine)
+    {
+        *pdwErrorLine = 0;
+    }
+    Clear();
+    if (!pszzSource || !*pszzSource)
+    {
+        return S_OK;
+    }
+
+    // 从这里开始即视为已配置：编译失败时没有规则且默认拒绝
+    _fConfigured = true;
+
+    DWORD cLines = 0;
+    for (PCWSTR psz = pszzSource; *psz; psz += wcslen(psz) + 1)
+    {
+        cLines++;
+    }
+
+    UNLOCK_POLICY_RULE* rgRules = (UNLOCK_POLICY_RULE*)CoTaskMemAlloc(min(cLines, (DWORD)UNLOCK_POLICY_MAX_RULES) * sizeof(UNLOCK_POLICY_RULE));
+    if (!rgRules)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    HRESULT hr = S_OK;
+    DWORD cRules = 0;
+    bool fDefaultAllow = false;
+    DWORD iLine = 0;
+    for (PCWSTR psz = pszzSource; *psz && SUCCEEDED(hr); psz += wcslen(psz) + 1)
+    {
+        iLine++;
+        UNLOCK_POLICY_RULE rule;
+        POLICY_LINE_KIND kind = PLK_EMPTY;
+        hr = CompileLine(psz, &rule, &kind);
+        if (SUCCEEDED(hr))
+        {
+            if (kind == PLK_RULE)
+            {
+                if (cRules < UNLOCK_POLICY_MAX_RULES)
+                {
+                    rgRules[cRules++] = rule;
+                }
+                else
+                {
+                    hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                }
+            }
+            else if (kind != PLK_EMPTY)
+            {
+                fDefaultAllow = (kind == PLK_DEFAULT_ALLOW);
+            }
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        CoTaskMemFree(rgRules);
+        if (pdwErrorLine)
+        {
+            *pdwErrorLine = iLine;
+        }
+        return hr;
+    }
+
+    _rgRules = rgRules;
+    _cRules = cRules;
+    _fDefaultAllow = fDefaultAllow;
+    return S_OK;
+}
+
+UNLOCK_POLICY_DECISION UnlockPolicy::Evaluate(const UNLOCK_POLICY_CONTEXT& context) const
+{
+    if (!_fConfigured)
+    {
+        return UPD_ALLOW;
+    }
+
+    const DWORD dwScenarioBit = 1u << (context.dwScenario & 31);
+    const DWORD dwDayBit = 1u << (context.dwDayOfWeek % 7);
+    const DWORD dwMinute = context.dwMinuteOfDay;
+    for (DWORD i = 0; i < _cRules; i++)
+    {
+        const UNLOCK_POLICY_RULE& rule = _rgRules[i];
+
+        // 各条件按位组合，每条规则只在最后判断一次
+        DWORD fAccount = (rule.ullAccountHash == 0) | (rule.ullAccountHash == context.ullKeyHash) |
+            (rule.ullAccountHash == context.ullUserHash);
+        DWORD fScenario = (rule.dwScenarioMask & dwScenarioBit) != 0;
+        DWORD fDay = (rule.dwDayMask & dwDayBit) != 0;
+        DWORD fAfterStart = dwMinute >= rule.wStartMinute;
+        DWORD fBeforeEnd = dwMinute < rule.wEndMinute;
+        DWORD fWrap = rule.wStartMinute > rule.wEndMinute;
+        DWORD fTime = (fAfterStart & fBeforeEnd) | (fWrap & (fAfterStart | fBeforeEnd));
+        if (fAccount & fScenario & fDay & fTime)
+        {
+            if (!(rule.wFlags & UPF_ALLOW))
+            {
+                return UPD_DENY;
+            }
+            if (rule.wMaxPerHour && (context.cRecentUnlocks >= rule.wMaxPerHour))
+            {
+                return UPD_RATE_LIMITED;
+            }
+            if ((rule.wFlags & UPF_REQUIRE_SIGNAL) && !context.fSignaled)
+            {
+                return UPD_SIGNAL_REQUIRED;
+            }
+            return UPD_ALLOW;
+        }
+    }
+    return _fDefaultAllow ? UPD_ALLOW : UPD_DENY;
+}
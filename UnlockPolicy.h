@@ -0,0 +1,98 @@
+#pragma once
+
+#include <windows.h>
+
+// 自动解锁策略
+//
+// 策略为若干行文本（注册表 HKLM\SOFTWARE\WinUnlock\UnlockPolicy，REG_MULTI_SZ，每个字符串一行），
+// 加载配置时编译为定长规则表，之后每次 SetSelected / GetCredentialCount 只做一次线性匹配：
+//
+//   # 注释
+//   default allow|deny
+//   allow|deny [account 名称] [scenario logon|unlock|any] [days 星期列表] [time HH:MM-HH:MM]
+//              [maxperhour 次数] [signal]
+//
+// - account 匹配账户键（SID）或用户名，不区分大小写；省略时匹配所有账户
+// - days 为逗号分隔的 sun / mon / tue / wed / thu / fri / sat，可用 mon-fri 表示范围
+// - time 为本地时间的左闭右开区间，开始晚于结束时跨越午夜
+// - maxperhour 限制该账户最近一小时内自动解锁的次数，signal 要求已收到外部解锁信号（见 UnlockSignal.h）
+//
+// 按顺序取第一条匹配的规则；没有规则匹配时使用 default，未写 default 时为 deny。
+// 未配置策略时一律允许，与引入策略之前的行为相同。
+// 编译和求值只依赖内存中的字符串，不调用系统 API。
+
+// 规则条数上限
+#define UNLOCK_POLICY_MAX_RULES     1024
+
+// maxperhour 上限，与 ResultCache 为每个账户保留的最近解锁时刻数一致
+#define UNLOCK_POLICY_MAX_PER_HOUR  16
+
+// wFlags
+#define UPF_ALLOW           0x0001
+#define UPF_REQUIRE_SIGNAL  0x0002
+
+// 编译后的规则，所有选择条件都以掩码或区间表示，求值时不做字符串比较
+struct UNLOCK_POLICY_RULE
+{
+    ULONGLONG ullAccountHash;   // 0 表示任意账户
+    DWORD dwScenarioMask;       // 1 << CREDENTIAL_PROVIDER_USAGE_SCENARIO
+    DWORD dwDayMask;            // 1 << wDayOfWeek（0 为星期日）
+    WORD wStartMinute;          // 一天中的分钟数，[wStartMinute, wEndMinute)
+    WORD wEndMinute;
+    WORD wMaxPerHour;           // 0 表示不限
+    WORD wFlags;
+};
+
+// 求值输入，由调用方按当前账户、场景和本地时间填写
+struct UNLOCK_POLICY_CONTEXT
+{
+    ULONGLONG ullKeyHash;       // UnlockPolicy::HashName(账户键)
+    ULONGLONG ullUserHash;      // UnlockPolicy::HashName(用户名)
+    DWORD dwScenario;           // CREDENTIAL_PROVIDER_USAGE_SCENARIO
+    DWORD dwDayOfWeek;          // 0～6，0 为星期日
+    DWORD dwMinuteOfDay;        // 0～1439
+    DWORD cRecentUnlocks;       // 最近一小时内该账户自动解锁的次数
+    bool fSignaled;             // 已收到外部解锁信号
+};
+
+enum UNLOCK_POLICY_DECISION
+{
+    UPD_ALLOW = 0,
+    UPD_DENY,                   // 规则或默认动作为 deny
+    UPD_RATE_LIMITED,           // 匹配的规则允许，但已达到 maxperhour
+    UPD_SIGNAL_REQUIRED,        // 匹配的规则允许，但要求外部解锁信号
+};
+
+class UnlockPolicy
+{
+public:
+    UnlockPolicy();
+    ~UnlockPolicy();
+
+    // 编译以双 NUL 结尾的多行策略（REG_MULTI_SZ 格式），pszzSource 为 nullptr 或空时清除策略。
+    // 语法错误返回 HRESULT_FROM_WIN32(ERROR_INVALID_DATA)，pdwErrorLine（可为 nullptr）返回出错行号（从 1 开始），
+    // 此时策略处于“全部拒绝”状态
+    HRESULT Compile(PCWSTR pszzSource, DWORD* pdwErrorLine = nullptr);
+
+    void Clear();
+
+    // 交换两份已编译的策略，用于在锁外编译后一次性替换
+    void Swap(UnlockPolicy& other);
+
+    bool IsConfigured() const { return _fConfigured; }
+    DWORD GetRuleCount() const { return _cRules; }
+
+    UNLOCK_POLICY_DECISION Evaluate(const UNLOCK_POLICY_CONTEXT& context) const;
+
+    // 账户名哈希（FNV-1a，ASCII 字母不区分大小写），结果不为 0
+    static ULONGLONG HashName(PCWSTR pszName);
+
+private:
+    UnlockPolicy(const UnlockPolicy&);
+    UnlockPolicy& operator=(const UnlockPolicy&);
+
+    UNLOCK_POLICY_RULE* _rgRules;
+    DWORD _cRules;
+    bool _fDefaultAllow;
+    bool _fConfigured;
+};
@@ -0,0 +1,394 @@
+#include "pch.h"
+#include "UnlockSignal.h"
+#include "CredentialProvider.h"
+#include <bcrypt.h>
+#include <sddl.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+// 本机 SYSTEM 和管理员完全控制，已验证用户可读写；是否接受信号由 HMAC 决定
+static const WCHAR c_szPipeSddl[] = L"D:P(A;;GA;;;SY)(A;;GA;;;BA)(A;;GRGW;;;AU)";
+
+UnlockSignal::UnlockSignal() :
+    _cRef(1),
+    _pfnSignal(nullptr),
+    _pvContext(nullptr),
+    _hStop(nullptr),
+    _hIdle(nullptr),
+    _fListening(FALSE),
+    _dwSessionId(0),
+    _llTicketTick(0),
+    _cbKey(0)
+{
+    InitializeSRWLock(&_lock);
+    ZeroMemory(_rgbKey, sizeof(_rgbKey));
+}
+
+UnlockSignal::~UnlockSignal()
+{
+    SecureZeroMemory(_rgbKey, sizeof(_rgbKey));
+    if (_hStop)
+    {
+        CloseHandle(_hStop);
+        _hStop = nullptr;
+    }
+    if (_hIdle)
+    {
+        CloseHandle(_hIdle);
+        _hIdle = nullptr;
+    }
+}
+
+HRESULT UnlockSignal::CreateFromRegistry(UnlockSignal** ppSignal)
+{
+    *ppSignal = nullptr;
+
+    BYTE rgbKey[UNLOCK_SIGNAL_KEY_MAX];
+    DWORD cbKey = sizeof(rgbKey);
+    DWORD dwType = REG_BINARY;
+    LSTATUS ls = RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"SignalKey", RRF_RT_REG_BINARY, &dwType, rgbKey, &cbKey);
+    if (ls == ERROR_FILE_NOT_FOUND)
+    {
+        return S_FALSE;
+    }
+    if (ls != ERROR_SUCCESS)
+    {
+        SecureZeroMemory(rgbKey, sizeof(rgbKey));
+        return HRESULT_FROM_WIN32(ls);
+    }
+    if (cbKey < UNLOCK_SIGNAL_KEY_MIN)
+    {
+        SecureZeroMemory(rgbKey, sizeof(rgbKey));
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    HRESULT hr = S_OK;
+    DWORD dwSessionId = 0;
+    if (!ProcessIdToSessionId(GetCurrentProcessId(), &dwSessionId))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    UnlockSignal* pSignal = nullptr;
+    if (SUCCEEDED(hr))
+    {
+        pSignal = new(std::nothrow) UnlockSignal();
+        hr = pSignal ? S_OK : E_OUTOFMEMORY;
+    }
+    if (SUCCEEDED(hr))
+    {
+        pSignal->_hStop = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        pSignal->_hIdle = CreateEventW(nullptr, TRUE, TRUE, nullptr);
+        if (pSignal->_hStop && pSignal->_hIdle)
+        {
+            CopyMemory(pSignal->_rgbKey, rgbKey, cbKey);
+            pSignal->_cbKey = cbKey;
+            pSignal->_dwSessionId = dwSessionId;
+            *ppSignal = pSignal;
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            pSignal->Release();
+        }
+    }
+    SecureZeroMemory(rgbKey, sizeof(rgbKey));
+    return hr;
+}
+
+ULONG UnlockSignal::AddRef()
+{
+    return InterlockedIncrement(&_cRef);
+}
+
+ULONG UnlockSignal::Release()
+{
+    LONG cRef = InterlockedDecrement(&_cRef);
+    if (!cRef)
+        delete this;
+    return cRef;
+}
+
+HRESULT UnlockSignal::Start(PFN_UNLOCK_SIGNAL pfnSignal, void* pvContext)
+{
+    AcquireSRWLockExclusive(&_lock);
+    if (_fListening)
+    {
+        ReleaseSRWLockExclusive(&_lock);
+        return S_FALSE;
+    }
+    _fListening = TRUE;
+    ResetEvent(_hIdle);
+    _pfnSignal = pfnSignal;
+    _pvContext = pvContext;
+    ReleaseSRWLockExclusive(&_lock);
+    ResetEvent(_hStop);
+
+    // 监听循环持有引用，并通过回调库保证 DLL 不会在循环退出前被卸载
+    AddRef();
+    TP_CALLBACK_ENVIRON env;
+    InitializeThreadpoolEnvironment(&env);
+    SetThreadpoolCallbackLibrary(&env, g_hinst);
+    SetThreadpoolCallbackRunsLong(&env);
+    BOOL fSubmitted = TrySubmitThreadpoolCallback(s_ListenCallback, this, &env);
+    DestroyThreadpoolEnvironment(&env);
+
+    if (!fSubmitted)
+    {
+        HRESULT hr = HRESULT_FROM_WIN32(GetLastError());
+        AcquireSRWLockExclusive(&_lock);
+        _pfnSignal = nullptr;
+        _pvContext = nullptr;
+        _fListening = FALSE;
+        SetEvent(_hIdle);
+        ReleaseSRWLockExclusive(&_lock);
+        Release();
+        return hr;
+    }
+    return S_OK;
+}
+
+void UnlockSignal::Stop()
+{
+    // 先清除回调：正在执行的回调持有共享锁，排他锁返回时它已经结束
+    AcquireSRWLockExclusive(&_lock);
+    _pfnSignal = nullptr;
+    _pvContext = nullptr;
+    ReleaseSRWLockExclusive(&_lock);
+
+    SetEvent(_hStop);
+    InterlockedExchange64(&_llTicketTick, 0);
+
+    // 监听循环在所有等待中都检查停止事件，很快就会关闭管道；
+    // 不等它结束的话，紧接着启动的下一个实例会因 FIRST_PIPE_INSTANCE 创建失败而不再监听
+    WaitForSingleObject(_hIdle, UNLOCK_SIGNAL_STOP_TIMEOUT_MS);
+}
+
+bool UnlockSignal::IsPending()
+{
+    LONGLONG llTick = InterlockedCompareExchange64(&_llTicketTick, 0, 0);
+    return llTick && ((ULONGLONG)GetTickCount64() - (ULONGLONG)llTick < UNLOCK_SIGNAL_TICKET_MS);
+}
+
+bool UnlockSignal::Consume()
+{
+    LONGLONG llTick = InterlockedExchange64(&_llTicketTick, 0);
+    return llTick && ((ULONGLONG)GetTickCount64() - (ULONGLONG)llTick < UNLOCK_SIGNAL_TICKET_MS);
+}
+
+void CALLBACK UnlockSignal::s_ListenCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UnlockSignal* pSignal = static_cast<UnlockSignal*>(pvContext);
+    pSignal->_Listen();
+
+    // 与 Start 在同一把锁下修改，重新启动的 ResetEvent 不会被这里的 SetEvent 覆盖
+    AcquireSRWLockExclusive(&pSignal->_lock);
+    pSignal->_fListening = FALSE;
+    SetEvent(pSignal->_hIdle);
+    ReleaseSRWLockExclusive(&pSignal->_lock);
+    pSignal->Release();
+}
+
+// 单实例管道，逐个连接处理；等待连接和读写都与停止事件一起等待，空闲时不占用 CPU
+void UnlockSignal::_Listen()
+{
+    WCHAR szPipeName[64];
+    StringCchPrintfW(szPipeName, ARRAYSIZE(szPipeName), UNLOCK_SIGNAL_PIPE_FORMAT, _dwSessionId);
+
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), nullptr, FALSE };
+    if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(c_szPipeSddl, SDDL_REVISION_1, &sa.lpSecurityDescriptor, nullptr))
+    {
+        return;
+    }
+
+    // FILE_FLAG_FIRST_PIPE_INSTANCE：管道名已被其他进程占用时不监听。
+    // 上一个实例（例如刚释放的提供程序）可能还没关闭管道，此时按退避间隔重试，直到停止或超过上限
+    HANDLE hPipe = INVALID_HANDLE_VALUE;
+    for (DWORD dwRetryMs = UNLOCK_SIGNAL_RETRY_MS; ; dwRetryMs *= 2)
+    {
+        hPipe = CreateNamedPipeW(szPipeName,
+            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+            PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+            1, sizeof(UNLOCK_SIGNAL_MESSAGE) * 2, sizeof(UNLOCK_SIGNAL_MESSAGE) * 2, 0, &sa);
+        if ((hPipe != INVALID_HANDLE_VALUE) || (GetLastError() != ERROR_ACCESS_DENIED) ||
+            (dwRetryMs > UNLOCK_SIGNAL_RETRY_MAX_MS) || (WaitForSingleObject(_hStop, dwRetryMs) != WAIT_TIMEOUT))
+        {
+            break;
+        }
+    }
+    LocalFree(sa.lpSecurityDescriptor);
+    if (hPipe == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    OVERLAPPED ov = { 0 };
+    ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    while (ov.hEvent)
+    {
+        ResetEvent(ov.hEvent);
+        BOOL fConnected = ConnectNamedPipe(hPipe, &ov);
+        DWORD dwError = fConnected ? ERROR_SUCCESS : GetLastError();
+        HRESULT hr = S_OK;
+        if (dwError == ERROR_IO_PENDING)
+        {
+            DWORD cb = 0;
+            hr = _WaitForIo(hPipe, &ov, FALSE, INFINITE, &cb);
+        }
+        else if ((dwError != ERROR_SUCCESS) && (dwError != ERROR_PIPE_CONNECTED))
+        {
+            hr = HRESULT_FROM_WIN32(dwError);
+        }
+
+        if (WaitForSingleObject(_hStop, 0) == WAIT_OBJECT_0)
+        {
+            break;
+        }
+        if (SUCCEEDED(hr))
+        {
+            _ServeClient(hPipe, &ov);
+        }
+        DisconnectNamedPipe(hPipe);
+    }
+
+    if (ov.hEvent)
+    {
+        CloseHandle(ov.hEvent);
+    }
+    CloseHandle(hPipe);
+}
+
+// 等待一次重叠 I/O 完成；停止或超时时取消 I/O 并等它结束，OVERLAPPED 才能复用
+HRESULT UnlockSignal::_WaitForIo(HANDLE hPipe, OVERLAPPED* pov, BOOL fCompleted, DWORD dwTimeoutMs, DWORD* pcbTransferred)
+{
+    *pcbTransferred = 0;
+    if (!fCompleted)
+    {
+        DWORD dwError = GetLastError();
+        if (dwError != ERROR_IO_PENDING)
+        {
+            return HRESULT_FROM_WIN32(dwError);
+        }
+
+        HANDLE rghWait[] = { _hStop, pov->hEvent };
+        DWORD dwWait = WaitForMultipleObjects(ARRAYSIZE(rghWait), rghWait, FALSE, dwTimeoutMs);
+        if (dwWait != WAIT_OBJECT_0 + 1)
+        {
+            CancelIoEx(hPipe, pov);
+            GetOverlappedResult(hPipe, pov, pcbTransferred, TRUE);
+            *pcbTransferred = 0;
+            return (dwWait == WAIT_TIMEOUT) ? HRESULT_FROM_WIN32(ERROR_TIMEOUT) : E_ABORT;
+        }
+    }
+
+    if (!GetOverlappedResult(hPipe, pov, pcbTransferred, FALSE))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return S_OK;
+}
+
+HRESULT UnlockSignal::_ServeClient(HANDLE hPipe, OVERLAPPED* pov)
+{
+    BYTE rgbChallenge[UNLOCK_SIGNAL_CHALLENGE_SIZE];
+    NTSTATUS status = BCryptGenRandom(nullptr, rgbChallenge, sizeof(rgbChallenge), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+    if (!BCRYPT_SUCCESS(status))
+    {
+        return HRESULT_FROM_NT(status);
+    }
+
+    DWORD cb = 0;
+    ResetEvent(pov->hEvent);
+    HRESULT hr = _WaitForIo(hPipe, pov, WriteFile(hPipe, rgbChallenge, sizeof(rgbChallenge), nullptr, pov), UNLOCK_SIGNAL_IO_TIMEOUT_MS, &cb);
+
+    // 多读一个字节，用于发现超长消息
+    BYTE rgbMessage[sizeof(UNLOCK_SIGNAL_MESSAGE) + 1];
+    if (SUCCEEDED(hr))
+    {
+        ResetEvent(pov->hEvent);
+        hr = _WaitForIo(hPipe, pov, ReadFile(hPipe, rgbMessage, sizeof(rgbMessage), nullptr, pov), UNLOCK_SIGNAL_IO_TIMEOUT_MS, &cb);
+        if (hr == HRESULT_FROM_WIN32(ERROR_MORE_DATA))
+        {
+            return hr;
+        }
+    }
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    HRESULT hrResult = E_ACCESSDENIED;
+    UNLOCK_SIGNAL_MESSAGE message;
+    if (cb == sizeof(message))
+    {
+        CopyMemory(&message, rgbMessage, sizeof(message));
+        BYTE rgbMac[UNLOCK_SIGNAL_MAC_SIZE];
+        if ((message.dwVersion == UNLOCK_SIGNAL_VERSION) && (message.dwSessionId == _dwSessionId) &&
+            SUCCEEDED(_ComputeMac(rgbChallenge, &message, rgbMac)))
+        {
+            // 常量时间比较
+            BYTE bDiff = 0;
+            for (DWORD i = 0; i < UNLOCK_SIGNAL_MAC_SIZE; i++)
+            {
+                bDiff |= rgbMac[i] ^ message.rgbMac[i];
+            }
+            if (!bDiff)
+            {
+                hrResult = S_OK;
+            }
+        }
+        SecureZeroMemory(rgbMac, sizeof(rgbMac));
+    }
+
+    if (hrResult == S_OK)
+    {
+        ULONGLONG ullTick = GetTickCount64();
+        InterlockedExchange64(&_llTicketTick, (LONGLONG)(ullTick ? ullTick : 1));
+
+        AcquireSRWLockShared(&_lock);
+        if (_pfnSignal)
+        {
+            _pfnSignal(_pvContext);
+        }
+        ReleaseSRWLockShared(&_lock);
+    }
+
+    ResetEvent(pov->hEvent);
+    _WaitForIo(hPipe, pov, WriteFile(hPipe, &hrResult, sizeof(hrResult), nullptr, pov), UNLOCK_SIGNAL_IO_TIMEOUT_MS, &cb);
+    if (SUCCEEDED(hrResult))
+    {
+        FlushFileBuffers(hPipe);
+    }
+    return hrResult;
+}
+
+HRESULT UnlockSignal::_ComputeMac(const BYTE* pbChallenge, const UNLOCK_SIGNAL_MESSAGE* pMessage, BYTE* pbMac)
+{
+    BCRYPT_ALG_HANDLE hAlg = nullptr;
+    NTSTATUS status = BCryptOpenAlgorithmProvider(&hAlg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG);
+    if (BCRYPT_SUCCESS(status))
+    {
+        BCRYPT_HASH_HANDLE hHash = nullptr;
+        status = BCryptCreateHash(hAlg, &hHash, nullptr, 0, _rgbKey, _cbKey, 0);
+        if (BCRYPT_SUCCESS(status))
+        {
+            status = BCryptHashData(hHash, (PUCHAR)pbChallenge, UNLOCK_SIGNAL_CHALLENGE_SIZE, 0);
+            if (BCRYPT_SUCCESS(status))
+            {
+                status = BCryptHashData(hHash, (PUCHAR)&pMessage->dwVersion, sizeof(pMessage->dwVersion), 0);
+            }
+            if (BCRYPT_SUCCESS(status))
+            {
+                status = BCryptHashData(hHash, (PUCHAR)&pMessage->dwSessionId, sizeof(pMessage->dwSessionId), 0);
+            }
+            if (BCRYPT_SUCCESS(status))
+            {
+                status = BCryptFinishHash(hHash, pbMac, UNLOCK_SIGNAL_MAC_SIZE, 0);
+            }
+            BCryptDestroyHash(hHash);
+        }
+        BCryptCloseAlgorithmProvider(hAlg, 0);
+    }
+    return BCRYPT_SUCCESS(status) ? S_OK : HRESULT_FROM_NT(status);
+}
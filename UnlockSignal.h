@@ -0,0 +1,87 @@
+#pragma once
+
+#include <windows.h>
+
+// 外部解锁信号
+//
+// 配套代理（配对手机、近场感应服务等）通过本机命名管道发送“立即解锁”信号，
+// 提供程序收到后通过 CredentialsChanged 让 LogonUI 重新查询并立即自动提交，无需轮询。
+// 配置 HKLM\SOFTWARE\WinUnlock\SignalKey（REG_BINARY，32～64 字节）后启用；
+// 启用后自动解锁只在收到有效信号后进行，每个信号只能使用一次，并在 UNLOCK_SIGNAL_TICKET_MS 后过期。
+//
+// 协议（每个连接一次往返，消息模式管道）：
+//   1. 服务端发送 UNLOCK_SIGNAL_CHALLENGE_SIZE 字节随机挑战
+//   2. 客户端回复 UNLOCK_SIGNAL_MESSAGE，rgbMac = HMAC-SHA256(SignalKey, 挑战 || dwVersion || dwSessionId)
+//   3. 服务端回复一个 HRESULT（S_OK 表示信号已接受）
+// 管道名带会话号，每个 LogonUI 会话各自监听；只接受本机连接。
+
+#define UNLOCK_SIGNAL_PIPE_FORMAT       L"\\\\.\\pipe\\WinUnlock.Signal.%lu"
+#define UNLOCK_SIGNAL_VERSION           1
+#define UNLOCK_SIGNAL_KEY_MIN           32
+#define UNLOCK_SIGNAL_KEY_MAX           64
+#define UNLOCK_SIGNAL_CHALLENGE_SIZE    32
+#define UNLOCK_SIGNAL_MAC_SIZE          32
+#define UNLOCK_SIGNAL_TICKET_MS         30000   // 信号的有效期
+#define UNLOCK_SIGNAL_IO_TIMEOUT_MS     2000    // 单次读写的超时，防止客户端占住管道
+#define UNLOCK_SIGNAL_STOP_TIMEOUT_MS   5000    // Stop 等待监听循环关闭管道的上限
+#define UNLOCK_SIGNAL_RETRY_MS          50      // 管道名仍被占用时的首次重试间隔，之后逐次加倍
+#define UNLOCK_SIGNAL_RETRY_MAX_MS      1600
+
+struct UNLOCK_SIGNAL_MESSAGE
+{
+    DWORD dwVersion;
+    DWORD dwSessionId;      // 目标会话，必须与监听方所在会话一致
+    BYTE rgbMac[UNLOCK_SIGNAL_MAC_SIZE];
+};
+
+// 收到有效信号时调用，在线程池线程上执行
+typedef void (CALLBACK *PFN_UNLOCK_SIGNAL)(void* pvContext);
+
+// 解锁信号监听器
+// 提供程序与其凭据对象共享同一实例：提供程序负责启动和停止监听，
+// 凭据对象在自动提交前检查并消费信号，因此使用引用计数管理生命周期。
+class UnlockSignal
+{
+public:
+    // 读取 SignalKey；未配置时返回 S_FALSE 且 *ppSignal 为 nullptr
+    static HRESULT CreateFromRegistry(UnlockSignal** ppSignal);
+
+    ULONG AddRef();
+    ULONG Release();
+
+    // 在线程池中开始监听；已在监听时返回 S_FALSE
+    HRESULT Start(PFN_UNLOCK_SIGNAL pfnSignal, void* pvContext);
+
+    // 停止监听并清除回调，返回后不会再调用回调；
+    // 并等待监听循环关闭管道（最多 UNLOCK_SIGNAL_STOP_TIMEOUT_MS），随后创建的实例可以立即接管管道名
+    void Stop();
+
+    // 是否有未过期、未使用的信号
+    bool IsPending();
+
+    // 使用信号；没有可用信号时返回 false
+    bool Consume();
+
+private:
+    UnlockSignal();
+    ~UnlockSignal();
+
+    static void CALLBACK s_ListenCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext);
+
+    void _Listen();
+    HRESULT _ServeClient(HANDLE hPipe, OVERLAPPED* pov);
+    HRESULT _WaitForIo(HANDLE hPipe, OVERLAPPED* pov, BOOL fCompleted, DWORD dwTimeoutMs, DWORD* pcbTransferred);
+    HRESULT _ComputeMac(const BYTE* pbChallenge, const UNLOCK_SIGNAL_MESSAGE* pMessage, BYTE* pbMac);
+
+    LONG _cRef;
+    SRWLOCK _lock;              // 保护回调；Stop 取排他锁，回调在共享锁下调用
+    PFN_UNLOCK_SIGNAL _pfnSignal;
+    void* _pvContext;
+    HANDLE _hStop;              // 手动重置事件，触发后监听循环退出
+    HANDLE _hIdle;              // 手动重置事件，监听循环未运行（管道已关闭）时为触发状态
+    volatile LONG _fListening;  // 与 _hIdle 一起在 _lock 排他锁下修改
+    DWORD _dwSessionId;
+    volatile LONGLONG _llTicketTick;    // 最近一次有效信号的 GetTickCount64，0 表示没有
+    BYTE _rgbKey[UNLOCK_SIGNAL_KEY_MAX];
+    DWORD _cbKey;
+};
@@ -0,0 +1,379 @@
+#include "pch.h"
+#include "Vault.h"
+#include "ConfigFile.h"
+#include <bcrypt.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+// PBKDF2-HMAC-SHA256 的算法句柄进程内共享，首次使用时打开
+static INIT_ONCE s_initVault = INIT_ONCE_STATIC_INIT;
+static BCRYPT_ALG_HANDLE s_hHmacAlg = nullptr;
+
+static BOOL CALLBACK InitializeVault(PINIT_ONCE pInitOnce, PVOID pvParameter, PVOID* ppvContext)
+{
+    UNREFERENCED_PARAMETER(pInitOnce);
+    UNREFERENCED_PARAMETER(pvParameter);
+    UNREFERENCED_PARAMETER(ppvContext);
+
+    return BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&s_hHmacAlg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG));
+}
+
+static HRESULT EnsureVaultInitialized()
+{
+    return InitOnceExecuteOnce(&s_initVault, InitializeVault, nullptr, nullptr) ? S_OK : E_FAIL;
+}
+
+static HRESULT Pbkdf2Sha256(const BYTE* pbPassword, DWORD cbPassword, const BYTE* pbSalt, DWORD cbSalt, BYTE* pbOut, DWORD cbOut)
+{
+    NTSTATUS status = BCryptDeriveKeyPBKDF2(s_hHmacAlg, (PUCHAR)pbPassword, cbPassword, (PUCHAR)pbSalt, cbSalt, 1, pbOut, cbOut, 0);
+    return BCRYPT_SUCCESS(status) ? S_OK : HRESULT_FROM_NT(status);
+}
+
+static HRESULT GenerateRandom(BYTE* pb, DWORD cb)
+{
+    NTSTATUS status = BCryptGenRandom(nullptr, pb, cb, BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+    return BCRYPT_SUCCESS(status) ? S_OK : HRESULT_FROM_NT(status);
+}
+
+bool VaultIsSealed(const BYTE* pbFile, DWORD cbFile)
+{
+    // DPAPI 数据以版本号 1 开头，不会与标记冲突
+    DWORD dwMagic = 0;
+    if (cbFile < sizeof(VAULT_FILE_HEADER) + POLY1305_TAG_SIZE)
+    {
+        return false;
+    }
+    CopyMemory(&dwMagic, pbFile, sizeof(dwMagic));
+    return dwMagic == VAULT_FILE_MAGIC;
+}
+
+bool VaultValidateKdfParams(const VAULT_KDF_PARAMS* pParams)
+{
+    if ((pParams->bLog2N < VAULT_KDF_MIN_LOG2N) || (pParams->bLog2N > VAULT_KDF_MAX_LOG2N) ||
+        !pParams->bBlockSize || (pParams->bBlockSize > VAULT_KDF_MAX_BLOCK) ||
+        !pParams->bLanes || (pParams->bLanes > VAULT_KDF_MAX_LANES))
+    {
+        return false;
+    }
+    ULONGLONG cbMemory = 128ull * pParams->bBlockSize * (1ull << pParams->bLog2N) * pParams->bLanes;
+    return cbMemory <= VAULT_KDF_MAX_MEMORY;
+}
+
+// scrypt 并行通道：各线程（含调用线程）依次领取通道号，直到全部领完
+
+struct VAULT_KDF_LANES
+{
+    BYTE* pbBlocks;
+    VAULT_KDF_PARAMS params;
+    volatile LONG iNext;
+    volatile LONG hrFailed;
+};
+
+static void RunKdfLanes(VAULT_KDF_LANES* pLanes)
+{
+    const DWORD cbLane = 128 * pLanes->params.bBlockSize;
+    for (;;)
+    {
+        LONG iLane = InterlockedIncrement(&pLanes->iNext) - 1;
+        if (iLane >= pLanes->params.bLanes)
+        {
+            break;
+        }
+        HRESULT hr = ScryptRomix(pLanes->pbBlocks + iLane * cbLane, pLanes->params.bBlockSize, pLanes->params.bLog2N);
+        if (FAILED(hr))
+        {
+            InterlockedCompareExchange(&pLanes->hrFailed, hr, S_OK);
+        }
+    }
+}
+
+static void CALLBACK s_KdfLaneCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext, PTP_WORK pWork)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    UNREFERENCED_PARAMETER(pWork);
+    RunKdfLanes((VAULT_KDF_LANES*)pvContext);
+}
+
+HRESULT VaultDeriveKey(const BYTE* pbPassphrase, DWORD cbPassphrase, const BYTE* pbSalt, DWORD cbSalt,
+    const VAULT_KDF_PARAMS* pParams, BYTE* pbKey)
+{
+    if (!VaultValidateKdfParams(pParams))
+    {
+        return E_INVALIDARG;
+    }
+    HRESULT hr = EnsureVaultInitialized();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    DWORD cbBlocks = 128 * pParams->bBlockSize * pParams->bLanes;
+    BYTE* pbBlocks = (BYTE*)CoTaskMemAlloc(cbBlocks);
+    if (!pbBlocks)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    hr = Pbkdf2Sha256(pbPassphrase, cbPassphrase, pbSalt, cbSalt, pbBlocks, cbBlocks);
+    if (SUCCEEDED(hr))
+    {
+        VAULT_KDF_LANES lanes = { pbBlocks, *pParams, 0, S_OK };
+
+        // 调用方同步等待全部回调结束，DLL 不会在回调期间卸载，无需 SetThreadpoolCallbackLibrary。
+        // 工作项创建失败时由调用线程依次计算全部通道
+        PTP_WORK pWork = nullptr;
+        if (pParams->bLanes > 1)
+        {
+            pWork = CreateThreadpoolWork(s_KdfLaneCallback, &lanes, nullptr);
+            if (pWork)
+            {
+                for (BYTE i = 1; i < pParams->bLanes; i++)
+                {
+                    SubmitThreadpoolWork(pWork);
+                }
+            }
+        }
+        RunKdfLanes(&lanes);
+        if (pWork)
+        {
+            WaitForThreadpoolWorkCallbacks(pWork, FALSE);
+            CloseThreadpoolWork(pWork);
+        }
+
+        hr = lanes.hrFailed;
+        if (SUCCEEDED(hr))
+        {
+            hr = Pbkdf2Sha256(pbPassphrase, cbPassphrase, pbBlocks, cbBlocks, pbKey, CHACHA20_KEY_SIZE);
+        }
+    }
+
+    SecureZeroMemory(pbBlocks, cbBlocks);
+    CoTaskMemFree(pbBlocks);
+    return hr;
+}
+
+static HRESULT MeasureKdf(const VAULT_KDF_PARAMS* pParams, DWORD* pdwMs)
+{
+    static LARGE_INTEGER s_liFrequency = { 0 };
+    if (!s_liFrequency.QuadPart)
+    {
+        QueryPerformanceFrequency(&s_liFrequency);
+    }
+
+    BYTE rgbPassphrase[VAULT_PASSPHRASE_MIN];
+    BYTE rgbSalt[VAULT_SALT_SIZE];
+    BYTE rgbKey[CHACHA20_KEY_SIZE];
+    HRESULT hr = GenerateRandom(rgbPassphrase, sizeof(rgbPassphrase));
+    if (SUCCEEDED(hr))
+    {
+        hr = GenerateRandom(rgbSalt, sizeof(rgbSalt));
+    }
+    if (SUCCEEDED(hr))
+    {
+        LARGE_INTEGER liStart;
+        LARGE_INTEGER liEnd;
+        QueryPerformanceCounter(&liStart);
+        hr = VaultDeriveKey(rgbPassphrase, sizeof(rgbPassphrase), rgbSalt, sizeof(rgbSalt), pParams, rgbKey);
+        QueryPerformanceCounter(&liEnd);
+        *pdwMs = (DWORD)((liEnd.QuadPart - liStart.QuadPart) * 1000 / s_liFrequency.QuadPart);
+    }
+    SecureZeroMemory(rgbKey, sizeof(rgbKey));
+    return hr;
+}
+
+HRESULT VaultTuneKdf(DWORD dwBudgetMs, BYTE bBlockSize, BYTE bLanes, VAULT_KDF_PARAMS* pParams, DWORD* pdwMeasuredMs)
+{
+    VAULT_KDF_PARAMS params = { VAULT_KDF_MIN_LOG2N, bBlockSize, bLanes };
+    if (!VaultValidateKdfParams(&params))
+    {
+        return E_INVALIDARG;
+    }
+
+    DWORD dwMs = 0;
+    HRESULT hr = MeasureKdf(&params, &dwMs);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    // 耗时随 N 线性增长：预计加倍后仍在预算内才实测下一档，超出预算的档位不采用
+    while (dwMs * 2 <= dwBudgetMs)
+    {
+        VAULT_KDF_PARAMS next = params;
+        next.bLog2N++;
+        if (!VaultValidateKdfParams(&next))
+        {
+            break;
+        }
+        DWORD dwNextMs = 0;
+        hr = MeasureKdf(&next, &dwNextMs);
+        if (FAILED(hr))
+        {
+            return hr;
+        }
+        if (dwNextMs > dwBudgetMs)
+        {
+            break;
+        }
+        params = next;
+        dwMs = dwNextMs;
+    }
+
+    *pParams = params;
+    *pdwMeasuredMs = dwMs;
+
+    // 最小的参数也超出预算
+    return (dwMs > dwBudgetMs) ? S_FALSE : S_OK;
+}
+
+HRESULT VaultSeal(const BYTE* pbPassphrase, DWORD cbPassphrase, const VAULT_KDF_PARAMS* pParams, DWORD dwBudgetMs,
+    PCWSTR pchAccounts, DWORD cchAccounts, BYTE** ppbVault, DWORD* pcbVault)
+{
+    *ppbVault = nullptr;
+    *pcbVault = 0;
+    if (!cchAccounts || (cchAccounts > VAULT_FILE_MAX_SIZE / sizeof(WCHAR)))
+    {
+        return E_INVALIDARG;
+    }
+    DWORD cbPayload = cchAccounts * sizeof(WCHAR);
+    DWORD cbVault = sizeof(VAULT_FILE_HEADER) + cbPayload + POLY1305_TAG_SIZE;
+    if (cbVault > VAULT_FILE_MAX_SIZE)
+    {
+        return HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE);
+    }
+
+    BYTE* pbVault = (BYTE*)CoTaskMemAlloc(cbVault);
+    if (!pbVault)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    VAULT_FILE_HEADER header = {};
+    header.dwMagic = VAULT_FILE_MAGIC;
+    header.wVersion = VAULT_FILE_VERSION;
+    header.wKdf = VAULT_KDF_SCRYPT;
+    header.kdf = *pParams;
+    header.dwBudgetMs = dwBudgetMs;
+    header.cbPayload = cbPayload;
+    HRESULT hr = GenerateRandom(header.rgbSalt, sizeof(header.rgbSalt));
+    if (SUCCEEDED(hr))
+    {
+        hr = GenerateRandom(header.rgbNonce, sizeof(header.rgbNonce));
+    }
+
+    BYTE rgbKey[CHACHA20_KEY_SIZE];
+    if (SUCCEEDED(hr))
+    {
+        hr = VaultDeriveKey(pbPassphrase, cbPassphrase, header.rgbSalt, sizeof(header.rgbSalt), pParams, rgbKey);
+    }
+    if (SUCCEEDED(hr))
+    {
+        CopyMemory(pbVault, &header, sizeof(header));
+        BYTE* pbCipher = pbVault + sizeof(header);
+        ChaChaPolySeal(rgbKey, header.rgbNonce, pbVault, sizeof(header), (const BYTE*)pchAccounts, pbCipher, cbPayload, pbCipher + cbPayload);
+        *ppbVault = pbVault;
+        *pcbVault = cbVault;
+        pbVault = nullptr;
+    }
+    SecureZeroMemory(rgbKey, sizeof(rgbKey));
+    CoTaskMemFree(pbVault);
+    return hr;
+}
+
+HRESULT VaultOpen(const BYTE* pbPassphrase, DWORD cbPassphrase, const BYTE* pbVault, DWORD cbVault,
+    SecretString* pAccounts, DWORD* pcchAccounts)
+{
+    *pcchAccounts = 0;
+    if (!VaultIsSealed(pbVault, cbVault))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    // 文件缓冲区不保证对齐，先复制头部
+    VAULT_FILE_HEADER header;
+    CopyMemory(&header, pbVault, sizeof(header));
+    if ((header.wVersion != VAULT_FILE_VERSION) || (header.wKdf != VAULT_KDF_SCRYPT) ||
+        !VaultValidateKdfParams(&header.kdf) || !header.cbPayload || (header.cbPayload % sizeof(WCHAR)) ||
+        (header.cbPayload != cbVault - sizeof(header) - POLY1305_TAG_SIZE))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    BYTE rgbKey[CHACHA20_KEY_SIZE];
+    HRESULT hr = VaultDeriveKey(pbPassphrase, cbPassphrase, header.rgbSalt, sizeof(header.rgbSalt), &header.kdf, rgbKey);
+    if (SUCCEEDED(hr))
+    {
+        DWORD cchAccounts = header.cbPayload / sizeof(WCHAR);
+        hr = pAccounts->Allocate(cchAccounts);
+        if (SUCCEEDED(hr))
+        {
+            const BYTE* pbCipher = pbVault + sizeof(header);
+            hr = ChaChaPolyOpen(rgbKey, header.rgbNonce, pbVault, sizeof(header), pbCipher, (BYTE*)pAccounts->Get(), header.cbPayload, pbCipher + header.cbPayload);
+            if (SUCCEEDED(hr))
+            {
+                *pcchAccounts = cchAccounts;
+            }
+            else
+            {
+                pAccounts->Free();
+            }
+        }
+    }
+    SecureZeroMemory(rgbKey, sizeof(rgbKey));
+    return hr;
+}
+
+HRESULT VaultReadPassphrase(BYTE* pbPassphrase, DWORD* pcbPassphrase)
+{
+    *pcbPassphrase = 0;
+    WCHAR szPath[MAX_PATH];
+    DWORD cch = ExpandEnvironmentStringsW(VAULT_PASSPHRASE_PATH, szPath, ARRAYSIZE(szPath));
+    if (!cch || (cch > ARRAYSIZE(szPath)))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    HANDLE hFile = CreateFileW(szPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    // 密钥文件只能由 SYSTEM 或管理员创建
+    HRESULT hr = ConfigCheckFileOwner(hFile);
+    if (FAILED(hr))
+    {
+        CloseHandle(hFile);
+        return hr;
+    }
+
+    LARGE_INTEGER liSize;
+    DWORD cbRead = 0;
+    if (!GetFileSizeEx(hFile, &liSize))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if ((liSize.QuadPart < VAULT_PASSPHRASE_MIN) || (liSize.QuadPart > VAULT_PASSPHRASE_MAX))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    else if (!ReadFile(hFile, pbPassphrase, (DWORD)liSize.QuadPart, &cbRead, nullptr))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if (cbRead != liSize.QuadPart)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    CloseHandle(hFile);
+
+    if (SUCCEEDED(hr))
+    {
+        *pcbPassphrase = cbRead;
+    }
+    else
+    {
+        SecureZeroMemory(pbPassphrase, VAULT_PASSPHRASE_MAX);
+    }
+    return hr;
+}
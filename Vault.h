@@ -0,0 +1,90 @@
+#pragma once
+
+#include "pch.h"
+#include "SecretArena.h"
+#include "VaultCrypto.h"
+
+// 口令保险库
+//
+// vault 来源的文件除旧的 DPAPI 格式外，还可以是以口令保护、可在任意计算机上生成的保险库：
+//
+//   VAULT_FILE_HEADER           同时作为附加认证数据
+//   密文[cbPayload]             全部账户，"用户名\0密码\0" UTF-16 成对排列
+//   标签[POLY1305_TAG_SIZE]
+//
+//   密钥 = scrypt(口令, rgbSalt, N = 2^bLog2N, r = bBlockSize, p = bLanes)
+//
+// scrypt 的 p 个通道互不依赖，在线程池上并行计算；参数由 tools\vaultseal.cpp 在部署时按耗时预算自动选定。
+// 派生出密钥后全部账户作为一条 ChaCha20-Poly1305 消息一次解密。
+// 口令保存在 VAULT_PASSPHRASE_PATH（只允许 SYSTEM 和管理员访问），与保险库文件分开分发和备份；
+// 保险库文件单独泄露时，每次离线猜测口令都要付出一次 KDF 的时间和内存。
+
+#define VAULT_FILE_DEFAULT_PATH L"%ProgramData%\\WinUnlock\\vault.dat"
+#define VAULT_PASSPHRASE_PATH   L"%ProgramData%\\WinUnlock\\vault.key"
+#define VAULT_PASSPHRASE_MIN    16
+#define VAULT_PASSPHRASE_MAX    1024
+
+#define VAULT_FILE_MAGIC        0x54565557      // "WUVT"
+#define VAULT_FILE_VERSION      1
+#define VAULT_FILE_MAX_SIZE     (64 * 1024)
+
+#define VAULT_KDF_SCRYPT        1
+#define VAULT_SALT_SIZE         16
+
+// 参数范围；总内存 128 * r * N * p 不超过 VAULT_KDF_MAX_MEMORY，避免 LogonUI 被过大的参数拖垮
+#define VAULT_KDF_MIN_LOG2N     10
+#define VAULT_KDF_MAX_LOG2N     22
+#define VAULT_KDF_MAX_BLOCK     32
+#define VAULT_KDF_MAX_LANES     16
+#define VAULT_KDF_MAX_MEMORY    (256 * 1024 * 1024)
+
+// 自动选择参数时的默认值
+#define VAULT_KDF_DEFAULT_BLOCK 8
+#define VAULT_KDF_DEFAULT_LANES 4
+#define VAULT_DEFAULT_BUDGET_MS 250
+
+struct VAULT_KDF_PARAMS
+{
+    BYTE bLog2N;
+    BYTE bBlockSize;        // r
+    BYTE bLanes;            // p
+};
+
+struct VAULT_FILE_HEADER
+{
+    DWORD dwMagic;
+    WORD wVersion;
+    WORD wKdf;
+    VAULT_KDF_PARAMS kdf;
+    BYTE bReserved;
+    DWORD dwBudgetMs;       // 部署时的耗时预算，仅供诊断
+    BYTE rgbSalt[VAULT_SALT_SIZE];
+    BYTE rgbNonce[CHACHA20_NONCE_SIZE];
+    DWORD cbPayload;
+};
+
+static_assert(sizeof(VAULT_FILE_HEADER) == 48, "header layout is part of the file format");
+
+// 文件是否为口令保险库（否则按旧的 DPAPI 格式读取）
+bool VaultIsSealed(const BYTE* pbFile, DWORD cbFile);
+
+// 参数是否在允许范围内
+bool VaultValidateKdfParams(const VAULT_KDF_PARAMS* pParams);
+
+// 由口令派生 CHACHA20_KEY_SIZE 字节的密钥，各通道在线程池上并行计算，调用线程也参与计算
+HRESULT VaultDeriveKey(const BYTE* pbPassphrase, DWORD cbPassphrase, const BYTE* pbSalt, DWORD cbSalt,
+    const VAULT_KDF_PARAMS* pParams, BYTE* pbKey);
+
+// 在本机实测，选出 r、p 固定时耗时不超过 dwBudgetMs 的最大 N；pdwMeasuredMs 返回选定参数的实测耗时
+HRESULT VaultTuneKdf(DWORD dwBudgetMs, BYTE bBlockSize, BYTE bLanes, VAULT_KDF_PARAMS* pParams, DWORD* pdwMeasuredMs);
+
+// 生成保险库，pchAccounts 为 cchAccounts 个字符的 "用户名\0密码\0" 序列；结果用 CoTaskMemFree 释放
+HRESULT VaultSeal(const BYTE* pbPassphrase, DWORD cbPassphrase, const VAULT_KDF_PARAMS* pParams, DWORD dwBudgetMs,
+    PCWSTR pchAccounts, DWORD cchAccounts, BYTE** ppbVault, DWORD* pcbVault);
+
+// 校验并解密保险库，全部账户写入 pAccounts，pcchAccounts 返回字符数（账户之间以 NUL 分隔，不能用 Length()）
+HRESULT VaultOpen(const BYTE* pbPassphrase, DWORD cbPassphrase, const BYTE* pbVault, DWORD cbVault,
+    SecretString* pAccounts, DWORD* pcchAccounts);
+
+// 读取本机的保险库口令，pbPassphrase 至少 VAULT_PASSPHRASE_MAX 字节
+HRESULT VaultReadPassphrase(BYTE* pbPassphrase, DWORD* pcbPassphrase);
@@ -0,0 +1,488 @@
+#include "pch.h"
+#include "VaultCrypto.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define VAULT_CRYPTO_SSE2
+#include <emmintrin.h>
+#endif
+
+// 与 BCrypt AES-GCM 解密失败时相同，调用方不必区分两种密封
+#ifndef STATUS_AUTH_TAG_MISMATCH
+#define STATUS_AUTH_TAG_MISMATCH ((NTSTATUS)0xC000A002L)
+#endif
+
+static inline DWORD Rotl32(DWORD dw, int n)
+{
+    return (dw << n) | (dw >> (32 - n));
+}
+
+static inline DWORD Load32(const BYTE* pb)
+{
+    return (DWORD)pb[0] | ((DWORD)pb[1] << 8) | ((DWORD)pb[2] << 16) | ((DWORD)pb[3] << 24);
+}
+
+static inline void Store32(BYTE* pb, DWORD dw)
+{
+    pb[0] = (BYTE)dw;
+    pb[1] = (BYTE)(dw >> 8);
+    pb[2] = (BYTE)(dw >> 16);
+    pb[3] = (BYTE)(dw >> 24);
+}
+
+// ChaCha20
+
+#define CHACHA_QR(a, b, c, d) \
+    a += b; d = Rotl32(d ^ a, 16); \
+    c += d; b = Rotl32(b ^ c, 12); \
+    a += b; d = Rotl32(d ^ a, 8); \
+    c += d; b = Rotl32(b ^ c, 7);
+
+static void ChaCha20InitState(const BYTE* pbKey, const BYTE* pbNonce, DWORD dwCounter, DWORD* pState)
+{
+    // "expand 32-byte k"
+    pState[0] = 0x61707865;
+    pState[1] = 0x3320646e;
+    pState[2] = 0x79622d32;
+    pState[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++)
+    {
+        pState[4 + i] = Load32(pbKey + 4 * i);
+    }
+    pState[12] = dwCounter;
+    pState[13] = Load32(pbNonce);
+    pState[14] = Load32(pbNonce + 4);
+    pState[15] = Load32(pbNonce + 8);
+}
+
+static void ChaCha20Block(const DWORD* pState, BYTE* pbKeyStream)
+{
+    DWORD x[16];
+    CopyMemory(x, pState, sizeof(x));
+    for (int i = 0; i < 10; i++)
+    {
+        CHACHA_QR(x[0], x[4], x[8], x[12]);
+        CHACHA_QR(x[1], x[5], x[9], x[13]);
+        CHACHA_QR(x[2], x[6], x[10], x[14]);
+        CHACHA_QR(x[3], x[7], x[11], x[15]);
+        CHACHA_QR(x[0], x[5], x[10], x[15]);
+        CHACHA_QR(x[1], x[6], x[11], x[12]);
+        CHACHA_QR(x[2], x[7], x[8], x[13]);
+        CHACHA_QR(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        Store32(pbKeyStream + 4 * i, x[i] + pState[i]);
+    }
+    SecureZeroMemory(x, sizeof(x));
+}
+
+#ifdef VAULT_CRYPTO_SSE2
+
+#define CHACHA_ROTL_SSE2(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define CHACHA_QR_SSE2(a, b, c, d) \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_ROTL_SSE2(d, 16); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL_SSE2(b, 12); \
+    a = _mm_add_epi32(a, b); d = _mm_xor_si128(d, a); d = CHACHA_ROTL_SSE2(d, 8); \
+    c = _mm_add_epi32(c, d); b = _mm_xor_si128(b, c); b = CHACHA_ROTL_SSE2(b, 7);
+
+// 同时计算 4 个连续块：每个寄存器保存 4 个块的同一个状态字，计算完成后转置回块顺序，与 256 字节输入异或
+static void ChaCha20Xor4Sse2(const DWORD* pState, const BYTE* pbIn, BYTE* pbOut)
+{
+    __m128i orig[16];
+    __m128i x[16];
+    for (int i = 0; i < 16; i++)
+    {
+        orig[i] = _mm_set1_epi32((int)pState[i]);
+    }
+    orig[12] = _mm_add_epi32(orig[12], _mm_set_epi32(3, 2, 1, 0));
+    for (int i = 0; i < 16; i++)
+    {
+        x[i] = orig[i];
+    }
+
+    for (int i = 0; i < 10; i++)
+    {
+        CHACHA_QR_SSE2(x[0], x[4], x[8], x[12]);
+        CHACHA_QR_SSE2(x[1], x[5], x[9], x[13]);
+        CHACHA_QR_SSE2(x[2], x[6], x[10], x[14]);
+        CHACHA_QR_SSE2(x[3], x[7], x[11], x[15]);
+        CHACHA_QR_SSE2(x[0], x[5], x[10], x[15]);
+        CHACHA_QR_SSE2(x[1], x[6], x[11], x[12]);
+        CHACHA_QR_SSE2(x[2], x[7], x[8], x[13]);
+        CHACHA_QR_SSE2(x[3], x[4], x[9], x[14]);
+    }
+
+    for (int i = 0; i < 16; i += 4)
+    {
+        __m128i a = _mm_add_epi32(x[i], orig[i]);
+        __m128i b = _mm_add_epi32(x[i + 1], orig[i + 1]);
+        __m128i c = _mm_add_epi32(x[i + 2], orig[i + 2]);
+        __m128i d = _mm_add_epi32(x[i + 3], orig[i + 3]);
+
+        // 4x4 转置：rgBlock[k] 为第 k 块的第 i～i+3 个字
+        __m128i t0 = _mm_unpacklo_epi32(a, b);
+        __m128i t1 = _mm_unpacklo_epi32(c, d);
+        __m128i t2 = _mm_unpackhi_epi32(a, b);
+        __m128i t3 = _mm_unpackhi_epi32(c, d);
+        __m128i rgBlock[4] =
+        {
+            _mm_unpacklo_epi64(t0, t1),
+            _mm_unpackhi_epi64(t0, t1),
+            _mm_unpacklo_epi64(t2, t3),
+            _mm_unpackhi_epi64(t2, t3),
+        };
+        for (int k = 0; k < 4; k++)
+        {
+            size_t ib = k * CHACHA20_BLOCK_SIZE + i * 4;
+            _mm_storeu_si128((__m128i*)(pbOut + ib), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(pbIn + ib)), rgBlock[k]));
+        }
+    }
+}
+
+#endif
+
+static void ChaCha20XorImpl(const BYTE* pbKey, const BYTE* pbNonce, DWORD dwCounter, const BYTE* pbIn, BYTE* pbOut, size_t cb, bool fVector)
+{
+    DWORD rgdwState[16];
+    ChaCha20InitState(pbKey, pbNonce, dwCounter, rgdwState);
+
+#ifdef VAULT_CRYPTO_SSE2
+    if (fVector)
+    {
+        while (cb >= 4 * CHACHA20_BLOCK_SIZE)
+        {
+            ChaCha20Xor4Sse2(rgdwState, pbIn, pbOut);
+            rgdwState[12] += 4;
+            pbIn += 4 * CHACHA20_BLOCK_SIZE;
+            pbOut += 4 * CHACHA20_BLOCK_SIZE;
+            cb -= 4 * CHACHA20_BLOCK_SIZE;
+        }
+    }
+#else
+    UNREFERENCED_PARAMETER(fVector);
+#endif
+
+    BYTE rgbKeyStream[CHACHA20_BLOCK_SIZE];
+    while (cb > 0)
+    {
+        ChaCha20Block(rgdwState, rgbKeyStream);
+        size_t cbBlock = (cb < CHACHA20_BLOCK_SIZE) ? cb : CHACHA20_BLOCK_SIZE;
+        for (size_t i = 0; i < cbBlock; i++)
+        {
+            pbOut[i] = pbIn[i] ^ rgbKeyStream[i];
+        }
+        rgdwState[12]++;
+        pbIn += cbBlock;
+        pbOut += cbBlock;
+        cb -= cbBlock;
+    }
+    SecureZeroMemory(rgbKeyStream, sizeof(rgbKeyStream));
+    SecureZeroMemory(rgdwState, sizeof(rgdwState));
+}
+
+void ChaCha20Xor(const BYTE* pbKey, const BYTE* pbNonce, DWORD dwCounter, const BYTE* pbIn, BYTE* pbOut, size_t cb)
+{
+    ChaCha20XorImpl(pbKey, pbNonce, dwCounter, pbIn, pbOut, cb, true);
+}
+
+void ChaCha20XorScalar(const BYTE* pbKey, const BYTE* pbNonce, DWORD dwCounter, const BYTE* pbIn, BYTE* pbOut, size_t cb)
+{
+    ChaCha20XorImpl(pbKey, pbNonce, dwCounter, pbIn, pbOut, cb, false);
+}
+
+// Poly1305：h 和 r 以 5 个 26 位分量表示，乘积用 64 位累加
+
+void Poly1305Init(POLY1305_STATE* pState, const BYTE* pbKey)
+{
+    // r 按 RFC 8439 截断（clamp）
+    pState->r[0] = Load32(pbKey) & 0x3ffffff;
+    pState->r[1] = (Load32(pbKey + 3) >> 2) & 0x3ffff03;
+    pState->r[2] = (Load32(pbKey + 6) >> 4) & 0x3ffc0ff;
+    pState->r[3] = (Load32(pbKey + 9) >> 6) & 0x3f03fff;
+    pState->r[4] = (Load32(pbKey + 12) >> 8) & 0x00fffff;
+    ZeroMemory(pState->h, sizeof(pState->h));
+    for (int i = 0; i < 4; i++)
+    {
+        pState->pad[i] = Load32(pbKey + 16 + 4 * i);
+    }
+    pState->cbBuffer = 0;
+}
+
+// dwHiBit 为 1 << 24（完整块）或 0（已补 0x01 的最后一块）
+static void Poly1305Blocks(POLY1305_STATE* pState, const BYTE* pb, size_t cb, DWORD dwHiBit)
+{
+    const DWORD r0 = pState->r[0], r1 = pState->r[1], r2 = pState->r[2], r3 = pState->r[3], r4 = pState->r[4];
+    const DWORD s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    DWORD h0 = pState->h[0], h1 = pState->h[1], h2 = pState->h[2], h3 = pState->h[3], h4 = pState->h[4];
+
+    while (cb >= 16)
+    {
+        h0 += Load32(pb) & 0x3ffffff;
+        h1 += (Load32(pb + 3) >> 2) & 0x3ffffff;
+        h2 += (Load32(pb + 6) >> 4) & 0x3ffffff;
+        h3 += (Load32(pb + 9) >> 6) & 0x3ffffff;
+        h4 += (Load32(pb + 12) >> 8) | dwHiBit;
+
+        ULONGLONG d0 = (ULONGLONG)h0 * r0 + (ULONGLONG)h1 * s4 + (ULONGLONG)h2 * s3 + (ULONGLONG)h3 * s2 + (ULONGLONG)h4 * s1;
+        ULONGLONG d1 = (ULONGLONG)h0 * r1 + (ULONGLONG)h1 * r0 + (ULONGLONG)h2 * s4 + (ULONGLONG)h3 * s3 + (ULONGLONG)h4 * s2;
+        ULONGLONG d2 = (ULONGLONG)h0 * r2 + (ULONGLONG)h1 * r1 + (ULONGLONG)h2 * r0 + (ULONGLONG)h3 * s4 + (ULONGLONG)h4 * s3;
+        ULONGLONG d3 = (ULONGLONG)h0 * r3 + (ULONGLONG)h1 * r2 + (ULONGLONG)h2 * r1 + (ULONGLONG)h3 * r0 + (ULONGLONG)h4 * s4;
+        ULONGLONG d4 = (ULONGLONG)h0 * r4 + (ULONGLONG)h1 * r3 + (ULONGLONG)h2 * r2 + (ULONGLONG)h3 * r1 + (ULONGLONG)h4 * r0;
+
+        DWORD c = (DWORD)(d0 >> 26); h0 = (DWORD)d0 & 0x3ffffff;
+        d1 += c; c = (DWORD)(d1 >> 26); h1 = (DWORD)d1 & 0x3ffffff;
+        d2 += c; c = (DWORD)(d2 >> 26); h2 = (DWORD)d2 & 0x3ffffff;
+        d3 += c; c = (DWORD)(d3 >> 26); h3 = (DWORD)d3 & 0x3ffffff;
+        d4 += c; c = (DWORD)(d4 >> 26); h4 = (DWORD)d4 & 0x3ffffff;
+        h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += c;
+
+        pb += 16;
+        cb -= 16;
+    }
+
+    pState->h[0] = h0;
+    pState->h[1] = h1;
+    pState->h[2] = h2;
+    pState->h[3] = h3;
+    pState->h[4] = h4;
+}
+
+void Poly1305Update(POLY1305_STATE* pState, const BYTE* pb, size_t cb)
+{
+    if (pState->cbBuffer)
+    {
+        size_t cbTake = 16 - pState->cbBuffer;
+        if (cbTake > cb)
+        {
+            cbTake = cb;
+        }
+        CopyMemory(pState->rgbBuffer + pState->cbBuffer, pb, cbTake);
+        pState->cbBuffer += (DWORD)cbTake;
+        pb += cbTake;
+        cb -= cbTake;
+        if (pState->cbBuffer < 16)
+        {
+            return;
+        }
+        Poly1305Blocks(pState, pState->rgbBuffer, 16, 1 << 24);
+        pState->cbBuffer = 0;
+    }
+
+    size_t cbBlocks = cb & ~(size_t)15;
+    Poly1305Blocks(pState, pb, cbBlocks, 1 << 24);
+    if (cb > cbBlocks)
+    {
+        CopyMemory(pState->rgbBuffer, pb + cbBlocks, cb - cbBlocks);
+        pState->cbBuffer = (DWORD)(cb - cbBlocks);
+    }
+}
+
+void Poly1305Final(POLY1305_STATE* pState, BYTE* pbTag)
+{
+    if (pState->cbBuffer)
+    {
+        pState->rgbBuffer[pState->cbBuffer] = 1;
+        ZeroMemory(pState->rgbBuffer + pState->cbBuffer + 1, 16 - pState->cbBuffer - 1);
+        Poly1305Blocks(pState, pState->rgbBuffer, 16, 0);
+    }
+
+    DWORD h0 = pState->h[0], h1 = pState->h[1], h2 = pState->h[2], h3 = pState->h[3], h4 = pState->h[4];
+    DWORD c = h1 >> 26; h1 &= 0x3ffffff;
+    h2 += c; c = h2 >> 26; h2 &= 0x3ffffff;
+    h3 += c; c = h3 >> 26; h3 &= 0x3ffffff;
+    h4 += c; c = h4 >> 26; h4 &= 0x3ffffff;
+    h0 += c * 5; c = h0 >> 26; h0 &= 0x3ffffff;
+    h1 += c;
+
+    // g = h + 5 - 2^130；g 非负（h >= p）时取 g，不用分支
+    DWORD g0 = h0 + 5; c = g0 >> 26; g0 &= 0x3ffffff;
+    DWORD g1 = h1 + c; c = g1 >> 26; g1 &= 0x3ffffff;
+    DWORD g2 = h2 + c; c = g2 >> 26; g2 &= 0x3ffffff;
+    DWORD g3 = h3 + c; c = g3 >> 26; g3 &= 0x3ffffff;
+    DWORD g4 = h4 + c - (1 << 26);
+
+    DWORD dwMask = (g4 >> 31) - 1;
+    h0 = (h0 & ~dwMask) | (g0 & dwMask);
+    h1 = (h1 & ~dwMask) | (g1 & dwMask);
+    h2 = (h2 & ~dwMask) | (g2 & dwMask);
+    h3 = (h3 & ~dwMask) | (g3 & dwMask);
+    h4 = (h4 & ~dwMask) | (g4 & dwMask);
+
+    // 转为 4 个 32 位字后加上 pad（模 2^128）
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+
+    ULONGLONG f = (ULONGLONG)h0 + pState->pad[0];
+    Store32(pbTag, (DWORD)f);
+    f = (ULONGLONG)h1 + pState->pad[1] + (f >> 32);
+    Store32(pbTag + 4, (DWORD)f);
+    f = (ULONGLONG)h2 + pState->pad[2] + (f >> 32);
+    Store32(pbTag + 8, (DWORD)f);
+    f = (ULONGLONG)h3 + pState->pad[3] + (f >> 32);
+    Store32(pbTag + 12, (DWORD)f);
+
+    SecureZeroMemory(pState, sizeof(*pState));
+}
+
+// ChaCha20-Poly1305
+
+static void ChaChaPolyComputeTag(const BYTE* pbKey, const BYTE* pbNonce, const BYTE* pbAad, size_t cbAad,
+    const BYTE* pbCipher, size_t cb, BYTE* pbTag)
+{
+    static const BYTE c_rgbZero[16] = { 0 };
+
+    // 一次性 Poly1305 密钥为块 0 的密钥流前 32 字节，数据从块 1 开始加密
+    BYTE rgbPolyKey[CHACHA20_BLOCK_SIZE] = { 0 };
+    ChaCha20XorScalar(pbKey, pbNonce, 0, rgbPolyKey, rgbPolyKey, sizeof(rgbPolyKey));
+
+    POLY1305_STATE state;
+    Poly1305Init(&state, rgbPolyKey);
+    Poly1305Update(&state, pbAad, cbAad);
+    Poly1305Update(&state, c_rgbZero, (16 - (cbAad & 15)) & 15);
+    Poly1305Update(&state, pbCipher, cb);
+    Poly1305Update(&state, c_rgbZero, (16 - (cb & 15)) & 15);
+
+    BYTE rgbLengths[16];
+    ULONGLONG ullAad = cbAad;
+    ULONGLONG ullCipher = cb;
+    for (int i = 0; i < 8; i++)
+    {
+        rgbLengths[i] = (BYTE)(ullAad >> (8 * i));
+        rgbLengths[8 + i] = (BYTE)(ullCipher >> (8 * i));
+    }
+    Poly1305Update(&state, rgbLengths, sizeof(rgbLengths));
+    Poly1305Final(&state, pbTag);
+    SecureZeroMemory(rgbPolyKey, sizeof(rgbPolyKey));
+}
+
+void ChaChaPolySeal(const BYTE* pbKey, const BYTE* pbNonce, const BYTE* pbAad, size_t cbAad,
+    const BYTE* pbIn, BYTE* pbOut, size_t cb, BYTE* pbTag)
+{
+    ChaCha20Xor(pbKey, pbNonce, 1, pbIn, pbOut, cb);
+    ChaChaPolyComputeTag(pbKey, pbNonce, pbAad, cbAad, pbOut, cb, pbTag);
+}
+
+HRESULT ChaChaPolyOpen(const BYTE* pbKey, const BYTE* pbNonce, const BYTE* pbAad, size_t cbAad,
+    const BYTE* pbIn, BYTE* pbOut, size_t cb, const BYTE* pbTag)
+{
+    BYTE rgbTag[POLY1305_TAG_SIZE];
+    ChaChaPolyComputeTag(pbKey, pbNonce, pbAad, cbAad, pbIn, cb, rgbTag);
+
+    // 比较时间与标签内容无关
+    BYTE bDiff = 0;
+    for (int i = 0; i < POLY1305_TAG_SIZE; i++)
+    {
+        bDiff |= rgbTag[i] ^ pbTag[i];
+    }
+    if (bDiff)
+    {
+        return HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH);
+    }
+    ChaCha20Xor(pbKey, pbNonce, 1, pbIn, pbOut, cb);
+    return S_OK;
+}
+
+// scrypt ROMix
+
+static void Salsa208(DWORD* pB)
+{
+    DWORD x[16];
+    CopyMemory(x, pB, sizeof(x));
+    for (int i = 0; i < 8; i += 2)
+    {
+        // 列
+        x[4] ^= Rotl32(x[0] + x[12], 7);    x[8] ^= Rotl32(x[4] + x[0], 9);
+        x[12] ^= Rotl32(x[8] + x[4], 13);   x[0] ^= Rotl32(x[12] + x[8], 18);
+        x[9] ^= Rotl32(x[5] + x[1], 7);     x[13] ^= Rotl32(x[9] + x[5], 9);
+        x[1] ^= Rotl32(x[13] + x[9], 13);   x[5] ^= Rotl32(x[1] + x[13], 18);
+        x[14] ^= Rotl32(x[10] + x[6], 7);   x[2] ^= Rotl32(x[14] + x[10], 9);
+        x[6] ^= Rotl32(x[2] + x[14], 13);   x[10] ^= Rotl32(x[6] + x[2], 18);
+        x[3] ^= Rotl32(x[15] + x[11], 7);   x[7] ^= Rotl32(x[3] + x[15], 9);
+        x[11] ^= Rotl32(x[7] + x[3], 13);   x[15] ^= Rotl32(x[11] + x[7], 18);
+        // 行
+        x[1] ^= Rotl32(x[0] + x[3], 7);     x[2] ^= Rotl32(x[1] + x[0], 9);
+        x[3] ^= Rotl32(x[2] + x[1], 13);    x[0] ^= Rotl32(x[3] + x[2], 18);
+        x[6] ^= Rotl32(x[5] + x[4], 7);     x[7] ^= Rotl32(x[6] + x[5], 9);
+        x[4] ^= Rotl32(x[7] + x[6], 13);    x[5] ^= Rotl32(x[4] + x[7], 18);
+        x[11] ^= Rotl32(x[10] + x[9], 7);   x[8] ^= Rotl32(x[11] + x[10], 9);
+        x[9] ^= Rotl32(x[8] + x[11], 13);   x[10] ^= Rotl32(x[9] + x[8], 18);
+        x[12] ^= Rotl32(x[15] + x[14], 7);  x[13] ^= Rotl32(x[12] + x[15], 9);
+        x[14] ^= Rotl32(x[13] + x[12], 13); x[15] ^= Rotl32(x[14] + x[13], 18);
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        pB[i] += x[i];
+    }
+}
+
+// BlockMix：pIn 为 2r 个 16 字的块，结果按偶数块在前、奇数块在后写入 pOut
+static void ScryptBlockMix(const DWORD* pIn, DWORD* pOut, DWORD r)
+{
+    DWORD x[16];
+    CopyMemory(x, pIn + (2 * r - 1) * 16, sizeof(x));
+    for (DWORD i = 0; i < 2 * r; i++)
+    {
+        for (int k = 0; k < 16; k++)
+        {
+            x[k] ^= pIn[i * 16 + k];
+        }
+        Salsa208(x);
+        CopyMemory(pOut + ((i & 1) ? (r + i / 2) : (i / 2)) * 16, x, sizeof(x));
+    }
+}
+
+HRESULT ScryptRomix(BYTE* pbBlock, BYTE bBlockSize, BYTE bLog2N)
+{
+    const DWORD r = bBlockSize;
+    const DWORD cWords = 32 * r;
+    const SIZE_T cBlocks = (SIZE_T)1 << bLog2N;
+    if (!r || (bLog2N >= 8 * sizeof(DWORD)))
+    {
+        return E_INVALIDARG;
+    }
+
+    // V 之后紧接 X、Y 两个工作块
+    SIZE_T cbV = cBlocks * cWords * sizeof(DWORD);
+    DWORD* pV = (DWORD*)VirtualAlloc(nullptr, cbV + 2 * cWords * sizeof(DWORD), MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!pV)
+    {
+        return E_OUTOFMEMORY;
+    }
+    DWORD* pX = pV + cBlocks * cWords;
+    DWORD* pY = pX + cWords;
+
+    for (DWORD k = 0; k < cWords; k++)
+    {
+        pX[k] = Load32(pbBlock + 4 * k);
+    }
+    for (SIZE_T i = 0; i < cBlocks; i++)
+    {
+        CopyMemory(pV + i * cWords, pX, cWords * sizeof(DWORD));
+        ScryptBlockMix(pX, pY, r);
+        DWORD* pT = pX; pX = pY; pY = pT;
+    }
+    for (SIZE_T i = 0; i < cBlocks; i++)
+    {
+        SIZE_T j = pX[(2 * r - 1) * 16] & (cBlocks - 1);
+        const DWORD* pVj = pV + j * cWords;
+        for (DWORD k = 0; k < cWords; k++)
+        {
+            pX[k] ^= pVj[k];
+        }
+        ScryptBlockMix(pX, pY, r);
+        DWORD* pT = pX; pX = pY; pY = pT;
+    }
+    for (DWORD k = 0; k < cWords; k++)
+    {
+        Store32(pbBlock + 4 * k, pX[k]);
+    }
+
+    // V 交还系统，页面再次分配前由系统清零；工作块在此清零
+    SecureZeroMemory(pV + cBlocks * cWords, 2 * cWords * sizeof(DWORD));
+    VirtualFree(pV, 0, MEM_RELEASE);
+    return S_OK;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "pch.h"
+
+// 保险库加密原语
+//
+// ChaCha20-Poly1305（RFC 8439）和 scrypt 的单通道计算（RFC 7914 的 ROMix）。
+// ChaCha20 在 x86/x64 上用 SSE2 一次生成 4 个块的密钥流，其余平台及不足 4 块的尾部使用标量实现，两者结果逐字节相同。
+// 本文件只依赖内存缓冲区，PBKDF2、并行通道和文件格式见 Vault.h；测试向量和性能测试见 tools\vaultseal.cpp。
+
+#define CHACHA20_KEY_SIZE       32
+#define CHACHA20_NONCE_SIZE     12
+#define CHACHA20_BLOCK_SIZE     64
+#define POLY1305_KEY_SIZE       32
+#define POLY1305_TAG_SIZE       16
+
+// 以 dwCounter 为起始块号生成密钥流并与 pbIn 异或，pbIn 与 pbOut 可以相同
+void ChaCha20Xor(const BYTE* pbKey, const BYTE* pbNonce, DWORD dwCounter, const BYTE* pbIn, BYTE* pbOut, size_t cb);
+
+// 只使用标量实现，供测试和性能对比
+void ChaCha20XorScalar(const BYTE* pbKey, const BYTE* pbNonce, DWORD dwCounter, const BYTE* pbIn, BYTE* pbOut, size_t cb);
+
+// Poly1305 增量计算
+struct POLY1305_STATE
+{
+    DWORD r[5];
+    DWORD h[5];
+    DWORD pad[4];
+    BYTE rgbBuffer[16];
+    DWORD cbBuffer;
+};
+
+void Poly1305Init(POLY1305_STATE* pState, const BYTE* pbKey);
+void Poly1305Update(POLY1305_STATE* pState, const BYTE* pb, size_t cb);
+void Poly1305Final(POLY1305_STATE* pState, BYTE* pbTag);   // 之后状态被清零
+
+// AEAD 加密，密文与明文等长；pbIn 与 pbOut 可以相同
+void ChaChaPolySeal(const BYTE* pbKey, const BYTE* pbNonce, const BYTE* pbAad, size_t cbAad,
+    const BYTE* pbIn, BYTE* pbOut, size_t cb, BYTE* pbTag);
+
+// AEAD 解密：先校验认证标签，通过后才解密，失败时不写入 pbOut。
+// 所有记录作为一条消息密封，一次调用即可解密全部内容
+HRESULT ChaChaPolyOpen(const BYTE* pbKey, const BYTE* pbNonce, const BYTE* pbAad, size_t cbAad,
+    const BYTE* pbIn, BYTE* pbOut, size_t cb, const BYTE* pbTag);
+
+// scrypt 单通道：对 128 * r 字节的块 pbBlock 原地执行 ROMix，N = 2^bLog2N。
+// 需要 128 * r * N 字节的临时内存，分配失败时返回 E_OUTOFMEMORY
+HRESULT ScryptRomix(BYTE* pbBlock, BYTE bBlockSize, BYTE bLog2N);
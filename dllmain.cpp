@@ -1,9 +1,17 @@
 #include "pch.h"
+#include "ConfigSnapshot.h"
 #include "CredentialProvider.h"
+#include "ObjectPool.h"
+#include "SharedCache.h"
+#include "StringTable.h"
+#include "TileImage.h"
 
 // DLL 引用计数
 static LONG g_cRef = 0;
 
+// DLL 模块句柄
+HINSTANCE g_hinst = nullptr;
+
 void DllAddRef()
 {
     InterlockedIncrement(&g_cRef);
@@ -14,6 +22,8 @@ void DllRelease()
     InterlockedDecrement(&g_cRef);
 }
 
+// 类工厂是静态对象，随 DLL 存在，不会被释放。
+// 对它的引用只计入 DLL 引用计数，DllCanUnloadNow 据此判断是否还有调用方持有它
 class CWinUnlockProviderClassFactory : public IClassFactory
 {
 public:
@@ -30,15 +40,14 @@ public:
 
     IFACEMETHODIMP_(ULONG) AddRef()
     {
-        return InterlockedIncrement(&_cRef);
+        DllAddRef();
+        return 2;
     }
 
     IFACEMETHODIMP_(ULONG) Release()
     {
-        LONG cRef = InterlockedDecrement(&_cRef);
-        if (!cRef)
-            delete this;
-        return cRef;
+        DllRelease();
+        return 1;
     }
 
     // IClassFactory
@@ -70,16 +79,10 @@ public:
         }
         return S_OK;
     }
-
-    CWinUnlockProviderClassFactory() : _cRef(1)
-    {
-        DllAddRef();
-    }
-
-private:
-    LONG _cRef;
 };
 
+static CWinUnlockProviderClassFactory s_classFactory;
+
 STDAPI DllCanUnloadNow()
 {
     return (g_cRef == 0) ? S_OK : S_FALSE;
@@ -90,25 +93,40 @@ STDAPI DllGetClassObject(REFCLSID rclsid, REFIID riid, void** ppv)
     HRESULT hr = CLASS_E_CLASSNOTAVAILABLE;
     if (IsEqualGUID(rclsid, CLSID_WinUnlockProvider))
     {
-        hr = E_OUTOFMEMORY;
-        CWinUnlockProviderClassFactory* pClassFactory = new(std::nothrow) CWinUnlockProviderClassFactory();
-        if (pClassFactory)
-        {
-            hr = pClassFactory->QueryInterface(riid, ppv);
-            pClassFactory->Release();
-        }
+        hr = s_classFactory.QueryInterface(riid, ppv);
     }
     return hr;
 }
 
+HRESULT WINAPI WinUnlockGetObjectStats(WINUNLOCK_OBJECT_STATS* pStats)
+{
+    if (!pStats)
+    {
+        return E_INVALIDARG;
+    }
+    pStats->cDllRefs = g_cRef;
+    WinUnlockProvider::GetPoolStats(&pStats->providers);
+    WinUnlockCredential::GetPoolStats(&pStats->credentials);
+    return S_OK;
+}
+
 BOOL APIENTRY DllMain(HMODULE hModule, DWORD dwReason, LPVOID lpReserved)
 {
     switch (dwReason)
     {
     case DLL_PROCESS_ATTACH:
+        g_hinst = hModule;
         DisableThreadLibraryCalls(hModule);
         break;
     case DLL_PROCESS_DETACH:
+        // 进程退出时无需释放
+        if (!lpReserved)
+        {
+            StringTableCleanup();
+            TileImageCleanup();
+            ConfigSnapshotCleanup();
+            SharedCacheCleanup();
+        }
         break;
     }
     return TRUE;
@@ -0,0 +1,9 @@
+// 资源 ID（winunlock.rc）
+
+// 磁贴字符串，全部位于同一个 16 条的字符串块中（IDS_STRING_BASE 必须是 16 的倍数）
+#define IDS_STRING_BASE             112
+#define IDS_TILE_TITLE              112
+#define IDS_TILE_DESCRIPTION        113
+#define IDS_SERIALIZATION_FAILED    114
+#define IDS_WAITING_FOR_SIGNAL      115
+#define IDS_CREDENTIALS_LOADING     116
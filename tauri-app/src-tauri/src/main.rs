@@ -2,6 +2,9 @@
 #![cfg_attr(not(debug_assertions), windows_subsystem = "windows")]
 
 use serde::{Deserialize, Serialize};
+use std::ffi::OsStr;
+use std::os::windows::ffi::OsStrExt;
+use std::path::PathBuf;
 use winreg::enums::*;
 use winreg::RegKey;
 
@@ -20,6 +23,98 @@ struct ConfigResponse {
 }
 
 const REGISTRY_PATH: &str = r"SOFTWARE\WinUnlock";
+const PROVIDER_INPROC_PATH: &str = r"CLSID\{A1B2C3D4-E5F6-7890-ABCD-EF1234567891}\InprocServer32";
+
+// winunlock.dll 导出的 WinUnlockSaveConfig
+type SaveConfigFn = unsafe extern "system" fn(*const u16, *const u16, i32) -> i32;
+
+fn to_wide(s: &str) -> Vec<u16> {
+    OsStr::new(s).encode_wide().chain(std::iter::once(0)).collect()
+}
+
+// 二进制配置文件位置，与 ConfigFile.h 中的 CONFIG_FILE_PATH 一致
+fn config_file_path() -> PathBuf {
+    let program_data = std::env::var("ProgramData").unwrap_or_else(|_| r"C:\ProgramData".to_string());
+    PathBuf::from(program_data).join("WinUnlock").join("config.bin")
+}
+
+// 二进制配置文件布局，见 ConfigFormat.h
+const CONFIG_FILE_MAGIC: u32 = 0x46435557;
+const CONFIG_FLAG_AUTO_UNLOCK_ENABLED: u32 = 0x00000001;
+const CONFIG_RECORD_SIZE: usize = 32;
+
+// config.bin 中与来源链有关的内容
+struct BinaryConfig {
+    auto_unlock_enabled: bool,
+    usernames: Vec<String>,
+}
+
+// 读取 config.bin 的标志和账户用户名；文件不存在或不是有效的配置文件时返回 None，
+// 与 config 来源相同，此时来源链会继续读取注册表
+fn read_binary_config() -> Option<BinaryConfig> {
+    let data = std::fs::read(config_file_path()).ok()?;
+    let dword = |ib: usize| {
+        data.get(ib..ib.checked_add(4)?)
+            .map(|b| u32::from_le_bytes([b[0], b[1], b[2], b[3]]))
+    };
+    if dword(0)? != CONFIG_FILE_MAGIC || dword(12)? as usize != data.len() {
+        return None;
+    }
+    let flags = dword(16)?;
+    let account_count = dword(24)? as usize;
+    let ib_records = dword(28)? as usize;
+    let ib_strings = dword(32)? as usize;
+
+    let mut usernames = Vec::with_capacity(account_count.min(256));
+    for i in 0..account_count {
+        let ib_record = ib_records.checked_add(i.checked_mul(CONFIG_RECORD_SIZE)?)?;
+        let ich_name = dword(ib_record.checked_add(4)?)? as usize;
+        let cch_name = dword(ib_record.checked_add(8)?)? as usize;
+        let ib_name = ib_strings.checked_add(ich_name.checked_mul(2)?)?;
+        let bytes = data.get(ib_name..ib_name.checked_add(cch_name.checked_mul(2)?)?)?;
+        let name: Vec<u16> = bytes.chunks_exact(2).map(|c| u16::from_le_bytes([c[0], c[1]])).collect();
+        usernames.push(String::from_utf16_lossy(&name));
+    }
+    Some(BinaryConfig {
+        auto_unlock_enabled: flags & CONFIG_FLAG_AUTO_UNLOCK_ENABLED != 0,
+        usernames,
+    })
+}
+
+// 删除 config.bin；文件本来就不存在时视为成功
+fn remove_binary_config() -> std::io::Result<()> {
+    match std::fs::remove_file(config_file_path()) {
+        Err(e) if e.kind() != std::io::ErrorKind::NotFound => Err(e),
+        _ => Ok(()),
+    }
+}
+
+// 优先使用已注册的提供程序 DLL，未注册时按默认搜索顺序加载
+fn provider_dll_path() -> String {
+    RegKey::predef(HKEY_CLASSES_ROOT)
+        .open_subkey(PROVIDER_INPROC_PATH)
+        .and_then(|key| key.get_value::<String, _>(""))
+        .unwrap_or_else(|_| "winunlock.dll".to_string())
+}
+
+// 通过提供程序 DLL 把账户写入二进制配置文件（密码经 DPAPI 密封）
+fn save_binary_config(username: &str, password: &str, auto_unlock_enabled: bool) -> Result<(), String> {
+    let username = to_wide(username);
+    let mut password = to_wide(password);
+    let hr = unsafe {
+        let library = libloading::Library::new(provider_dll_path())
+            .map_err(|e| format!("无法加载 winunlock.dll: {}", e))?;
+        let save: libloading::Symbol<SaveConfigFn> = library
+            .get(b"WinUnlockSaveConfig\0")
+            .map_err(|e| format!("winunlock.dll 版本过旧: {}", e))?;
+        save(username.as_ptr(), password.as_ptr(), auto_unlock_enabled as i32)
+    };
+    password.iter_mut().for_each(|c| *c = 0);
+    if hr < 0 {
+        return Err(format!("保存配置文件失败: 0x{:08X}", hr as u32));
+    }
+    Ok(())
+}
 
 // 读取配置
 #[tauri::command]
@@ -83,12 +178,28 @@ fn save_config(username: String, password: String, auto_unlock_enabled: bool) ->
         });
     }
 
-    if let Err(e) = config_key.set_value("Password", &password) {
-        return Ok(ConfigResponse {
-            success: false,
-            message: format!("无法保存密码: {}", e),
-            config: None,
-        });
+    // 密码优先密封保存到二进制配置文件，此时删除注册表中的明文；DLL 不可用时退回注册表。
+    // 退回前先删除旧的 config.bin：它排在来源链最前面，留着会让刚写入的密码和开关都不生效
+    match save_binary_config(&username, &password, auto_unlock_enabled) {
+        Ok(()) => {
+            let _ = config_key.delete_value("Password");
+        }
+        Err(_) => {
+            if let Err(e) = remove_binary_config() {
+                return Ok(ConfigResponse {
+                    success: false,
+                    message: format!("无法删除旧的配置文件 {}: {}", config_file_path().display(), e),
+                    config: None,
+                });
+            }
+            if let Err(e) = config_key.set_value("Password", &password) {
+                return Ok(ConfigResponse {
+                    success: false,
+                    message: format!("无法保存密码: {}", e),
+                    config: None,
+                });
+            }
+        }
     }
 
     let enabled_value: u32 = if auto_unlock_enabled { 1 } else { 0 };
@@ -100,6 +211,11 @@ fn save_config(username: String, password: String, auto_unlock_enabled: bool) ->
         });
     }
 
+    // 全部写入后再递增 Generation，正在运行的提供程序据此重新加载（见 ConfigWatch.h）；
+    // 递增失败只是不能即时生效，下次锁定时仍会读到新配置
+    let generation: u32 = config_key.get_value("Generation").unwrap_or(0);
+    let _ = config_key.set_value("Generation", &generation.wrapping_add(1));
+
     Ok(ConfigResponse {
         success: true,
         message: "配置保存成功".to_string(),
@@ -116,7 +232,19 @@ fn save_config(username: String, password: String, auto_unlock_enabled: bool) ->
 fn test_config() -> Result<String, String> {
     let config_result = get_config()?;
     if let Some(config) = config_result.config {
-        if config.username.is_empty() || config.password.is_empty() {
+        // 有效的 config.bin 排在来源链最前面：其中关闭了自动解锁时整条链停止，
+        // 有账户时只用其中的账户；没有账户或文件无效时才轮到注册表中的密码
+        let has_password = match read_binary_config() {
+            Some(binary) if !binary.auto_unlock_enabled => {
+                return Ok("自动解锁已关闭".to_string());
+            }
+            Some(binary) if !binary.usernames.is_empty() => binary
+                .usernames
+                .iter()
+                .any(|name| name.to_lowercase() == config.username.to_lowercase()),
+            _ => !config.password.is_empty(),
+        };
+        if config.username.is_empty() || !has_password {
             return Ok("配置不完整，请填写用户名和密码".to_string());
         }
         Ok("配置有效".to_string())
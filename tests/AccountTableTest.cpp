@@ -0,0 +1,198 @@
+#include "pch.h"
+#include "AccountTable.h"
+#include "Test.h"
+
+// AccountTable：按 SID 或用户名为键添加、重复键忽略、SID 解析失败的计数，
+// 以及读取完成时为以用户名为键的账户建立的 SID 映射（Find 本身不调用 LSA）
+
+static const WCHAR c_szAliceSid[] = L"S-1-5-21-1000-2000-3000-1001";
+static const WCHAR c_szBobSid[] = L"S-1-5-21-1000-2000-3000-1002";
+static const WCHAR c_szCarolSid[] = L"S-1-5-21-1000-2000-3000-1003";
+
+static bool PasswordEquals(const AccountTable& table, DWORD dwIndex, PCWSTR pszExpected)
+{
+    SecretString password;
+    return SUCCEEDED(table.UnsealPassword(dwIndex, &password)) && !wcscmp(password.Get(), pszExpected);
+}
+
+TEST(ResolvedAccountKeyedBySid)
+{
+    WinCompatClearAccounts();
+    WinCompatSetAccount(c_szAliceSid, L"HOST", L"alice");
+    LONG cUnresolved = AccountTable::GetUnresolvedAccounts();
+
+    AccountTable table;
+    CHECK_HR(table.AddAccount(L"alice", L"p1"), S_OK);
+    CHECK_EQ(table.GetCount(), 1u);
+    CHECK(!wcscmp(table.GetKey(0), c_szAliceSid));
+    CHECK(!wcscmp(table.GetUsername(0), L"alice"));
+    CHECK_EQ(AccountTable::GetUnresolvedAccounts(), cUnresolved);
+
+    DWORD dwIndex = 99;
+    CHECK_HR(table.Find(c_szAliceSid, &dwIndex), S_OK);
+    CHECK_EQ(dwIndex, 0u);
+    CHECK(PasswordEquals(table, dwIndex, L"p1"));
+
+    // 键是 SID，用户名本身不是键
+    CHECK_HR(table.Find(L"alice", &dwIndex), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    // 同一 SID 再次添加时忽略，先添加者优先
+    CHECK_HR(table.AddAccountWithSid(c_szAliceSid, L"HOST\\alice", L"p2"), S_FALSE);
+    CHECK_EQ(table.GetCount(), 1u);
+    CHECK(PasswordEquals(table, 0, L"p1"));
+    WinCompatClearAccounts();
+}
+
+TEST(UnresolvedAccountKeyedByUsernameAndCounted)
+{
+    WinCompatClearAccounts();
+    LONG cUnresolved = AccountTable::GetUnresolvedAccounts();
+
+    AccountTable table;
+    CHECK_HR(table.AddAccount(L"bob", L"p1"), S_OK);
+    CHECK_EQ(table.GetCount(), 1u);
+    CHECK(!wcscmp(table.GetKey(0), L"bob"));
+    CHECK(!wcscmp(table.GetUsername(0), L"bob"));
+    CHECK_EQ(AccountTable::GetUnresolvedAccounts(), cUnresolved + 1);
+
+    // 重复添加不再计数
+    CHECK_HR(table.AddAccount(L"bob", L"p2"), S_FALSE);
+    CHECK_EQ(AccountTable::GetUnresolvedAccounts(), cUnresolved + 1);
+
+    DWORD dwIndex = 99;
+    CHECK_HR(table.Find(L"bob", &dwIndex), S_OK);
+    CHECK(PasswordEquals(table, dwIndex, L"p1"));
+
+    // 读取完成时仍无法解析，按 SID 找不到
+    CHECK_HR(table.ResolveUsernameKeys(), S_OK);
+    CHECK_HR(table.Find(c_szBobSid, &dwIndex), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+    CHECK_HR(table.AddAccount(L"", L"p"), E_INVALIDARG);
+}
+
+TEST(UsernameKeysResolvedAfterLoad)
+{
+    WinCompatClearAccounts();
+
+    // 添加时账户都无法解析（例如域控制器不可达），只能以用户名为键
+    AccountTable table;
+    CHECK_HR(table.AddAccount(L"bob", L"pb"), S_OK);
+    CHECK_HR(table.AddAccount(L"CONTOSO\\carol", L"pc"), S_OK);
+    CHECK_HR(table.AddAccount(L".\\dave", L"pd"), S_OK);
+    CHECK_HR(table.AddAccount(L"OTHER\\erin", L"pe"), S_OK);
+    CHECK_EQ(table.GetCount(), 4u);
+
+    // 读取完成前账户变得可解析
+    WinCompatSetAccount(c_szBobSid, L"HOST", L"Bob");
+    WinCompatSetAccount(c_szCarolSid, L"contoso", L"carol");
+    WinCompatSetAccount(L"S-1-5-21-1000-2000-3000-1004", L"HOST", L"dave");
+    WinCompatSetAccount(L"S-1-5-21-1000-2000-3000-1005", L"CONTOSO", L"erin");
+
+    // 映射建立前 Find 不会自行查询 LSA
+    DWORD dwIndex = 99;
+    CHECK_HR(table.Find(c_szBobSid, &dwIndex), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    CHECK_HR(table.ResolveUsernameKeys(), S_OK);
+    CHECK_EQ(table.GetCount(), 4u);
+    CHECK_HR(table.Find(c_szBobSid, &dwIndex), S_OK);
+    CHECK(!wcscmp(table.GetUsername(dwIndex), L"bob"));
+    CHECK(PasswordEquals(table, dwIndex, L"pb"));
+
+    CHECK_HR(table.Find(c_szCarolSid, &dwIndex), S_OK);
+    CHECK(!wcscmp(table.GetUsername(dwIndex), L"CONTOSO\\carol"));
+
+    // "." 表示本机，与任意域名匹配
+    CHECK_HR(table.Find(L"S-1-5-21-1000-2000-3000-1004", &dwIndex), S_OK);
+    CHECK(!wcscmp(table.GetUsername(dwIndex), L".\\dave"));
+
+    // 同名但域不同的账户不是同一个人
+    CHECK_HR(table.Find(L"S-1-5-21-1000-2000-3000-1005", &dwIndex), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    // 其他 SID 不会找到这些用户名键
+    CHECK_HR(table.Find(c_szAliceSid, &dwIndex), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    // 映射只在读取完成时建立一次：之后 LSA 的变化不影响查找，用户名键照常可用
+    WinCompatClearAccounts();
+    CHECK_HR(table.ResolveUsernameKeys(), S_OK);
+    CHECK_HR(table.Find(c_szBobSid, &dwIndex), S_OK);
+    CHECK_HR(table.Find(L"bob", &dwIndex), S_OK);
+    CHECK(!wcscmp(table.GetUsername(dwIndex), L"bob"));
+}
+
+// 解析出的 SID 已是另一个账户的键时，先添加者优先
+TEST(ResolvedSidKeepsFirstAccount)
+{
+    WinCompatClearAccounts();
+    AccountTable table;
+    CHECK_HR(table.AddAccountWithSid(c_szAliceSid, L"alice", L"p1"), S_OK);
+    CHECK_HR(table.AddAccountWithSid(nullptr, L"HOST\\alice", L"p2"), S_OK);
+    WinCompatSetAccount(c_szAliceSid, L"HOST", L"alice");
+    CHECK_HR(table.ResolveUsernameKeys(), S_OK);
+
+    DWORD dwIndex = 99;
+    CHECK_HR(table.Find(c_szAliceSid, &dwIndex), S_OK);
+    CHECK_EQ(dwIndex, 0u);
+    CHECK(PasswordEquals(table, dwIndex, L"p1"));
+    WinCompatClearAccounts();
+}
+
+TEST(ManyAccountsStayFindable)
+{
+    WinCompatClearAccounts();
+    AccountTable table;
+    WCHAR szSid[64];
+    WCHAR szUsername[32];
+    for (DWORD i = 0; i < 200; i++)
+    {
+        StringCchPrintfW(szSid, ARRAYSIZE(szSid), L"S-1-5-21-1-2-3-%u", i);
+        StringCchPrintfW(szUsername, ARRAYSIZE(szUsername), L"user%u", i);
+        CHECK_HR(table.AddAccountWithSid((i % 2) ? szSid : nullptr, szUsername, szUsername), S_OK);
+    }
+    CHECK_EQ(table.GetCount(), 200u);
+    for (DWORD i = 0; i < 200; i++)
+    {
+        StringCchPrintfW(szSid, ARRAYSIZE(szSid), L"S-1-5-21-1-2-3-%u", i);
+        StringCchPrintfW(szUsername, ARRAYSIZE(szUsername), L"user%u", i);
+        DWORD dwIndex = 0;
+        CHECK_HR(table.Find((i % 2) ? szSid : szUsername, &dwIndex), S_OK);
+        CHECK_EQ(dwIndex, i);
+        CHECK(PasswordEquals(table, dwIndex, szUsername));
+    }
+}
+
+BENCH(AccountTableBench)
+{
+    WinCompatClearAccounts();
+    AccountTable table;
+    WCHAR szSid[64];
+    WCHAR szUsername[32];
+    for (DWORD i = 0; i < 64; i++)
+    {
+        StringCchPrintfW(szSid, ARRAYSIZE(szSid), L"S-1-5-21-1-2-3-%u", i);
+        StringCchPrintfW(szUsername, ARRAYSIZE(szUsername), L"user%u", i);
+        table.AddAccountWithSid(szSid, szUsername, L"password");
+    }
+    AccountTable unresolved;
+    unresolved.AddAccount(L"bob", L"password");
+    WinCompatSetAccount(c_szBobSid, L"HOST", L"bob");
+    unresolved.ResolveUsernameKeys();
+
+    volatile DWORD dwSink = 0;
+    BenchRun("Find（SID 命中）", 2000000, [&](DWORD i) {
+        DWORD dwIndex = 0;
+        table.Find((i & 1) ? L"S-1-5-21-1-2-3-17" : L"S-1-5-21-1-2-3-42", &dwIndex);
+        dwSink = dwSink + dwIndex;
+    });
+    BenchRun("Find（未命中，表中没有用户名键）", 2000000, [&](DWORD) {
+        DWORD dwIndex = 0;
+        table.Find(c_szAliceSid, &dwIndex);
+        dwSink = dwSink + dwIndex;
+    });
+    BenchRun("Find（SID 映射到用户名键）", 2000000, [&](DWORD) {
+        DWORD dwIndex = 0;
+        unresolved.Find(c_szBobSid, &dwIndex);
+        dwSink = dwSink + dwIndex;
+    });
+    WinCompatClearAccounts();
+}
+
+TEST_MAIN()
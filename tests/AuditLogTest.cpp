@@ -0,0 +1,443 @@
+#include "pch.h"
+#include "AuditLog.h"
+#include "ConfigFormat.h"
+#include "ConfigFile.h"
+#include "Test.h"
+
+// AuditLog：文件头与定长记录的格式、CRC 校验、写了一半的尾部记录被截掉、
+// 满文件、外来文件和不可信所有者文件的轮转、写入失败与队列满时的丢弃计数（兼容层的内存文件系统）
+
+static const WCHAR c_szAuditPath[] = L"C:\\ProgramData\\WinUnlock\\audit.log";
+static const WCHAR c_szAuditPath1[] = L"C:\\ProgramData\\WinUnlock\\audit.1.log";
+static const WCHAR c_szAuditPath2[] = L"C:\\ProgramData\\WinUnlock\\audit.2.log";
+
+#define STATUS_LOGON_FAILURE ((NTSTATUS)0xC000006DL)
+
+// QPC 频率下的毫秒数
+static LONGLONG MsToQpc(LONGLONG llMs)
+{
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    return llMs * liFrequency.QuadPart / 1000;
+}
+
+// 每个测试从空目录、空队列开始；AuditLogStart 每个进程只生效一次
+static void ResetAudit()
+{
+    AuditLogStart(c_szAuditPath);
+    AuditLogFlush();
+    WinCompatSetFileError(ERROR_SUCCESS);
+    WinCompatClearFiles();
+}
+
+static bool ReadWholeFile(PCWSTR pszPath, BYTE* pb, DWORD cbMax, DWORD* pcb)
+{
+    *pcb = 0;
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    bool fOk = ReadFile(hFile, pb, cbMax, pcb, nullptr) != FALSE;
+    CloseHandle(hFile);
+    return fOk;
+}
+
+static bool WriteWholeFile(PCWSTR pszPath, const void* pv, DWORD cb)
+{
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    DWORD cbWritten = 0;
+    bool fOk = WriteFile(hFile, pv, cb, &cbWritten, nullptr) && (cbWritten == cb);
+    CloseHandle(hFile);
+    return fOk;
+}
+
+static ULONGLONG GetFileSize(PCWSTR pszPath)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fad;
+    if (!GetFileAttributesExW(pszPath, GetFileExInfoStandard, &fad))
+    {
+        return MAXULONGLONG;
+    }
+    return ((ULONGLONG)fad.nFileSizeHigh << 32) | fad.nFileSizeLow;
+}
+
+// 读取日志文件的文件头和全部完整记录
+class AuditFile
+{
+public:
+    AuditFile() : _cb(0), _cRecords(0)
+    {
+    }
+
+    bool Read(PCWSTR pszPath)
+    {
+        if (!ReadWholeFile(pszPath, _rgb, sizeof(_rgb), &_cb) || (_cb < sizeof(AUDIT_FILE_HEADER)))
+        {
+            return false;
+        }
+        _cRecords = (_cb - sizeof(AUDIT_FILE_HEADER)) / sizeof(AUDIT_RECORD);
+        return true;
+    }
+
+    const AUDIT_FILE_HEADER* GetHeader() const { return (const AUDIT_FILE_HEADER*)_rgb; }
+    DWORD GetCount() const { return _cRecords; }
+    DWORD GetSize() const { return _cb; }
+    const AUDIT_RECORD* GetRecord(DWORD dwIndex) const
+    {
+        return (const AUDIT_RECORD*)(_rgb + sizeof(AUDIT_FILE_HEADER)) + dwIndex;
+    }
+
+private:
+    BYTE _rgb[sizeof(AUDIT_FILE_HEADER) + 12000 * sizeof(AUDIT_RECORD)];
+    DWORD _cb;
+    DWORD _cRecords;
+};
+
+static AuditFile s_file;
+
+TEST(StartsOnce)
+{
+    CHECK(SUCCEEDED(AuditLogStart(c_szAuditPath)));
+    CHECK_HR(AuditLogStart(c_szAuditPath), S_FALSE);
+    CHECK(g_fAuditEnabled);
+}
+
+TEST(WritesHeaderAndRecords)
+{
+    ResetAudit();
+    AUDIT_STATS before;
+    AuditLogGetStats(&before);
+
+    LONGLONG llCreated = MsToQpc(1000);
+    CHECK(AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"S-1-5-21-1-1001", 0, 0, llCreated, llCreated + MsToQpc(2), llCreated + MsToQpc(5)));
+    CHECK(AuditLogRecordResult(CPUS_LOGON, nullptr, STATUS_LOGON_FAILURE, 0, 0, 0, 0));
+    WCHAR szLong[100];
+    for (DWORD i = 0; i < ARRAYSIZE(szLong) - 1; i++)
+    {
+        szLong[i] = (WCHAR)(L'a' + i % 26);
+    }
+    szLong[ARRAYSIZE(szLong) - 1] = 0;
+    CHECK(AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, szLong, 0, 0, 0, 0, 0));
+    AuditLogFlush();
+
+    CHECK(s_file.Read(c_szAuditPath));
+    CHECK_EQ(s_file.GetHeader()->dwMagic, (DWORD)AUDIT_FILE_MAGIC);
+    CHECK_EQ(s_file.GetHeader()->wVersion, AUDIT_FILE_VERSION);
+    CHECK_EQ(s_file.GetHeader()->cbRecord, sizeof(AUDIT_RECORD));
+    CHECK(s_file.GetHeader()->ullCreated != 0);
+    CHECK_EQ(s_file.GetSize(), sizeof(AUDIT_FILE_HEADER) + 3 * sizeof(AUDIT_RECORD));
+    if (s_file.GetCount() != 3)
+    {
+        return;
+    }
+
+    const AUDIT_RECORD* pFirst = s_file.GetRecord(0);
+    CHECK(AuditRecordIsValid(pFirst));
+    CHECK_EQ(pFirst->wKind, AUDIT_KIND_RESULT);
+    CHECK_EQ(pFirst->wScenario, CPUS_UNLOCK_WORKSTATION);
+    CHECK_EQ(pFirst->dwSerializeUs, 2000u);
+    CHECK_EQ(pFirst->dwLogonUs, 3000u);
+    CHECK_EQ(pFirst->dwProcessId, GetCurrentProcessId());
+    CHECK(!wcscmp(pFirst->szAccount, L"S-1-5-21-1-1001"));
+
+    const AUDIT_RECORD* pSecond = s_file.GetRecord(1);
+    CHECK(AuditRecordIsValid(pSecond));
+    CHECK_EQ(pSecond->wScenario, CPUS_LOGON);
+    CHECK_EQ(pSecond->ntsStatus, STATUS_LOGON_FAILURE);
+    CHECK_EQ(pSecond->dwSerializeUs, 0u);
+    CHECK_EQ(pSecond->szAccount[0], 0);
+    CHECK_EQ(pSecond->ullSequence, pFirst->ullSequence + 1);
+
+    // 超长账户截断，结尾总是 NUL
+    const AUDIT_RECORD* pThird = s_file.GetRecord(2);
+    CHECK(AuditRecordIsValid(pThird));
+    CHECK_EQ(wcslen(pThird->szAccount), (size_t)(AUDIT_ACCOUNT_CCH - 1));
+    CHECK(!wcsncmp(pThird->szAccount, szLong, AUDIT_ACCOUNT_CCH - 1));
+
+    AUDIT_STATS after;
+    AuditLogGetStats(&after);
+    CHECK_EQ(after.cEnqueued - before.cEnqueued, 3);
+    CHECK_EQ(after.cWritten - before.cWritten, 3);
+    CHECK_EQ(after.cDropped - before.cDropped, 0);
+    CHECK(after.cBatches > before.cBatches);
+}
+
+TEST(RejectsCorruptRecords)
+{
+    // 读取方（auditdump）按标准 CRC-32 校验
+    CHECK_EQ(ConfigCrc32((const BYTE*)"123456789", 9), 0xCBF43926u);
+
+    ResetAudit();
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"alice", 0, 0, 0, 0, 0);
+    AuditLogFlush();
+    CHECK(s_file.Read(c_szAuditPath) && (s_file.GetCount() == 1));
+
+    AUDIT_RECORD record = *s_file.GetRecord(0);
+    CHECK(AuditRecordIsValid(&record));
+    record.szAccount[0] ^= 1;
+    CHECK(!AuditRecordIsValid(&record));
+    record.szAccount[0] ^= 1;
+    record.dwCrc32 ^= 0x80000000;
+    CHECK(!AuditRecordIsValid(&record));
+
+    // CRC 正确但类型未知
+    record.wKind = 7;
+    record.dwCrc32 = ConfigCrc32((const BYTE*)&record + sizeof(record.dwCrc32), sizeof(record) - sizeof(record.dwCrc32));
+    CHECK(!AuditRecordIsValid(&record));
+}
+
+TEST(TruncatesTornTail)
+{
+    ResetAudit();
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"alice", 0, 0, 0, 0, 0);
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"bob", 0, 0, 0, 0, 0);
+    AuditLogFlush();
+
+    // 模拟上次写到一半时断电：尾部多出不足一条的数据
+    HANDLE hFile = CreateFileW(c_szAuditPath, GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    CHECK(hFile != INVALID_HANDLE_VALUE);
+    LARGE_INTEGER liZero = { 0 };
+    BYTE rgbTorn[100];
+    FillMemory(rgbTorn, sizeof(rgbTorn), 0xCC);
+    DWORD cbWritten = 0;
+    SetFilePointerEx(hFile, liZero, nullptr, FILE_END);
+    WriteFile(hFile, rgbTorn, sizeof(rgbTorn), &cbWritten, nullptr);
+    CloseHandle(hFile);
+    CHECK_EQ(GetFileSize(c_szAuditPath), sizeof(AUDIT_FILE_HEADER) + 2 * sizeof(AUDIT_RECORD) + sizeof(rgbTorn));
+
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"carol", 0, 0, 0, 0, 0);
+    AuditLogFlush();
+    CHECK(s_file.Read(c_szAuditPath));
+    CHECK_EQ(s_file.GetSize(), sizeof(AUDIT_FILE_HEADER) + 3 * sizeof(AUDIT_RECORD));
+    for (DWORD i = 0; i < s_file.GetCount(); i++)
+    {
+        CHECK(AuditRecordIsValid(s_file.GetRecord(i)));
+    }
+    CHECK((s_file.GetCount() == 3) && !wcscmp(s_file.GetRecord(2)->szAccount, L"carol"));
+}
+
+TEST(RotatesForeignAndFullFiles)
+{
+    // 不是审计日志的文件被轮转走，而不是在其后追加
+    ResetAudit();
+    BYTE rgbForeign[64];
+    FillMemory(rgbForeign, sizeof(rgbForeign), 'x');
+    CHECK(WriteWholeFile(c_szAuditPath, rgbForeign, sizeof(rgbForeign)));
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"alice", 0, 0, 0, 0, 0);
+    AuditLogFlush();
+    CHECK_EQ(GetFileSize(c_szAuditPath1), sizeof(rgbForeign));
+    CHECK(s_file.Read(c_szAuditPath) && (s_file.GetCount() == 1));
+    CHECK_EQ(s_file.GetHeader()->dwMagic, (DWORD)AUDIT_FILE_MAGIC);
+
+    // 追加后超过上限：audit.log -> audit.1.log -> audit.2.log
+    ResetAudit();
+    const DWORD cbFull = AUDIT_FILE_MAX_SIZE - 100;
+    BYTE* pbFull = (BYTE*)CoTaskMemAlloc(cbFull);
+    CHECK(pbFull != nullptr);
+    if (!pbFull)
+    {
+        return;
+    }
+    ZeroMemory(pbFull, cbFull);
+    AUDIT_FILE_HEADER* pHeader = (AUDIT_FILE_HEADER*)pbFull;
+    pHeader->dwMagic = AUDIT_FILE_MAGIC;
+    pHeader->wVersion = AUDIT_FILE_VERSION;
+    pHeader->cbRecord = sizeof(AUDIT_RECORD);
+    CHECK(WriteWholeFile(c_szAuditPath, pbFull, cbFull));
+    CHECK(WriteWholeFile(c_szAuditPath1, rgbForeign, sizeof(rgbForeign)));
+    CoTaskMemFree(pbFull);
+
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"bob", 0, 0, 0, 0, 0);
+    AuditLogFlush();
+    CHECK_EQ(GetFileSize(c_szAuditPath2), sizeof(rgbForeign));
+    CHECK_EQ(GetFileSize(c_szAuditPath1), cbFull);
+    CHECK(s_file.Read(c_szAuditPath) && (s_file.GetCount() == 1));
+    CHECK(!wcscmp(s_file.GetRecord(0)->szAccount, L"bob"));
+}
+
+TEST(RotatesFilesNotOwnedByAdministrators)
+{
+    // 格式正确、但由普通用户创建的日志：不在其后追加，改名移走后新建
+    ResetAudit();
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"mallory", 0, 0, 0, 0, 0);
+    AuditLogFlush();
+    const ULONGLONG cbPlanted = GetFileSize(c_szAuditPath);
+    CHECK_EQ(cbPlanted, sizeof(AUDIT_FILE_HEADER) + sizeof(AUDIT_RECORD));
+    CHECK(WinCompatSetFileOwner(c_szAuditPath, L"S-1-5-21-1000-2000-3000-1001"));
+
+    AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"alice", 0, 0, 0, 0, 0);
+    AuditLogFlush();
+    CHECK_EQ(GetFileSize(c_szAuditPath1), cbPlanted);
+    CHECK(s_file.Read(c_szAuditPath) && (s_file.GetCount() == 1));
+    CHECK(!wcscmp(s_file.GetRecord(0)->szAccount, L"alice"));
+
+    HANDLE hFile = CreateFileW(c_szAuditPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    CHECK(hFile != INVALID_HANDLE_VALUE);
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CHECK_HR(ConfigCheckFileOwner(hFile), S_OK);
+        CloseHandle(hFile);
+    }
+}
+
+TEST(WriteFailureReportedAsDropped)
+{
+    ResetAudit();
+    AUDIT_STATS before;
+    AuditLogGetStats(&before);
+
+    // 磁盘故障期间的记录不重试，计入丢弃数
+    WinCompatSetFileError(ERROR_DISK_FULL);
+    for (DWORD i = 0; i < 5; i++)
+    {
+        CHECK(AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"alice", 0, 0, 0, 0, 0));
+    }
+    AuditLogFlush();
+    AUDIT_STATS during;
+    AuditLogGetStats(&during);
+    CHECK_EQ(during.cDropped - before.cDropped, 5);
+    CHECK_EQ(during.cWritten - before.cWritten, 0);
+    CHECK_EQ(GetFileSize(c_szAuditPath), MAXULONGLONG);
+
+    // 恢复后第一批先写一条丢弃记录
+    WinCompatSetFileError(ERROR_SUCCESS);
+    CHECK(AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"bob", 0, 0, 0, 0, 0));
+    AuditLogFlush();
+    CHECK(s_file.Read(c_szAuditPath) && (s_file.GetCount() == 2));
+    if (s_file.GetCount() == 2)
+    {
+        CHECK(AuditRecordIsValid(s_file.GetRecord(0)));
+        CHECK_EQ(s_file.GetRecord(0)->wKind, AUDIT_KIND_DROPPED);
+        CHECK_EQ(s_file.GetRecord(0)->cDropped, 5u);
+        CHECK_EQ(s_file.GetRecord(1)->wKind, AUDIT_KIND_RESULT);
+        CHECK(!wcscmp(s_file.GetRecord(1)->szAccount, L"bob"));
+    }
+
+    AUDIT_STATS after;
+    AuditLogGetStats(&after);
+    CHECK_EQ(after.cWritten - before.cWritten, 1);
+    CHECK_EQ(after.cDropped - before.cDropped, 5);
+}
+
+struct PRODUCER_CONTEXT
+{
+    DWORD cRecords;
+    DWORD cAccepted;
+    DWORD cRejected;
+};
+
+static DWORD WINAPI ProducerThread(LPVOID pv)
+{
+    PRODUCER_CONTEXT* pContext = (PRODUCER_CONTEXT*)pv;
+    for (DWORD i = 0; i < pContext->cRecords; i++)
+    {
+        if (AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"alice", 0, 0, 0, 0, 0))
+        {
+            pContext->cAccepted++;
+        }
+        else
+        {
+            pContext->cRejected++;
+        }
+    }
+    return 0;
+}
+
+TEST(ConcurrentProducersAccountForEveryRecord)
+{
+    ResetAudit();
+    AUDIT_STATS before;
+    AuditLogGetStats(&before);
+
+    // 生产者远快于写入方，队列会满；每条记录要么写入文件，要么计入丢弃记录
+    const DWORD cProducers = 4;
+    PRODUCER_CONTEXT rgContexts[cProducers];
+    HANDLE rghThreads[cProducers];
+    for (DWORD i = 0; i < cProducers; i++)
+    {
+        rgContexts[i] = { 2000, 0, 0 };
+        rghThreads[i] = CreateThread(nullptr, 0, ProducerThread, &rgContexts[i], 0, nullptr);
+    }
+    WaitForMultipleObjects(cProducers, rghThreads, TRUE, INFINITE);
+    DWORD cAccepted = 0;
+    DWORD cRejected = 0;
+    for (DWORD i = 0; i < cProducers; i++)
+    {
+        CloseHandle(rghThreads[i]);
+        cAccepted += rgContexts[i].cAccepted;
+        cRejected += rgContexts[i].cRejected;
+    }
+    AuditLogFlush();
+
+    CHECK(s_file.Read(c_szAuditPath));
+    DWORD cResults = 0;
+    DWORD cDropped = 0;
+    ULONGLONG ullLastSequence = 0;
+    bool fValid = true;
+    bool fOrdered = true;
+    for (DWORD i = 0; i < s_file.GetCount(); i++)
+    {
+        const AUDIT_RECORD* pRecord = s_file.GetRecord(i);
+        fValid = fValid && AuditRecordIsValid(pRecord);
+        if (pRecord->wKind == AUDIT_KIND_DROPPED)
+        {
+            cDropped += pRecord->cDropped;
+        }
+        else
+        {
+            cResults++;
+            // 按入队顺序写出
+            fOrdered = fOrdered && (pRecord->ullSequence > ullLastSequence);
+            ullLastSequence = pRecord->ullSequence;
+        }
+    }
+    CHECK(fValid);
+    CHECK(fOrdered);
+    CHECK_EQ(cResults, cAccepted);
+    CHECK_EQ(cDropped, cRejected);
+    CHECK_EQ(cAccepted + cRejected, cProducers * 2000);
+
+    AUDIT_STATS after;
+    AuditLogGetStats(&after);
+    CHECK_EQ(after.cEnqueued - before.cEnqueued, (LONG64)cAccepted);
+    CHECK_EQ(after.cWritten - before.cWritten, (LONG64)cAccepted);
+    CHECK_EQ(after.cDropped - before.cDropped, (LONG64)cRejected);
+}
+
+BENCH(AuditLogBench)
+{
+    ResetAudit();
+    volatile DWORD dwSink = 0;
+
+    // 每 AUDIT_QUEUE_SIZE / 2 条写出一次，队列不满，测的是入队本身
+    BenchRun("AuditLogRecordResult 入队", 200000, [&](DWORD i) {
+        dwSink = dwSink + AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"S-1-5-21-1-1001", 0, 0, 1, 2, 3);
+        if ((i % (AUDIT_QUEUE_SIZE / 2)) == 0)
+        {
+            AuditLogFlush();
+            WinCompatClearFiles();
+        }
+    });
+    BenchRun("入队 64 条并组提交一批", 5000, [&](DWORD i) {
+        for (DWORD j = 0; j < 64; j++)
+        {
+            AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"S-1-5-21-1-1001", 0, 0, 1, 2, 3);
+        }
+        AuditLogFlush();
+        if ((i % 256) == 0)
+        {
+            WinCompatClearFiles();
+        }
+    });
+    AUDIT_STATS stats;
+    AuditLogGetStats(&stats);
+    printf("已写入 %lld 条，%lld 批，丢弃 %lld 条\n", (long long)stats.cWritten, (long long)stats.cBatches, (long long)stats.cDropped);
+    ResetAudit();
+}
+
+TEST_MAIN()
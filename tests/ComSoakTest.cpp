@@ -0,0 +1,257 @@
+#include "pch.h"
+#include "CredentialProvider.h"
+#include "ObjectPool.h"
+#include "Test.h"
+
+// COM 对象反复创建：与 tools/comsoak.cpp 相同，反复执行
+// DllGetClassObject -> CreateInstance -> QueryInterface -> Release（可选 SetUsageScenario 并枚举磁贴），
+// 检查结束后提供程序和凭据全部释放、DllCanUnloadNow 返回 S_OK，且预热之后对象都从空闲链表取得；
+// 性能测试为每轮的耗时
+
+STDAPI DllGetClassObject(REFCLSID rclsid, REFIID riid, void** ppv);
+STDAPI DllCanUnloadNow();
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+static const WCHAR c_szUserSid[] = L"S-1-5-21-7-1001";
+static const WCHAR c_szUserName[] = L"alice";
+static const WCHAR c_szPassword[] = L"correct horse";
+
+// 预热轮数：首轮创建会初始化字符串表、配置快照等只分配一次的数据，不计入统计
+#define COMSOAK_WARMUP_CYCLES 16
+#define COMSOAK_CYCLES 2000
+#define COMSOAK_THREADS 4
+
+// 线程池上的预取可能在最后一次 Release 之后才结束，最多等待这么久引用计数归零
+static const DWORD c_dwQuiesceMs = 5000;
+
+struct SOAK_CONTEXT
+{
+    DWORD cCycles;
+    bool fScenario;
+    volatile LONG cFailed;
+    HRESULT hrFirstFailure;
+};
+
+// 注册表中配置单个账户，登录场景枚举出一个磁贴
+static void ConfigureAccount()
+{
+    WinCompatClearRegistry();
+    WinCompatClearFiles();
+    WinCompatClearAccounts();
+    WinCompatSetAccount(c_szUserSid, L"WINUNLOCK-TEST", c_szUserName);
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"CredentialSources", REG_MULTI_SZ, L"registry\0", sizeof(L"registry\0"));
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"Username", REG_SZ, c_szUserName, sizeof(c_szUserName));
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"Password", REG_SZ, c_szPassword, sizeof(c_szPassword));
+    WinCompatSetSessionUser(c_szUserSid);
+}
+
+static HRESULT RunCycle(const SOAK_CONTEXT* pContext)
+{
+    IClassFactory* pcf = nullptr;
+    HRESULT hr = DllGetClassObject(CLSID_WinUnlockProvider, IID_PPV_ARGS(&pcf));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ICredentialProvider* pcp = nullptr;
+    hr = pcf->CreateInstance(nullptr, IID_PPV_ARGS(&pcp));
+    if (SUCCEEDED(hr))
+    {
+        IUnknown* punk = nullptr;
+        hr = pcp->QueryInterface(IID_PPV_ARGS(&punk));
+        if (SUCCEEDED(hr))
+        {
+            punk->Release();
+        }
+
+        if (SUCCEEDED(hr) && pContext->fScenario)
+        {
+            hr = pcp->SetUsageScenario(CPUS_LOGON, 0);
+            if (SUCCEEDED(hr))
+            {
+                DWORD cCredentials = 0;
+                DWORD dwDefault = 0;
+                BOOL bAutoLogon = FALSE;
+                hr = pcp->GetCredentialCount(&cCredentials, &dwDefault, &bAutoLogon);
+                if (SUCCEEDED(hr) && !cCredentials)
+                {
+                    // 配置的账户应当呈现为一个磁贴，否则凭据对象的创建和释放没有被覆盖
+                    hr = E_FAIL;
+                }
+                for (DWORD i = 0; SUCCEEDED(hr) && (i < cCredentials); i++)
+                {
+                    ICredentialProviderCredential* pcpc = nullptr;
+                    hr = pcp->GetCredentialAt(i, &pcpc);
+                    if (SUCCEEDED(hr))
+                    {
+                        pcpc->Release();
+                    }
+                }
+            }
+        }
+        pcp->Release();
+    }
+    pcf->Release();
+    return hr;
+}
+
+static DWORD WINAPI SoakThread(LPVOID pvContext)
+{
+    SOAK_CONTEXT* pContext = (SOAK_CONTEXT*)pvContext;
+    for (DWORD i = 0; i < pContext->cCycles; i++)
+    {
+        HRESULT hr = RunCycle(pContext);
+        if (FAILED(hr) && (InterlockedIncrement(&pContext->cFailed) == 1))
+        {
+            pContext->hrFirstFailure = hr;
+        }
+    }
+    return 0;
+}
+
+// 等待 DLL 引用计数归零，返回最后一次 DllCanUnloadNow 的结果
+static HRESULT WaitForUnload()
+{
+    ULONGLONG ullDeadline = GetTickCount64() + c_dwQuiesceMs;
+    HRESULT hr = DllCanUnloadNow();
+    while ((hr != S_OK) && (GetTickCount64() < ullDeadline))
+    {
+        Sleep(1);
+        hr = DllCanUnloadNow();
+    }
+    return hr;
+}
+
+// 在 cThreads 个线程上共执行 cThreads * cCycles 轮，检查没有失败、对象全部释放，
+// 并且预热之后两个空闲链表的堆分配次数不超过 cMaxHeapAllocs
+static void Soak(bool fScenario, DWORD cThreads, DWORD cCycles, LONG cMaxHeapAllocs)
+{
+    ConfigureAccount();
+    SOAK_CONTEXT context = {};
+    context.fScenario = fScenario;
+    context.cCycles = COMSOAK_WARMUP_CYCLES;
+    SoakThread(&context);
+    CHECK_EQ(context.cFailed, 0);
+    CHECK_HR(WaitForUnload(), S_OK);
+
+    WINUNLOCK_OBJECT_STATS before;
+    CHECK_HR(WinUnlockGetObjectStats(&before), S_OK);
+
+    context.cCycles = cCycles;
+    HANDLE rghThreads[COMSOAK_THREADS];
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        rghThreads[i] = CreateThread(nullptr, 0, SoakThread, &context, 0, nullptr);
+        CHECK(rghThreads[i] != nullptr);
+    }
+    CHECK_EQ(WaitForMultipleObjects(cThreads, rghThreads, TRUE, INFINITE), (DWORD)WAIT_OBJECT_0);
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        CloseHandle(rghThreads[i]);
+    }
+    CHECK_EQ(context.cFailed, 0);
+    CHECK_HR(context.hrFirstFailure, S_OK);
+    CHECK_HR(WaitForUnload(), S_OK);
+
+    WINUNLOCK_OBJECT_STATS after;
+    CHECK_HR(WinUnlockGetObjectStats(&after), S_OK);
+    CHECK_EQ(after.cDllRefs, 0);
+    CHECK_EQ(after.providers.cLive, 0);
+    CHECK_EQ(after.credentials.cLive, 0);
+
+    // 每轮都创建了提供程序，场景轮次还创建了凭据
+    LONG cTotal = (LONG)(cThreads * cCycles);
+    LONG cProviders = (after.providers.cHeapAllocs - before.providers.cHeapAllocs) + (after.providers.cPoolHits - before.providers.cPoolHits);
+    LONG cCredentials = (after.credentials.cHeapAllocs - before.credentials.cHeapAllocs) + (after.credentials.cPoolHits - before.credentials.cPoolHits);
+    CHECK_EQ(cProviders, cTotal);
+    CHECK_EQ(cCredentials, fScenario ? cTotal : 0);
+    CHECK(after.providers.cHeapAllocs - before.providers.cHeapAllocs <= cMaxHeapAllocs);
+    CHECK(after.credentials.cHeapAllocs - before.credentials.cHeapAllocs <= cMaxHeapAllocs);
+}
+
+// 单线程时同一时刻只有一个提供程序，预热之后不再进入堆分配器
+TEST(CreateReleaseReusesPool)
+{
+    Soak(false, 1, COMSOAK_CYCLES, 0);
+}
+
+// 预取回调可能在 Release 之后才释放提供程序，同时存活的对象略多于一个，但仍在空闲链表容量之内
+TEST(ScenarioCyclesReleaseEverything)
+{
+    Soak(true, 1, COMSOAK_CYCLES, 4);
+}
+
+// 多个线程同时创建和释放：引用计数不泄漏，同时存活的对象超过空闲链表容量时才进入堆分配器
+TEST(ConcurrentCyclesReleaseEverything)
+{
+    Soak(false, COMSOAK_THREADS, COMSOAK_CYCLES / COMSOAK_THREADS, COMSOAK_CYCLES / 10);
+    Soak(true, COMSOAK_THREADS, COMSOAK_CYCLES / COMSOAK_THREADS, COMSOAK_CYCLES / 10);
+}
+
+// 提供程序释放后 LogonUI 仍持有的磁贴同样计入 DLL 引用计数
+TEST(HeldCredentialKeepsDllLoaded)
+{
+    ConfigureAccount();
+    CHECK_HR(WaitForUnload(), S_OK);
+    IClassFactory* pcf = nullptr;
+    CHECK_HR(DllGetClassObject(CLSID_WinUnlockProvider, IID_PPV_ARGS(&pcf)), S_OK);
+    if (!pcf)
+    {
+        return;
+    }
+    ICredentialProvider* pcp = nullptr;
+    CHECK_HR(pcf->CreateInstance(nullptr, IID_PPV_ARGS(&pcp)), S_OK);
+    pcf->Release();
+    if (!pcp)
+    {
+        return;
+    }
+
+    ICredentialProviderCredential* pcpc = nullptr;
+    DWORD cCredentials = 0;
+    DWORD dwDefault = 0;
+    BOOL bAutoLogon = FALSE;
+    CHECK_HR(pcp->SetUsageScenario(CPUS_LOGON, 0), S_OK);
+    CHECK_HR(pcp->GetCredentialCount(&cCredentials, &dwDefault, &bAutoLogon), S_OK);
+    CHECK_EQ(cCredentials, 1u);
+    CHECK_HR(pcp->GetCredentialAt(0, &pcpc), S_OK);
+    pcp->Release();
+
+    // 等待预取回调释放提供程序，之后只剩磁贴持有的引用
+    WINUNLOCK_OBJECT_STATS stats = {};
+    ULONGLONG ullDeadline = GetTickCount64() + c_dwQuiesceMs;
+    WinUnlockGetObjectStats(&stats);
+    while (stats.providers.cLive && (GetTickCount64() < ullDeadline))
+    {
+        Sleep(1);
+        WinUnlockGetObjectStats(&stats);
+    }
+    CHECK_EQ(stats.providers.cLive, 0);
+    CHECK_EQ(stats.credentials.cLive, 1);
+    CHECK_HR(DllCanUnloadNow(), S_FALSE);
+
+    if (pcpc)
+    {
+        pcpc->Release();
+    }
+    CHECK_HR(WaitForUnload(), S_OK);
+}
+
+BENCH(ComSoakBench)
+{
+    ConfigureAccount();
+    SOAK_CONTEXT context = {};
+    context.cCycles = COMSOAK_WARMUP_CYCLES;
+    SoakThread(&context);
+    BenchRun("创建 → QueryInterface → 释放", 200000, [&](DWORD) {
+        RunCycle(&context);
+    });
+    context.fScenario = true;
+    BenchRun("创建 → SetUsageScenario → 枚举磁贴 → 释放", 20000, [&](DWORD) {
+        RunCycle(&context);
+    });
+    WaitForUnload();
+}
+
+TEST_MAIN()
@@ -0,0 +1,339 @@
+#include "pch.h"
+#include "ConfigFormat.h"
+#include "Test.h"
+#include <stddef.h>
+
+// ConfigFormat：构建后逐项读回、截断和各区越界的拒绝（改写后重算 CRC，只靠结构校验发现）、
+// 超出文件上限的字段，以及 CRC 与 Attach 的吞吐量
+
+static const BYTE c_rgbSealed[] = { 0x01, 0x00, 0x00, 0x00, 0xd0, 0x8c, 0x9d, 0xdf, 0x01, 0x15, 0xd1, 0x11, 0x8c, 0x7a, 0x00, 0xc0 };
+
+// 附加到 CoTaskMemAlloc 分配的副本，满足 Attach 的对齐要求
+static HRESULT AttachCopy(const BYTE* pb, size_t cb, ConfigView* pView, BYTE** ppbCopy)
+{
+    *ppbCopy = (BYTE*)CoTaskMemAlloc(cb ? cb : 1);
+    if (!*ppbCopy)
+    {
+        return E_OUTOFMEMORY;
+    }
+    CopyMemory(*ppbCopy, pb, cb);
+    return pView->Attach(*ppbCopy, cb);
+}
+
+static HRESULT AttachCopy(const BYTE* pb, size_t cb)
+{
+    ConfigView view;
+    BYTE* pbCopy = nullptr;
+    HRESULT hr = AttachCopy(pb, cb, &view, &pbCopy);
+    CoTaskMemFree(pbCopy);
+    return hr;
+}
+
+// 修改后重算校验和，使 Attach 只能靠结构校验发现问题
+static void Reseal(BYTE* pb, DWORD cb)
+{
+    const size_t ibCrcStart = offsetof(CONFIG_FILE_HEADER, cbFile);
+    ((CONFIG_FILE_HEADER*)pb)->dwCrc32 = ConfigCrc32(pb + ibCrcStart, cb - ibCrcStart);
+}
+
+static HRESULT BuildSample(BYTE** ppb, DWORD* pcb)
+{
+    ConfigBuilder builder;
+    builder.SetFlags(CONFIG_FLAG_AUTO_UNLOCK_ENABLED);
+    builder.SetSerial(42);
+    HRESULT hr = builder.AddAccount(L"alice", L"S-1-5-21-1000-2000-3000-1001", c_rgbSealed, sizeof(c_rgbSealed));
+    if (SUCCEEDED(hr))
+    {
+        hr = builder.AddAccount(L"CONTOSO\\bob", nullptr, c_rgbSealed, 3);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = builder.SetDword(L"FetchDeadlineMs", 250);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = builder.SetString(L"Policy", L"deny user=guest");
+    }
+    return SUCCEEDED(hr) ? builder.Build(ppb, pcb) : hr;
+}
+
+TEST(Crc32KnownAnswer)
+{
+    const BYTE rgb[] = "123456789";
+    CHECK_EQ(ConfigCrc32(rgb, 9), 0xCBF43926u);
+    CHECK_EQ(ConfigCrc32(rgb, 0), 0u);
+
+    // 分段计算与一次计算相同（覆盖 8 字节展开和尾部两条路径）
+    CHECK_EQ(ConfigCrc32(rgb + 5, 4, ConfigCrc32(rgb, 5)), 0xCBF43926u);
+}
+
+TEST(RoundTrip)
+{
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    CHECK_HR(BuildSample(&pb, &cb), S_OK);
+    CHECK_EQ(((const CONFIG_FILE_HEADER*)pb)->ibBlobs % 4, 0u);
+
+    ConfigView view;
+    BYTE* pbCopy = nullptr;
+    CHECK_HR(AttachCopy(pb, cb, &view, &pbCopy), S_OK);
+    CHECK(view.IsAttached());
+    CHECK_EQ(view.GetFlags(), (DWORD)CONFIG_FLAG_AUTO_UNLOCK_ENABLED);
+    CHECK_EQ(view.GetSerial(), 42ull);
+    CHECK_EQ(view.GetAccountCount(), 2u);
+
+    CONFIG_ACCOUNT_VIEW account;
+    view.GetAccount(0, &account);
+    CHECK(!wcscmp(account.pszUsername, L"alice"));
+    CHECK(!wcscmp(account.pszSid, L"S-1-5-21-1000-2000-3000-1001"));
+    CHECK_EQ(account.cbSealed, (DWORD)sizeof(c_rgbSealed));
+    CHECK(!memcmp(account.pbSealed, c_rgbSealed, sizeof(c_rgbSealed)));
+
+    // 视图直接指向缓冲区；未配置的 SID 为空串
+    view.GetAccount(1, &account);
+    CHECK(!wcscmp(account.pszUsername, L"CONTOSO\\bob"));
+    CHECK(!account.pszSid[0]);
+    CHECK_EQ(account.cbSealed, 3u);
+    CHECK(account.pbSealed >= pbCopy);
+    CHECK(account.pbSealed + account.cbSealed <= pbCopy + cb);
+
+    DWORD dwValue = 0;
+    CHECK_HR(view.FindDword(L"fetchdeadlinems", &dwValue), S_OK);
+    CHECK_EQ(dwValue, 250u);
+    PCWSTR pszValue = nullptr;
+    CHECK_HR(view.FindString(L"Policy", &pszValue), S_OK);
+    CHECK(!wcscmp(pszValue, L"deny user=guest"));
+
+    // 按类型查找：同名的字符串值不是 DWORD
+    CHECK_HR(view.FindDword(L"Policy", &dwValue), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+    CHECK_HR(view.FindString(L"Missing", &pszValue), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    view.Detach();
+    CHECK(!view.IsAttached());
+    CoTaskMemFree(pbCopy);
+    CoTaskMemFree(pb);
+}
+
+TEST(BuilderReplacesValuesAndRejectsEmptyFields)
+{
+    ConfigBuilder builder;
+    CHECK_HR(builder.SetDword(L"Value", 1), S_OK);
+    CHECK_HR(builder.SetDword(L"VALUE", 2), S_OK);
+    CHECK_HR(builder.SetString(L"Text", L"first"), S_OK);
+    CHECK_HR(builder.SetString(L"text", L"second"), S_OK);
+    CHECK_HR(builder.SetDword(L"", 1), E_INVALIDARG);
+    CHECK_HR(builder.SetString(nullptr, L"x"), E_INVALIDARG);
+    CHECK_HR(builder.AddAccount(L"", nullptr, c_rgbSealed, 1), E_INVALIDARG);
+    CHECK_HR(builder.AddAccount(L"carol", nullptr, c_rgbSealed, 0), E_INVALIDARG);
+    CHECK_HR(builder.AddAccount(L"carol", nullptr, nullptr, 1), E_INVALIDARG);
+
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    CHECK_HR(builder.Build(&pb, &cb), S_OK);
+    ConfigView view;
+    BYTE* pbCopy = nullptr;
+    CHECK_HR(AttachCopy(pb, cb, &view, &pbCopy), S_OK);
+    CHECK_EQ(view.GetAccountCount(), 0u);
+    DWORD dwValue = 0;
+    CHECK_HR(view.FindDword(L"value", &dwValue), S_OK);
+    CHECK_EQ(dwValue, 2u);
+    PCWSTR pszValue = nullptr;
+    CHECK_HR(view.FindString(L"TEXT", &pszValue), S_OK);
+    CHECK(!wcscmp(pszValue, L"second"));
+    CoTaskMemFree(pbCopy);
+    CoTaskMemFree(pb);
+}
+
+// 写了一半的文件：任何截断都被拒绝，不会越界读取（ASan 下检查）
+TEST(TruncatedInputRejected)
+{
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    CHECK_HR(BuildSample(&pb, &cb), S_OK);
+    for (DWORD cbTruncated = 0; cbTruncated < cb; cbTruncated++)
+    {
+        CHECK_HR(AttachCopy(pb, cbTruncated), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    }
+
+    // 截断后连 cbFile 和校验和一起改写也不行：各区已超出文件
+    for (DWORD cbTruncated = sizeof(CONFIG_FILE_HEADER); cbTruncated < cb; cbTruncated += 4)
+    {
+        BYTE* pbCopy = (BYTE*)CoTaskMemAlloc(cbTruncated);
+        CopyMemory(pbCopy, pb, cbTruncated);
+        ((CONFIG_FILE_HEADER*)pbCopy)->cbFile = cbTruncated;
+        Reseal(pbCopy, cbTruncated);
+        ConfigView view;
+        CHECK_HR(view.Attach(pbCopy, cbTruncated), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        CHECK(!view.IsAttached());
+        CoTaskMemFree(pbCopy);
+    }
+    CoTaskMemFree(pb);
+}
+
+// 按偏移改写一个 DWORD 后重算校验和，应被拒绝
+static void CheckRejectedAfterPatch(const BYTE* pb, DWORD cb, size_t ib, DWORD dwValue)
+{
+    BYTE* pbCopy = (BYTE*)CoTaskMemAlloc(cb);
+    CopyMemory(pbCopy, pb, cb);
+    CopyMemory(pbCopy + ib, &dwValue, sizeof(dwValue));
+    Reseal(pbCopy, cb);
+    ConfigView view;
+    CHECK_HR(view.Attach(pbCopy, cb), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CoTaskMemFree(pbCopy);
+}
+
+TEST(MalformedInputRejected)
+{
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    CHECK_HR(BuildSample(&pb, &cb), S_OK);
+    const CONFIG_FILE_HEADER* pHeader = (const CONFIG_FILE_HEADER*)pb;
+    const size_t ibRecord0 = pHeader->ibRecords;
+    const size_t ibValueRecord = pHeader->ibRecords + 2 * sizeof(CONFIG_RECORD);
+
+    // 任一字节被改动都由校验和发现
+    for (DWORD ib = 0; ib < cb; ib++)
+    {
+        BYTE* pbCopy = (BYTE*)CoTaskMemAlloc(cb);
+        CopyMemory(pbCopy, pb, cb);
+        pbCopy[ib] ^= 0x20;
+        ConfigView view;
+        CHECK_HR(view.Attach(pbCopy, cb), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        CoTaskMemFree(pbCopy);
+    }
+
+    // 头部
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, dwMagic), 0x12345678);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, wVersion), CONFIG_FILE_VERSION + 1);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, wVersion), CONFIG_FILE_VERSION | (sizeof(CONFIG_FILE_HEADER) - 4) << 16);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, wVersion), CONFIG_FILE_VERSION | (sizeof(CONFIG_FILE_HEADER) + 2) << 16);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, cAccounts), pHeader->cRecords + 1);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, cRecords), 0x08000000);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, ibRecords), 4);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, ibRecords), pHeader->ibRecords + 2);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, ibStrings), pHeader->ibStrings + 2);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, cbStrings), pHeader->cbStrings + 1);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, cbStrings), 0xFFFFFFFE);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, ibBlobs), 0xFFFFFFF0);
+    CheckRejectedAfterPatch(pb, cb, offsetof(CONFIG_FILE_HEADER, cbBlobs), cb);
+
+    // 记录：类型与位置不符、名称为空、字符串越界或没有在 cch 处结束、密封数据为空或越界
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, wType), CRT_DWORD);
+    CheckRejectedAfterPatch(pb, cb, ibValueRecord + offsetof(CONFIG_RECORD, wType), CRT_ACCOUNT);
+    CheckRejectedAfterPatch(pb, cb, ibValueRecord + offsetof(CONFIG_RECORD, wType), 7);
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, cchName), 0);
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, cchName), 4);
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, ichName), pHeader->cbStrings / sizeof(WCHAR));
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, ichName), 0xFFFFFFFF);
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, cchValue), 0xFFFFFFFF);
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, cbBlob), 0);
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, cbBlob), pHeader->cbBlobs + 1);
+    CheckRejectedAfterPatch(pb, cb, ibRecord0 + offsetof(CONFIG_RECORD, ibBlob), 0xFFFFFFFF);
+
+    // 未对齐的缓冲区、超出上限的长度
+    BYTE* pbUnaligned = (BYTE*)CoTaskMemAlloc(cb + 8);
+    CopyMemory(pbUnaligned + 4, pb, cb);
+    ConfigView view;
+    CHECK_HR(view.Attach(pbUnaligned + 4, cb), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK_HR(view.Attach(nullptr, cb), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK_HR(view.Attach(pb, (size_t)CONFIG_FILE_MAX_SIZE + 8), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CoTaskMemFree(pbUnaligned);
+
+    // 原始内容仍然有效
+    CHECK_HR(AttachCopy(pb, cb), S_OK);
+    CoTaskMemFree(pb);
+}
+
+TEST(OversizedFieldsRejected)
+{
+    const DWORD cbLarge = CONFIG_FILE_MAX_SIZE;
+    BYTE* pbLarge = (BYTE*)CoTaskMemAlloc(cbLarge);
+    ZeroMemory(pbLarge, cbLarge);
+
+    // 单个密封数据达到文件上限
+    ConfigBuilder builder;
+    CHECK_HR(builder.AddAccount(L"alice", nullptr, pbLarge, cbLarge), HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE));
+
+    // 各字段单独未超限，合计超出时 Build 失败
+    CHECK_HR(builder.AddAccount(L"alice", nullptr, pbLarge, cbLarge - 64), S_OK);
+    CHECK_HR(builder.AddAccount(L"bob", nullptr, pbLarge, 128), HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE));
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    CHECK_HR(builder.Build(&pb, &cb), HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE));
+    CHECK(!pb);
+    CHECK_EQ(cb, 0u);
+
+    // 字符串达到文件上限
+    const size_t cchLarge = CONFIG_FILE_MAX_SIZE / sizeof(WCHAR);
+    PWSTR pszLarge = (PWSTR)CoTaskMemAlloc((cchLarge + 1) * sizeof(WCHAR));
+    for (size_t i = 0; i < cchLarge; i++)
+    {
+        pszLarge[i] = L'a';
+    }
+    pszLarge[cchLarge] = L'\0';
+    ConfigBuilder strings;
+    CHECK_HR(strings.SetString(L"Policy", pszLarge), HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE));
+    CHECK_HR(strings.SetDword(pszLarge, 1), HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE));
+    CHECK_HR(strings.AddAccount(pszLarge, nullptr, c_rgbSealed, 1), HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE));
+
+    // 失败不影响之后的添加
+    CHECK_HR(strings.SetString(L"Policy", L"allow"), S_OK);
+    CHECK_HR(strings.Build(&pb, &cb), S_OK);
+    CHECK_HR(AttachCopy(pb, cb), S_OK);
+    CoTaskMemFree(pb);
+    CoTaskMemFree(pszLarge);
+    CoTaskMemFree(pbLarge);
+}
+
+BENCH(ConfigFormatBench)
+{
+    ConfigBuilder builder;
+    builder.SetFlags(CONFIG_FLAG_AUTO_UNLOCK_ENABLED);
+    WCHAR szUsername[32];
+    WCHAR szSid[64];
+    for (DWORD i = 0; i < 100; i++)
+    {
+        StringCchPrintfW(szUsername, ARRAYSIZE(szUsername), L"CONTOSO\\user%u", i);
+        StringCchPrintfW(szSid, ARRAYSIZE(szSid), L"S-1-5-21-1000-2000-3000-%u", 1000 + i);
+        builder.AddAccount(szUsername, szSid, c_rgbSealed, sizeof(c_rgbSealed));
+    }
+    for (DWORD i = 0; i < 20; i++)
+    {
+        StringCchPrintfW(szUsername, ARRAYSIZE(szUsername), L"Setting%u", i);
+        builder.SetDword(szUsername, i);
+    }
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    builder.Build(&pb, &cb);
+
+    volatile DWORD dwSink = 0;
+    ConfigView view;
+    char szName[64];
+    snprintf(szName, sizeof(szName), "Attach（100 个账户，%u 字节）", cb);
+    double dblNs = BenchRun(szName, 20000, [&](DWORD) {
+        view.Attach(pb, cb);
+        dwSink = dwSink + view.GetAccountCount();
+    });
+    printf("  解析吞吐量 %.0f MB/s\n", cb / dblNs * 1e3);
+
+    DWORD dwValue = 0;
+    BenchRun("FindDword（最后一项）", 1000000, [&](DWORD) {
+        view.FindDword(L"Setting19", &dwValue);
+        dwSink = dwSink + dwValue;
+    });
+
+    const DWORD cbLarge = 1024 * 1024;
+    BYTE* pbLarge = (BYTE*)CoTaskMemAlloc(cbLarge);
+    for (DWORD i = 0; i < cbLarge; i++)
+    {
+        pbLarge[i] = (BYTE)(i * 131);
+    }
+    dblNs = BenchRun("ConfigCrc32（1 MB）", 200, [&](DWORD) {
+        dwSink = dwSink + ConfigCrc32(pbLarge, cbLarge);
+    });
+    printf("  CRC 吞吐量 %.0f MB/s\n", cbLarge / dblNs * 1e3);
+    CoTaskMemFree(pbLarge);
+    CoTaskMemFree(pb);
+}
+
+TEST_MAIN()
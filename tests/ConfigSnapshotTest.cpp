@@ -0,0 +1,337 @@
+#include "pch.h"
+#include "ConfigSnapshot.h"
+#include "ConfigWatch.h"
+#include "CredentialCache.h"
+#include "Test.h"
+
+// 配置快照：从注册表加载与 Generation 相同时不替换、读取作用域内被替换的快照不释放、
+// 带引用计数的快照在回收后仍可用，以及多个读取线程与不断发布（直接发布和经注册表重新加载）并发时
+// 读取方从未拿到已释放或不完整的快照、代数不回退、结束后旧快照全部回收；性能测试对比共享 SRW 锁的读取
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+
+// 快照内容都由代数推出，读取方据此检查拿到的快照是否完整（与 tools\configbench.cpp 相同）
+static DWORD ExpectedDeadline(DWORD dwGeneration)
+{
+    return CREDENTIAL_FETCH_DEADLINE_MIN_MS + dwGeneration % 1000;
+}
+
+static DWORD ExpectedRules(DWORD dwGeneration)
+{
+    return dwGeneration % 4;
+}
+
+// 从第 (3 - 规则数) 条开始取，得到 ExpectedRules 条 deny 规则
+static PCWSTR TestPolicy(DWORD dwGeneration, DWORD* pcbPolicy)
+{
+    static const WCHAR c_szzPolicy[] = L"deny account a\0deny account b\0deny account c\0default allow\0";
+    PCWSTR pszzPolicy = c_szzPolicy;
+    for (DWORD i = ExpectedRules(dwGeneration); i < 3; i++)
+    {
+        pszzPolicy += wcslen(pszzPolicy) + 1;
+    }
+    *pcbPolicy = (DWORD)((BYTE*)(c_szzPolicy + ARRAYSIZE(c_szzPolicy)) - (BYTE*)pszzPolicy);
+    return pszzPolicy;
+}
+
+static ConfigSnapshot* CreateTestSnapshot(DWORD dwGeneration)
+{
+    DWORD cbPolicy = 0;
+    ConfigSnapshot* pSnapshot = nullptr;
+    CHECK_HR(ConfigSnapshot::Create(dwGeneration, ExpectedDeadline(dwGeneration), TestPolicy(dwGeneration, &cbPolicy), &pSnapshot), S_OK);
+    return pSnapshot;
+}
+
+// 与 CreateTestSnapshot 内容相同的注册表配置，供 ConfigSnapshotReload 读取
+static void WriteTestConfig(DWORD dwGeneration)
+{
+    DWORD dwDeadline = ExpectedDeadline(dwGeneration);
+    DWORD cbPolicy = 0;
+    PCWSTR pszzPolicy = TestPolicy(dwGeneration, &cbPolicy);
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"FetchDeadlineMs", REG_DWORD, &dwDeadline, sizeof(dwDeadline));
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"UnlockPolicy", REG_MULTI_SZ, pszzPolicy, cbPolicy);
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, CONFIG_GENERATION_VALUE, REG_DWORD, &dwGeneration, sizeof(dwGeneration));
+}
+
+// 快照未释放、内容与代数相符且代数不小于上一次读到的
+static bool CheckSnapshot(const ConfigSnapshot* pSnapshot, DWORD* pdwLastGeneration)
+{
+    if (!pSnapshot || !pSnapshot->IsAlive())
+    {
+        return false;
+    }
+    DWORD dwGeneration = pSnapshot->GetGeneration();
+    bool fValid = (pSnapshot->GetFetchDeadline() == ExpectedDeadline(dwGeneration)) &&
+        (pSnapshot->GetPolicy().GetRuleCount() == ExpectedRules(dwGeneration)) &&
+        (dwGeneration >= *pdwLastGeneration);
+    *pdwLastGeneration = dwGeneration;
+    return fValid;
+}
+
+static DWORD CurrentGeneration()
+{
+    ConfigReadScope scope;
+    const ConfigSnapshot* pSnapshot = scope.Get();
+    return pSnapshot ? pSnapshot->GetGeneration() : (DWORD)-1;
+}
+
+TEST(LoadFromRegistry)
+{
+    ConfigSnapshotCleanup();
+    WinCompatClearRegistry();
+
+    // 未配置：默认期限、无策略；首次读取时加载
+    {
+        ConfigReadScope scope;
+        const ConfigSnapshot* pSnapshot = scope.Get();
+        CHECK(pSnapshot != nullptr);
+        CHECK_EQ(pSnapshot->GetGeneration(), 0u);
+        CHECK_EQ(pSnapshot->GetFetchDeadline(), (DWORD)CREDENTIAL_PREFETCH_WAIT_MS);
+        CHECK_EQ(pSnapshot->GetPolicy().GetRuleCount(), 0u);
+        CHECK(scope.Get() == pSnapshot);
+    }
+
+    WriteTestConfig(6);
+    CHECK_HR(ConfigSnapshotReload(), S_OK);
+    DWORD dwLastGeneration = 0;
+    ConfigSnapshot* pSnapshot = ConfigSnapshotAcquire();
+    CHECK(CheckSnapshot(pSnapshot, &dwLastGeneration));
+    CHECK_EQ(dwLastGeneration, 6u);
+
+    // Generation 未变：其他值变了也不替换，除非强制
+    DWORD dwDeadline = CREDENTIAL_FETCH_DEADLINE_MAX_MS + 1;
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"FetchDeadlineMs", REG_DWORD, &dwDeadline, sizeof(dwDeadline));
+    CHECK_HR(ConfigSnapshotReload(), S_FALSE);
+    {
+        ConfigReadScope scope;
+        CHECK(scope.Get() == pSnapshot);
+    }
+    CHECK_HR(ConfigSnapshotReload(true), S_OK);
+    {
+        // 超出范围的期限使用默认值
+        ConfigReadScope scope;
+        CHECK(scope.Get() != pSnapshot);
+        CHECK_EQ(scope.Get()->GetFetchDeadline(), (DWORD)CREDENTIAL_PREFETCH_WAIT_MS);
+        CHECK_EQ(scope.Get()->GetPolicy().GetRuleCount(), ExpectedRules(6));
+    }
+    pSnapshot->Release();
+
+    ConfigSnapshotCleanup();
+    WinCompatClearRegistry();
+}
+
+// 作用域内拿到的快照在被替换后仍然有效，最后一个更早纪元的作用域离开时回收
+TEST(ScopeKeepsReplacedSnapshot)
+{
+    ConfigSnapshotPublish(CreateTestSnapshot(1));
+    CONFIG_SNAPSHOT_STATS before;
+    ConfigSnapshotGetStats(&before);
+    {
+        ConfigReadScope scopeOld;
+        const ConfigSnapshot* pOld = scopeOld.Get();
+        ConfigSnapshotPublish(CreateTestSnapshot(2));
+
+        CONFIG_SNAPSHOT_STATS stats;
+        ConfigSnapshotGetStats(&stats);
+        CHECK_EQ(stats.llEpoch, before.llEpoch + 1);
+        CHECK_EQ(stats.cRetired, 1u);
+        CHECK_EQ(stats.cReclaimed, before.cReclaimed);
+        {
+            // 新作用域看到新快照；它离开时旧快照仍被 scopeOld 使用
+            ConfigReadScope scopeNew;
+            CHECK_EQ(scopeNew.Get()->GetGeneration(), 2u);
+        }
+        ConfigSnapshotGetStats(&stats);
+        CHECK_EQ(stats.cRetired, 1u);
+        DWORD dwLastGeneration = 0;
+        CHECK(CheckSnapshot(pOld, &dwLastGeneration));
+        CHECK_EQ(dwLastGeneration, 1u);
+    }
+    CONFIG_SNAPSHOT_STATS after;
+    ConfigSnapshotGetStats(&after);
+    CHECK_EQ(after.cRetired, 0u);
+    CHECK_EQ(after.cReclaimed, before.cReclaimed + 1);
+    CHECK_EQ(after.cPublished, before.cPublished + 1);
+    ConfigSnapshotCleanup();
+}
+
+// ConfigSnapshotAcquire 的引用在快照被回收后仍然有效
+TEST(AcquiredSnapshotOutlivesReclaim)
+{
+    ConfigSnapshotPublish(CreateTestSnapshot(3));
+    ConfigSnapshot* pSnapshot = ConfigSnapshotAcquire();
+    CONFIG_SNAPSHOT_STATS before;
+    ConfigSnapshotGetStats(&before);
+    ConfigSnapshotPublish(CreateTestSnapshot(4));
+
+    CONFIG_SNAPSHOT_STATS after;
+    ConfigSnapshotGetStats(&after);
+    CHECK_EQ(after.cReclaimed, before.cReclaimed + 1);
+    CHECK_EQ(after.cRetired, 0u);
+    DWORD dwLastGeneration = 0;
+    CHECK(CheckSnapshot(pSnapshot, &dwLastGeneration));
+    CHECK_EQ(dwLastGeneration, 3u);
+    CHECK_EQ(CurrentGeneration(), 4u);
+    pSnapshot->Release();
+    ConfigSnapshotCleanup();
+}
+
+struct STRESS_SHARED
+{
+    volatile LONG fStop;
+    DWORD cPublished;
+};
+
+struct STRESS_READER
+{
+    STRESS_SHARED* pShared;
+    LONG64 cReads;
+    LONG64 cErrors;
+};
+
+// 每 64 次读取中有一次改用带引用计数的 ConfigSnapshotAcquire
+static DWORD WINAPI StressReaderThread(PVOID pvContext)
+{
+    STRESS_READER* pReader = (STRESS_READER*)pvContext;
+    DWORD dwLastGeneration = 0;
+    while (!ReadAcquire(&pReader->pShared->fStop))
+    {
+        for (DWORD i = 0; i < 64; i++)
+        {
+            bool fValid;
+            if (i)
+            {
+                ConfigReadScope scope;
+                fValid = CheckSnapshot(scope.Get(), &dwLastGeneration);
+            }
+            else
+            {
+                ConfigSnapshot* pSnapshot = ConfigSnapshotAcquire();
+                fValid = CheckSnapshot(pSnapshot, &dwLastGeneration);
+                if (pSnapshot)
+                {
+                    pSnapshot->Release();
+                }
+            }
+            if (!fValid)
+            {
+                pReader->cErrors++;
+            }
+        }
+        pReader->cReads += 64;
+    }
+    return 0;
+}
+
+// 不间断发布；每 8 代中有一代写入注册表后经 ConfigSnapshotReload 加载
+static DWORD WINAPI StressPublisherThread(PVOID pvContext)
+{
+    STRESS_SHARED* pShared = (STRESS_SHARED*)pvContext;
+    DWORD dwGeneration = 1;
+    while (!ReadAcquire(&pShared->fStop))
+    {
+        dwGeneration++;
+        if (dwGeneration % 8)
+        {
+            DWORD cbPolicy = 0;
+            ConfigSnapshot* pSnapshot = nullptr;
+            if (SUCCEEDED(ConfigSnapshot::Create(dwGeneration, ExpectedDeadline(dwGeneration), TestPolicy(dwGeneration, &cbPolicy), &pSnapshot)))
+            {
+                ConfigSnapshotPublish(pSnapshot);
+                pShared->cPublished++;
+            }
+        }
+        else
+        {
+            WriteTestConfig(dwGeneration);
+            if (ConfigSnapshotReload() == S_OK)
+            {
+                pShared->cPublished++;
+            }
+        }
+    }
+    return 0;
+}
+
+// 读取线程与发布线程并发约 1 秒（ASan 下检查释放后读取，TSan 下检查同步）
+TEST(ConcurrentReadersAndReloads)
+{
+    WinCompatClearRegistry();
+    ConfigSnapshotPublish(CreateTestSnapshot(1));
+    CONFIG_SNAPSHOT_STATS before;
+    ConfigSnapshotGetStats(&before);
+
+    const DWORD cReaders = 4;
+    STRESS_SHARED shared = {};
+    STRESS_READER rgReaders[cReaders] = {};
+    HANDLE rghThreads[cReaders + 1];
+    for (DWORD i = 0; i < cReaders; i++)
+    {
+        rgReaders[i].pShared = &shared;
+        rghThreads[i] = CreateThread(nullptr, 0, StressReaderThread, &rgReaders[i], 0, nullptr);
+    }
+    rghThreads[cReaders] = CreateThread(nullptr, 0, StressPublisherThread, &shared, 0, nullptr);
+
+    Sleep(1000);
+    InterlockedExchange(&shared.fStop, TRUE);
+    WaitForMultipleObjects(ARRAYSIZE(rghThreads), rghThreads, TRUE, INFINITE);
+    LONG64 cReads = 0;
+    LONG64 cErrors = 0;
+    for (DWORD i = 0; i < ARRAYSIZE(rghThreads); i++)
+    {
+        CloseHandle(rghThreads[i]);
+    }
+    for (const STRESS_READER& reader : rgReaders)
+    {
+        cReads += reader.cReads;
+        cErrors += reader.cErrors;
+    }
+    CHECK_EQ(cErrors, 0);
+    CHECK(cReads > 0);
+    CHECK(shared.cPublished > 8);
+
+    // 没有读取方时再发布一次：之前替换下来的快照全部回收
+    ConfigSnapshotPublish(CreateTestSnapshot(0x7fffffff));
+    CONFIG_SNAPSHOT_STATS after;
+    ConfigSnapshotGetStats(&after);
+    CHECK_EQ(after.cPublished - before.cPublished, (LONG64)shared.cPublished + 1);
+    CHECK_EQ(after.cReclaimed - before.cReclaimed, (LONG64)shared.cPublished + 1);
+    CHECK_EQ(after.cRetired, 0u);
+    CHECK_EQ(CurrentGeneration(), 0x7fffffffu);
+
+    ConfigSnapshotCleanup();
+    WinCompatClearRegistry();
+}
+
+BENCH(ConfigSnapshotBench)
+{
+    ConfigSnapshotPublish(CreateTestSnapshot(1));
+    volatile DWORD dwSink = 0;
+    BenchRun("ConfigReadScope + Get", 10000000, [&](DWORD) {
+        ConfigReadScope scope;
+        dwSink += scope.Get()->GetFetchDeadline();
+    });
+    BenchRun("ConfigSnapshotAcquire + Release", 10000000, [&](DWORD) {
+        ConfigSnapshot* pSnapshot = ConfigSnapshotAcquire();
+        dwSink += pSnapshot->GetFetchDeadline();
+        pSnapshot->Release();
+    });
+
+    // 对照：共享 SRW 锁保护指针
+    SRWLOCK lock = SRWLOCK_INIT;
+    ConfigSnapshot* pLocked = CreateTestSnapshot(1);
+    BenchRun("共享 SRW 锁 + 读取指针（对照）", 10000000, [&](DWORD) {
+        AcquireSRWLockShared(&lock);
+        dwSink += pLocked->GetFetchDeadline();
+        ReleaseSRWLockShared(&lock);
+    });
+    pLocked->Release();
+
+    DWORD dwGeneration = 2;
+    BenchRun("ConfigSnapshotPublish（含编译策略）", 200000, [&](DWORD) {
+        ConfigSnapshotPublish(CreateTestSnapshot(dwGeneration++));
+    });
+    ConfigSnapshotCleanup();
+}
+
+TEST_MAIN()
@@ -0,0 +1,201 @@
+#include "pch.h"
+#include "ConfigWatch.h"
+#include "Test.h"
+
+// 配置变更通知：配置键不存在时不监听、只有 Generation 变化才回调、防抖期内的连续保存合并为一次
+// 尾沿回调、防抖为 0 时每次保存都回调、Stop 之后不再回调且可以重新开始；
+// 性能测试为防抖为 0 时从保存到回调的延迟
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+
+// 回调时间按防抖期判断，留出线程切换的余量
+static const DWORD c_dwDebounceMs = 100;
+static const DWORD c_dwSlackMs = 400;
+
+struct WATCH_CONTEXT
+{
+    HANDLE hChanged;
+    volatile LONG cCalls;
+    volatile LONG lGeneration;
+    volatile LONG64 llCalledAt;
+};
+
+static void CALLBACK OnConfigChanged(void* pvContext, DWORD dwGeneration)
+{
+    WATCH_CONTEXT* pContext = static_cast<WATCH_CONTEXT*>(pvContext);
+    InterlockedExchange64(&pContext->llCalledAt, (LONG64)GetTickCount64());
+    InterlockedExchange(&pContext->lGeneration, (LONG)dwGeneration);
+    InterlockedIncrement(&pContext->cCalls);
+    SetEvent(pContext->hChanged);
+}
+
+static void InitContext(WATCH_CONTEXT* pContext)
+{
+    pContext->hChanged = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    pContext->cCalls = 0;
+    pContext->lGeneration = 0;
+    pContext->llCalledAt = 0;
+}
+
+// 与配置工具相同：最后写入 Generation
+static void SaveGeneration(DWORD dwGeneration)
+{
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, CONFIG_GENERATION_VALUE, REG_DWORD, &dwGeneration, sizeof(dwGeneration));
+}
+
+TEST(MissingKeyIsNotWatched)
+{
+    WinCompatClearRegistry();
+    WATCH_CONTEXT context;
+    InitContext(&context);
+    ConfigWatcher watcher;
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, c_dwDebounceMs), S_FALSE);
+    CHECK_EQ(watcher.GetGeneration(), 0u);
+    SaveGeneration(1);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs * 2), (DWORD)WAIT_TIMEOUT);
+    CHECK_EQ(context.cCalls, 0);
+    CloseHandle(context.hChanged);
+}
+
+TEST(SaveNotifiesAfterDebounce)
+{
+    WinCompatClearRegistry();
+    SaveGeneration(7);
+    WATCH_CONTEXT context;
+    InitContext(&context);
+    ConfigWatcher watcher;
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, c_dwDebounceMs), S_OK);
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, c_dwDebounceMs), S_FALSE);
+    CHECK_EQ(watcher.GetGeneration(), 7u);
+
+    ULONGLONG ullSaved = GetTickCount64();
+    SaveGeneration(8);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs + c_dwSlackMs), (DWORD)WAIT_OBJECT_0);
+    CHECK_EQ(context.cCalls, 1);
+    CHECK_EQ(context.lGeneration, 8);
+    CHECK((ULONGLONG)context.llCalledAt - ullSaved >= c_dwDebounceMs);
+    CHECK_EQ(watcher.GetGeneration(), 8u);
+
+    // 回调之后仍在监听
+    SaveGeneration(9);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs + c_dwSlackMs), (DWORD)WAIT_OBJECT_0);
+    CHECK_EQ(context.cCalls, 2);
+    CHECK_EQ(context.lGeneration, 9);
+    watcher.Stop();
+    CloseHandle(context.hChanged);
+}
+
+// 保存中途写入的其他值和 Generation 未变的重写都不算一次保存
+TEST(OnlyGenerationChangesCount)
+{
+    WinCompatClearRegistry();
+    SaveGeneration(3);
+    WATCH_CONTEXT context;
+    InitContext(&context);
+    ConfigWatcher watcher;
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, c_dwDebounceMs), S_OK);
+
+    DWORD dwDeadline = 2000;
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"FetchDeadlineMs", REG_DWORD, &dwDeadline, sizeof(dwDeadline));
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"UnlockPolicy", REG_MULTI_SZ, L"default allow\0", sizeof(L"default allow\0"));
+    SaveGeneration(3);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs * 3), (DWORD)WAIT_TIMEOUT);
+    CHECK_EQ(context.cCalls, 0);
+    CHECK_EQ(watcher.GetGeneration(), 3u);
+
+    // 之前的写入没有让监听失效
+    SaveGeneration(4);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs + c_dwSlackMs), (DWORD)WAIT_OBJECT_0);
+    CHECK_EQ(context.lGeneration, 4);
+    watcher.Stop();
+    CloseHandle(context.hChanged);
+}
+
+// 间隔小于防抖期的连续保存只回调一次，以最后一次保存的 Generation、在最后一次保存之后一个防抖期回调
+TEST(BurstIsCoalesced)
+{
+    WinCompatClearRegistry();
+    SaveGeneration(10);
+    WATCH_CONTEXT context;
+    InitContext(&context);
+    ConfigWatcher watcher;
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, c_dwDebounceMs), S_OK);
+
+    ULONGLONG ullLastSave = 0;
+    for (DWORD dwGeneration = 11; dwGeneration <= 15; dwGeneration++)
+    {
+        ullLastSave = GetTickCount64();
+        SaveGeneration(dwGeneration);
+        Sleep(c_dwDebounceMs / 4);
+    }
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs + c_dwSlackMs), (DWORD)WAIT_OBJECT_0);
+    CHECK_EQ(context.lGeneration, 15);
+    CHECK((ULONGLONG)context.llCalledAt - ullLastSave >= c_dwDebounceMs);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs * 2), (DWORD)WAIT_TIMEOUT);
+    CHECK_EQ(context.cCalls, 1);
+    watcher.Stop();
+    CloseHandle(context.hChanged);
+}
+
+TEST(ZeroDebounceNotifiesEverySave)
+{
+    WinCompatClearRegistry();
+    SaveGeneration(20);
+    WATCH_CONTEXT context;
+    InitContext(&context);
+    ConfigWatcher watcher;
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, 0), S_OK);
+    for (DWORD dwGeneration = 21; dwGeneration <= 25; dwGeneration++)
+    {
+        SaveGeneration(dwGeneration);
+        CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwSlackMs), (DWORD)WAIT_OBJECT_0);
+        CHECK_EQ(context.lGeneration, (LONG)dwGeneration);
+    }
+    CHECK_EQ(context.cCalls, 5);
+    watcher.Stop();
+    CloseHandle(context.hChanged);
+}
+
+// 防抖期内 Stop：返回后不再回调；重新 Start 以当时的 Generation 为起点
+TEST(StopCancelsPendingNotification)
+{
+    WinCompatClearRegistry();
+    SaveGeneration(30);
+    WATCH_CONTEXT context;
+    InitContext(&context);
+    ConfigWatcher watcher;
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, c_dwDebounceMs), S_OK);
+    SaveGeneration(31);
+    Sleep(c_dwDebounceMs / 4);
+    watcher.Stop();
+    SaveGeneration(32);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs * 3), (DWORD)WAIT_TIMEOUT);
+    CHECK_EQ(context.cCalls, 0);
+
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, c_dwDebounceMs), S_OK);
+    CHECK_EQ(watcher.GetGeneration(), 32u);
+    SaveGeneration(33);
+    CHECK_EQ(WaitForSingleObject(context.hChanged, c_dwDebounceMs + c_dwSlackMs), (DWORD)WAIT_OBJECT_0);
+    CHECK_EQ(context.cCalls, 1);
+    CHECK_EQ(context.lGeneration, 33);
+    CloseHandle(context.hChanged);
+}
+
+BENCH(ConfigWatchBench)
+{
+    WinCompatClearRegistry();
+    SaveGeneration(1);
+    WATCH_CONTEXT context;
+    InitContext(&context);
+    ConfigWatcher watcher;
+    CHECK_HR(watcher.Start(OnConfigChanged, &context, 0), S_OK);
+    DWORD dwGeneration = 2;
+    BenchRun("保存 → 回调（防抖 0）", 2000, [&](DWORD) {
+        SaveGeneration(dwGeneration++);
+        WaitForSingleObject(context.hChanged, INFINITE);
+    });
+    watcher.Stop();
+    CloseHandle(context.hChanged);
+}
+
+TEST_MAIN()
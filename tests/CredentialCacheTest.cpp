@@ -0,0 +1,330 @@
+#include "pch.h"
+#include "CredentialCache.h"
+#include "ResultCache.h"
+#include "Test.h"
+
+// CredentialCache：只在来源报告变化、Invalidate 或场景切换时重新读取，每次重新读取代数加一
+
+// 可控的凭据来源：账户和“已变化”标志由测试设置，记录读取次数和读取时的场景
+class FakeCredentialSource : public ICredentialSource
+{
+public:
+    FakeCredentialSource() : _cLoads(0), _fChanged(FALSE), _cpusLoaded(CPUS_INVALID), _hrLoad(S_OK), _pszPassword(L"pw1"), _hGate(nullptr)
+    {
+    }
+
+    PCWSTR GetName() override { return L"fake"; }
+
+    HRESULT LoadAccounts(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override
+    {
+        if (_hGate)
+        {
+            // 模拟慢来源：测试打开闸门前一直阻塞在线程池线程上
+            WaitForSingleObject(_hGate, INFINITE);
+        }
+        InterlockedIncrement(&_cLoads);
+        InterlockedExchange(&_fChanged, FALSE);
+        _cpusLoaded = cpus;
+        if (FAILED(_hrLoad))
+        {
+            return _hrLoad;
+        }
+        HRESULT hr = pTable->AddAccountWithSid(L"S-1-5-21-1-1001", L"alice", _pszPassword);
+        if (SUCCEEDED(hr) && (cpus == CPUS_LOGON))
+        {
+            // 登录场景多一个账户，便于区分快照属于哪个场景
+            hr = pTable->AddAccountWithSid(L"S-1-5-21-1-1002", L"bob", L"pw2");
+        }
+        return hr;
+    }
+
+    bool HasChanged() override { return ReadAcquire(&_fChanged) != FALSE; }
+
+    void GetLatency(CREDENTIAL_SOURCE_LATENCY* pLatency) override { ZeroMemory(pLatency, sizeof(*pLatency)); }
+
+    void MarkChanged() { InterlockedExchange(&_fChanged, TRUE); }
+
+    volatile LONG _cLoads;
+    volatile LONG _fChanged;
+    CREDENTIAL_PROVIDER_USAGE_SCENARIO _cpusLoaded;
+    HRESULT _hrLoad;
+    PCWSTR _pszPassword;
+    HANDLE _hGate;
+};
+
+static CredentialCache* CreateCache(FakeCredentialSource** ppSource, CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus)
+{
+    *ppSource = new FakeCredentialSource();
+    CredentialCache* pCache = new CredentialCache(*ppSource);
+    pCache->SetUsageScenario(cpus);
+    return pCache;
+}
+
+TEST(LoadsOnceWhileUnchanged)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+
+    DWORD cAccounts = 0;
+    LONG lGeneration = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+    CHECK_EQ(cAccounts, 1u);
+    CHECK_EQ(lGeneration, 1);
+    CHECK_EQ(pSource->_cpusLoaded, CPUS_UNLOCK_WORKSTATION);
+
+    for (DWORD i = 0; i < 10; i++)
+    {
+        LONG lAgain = 0;
+        CHECK_HR(pCache->GetAccountCount(&cAccounts, &lAgain), S_OK);
+        CHECK_EQ(lAgain, lGeneration);
+        CHECK_HR(pCache->FindAccount(L"S-1-5-21-1-1001", nullptr), S_OK);
+    }
+    CHECK_EQ(pSource->_cLoads, 1);
+
+    pCache->Release();
+}
+
+TEST(ReloadsWhenSourceChanges)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+
+    DWORD cAccounts = 0;
+    LONG lGeneration = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+
+    PWSTR pszKey = nullptr;
+    PWSTR pszUsername = nullptr;
+    CHECK_HR(pCache->GetAccountAt(lGeneration, 0, &pszKey, &pszUsername), S_OK);
+    CHECK(pszKey && !wcscmp(pszKey, L"S-1-5-21-1-1001"));
+    CHECK(pszUsername && !wcscmp(pszUsername, L"alice"));
+    CoTaskMemFree(pszKey);
+    CoTaskMemFree(pszUsername);
+
+    pSource->MarkChanged();
+    LONG lNext = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lNext), S_OK);
+    CHECK_EQ(pSource->_cLoads, 2);
+    CHECK_EQ(lNext, lGeneration + 1);
+
+    // 按旧代数取得的序号不再有效，调用方必须重新枚举
+    CHECK_HR(pCache->GetAccountAt(lGeneration, 0, &pszKey, &pszUsername), E_CHANGED_STATE);
+    CHECK(pszKey == nullptr && pszUsername == nullptr);
+    CHECK_HR(pCache->GetAccountAt(lNext, 0, &pszKey, &pszUsername), S_OK);
+    CoTaskMemFree(pszKey);
+    CoTaskMemFree(pszUsername);
+    CHECK_HR(pCache->GetAccountAt(lNext, 1, &pszKey, &pszUsername), E_BOUNDS);
+
+    pCache->Release();
+}
+
+TEST(InvalidateForcesReload)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+
+    DWORD cAccounts = 0;
+    LONG lGeneration = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+
+    // 来源本身没有报告变化（例如只改了配置快照），Invalidate 仍使下一次访问重新读取
+    pCache->Invalidate();
+    LONG lNext = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lNext), S_OK);
+    CHECK_EQ(pSource->_cLoads, 2);
+    CHECK_EQ(lNext, lGeneration + 1);
+
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lNext), S_OK);
+    CHECK_EQ(pSource->_cLoads, 2);
+
+    pCache->Release();
+}
+
+TEST(ScenarioSwitchDropsSnapshot)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+
+    DWORD cAccounts = 0;
+    LONG lGeneration = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+    CHECK_EQ(cAccounts, 1u);
+
+    pCache->SetUsageScenario(CPUS_LOGON);
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+    CHECK_EQ(cAccounts, 2u);
+    CHECK_EQ(pSource->_cpusLoaded, CPUS_LOGON);
+    CHECK_EQ(lGeneration, 2);
+
+    // 同一场景再次设置不丢弃快照
+    pCache->SetUsageScenario(CPUS_LOGON);
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+    CHECK_EQ(pSource->_cLoads, 2);
+
+    pCache->Release();
+}
+
+TEST(CredentialsFollowReload)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+
+    SecretString username;
+    SecretString password;
+    ULONGLONG ullStamp1 = 0;
+    CHECK_HR(pCache->GetCredentials(L"S-1-5-21-1-1001", username, password, &ullStamp1), S_OK);
+    CHECK(username.Get() && !wcscmp(username.Get(), L"alice"));
+    CHECK(password.Get() && !wcscmp(password.Get(), L"pw1"));
+
+    // 密码修改后重新读取，指纹随之变化（ResultCache 据此作废旧的失败记录）
+    pSource->_pszPassword = L"pw-new";
+    pSource->MarkChanged();
+    ULONGLONG ullStamp2 = 0;
+    CHECK_HR(pCache->GetCredentials(L"S-1-5-21-1-1001", username, password, &ullStamp2), S_OK);
+    CHECK(password.Get() && !wcscmp(password.Get(), L"pw-new"));
+    CHECK(ullStamp1 != ullStamp2);
+
+    CHECK_HR(pCache->GetCredentials(L"S-1-5-21-9-9999", username, password), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    pCache->Release();
+}
+
+TEST(SourceFailureIsReported)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+    pSource->_hrLoad = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+
+    DWORD cAccounts = 1;
+    LONG lGeneration = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+    CHECK_EQ(cAccounts, 0u);
+    CHECK_HR(pCache->CanAutoUnlock(L"S-1-5-21-1-1001", false), HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+    // 失败的读取同样是一个快照：来源恢复并报告变化后才重新读取
+    pSource->_hrLoad = S_OK;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+    pSource->MarkChanged();
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+    CHECK_EQ(cAccounts, 1u);
+
+    pCache->Release();
+}
+
+TEST(CanAutoUnlockHonoursResultCache)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+    ResultCache::GetDefault()->Reset();
+
+    SecretString username;
+    SecretString password;
+    ULONGLONG ullStamp = 0;
+    CHECK_HR(pCache->GetCredentials(L"S-1-5-21-1-1001", username, password, &ullStamp), S_OK);
+    CHECK_HR(pCache->CanAutoUnlock(L"S-1-5-21-1-1001", false), S_OK);
+
+    // 账户锁定：同一密码不再自动提交；密码修改并重新读取后恢复
+    ResultCache::GetDefault()->RecordResult(L"S-1-5-21-1-1001", ullStamp, (NTSTATUS)0xC0000234L, 0, GetTickCount64());
+    CHECK_HR(pCache->CanAutoUnlock(L"S-1-5-21-1-1001", false), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+
+    pSource->_pszPassword = L"pw-new";
+    pSource->MarkChanged();
+    CHECK_HR(pCache->CanAutoUnlock(L"S-1-5-21-1-1001", false), S_OK);
+
+    ResultCache::GetDefault()->Reset();
+    pCache->Release();
+}
+
+struct PREFETCH_RESULT
+{
+    HANDLE hDone;
+    HRESULT hr;
+};
+
+static void CALLBACK PrefetchComplete(void* pvContext, HRESULT hr)
+{
+    PREFETCH_RESULT* pResult = (PREFETCH_RESULT*)pvContext;
+    pResult->hr = hr;
+    SetEvent(pResult->hDone);
+}
+
+TEST(PrefetchCompletes)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+
+    PREFETCH_RESULT result = { CreateEventW(nullptr, TRUE, FALSE, nullptr), E_FAIL };
+    CHECK_HR(pCache->BeginPrefetch(PrefetchComplete, &result), S_OK);
+    CHECK_EQ(WaitForSingleObject(result.hDone, 5000), WAIT_OBJECT_0);
+    CHECK_HR(result.hr, S_OK);
+
+    // 预取结果直接用于之后的调用，不再读取来源
+    DWORD cAccounts = 0;
+    LONG lGeneration = 0;
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration, 0), S_OK);
+    CHECK_EQ(pSource->_cLoads, 1);
+
+    CloseHandle(result.hDone);
+    pCache->Release();
+}
+
+// 慢来源：带期限的调用按期返回 E_PENDING 并计数，读取在后台继续，结果留给之后的调用
+TEST(DeadlineMissReturnsPending)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+    pSource->_hGate = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    LONG cMissedBefore = CredentialCache::GetMissedDeadlines();
+
+    DWORD cAccounts = 1;
+    LONG lGeneration = 0;
+    ULONGLONG ullStart = GetTickCount64();
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration, 50), E_PENDING);
+    CHECK(GetTickCount64() - ullStart < 2000);
+    CHECK_EQ(cAccounts, 0u);
+    CHECK_HR(pCache->CanAutoUnlock(L"S-1-5-21-1-1001", false, 20), E_PENDING);
+    CHECK_EQ(CredentialCache::GetMissedDeadlines(), cMissedBefore + 2);
+
+    // 期限为 0 只是探询，不算错过期限
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration, 0), E_PENDING);
+    CHECK_EQ(CredentialCache::GetMissedDeadlines(), cMissedBefore + 2);
+
+    // 迟到的结果被保留：之后的调用直接使用，不再次读取来源
+    SetEvent(pSource->_hGate);
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration), S_OK);
+    CHECK_EQ(cAccounts, 1u);
+    CHECK_HR(pCache->GetAccountCount(&cAccounts, &lGeneration, 0), S_OK);
+    CHECK_EQ(pSource->_cLoads, 1);
+
+    HANDLE hGate = pSource->_hGate;
+    pCache->Release();
+    CloseHandle(hGate);
+}
+
+BENCH(CachedLookupBench)
+{
+    FakeCredentialSource* pSource;
+    CredentialCache* pCache = CreateCache(&pSource, CPUS_UNLOCK_WORKSTATION);
+    DWORD cAccounts = 0;
+    LONG lGeneration = 0;
+    pCache->GetAccountCount(&cAccounts, &lGeneration);
+
+    volatile HRESULT hrSink = S_OK;
+    BenchRun("CredentialCache::GetAccountCount（命中）", 2000000, [&](DWORD) {
+        DWORD c;
+        LONG l;
+        hrSink = pCache->GetAccountCount(&c, &l, 100);
+    });
+    BenchRun("CredentialCache::CanAutoUnlock（命中）", 2000000, [&](DWORD) {
+        hrSink = pCache->CanAutoUnlock(L"S-1-5-21-1-1001", false, 100);
+    });
+    BenchRun("CredentialCache::GetAccountCount（每次重新读取）", 20000, [&](DWORD) {
+        DWORD c;
+        LONG l;
+        pCache->Invalidate();
+        hrSink = pCache->GetAccountCount(&c, &l, INFINITE);
+    });
+    pCache->Release();
+}
+
+TEST_MAIN()
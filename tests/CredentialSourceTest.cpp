@@ -0,0 +1,397 @@
+#include "pch.h"
+#include "CredentialSource.h"
+#include "ConfigFile.h"
+#include "Test.h"
+
+// CredentialSource：内存来源的账户设置与变更检测、来源链的顺序与回退、耗时统计，
+// 以及依赖注册表/文件/登录会话的来源在兼容层下干净地失败
+
+static bool PasswordEquals(const AccountTable& table, DWORD dwIndex, PCWSTR pszExpected)
+{
+    SecretString password;
+    return SUCCEEDED(table.UnsealPassword(dwIndex, &password)) && !wcscmp(password.Get(), pszExpected);
+}
+
+// 始终失败的来源，记录被调用的次数
+class FailingCredentialSource : public CredentialSourceBase
+{
+public:
+    FailingCredentialSource(HRESULT hrLoad) : _hrLoad(hrLoad), _cLoads(0), _fChanged(false)
+    {
+    }
+
+    PCWSTR GetName() override { return L"failing"; }
+    bool HasChanged() override { return _fChanged; }
+
+    HRESULT _hrLoad;
+    DWORD _cLoads;
+    bool _fChanged;
+
+protected:
+    HRESULT _Load(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, AccountTable* pTable) override
+    {
+        UNREFERENCED_PARAMETER(cpus);
+        UNREFERENCED_PARAMETER(pTable);
+        _cLoads++;
+        return _hrLoad;
+    }
+};
+
+TEST(MemorySourceSetAndAdd)
+{
+    MemoryCredentialSource source;
+    AccountTable table;
+
+    // 没有账户：读取失败
+    CHECK(source.HasChanged());
+    CHECK_HR(source.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), E_FAIL);
+    CHECK(!source.HasChanged());
+    CHECK_EQ(table.GetCount(), 0u);
+
+    CHECK_HR(source.AddAccount(nullptr, L"pw"), E_INVALIDARG);
+    CHECK_HR(source.AddAccount(L"", L"pw"), E_INVALIDARG);
+    CHECK(!source.HasChanged());
+
+    CHECK_HR(source.SetCredentials(L"alice", L"pw1"), S_OK);
+    CHECK_HR(source.AddAccount(L"bob", nullptr), S_OK);
+    CHECK(source.HasChanged());
+    CHECK_HR(source.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), S_OK);
+    CHECK(!source.HasChanged());
+    CHECK_EQ(table.GetCount(), 2u);
+    CHECK(!wcscmp(table.GetUsername(0), L"alice"));
+    CHECK(PasswordEquals(table, 0, L"pw1"));
+    CHECK(!wcscmp(table.GetUsername(1), L"bob"));
+    CHECK(PasswordEquals(table, 1, L""));
+
+    // SetCredentials 替换全部账户
+    AccountTable replaced;
+    CHECK_HR(source.SetCredentials(L"carol", L"pw3"), S_OK);
+    CHECK(source.HasChanged());
+    CHECK_HR(source.LoadAccounts(CPUS_LOGON, &replaced), S_OK);
+    CHECK_EQ(replaced.GetCount(), 1u);
+    CHECK(!wcscmp(replaced.GetUsername(0), L"carol"));
+    CHECK(PasswordEquals(replaced, 0, L"pw3"));
+
+    // 清除同样算作变更，之后读取失败
+    AccountTable cleared;
+    CHECK_HR(source.SetCredentials(nullptr, nullptr), S_OK);
+    CHECK(source.HasChanged());
+    CHECK_HR(source.LoadAccounts(CPUS_LOGON, &cleared), E_FAIL);
+    CHECK_EQ(cleared.GetCount(), 0u);
+}
+
+TEST(LatencyCountsEveryLookup)
+{
+    MemoryCredentialSource source;
+    source.SetCredentials(L"alice", L"pw1");
+
+    CREDENTIAL_SOURCE_LATENCY latency;
+    source.GetLatency(&latency);
+    CHECK_EQ(latency.cLookups, 0u);
+    CHECK_EQ(latency.ullTotalMicroseconds, 0ull);
+
+    for (DWORD i = 0; i < 5; i++)
+    {
+        AccountTable table;
+        source.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table);
+    }
+    source.GetLatency(&latency);
+    CHECK_EQ(latency.cLookups, 5u);
+    CHECK(latency.ullTotalMicroseconds >= latency.ullLastMicroseconds);
+}
+
+TEST(ChainFirstSuccessWins)
+{
+    ChainedCredentialSource chain;
+    FailingCredentialSource* pFailing = new FailingCredentialSource(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+    MemoryCredentialSource* pFirst = new MemoryCredentialSource();
+    MemoryCredentialSource* pSecond = new MemoryCredentialSource();
+    pFirst->SetCredentials(L"alice", L"pw1");
+    pSecond->SetCredentials(L"bob", L"pw2");
+    CHECK_HR(chain.Append(pFailing), S_OK);
+    CHECK_HR(chain.Append(pFirst), S_OK);
+    CHECK_HR(chain.Append(pSecond), S_OK);
+    CHECK_EQ(chain.GetSourceCount(), 3u);
+    CHECK(chain.GetSourceAt(1) == pFirst);
+    CHECK(chain.GetSourceAt(3) == nullptr);
+
+    // 失败的来源被跳过，第一个读到账户的来源胜出，之后的来源不再读取
+    AccountTable table;
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), S_OK);
+    CHECK_EQ(pFailing->_cLoads, 1u);
+    CHECK_EQ(table.GetCount(), 1u);
+    CHECK(!wcscmp(table.GetUsername(0), L"alice"));
+    CREDENTIAL_SOURCE_LATENCY latency;
+    pSecond->GetLatency(&latency);
+    CHECK_EQ(latency.cLookups, 0u);
+
+    // 前面的来源清空后回退到下一个
+    AccountTable fallback;
+    pFirst->SetCredentials(nullptr, nullptr);
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &fallback), S_OK);
+    CHECK_EQ(fallback.GetCount(), 1u);
+    CHECK(!wcscmp(fallback.GetUsername(0), L"bob"));
+    CHECK(PasswordEquals(fallback, 0, L"pw2"));
+
+    // 全部失败：链本身失败
+    AccountTable empty;
+    pSecond->SetCredentials(nullptr, nullptr);
+    CHECK(FAILED(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &empty)));
+    CHECK_EQ(empty.GetCount(), 0u);
+    CHECK_EQ(pFailing->_cLoads, 3u);
+}
+
+TEST(ChainStopsWhenDisabled)
+{
+    ChainedCredentialSource chain;
+    FailingCredentialSource* pDisabled = new FailingCredentialSource(E_AUTO_UNLOCK_DISABLED);
+    MemoryCredentialSource* pMemory = new MemoryCredentialSource();
+    pMemory->SetCredentials(L"alice", L"pw1");
+    chain.Append(pDisabled);
+    chain.Append(pMemory);
+
+    // 关闭自动解锁是终止结果，后面的来源不再读取
+    AccountTable table;
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), E_AUTO_UNLOCK_DISABLED);
+    CHECK_EQ(table.GetCount(), 0u);
+    CREDENTIAL_SOURCE_LATENCY latency;
+    pMemory->GetLatency(&latency);
+    CHECK_EQ(latency.cLookups, 0u);
+
+    // 其他失败照常回退
+    AccountTable fallback;
+    pDisabled->_hrLoad = HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &fallback), S_OK);
+    CHECK_EQ(fallback.GetCount(), 1u);
+}
+
+static const WCHAR c_szConfig[] = L"C:\\ProgramData\\WinUnlock\\config.bin";
+
+static bool WriteConfig(DWORD dwFlags)
+{
+    ConfigBuilder builder;
+    builder.SetFlags(dwFlags);
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    if (FAILED(builder.Build(&pb, &cb)))
+    {
+        return false;
+    }
+    HANDLE hFile = CreateFileW(c_szConfig, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    DWORD cbWritten = 0;
+    bool fOk = (hFile != INVALID_HANDLE_VALUE) && WriteFile(hFile, pb, cb, &cbWritten, nullptr) && (cbWritten == cb);
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(hFile);
+    }
+    CoTaskMemFree(pb);
+    return fOk;
+}
+
+TEST(DisabledConfigFileStopsChain)
+{
+    WinCompatClearFiles();
+    ChainedCredentialSource chain;
+    chain.Append(new ConfigFileCredentialSource(c_szConfig));
+    MemoryCredentialSource* pFallback = new MemoryCredentialSource();
+    pFallback->SetCredentials(L"legacy", L"plaintext");
+    chain.Append(pFallback);
+
+    // 没有配置文件：回退到后面的来源
+    AccountTable missing;
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &missing), S_OK);
+    CHECK((missing.GetCount() == 1) && !wcscmp(missing.GetUsername(0), L"legacy"));
+
+    // 配置中关闭了自动解锁：不再回退
+    CHECK(WriteConfig(0));
+    CHECK(chain.HasChanged());
+    AccountTable disabled;
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &disabled), E_AUTO_UNLOCK_DISABLED);
+    CHECK_EQ(disabled.GetCount(), 0u);
+    CHECK(!chain.HasChanged());
+
+    // 开启但没有账户：与读不到账户相同，继续回退
+    CHECK(WriteConfig(CONFIG_FLAG_AUTO_UNLOCK_ENABLED));
+    CHECK(chain.HasChanged());
+    AccountTable empty;
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &empty), S_OK);
+    CHECK((empty.GetCount() == 1) && !wcscmp(empty.GetUsername(0), L"legacy"));
+    WinCompatClearFiles();
+}
+
+TEST(UntrustedConfigFileIsRefused)
+{
+    WinCompatClearFiles();
+    ChainedCredentialSource chain;
+    chain.Append(new ConfigFileCredentialSource(c_szConfig));
+    MemoryCredentialSource* pFallback = new MemoryCredentialSource();
+    pFallback->SetCredentials(L"legacy", L"plaintext");
+    chain.Append(pFallback);
+
+    // 普通用户抢先写入的配置文件：内容（这里关闭了自动解锁）不生效，回退到后面的来源
+    CHECK(WriteConfig(0));
+    CHECK(WinCompatSetFileOwner(c_szConfig, L"S-1-5-21-1000-2000-3000-1001"));
+    ConfigFile file;
+    CHECK_HR(file.Open(c_szConfig), HRESULT_FROM_WIN32(ERROR_INVALID_OWNER));
+    AccountTable untrusted;
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &untrusted), S_OK);
+    CHECK((untrusted.GetCount() == 1) && !wcscmp(untrusted.GetUsername(0), L"legacy"));
+
+    // 管理员拥有的文件照常读取
+    CHECK(WinCompatSetFileOwner(c_szConfig, L"S-1-5-32-544"));
+    CHECK_HR(file.Open(c_szConfig), S_OK);
+    file.Close();
+    AccountTable disabled;
+    CHECK_HR(chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &disabled), E_AUTO_UNLOCK_DISABLED);
+
+    // 保存时新建临时文件再改名，替换掉不可信的文件
+    CHECK(WinCompatSetFileOwner(c_szConfig, L"S-1-5-21-1000-2000-3000-1001"));
+    static const BYTE c_rgbKey[] = { 1, 2, 3, 4 };
+    CHECK_HR(ConfigFileSave(c_szConfig, c_rgbKey, sizeof(c_rgbKey)), S_OK);
+    HANDLE hFile = CreateFileW(c_szConfig, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    CHECK(hFile != INVALID_HANDLE_VALUE);
+    if (hFile != INVALID_HANDLE_VALUE)
+    {
+        CHECK_HR(ConfigCheckFileOwner(hFile), S_OK);
+        CloseHandle(hFile);
+    }
+    WinCompatClearFiles();
+}
+
+TEST(ChainHasChangedWhenAnySourceChanged)
+{
+    ChainedCredentialSource chain;
+    CHECK(!chain.HasChanged());
+
+    FailingCredentialSource* pFailing = new FailingCredentialSource(E_FAIL);
+    MemoryCredentialSource* pMemory = new MemoryCredentialSource();
+    pMemory->SetCredentials(L"alice", L"pw1");
+    chain.Append(pFailing);
+    chain.Append(pMemory);
+    CHECK(chain.HasChanged());
+
+    AccountTable table;
+    chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table);
+    CHECK(!chain.HasChanged());
+
+    // 排在胜出来源之前的来源变化也可能改变结果
+    pFailing->_fChanged = true;
+    CHECK(chain.HasChanged());
+    pFailing->_fChanged = false;
+    CHECK(!chain.HasChanged());
+    pMemory->AddAccount(L"bob", L"pw2");
+    CHECK(chain.HasChanged());
+}
+
+TEST(ChainAppendBounds)
+{
+    ChainedCredentialSource chain;
+    CHECK_HR(chain.Append(nullptr), E_INVALIDARG);
+    for (DWORD i = 0; i < ChainedCredentialSource::MAX_SOURCES; i++)
+    {
+        CHECK_HR(chain.Append(new MemoryCredentialSource()), S_OK);
+    }
+    // 超出上限的来源被拒绝并释放（ASan 下可验证没有泄漏）
+    CHECK_HR(chain.Append(new MemoryCredentialSource()), E_BOUNDS);
+    CHECK_EQ(chain.GetSourceCount(), ChainedCredentialSource::MAX_SOURCES);
+}
+
+TEST(SystemSourcesFailCleanly)
+{
+    // 兼容层中注册表和登录会话不可用
+    WinCompatClearFiles();
+    AccountTable table;
+    RegistryCredentialSource registry;
+    CHECK(FAILED(registry.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table)));
+    CHECK(registry.HasChanged());
+
+    CurrentUserCredentialSource currentUser;
+    CHECK_HR(currentUser.LoadAccounts(CPUS_LOGON, &table), E_FAIL);
+    CHECK_HR(currentUser.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED));
+    CHECK_EQ(table.GetCount(), 0u);
+}
+
+TEST(VaultFileTracksStamp)
+{
+    static const WCHAR c_szVault[] = L"C:\\ProgramData\\WinUnlock\\vault.bin";
+    WinCompatClearFiles();
+    AccountTable table;
+    VaultFileCredentialSource vault(c_szVault);
+    CHECK(!vault.HasChanged());
+    CHECK_HR(vault.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+    // 文件出现即为变更；读取记下时间戳，之后的写入再次报告变更
+    HANDLE hFile = CreateFileW(c_szVault, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    CHECK(hFile != INVALID_HANDLE_VALUE);
+    CHECK(vault.HasChanged());
+    CHECK_HR(vault.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK(!vault.HasChanged());
+
+    BYTE rgb[64] = { 0 };
+    DWORD cbWritten = 0;
+    WriteFile(hFile, rgb, sizeof(rgb), &cbWritten, nullptr);
+    CloseHandle(hFile);
+    CHECK(vault.HasChanged());
+
+    // DPAPI 在兼容层中不可用
+    CHECK_HR(vault.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table), HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED));
+    CHECK(!vault.HasChanged());
+    CHECK_EQ(table.GetCount(), 0u);
+
+    DeleteFileW(c_szVault);
+    CHECK(vault.HasChanged());
+}
+
+TEST(ConfiguredChainDefaults)
+{
+    // 没有 CredentialSources 配置时为 config -> registry -> currentuser
+    WinCompatClearFiles();
+    ICredentialSource* pSource = nullptr;
+    CHECK_HR(CreateConfiguredCredentialSource(&pSource), S_OK);
+    ChainedCredentialSource* pChain = static_cast<ChainedCredentialSource*>(pSource);
+    CHECK(pChain && (pChain->GetSourceCount() == 3));
+    if (pChain && (pChain->GetSourceCount() == 3))
+    {
+        CHECK(!wcscmp(pChain->GetSourceAt(0)->GetName(), L"config"));
+        CHECK(!wcscmp(pChain->GetSourceAt(1)->GetName(), L"registry"));
+        CHECK(!wcscmp(pChain->GetSourceAt(2)->GetName(), L"currentuser"));
+        AccountTable table;
+        CHECK(FAILED(pSource->LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table)));
+    }
+    delete pSource;
+}
+
+BENCH(CredentialSourceBench)
+{
+    MemoryCredentialSource memory;
+    for (DWORD i = 0; i < 16; i++)
+    {
+        WCHAR szUser[16] = L"user";
+        szUser[4] = (WCHAR)(L'a' + i);
+        memory.AddAccount(szUser, L"password");
+    }
+
+    ChainedCredentialSource chain;
+    chain.Append(new FailingCredentialSource(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)));
+    chain.Append(new FailingCredentialSource(HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND)));
+    MemoryCredentialSource* pTail = new MemoryCredentialSource();
+    pTail->SetCredentials(L"alice", L"pw1");
+    chain.Append(pTail);
+
+    volatile DWORD dwSink = 0;
+    BenchRun("MemoryCredentialSource 读取 16 个账户", 100000, [&](DWORD) {
+        AccountTable table;
+        memory.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table);
+        dwSink = dwSink + table.GetCount();
+    });
+    BenchRun("来源链跳过两个失败来源", 200000, [&](DWORD) {
+        AccountTable table;
+        chain.LoadAccounts(CPUS_UNLOCK_WORKSTATION, &table);
+        dwSink = dwSink + table.GetCount();
+    });
+    BenchRun("ChainedCredentialSource::HasChanged", 2000000, [&](DWORD) {
+        dwSink = dwSink + (chain.HasChanged() ? 1 : 0);
+    });
+}
+
+TEST_MAIN()
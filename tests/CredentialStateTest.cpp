@@ -0,0 +1,316 @@
+#include "pch.h"
+#include "CredentialState.h"
+#include "Test.h"
+
+// CredentialState.h：状态转换表、并发比较交换，以及多生产者、唯一消费者的事件队列
+
+// 与 CredentialState.h 注释中的转换表逐项对应
+static const CREDENTIAL_STATE c_rgTransitions[][2] =
+{
+    { CS_IDLE, CS_FETCHING }, { CS_IDLE, CS_READY }, { CS_IDLE, CS_SUBMITTING },
+    { CS_FETCHING, CS_READY }, { CS_FETCHING, CS_IDLE },
+    { CS_READY, CS_SUBMITTING }, { CS_READY, CS_IDLE },
+    { CS_SUBMITTING, CS_DONE }, { CS_SUBMITTING, CS_FAILED }, { CS_SUBMITTING, CS_FETCHING }, { CS_SUBMITTING, CS_IDLE },
+    { CS_DONE, CS_READY }, { CS_DONE, CS_SUBMITTING }, { CS_DONE, CS_FETCHING }, { CS_DONE, CS_IDLE },
+    { CS_FAILED, CS_READY }, { CS_FAILED, CS_SUBMITTING }, { CS_FAILED, CS_FETCHING }, { CS_FAILED, CS_IDLE },
+};
+
+static bool IsDocumentedTransition(CREDENTIAL_STATE from, CREDENTIAL_STATE to)
+{
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgTransitions); i++)
+    {
+        if ((c_rgTransitions[i][0] == from) && (c_rgTransitions[i][1] == to))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(TransitionTable)
+{
+    for (DWORD from = 0; from <= CS_NUM_STATES; from++)
+    {
+        for (DWORD to = 0; to <= CS_NUM_STATES; to++)
+        {
+            CHECK_EQ(CredentialStateMachine::IsValidTransition((CREDENTIAL_STATE)from, (CREDENTIAL_STATE)to),
+                IsDocumentedTransition((CREDENTIAL_STATE)from, (CREDENTIAL_STATE)to));
+        }
+    }
+}
+
+TEST(TransitionChecksCurrentState)
+{
+    CredentialStateMachine state;
+    CHECK_EQ(state.Get(), CS_IDLE);
+
+    // 不合法的转换和起始状态不符的转换都不改变状态
+    CHECK(!state.Transition(CS_IDLE, CS_DONE));
+    CHECK(!state.Transition(CS_READY, CS_SUBMITTING));
+    CHECK_EQ(state.Get(), CS_IDLE);
+
+    CHECK(state.Transition(CS_IDLE, CS_FETCHING));
+    CHECK(!state.TransitionTo(CS_SUBMITTING));
+    CHECK_EQ(state.Get(), CS_FETCHING);
+
+    CREDENTIAL_STATE previous = CS_NUM_STATES;
+    CHECK(state.TransitionTo(CS_IDLE, &previous));
+    CHECK_EQ(previous, CS_FETCHING);
+    CHECK(!state.TransitionTo(CS_IDLE, &previous));
+    CHECK_EQ(previous, CS_IDLE);
+}
+
+// 成功登录后 LogonUI 复用同一磁贴：再次选中时按 SetSelected 的路径回到 Ready 或 Fetching，可以再次自动提交
+TEST(DoneCredentialIsReselectable)
+{
+    CredentialStateMachine state;
+    CHECK(state.TransitionTo(CS_READY));
+    CHECK(state.TransitionTo(CS_SUBMITTING));
+    CHECK(state.Transition(CS_SUBMITTING, CS_DONE));
+
+    CREDENTIAL_STATE previous = CS_NUM_STATES;
+    CHECK(state.TransitionTo(CS_READY, &previous));
+    CHECK_EQ(previous, CS_DONE);
+    CHECK(state.TransitionTo(CS_SUBMITTING));
+    CHECK(state.Transition(CS_SUBMITTING, CS_DONE));
+
+    CHECK(state.TransitionTo(CS_FETCHING));
+    CHECK(state.Transition(CS_FETCHING, CS_READY));
+    CHECK(state.TransitionTo(CS_SUBMITTING));
+    CHECK(state.Transition(CS_SUBMITTING, CS_DONE));
+
+    // 没有可用凭据时从 Done 回到 Idle
+    CHECK(state.Transition(CS_DONE, CS_IDLE));
+}
+
+struct RACE_CONTEXT
+{
+    CredentialStateMachine* pState;
+    HANDLE hStart;
+    volatile LONG cWins;
+};
+
+static DWORD WINAPI RaceThread(LPVOID pv)
+{
+    RACE_CONTEXT* pContext = (RACE_CONTEXT*)pv;
+    WaitForSingleObject(pContext->hStart, INFINITE);
+    if (pContext->pState->Transition(CS_FETCHING, CS_READY))
+    {
+        InterlockedIncrement(&pContext->cWins);
+    }
+    return 0;
+}
+
+// LogonUI 线程和线程池线程同时离开 Fetching 时只有一方成功
+TEST(ConcurrentTransitionHasOneWinner)
+{
+    const DWORD cThreads = 8;
+    for (DWORD iRound = 0; iRound < 200; iRound++)
+    {
+        CredentialStateMachine state;
+        state.Transition(CS_IDLE, CS_FETCHING);
+        RACE_CONTEXT context = { &state, CreateEventW(nullptr, TRUE, FALSE, nullptr), 0 };
+        HANDLE rghThreads[cThreads];
+        for (DWORD i = 0; i < cThreads; i++)
+        {
+            rghThreads[i] = CreateThread(nullptr, 0, RaceThread, &context, 0, nullptr);
+        }
+        SetEvent(context.hStart);
+        WaitForMultipleObjects(cThreads, rghThreads, TRUE, INFINITE);
+        for (DWORD i = 0; i < cThreads; i++)
+        {
+            CloseHandle(rghThreads[i]);
+        }
+        CloseHandle(context.hStart);
+        CHECK_EQ(context.cWins, 1);
+        CHECK_EQ(state.Get(), CS_READY);
+    }
+}
+
+// 记录收到的事件；只有投递线程调用
+class RecordingEvents final : public ICredentialProviderCredentialEvents
+{
+public:
+    struct RECORD
+    {
+        CREDENTIAL_EVENT_TYPE type;
+        DWORD dwFieldID;
+        DWORD dwValue;
+        WCHAR szValue[16];
+    };
+
+    RecordingEvents() : _cRecords(0) {}
+
+    IFACEMETHODIMP QueryInterface(REFIID riid, void** ppv) { UNREFERENCED_PARAMETER(riid); *ppv = nullptr; return E_NOINTERFACE; }
+    IFACEMETHODIMP_(ULONG) AddRef() { return 1; }
+    IFACEMETHODIMP_(ULONG) Release() { return 1; }
+
+    IFACEMETHODIMP SetFieldState(ICredentialProviderCredential*, DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_STATE cpfs)
+    {
+        return _Record(CET_FIELD_STATE, dwFieldID, cpfs, nullptr);
+    }
+    IFACEMETHODIMP SetFieldInteractiveState(ICredentialProviderCredential*, DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE cpfis)
+    {
+        return _Record(CET_FIELD_INTERACTIVE_STATE, dwFieldID, cpfis, nullptr);
+    }
+    IFACEMETHODIMP SetFieldString(ICredentialProviderCredential*, DWORD dwFieldID, LPCWSTR psz)
+    {
+        return _Record(CET_FIELD_STRING, dwFieldID, 0, psz);
+    }
+    IFACEMETHODIMP SetFieldCheckbox(ICredentialProviderCredential*, DWORD, BOOL, LPCWSTR) { return E_NOTIMPL; }
+    IFACEMETHODIMP SetFieldBitmap(ICredentialProviderCredential*, DWORD, HBITMAP) { return E_NOTIMPL; }
+    IFACEMETHODIMP SetFieldComboBoxSelectedItem(ICredentialProviderCredential*, DWORD, DWORD) { return E_NOTIMPL; }
+    IFACEMETHODIMP DeleteFieldComboBoxItem(ICredentialProviderCredential*, DWORD, DWORD) { return E_NOTIMPL; }
+    IFACEMETHODIMP AppendFieldComboBoxItem(ICredentialProviderCredential*, DWORD, LPCWSTR) { return E_NOTIMPL; }
+    IFACEMETHODIMP SetFieldSubmitButton(ICredentialProviderCredential*, DWORD, DWORD) { return E_NOTIMPL; }
+    IFACEMETHODIMP OnCreatingWindow(HWND*) { return E_NOTIMPL; }
+
+    static const DWORD c_cMaxRecords = 64 * 1024;
+    RECORD _rgRecords[c_cMaxRecords];
+    DWORD _cRecords;
+
+private:
+    HRESULT _Record(CREDENTIAL_EVENT_TYPE type, DWORD dwFieldID, DWORD dwValue, PCWSTR psz)
+    {
+        if (_cRecords < c_cMaxRecords)
+        {
+            RECORD& record = _rgRecords[_cRecords++];
+            record.type = type;
+            record.dwFieldID = dwFieldID;
+            record.dwValue = dwValue;
+            record.szValue[0] = L'\0';
+            if (psz)
+            {
+                StringCchCopyW(record.szValue, ARRAYSIZE(record.szValue), psz);
+            }
+        }
+        return S_OK;
+    }
+};
+
+TEST(EventsDeliveredInPostOrder)
+{
+    CredentialEventQueue queue;
+    RecordingEvents* pEvents = new RecordingEvents();
+    CHECK(!queue.HasPending());
+
+    CHECK_HR(queue.PostFieldString(2, L"loading"), S_OK);
+    CHECK_HR(queue.PostFieldState(3, CPFS_HIDDEN), S_OK);
+    CHECK_HR(queue.PostFieldInteractiveState(4, CPFIS_FOCUSED), S_OK);
+    CHECK_HR(queue.PostFieldString(2, nullptr), S_OK);
+    CHECK(queue.HasPending());
+
+    queue.Deliver(nullptr, pEvents);
+    CHECK(!queue.HasPending());
+    CHECK_EQ(pEvents->_cRecords, 4u);
+    CHECK_EQ(pEvents->_rgRecords[0].type, CET_FIELD_STRING);
+    CHECK(!wcscmp(pEvents->_rgRecords[0].szValue, L"loading"));
+    CHECK_EQ(pEvents->_rgRecords[1].type, CET_FIELD_STATE);
+    CHECK_EQ(pEvents->_rgRecords[1].dwFieldID, 3u);
+    CHECK_EQ(pEvents->_rgRecords[1].dwValue, (DWORD)CPFS_HIDDEN);
+    CHECK_EQ(pEvents->_rgRecords[2].type, CET_FIELD_INTERACTIVE_STATE);
+    CHECK_EQ(pEvents->_rgRecords[2].dwValue, (DWORD)CPFIS_FOCUSED);
+    CHECK_EQ(pEvents->_rgRecords[3].type, CET_FIELD_STRING);
+    CHECK(!pEvents->_rgRecords[3].szValue[0]);
+
+    // 没有接收器时丢弃
+    queue.PostFieldString(2, L"dropped");
+    queue.Deliver(nullptr, nullptr);
+    CHECK(!queue.HasPending());
+    queue.Deliver(nullptr, pEvents);
+    CHECK_EQ(pEvents->_cRecords, 4u);
+
+    // 析构时释放未投递的事件（ASan 下检查泄漏）
+    queue.PostFieldString(2, L"leftover");
+    delete pEvents;
+}
+
+struct PRODUCER_CONTEXT
+{
+    CredentialEventQueue* pQueue;
+    DWORD dwProducer;
+    DWORD cEvents;
+};
+
+static DWORD WINAPI ProducerThread(LPVOID pv)
+{
+    PRODUCER_CONTEXT* pContext = (PRODUCER_CONTEXT*)pv;
+    for (DWORD i = 0; i < pContext->cEvents; i++)
+    {
+        // 字段号区分生产者，值为该生产者内的序号
+        pContext->pQueue->PostFieldState(pContext->dwProducer, (CREDENTIAL_PROVIDER_FIELD_STATE)i);
+    }
+    return 0;
+}
+
+// 多个线程池线程同时投递，唯一的消费者按各自的投递顺序收到全部事件
+TEST(ConcurrentPostersSingleConsumer)
+{
+    const DWORD cProducers = 4;
+    const DWORD cEventsPerProducer = 10000;
+    CredentialEventQueue queue;
+    RecordingEvents* pEvents = new RecordingEvents();
+
+    PRODUCER_CONTEXT rgContexts[cProducers];
+    HANDLE rghThreads[cProducers];
+    for (DWORD i = 0; i < cProducers; i++)
+    {
+        rgContexts[i] = { &queue, i, cEventsPerProducer };
+        rghThreads[i] = CreateThread(nullptr, 0, ProducerThread, &rgContexts[i], 0, nullptr);
+    }
+
+    // 生产者运行期间反复投递，模拟 LogonUI 线程上的各个入口
+    while (WaitForMultipleObjects(cProducers, rghThreads, TRUE, 0) == WAIT_TIMEOUT)
+    {
+        queue.Deliver(nullptr, pEvents);
+    }
+    queue.Deliver(nullptr, pEvents);
+    for (DWORD i = 0; i < cProducers; i++)
+    {
+        CloseHandle(rghThreads[i]);
+    }
+
+    CHECK_EQ(pEvents->_cRecords, cProducers * cEventsPerProducer);
+    DWORD rgdwNext[cProducers] = {};
+    bool fInOrder = true;
+    for (DWORD i = 0; i < pEvents->_cRecords; i++)
+    {
+        const RecordingEvents::RECORD& record = pEvents->_rgRecords[i];
+        if ((record.dwFieldID >= cProducers) || (record.dwValue != rgdwNext[record.dwFieldID]))
+        {
+            fInOrder = false;
+            break;
+        }
+        rgdwNext[record.dwFieldID]++;
+    }
+    CHECK(fInOrder);
+    delete pEvents;
+}
+
+BENCH(EventQueueBench)
+{
+    CredentialEventQueue queue;
+    RecordingEvents* pEvents = new RecordingEvents();
+    BenchRun("PostFieldString + Deliver", 1000000, [&](DWORD) {
+        queue.PostFieldString(2, L"loading");
+        queue.Deliver(nullptr, pEvents);
+        pEvents->_cRecords = 0;
+    });
+    BenchRun("PostFieldState x16 + Deliver", 100000, [&](DWORD) {
+        for (DWORD i = 0; i < 16; i++)
+        {
+            queue.PostFieldState(i, CPFS_DISPLAY_IN_BOTH);
+        }
+        queue.Deliver(nullptr, pEvents);
+        pEvents->_cRecords = 0;
+    });
+
+    CredentialStateMachine state;
+    BenchRun("Transition Idle -> Ready -> Idle", 10000000, [&](DWORD) {
+        state.Transition(CS_IDLE, CS_READY);
+        state.Transition(CS_READY, CS_IDLE);
+    });
+    delete pEvents;
+}
+
+TEST_MAIN()
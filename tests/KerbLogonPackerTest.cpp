@@ -0,0 +1,168 @@
+#include "pch.h"
+#include "KerbLogonPacker.h"
+#include "Test.h"
+
+// KerbLogonPacker.h：与 x64 LSA 期望的序列化布局逐字节比较
+
+static_assert(sizeof(void*) == 8, "黄金缓冲区按 x64 布局编写");
+static_assert(sizeof(KERB_INTERACTIVE_LOGON) == 56, "KERB_INTERACTIVE_LOGON 布局");
+static_assert(sizeof(KERB_INTERACTIVE_UNLOCK_LOGON) == 64, "KERB_INTERACTIVE_UNLOCK_LOGON 布局");
+
+// 域 "PC"、用户 "bob"、密码 "pw"：[结构][域][用户][密码]，字符串不带 NUL，Buffer 为相对偏移
+static const BYTE c_rgbInteractiveLogon[] =
+{
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     // MessageType = KerbInteractiveLogon
+    0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,                     // LogonDomainName.Length/MaximumLength
+    0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 56
+    0x06, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00,                     // UserName
+    0x3c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 60
+    0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,                     // Password
+    0x42, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 66
+    'P', 0x00, 'C', 0x00,
+    'b', 0x00, 'o', 0x00, 'b', 0x00,
+    'p', 0x00, 'w', 0x00,
+};
+
+static const BYTE c_rgbUnlockLogon[] =
+{
+    0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     // MessageType = KerbWorkstationUnlockLogon
+    0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 64
+    0x06, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 68
+    0x04, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x4a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 74
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     // LogonId 为零
+    'P', 0x00, 'C', 0x00,
+    'b', 0x00, 'o', 0x00, 'b', 0x00,
+    'p', 0x00, 'w', 0x00,
+};
+
+// 空域名：Length 为 0、Buffer 为空，后续字符串紧接结构头
+static const BYTE c_rgbEmptyDomain[] =
+{
+    0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = nullptr
+    0x02, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x38, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 56
+    0x02, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x3a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,                     //   Buffer = 58
+    'u', 0x00,
+    'p', 0x00,
+};
+
+template <typename TLogon>
+static void CheckGolden(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, PCWSTR pszDomain, PCWSTR pszUser, PCWSTR pszPassword, const BYTE* rgbExpected, DWORD cbExpected)
+{
+    BYTE* rgb = nullptr;
+    DWORD cb = 0;
+    HRESULT hr = KerbLogonPack<TLogon>(KerbLogonMessageType(cpus), KerbPackString(pszDomain), KerbPackString(pszUser), KerbPackString(pszPassword), &rgb, &cb);
+    CHECK_HR(hr, S_OK);
+    CHECK_EQ(cb, cbExpected);
+    if (SUCCEEDED(hr) && (cb == cbExpected))
+    {
+        CHECK(!memcmp(rgb, rgbExpected, cb));
+    }
+    CoTaskMemFree(rgb);
+}
+
+TEST(InteractiveLogonLayout)
+{
+    CheckGolden<KERB_INTERACTIVE_LOGON>(CPUS_LOGON, L"PC", L"bob", L"pw", c_rgbInteractiveLogon, sizeof(c_rgbInteractiveLogon));
+}
+
+TEST(UnlockLogonLayout)
+{
+    CheckGolden<KERB_INTERACTIVE_UNLOCK_LOGON>(CPUS_UNLOCK_WORKSTATION, L"PC", L"bob", L"pw", c_rgbUnlockLogon, sizeof(c_rgbUnlockLogon));
+}
+
+TEST(EmptyStringHasNullBuffer)
+{
+    CheckGolden<KERB_INTERACTIVE_LOGON>(CPUS_LOGON, L"", L"u", L"p", c_rgbEmptyDomain, sizeof(c_rgbEmptyDomain));
+}
+
+TEST(MessageTypeByScenario)
+{
+    CHECK_EQ(KerbLogonMessageType(CPUS_LOGON), KerbInteractiveLogon);
+    CHECK_EQ(KerbLogonMessageType(CPUS_CREDUI), KerbInteractiveLogon);
+    CHECK_EQ(KerbLogonMessageType(CPUS_UNLOCK_WORKSTATION), KerbWorkstationUnlockLogon);
+}
+
+// UNICODE_STRING 的 Length 是 USHORT：最多 USHRT_MAX / 2 = 32767 个字符
+TEST(LengthLimit)
+{
+    const size_t cchMax = USHRT_MAX / sizeof(WCHAR);
+    PWSTR pszLong = (PWSTR)CoTaskMemAlloc((cchMax + 2) * sizeof(WCHAR));
+    CHECK(pszLong != nullptr);
+    if (!pszLong)
+    {
+        return;
+    }
+    for (size_t i = 0; i <= cchMax; i++)
+    {
+        pszLong[i] = (WCHAR)(L'a' + (i % 26));
+    }
+
+    DWORD cb = 0;
+    CHECK(KerbLogonPackSize(sizeof(KERB_INTERACTIVE_LOGON), KerbPackString(L""), KerbPackString(L""), KerbPackString(pszLong, cchMax), &cb));
+    CHECK_EQ(cb, (DWORD)(sizeof(KERB_INTERACTIVE_LOGON) + cchMax * sizeof(WCHAR)));
+    CHECK(!KerbLogonPackSize(sizeof(KERB_INTERACTIVE_LOGON), KerbPackString(L""), KerbPackString(L""), KerbPackString(pszLong, cchMax + 1), &cb));
+
+    // 恰好 32767 个字符：长度 65534 不被截断，内容完整
+    BYTE* rgb = nullptr;
+    CHECK_HR((KerbLogonPack<KERB_INTERACTIVE_UNLOCK_LOGON>(KerbWorkstationUnlockLogon, KerbPackString(L"D"), KerbPackString(pszLong, cchMax), KerbPackString(L"p"), &rgb, &cb)), S_OK);
+    if (rgb)
+    {
+        KERB_INTERACTIVE_UNLOCK_LOGON* pkiul = (KERB_INTERACTIVE_UNLOCK_LOGON*)rgb;
+        CHECK_EQ(pkiul->Logon.UserName.Length, (USHORT)(cchMax * sizeof(WCHAR)));
+        CHECK_EQ(pkiul->Logon.UserName.MaximumLength, (USHORT)(cchMax * sizeof(WCHAR)));
+        CHECK_EQ((ULONG_PTR)pkiul->Logon.UserName.Buffer, sizeof(KERB_INTERACTIVE_UNLOCK_LOGON) + sizeof(WCHAR));
+        CHECK(!memcmp(rgb + (ULONG_PTR)pkiul->Logon.UserName.Buffer, pszLong, cchMax * sizeof(WCHAR)));
+        CHECK_EQ((ULONG_PTR)pkiul->Logon.Password.Buffer, (ULONG_PTR)pkiul->Logon.UserName.Buffer + cchMax * sizeof(WCHAR));
+        CoTaskMemFree(rgb);
+    }
+
+    // 32768 个字符会被 USHORT 截断为 0，必须拒绝而不是静默打包
+    rgb = (BYTE*)1;
+    cb = 1;
+    CHECK_HR((KerbLogonPack<KERB_INTERACTIVE_LOGON>(KerbInteractiveLogon, KerbPackString(L""), KerbPackString(L"u"), KerbPackString(pszLong, cchMax + 1), &rgb, &cb)), E_INVALIDARG);
+    CHECK(rgb == nullptr);
+    CHECK_EQ(cb, 0u);
+
+    CoTaskMemFree(pszLong);
+}
+
+BENCH(PackBench)
+{
+    KERB_PACK_STRING domain = KerbPackString(L"WORKSTATION-01");
+    KERB_PACK_STRING user = KerbPackString(L"administrator");
+    KERB_PACK_STRING password = KerbPackString(L"correct horse battery staple");
+    DWORD cb = 0;
+    KerbLogonPackSize(sizeof(KERB_INTERACTIVE_UNLOCK_LOGON), domain, user, password, &cb);
+
+    volatile BYTE bSink = 0;
+    BenchRun("KerbLogonPack<UNLOCK_LOGON> (CoTaskMemAlloc)", 2000000, [&](DWORD) {
+        BYTE* rgb;
+        DWORD cbOut;
+        KerbLogonPack<KERB_INTERACTIVE_UNLOCK_LOGON>(KerbWorkstationUnlockLogon, domain, user, password, &rgb, &cbOut);
+        bSink = bSink + rgb[cbOut - 1];
+        CoTaskMemFree(rgb);
+    });
+
+    BYTE rgbBuffer[256];
+    BenchRun("KerbLogonPackInto<UNLOCK_LOGON>", 2000000, [&](DWORD) {
+        KerbLogonPackInto<KERB_INTERACTIVE_UNLOCK_LOGON>(KerbWorkstationUnlockLogon, domain, user, password, rgbBuffer);
+        bSink = bSink + rgbBuffer[cb - 1];
+    });
+
+    BenchRun("KerbLogonPack<UNLOCK_LOGON> + wcslen", 2000000, [&](DWORD) {
+        BYTE* rgb;
+        DWORD cbOut;
+        KerbLogonPack<KERB_INTERACTIVE_UNLOCK_LOGON>(KerbWorkstationUnlockLogon, KerbPackString(L"WORKSTATION-01"), KerbPackString(L"administrator"), KerbPackString(L"correct horse battery staple"), &rgb, &cbOut);
+        bSink = bSink + rgb[cbOut - 1];
+        CoTaskMemFree(rgb);
+    });
+}
+
+TEST_MAIN()
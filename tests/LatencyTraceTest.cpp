@@ -0,0 +1,293 @@
+#include "pch.h"
+#include "LatencyTrace.h"
+#include "ConfigFile.h"
+#include "Test.h"
+
+// LatencyTrace：分位数与文件头校验、环形缓冲区回绕后只保留最近 TRACE_RING_SIZE 条且按写入顺序、
+// 并发写入时快照按序列号丢弃正在写入的槽位（不会读到半条记录）、转储文件的文件头与记录读回
+
+#define TRACE_TEST_METHOD TM_SOURCE_FETCH
+
+static TRACE_RECORD* AllocRecords()
+{
+    return (TRACE_RECORD*)HeapAlloc(GetProcessHeap(), 0, sizeof(TRACE_RECORD) * TRACE_RING_SIZE);
+}
+
+TEST(PercentileNearestRank)
+{
+    const double rgValues[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    CHECK_EQ(TracePercentile(rgValues, 10, 0.0), 1.0);
+    CHECK_EQ(TracePercentile(rgValues, 10, 0.5), 6.0);
+    CHECK_EQ(TracePercentile(rgValues, 10, 0.9), 9.0);
+    CHECK_EQ(TracePercentile(rgValues, 10, 0.99), 10.0);
+    CHECK_EQ(TracePercentile(rgValues, 10, 1.0), 10.0);
+
+    // 超出范围的 p 取两端，单个值和空集合
+    CHECK_EQ(TracePercentile(rgValues, 10, 1.5), 10.0);
+    CHECK_EQ(TracePercentile(rgValues, 10, -1.0), 1.0);
+    CHECK_EQ(TracePercentile(rgValues, 1, 0.99), 1.0);
+    CHECK_EQ(TracePercentile(rgValues, 0, 0.5), 0.0);
+}
+
+TEST(FileHeaderValidation)
+{
+    TRACE_FILE_HEADER header = { TRACE_FILE_MAGIC, TRACE_FILE_VERSION, sizeof(TRACE_RECORD), 10000000, 0, 0 };
+    CHECK(TraceFileHeaderIsValid(header));
+
+    TRACE_FILE_HEADER bad = header;
+    bad.dwMagic ^= 1;
+    CHECK(!TraceFileHeaderIsValid(bad));
+    bad = header;
+    bad.wVersion++;
+    CHECK(!TraceFileHeaderIsValid(bad));
+    bad = header;
+    bad.cbRecord += 8;
+    CHECK(!TraceFileHeaderIsValid(bad));
+    bad = header;
+    bad.llFrequency = 0;
+    CHECK(!TraceFileHeaderIsValid(bad));
+}
+
+// 写满一圈再多写 100 条：只剩最近的 TRACE_RING_SIZE 条，最早的 100 条已被覆盖
+TEST(RingWrapKeepsNewestInOrder)
+{
+    const DWORD cExtra = 100;
+    for (DWORD i = 0; i < TRACE_RING_SIZE + cExtra; i++)
+    {
+        LatencyTraceRecord(TRACE_TEST_METHOD, i, i + 1);
+    }
+
+    TRACE_RECORD* prgRecords = AllocRecords();
+    CHECK_EQ(LatencyTraceSnapshot(prgRecords), (DWORD)TRACE_RING_SIZE);
+    bool fInOrder = true;
+    for (DWORD i = 0; i < TRACE_RING_SIZE; i++)
+    {
+        const TRACE_RECORD& record = prgRecords[i];
+        if ((record.llEnter != (LONGLONG)(cExtra + i)) || (record.llExit != record.llEnter + 1) ||
+            (record.wMethod != TRACE_TEST_METHOD) || (record.dwThreadId != GetCurrentThreadId()) || record.wReserved)
+        {
+            fInOrder = false;
+        }
+    }
+    CHECK(fInOrder);
+    HeapFree(GetProcessHeap(), 0, prgRecords);
+}
+
+// 每个开始时间只产生一条区间记录；未跟踪的场景不记录
+TEST(ScenarioSpanRecordedOnce)
+{
+    TRACE_RECORD* prgRecords = AllocRecords();
+    InterlockedExchange(&g_fTraceEnabled, TRUE);
+    LatencyTraceScenarioBegin(CPUS_LOGON);
+    LatencyTraceScenarioEnd(CPUS_LOGON);
+    LatencyTraceScenarioEnd(CPUS_LOGON);
+    LatencyTraceScenarioBegin(CPUS_CREDUI);
+    LatencyTraceScenarioEnd(CPUS_CREDUI);
+    LatencyTraceScenarioBegin(CPUS_UNLOCK_WORKSTATION);
+    LatencyTraceScenarioEnd(CPUS_UNLOCK_WORKSTATION);
+    InterlockedExchange(&g_fTraceEnabled, FALSE);
+
+    DWORD cRecords = LatencyTraceSnapshot(prgRecords);
+    CHECK_EQ(cRecords, (DWORD)TRACE_RING_SIZE);
+    CHECK_EQ(prgRecords[cRecords - 2].wMethod, TM_SPAN_LOGON_TO_SERIALIZATION);
+    CHECK_EQ(prgRecords[cRecords - 1].wMethod, TM_SPAN_UNLOCK_TO_SERIALIZATION);
+    CHECK(prgRecords[cRecords - 1].llExit >= prgRecords[cRecords - 1].llEnter);
+    CHECK_EQ(prgRecords[cRecords - 3].wMethod, TRACE_TEST_METHOD);
+
+    // 关闭跟踪时不记录
+    LatencyTraceScenarioBegin(CPUS_LOGON);
+    LatencyTraceScenarioEnd(CPUS_LOGON);
+    CHECK_EQ(LatencyTraceSnapshot(prgRecords), cRecords);
+    CHECK_EQ(prgRecords[cRecords - 1].wMethod, TM_SPAN_UNLOCK_TO_SERIALIZATION);
+    HeapFree(GetProcessHeap(), 0, prgRecords);
+}
+
+// 写入线程 t 的第 n 条记录：llEnter 为 (t << 32) | n，其余字段都由它推出，半条记录无法自洽
+struct TORN_CONTEXT
+{
+    DWORD dwThread;
+    volatile LONG* pfStop;
+};
+
+static bool RecordIsConsistent(const TRACE_RECORD& record)
+{
+    return (record.llExit == record.llEnter * 3 + 1) &&
+        (record.wMethod == (WORD)(record.llEnter % TM_NUM_METHODS)) &&
+        (record.wReserved == 0);
+}
+
+static DWORD WINAPI TraceWriterThread(LPVOID pv)
+{
+    TORN_CONTEXT* pContext = (TORN_CONTEXT*)pv;
+    LONGLONG llBase = (LONGLONG)(pContext->dwThread + 1) << 32;
+    for (LONGLONG n = 0; !ReadAcquire(pContext->pfStop); n++)
+    {
+        LONGLONG llEnter = llBase | n;
+        LatencyTraceRecord((TRACE_METHOD)(llEnter % TM_NUM_METHODS), llEnter, llEnter * 3 + 1);
+    }
+    return 0;
+}
+
+// 快照与多个写入线程并发一秒：返回的每条记录都完整，且同一线程的记录保持写入顺序。
+// 半条记录只在复制途中槽位被改写时出现，单核机器上要靠抢占碰上，多核上几乎每轮都会发生
+TEST(ConcurrentSnapshotRejectsTornSlots)
+{
+    const DWORD cWriters = 3;
+    volatile LONG fStop = FALSE;
+    TORN_CONTEXT rgContexts[cWriters];
+    HANDLE rghThreads[cWriters];
+    for (DWORD i = 0; i < cWriters; i++)
+    {
+        rgContexts[i].dwThread = i;
+        rgContexts[i].pfStop = &fStop;
+        rghThreads[i] = CreateThread(nullptr, 0, TraceWriterThread, &rgContexts[i], 0, nullptr);
+    }
+
+    TRACE_RECORD* prgRecords = AllocRecords();
+    DWORD cTorn = 0;
+    DWORD cOutOfOrder = 0;
+    ULONGLONG cRecordsSeen = 0;
+    ULONGLONG ullDeadline = GetTickCount64() + 1000;
+    while (GetTickCount64() < ullDeadline)
+    {
+        LONGLONG rgllLast[cWriters + 1] = { 0 };
+        DWORD cRecords = LatencyTraceSnapshot(prgRecords);
+        cRecordsSeen += cRecords;
+        for (DWORD i = 0; i < cRecords; i++)
+        {
+            const TRACE_RECORD& record = prgRecords[i];
+            if (record.dwThreadId == GetCurrentThreadId())
+            {
+                // 前面的用例留在缓冲区中、尚未被覆盖的记录
+                continue;
+            }
+            DWORD dwWriter = (DWORD)(record.llEnter >> 32);
+            if (!RecordIsConsistent(record) || !dwWriter || (dwWriter > cWriters))
+            {
+                cTorn++;
+                continue;
+            }
+            if (record.llEnter <= rgllLast[dwWriter])
+            {
+                cOutOfOrder++;
+            }
+            rgllLast[dwWriter] = record.llEnter;
+        }
+    }
+
+    InterlockedExchange(&fStop, TRUE);
+    WaitForMultipleObjects(cWriters, rghThreads, TRUE, INFINITE);
+    for (DWORD i = 0; i < cWriters; i++)
+    {
+        CloseHandle(rghThreads[i]);
+    }
+    HeapFree(GetProcessHeap(), 0, prgRecords);
+
+    CHECK_EQ(cTorn, 0u);
+    CHECK_EQ(cOutOfOrder, 0u);
+    CHECK(cRecordsSeen > 0);
+}
+
+static bool ReadTraceFile(TRACE_FILE_HEADER* pHeader, TRACE_RECORD* prgRecords, DWORD* pcbRead)
+{
+    *pcbRead = 0;
+    HANDLE hFile = CreateFileW(TRACE_FILE_PATH, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    DWORD cbHeader = 0;
+    DWORD cbRecords = 0;
+    bool fOk = ReadFile(hFile, pHeader, sizeof(*pHeader), &cbHeader, nullptr) &&
+        (cbHeader == sizeof(*pHeader)) &&
+        ReadFile(hFile, prgRecords, sizeof(TRACE_RECORD) * TRACE_RING_SIZE, &cbRecords, nullptr);
+    CloseHandle(hFile);
+    *pcbRead = cbHeader + cbRecords;
+    return fOk;
+}
+
+// 转储在线程池中写文件：等到文件内容与文件头中的记录数一致
+static bool WaitForTraceFile(TRACE_FILE_HEADER* pHeader, TRACE_RECORD* prgRecords)
+{
+    for (DWORD i = 0; i < 500; i++)
+    {
+        DWORD cbRead = 0;
+        if (ReadTraceFile(pHeader, prgRecords, &cbRead) &&
+            (cbRead == sizeof(*pHeader) + pHeader->cRecords * sizeof(TRACE_RECORD)) && pHeader->cRecords)
+        {
+            return true;
+        }
+        Sleep(10);
+    }
+    return false;
+}
+
+// 转储写出的文件头可通过 tracedump 的校验，记录与转储前的快照逐字节一致；
+// 普通用户抢先创建的文件被替换为 SYSTEM 所有
+TEST(DumpFileRoundTrip)
+{
+    WinCompatClearFiles();
+    for (DWORD i = 0; i < 10; i++)
+    {
+        LatencyTraceRecord(TM_PROVIDER_GETCREDENTIALAT, 1000 + i, 2000 + i);
+    }
+    TRACE_RECORD* prgExpected = AllocRecords();
+    DWORD cExpected = LatencyTraceSnapshot(prgExpected);
+
+    // 跟踪关闭时不转储
+    LatencyTraceQueueDump();
+    Sleep(20);
+    DWORD cbRead = 0;
+    TRACE_FILE_HEADER header = { 0 };
+    TRACE_RECORD* prgRecords = AllocRecords();
+    CHECK(!ReadTraceFile(&header, prgRecords, &cbRead));
+
+    HANDLE hFile = CreateFileW(TRACE_FILE_PATH, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    CHECK(hFile != INVALID_HANDLE_VALUE);
+    CloseHandle(hFile);
+    CHECK(WinCompatSetFileOwner(TRACE_FILE_PATH, L"S-1-5-21-1000-2000-3000-1001"));
+
+    InterlockedExchange(&g_fTraceEnabled, TRUE);
+    LatencyTraceQueueDump();
+    bool fWritten = WaitForTraceFile(&header, prgRecords);
+    InterlockedExchange(&g_fTraceEnabled, FALSE);
+    CHECK(fWritten);
+    CHECK(TraceFileHeaderIsValid(header));
+    CHECK_EQ(header.cRecords, cExpected);
+    CHECK(!memcmp(prgRecords, prgExpected, cExpected * sizeof(TRACE_RECORD)));
+    CHECK_EQ(prgRecords[cExpected - 1].wMethod, TM_PROVIDER_GETCREDENTIALAT);
+    CHECK_EQ(prgRecords[cExpected - 1].llEnter, 1009);
+
+    hFile = CreateFileW(TRACE_FILE_PATH, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    CHECK(hFile != INVALID_HANDLE_VALUE);
+    CHECK_HR(ConfigCheckFileOwner(hFile), S_OK);
+    CloseHandle(hFile);
+
+    HeapFree(GetProcessHeap(), 0, prgRecords);
+    HeapFree(GetProcessHeap(), 0, prgExpected);
+    WinCompatClearFiles();
+}
+
+BENCH(LatencyTraceBench)
+{
+    BenchRun("LatencyTraceRecord", 10000000, [](DWORD i) {
+        LatencyTraceRecord(TRACE_TEST_METHOD, i, i + 1);
+    });
+
+    TRACE_RECORD* prgRecords = AllocRecords();
+    BenchRun("LatencyTraceSnapshot（4096 条）", 2000, [&](DWORD) {
+        LatencyTraceSnapshot(prgRecords);
+    });
+    HeapFree(GetProcessHeap(), 0, prgRecords);
+
+    InterlockedExchange(&g_fTraceEnabled, TRUE);
+    BenchRun("TRACE_SCOPE（开启）", 5000000, [](DWORD) {
+        TRACE_SCOPE(TRACE_TEST_METHOD);
+    });
+    InterlockedExchange(&g_fTraceEnabled, FALSE);
+    BenchRun("TRACE_SCOPE（关闭）", 5000000, [](DWORD) {
+        TRACE_SCOPE(TRACE_TEST_METHOD);
+    });
+}
+
+TEST_MAIN()
@@ -0,0 +1,461 @@
+#include "pch.h"
+#include "CredentialProvider.h"
+#include "Test.h"
+#include <vector>
+#include <algorithm>
+
+// 登录流程模拟：与 tools/logonsim.cpp 相同，按 LogonUI 的调用顺序驱动提供程序和凭据
+// DllGetClassObject -> CreateInstance -> SetUsageScenario -> Advise -> GetFieldDescriptorCount/GetFieldDescriptorAt
+// -> GetCredentialCount -> GetCredentialAt -> SetSelected -> GetSerialization -> ReportResult，
+// 账户来自注册表来源。检查 CPUS_LOGON 和 CPUS_UNLOCK_WORKSTATION 每轮都自动提交、
+// 序列化内容正确，且从 SetUsageScenario 到 GetSerialization 返回的耗时在期限内；
+// 性能测试输出两个场景的耗时分位数
+
+STDAPI DllGetClassObject(REFCLSID rclsid, REFIID riid, void** ppv);
+STDAPI DllCanUnloadNow();
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+static const WCHAR c_szUserSid[] = L"S-1-5-21-7-1001";
+static const WCHAR c_szOtherSid[] = L"S-1-5-21-7-1002";
+static const WCHAR c_szUserName[] = L"alice";
+static const WCHAR c_szPassword[] = L"correct horse";
+static const WCHAR c_szComputerName[] = L"WINUNLOCK-TEST";
+
+#define LOGONSIM_STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+#define LOGONSIM_ITERATIONS 200
+
+// 预热轮数：首轮会初始化字符串表、配置快照等只加载一次的数据，不计入统计
+#define LOGONSIM_WARMUP_ITERATIONS 16
+
+// 到序列化的耗时上限：凭据已在 SetUsageScenario 中预取，LogonUI 线程上只剩快照查询和打包。
+// 中位数按消毒器构建和单核机器放宽；p99 不得达到 LogonUI 线程等待预取的上限
+static const double c_dblMedianBudgetMs = 10.0;
+static const double c_dblP99BudgetMs = CREDENTIAL_PREFETCH_WAIT_MS;
+
+// 未自动提交时等待 CredentialsChanged 的时间
+static const DWORD c_dwWaitMs = 1000;
+
+// LogonUI 一侧的 ICredentialProviderEvents：记录通知并唤醒等待的模拟线程
+class SimEvents : public ICredentialProviderEvents
+{
+public:
+    SimEvents() : _cRef(1), _cNotifications(0)
+    {
+        _hChanged = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    }
+
+    ~SimEvents()
+    {
+        CloseHandle(_hChanged);
+    }
+
+    IFACEMETHODIMP_(ULONG) AddRef()
+    {
+        return InterlockedIncrement(&_cRef);
+    }
+
+    IFACEMETHODIMP_(ULONG) Release()
+    {
+        // 栈上对象，不随引用计数释放
+        return InterlockedDecrement(&_cRef);
+    }
+
+    IFACEMETHODIMP QueryInterface(REFIID riid, void** ppv)
+    {
+        static const QITAB qit[] =
+        {
+            QITABENT(SimEvents, ICredentialProviderEvents),
+            { 0 },
+        };
+        return QISearch(this, qit, riid, ppv);
+    }
+
+    IFACEMETHODIMP CredentialsChanged(UINT_PTR upAdviseContext)
+    {
+        UNREFERENCED_PARAMETER(upAdviseContext);
+        InterlockedIncrement(&_cNotifications);
+        SetEvent(_hChanged);
+        return S_OK;
+    }
+
+    void Reset()
+    {
+        ResetEvent(_hChanged);
+    }
+
+    bool Wait(DWORD dwMilliseconds)
+    {
+        return WaitForSingleObject(_hChanged, dwMilliseconds) == WAIT_OBJECT_0;
+    }
+
+    LONG GetRefCount() const
+    {
+        return _cRef;
+    }
+
+private:
+    volatile LONG _cRef;
+    volatile LONG _cNotifications;
+    HANDLE _hChanged;
+};
+
+// 一个场景的统计
+struct SIM_RESULT
+{
+    std::vector<double> serializeMs;    // 返回凭据的轮次，SetUsageScenario 到 GetSerialization 返回
+    DWORD cSerialized;
+    DWORD cNotFinished;                 // 未返回凭据
+    DWORD cNoTile;
+    DWORD cRequeried;                   // 收到 CredentialsChanged 后重新查询的轮次
+    DWORD cBadSerialization;            // 序列化内容与配置的账户不符
+    DWORD cFailed;
+    HRESULT hrFirstFailure;
+};
+
+// 管理员在注册表中配置的单个账户；会话所有者决定解锁场景的磁贴
+static void ConfigureAccount(PCWSTR pszSessionUserSid)
+{
+    WinCompatClearRegistry();
+    WinCompatClearFiles();
+    WinCompatClearAccounts();
+    WinCompatSetAccount(c_szUserSid, c_szComputerName, c_szUserName);
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"CredentialSources", REG_MULTI_SZ, L"registry\0", sizeof(L"registry\0"));
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"Username", REG_SZ, c_szUserName, sizeof(c_szUserName));
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"Password", REG_SZ, c_szPassword, sizeof(c_szPassword));
+    WinCompatSetSessionUser(pszSessionUserSid);
+}
+
+static void FreeFieldDescriptor(CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* pcpfd)
+{
+    if (pcpfd)
+    {
+        CoTaskMemFree(pcpfd->pszLabel);
+        CoTaskMemFree(pcpfd);
+    }
+}
+
+// 打包后的 UNICODE_STRING.Buffer 是相对序列化缓冲区起始的偏移
+static bool PackedStringEquals(const CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs, const UNICODE_STRING& str, PCWSTR pszExpected)
+{
+    size_t cb = wcslen(pszExpected) * sizeof(WCHAR);
+    size_t ibBuffer = (size_t)str.Buffer;
+    return (str.Length == cb) && (ibBuffer + cb <= pcpcs->cbSerialization) &&
+        !memcmp(pcpcs->rgbSerialization + ibBuffer, pszExpected, cb);
+}
+
+static bool SerializationMatches(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, const CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs)
+{
+    if (!pcpcs->rgbSerialization || (pcpcs->cbSerialization < sizeof(KERB_INTERACTIVE_UNLOCK_LOGON)) ||
+        !IsEqualCLSID(pcpcs->clsidCredentialProvider, CLSID_WinUnlockProvider) || (pcpcs->ulAuthenticationPackage != 1))
+    {
+        return false;
+    }
+    const KERB_INTERACTIVE_LOGON* pLogon = &((const KERB_INTERACTIVE_UNLOCK_LOGON*)pcpcs->rgbSerialization)->Logon;
+    KERB_LOGON_SUBMIT_TYPE messageType = (cpus == CPUS_UNLOCK_WORKSTATION) ? KerbWorkstationUnlockLogon : KerbInteractiveLogon;
+    return (pLogon->MessageType == messageType) &&
+        PackedStringEquals(pcpcs, pLogon->LogonDomainName, c_szComputerName) &&
+        PackedStringEquals(pcpcs, pLogon->UserName, c_szUserName) &&
+        PackedStringEquals(pcpcs, pLogon->Password, c_szPassword);
+}
+
+// 与 LogonUI 相同：枚举磁贴并选中默认磁贴，返回选中的凭据
+static HRESULT SelectCredential(ICredentialProvider* pcp, ICredentialProviderCredential** ppcpc, BOOL* pbAutoLogon)
+{
+    *ppcpc = nullptr;
+    *pbAutoLogon = FALSE;
+
+    DWORD cCredentials = 0;
+    DWORD dwDefault = CREDENTIAL_PROVIDER_NO_DEFAULT;
+    BOOL bAutoLogonWithDefault = FALSE;
+    HRESULT hr = pcp->GetCredentialCount(&cCredentials, &dwDefault, &bAutoLogonWithDefault);
+    if (FAILED(hr) || !cCredentials)
+    {
+        return hr;
+    }
+
+    ICredentialProviderCredential* pcpc = nullptr;
+    hr = pcp->GetCredentialAt((dwDefault < cCredentials) ? dwDefault : 0, &pcpc);
+    if (SUCCEEDED(hr))
+    {
+        BOOL bAutoLogon = FALSE;
+        hr = pcpc->SetSelected(&bAutoLogon);
+        if (SUCCEEDED(hr))
+        {
+            *ppcpc = pcpc;
+            *pbAutoLogon = bAutoLogon || bAutoLogonWithDefault;
+        }
+        else
+        {
+            pcpc->Release();
+        }
+    }
+    return hr;
+}
+
+static HRESULT RunIteration(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, SimEvents* pEvents, SIM_RESULT* pResult)
+{
+    IClassFactory* pcf = nullptr;
+    HRESULT hr = DllGetClassObject(CLSID_WinUnlockProvider, IID_PPV_ARGS(&pcf));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ICredentialProvider* pcp = nullptr;
+    hr = pcf->CreateInstance(nullptr, IID_PPV_ARGS(&pcp));
+    pcf->Release();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    pEvents->Reset();
+    LARGE_INTEGER liStart;
+    QueryPerformanceCounter(&liStart);
+    hr = pcp->SetUsageScenario(cpus, 0);
+    if (SUCCEEDED(hr))
+    {
+        hr = pcp->Advise(pEvents, (UINT_PTR)cpus);
+    }
+
+    DWORD cFields = 0;
+    if (SUCCEEDED(hr))
+    {
+        hr = pcp->GetFieldDescriptorCount(&cFields);
+    }
+    for (DWORD i = 0; SUCCEEDED(hr) && (i < cFields); i++)
+    {
+        CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* pcpfd = nullptr;
+        hr = pcp->GetFieldDescriptorAt(i, &pcpfd);
+        FreeFieldDescriptor(pcpfd);
+    }
+
+    ICredentialProviderCredential* pcpc = nullptr;
+    BOOL bAutoLogon = FALSE;
+    if (SUCCEEDED(hr))
+    {
+        hr = SelectCredential(pcp, &pcpc, &bAutoLogon);
+    }
+
+    // 快照未在期限内就绪时磁贴先按“不自动解锁”显示，预取完成后提供程序通知 LogonUI 重新查询
+    if (SUCCEEDED(hr) && !bAutoLogon && pEvents->Wait(c_dwWaitMs))
+    {
+        pResult->cRequeried++;
+        if (pcpc)
+        {
+            pcpc->Release();
+            pcpc = nullptr;
+        }
+        hr = SelectCredential(pcp, &pcpc, &bAutoLogon);
+    }
+
+    if (SUCCEEDED(hr) && !pcpc)
+    {
+        pResult->cNoTile++;
+    }
+    else if (SUCCEEDED(hr))
+    {
+        CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE cpgsr = CPGSR_NO_CREDENTIAL_NOT_FINISHED;
+        CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION cpcs = { 0 };
+        PWSTR pszStatus = nullptr;
+        CREDENTIAL_PROVIDER_STATUS_ICON cpsi = CPSI_NONE;
+        hr = pcpc->GetSerialization(&cpgsr, &cpcs, &pszStatus, &cpsi);
+        LARGE_INTEGER liEnd;
+        QueryPerformanceCounter(&liEnd);
+        CoTaskMemFree(pszStatus);
+
+        if (SUCCEEDED(hr) && (cpgsr == CPGSR_RETURN_CREDENTIAL_FINISHED))
+        {
+            LARGE_INTEGER liFrequency;
+            QueryPerformanceFrequency(&liFrequency);
+            pResult->serializeMs.push_back((double)(liEnd.QuadPart - liStart.QuadPart) * 1000.0 / liFrequency.QuadPart);
+            pResult->cSerialized++;
+            if (!SerializationMatches(cpus, &cpcs))
+            {
+                pResult->cBadSerialization++;
+            }
+
+            // 序列化缓冲区含密码，释放前清零
+            if (cpcs.rgbSerialization)
+            {
+                SecureZeroMemory(cpcs.rgbSerialization, cpcs.cbSerialization);
+                CoTaskMemFree(cpcs.rgbSerialization);
+            }
+
+            PWSTR pszResult = nullptr;
+            CREDENTIAL_PROVIDER_STATUS_ICON cpsiResult = CPSI_NONE;
+            pcpc->ReportResult(LOGONSIM_STATUS_SUCCESS, LOGONSIM_STATUS_SUCCESS, &pszResult, &cpsiResult);
+            CoTaskMemFree(pszResult);
+        }
+        else if (SUCCEEDED(hr))
+        {
+            pResult->cNotFinished++;
+        }
+    }
+
+    if (pcpc)
+    {
+        pcpc->SetDeselected();
+        pcpc->Release();
+    }
+    pcp->UnAdvise();
+    pcp->Release();
+    return hr;
+}
+
+static void RunScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, DWORD cIterations, SimEvents* pEvents, SIM_RESULT* pResult)
+{
+    SIM_RESULT warmup = {};
+    for (DWORD i = 0; i < LOGONSIM_WARMUP_ITERATIONS; i++)
+    {
+        RunIteration(cpus, pEvents, &warmup);
+    }
+
+    *pResult = SIM_RESULT();
+    pResult->serializeMs.reserve(cIterations);
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        HRESULT hr = RunIteration(cpus, pEvents, pResult);
+        if (FAILED(hr) && (pResult->cFailed++ == 0))
+        {
+            pResult->hrFirstFailure = hr;
+        }
+    }
+    std::sort(pResult->serializeMs.begin(), pResult->serializeMs.end());
+}
+
+static double Percentile(const SIM_RESULT& result, double dblFraction)
+{
+    return result.serializeMs[(size_t)(dblFraction * (result.serializeMs.size() - 1))];
+}
+
+// 每轮都自动提交了配置的账户，且到序列化的耗时在期限内
+static void CheckScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus)
+{
+    SimEvents events;
+    SIM_RESULT result;
+    RunScenario(cpus, LOGONSIM_ITERATIONS, &events, &result);
+    CHECK_EQ(result.cFailed, 0u);
+    CHECK_HR(result.hrFirstFailure, S_OK);
+    CHECK_EQ(result.cNoTile, 0u);
+    CHECK_EQ(result.cNotFinished, 0u);
+    CHECK_EQ(result.cSerialized, (DWORD)LOGONSIM_ITERATIONS);
+    CHECK_EQ(result.cBadSerialization, 0u);
+    CHECK_EQ(result.cRequeried, 0u);
+    if (!result.serializeMs.empty())
+    {
+        CHECK(Percentile(result, 0.50) < c_dblMedianBudgetMs);
+        CHECK(Percentile(result, 0.99) < c_dblP99BudgetMs);
+    }
+    CHECK_EQ(events.GetRefCount(), 1);
+}
+
+TEST(ClassFactoryContract)
+{
+    ConfigureAccount(c_szUserSid);
+    IClassFactory* pcf = nullptr;
+    CHECK_HR(DllGetClassObject(IID_IUnknown, IID_PPV_ARGS(&pcf)), CLASS_E_CLASSNOTAVAILABLE);
+    CHECK(!pcf);
+    CHECK_HR(DllGetClassObject(CLSID_WinUnlockProvider, IID_ICredentialProvider, (void**)&pcf), E_NOINTERFACE);
+    CHECK_HR(DllGetClassObject(CLSID_WinUnlockProvider, IID_PPV_ARGS(&pcf)), S_OK);
+    if (!pcf)
+    {
+        return;
+    }
+    CHECK_HR(DllCanUnloadNow(), S_FALSE);
+
+    IUnknown* punkOuter = pcf;
+    ICredentialProvider* pcp = nullptr;
+    CHECK_HR(pcf->CreateInstance(punkOuter, IID_PPV_ARGS(&pcp)), CLASS_E_NOAGGREGATION);
+    CHECK_HR(pcf->CreateInstance(nullptr, IID_ICredentialProviderCredential, (void**)&pcp), E_NOINTERFACE);
+    CHECK(!pcp);
+    CHECK_HR(pcf->CreateInstance(nullptr, IID_PPV_ARGS(&pcp)), S_OK);
+    pcf->Release();
+    if (pcp)
+    {
+        // 只支持登录和解锁
+        CHECK_HR(pcp->SetUsageScenario(CPUS_CREDUI, 0), E_INVALIDARG);
+        IUnknown* punk = nullptr;
+        CHECK_HR(pcp->QueryInterface(IID_PPV_ARGS(&punk)), S_OK);
+        CHECK(punk == pcp);
+        if (punk)
+        {
+            punk->Release();
+        }
+        pcp->Release();
+    }
+}
+
+TEST(LogonSerializesWithinBudget)
+{
+    ConfigureAccount(c_szUserSid);
+    CheckScenario(CPUS_LOGON);
+}
+
+TEST(UnlockSerializesWithinBudget)
+{
+    ConfigureAccount(c_szUserSid);
+    CheckScenario(CPUS_UNLOCK_WORKSTATION);
+}
+
+// 解锁场景只为锁定会话的所有者呈现磁贴；登录场景不受影响
+TEST(UnlockOnlyForSessionOwner)
+{
+    ConfigureAccount(c_szOtherSid);
+    SimEvents events;
+    SIM_RESULT unlock = {};
+    CHECK_HR(RunIteration(CPUS_UNLOCK_WORKSTATION, &events, &unlock), S_OK);
+    CHECK_EQ(unlock.cNoTile, 1u);
+    CHECK_EQ(unlock.cSerialized, 0u);
+
+    ConfigureAccount(nullptr);
+    SIM_RESULT noSession = {};
+    CHECK_HR(RunIteration(CPUS_UNLOCK_WORKSTATION, &events, &noSession), S_OK);
+    CHECK_EQ(noSession.cNoTile, 1u);
+
+    SIM_RESULT logon = {};
+    CHECK_HR(RunIteration(CPUS_LOGON, &events, &logon), S_OK);
+    CHECK_EQ(logon.cSerialized, 1u);
+    CHECK_EQ(logon.cBadSerialization, 0u);
+}
+
+// 没有配置账户：不呈现磁贴，也不自动提交
+TEST(NoAccountNoTile)
+{
+    ConfigureAccount(c_szUserSid);
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, c_szConfigKey, L"Username", REG_SZ, nullptr, 0);
+    SimEvents events;
+    SIM_RESULT result = {};
+    CHECK_HR(RunIteration(CPUS_LOGON, &events, &result), S_OK);
+    CHECK_EQ(result.cNoTile, 1u);
+    CHECK_EQ(result.cSerialized, 0u);
+}
+
+BENCH(LogonSimBench)
+{
+    static const struct
+    {
+        CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus;
+        const char* pszName;
+    } c_rgScenarios[] =
+    {
+        { CPUS_LOGON, "CPUS_LOGON" },
+        { CPUS_UNLOCK_WORKSTATION, "CPUS_UNLOCK_WORKSTATION" },
+    };
+
+    ConfigureAccount(c_szUserSid);
+    for (const auto& scenario : c_rgScenarios)
+    {
+        SimEvents events;
+        SIM_RESULT result;
+        RunScenario(scenario.cpus, 2000, &events, &result);
+        printf("%-24s 返回凭据 %u，重新查询 %u，失败 %u\n", scenario.pszName, result.cSerialized, result.cRequeried, result.cFailed);
+        if (!result.serializeMs.empty())
+        {
+            printf("  到序列化的耗时（毫秒）: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+                Percentile(result, 0.50), Percentile(result, 0.90), Percentile(result, 0.99), result.serializeMs.back());
+        }
+    }
+}
+
+TEST_MAIN()
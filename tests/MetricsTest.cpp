@@ -0,0 +1,461 @@
+#include "pch.h"
+#include "Metrics.h"
+#include "LatencyTrace.h"
+#include "Test.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// 指标：分桶边界与相对误差、Prometheus 文本（累计桶、+Inf 与 _count 一致、HELP/TYPE 每个名称一次）、
+// 耗时和结果计数落在正确的序列上、缓冲区不足、经兼容层的命名管道（Unix 套接字）读取，
+// 以及采集与多线程记录并发时每次读到的直方图自洽、最终计数不丢失；性能测试为记录、生成文本和一次读取的耗时
+
+// 兼容层中 ProcessIdToSessionId 总是返回会话 1
+#define TEST_SESSION_ID 1
+
+typedef std::map<std::string, double> METRIC_VALUES;
+
+// 开启指标并开始监听；MetricsInitialize 只在首次调用时生效，之后的测试共用同一个监听
+static void EnableMetrics()
+{
+    DWORD dwEnabled = 1;
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"MetricsEnabled", REG_DWORD, &dwEnabled, sizeof(dwEnabled));
+    MetricsInitialize();
+}
+
+static LONGLONG MicrosecondsToTicks(ULONGLONG ullUs)
+{
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    return (LONGLONG)(ullUs * (ULONGLONG)liFrequency.QuadPart / 1000000);
+}
+
+static std::string Render()
+{
+    std::vector<char> text(METRICS_TEXT_MAX);
+    size_t cch = 0;
+    HRESULT hr = MetricsRender(text.data(), text.size(), &cch);
+    CHECK_HR(hr, S_OK);
+    return std::string(text.data(), SUCCEEDED(hr) ? cch : 0);
+}
+
+// 样本行 "名称{标签} 值" -> 值；注释行跳过
+static METRIC_VALUES ParseSamples(const std::string& text)
+{
+    METRIC_VALUES values;
+    size_t ich = 0;
+    while (ich < text.size())
+    {
+        size_t ichEnd = text.find('\n', ich);
+        if (ichEnd == std::string::npos)
+        {
+            ichEnd = text.size();
+        }
+        std::string line = text.substr(ich, ichEnd - ich);
+        ich = ichEnd + 1;
+        size_t ichSpace = line.rfind(' ');
+        if (line.empty() || (line[0] == '#') || (ichSpace == std::string::npos))
+        {
+            continue;
+        }
+        values[line.substr(0, ichSpace)] = strtod(line.c_str() + ichSpace + 1, nullptr);
+    }
+    return values;
+}
+
+static std::string BucketSample(PCSTR pszName, PCSTR pszLabels, DWORD dwBucket)
+{
+    char szLe[32] = "+Inf";
+    if (dwBucket < METRICS_HISTOGRAM_BUCKETS - 1)
+    {
+        snprintf(szLe, sizeof(szLe), "%.9g", (double)MetricsBucketBound(dwBucket) / 1e6);
+    }
+    return std::string(pszName) + "_bucket{" + pszLabels + (pszLabels[0] ? "," : "") + "le=\"" + szLe + "\"}";
+}
+
+static std::string SeriesSample(PCSTR pszName, PCSTR pszSuffix, PCSTR pszLabels)
+{
+    return std::string(pszName) + pszSuffix + (pszLabels[0] ? std::string("{") + pszLabels + "}" : std::string());
+}
+
+// 直方图自洽：各桶累计不减，+Inf 等于 _count；返回 _count
+static double CheckHistogram(const METRIC_VALUES& values, PCSTR pszName, PCSTR pszLabels)
+{
+    double dPrevious = 0;
+    bool fConsistent = true;
+    for (DWORD i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+    {
+        auto it = values.find(BucketSample(pszName, pszLabels, i));
+        if (it == values.end() || (it->second < dPrevious))
+        {
+            fConsistent = false;
+            break;
+        }
+        dPrevious = it->second;
+    }
+    auto itCount = values.find(SeriesSample(pszName, "_count", pszLabels));
+    CHECK(fConsistent && (itCount != values.end()) && (itCount->second == dPrevious));
+    return dPrevious;
+}
+
+static bool NearlyEqual(double d1, double d2, double dTolerance)
+{
+    return (d1 - d2 < dTolerance) && (d2 - d1 < dTolerance);
+}
+
+static double Delta(const METRIC_VALUES& before, const METRIC_VALUES& after, const std::string& sample)
+{
+    auto itBefore = before.find(sample);
+    auto itAfter = after.find(sample);
+    CHECK(itAfter != after.end());
+    return ((itAfter != after.end()) ? itAfter->second : 0) - ((itBefore != before.end()) ? itBefore->second : 0);
+}
+
+// 监听在线程池中创建管道：管道出现之前重试
+static HANDLE OpenMetricsPipe()
+{
+    WCHAR szPipeName[64];
+    StringCchPrintfW(szPipeName, ARRAYSIZE(szPipeName), METRICS_PIPE_FORMAT, TEST_SESSION_ID);
+    for (DWORD i = 0; i < 500; i++)
+    {
+        HANDLE hPipe = CreateFileW(szPipeName, GENERIC_READ | FILE_WRITE_ATTRIBUTES, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if ((hPipe != INVALID_HANDLE_VALUE) || (GetLastError() != ERROR_FILE_NOT_FOUND))
+        {
+            return hPipe;
+        }
+        Sleep(10);
+    }
+    return INVALID_HANDLE_VALUE;
+}
+
+// 与 tools\metricsscrape.cpp 相同：消息模式读取一条完整的文本后关闭连接。
+// 兼容层的管道在 ERROR_MORE_DATA 时丢弃剩余部分，因此一次读取整条消息
+static HRESULT Scrape(std::string& text)
+{
+    text.clear();
+    HANDLE hPipe = OpenMetricsPipe();
+    if (hPipe == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    HRESULT hr = S_OK;
+    DWORD dwMode = PIPE_READMODE_MESSAGE;
+    if (!SetNamedPipeHandleState(hPipe, &dwMode, nullptr, nullptr))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (SUCCEEDED(hr))
+    {
+        std::vector<char> rgch(METRICS_TEXT_MAX);
+        DWORD cbRead = 0;
+        if (ReadFile(hPipe, rgch.data(), (DWORD)rgch.size(), &cbRead, nullptr))
+        {
+            text.assign(rgch.data(), cbRead);
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    CloseHandle(hPipe);
+    return hr;
+}
+
+TEST(BucketBoundaries)
+{
+    // 4 微秒以下每个值一桶
+    for (ULONGLONG i = 0; i < 4; i++)
+    {
+        CHECK_EQ(MetricsBucketIndex(i), (DWORD)i);
+        CHECK_EQ(MetricsBucketBound((DWORD)i), i + 1);
+    }
+
+    // 上界不含：上界减一仍在本桶，上界落在下一桶；之后每桶宽度不超过下界的 25%
+    bool fContiguous = true;
+    bool fWithinError = true;
+    for (DWORD i = 0; i < METRICS_HISTOGRAM_BUCKETS - 1; i++)
+    {
+        ULONGLONG ullBound = MetricsBucketBound(i);
+        if ((MetricsBucketIndex(ullBound - 1) != i) || (MetricsBucketIndex(ullBound) != i + 1))
+        {
+            fContiguous = false;
+        }
+        if (i >= 4)
+        {
+            ULONGLONG ullLower = MetricsBucketBound(i - 1);
+            if ((ullBound - ullLower) * 4 > ullLower)
+            {
+                fWithinError = false;
+            }
+        }
+    }
+    CHECK(fContiguous);
+    CHECK(fWithinError);
+
+    // 超出范围的值计入最后一桶
+    const ULONGLONG ullMax = 1ULL << (METRICS_MAX_EXPONENT + 1);
+    CHECK_EQ(MetricsBucketIndex(ullMax - 1), (DWORD)METRICS_HISTOGRAM_BUCKETS - 1);
+    CHECK_EQ(MetricsBucketIndex(ullMax), (DWORD)METRICS_HISTOGRAM_BUCKETS - 1);
+    CHECK_EQ(MetricsBucketIndex(MAXULONGLONG), (DWORD)METRICS_HISTOGRAM_BUCKETS - 1);
+    CHECK_EQ(MetricsBucketBound(METRICS_HISTOGRAM_BUCKETS - 1), ullMax);
+}
+
+TEST(RenderedTextIsWellFormed)
+{
+    EnableMetrics();
+    std::string text = Render();
+    CHECK(!text.empty() && (text.back() == '\n'));
+
+    // 三个方法共用一个指标名：HELP/TYPE 只出现一次
+    std::map<std::string, int> cHelp;
+    std::map<std::string, int> cType;
+    size_t ich = 0;
+    while ((ich = text.find("# ", ich)) != std::string::npos)
+    {
+        size_t ichName = ich + 7;
+        std::string name = text.substr(ichName, text.find(' ', ichName) - ichName);
+        if (!text.compare(ich, 7, "# HELP "))
+        {
+            cHelp[name]++;
+        }
+        else if (!text.compare(ich, 7, "# TYPE "))
+        {
+            cType[name]++;
+        }
+        ich = text.find('\n', ich);
+    }
+    CHECK_EQ(cHelp.size(), (size_t)8);
+    CHECK(cHelp == cType);
+    CHECK_EQ(cHelp["winunlock_method_duration_seconds"], 1);
+    CHECK(text.find("# TYPE winunlock_method_duration_seconds histogram\n") != std::string::npos);
+    CHECK(text.find("# TYPE winunlock_results_total counter\n") != std::string::npos);
+    CHECK(text.find("# TYPE winunlock_config_generation gauge\n") != std::string::npos);
+
+    // 每个直方图 METRICS_HISTOGRAM_BUCKETS 个桶（含 +Inf）加 _sum 和 _count；结果计数 3 个场景 × 4 种结果；另有 5 个单值
+    METRIC_VALUES values = ParseSamples(text);
+    CHECK_EQ(values.size(), (size_t)(MH_NUM_HISTOGRAMS * (METRICS_HISTOGRAM_BUCKETS + 2) + MS_NUM_SCENARIOS * 4 + 5));
+    CheckHistogram(values, "winunlock_method_duration_seconds", "method=\"GetCredentialCount\"");
+    CheckHistogram(values, "winunlock_method_duration_seconds", "method=\"SetSelected\"");
+    CheckHistogram(values, "winunlock_method_duration_seconds", "method=\"GetSerialization\"");
+    CheckHistogram(values, "winunlock_source_fetch_duration_seconds", "");
+    CHECK(values.count(BucketSample("winunlock_source_fetch_duration_seconds", "", 0)) == 1);
+    CHECK(values.count("winunlock_source_fetch_duration_seconds_sum") == 1);
+}
+
+TEST(DurationsLandInTheirBuckets)
+{
+    EnableMetrics();
+    const PCSTR pszName = "winunlock_method_duration_seconds";
+    const PCSTR pszLabels = "method=\"SetSelected\"";
+    METRIC_VALUES before = ParseSamples(Render());
+
+    const ULONGLONG rgullUs[] = { 3, 100, 5000, 1ULL << (METRICS_MAX_EXPONENT + 2) };
+    for (ULONGLONG ullUs : rgullUs)
+    {
+        MetricsRecordDuration(MH_SETSELECTED, MicrosecondsToTicks(ullUs));
+    }
+    // 负值（计数器回绕等）按 0 计入第一桶
+    MetricsRecordDuration(MH_SETSELECTED, -5);
+
+    METRIC_VALUES after = ParseSamples(Render());
+    CHECK_EQ(CheckHistogram(after, pszName, pszLabels) - CheckHistogram(before, pszName, pszLabels), 5.0);
+
+    // 累计桶：每个值使其所在桶及之后的桶各加一
+    bool fBucketsMatch = true;
+    for (DWORD i = 0; i < METRICS_HISTOGRAM_BUCKETS; i++)
+    {
+        double dExpected = 1;
+        for (ULONGLONG ullUs : rgullUs)
+        {
+            dExpected += (MetricsBucketIndex(ullUs) <= i) ? 1 : 0;
+        }
+        if (Delta(before, after, BucketSample(pszName, pszLabels, i)) != dExpected)
+        {
+            fBucketsMatch = false;
+        }
+    }
+    CHECK(fBucketsMatch);
+    double dSum = Delta(before, after, SeriesSample(pszName, "_sum", pszLabels));
+    CHECK(NearlyEqual(dSum, (3 + 100 + 5000 + (double)(1ULL << (METRICS_MAX_EXPONENT + 2))) / 1e6, 1e-5));
+
+    // 其他直方图不受影响
+    CHECK_EQ(Delta(before, after, SeriesSample(pszName, "_count", "method=\"GetSerialization\"")), 0.0);
+
+    // 作用域计时写入对应的直方图
+    {
+        METRICS_SCOPE(MH_SOURCE_FETCH);
+        Sleep(2);
+    }
+    METRIC_VALUES scoped = ParseSamples(Render());
+    CHECK_EQ(Delta(after, scoped, "winunlock_source_fetch_duration_seconds_count"), 1.0);
+    CHECK(Delta(after, scoped, "winunlock_source_fetch_duration_seconds_sum") >= 0.002);
+    CHECK_EQ(Delta(after, scoped, BucketSample("winunlock_source_fetch_duration_seconds", "", MetricsBucketIndex(1999))), 0.0);
+}
+
+TEST(ResultsAndCounters)
+{
+    EnableMetrics();
+    METRIC_VALUES before = ParseSamples(Render());
+
+    MetricsRecordResult(CPUS_LOGON, RK_SUCCESS);
+    MetricsRecordResult(CPUS_UNLOCK_WORKSTATION, RK_CREDENTIAL);
+    MetricsRecordResult(CPUS_UNLOCK_WORKSTATION, RK_CREDENTIAL);
+    MetricsRecordResult(CPUS_CREDUI, RK_TRANSIENT);
+    MetricsRecordResult(CPUS_LOGON, (RESULT_KIND)4);
+    MetricsRecordFetchFailure();
+    MetricsRecordConfigReload(41);
+    MetricsRecordConfigReload(42);
+
+    METRIC_VALUES after = ParseSamples(Render());
+    CHECK_EQ(Delta(before, after, "winunlock_results_total{scenario=\"logon\",result=\"success\"}"), 1.0);
+    CHECK_EQ(Delta(before, after, "winunlock_results_total{scenario=\"unlock\",result=\"credential\"}"), 2.0);
+    CHECK_EQ(Delta(before, after, "winunlock_results_total{scenario=\"other\",result=\"transient\"}"), 1.0);
+    CHECK_EQ(Delta(before, after, "winunlock_results_total{scenario=\"logon\",result=\"permanent\"}"), 0.0);
+    CHECK_EQ(Delta(before, after, "winunlock_source_fetch_failures_total"), 1.0);
+    CHECK_EQ(Delta(before, after, "winunlock_config_reloads_total"), 2.0);
+    CHECK_EQ(after["winunlock_config_generation"], 42.0);
+}
+
+TEST(RenderBufferTooSmall)
+{
+    std::string text = Render();
+    std::vector<char> rgch(text.size());
+    size_t cch = 1;
+    CHECK_HR(MetricsRender(rgch.data(), rgch.size(), &cch), STRSAFE_E_INSUFFICIENT_BUFFER);
+    CHECK_EQ(cch, (size_t)0);
+
+    // 恰好容纳文本和结尾 NUL
+    rgch.resize(text.size() + 1);
+    CHECK_HR(MetricsRender(rgch.data(), rgch.size(), &cch), S_OK);
+    CHECK_EQ(cch, text.size());
+}
+
+TEST(ScrapeOverPipe)
+{
+    EnableMetrics();
+    std::string scraped;
+    CHECK_HR(Scrape(scraped), S_OK);
+    CHECK(scraped == Render());
+
+    // 连上后不读就关闭的采集方不影响下一次读取
+    HANDLE hPipe = OpenMetricsPipe();
+    CHECK(hPipe != INVALID_HANDLE_VALUE);
+    CloseHandle(hPipe);
+
+    MetricsRecordConfigReload(7);
+    CHECK_HR(Scrape(scraped), S_OK);
+    CHECK_EQ(ParseSamples(scraped)["winunlock_config_generation"], 7.0);
+}
+
+struct RECORD_CONTEXT
+{
+    volatile LONG* pfStop;
+    LONGLONG llTicks;
+    DWORD cRecords;
+    ULONGLONG ullSumTicks;
+};
+
+static DWORD WINAPI RecordThread(LPVOID pv)
+{
+    RECORD_CONTEXT* pContext = (RECORD_CONTEXT*)pv;
+    while (!ReadAcquire(pContext->pfStop))
+    {
+        LONGLONG llTicks = pContext->llTicks * (pContext->cRecords % 7 + 1);
+        MetricsRecordDuration(MH_GETCREDENTIALCOUNT, llTicks);
+        pContext->ullSumTicks += (ULONGLONG)llTicks;
+        pContext->cRecords++;
+    }
+    return 0;
+}
+
+// 采集期间多线程记录：每次读到的直方图都自洽，_count 不减；结束后计数和总和都不丢失
+TEST(ScrapeWhileRecording)
+{
+    EnableMetrics();
+    const PCSTR pszName = "winunlock_method_duration_seconds";
+    const PCSTR pszLabels = "method=\"GetCredentialCount\"";
+    METRIC_VALUES before = ParseSamples(Render());
+
+    const DWORD cThreads = 4;
+    volatile LONG fStop = FALSE;
+    RECORD_CONTEXT rgContexts[cThreads];
+    HANDLE rghThreads[cThreads];
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        rgContexts[i] = { &fStop, MicrosecondsToTicks(10), 0, 0 };
+        rghThreads[i] = CreateThread(nullptr, 0, RecordThread, &rgContexts[i], 0, nullptr);
+    }
+
+    double dPrevious = CheckHistogram(before, pszName, pszLabels);
+    DWORD cScrapes = 0;
+    bool fMonotonic = true;
+    ULONGLONG ullDeadline = GetTickCount64() + 500;
+    while (GetTickCount64() < ullDeadline)
+    {
+        std::string scraped;
+        CHECK_HR(Scrape(scraped), S_OK);
+        double dCount = CheckHistogram(ParseSamples(scraped), pszName, pszLabels);
+        fMonotonic = fMonotonic && (dCount >= dPrevious);
+        dPrevious = dCount;
+        cScrapes++;
+    }
+    InterlockedExchange(&fStop, TRUE);
+    WaitForMultipleObjects(cThreads, rghThreads, TRUE, INFINITE);
+    double dRecords = 0;
+    double dSumUs = 0;
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        CloseHandle(rghThreads[i]);
+        dRecords += rgContexts[i].cRecords;
+        dSumUs += (double)rgContexts[i].ullSumTicks / (double)MicrosecondsToTicks(1);
+    }
+    CHECK(fMonotonic);
+    CHECK(cScrapes > 1);
+    CHECK(dRecords >= dPrevious - CheckHistogram(before, pszName, pszLabels));
+
+    METRIC_VALUES after = ParseSamples(Render());
+    CHECK_EQ(CheckHistogram(after, pszName, pszLabels) - CheckHistogram(before, pszName, pszLabels), dRecords);
+    CHECK(NearlyEqual(Delta(before, after, SeriesSample(pszName, "_sum", pszLabels)), dSumUs / 1e6, 1e-3));
+}
+
+BENCH(MetricsBench)
+{
+    EnableMetrics();
+    LONGLONG llTicks = MicrosecondsToTicks(250);
+    BenchRun("MetricsRecordDuration", 10000000, [&](DWORD i) {
+        MetricsRecordDuration(MH_GETSERIALIZATION, llTicks + i % 1024);
+    });
+    BenchRun("METRICS_SCOPE（含两次 QPC）", 5000000, [&](DWORD) {
+        METRICS_SCOPE(MH_SETSELECTED);
+    });
+
+    std::vector<char> text(METRICS_TEXT_MAX);
+    size_t cch = 0;
+    BenchRun("MetricsRender", 2000, [&](DWORD) {
+        MetricsRender(text.data(), text.size(), &cch);
+    });
+    printf("  文本 %zu 字节\n", cch);
+
+    const DWORD cScrapes = 1000;
+    std::vector<double> latencies;
+    latencies.reserve(cScrapes);
+    std::string scraped;
+    BenchRun("管道读取一次（连接到读完）", cScrapes, [&](DWORD) {
+        LARGE_INTEGER liStart, liEnd, liFrequency;
+        QueryPerformanceCounter(&liStart);
+        HRESULT hr = Scrape(scraped);
+        QueryPerformanceCounter(&liEnd);
+        QueryPerformanceFrequency(&liFrequency);
+        if (SUCCEEDED(hr))
+        {
+            latencies.push_back((double)(liEnd.QuadPart - liStart.QuadPart) * 1e6 / (double)liFrequency.QuadPart);
+        }
+    });
+    std::sort(latencies.begin(), latencies.end());
+    printf("  成功 %zu 次；耗时（微秒）: p50 %.1f  p99 %.1f  max %.1f\n", latencies.size(),
+        TracePercentile(latencies.data(), latencies.size(), 0.50), TracePercentile(latencies.data(), latencies.size(), 0.99),
+        latencies.empty() ? 0.0 : latencies.back());
+}
+
+TEST_MAIN()
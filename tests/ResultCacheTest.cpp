@@ -0,0 +1,216 @@
+#include "pch.h"
+#include "ResultCache.h"
+#include "Test.h"
+
+// ResultCache：失败退避、三次停止、密码指纹变化后重置、最近一小时的成功次数
+
+#define STATUS_WRONG_PASSWORD       ((NTSTATUS)0xC000006AL)
+#define STATUS_LOGON_FAILURE        ((NTSTATUS)0xC000006DL)
+#define STATUS_ACCOUNT_LOCKED_OUT   ((NTSTATUS)0xC0000234L)
+#define STATUS_PASSWORD_EXPIRED     ((NTSTATUS)0xC0000071L)
+#define STATUS_NO_LOGON_SERVERS     ((NTSTATUS)0xC000005EL)
+
+static const ULONGLONG c_ullStart = 1000000;
+static const ULONGLONG c_ullStampA = 0x1111;
+static const ULONGLONG c_ullStampB = 0x2222;
+
+static ULONGLONG RetryTick(ResultCache& cache, PCWSTR pszKey)
+{
+    ULONGLONG ullRetryTick = 0;
+    bool fBlocked = false;
+    cache.GetDecision(pszKey, &ullRetryTick, &fBlocked);
+    return ullRetryTick;
+}
+
+TEST(Classify)
+{
+    CHECK_EQ(ResultCache::Classify(STATUS_SUCCESS, STATUS_SUCCESS), RK_SUCCESS);
+    CHECK_EQ(ResultCache::Classify(STATUS_WRONG_PASSWORD, STATUS_SUCCESS), RK_CREDENTIAL);
+    CHECK_EQ(ResultCache::Classify(STATUS_LOGON_FAILURE, STATUS_SUCCESS), RK_CREDENTIAL);
+    CHECK_EQ(ResultCache::Classify(STATUS_ACCOUNT_LOCKED_OUT, STATUS_SUCCESS), RK_PERMANENT);
+    CHECK_EQ(ResultCache::Classify(STATUS_NO_LOGON_SERVERS, STATUS_SUCCESS), RK_TRANSIENT);
+
+    // STATUS_LOGON_FAILURE 的具体原因在子状态中
+    CHECK_EQ(ResultCache::Classify(STATUS_LOGON_FAILURE, STATUS_PASSWORD_EXPIRED), RK_PERMANENT);
+    CHECK_EQ(ResultCache::Classify(STATUS_LOGON_FAILURE, STATUS_WRONG_PASSWORD), RK_CREDENTIAL);
+}
+
+TEST(ThreeStrikesBlock)
+{
+    ResultCache cache;
+    ULONGLONG ullNow = c_ullStart;
+    CHECK_HR(cache.CanAutoSubmit(L"S-1-5-21-1", c_ullStampA, ullNow), S_OK);
+
+    for (DWORD i = 1; i < RESULT_CACHE_MAX_FAILURES; i++)
+    {
+        cache.RecordResult(L"S-1-5-21-1", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, ullNow);
+        CHECK_HR(cache.CanAutoSubmit(L"S-1-5-21-1", c_ullStampA, ullNow), HRESULT_FROM_WIN32(ERROR_RETRY));
+
+        // 退避结束后允许再试
+        ullNow = RetryTick(cache, L"S-1-5-21-1");
+        CHECK_HR(cache.CanAutoSubmit(L"S-1-5-21-1", c_ullStampA, ullNow), S_OK);
+    }
+
+    // 第三次：停止自动提交，退避结束后也不再恢复
+    cache.RecordResult(L"S-1-5-21-1", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, ullNow);
+    CHECK_HR(cache.CanAutoSubmit(L"S-1-5-21-1", c_ullStampA, ullNow), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+    CHECK_HR(cache.CanAutoSubmit(L"S-1-5-21-1", c_ullStampA, ullNow + 24 * 60 * 60 * 1000ULL), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+
+    // 其他账户不受影响
+    CHECK_HR(cache.CanAutoSubmit(L"S-1-5-21-2", c_ullStampA, ullNow), S_OK);
+}
+
+TEST(PermanentBlocksImmediately)
+{
+    ResultCache cache;
+    cache.RecordResult(L"user", c_ullStampA, STATUS_ACCOUNT_LOCKED_OUT, STATUS_SUCCESS, c_ullStart);
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampA, c_ullStart + RESULT_CACHE_BACKOFF_MAX_MS), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+}
+
+TEST(BackoffDoublesUpToCap)
+{
+    ResultCache cache;
+    ULONGLONG ullBackoff = RESULT_CACHE_BACKOFF_MS;
+    ULONGLONG ullNow = c_ullStart;
+    bool fCapped = false;
+    for (DWORD i = 1; i <= 12; i++)
+    {
+        cache.RecordResult(L"user", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, ullNow);
+        ULONGLONG ullExpected = min(ullBackoff, (ULONGLONG)RESULT_CACHE_BACKOFF_MAX_MS);
+        CHECK_EQ(RetryTick(cache, L"user") - ullNow, ullExpected);
+        fCapped = fCapped || (ullExpected == RESULT_CACHE_BACKOFF_MAX_MS);
+        ullBackoff *= 2;
+        ullNow += 1000;
+    }
+    CHECK(fCapped);
+}
+
+TEST(TransientBackoffDoesNotCount)
+{
+    ResultCache cache;
+    for (DWORD i = 0; i < 2 * RESULT_CACHE_MAX_FAILURES; i++)
+    {
+        cache.RecordResult(L"user", c_ullStampA, STATUS_NO_LOGON_SERVERS, STATUS_SUCCESS, c_ullStart);
+        CHECK_EQ(RetryTick(cache, L"user") - c_ullStart, (ULONGLONG)RESULT_CACHE_BACKOFF_MS);
+    }
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampA, c_ullStart), HRESULT_FROM_WIN32(ERROR_RETRY));
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampA, c_ullStart + RESULT_CACHE_BACKOFF_MS), S_OK);
+}
+
+TEST(StampChangeResets)
+{
+    ResultCache cache;
+    for (DWORD i = 0; i < RESULT_CACHE_MAX_FAILURES; i++)
+    {
+        cache.RecordResult(L"user", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart);
+    }
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampA, c_ullStart), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+
+    // 管理员更新密码后指纹变化：旧记录不再生效，包括尚未结束的退避
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampB, c_ullStart), S_OK);
+
+    // 新密码再失败一次从第一次重新计数
+    cache.RecordResult(L"user", c_ullStampB, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart);
+    CHECK_EQ(RetryTick(cache, L"user") - c_ullStart, (ULONGLONG)RESULT_CACHE_BACKOFF_MS);
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampB, c_ullStart + RESULT_CACHE_BACKOFF_MS), S_OK);
+}
+
+TEST(SuccessClearsFailures)
+{
+    ResultCache cache;
+    cache.RecordResult(L"user", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart);
+    cache.RecordResult(L"user", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart);
+    cache.RecordResult(L"user", c_ullStampA, STATUS_SUCCESS, STATUS_SUCCESS, c_ullStart + 1);
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampA, c_ullStart + 1), S_OK);
+
+    // 连续失败次数已清零：再失败两次仍未停止
+    cache.RecordResult(L"user", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart + 2);
+    cache.RecordResult(L"user", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart + 3);
+    CHECK_HR(cache.CanAutoSubmit(L"user", c_ullStampA, c_ullStart + RESULT_CACHE_BACKOFF_MAX_MS), S_OK);
+}
+
+TEST(RecentUnlocksWindow)
+{
+    ResultCache cache;
+    const ULONGLONG ullMinute = 60 * 1000;
+
+    // 每 10 分钟成功一次，共 5 次
+    for (DWORD i = 0; i < 5; i++)
+    {
+        cache.RecordResult(L"user", c_ullStampA, STATUS_SUCCESS, STATUS_SUCCESS, c_ullStart + i * 10 * ullMinute);
+    }
+    CHECK_EQ(cache.CountRecentUnlocks(L"user", c_ullStart + 40 * ullMinute), 5u);
+
+    // 第一次成功距今恰好一小时时不再计入，之后每 10 分钟少一次
+    CHECK_EQ(cache.CountRecentUnlocks(L"user", c_ullStart + RESULT_CACHE_RECENT_WINDOW_MS - 1), 5u);
+    CHECK_EQ(cache.CountRecentUnlocks(L"user", c_ullStart + RESULT_CACHE_RECENT_WINDOW_MS), 4u);
+    CHECK_EQ(cache.CountRecentUnlocks(L"user", c_ullStart + RESULT_CACHE_RECENT_WINDOW_MS + 40 * ullMinute), 0u);
+
+    CHECK_EQ(cache.CountRecentUnlocks(L"other", c_ullStart), 0u);
+
+    // 失败不计入成功次数
+    cache.RecordResult(L"user", c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart + 41 * ullMinute);
+    CHECK_EQ(cache.CountRecentUnlocks(L"user", c_ullStart + 41 * ullMinute), 5u);
+}
+
+TEST(RecentUnlocksSaturate)
+{
+    ResultCache cache;
+    for (DWORD i = 0; i < 3 * RESULT_CACHE_RECENT_UNLOCKS; i++)
+    {
+        cache.RecordResult(L"user", c_ullStampA, STATUS_SUCCESS, STATUS_SUCCESS, c_ullStart + i);
+    }
+    CHECK_EQ(cache.CountRecentUnlocks(L"user", c_ullStart + 3 * RESULT_CACHE_RECENT_UNLOCKS), (DWORD)RESULT_CACHE_RECENT_UNLOCKS);
+}
+
+TEST(KeyIsCaseInsensitive)
+{
+    CHECK_EQ(ResultCache::HashKey(L"Administrator"), ResultCache::HashKey(L"ADMINISTRATOR"));
+    CHECK(ResultCache::HashKey(L"alice") != ResultCache::HashKey(L"bob"));
+
+    ResultCache cache;
+    cache.RecordResult(L"Alice", c_ullStampA, STATUS_ACCOUNT_LOCKED_OUT, STATUS_SUCCESS, c_ullStart);
+    CHECK_HR(cache.CanAutoSubmit(L"alice", c_ullStampA, c_ullStart), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+}
+
+// 表满时淘汰最久未更新的记录，其余账户的记录保持不变
+TEST(EvictsOldest)
+{
+    ResultCache cache;
+    WCHAR szKey[16];
+    for (DWORD i = 0; i <= RESULT_CACHE_SLOTS; i++)
+    {
+        StringCchCopyW(szKey, ARRAYSIZE(szKey), L"user-00");
+        szKey[5] = (WCHAR)(L'0' + i / 10);
+        szKey[6] = (WCHAR)(L'0' + i % 10);
+        cache.RecordResult(szKey, c_ullStampA, STATUS_ACCOUNT_LOCKED_OUT, STATUS_SUCCESS, c_ullStart + i);
+    }
+    CHECK_HR(cache.CanAutoSubmit(L"user-00", c_ullStampA, c_ullStart), S_OK);
+    CHECK_HR(cache.CanAutoSubmit(L"user-01", c_ullStampA, c_ullStart), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+    CHECK_HR(cache.CanAutoSubmit(L"user-32", c_ullStampA, c_ullStart), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+}
+
+BENCH(CanAutoSubmitBench)
+{
+    ResultCache cache;
+    WCHAR szKey[16] = L"user-00";
+    for (DWORD i = 0; i < RESULT_CACHE_SLOTS; i++)
+    {
+        szKey[5] = (WCHAR)(L'0' + i / 10);
+        szKey[6] = (WCHAR)(L'0' + i % 10);
+        cache.RecordResult(szKey, c_ullStampA, STATUS_WRONG_PASSWORD, STATUS_SUCCESS, c_ullStart);
+    }
+
+    volatile HRESULT hrSink = S_OK;
+    BenchRun("ResultCache::CanAutoSubmit (32 个账户)", 5000000, [&](DWORD i) {
+        hrSink = cache.CanAutoSubmit(L"user-17", c_ullStampA, c_ullStart + i);
+    });
+    BenchRun("ResultCache::CountRecentUnlocks", 5000000, [&](DWORD i) {
+        hrSink = (HRESULT)cache.CountRecentUnlocks(L"user-17", c_ullStart + i);
+    });
+    BenchRun("ResultCache::RecordResult", 5000000, [&](DWORD i) {
+        cache.RecordResult(L"user-17", c_ullStampA, STATUS_SUCCESS, STATUS_SUCCESS, c_ullStart + i);
+    });
+}
+
+TEST_MAIN()
@@ -0,0 +1,237 @@
+#include "pch.h"
+#include "SecretArena.h"
+#include "Test.h"
+
+// SecretArena：分配对齐且已清零、释放即清零、全部释放后复位、用尽时 SecretString 退回进程堆，
+// 以及兼容层以 mlock 实现的 VirtualLock：区域确实锁定在物理内存中，锁定失败时不再使用该区域
+
+static bool IsZero(const void* pv, size_t cb)
+{
+    const BYTE* pb = (const BYTE*)pv;
+    for (size_t i = 0; i < cb; i++)
+    {
+        if (pb[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(AllocAlignedAndZeroed)
+{
+    SecretArena arena;
+    PWSTR psz1 = arena.Alloc(5);
+    PWSTR psz2 = arena.Alloc(1);
+    PWSTR psz3 = arena.Alloc(8);
+    CHECK(psz1 && psz2 && psz3);
+    CHECK_EQ((ULONG_PTR)psz1 % 16, 0u);
+    CHECK_EQ((ULONG_PTR)psz2 % 16, 0u);
+    CHECK_EQ((ULONG_PTR)psz3 % 16, 0u);
+
+    // 按 16 字节递增，互不重叠
+    CHECK_EQ((BYTE*)psz2 - (BYTE*)psz1, 16);
+    CHECK_EQ((BYTE*)psz3 - (BYTE*)psz2, 16);
+    CHECK(IsZero(psz1, 16) && IsZero(psz2, 16) && IsZero(psz3, 16));
+
+    arena.Free(psz3, 8);
+    arena.Free(psz2, 1);
+    arena.Free(psz1, 5);
+}
+
+TEST(FreeZeroizes)
+{
+    SecretArena arena;
+    PWSTR pszKeep = arena.Alloc(8);
+    PWSTR pszSecret = arena.Alloc(8);
+    CHECK(pszKeep && pszSecret);
+    StringCchCopyW(pszKeep, 8, L"keep");
+    StringCchCopyW(pszSecret, 8, L"hunter2");
+
+    // 释放一个分配只清零它自己，其他分配不受影响
+    arena.Free(pszSecret, 8);
+    CHECK(IsZero(pszSecret, 8 * sizeof(WCHAR)));
+    CHECK(!wcscmp(pszKeep, L"keep"));
+
+    // 释放的空间在全部分配释放前不复用
+    PWSTR pszNext = arena.Alloc(8);
+    CHECK(pszNext > pszSecret);
+
+    // 全部释放后整体清零并从头分配，对齐填充中的残留也被清除
+    pszKeep[7] = L'x';
+    arena.Free(pszNext, 8);
+    arena.Free(pszKeep, 4);
+    CHECK(IsZero(pszKeep, 3 * 16));
+    CHECK_EQ(arena.Alloc(1), pszKeep);
+    arena.Free(pszKeep, 1);
+
+    // 释放空指针无操作
+    arena.Free(nullptr, 8);
+}
+
+TEST(ExhaustionReturnsNull)
+{
+    SecretArena arena;
+    PWSTR pszFirst = arena.Alloc(1);
+    CHECK(pszFirst != nullptr);
+
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    SIZE_T cbSize = (SECRET_ARENA_SIZE + si.dwPageSize - 1) & ~((SIZE_T)si.dwPageSize - 1);
+
+    // 恰好用完剩余空间，之后任何分配都失败
+    size_t cchRest = (cbSize - 16) / sizeof(WCHAR);
+    PWSTR pszRest = arena.Alloc(cchRest);
+    CHECK(pszRest != nullptr);
+    CHECK(!arena.Alloc(1));
+    arena.Free(pszRest, cchRest);
+    CHECK(!arena.Alloc(cbSize));
+    arena.Free(pszFirst, 1);
+
+    // 全部释放后恢复
+    pszFirst = arena.Alloc(cchRest);
+    CHECK(pszFirst != nullptr);
+    arena.Free(pszFirst, cchRest);
+}
+
+// 共享实例用尽时 SecretString 退回进程堆，照常可用
+TEST(SecretStringFallsBackToHeap)
+{
+    SecretArena* pArena = SecretArena::GetDefault();
+    PWSTR pszFill = pArena->Alloc(SECRET_ARENA_SIZE / sizeof(WCHAR) - 8);
+    CHECK(pszFill != nullptr);
+
+    SecretString inArena;
+    CHECK_HR(inArena.Assign(L"short"), S_OK);
+
+    SecretString onHeap;
+    CHECK_HR(onHeap.Assign(L"this password does not fit in what is left of the arena"), S_OK);
+    CHECK(!wcscmp(onHeap.Get(), L"this password does not fit in what is left of the arena"));
+    CHECK_EQ(onHeap.Length(), wcslen(L"this password does not fit in what is left of the arena"));
+    CHECK(((BYTE*)onHeap.Get() < (BYTE*)pszFill) || ((BYTE*)onHeap.Get() >= (BYTE*)pszFill + SECRET_ARENA_SIZE));
+    CHECK(!wcscmp(inArena.Get(), L"short"));
+
+    // 直接写入后重新计算长度
+    CHECK_HR(onHeap.Allocate(8), S_OK);
+    CHECK(IsZero(onHeap.Get(), 9 * sizeof(WCHAR)));
+    StringCchCopyW(onHeap.Get(), 9, L"abc");
+    onHeap.UpdateLength();
+    CHECK_EQ(onHeap.Length(), 3u);
+
+    onHeap.Free();
+    CHECK(onHeap.IsEmpty());
+    inArena.Free();
+    pArena->Free(pszFill, SECRET_ARENA_SIZE / sizeof(WCHAR) - 8);
+}
+
+// 区域在首次分配时锁定，析构时解除锁定
+TEST(ArenaPagesLocked)
+{
+    SIZE_T cbBefore = WinCompatGetLockedBytes();
+    {
+        SecretArena arena;
+        CHECK_EQ(WinCompatGetLockedBytes(), cbBefore);
+        PWSTR psz = arena.Alloc(4);
+        CHECK(psz != nullptr);
+        CHECK(WinCompatGetLockedBytes() >= cbBefore + SECRET_ARENA_SIZE);
+        arena.Free(psz, 4);
+    }
+    CHECK_EQ(WinCompatGetLockedBytes(), cbBefore);
+}
+
+// 锁定失败（超出工作集配额）时不使用该区域，且只尝试一次
+TEST(LockFailureDisablesArena)
+{
+    SIZE_T cbBefore = WinCompatGetLockedBytes();
+    SecretArena arena;
+    WinCompatSetVirtualLockError(ERROR_WORKING_SET_QUOTA);
+    CHECK(!arena.Alloc(4));
+    WinCompatSetVirtualLockError(ERROR_SUCCESS);
+    CHECK(!arena.Alloc(4));
+    CHECK_EQ(WinCompatGetLockedBytes(), cbBefore);
+}
+
+struct ALLOC_CONTEXT
+{
+    SecretArena* pArena;
+    DWORD dwTag;
+    volatile LONG cCorrupted;
+};
+
+static DWORD WINAPI AllocThread(LPVOID pv)
+{
+    ALLOC_CONTEXT* pContext = (ALLOC_CONTEXT*)pv;
+    for (DWORD i = 0; i < 20000; i++)
+    {
+        PWSTR psz = pContext->pArena->Alloc(8);
+        if (!psz)
+        {
+            continue;
+        }
+        for (DWORD k = 0; k < 8; k++)
+        {
+            psz[k] = (WCHAR)(pContext->dwTag + k);
+        }
+        for (DWORD k = 0; k < 8; k++)
+        {
+            if (psz[k] != (WCHAR)(pContext->dwTag + k))
+            {
+                InterlockedIncrement(&pContext->cCorrupted);
+            }
+        }
+        pContext->pArena->Free(psz, 8);
+    }
+    return 0;
+}
+
+// 多个线程同时分配和释放：各自的分配互不覆盖（TSan 下检查加锁）
+TEST(ConcurrentAllocFree)
+{
+    const DWORD cThreads = 4;
+    SecretArena arena;
+    ALLOC_CONTEXT rgContexts[cThreads];
+    HANDLE rghThreads[cThreads];
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        rgContexts[i].pArena = &arena;
+        rgContexts[i].dwTag = 0x100 * (i + 1);
+        rgContexts[i].cCorrupted = 0;
+        rghThreads[i] = CreateThread(nullptr, 0, AllocThread, &rgContexts[i], 0, nullptr);
+    }
+    WaitForMultipleObjects(cThreads, rghThreads, TRUE, INFINITE);
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        CloseHandle(rghThreads[i]);
+        CHECK_EQ(rgContexts[i].cCorrupted, 0);
+    }
+
+    // 全部释放后区域已复位
+    PWSTR psz = arena.Alloc(SECRET_ARENA_SIZE / sizeof(WCHAR));
+    CHECK(psz != nullptr);
+    CHECK(IsZero(psz, SECRET_ARENA_SIZE));
+    arena.Free(psz, SECRET_ARENA_SIZE / sizeof(WCHAR));
+}
+
+BENCH(SecretArenaBench)
+{
+    SecretArena arena;
+    arena.Free(arena.Alloc(1), 1);
+    BenchRun("Alloc + Free（32 字符）", 5000000, [&](DWORD) {
+        arena.Free(arena.Alloc(32), 32);
+    });
+
+    SecretString secret;
+    BenchRun("SecretString::Assign（密码长度）", 5000000, [&](DWORD) {
+        secret.Assign(L"correct horse battery staple");
+    });
+
+    secret.Free();
+    PWSTR pszFill = SecretArena::GetDefault()->Alloc(SECRET_ARENA_SIZE / sizeof(WCHAR));
+    BenchRun("SecretString::Assign（区域用尽，进程堆）", 5000000, [&](DWORD) {
+        secret.Assign(L"correct horse battery staple");
+    });
+    secret.Free();
+    SecretArena::GetDefault()->Free(pszFill, SECRET_ARENA_SIZE / sizeof(WCHAR));
+}
+
+TEST_MAIN()
@@ -0,0 +1,454 @@
+#include "pch.h"
+#include "ConfigFormat.h"
+#include "SharedCache.h"
+#include "Test.h"
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// 跨会话共享缓存：区段在各进程的映射地址不同也能共用、所有者不可信或版本不同的已有区段被拒绝、
+// 其他进程写入的决策记录及其作废规则、其他进程持有写锁或中途退出时的处理，
+// 以及多个读取子进程与发布方并发时读到的配置和决策记录都出自同一次写入（与 tools\sharedcache.cpp /stress 相同）。
+// 子进程由 fork 创建，各自打开区段，通过 _exit 的退出码报告结果
+
+#define STRESS_READERS  3
+#define STRESS_KEYS     16
+#define STRESS_MS       1000
+
+// 每个测试使用新的区段名，区段在本进程退出时才删除
+static void NextSectionName(PWSTR pszName, size_t cchName)
+{
+    static DWORD s_dwNext = 0;
+    StringCchPrintfW(pszName, cchName, L"Local\\WinUnlock.SharedCacheTest.%u", ++s_dwNext);
+}
+
+// 在子进程中执行 fn，退出码为其返回值；子进程不返回到测试框架，也不运行退出处理
+template <typename TFn>
+static pid_t RunChild(TFn fn)
+{
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        _exit(fn());
+    }
+    return pid;
+}
+
+static int WaitChild(pid_t pid)
+{
+    int nStatus = 0;
+    if (waitpid(pid, &nStatus, 0) != pid)
+    {
+        return -1;
+    }
+    return WIFEXITED(nStatus) ? WEXITSTATUS(nStatus) : 128 + WTERMSIG(nStatus);
+}
+
+// 测试内容都由序号推出，读取方据此检查拿到的内容是否出自同一次写入
+static ULONGLONG StressKeyHash(DWORD dwKey)
+{
+    return 0x5743000000000000ULL | (dwKey + 1);
+}
+
+static ULONGLONG StressRetryTick(ULONGLONG ullUpdateTick, DWORD dwGeneration)
+{
+    return ullUpdateTick * 3 + dwGeneration;
+}
+
+// 账户数和密封数据长度随序号变化，配置区内容的长度不断改变
+static HRESULT BuildStressConfig(ULONGLONG ullSerial, BYTE** ppb, DWORD* pcb)
+{
+    static BYTE s_rgbSealed[4096];
+    ConfigBuilder builder;
+    builder.SetFlags(CONFIG_FLAG_AUTO_UNLOCK_ENABLED);
+    builder.SetSerial(ullSerial);
+
+    HRESULT hr = S_OK;
+    DWORD cAccounts = (DWORD)(ullSerial % 8) + 1;
+    for (DWORD i = 0; (i < cAccounts) && SUCCEEDED(hr); i++)
+    {
+        WCHAR szUsername[32];
+        StringCchPrintfW(szUsername, ARRAYSIZE(szUsername), L"user%u", i);
+        FillMemory(s_rgbSealed, sizeof(s_rgbSealed), (BYTE)(ullSerial + i));
+        hr = builder.AddAccount(szUsername, L"", s_rgbSealed, (DWORD)((ullSerial * 37 + i * 101) % (sizeof(s_rgbSealed) - 16)) + 16);
+    }
+    return SUCCEEDED(hr) ? builder.Build(ppb, pcb) : hr;
+}
+
+static HRESULT PublishStressConfig(SharedCache* pCache, ULONGLONG ullSerial)
+{
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    HRESULT hr = BuildStressConfig(ullSerial, &pb, &cb);
+    if (SUCCEEDED(hr))
+    {
+        hr = pCache->PublishConfig(ullSerial, cb, pb, cb);
+        CoTaskMemFree(pb);
+    }
+    return hr;
+}
+
+TEST(SectionSharedBetweenMappings)
+{
+    WCHAR szName[64];
+    NextSectionName(szName, ARRAYSIZE(szName));
+    SharedCache creator;
+    SharedCache opener;
+    CHECK_HR(creator.Open(szName, true), S_OK);
+    CHECK_HR(opener.Open(szName, true), S_OK);
+    CHECK(opener.GetHeader() != creator.GetHeader());
+    CHECK_EQ(opener.GetHeader()->dwMagic, (DWORD)SHARED_CACHE_MAGIC);
+    CHECK_EQ(opener.GetHeader()->cbSection, (DWORD)SHARED_CACHE_SECTION_SIZE);
+
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    ULONGLONG ullWriteTime = 0;
+    ULONGLONG cbFile = 0;
+    CHECK_HR(opener.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile), HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    CHECK_HR(PublishStressConfig(&creator, 5), S_OK);
+    CHECK_HR(PublishStressConfig(&creator, 5), S_FALSE);
+    CHECK_HR(opener.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile), S_OK);
+    CHECK_EQ(ullWriteTime, 5ull);
+    CHECK_EQ(cbFile, (ULONGLONG)cb);
+    ConfigView view;
+    CHECK_HR(view.Attach(pb, cb), S_OK);
+    CHECK_EQ(view.GetSerial(), 5ull);
+    CHECK_EQ(view.GetAccountCount(), 6u);
+    view.Detach();
+    CoTaskMemFree(pb);
+    CHECK_EQ(opener.GetHeader()->dwRefresherProcessId, GetCurrentProcessId());
+
+    static BYTE s_rgbLarge[SHARED_CACHE_CONFIG_MAX + 1];
+    CHECK_HR(creator.PublishConfig(6, sizeof(s_rgbLarge), s_rgbLarge, sizeof(s_rgbLarge)), HRESULT_FROM_WIN32(ERROR_FILE_TOO_LARGE));
+
+    SHARED_CACHE_STATS stats;
+    opener.GetStats(&stats);
+    CHECK_EQ(stats.cConfigHits, 1);
+    CHECK_EQ(stats.cConfigMisses, 1);
+}
+
+// 普通用户抢先创建的区段只在不要求可信所有者时可用；其他版本创建的区段一律不用
+TEST(UntrustedOrMismatchedSectionRejected)
+{
+    WCHAR szName[64];
+    NextSectionName(szName, ARRAYSIZE(szName));
+    SharedCache squatter;
+    CHECK_HR(squatter.Open(szName, false), S_OK);
+    CHECK(WinCompatSetSectionOwner(szName, L"S-1-5-21-1-2-3-1001"));
+
+    SharedCache cache;
+    CHECK_HR(cache.Open(szName, true), HRESULT_FROM_WIN32(ERROR_INVALID_OWNER));
+    CHECK(cache.GetHeader() == nullptr);
+    CHECK_HR(cache.Open(szName, false), S_OK);
+
+    SHARED_CACHE_HEADER* pHeader = const_cast<SHARED_CACHE_HEADER*>(squatter.GetHeader());
+    pHeader->dwVersion = SHARED_CACHE_VERSION + 1;
+    SharedCache other;
+    CHECK_HR(other.Open(szName, false), HRESULT_FROM_WIN32(ERROR_REVISION_MISMATCH));
+    pHeader->dwVersion = SHARED_CACHE_VERSION;
+    CHECK_HR(other.Open(szName, false), S_OK);
+}
+
+// 另一进程（会话）记录的决策：同一 Generation 下停止或退避，Generation 变化或停止过久后作废
+TEST(DecisionFromOtherProcess)
+{
+    WCHAR szName[64];
+    NextSectionName(szName, ARRAYSIZE(szName));
+    SharedCache cache;
+    CHECK_HR(cache.Open(szName, true), S_OK);
+
+    const ULONGLONG ullNow = 1000000;
+    pid_t pid = RunChild([&] {
+        SharedCache child;
+        if (FAILED(child.Open(szName, true)))
+        {
+            return 2;
+        }
+        child.PublishDecision(StressKeyHash(0), 5, ullNow, true, ullNow);
+        child.PublishDecision(StressKeyHash(1), 5, ullNow + 60000, false, ullNow);
+        return 0;
+    });
+    CHECK_EQ(WaitChild(pid), 0);
+
+    SHARED_CACHE_DECISION decision;
+    CHECK_HR(cache.ReadDecision(StressKeyHash(0), &decision), S_OK);
+    CHECK_EQ(decision.dwGeneration, 5u);
+    CHECK_EQ(decision.fBlocked, (DWORD)TRUE);
+    CHECK_HR(cache.CheckDecision(StressKeyHash(0), 5, ullNow), HRESULT_FROM_WIN32(ERROR_LOGON_FAILURE));
+    CHECK_HR(cache.CheckDecision(StressKeyHash(0), 6, ullNow), S_OK);
+    CHECK_HR(cache.CheckDecision(StressKeyHash(0), 5, ullNow + SHARED_CACHE_BLOCK_MAX_MS), S_OK);
+    CHECK_HR(cache.CheckDecision(StressKeyHash(1), 5, ullNow + 59999), HRESULT_FROM_WIN32(ERROR_RETRY));
+    CHECK_HR(cache.CheckDecision(StressKeyHash(1), 5, ullNow + 60000), S_OK);
+    CHECK_HR(cache.CheckDecision(StressKeyHash(2), 5, ullNow), S_OK);
+    CHECK_HR(cache.ReadDecision(StressKeyHash(2), &decision), S_FALSE);
+
+    // 表满时淘汰最久未更新的记录
+    for (DWORD i = 2; i <= SHARED_CACHE_DECISIONS; i++)
+    {
+        cache.PublishDecision(StressKeyHash(i), 5, 0, false, ullNow + i);
+    }
+    CHECK_HR(cache.ReadDecision(StressKeyHash(0), &decision), S_FALSE);
+    CHECK_HR(cache.ReadDecision(StressKeyHash(1), &decision), S_OK);
+    CHECK_HR(cache.ReadDecision(StressKeyHash(SHARED_CACHE_DECISIONS), &decision), S_OK);
+}
+
+// 写入方在持有写锁、序号为奇数时退出：写锁未过期时放弃写入，读取方重试用尽后回退；
+// 写锁过期后被接管，新的写入让序号回到偶数
+TEST(WriterExitedMidWrite)
+{
+    WCHAR szName[64];
+    NextSectionName(szName, ARRAYSIZE(szName));
+    SharedCache cache;
+    CHECK_HR(cache.Open(szName, true), S_OK);
+    CHECK_HR(PublishStressConfig(&cache, 1), S_OK);
+    cache.PublishDecision(StressKeyHash(0), 1, 0, false, 1);
+
+    // 子进程改写到一半：决策记录只写了一个字段
+    pid_t pid = RunChild([&] {
+        SharedCache child;
+        if (FAILED(child.Open(szName, true)))
+        {
+            return 2;
+        }
+        SHARED_CACHE_HEADER* pHeader = const_cast<SHARED_CACHE_HEADER*>(child.GetHeader());
+        InterlockedExchange64(&pHeader->llWriteLock, (LONG64)GetTickCount64());
+        InterlockedExchange(&pHeader->lConfigSequence, pHeader->lConfigSequence + 1);
+        InterlockedExchange(&pHeader->lDecisionSequence, pHeader->lDecisionSequence + 1);
+        pHeader->rgDecisions[0].dwGeneration = 2;
+        return 0;
+    });
+    CHECK_EQ(WaitChild(pid), 0);
+
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    ULONGLONG ullWriteTime = 0;
+    ULONGLONG cbFile = 0;
+    CHECK_HR(cache.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile), E_PENDING);
+    CHECK_HR(PublishStressConfig(&cache, 2), E_PENDING);
+    SHARED_CACHE_DECISION decision;
+    CHECK_HR(cache.ReadDecision(StressKeyHash(0), &decision), E_PENDING);
+    CHECK_HR(cache.CheckDecision(StressKeyHash(0), 2, 0), S_OK);
+    cache.PublishDecision(StressKeyHash(1), 1, 0, false, 1);
+
+    SHARED_CACHE_STATS stats;
+    cache.GetStats(&stats);
+    CHECK_EQ(stats.cReadAbandoned, 3);
+    CHECK_EQ(stats.cReadRetries, (LONG64)SHARED_CACHE_READ_RETRIES * 3);
+    CHECK_EQ(stats.cWritesSkipped, 2);
+
+    SHARED_CACHE_HEADER* pHeader = const_cast<SHARED_CACHE_HEADER*>(cache.GetHeader());
+    InterlockedExchange64(&pHeader->llWriteLock, (LONG64)(GetTickCount64() - SHARED_CACHE_WRITE_LOCK_STALE_MS - 1));
+    CHECK_HR(PublishStressConfig(&cache, 2), S_OK);
+    CHECK_EQ(pHeader->llWriteLock, 0);
+    CHECK_EQ(pHeader->lConfigSequence & 1, 0);
+    CHECK_HR(cache.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile), S_OK);
+    CHECK_EQ(ullWriteTime, 2ull);
+    CoTaskMemFree(pb);
+    cache.PublishDecision(StressKeyHash(0), 3, 0, false, 2);
+    CHECK_EQ(pHeader->lDecisionSequence & 1, 0);
+    CHECK_HR(cache.ReadDecision(StressKeyHash(0), &decision), S_OK);
+    CHECK_EQ(decision.dwGeneration, 3u);
+}
+
+// 读取子进程的结果，放在 fork 之前建立的共享匿名映射中
+struct READER_RESULT
+{
+    LONG64 cReads;
+    LONG64 cConfigHits;
+    LONG64 cDecisionHits;
+    LONG64 cErrors;
+    LONG64 cReadRetries;
+    LONG64 cReadAbandoned;
+};
+
+static int RunReader(PCWSTR pszName, READER_RESULT* pResult)
+{
+    SharedCache cache;
+    if (FAILED(cache.Open(pszName, true)))
+    {
+        return 2;
+    }
+
+    ULONGLONG ullLastSerial = 0;
+    ULONGLONG ullEnd = GetTickCount64() + STRESS_MS;
+    while (GetTickCount64() < ullEnd)
+    {
+        for (DWORD i = 0; i < 64; i++, pResult->cReads++)
+        {
+            if (i % 4)
+            {
+                SHARED_CACHE_DECISION decision;
+                if (cache.ReadDecision(StressKeyHash(i % STRESS_KEYS), &decision) == S_OK)
+                {
+                    pResult->cDecisionHits++;
+                    if ((decision.ullRetryTick != StressRetryTick(decision.ullUpdateTick, decision.dwGeneration)) ||
+                        (decision.fBlocked != (decision.dwGeneration & 1)))
+                    {
+                        pResult->cErrors++;
+                    }
+                }
+                continue;
+            }
+
+            BYTE* pb = nullptr;
+            DWORD cb = 0;
+            ULONGLONG ullWriteTime = 0;
+            ULONGLONG cbFile = 0;
+            if (SUCCEEDED(cache.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile)))
+            {
+                // 写入时间戳即序号；序号不应回退
+                pResult->cConfigHits++;
+                ConfigView view;
+                if (FAILED(view.Attach(pb, cb)) || (view.GetSerial() != ullWriteTime) || (cbFile != cb) ||
+                    (view.GetAccountCount() != (DWORD)(ullWriteTime % 8) + 1) || (ullWriteTime < ullLastSerial))
+                {
+                    pResult->cErrors++;
+                }
+                ullLastSerial = ullWriteTime;
+                view.Detach();
+                CoTaskMemFree(pb);
+            }
+        }
+    }
+
+    SHARED_CACHE_STATS stats;
+    cache.GetStats(&stats);
+    pResult->cReadRetries = stats.cReadRetries;
+    pResult->cReadAbandoned = stats.cReadAbandoned;
+    return pResult->cErrors ? 1 : 0;
+}
+
+// 子进程全部退出前不断发布：配置和决策交替写入，决策的时刻用递增的序号代替
+TEST(ReadersInOtherProcesses)
+{
+    WCHAR szName[64];
+    NextSectionName(szName, ARRAYSIZE(szName));
+    SharedCache cache;
+    CHECK_HR(cache.Open(szName, true), S_OK);
+    ULONGLONG ullSerial = 1;
+    CHECK_HR(PublishStressConfig(&cache, ullSerial), S_OK);
+
+    READER_RESULT* rgResults = (READER_RESULT*)mmap(nullptr, sizeof(READER_RESULT) * STRESS_READERS,
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    CHECK(rgResults != MAP_FAILED);
+    if (rgResults == MAP_FAILED)
+    {
+        return;
+    }
+    ZeroMemory(rgResults, sizeof(READER_RESULT) * STRESS_READERS);
+
+    pid_t rgPids[STRESS_READERS];
+    for (DWORD i = 0; i < STRESS_READERS; i++)
+    {
+        READER_RESULT* pResult = &rgResults[i];
+        rgPids[i] = RunChild([&] { return RunReader(szName, pResult); });
+        CHECK(rgPids[i] > 0);
+    }
+
+    LONG64 cConfigs = 0;
+    DWORD cRunning = STRESS_READERS;
+    int rgExitCodes[STRESS_READERS];
+    while (cRunning)
+    {
+        ullSerial++;
+        if (PublishStressConfig(&cache, ullSerial) == S_OK)
+        {
+            cConfigs++;
+        }
+        for (DWORD i = 0; i < STRESS_KEYS; i++)
+        {
+            DWORD dwGeneration = (DWORD)ullSerial + i;
+            cache.PublishDecision(StressKeyHash(i), dwGeneration, StressRetryTick(ullSerial, dwGeneration), (dwGeneration & 1) != 0, ullSerial);
+        }
+        for (DWORD i = 0; i < STRESS_READERS; i++)
+        {
+            int nStatus = 0;
+            if ((rgPids[i] > 0) && (waitpid(rgPids[i], &nStatus, WNOHANG) == rgPids[i]))
+            {
+                rgExitCodes[i] = WIFEXITED(nStatus) ? WEXITSTATUS(nStatus) : 128 + WTERMSIG(nStatus);
+                rgPids[i] = 0;
+                cRunning--;
+            }
+        }
+    }
+
+    CHECK(cConfigs > 0);
+    for (DWORD i = 0; i < STRESS_READERS; i++)
+    {
+        CHECK_EQ(rgExitCodes[i], 0);
+        CHECK_EQ(rgResults[i].cErrors, 0);
+        CHECK(rgResults[i].cConfigHits > 0);
+        CHECK(rgResults[i].cDecisionHits > 0);
+    }
+    munmap(rgResults, sizeof(READER_RESULT) * STRESS_READERS);
+}
+
+// 另一进程不断发布时的读取耗时，对照无写入时
+BENCH(SharedCacheBench)
+{
+    WCHAR szName[64];
+    NextSectionName(szName, ARRAYSIZE(szName));
+    SharedCache cache;
+    CHECK_HR(cache.Open(szName, true), S_OK);
+    CHECK_HR(PublishStressConfig(&cache, 1), S_OK);
+    for (DWORD i = 0; i < STRESS_KEYS; i++)
+    {
+        cache.PublishDecision(StressKeyHash(i), i, StressRetryTick(1, i), (i & 1) != 0, 1);
+    }
+
+    volatile DWORD dwSink = 0;
+    auto readConfig = [&](DWORD) {
+        BYTE* pb = nullptr;
+        DWORD cb = 0;
+        ULONGLONG ullWriteTime = 0;
+        ULONGLONG cbFile = 0;
+        if (SUCCEEDED(cache.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile)))
+        {
+            dwSink += cb;
+            CoTaskMemFree(pb);
+        }
+    };
+    auto readDecision = [&](DWORD i) {
+        SHARED_CACHE_DECISION decision;
+        dwSink += cache.ReadDecision(StressKeyHash(i % STRESS_KEYS), &decision) == S_OK;
+    };
+    BenchRun("ReadConfig", 200000, readConfig);
+    BenchRun("ReadDecision", 1000000, readDecision);
+    BenchRun("PublishDecision", 1000000, [&](DWORD i) {
+        cache.PublishDecision(StressKeyHash(i % STRESS_KEYS), i, StressRetryTick(i, i), (i & 1) != 0, i);
+    });
+
+    volatile LONG* plStop = (volatile LONG*)mmap(nullptr, sizeof(LONG), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    *plStop = FALSE;
+    pid_t pid = RunChild([&] {
+        SharedCache writer;
+        if (FAILED(writer.Open(szName, true)))
+        {
+            return 2;
+        }
+        for (ULONGLONG ullSerial = 2; !ReadAcquire(plStop); ullSerial++)
+        {
+            PublishStressConfig(&writer, ullSerial);
+            for (DWORD i = 0; i < STRESS_KEYS; i++)
+            {
+                DWORD dwGeneration = (DWORD)ullSerial + i;
+                writer.PublishDecision(StressKeyHash(i), dwGeneration, StressRetryTick(ullSerial, dwGeneration), (dwGeneration & 1) != 0, ullSerial);
+            }
+        }
+        return 0;
+    });
+    BenchRun("ReadConfig（另一进程发布中）", 200000, readConfig);
+    BenchRun("ReadDecision（另一进程发布中）", 1000000, readDecision);
+    WriteRelease(plStop, TRUE);
+    CHECK_EQ(WaitChild(pid), 0);
+    munmap((void*)plStop, sizeof(LONG));
+
+    SHARED_CACHE_STATS stats;
+    cache.GetStats(&stats);
+    printf("重试 %lld 次，放弃 %lld 次\n", stats.cReadRetries, stats.cReadAbandoned);
+}
+
+TEST_MAIN()
@@ -0,0 +1,172 @@
+#include "pch.h"
+#include "StringTable.h"
+#include "Test.h"
+
+// StringTable：按语言解析字符串块、回退顺序、回退结果的缓存，以及损坏资源的拒绝
+
+static const LANGID c_langidZhCN = MAKELANGID(LANG_CHINESE, SUBLANG_CHINESE_SIMPLIFIED);
+static const LANGID c_langidEnUS = MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_US);
+static const LANGID c_langidEnGB = MAKELANGID(LANG_ENGLISH, SUBLANG_ENGLISH_UK);
+static const LANGID c_langidJaJP = MAKELANGID(LANG_JAPANESE, SUBLANG_DEFAULT);
+
+// RT_STRING 资源的块号：资源 ID / 16 + 1
+static const WORD c_wStringBlock = IDS_STRING_BASE / 16 + 1;
+
+// 按 RT_STRING 格式拼出一个字符串块：16 条 [WORD 长度][不带 NUL 的字符]，未给出的条目长度为 0
+class StringBlock
+{
+public:
+    StringBlock(const PCWSTR* rgpsz, DWORD cStrings) : _cw(0)
+    {
+        for (DWORD i = 0; i < 16; i++)
+        {
+            PCWSTR psz = (i < cStrings) ? rgpsz[i] : L"";
+            WORD cch = (WORD)wcslen(psz);
+            _rgw[_cw++] = cch;
+            CopyMemory(&_rgw[_cw], psz, cch * sizeof(WCHAR));
+            _cw += cch;
+        }
+    }
+
+    // cbMax 不为 0 时只注册块的前 cbMax 字节
+    void Register(LANGID langid, DWORD cbMax = 0) const
+    {
+        DWORD cb = _cw * sizeof(WORD);
+        WinCompatSetStringResource(c_wStringBlock, langid, _rgw, (cbMax && (cbMax < cb)) ? cbMax : cb);
+    }
+
+private:
+    WORD _rgw[1024];
+    DWORD _cw;
+};
+
+static const PCWSTR c_rgpszZhCN[] = { L"自动解锁", L"使用已保存的凭据", L"序列化失败", L"等待解锁信号", L"正在读取凭据" };
+static const PCWSTR c_rgpszEnUS[] = { L"Auto Unlock", L"Use saved credentials", L"Serialization failed", L"Waiting for unlock signal", L"Loading credentials" };
+
+static const StringBlock s_blockZhCN(c_rgpszZhCN, ARRAYSIZE(c_rgpszZhCN));
+static const StringBlock s_blockEnUS(c_rgpszEnUS, ARRAYSIZE(c_rgpszEnUS));
+
+static void ResetResources()
+{
+    StringTableCleanup();
+    WinCompatClearResources();
+}
+
+static bool StringEquals(const STRING_TABLE* pTable, STRINGID id, PCWSTR pszExpected)
+{
+    PWSTR psz = nullptr;
+    bool fEqual = SUCCEEDED(StringTableCoAllocCopy(pTable, id, &psz)) && !wcscmp(psz, pszExpected);
+    CoTaskMemFree(psz);
+    return fEqual;
+}
+
+TEST(SelectsExactLanguage)
+{
+    ResetResources();
+    s_blockZhCN.Register(c_langidZhCN);
+    s_blockEnUS.Register(c_langidEnUS);
+
+    const STRING_TABLE* pTable = nullptr;
+    CHECK_HR(StringTableSelect(c_langidEnUS, &pTable), S_OK);
+    CHECK(pTable != nullptr);
+    if (!pTable)
+    {
+        return;
+    }
+    CHECK_EQ(pTable->langid, c_langidEnUS);
+    for (DWORD i = 0; i < STR_NUM_STRINGS; i++)
+    {
+        CHECK(!wcscmp(pTable->rgpsz[i], c_rgpszEnUS[i]));
+        CHECK_EQ(pTable->rgcch[i], (WORD)wcslen(c_rgpszEnUS[i]));
+    }
+    CHECK(StringEquals(pTable, STR_CREDENTIALS_LOADING, L"Loading credentials"));
+
+    // 已加载的语言直接返回同一张表
+    const STRING_TABLE* pAgain = nullptr;
+    CHECK_HR(StringTableSelect(c_langidEnUS, &pAgain), S_OK);
+    CHECK(pAgain == pTable);
+}
+
+TEST(FallsBackToPrimaryLanguageThenChinese)
+{
+    ResetResources();
+    s_blockZhCN.Register(c_langidZhCN);
+    s_blockEnUS.Register(c_langidEnUS);
+
+    // en-GB 没有资源：回退到同一主语言的默认子语言 en-US
+    const STRING_TABLE* pEnGB = nullptr;
+    CHECK_HR(StringTableSelect(c_langidEnGB, &pEnGB), S_OK);
+    CHECK(pEnGB && (pEnGB->langid == c_langidEnUS));
+
+    // 日语没有资源：回退到简体中文
+    const STRING_TABLE* pJaJP = nullptr;
+    CHECK_HR(StringTableSelect(c_langidJaJP, &pJaJP), S_OK);
+    CHECK(pJaJP && (pJaJP->langid == c_langidZhCN));
+    CHECK(StringEquals(pJaJP, STR_TILE_TITLE, L"自动解锁"));
+
+    // 回退结果被记住：资源移除后仍命中已加载的表
+    WinCompatClearResources();
+    const STRING_TABLE* pAgain = nullptr;
+    CHECK_HR(StringTableSelect(c_langidEnGB, &pAgain), S_OK);
+    CHECK(pAgain == pEnGB);
+    CHECK_HR(StringTableSelect(c_langidJaJP, &pAgain), S_OK);
+    CHECK(pAgain == pJaJP);
+}
+
+TEST(NullTableUsesChinese)
+{
+    ResetResources();
+    s_blockZhCN.Register(c_langidZhCN);
+    CHECK(StringEquals(nullptr, STR_WAITING_FOR_SIGNAL, L"等待解锁信号"));
+
+    PWSTR psz = (PWSTR)1;
+    CHECK_HR(StringTableCoAllocCopy(nullptr, STR_NONE, &psz), E_INVALIDARG);
+    CHECK(psz == nullptr);
+    CHECK_HR(StringTableCoAllocCopy(nullptr, STR_NUM_STRINGS, &psz), E_INVALIDARG);
+}
+
+TEST(MissingOrTruncatedResource)
+{
+    ResetResources();
+    const STRING_TABLE* pTable = (const STRING_TABLE*)1;
+    CHECK_HR(StringTableSelect(c_langidEnUS, &pTable), HRESULT_FROM_WIN32(ERROR_RESOURCE_LANG_NOT_FOUND));
+    CHECK(pTable == nullptr);
+
+    // 第一条的长度字段超出块末尾：拒绝而不是越界读取
+    ResetResources();
+    s_blockZhCN.Register(c_langidZhCN, sizeof(WORD) * 3);
+    CHECK_HR(StringTableSelect(c_langidZhCN, &pTable), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK(pTable == nullptr);
+    ResetResources();
+}
+
+BENCH(StringTableBench)
+{
+    ResetResources();
+    s_blockZhCN.Register(c_langidZhCN);
+    s_blockEnUS.Register(c_langidEnUS);
+    const STRING_TABLE* pTable = nullptr;
+    StringTableSelect(c_langidEnGB, &pTable);
+
+    volatile DWORD dwSink = 0;
+    BenchRun("StringTableSelect（已加载）", 2000000, [&](DWORD) {
+        const STRING_TABLE* p = nullptr;
+        StringTableSelect(c_langidEnGB, &p);
+        dwSink = dwSink + p->rgcch[0];
+    });
+    BenchRun("StringTableCoAllocCopy", 2000000, [&](DWORD i) {
+        PWSTR psz = nullptr;
+        StringTableCoAllocCopy(pTable, (STRINGID)(i % STR_NUM_STRINGS), &psz);
+        dwSink = dwSink + psz[0];
+        CoTaskMemFree(psz);
+    });
+    BenchRun("清空后重新解析字符串块", 200000, [&](DWORD) {
+        StringTableCleanup();
+        const STRING_TABLE* p = nullptr;
+        StringTableSelect(c_langidEnUS, &p);
+        dwSink = dwSink + p->rgcch[0];
+    });
+    ResetResources();
+}
+
+TEST_MAIN()
@@ -0,0 +1,6 @@
+#include "pch.h"
+
+// 被测源文件引用、但测试不涉及的全局符号。各模块的替身在 stubs/ 中，每个文件单独成为静态库中的一个目标文件：
+// 测试链接了真实的源文件时链接器不再取用对应替身，不会出现重复定义
+
+HINSTANCE g_hinst = nullptr;
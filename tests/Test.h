@@ -0,0 +1,114 @@
+#pragma once
+
+#include <windows.h>
+#include <stdio.h>
+
+// 可移植单元测试的极简框架
+//
+// 每个测试文件编译为一个可执行文件：TEST 定义的用例在 main 中按定义顺序运行，任一 CHECK 失败时返回 1。
+// 以 bench 参数运行时改为执行 BENCH 定义的性能测试，不计入 ctest。
+
+typedef void (*PFN_TEST)();
+
+struct TEST_ENTRY
+{
+    const char* pszName;
+    PFN_TEST pfn;
+    bool fBench;
+    TEST_ENTRY* pNext;
+};
+
+inline TEST_ENTRY*& TestListHead()
+{
+    static TEST_ENTRY* s_pHead = nullptr;
+    return s_pHead;
+}
+
+inline int& TestFailureCount()
+{
+    static int s_cFailures = 0;
+    return s_cFailures;
+}
+
+struct TestRegistrar
+{
+    TestRegistrar(TEST_ENTRY* pEntry)
+    {
+        // 追加到末尾以保持定义顺序
+        TEST_ENTRY** ppNext = &TestListHead();
+        while (*ppNext)
+        {
+            ppNext = &(*ppNext)->pNext;
+        }
+        *ppNext = pEntry;
+    }
+};
+
+#define TEST_REGISTER(name, fBench) \
+    static void name(); \
+    static TEST_ENTRY s_entry_##name = { #name, name, fBench, nullptr }; \
+    static TestRegistrar s_registrar_##name(&s_entry_##name); \
+    static void name()
+
+#define TEST(name) TEST_REGISTER(name, false)
+#define BENCH(name) TEST_REGISTER(name, true)
+
+inline void TestFail(const char* pszFile, int nLine, const char* pszExpr)
+{
+    fprintf(stderr, "%s:%d: CHECK(%s) 失败\n", pszFile, nLine, pszExpr);
+    TestFailureCount()++;
+}
+
+#define CHECK(expr) \
+    do \
+    { \
+        if (!(expr)) \
+        { \
+            TestFail(__FILE__, __LINE__, #expr); \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+#define CHECK_HR(hr, hrExpected) CHECK((HRESULT)(hr) == (HRESULT)(hrExpected))
+
+// 用 QPC 计时 cIterations 次调用，输出每次的平均纳秒数
+template <typename TFn>
+double BenchRun(const char* pszName, DWORD cIterations, TFn fn)
+{
+    LARGE_INTEGER liFreq, liStart, liEnd;
+    QueryPerformanceFrequency(&liFreq);
+    QueryPerformanceCounter(&liStart);
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        fn(i);
+    }
+    QueryPerformanceCounter(&liEnd);
+    double dblNs = (double)(liEnd.QuadPart - liStart.QuadPart) * 1e9 / (double)liFreq.QuadPart / cIterations;
+    printf("%-44s %10.1f ns/次  (%u 次)\n", pszName, dblNs, cIterations);
+    return dblNs;
+}
+
+inline int TestMain(int argc, char** argv)
+{
+    bool fBench = (argc > 1) && !strcmp(argv[1], "bench");
+    int cRun = 0;
+    for (TEST_ENTRY* p = TestListHead(); p; p = p->pNext)
+    {
+        if (p->fBench != fBench)
+        {
+            continue;
+        }
+        int cFailuresBefore = TestFailureCount();
+        p->pfn();
+        cRun++;
+        printf("%s %s\n", (TestFailureCount() == cFailuresBefore) ? "[通过]" : "[失败]", p->pszName);
+    }
+    printf("%d 项，%d 处失败\n", cRun, TestFailureCount());
+    return TestFailureCount() ? 1 : 0;
+}
+
+#define TEST_MAIN() \
+    int main(int argc, char** argv) \
+    { \
+        return TestMain(argc, argv); \
+    }
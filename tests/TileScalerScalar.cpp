@@ -0,0 +1,7 @@
+// TileScaler.cpp 的标量路径：取消 __SSE2__ 后再编译一次，入口改名为 TileScaleSquareScalar，
+// 与同一可执行文件中的 SSE2 路径逐像素比较
+#include "pch.h"
+
+#undef __SSE2__
+#define TileScaleSquare TileScaleSquareScalar
+#include "TileScaler.cpp"
@@ -0,0 +1,151 @@
+#include "pch.h"
+#include "TileScaler.h"
+#include "Test.h"
+
+// TileScaler：SSE2 路径与标量路径逐像素一致，以及裁剪、减半舍入、参数检查
+
+// TileScalerScalar.cpp 中不带 SSE2 的同一实现
+HRESULT TileScaleSquareScalar(const DWORD* pSrc, UINT cxSrc, UINT cySrc, UINT cxStride, UINT cDst, DWORD* pDst);
+
+static DWORD* AllocImage(UINT cxStride, UINT cy, DWORD dwSeed)
+{
+    DWORD* p = (DWORD*)CoTaskMemAlloc((size_t)cxStride * cy * sizeof(DWORD));
+    for (size_t i = 0; p && (i < (size_t)cxStride * cy); i++)
+    {
+        dwSeed = dwSeed * 1664525 + 1013904223;
+        p[i] = dwSeed;
+    }
+    return p;
+}
+
+TEST(Sse2MatchesScalar)
+{
+    static const UINT c_rgSizes[][2] =
+    {
+        { 1, 1 }, { 2, 2 }, { 3, 5 }, { 7, 7 }, { 9, 4 }, { 64, 64 }, { 100, 60 },
+        { 257, 255 }, { 384, 384 }, { 1000, 37 }, { 1024, 768 },
+    };
+    static const UINT c_rgDst[] = { 1, 2, 3, 5, 48, 64, 96, 192, 256 };
+
+    DWORD cMismatches = 0;
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgSizes); i++)
+    {
+        UINT cx = c_rgSizes[i][0];
+        UINT cy = c_rgSizes[i][1];
+        UINT cxStride = cx + (i % 3);      // 行间有填充时同样裁剪
+        DWORD* pSrc = AllocImage(cxStride, cy, i + 1);
+        for (DWORD j = 0; j < ARRAYSIZE(c_rgDst); j++)
+        {
+            UINT cDst = c_rgDst[j];
+            DWORD* pSse2 = (DWORD*)CoTaskMemAlloc((size_t)cDst * cDst * sizeof(DWORD));
+            DWORD* pScalar = (DWORD*)CoTaskMemAlloc((size_t)cDst * cDst * sizeof(DWORD));
+            CHECK_HR(TileScaleSquare(pSrc, cx, cy, cxStride, cDst, pSse2), S_OK);
+            CHECK_HR(TileScaleSquareScalar(pSrc, cx, cy, cxStride, cDst, pScalar), S_OK);
+            if (memcmp(pSse2, pScalar, (size_t)cDst * cDst * sizeof(DWORD)))
+            {
+                fprintf(stderr, "  %ux%u (stride %u) -> %u 不一致\n", cx, cy, cxStride, cDst);
+                cMismatches++;
+            }
+            CoTaskMemFree(pSse2);
+            CoTaskMemFree(pScalar);
+        }
+        CoTaskMemFree(pSrc);
+    }
+    CHECK_EQ(cMismatches, 0u);
+}
+
+TEST(UniformImageStaysUniform)
+{
+    const DWORD dwColor = 0x80402010;
+    DWORD* pSrc = (DWORD*)CoTaskMemAlloc(300 * 200 * sizeof(DWORD));
+    for (UINT i = 0; i < 300 * 200; i++)
+    {
+        pSrc[i] = dwColor;
+    }
+    DWORD rgDst[48 * 48];
+    CHECK_HR(TileScaleSquare(pSrc, 300, 200, 300, 48, rgDst), S_OK);
+    bool fUniform = true;
+    for (UINT i = 0; i < ARRAYSIZE(rgDst); i++)
+    {
+        fUniform = fUniform && (rgDst[i] == dwColor);
+    }
+    CHECK(fUniform);
+    CoTaskMemFree(pSrc);
+}
+
+// 2x2 减半：先垂直后水平，每步 (a + b + 1) >> 1
+TEST(HalvingRoundsLikeAvgEpu8)
+{
+    const DWORD rgSrc[4] = { 0x00000000, 0x01010101, 0x01010101, 0xffffffff };
+    DWORD dwDst = 0;
+    CHECK_HR(TileScaleSquare(rgSrc, 2, 2, 2, 1, &dwDst), S_OK);
+    // 垂直：(0 + 1 + 1) >> 1 = 1，(1 + 255 + 1) >> 1 = 128；水平：(1 + 128 + 1) >> 1 = 65
+    CHECK_EQ(dwDst, 0x41414141u);
+    CHECK_HR(TileScaleSquareScalar(rgSrc, 2, 2, 2, 1, &dwDst), S_OK);
+    CHECK_EQ(dwDst, 0x41414141u);
+}
+
+// 边长等于目标时只做居中裁剪和复制
+TEST(CenterCropCopies)
+{
+    // 6x4，中心 4x4 为第 1..4 列
+    DWORD rgSrc[8 * 4] = {};
+    for (UINT y = 0; y < 4; y++)
+    {
+        for (UINT x = 0; x < 6; x++)
+        {
+            rgSrc[y * 8 + x] = (y << 8) | x;
+        }
+    }
+    DWORD rgDst[16];
+    CHECK_HR(TileScaleSquare(rgSrc, 6, 4, 8, 4, rgDst), S_OK);
+    bool fCropped = true;
+    for (UINT y = 0; y < 4; y++)
+    {
+        for (UINT x = 0; x < 4; x++)
+        {
+            fCropped = fCropped && (rgDst[y * 4 + x] == ((y << 8) | (x + 1)));
+        }
+    }
+    CHECK(fCropped);
+}
+
+TEST(InvalidArguments)
+{
+    DWORD dw = 0;
+    CHECK_HR(TileScaleSquare(nullptr, 1, 1, 1, 1, &dw), E_INVALIDARG);
+    CHECK_HR(TileScaleSquare(&dw, 1, 1, 1, 1, nullptr), E_INVALIDARG);
+    CHECK_HR(TileScaleSquare(&dw, 0, 1, 1, 1, &dw), E_INVALIDARG);
+    CHECK_HR(TileScaleSquare(&dw, 1, 1, 1, 0, &dw), E_INVALIDARG);
+    CHECK_HR(TileScaleSquare(&dw, 2, 1, 1, 1, &dw), E_INVALIDARG);
+}
+
+BENCH(ScaleBench)
+{
+    static const UINT c_rgCases[][2] = { { 1024, 192 }, { 448, 192 }, { 256, 96 }, { 96, 64 } };
+    volatile DWORD dwSink = 0;
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgCases); i++)
+    {
+        UINT cSrc = c_rgCases[i][0];
+        UINT cDst = c_rgCases[i][1];
+        DWORD* pSrc = AllocImage(cSrc, cSrc, i + 1);
+        DWORD* pDst = (DWORD*)CoTaskMemAlloc((size_t)cDst * cDst * sizeof(DWORD));
+        DWORD cIterations = (cSrc >= 448) ? 500 : 5000;
+
+        char szName[64];
+        snprintf(szName, sizeof(szName), "SSE2 %ux%u -> %u", cSrc, cSrc, cDst);
+        BenchRun(szName, cIterations, [&](DWORD) {
+            TileScaleSquare(pSrc, cSrc, cSrc, cSrc, cDst, pDst);
+            dwSink = dwSink + pDst[0];
+        });
+        snprintf(szName, sizeof(szName), "标量 %ux%u -> %u", cSrc, cSrc, cDst);
+        BenchRun(szName, cIterations, [&](DWORD) {
+            TileScaleSquareScalar(pSrc, cSrc, cSrc, cSrc, cDst, pDst);
+            dwSink = dwSink + pDst[0];
+        });
+        CoTaskMemFree(pSrc);
+        CoTaskMemFree(pDst);
+    }
+}
+
+TEST_MAIN()
@@ -0,0 +1,262 @@
+// 先于其他头文件包含：UnlockPolicy.h 只依赖 <windows.h>
+#include "UnlockPolicy.h"
+#include "Test.h"
+#include <credentialprovider.h>
+
+// UnlockPolicy：规则编译、首条匹配求值及规则条数上限
+
+// 以 ASCII 行拼出 REG_MULTI_SZ 格式的策略
+class PolicySource
+{
+public:
+    PolicySource() : _ich(0)
+    {
+        _rgch[0] = L'\0';
+    }
+
+    void Line(const char* pszLine)
+    {
+        while (*pszLine && (_ich < ARRAYSIZE(_rgch) - 2))
+        {
+            _rgch[_ich++] = (WCHAR)*pszLine++;
+        }
+        _rgch[_ich++] = L'\0';
+        _rgch[_ich] = L'\0';
+    }
+
+    // 形如 "<前缀><n><后缀>" 的一行
+    void LineN(const char* pszPrefix, DWORD n, const char* pszSuffix)
+    {
+        char szLine[128];
+        snprintf(szLine, sizeof(szLine), "%s%u%s", pszPrefix, n, pszSuffix);
+        Line(szLine);
+    }
+
+    PCWSTR Get() const { return _rgch; }
+
+private:
+    WCHAR _rgch[64 * 1024];
+    size_t _ich;
+};
+
+static void NameN(WCHAR* pszName, size_t cchName, const char* pszPrefix, DWORD n)
+{
+    char szName[64];
+    snprintf(szName, sizeof(szName), "%s%u", pszPrefix, n);
+    size_t i = 0;
+    for (; szName[i] && (i < cchName - 1); i++)
+    {
+        pszName[i] = (WCHAR)szName[i];
+    }
+    pszName[i] = L'\0';
+}
+
+static UNLOCK_POLICY_CONTEXT MakeContext(PCWSTR pszKey, PCWSTR pszUser, DWORD dwScenario = CPUS_UNLOCK_WORKSTATION)
+{
+    UNLOCK_POLICY_CONTEXT context = {};
+    context.ullKeyHash = UnlockPolicy::HashName(pszKey);
+    context.ullUserHash = UnlockPolicy::HashName(pszUser);
+    context.dwScenario = dwScenario;
+    context.dwDayOfWeek = 1;
+    context.dwMinuteOfDay = 9 * 60;
+    return context;
+}
+
+TEST(NotConfiguredAllows)
+{
+    UnlockPolicy policy;
+    CHECK_HR(policy.Compile(nullptr), S_OK);
+    CHECK(!policy.IsConfigured());
+    CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-1001", L"alice")), UPD_ALLOW);
+
+    // 只有注释和空行同样算已配置，未写 default 时拒绝
+    PolicySource source;
+    source.Line("# 仅注释");
+    source.Line("   ");
+    CHECK_HR(policy.Compile(source.Get()), S_OK);
+    CHECK(policy.IsConfigured());
+    CHECK_EQ(policy.GetRuleCount(), 0u);
+    CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-1001", L"alice")), UPD_DENY);
+}
+
+TEST(SyntaxErrorReportsLineAndDenies)
+{
+    static const char* const c_rgpszBad[] =
+    {
+        "permit",
+        "allow account",
+        "allow scenario credui",
+        "allow days mon-xyz",
+        "allow time 09:00-09:00",
+        "allow time 25:00-26:00",
+        "allow maxperhour 0",
+        "allow maxperhour 17",
+        "default maybe",
+        "default allow extra",
+    };
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgpszBad); i++)
+    {
+        PolicySource source;
+        source.Line("default allow");
+        source.Line("allow account alice");
+        source.Line(c_rgpszBad[i]);
+        UnlockPolicy policy;
+        DWORD dwErrorLine = 0;
+        CHECK_HR(policy.Compile(source.Get(), &dwErrorLine), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        CHECK_EQ(dwErrorLine, 3u);
+        CHECK(policy.IsConfigured());
+        CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-1001", L"alice")), UPD_DENY);
+    }
+}
+
+TEST(FirstMatchWins)
+{
+    PolicySource source;
+    source.Line("deny account BOB           # 用户名不区分大小写");
+    source.Line("allow account S-1-5-21-1-1001 scenario unlock");
+    source.Line("allow scenario unlock signal");
+    source.Line("default deny");
+    UnlockPolicy policy;
+    CHECK_HR(policy.Compile(source.Get()), S_OK);
+    CHECK_EQ(policy.GetRuleCount(), 3u);
+
+    CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-1002", L"bob")), UPD_DENY);
+    CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-1001", L"alice")), UPD_ALLOW);
+    CHECK_EQ(policy.Evaluate(MakeContext(L"s-1-5-21-1-1001", L"alice")), UPD_ALLOW);
+    CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-1003", L"carol")), UPD_SIGNAL_REQUIRED);
+    UNLOCK_POLICY_CONTEXT context = MakeContext(L"S-1-5-21-1-1003", L"carol");
+    context.fSignaled = true;
+    CHECK_EQ(policy.Evaluate(context), UPD_ALLOW);
+    CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-1001", L"alice", CPUS_LOGON)), UPD_DENY);
+}
+
+TEST(DaysAndTimeWindows)
+{
+    PolicySource source;
+    source.Line("allow days fri-mon time 22:00-06:00     # 跨越周末和午夜");
+    source.Line("allow days mon,wed time 12:00-24:00");
+    source.Line("default deny");
+    UnlockPolicy policy;
+    CHECK_HR(policy.Compile(source.Get()), S_OK);
+
+    struct
+    {
+        DWORD dwDay;
+        DWORD dwMinute;
+        UNLOCK_POLICY_DECISION decision;
+    } const c_rgCases[] =
+    {
+        { 5, 22 * 60, UPD_ALLOW },          // 星期五 22:00，区间包含开始
+        { 6, 3 * 60, UPD_ALLOW },           // 星期六凌晨
+        { 1, 5 * 60 + 59, UPD_ALLOW },      // 星期一 05:59
+        { 1, 6 * 60, UPD_DENY },            // 区间不包含结束
+        { 2, 23 * 60, UPD_DENY },           // 星期二不在任何规则中
+        { 3, 12 * 60, UPD_ALLOW },
+        { 3, 24 * 60 - 1, UPD_ALLOW },      // 24:00 作为结束包含 23:59
+        { 3, 11 * 60 + 59, UPD_DENY },
+    };
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgCases); i++)
+    {
+        UNLOCK_POLICY_CONTEXT context = MakeContext(L"S-1-5-21-1-1001", L"alice");
+        context.dwDayOfWeek = c_rgCases[i].dwDay;
+        context.dwMinuteOfDay = c_rgCases[i].dwMinute;
+        CHECK_EQ(policy.Evaluate(context), c_rgCases[i].decision);
+    }
+}
+
+TEST(MaxPerHour)
+{
+    PolicySource source;
+    source.Line("allow account alice maxperhour 3");
+    UnlockPolicy policy;
+    CHECK_HR(policy.Compile(source.Get()), S_OK);
+
+    UNLOCK_POLICY_CONTEXT context = MakeContext(L"S-1-5-21-1-1001", L"alice");
+    context.cRecentUnlocks = 2;
+    CHECK_EQ(policy.Evaluate(context), UPD_ALLOW);
+    context.cRecentUnlocks = 3;
+    CHECK_EQ(policy.Evaluate(context), UPD_RATE_LIMITED);
+}
+
+// 数百条按账户的规则：只有第一条匹配的规则生效，未匹配时落到 default
+TEST(HundredsOfRules)
+{
+    const DWORD cRules = 600;
+    PolicySource* pSource = new PolicySource();
+    pSource->Line("default allow");
+    for (DWORD i = 0; i < cRules; i++)
+    {
+        // 偶数号账户拒绝，奇数号账户需要信号
+        pSource->LineN((i % 2) ? "allow account user" : "deny account user", i, (i % 2) ? " signal" : "");
+    }
+    UnlockPolicy policy;
+    CHECK_HR(policy.Compile(pSource->Get()), S_OK);
+    CHECK_EQ(policy.GetRuleCount(), cRules);
+
+    for (DWORD i = 0; i < cRules; i++)
+    {
+        WCHAR szUser[32];
+        NameN(szUser, ARRAYSIZE(szUser), "USER", i);
+        CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-9999", szUser)), (i % 2) ? UPD_SIGNAL_REQUIRED : UPD_DENY);
+    }
+    CHECK_EQ(policy.Evaluate(MakeContext(L"S-1-5-21-1-9999", L"user600")), UPD_ALLOW);
+
+    // 编译后的规则可以在锁外准备，再一次性换入
+    UnlockPolicy empty;
+    empty.Swap(policy);
+    CHECK(!policy.IsConfigured());
+    CHECK_EQ(empty.GetRuleCount(), cRules);
+    delete pSource;
+}
+
+TEST(RuleLimit)
+{
+    PolicySource* pSource = new PolicySource();
+    for (DWORD i = 0; i < UNLOCK_POLICY_MAX_RULES; i++)
+    {
+        pSource->LineN("deny account user", i, "");
+    }
+    UnlockPolicy policy;
+    CHECK_HR(policy.Compile(pSource->Get()), S_OK);
+    CHECK_EQ(policy.GetRuleCount(), (DWORD)UNLOCK_POLICY_MAX_RULES);
+
+    pSource->Line("allow");
+    DWORD dwErrorLine = 0;
+    CHECK_HR(policy.Compile(pSource->Get(), &dwErrorLine), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK_EQ(dwErrorLine, (DWORD)UNLOCK_POLICY_MAX_RULES + 1);
+    CHECK_EQ(policy.GetRuleCount(), 0u);
+    delete pSource;
+}
+
+BENCH(EvaluateBench)
+{
+    static const DWORD c_rgcRules[] = { 1, 16, 128, 512, UNLOCK_POLICY_MAX_RULES };
+    volatile DWORD dwSink = 0;
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgcRules); i++)
+    {
+        PolicySource* pSource = new PolicySource();
+        pSource->Line("default allow");
+        for (DWORD j = 0; j < c_rgcRules[i]; j++)
+        {
+            pSource->LineN("deny account user", j, " days mon-fri time 09:00-17:00");
+        }
+
+        UnlockPolicy policy;
+        char szName[64];
+        snprintf(szName, sizeof(szName), "Compile %u 条", c_rgcRules[i]);
+        BenchRun(szName, (c_rgcRules[i] > 128) ? 2000 : 20000, [&](DWORD) {
+            policy.Compile(pSource->Get());
+        });
+
+        // 最坏情况：没有规则匹配，扫描全表后落到 default
+        UNLOCK_POLICY_CONTEXT context = MakeContext(L"S-1-5-21-1-9999", L"nobody");
+        snprintf(szName, sizeof(szName), "Evaluate %u 条（无匹配）", c_rgcRules[i]);
+        BenchRun(szName, 200000, [&](DWORD j) {
+            context.dwMinuteOfDay = j % (24 * 60);
+            dwSink = dwSink + policy.Evaluate(context);
+        });
+        delete pSource;
+    }
+}
+
+TEST_MAIN()
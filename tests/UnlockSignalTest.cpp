@@ -0,0 +1,328 @@
+#include "pch.h"
+#include "UnlockSignal.h"
+#include "LatencyTrace.h"
+#include "Test.h"
+#include <bcrypt.h>
+#include <algorithm>
+#include <vector>
+
+// UnlockSignal：经兼容层的命名管道（Unix 套接字）完成挑战应答。
+// 密钥配置、有效信号的回调与一次性消费、错误密钥/会话/版本及超长消息的拒绝、
+// 停止时取消等待中的读取、不发送的客户端超时断开、停止后下一个实例立即接管管道名；性能测试为回环往返耗时
+
+// 兼容层中 ProcessIdToSessionId 总是返回会话 1
+#define TEST_SESSION_ID 1
+
+static const BYTE c_rgbKey[UNLOCK_SIGNAL_KEY_MIN] =
+{
+    0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff,
+    0x0f, 0x1e, 0x2d, 0x3c, 0x4b, 0x5a, 0x69, 0x78, 0x87, 0x96, 0xa5, 0xb4, 0xc3, 0xd2, 0xe1, 0xf0,
+};
+
+static void SetSignalKey(const BYTE* pbKey, DWORD cbKey)
+{
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"SignalKey", REG_BINARY, pbKey, cbKey);
+}
+
+struct SIGNAL_COUNTER
+{
+    volatile LONG cSignals;
+};
+
+static void CALLBACK OnSignal(void* pvContext)
+{
+    InterlockedIncrement(&((SIGNAL_COUNTER*)pvContext)->cSignals);
+}
+
+static UnlockSignal* StartSignal(SIGNAL_COUNTER* pCounter)
+{
+    SetSignalKey(c_rgbKey, sizeof(c_rgbKey));
+    UnlockSignal* pSignal = nullptr;
+    HRESULT hr = UnlockSignal::CreateFromRegistry(&pSignal);
+    CHECK_HR(hr, S_OK);
+    if (pSignal)
+    {
+        CHECK_HR(pSignal->Start(OnSignal, pCounter), S_OK);
+    }
+    return pSignal;
+}
+
+static void StopSignal(UnlockSignal* pSignal)
+{
+    if (pSignal)
+    {
+        pSignal->Stop();
+        pSignal->Release();
+    }
+}
+
+// 监听循环在线程池中创建管道：管道出现之前重试
+static HANDLE OpenSignalPipe(DWORD dwFlags = 0)
+{
+    WCHAR szPipeName[64];
+    StringCchPrintfW(szPipeName, ARRAYSIZE(szPipeName), UNLOCK_SIGNAL_PIPE_FORMAT, TEST_SESSION_ID);
+    for (DWORD i = 0; i < 500; i++)
+    {
+        HANDLE hPipe = CreateFileW(szPipeName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, dwFlags, nullptr);
+        if ((hPipe != INVALID_HANDLE_VALUE) || (GetLastError() != ERROR_FILE_NOT_FOUND))
+        {
+            return hPipe;
+        }
+        Sleep(10);
+    }
+    return INVALID_HANDLE_VALUE;
+}
+
+static void ComputeMac(const BYTE* pbKey, DWORD cbKey, const BYTE* pbChallenge, UNLOCK_SIGNAL_MESSAGE* pMessage)
+{
+    BCRYPT_ALG_HANDLE hAlg = nullptr;
+    BCRYPT_HASH_HANDLE hHash = nullptr;
+    BCryptOpenAlgorithmProvider(&hAlg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG);
+    BCryptCreateHash(hAlg, &hHash, nullptr, 0, (PUCHAR)pbKey, cbKey, 0);
+    BCryptHashData(hHash, (PUCHAR)pbChallenge, UNLOCK_SIGNAL_CHALLENGE_SIZE, 0);
+    BCryptHashData(hHash, (PUCHAR)&pMessage->dwVersion, sizeof(pMessage->dwVersion), 0);
+    BCryptHashData(hHash, (PUCHAR)&pMessage->dwSessionId, sizeof(pMessage->dwSessionId), 0);
+    BCryptFinishHash(hHash, pMessage->rgbMac, sizeof(pMessage->rgbMac), 0);
+    BCryptDestroyHash(hHash);
+    BCryptCloseAlgorithmProvider(hAlg, 0);
+}
+
+// 与 tools\unlocksignal.cpp 相同的一次往返；cbExtra 在消息后追加字节（超长消息）。
+// 返回服务端回复的 HRESULT，连接被关闭而没有回复时返回对应的 Win32 错误
+static HRESULT SendSignal(const BYTE* pbKey, DWORD cbKey, DWORD dwVersion, DWORD dwSessionId, DWORD cbExtra = 0)
+{
+    HANDLE hPipe = OpenSignalPipe();
+    if (hPipe == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    BYTE rgbChallenge[UNLOCK_SIGNAL_CHALLENGE_SIZE];
+    DWORD cb = 0;
+    if (!ReadFile(hPipe, rgbChallenge, sizeof(rgbChallenge), &cb, nullptr) || (cb != sizeof(rgbChallenge)))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        BYTE rgbMessage[sizeof(UNLOCK_SIGNAL_MESSAGE) + 16] = { 0 };
+        UNLOCK_SIGNAL_MESSAGE message = { dwVersion, dwSessionId };
+        ComputeMac(pbKey, cbKey, rgbChallenge, &message);
+        CopyMemory(rgbMessage, &message, sizeof(message));
+        HRESULT hrResult = E_FAIL;
+        if (WriteFile(hPipe, rgbMessage, sizeof(message) + cbExtra, &cb, nullptr) &&
+            ReadFile(hPipe, &hrResult, sizeof(hrResult), &cb, nullptr) && (cb == sizeof(hrResult)))
+        {
+            hr = hrResult;
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    CloseHandle(hPipe);
+    return hr;
+}
+
+TEST(KeyConfiguration)
+{
+    UnlockSignal* pSignal = (UnlockSignal*)1;
+    WinCompatClearRegistry();
+    CHECK_HR(UnlockSignal::CreateFromRegistry(&pSignal), S_FALSE);
+    CHECK(pSignal == nullptr);
+
+    // 短于 UNLOCK_SIGNAL_KEY_MIN 的密钥不接受；类型不对时与 RegGetValueW 相同失败
+    SetSignalKey(c_rgbKey, UNLOCK_SIGNAL_KEY_MIN - 1);
+    CHECK_HR(UnlockSignal::CreateFromRegistry(&pSignal), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK(pSignal == nullptr);
+    DWORD dwKey = 1;
+    WinCompatSetRegistryValue(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"SignalKey", REG_DWORD, &dwKey, sizeof(dwKey));
+    CHECK_HR(UnlockSignal::CreateFromRegistry(&pSignal), HRESULT_FROM_WIN32(ERROR_UNSUPPORTED_TYPE));
+    CHECK(pSignal == nullptr);
+
+    SetSignalKey(c_rgbKey, sizeof(c_rgbKey));
+    CHECK_HR(UnlockSignal::CreateFromRegistry(&pSignal), S_OK);
+    CHECK(pSignal != nullptr);
+    if (pSignal)
+    {
+        CHECK(!pSignal->IsPending());
+        pSignal->Release();
+    }
+    WinCompatClearRegistry();
+}
+
+// 有效信号：回调一次，信号在消费前一直有效，只能消费一次
+TEST(ValidSignalConsumedOnce)
+{
+    SIGNAL_COUNTER counter = { 0 };
+    UnlockSignal* pSignal = StartSignal(&counter);
+    CHECK_HR(pSignal->Start(OnSignal, &counter), S_FALSE);
+
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), S_OK);
+    CHECK_EQ(counter.cSignals, 1);
+    CHECK(pSignal->IsPending());
+    CHECK(pSignal->IsPending());
+    CHECK(pSignal->Consume());
+    CHECK(!pSignal->IsPending());
+    CHECK(!pSignal->Consume());
+
+    // 同一监听循环继续接受下一个连接
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), S_OK);
+    CHECK_EQ(counter.cSignals, 2);
+
+    // 停止后清除未消费的信号，不再回调
+    pSignal->Stop();
+    CHECK(!pSignal->IsPending());
+    CHECK_EQ(counter.cSignals, 2);
+    pSignal->Release();
+}
+
+TEST(InvalidSignalsRejected)
+{
+    SIGNAL_COUNTER counter = { 0 };
+    UnlockSignal* pSignal = StartSignal(&counter);
+
+    BYTE rgbWrongKey[sizeof(c_rgbKey)];
+    CopyMemory(rgbWrongKey, c_rgbKey, sizeof(rgbWrongKey));
+    rgbWrongKey[7] ^= 0x01;
+    CHECK_HR(SendSignal(rgbWrongKey, sizeof(rgbWrongKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), E_ACCESSDENIED);
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID + 1), E_ACCESSDENIED);
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION + 1, TEST_SESSION_ID), E_ACCESSDENIED);
+
+    // 长度不对的消息拒绝；超出读取缓冲区的消息不回复，直接断开
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID, 1), E_ACCESSDENIED);
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID, 16), HRESULT_FROM_WIN32(ERROR_BROKEN_PIPE));
+    CHECK_EQ(counter.cSignals, 0);
+    CHECK(!pSignal->IsPending());
+
+    // 拒绝之后仍在监听
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), S_OK);
+    CHECK_EQ(counter.cSignals, 1);
+    StopSignal(pSignal);
+}
+
+// 客户端连上后不发送：Stop 取消等待中的读取，不必等 UNLOCK_SIGNAL_IO_TIMEOUT_MS
+TEST(StopCancelsPendingRead)
+{
+    SIGNAL_COUNTER counter = { 0 };
+    UnlockSignal* pSignal = StartSignal(&counter);
+    HANDLE hPipe = OpenSignalPipe();
+    CHECK(hPipe != INVALID_HANDLE_VALUE);
+    BYTE rgbChallenge[UNLOCK_SIGNAL_CHALLENGE_SIZE];
+    DWORD cb = 0;
+    CHECK(ReadFile(hPipe, rgbChallenge, sizeof(rgbChallenge), &cb, nullptr) && (cb == sizeof(rgbChallenge)));
+
+    ULONGLONG ullStart = GetTickCount64();
+    pSignal->Stop();
+    CHECK(GetTickCount64() - ullStart < UNLOCK_SIGNAL_IO_TIMEOUT_MS / 2);
+    pSignal->Release();
+
+    // 服务端已关闭连接
+    HRESULT hrResult = S_OK;
+    CHECK(!ReadFile(hPipe, &hrResult, sizeof(hrResult), &cb, nullptr));
+    CHECK_EQ(GetLastError(), (DWORD)ERROR_BROKEN_PIPE);
+    CloseHandle(hPipe);
+    CHECK_EQ(counter.cSignals, 0);
+}
+
+// 客户端连上后一直不发送：UNLOCK_SIGNAL_IO_TIMEOUT_MS 后服务端断开，接着处理下一个客户端
+TEST(SilentClientTimesOut)
+{
+    SIGNAL_COUNTER counter = { 0 };
+    UnlockSignal* pSignal = StartSignal(&counter);
+    HANDLE hPipe = OpenSignalPipe(FILE_FLAG_OVERLAPPED);
+    CHECK(hPipe != INVALID_HANDLE_VALUE);
+    BYTE rgbChallenge[UNLOCK_SIGNAL_CHALLENGE_SIZE];
+    DWORD cb = 0;
+    OVERLAPPED ov = { 0 };
+    ov.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+    BOOL fRead = ReadFile(hPipe, rgbChallenge, sizeof(rgbChallenge), nullptr, &ov) || (GetLastError() == ERROR_IO_PENDING);
+    CHECK(fRead && GetOverlappedResult(hPipe, &ov, &cb, TRUE) && (cb == sizeof(rgbChallenge)));
+
+    // 超时前不断开；超时后读取以 ERROR_BROKEN_PIPE 结束
+    ULONGLONG ullStart = GetTickCount64();
+    HRESULT hrResult = S_OK;
+    CHECK(!ReadFile(hPipe, &hrResult, sizeof(hrResult), nullptr, &ov));
+    CHECK_EQ(GetLastError(), (DWORD)ERROR_IO_PENDING);
+    CHECK_EQ(WaitForSingleObject(ov.hEvent, UNLOCK_SIGNAL_IO_TIMEOUT_MS + 1000), (DWORD)WAIT_OBJECT_0);
+    CHECK(GetTickCount64() - ullStart >= UNLOCK_SIGNAL_IO_TIMEOUT_MS - 100);
+    CHECK(!GetOverlappedResult(hPipe, &ov, &cb, FALSE));
+    CHECK_EQ(GetLastError(), (DWORD)ERROR_BROKEN_PIPE);
+    CancelIoEx(hPipe, &ov);
+    GetOverlappedResult(hPipe, &ov, &cb, TRUE);
+    CloseHandle(ov.hEvent);
+    CloseHandle(hPipe);
+
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), S_OK);
+    CHECK_EQ(counter.cSignals, 1);
+    StopSignal(pSignal);
+}
+
+// 新实例在旧实例仍占用管道名时按退避间隔重试，旧实例停止后接管；
+// Stop 等监听循环关闭管道后才返回，紧接着启动的实例第一次就能创建管道
+TEST(NextInstanceTakesOverPipeName)
+{
+    SIGNAL_COUNTER counterOld = { 0 };
+    SIGNAL_COUNTER counterNew = { 0 };
+    UnlockSignal* pOld = StartSignal(&counterOld);
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), S_OK);
+
+    UnlockSignal* pNew = StartSignal(&counterNew);
+    Sleep(UNLOCK_SIGNAL_RETRY_MS);
+    StopSignal(pOld);
+    CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), S_OK);
+    CHECK_EQ(counterOld.cSignals, 1);
+    CHECK_EQ(counterNew.cSignals, 1);
+    StopSignal(pNew);
+
+    for (DWORD i = 0; i < 5; i++)
+    {
+        SIGNAL_COUNTER counter = { 0 };
+        UnlockSignal* pSignal = StartSignal(&counter);
+        ULONGLONG ullStart = GetTickCount64();
+        CHECK_HR(SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID), S_OK);
+        CHECK(GetTickCount64() - ullStart < UNLOCK_SIGNAL_RETRY_MS);
+        CHECK_EQ(counter.cSignals, 1);
+        StopSignal(pSignal);
+    }
+    WinCompatClearRegistry();
+}
+
+// 回环往返：连接、挑战、应答、回复，与 unlocksignal /bench 相同的测量口径
+BENCH(UnlockSignalLoopbackBench)
+{
+    SIGNAL_COUNTER counter = { 0 };
+    UnlockSignal* pSignal = StartSignal(&counter);
+    SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID);
+
+    const DWORD cRounds = 2000;
+    std::vector<double> latencies;
+    latencies.reserve(cRounds);
+    DWORD cFailed = 0;
+    BenchRun("信号往返（连接到收到确认）", cRounds, [&](DWORD) {
+        LARGE_INTEGER liStart, liEnd, liFrequency;
+        QueryPerformanceCounter(&liStart);
+        HRESULT hr = SendSignal(c_rgbKey, sizeof(c_rgbKey), UNLOCK_SIGNAL_VERSION, TEST_SESSION_ID);
+        QueryPerformanceCounter(&liEnd);
+        QueryPerformanceFrequency(&liFrequency);
+        if (hr == S_OK)
+        {
+            latencies.push_back((double)(liEnd.QuadPart - liStart.QuadPart) * 1000.0 / (double)liFrequency.QuadPart);
+        }
+        else
+        {
+            cFailed++;
+        }
+    });
+    StopSignal(pSignal);
+    WinCompatClearRegistry();
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("  成功 %zu 次，失败 %u 次；往返耗时（毫秒）: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n", latencies.size(), cFailed,
+        TracePercentile(latencies.data(), latencies.size(), 0.50), TracePercentile(latencies.data(), latencies.size(), 0.90),
+        TracePercentile(latencies.data(), latencies.size(), 0.99), latencies.empty() ? 0.0 : latencies.back());
+}
+
+TEST_MAIN()
@@ -0,0 +1,381 @@
+#include "pch.h"
+#include "Vault.h"
+#include "ConfigSeal.h"
+#include "ConfigFile.h"
+#include "Test.h"
+#include <bcrypt.h>
+#include <vector>
+
+// 口令保险库与主机密钥密封的测试向量：RFC 8439（Poly1305、ChaCha20-Poly1305）、RFC 7914（PBKDF2-HMAC-SHA256、scrypt），
+// ChaCha20 的 SSE2 与标量实现逐字节一致；保险库文件和主机密钥密封各有一份由 OpenSSL 独立生成的参考数据，
+// 固定文件格式（AES-256-GCM、附加认证数据、派生标签）。性能测试为 ChaCha20 和 scrypt 的吞吐
+
+static std::vector<BYTE> ParseHex(const char* psz)
+{
+    std::vector<BYTE> data;
+    for (; psz[0] && psz[1]; psz += 2)
+    {
+        char sz[3] = { psz[0], psz[1], 0 };
+        data.push_back((BYTE)strtoul(sz, nullptr, 16));
+    }
+    return data;
+}
+
+static std::vector<BYTE> Sequence(BYTE bFirst, size_t cb)
+{
+    std::vector<BYTE> data(cb);
+    for (size_t i = 0; i < cb; i++)
+    {
+        data[i] = (BYTE)(bFirst + i);
+    }
+    return data;
+}
+
+// RFC 8439 2.5.2，分两次送入消息
+TEST(Poly1305Rfc8439)
+{
+    std::vector<BYTE> key = ParseHex("85d6be7857556d337f4452fe42d506a80103808afb0db2fd4abff6af4149f51b");
+    std::vector<BYTE> expected = ParseHex("a8061dc1305136c6c22b8baf0c0127a9");
+    static const char c_szMessage[] = "Cryptographic Forum Research Group";
+    BYTE rgbTag[POLY1305_TAG_SIZE];
+    POLY1305_STATE state;
+    Poly1305Init(&state, key.data());
+    Poly1305Update(&state, (const BYTE*)c_szMessage, 10);
+    Poly1305Update(&state, (const BYTE*)c_szMessage + 10, sizeof(c_szMessage) - 1 - 10);
+    Poly1305Final(&state, rgbTag);
+    CHECK(memcmp(rgbTag, expected.data(), sizeof(rgbTag)) == 0);
+}
+
+// RFC 8439 2.8.2：加密、解密，改动密文或附加数据后拒绝
+TEST(ChaChaPolyRfc8439)
+{
+    std::vector<BYTE> key = ParseHex("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f");
+    std::vector<BYTE> nonce = ParseHex("070000004041424344454647");
+    std::vector<BYTE> aad = ParseHex("50515253c0c1c2c3c4c5c6c7");
+    std::vector<BYTE> expected = ParseHex(
+        "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d63dbea45e8ca9671282fafb69da92728b1a71de0a9e060b2905d6a5b67ecd3b36"
+        "92ddbd7f2d778b8c9803aee328091b58fab324e4fad675945585808b4831d7bc3ff4def08e4b7a9de576d26586cec64b6116");
+    std::vector<BYTE> expectedTag = ParseHex("1ae10b594f09e26a7e902ecbd0600691");
+    static const char c_szPlain[] = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, sunscreen would be it.";
+    size_t cb = sizeof(c_szPlain) - 1;
+
+    std::vector<BYTE> cipher(cb);
+    std::vector<BYTE> plain(cb);
+    BYTE rgbTag[POLY1305_TAG_SIZE];
+    ChaChaPolySeal(key.data(), nonce.data(), aad.data(), aad.size(), (const BYTE*)c_szPlain, cipher.data(), cb, rgbTag);
+    CHECK(cipher == expected);
+    CHECK(memcmp(rgbTag, expectedTag.data(), sizeof(rgbTag)) == 0);
+
+    CHECK_HR(ChaChaPolyOpen(key.data(), nonce.data(), aad.data(), aad.size(), cipher.data(), plain.data(), cb, rgbTag), S_OK);
+    CHECK(memcmp(plain.data(), c_szPlain, cb) == 0);
+
+    cipher[cb / 2] ^= 0x01;
+    CHECK_HR(ChaChaPolyOpen(key.data(), nonce.data(), aad.data(), aad.size(), cipher.data(), plain.data(), cb, rgbTag),
+        HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH));
+    cipher[cb / 2] ^= 0x01;
+    aad[0] ^= 0x01;
+    CHECK_HR(ChaChaPolyOpen(key.data(), nonce.data(), aad.data(), aad.size(), cipher.data(), plain.data(), cb, rgbTag),
+        HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH));
+}
+
+// SSE2 与标量实现逐字节一致，覆盖 4 块批量和尾部的各种长度；计数器从非零值开始
+TEST(ChaCha20VectorMatchesScalar)
+{
+    std::vector<BYTE> key = Sequence(0x42, CHACHA20_KEY_SIZE);
+    std::vector<BYTE> nonce = Sequence(0x24, CHACHA20_NONCE_SIZE);
+    std::vector<BYTE> data(1100);
+    BCryptGenRandom(nullptr, data.data(), (ULONG)data.size(), BCRYPT_USE_SYSTEM_PREFERRED_RNG);
+    std::vector<BYTE> vector(data.size());
+    std::vector<BYTE> scalar(data.size());
+    size_t cbMismatch = 0;
+    for (size_t cb = 0; cb <= data.size(); cb++)
+    {
+        ChaCha20Xor(key.data(), nonce.data(), 1, data.data(), vector.data(), cb);
+        ChaCha20XorScalar(key.data(), nonce.data(), 1, data.data(), scalar.data(), cb);
+        cbMismatch += (memcmp(vector.data(), scalar.data(), cb) != 0);
+    }
+    CHECK_EQ(cbMismatch, 0u);
+
+    // 原地加密再解密得到原文
+    std::vector<BYTE> inPlace = data;
+    ChaCha20Xor(key.data(), nonce.data(), 7, inPlace.data(), inPlace.data(), inPlace.size());
+    CHECK(inPlace != data);
+    ChaCha20XorScalar(key.data(), nonce.data(), 7, inPlace.data(), inPlace.data(), inPlace.size());
+    CHECK(inPlace == data);
+}
+
+// RFC 7914 11：兼容层的 PBKDF2-HMAC-SHA256 与 Windows 相同，scrypt 的首尾两步依赖它
+TEST(Pbkdf2Rfc7914)
+{
+    std::vector<BYTE> expected = ParseHex(
+        "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783");
+    BCRYPT_ALG_HANDLE hAlg = nullptr;
+    CHECK(BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&hAlg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG)));
+    BYTE rgbOut[64];
+    CHECK(BCRYPT_SUCCESS(BCryptDeriveKeyPBKDF2(hAlg, (PUCHAR)"passwd", 6, (PUCHAR)"salt", 4, 1, rgbOut, sizeof(rgbOut), 0)));
+    CHECK(memcmp(rgbOut, expected.data(), sizeof(rgbOut)) == 0);
+    BCryptCloseAlgorithmProvider(hAlg, 0);
+}
+
+// RFC 7914 12，取派生结果的前 32 字节；p = 16 时各通道在线程池上并行
+TEST(ScryptRfc7914)
+{
+    struct SCRYPT_VECTOR
+    {
+        const char* pszPassword;
+        const char* pszSalt;
+        VAULT_KDF_PARAMS params;
+        const char* pszExpected;
+    };
+    static const SCRYPT_VECTOR c_rgVectors[] =
+    {
+        { "password", "NaCl", { 10, 8, 16 }, "fdbabe1c9d3472007856e7190d01e9fe7c6ad7cbc8237830e77376634b373162" },
+        { "pleaseletmein", "SodiumChloride", { 14, 8, 1 }, "7023bdcb3afd7348461c06cd81fd38ebfda8fbba904f8e3ea9b543f6545da1f2" },
+    };
+    for (const SCRYPT_VECTOR& vector : c_rgVectors)
+    {
+        BYTE rgbKey[CHACHA20_KEY_SIZE];
+        std::vector<BYTE> expected = ParseHex(vector.pszExpected);
+        CHECK_HR(VaultDeriveKey((const BYTE*)vector.pszPassword, (DWORD)strlen(vector.pszPassword),
+            (const BYTE*)vector.pszSalt, (DWORD)strlen(vector.pszSalt), &vector.params, rgbKey), S_OK);
+        CHECK(memcmp(rgbKey, expected.data(), sizeof(rgbKey)) == 0);
+    }
+
+    // 超出范围的参数在分配内存之前拒绝
+    BYTE rgbKey[CHACHA20_KEY_SIZE];
+    VAULT_KDF_PARAMS tooSmall = { VAULT_KDF_MIN_LOG2N - 1, 8, 1 };
+    VAULT_KDF_PARAMS tooLarge = { VAULT_KDF_MAX_LOG2N, VAULT_KDF_MAX_BLOCK, VAULT_KDF_MAX_LANES };
+    CHECK_HR(VaultDeriveKey((const BYTE*)"x", 1, (const BYTE*)"y", 1, &tooSmall, rgbKey), E_INVALIDARG);
+    CHECK_HR(VaultDeriveKey((const BYTE*)"x", 1, (const BYTE*)"y", 1, &tooLarge, rgbKey), E_INVALIDARG);
+}
+
+static const WCHAR c_rgchAccounts[] = L"alice\0pa55word\0CONTOSO\\bob\0s3cret\0";
+static const BYTE c_rgbPassphrase[] = "correct horse battery staple";
+
+// 参考保险库：scrypt N = 2^10, r = 8, p = 2，头部为附加认证数据（hashlib.scrypt 与 OpenSSL ChaCha20-Poly1305 生成）
+static std::vector<BYTE> ReferenceVault()
+{
+    return ParseHex(
+        "57555654010001000a080200fa000000303132333435363738393a3b3c3d3e3f505152535455565758595a5b44000000"
+        "d5eff6b3c5a3f71a526699be2148793135053a468defb81e089310865fb41b7e99078c37fd9377f22909210438dbcd5a"
+        "6d8b900762d493b72bd1655c4afa8e9b6190d23c"
+        "83e61e35e4bf74229935601690441161");
+}
+
+TEST(VaultOpensReferenceFile)
+{
+    std::vector<BYTE> vault = ReferenceVault();
+    CHECK_EQ(vault.size(), sizeof(VAULT_FILE_HEADER) + sizeof(c_rgchAccounts) - sizeof(WCHAR) + POLY1305_TAG_SIZE);
+    CHECK(VaultIsSealed(vault.data(), (DWORD)vault.size()));
+
+    SecretString accounts;
+    DWORD cchAccounts = 0;
+    CHECK_HR(VaultOpen(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, vault.data(), (DWORD)vault.size(), &accounts, &cchAccounts), S_OK);
+    CHECK_EQ(cchAccounts, ARRAYSIZE(c_rgchAccounts) - 1);
+    CHECK(!accounts.IsEmpty() && (memcmp(accounts.Get(), c_rgchAccounts, cchAccounts * sizeof(WCHAR)) == 0));
+
+    // 错误的口令、改动过的头部（仅供诊断的耗时预算也受认证）和密文都被拒绝，且不留下明文
+    CHECK_HR(VaultOpen(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 2, vault.data(), (DWORD)vault.size(), &accounts, &cchAccounts),
+        HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH));
+    CHECK(accounts.IsEmpty());
+    CHECK_EQ(cchAccounts, 0u);
+    std::vector<BYTE> tampered = vault;
+    tampered[offsetof(VAULT_FILE_HEADER, dwBudgetMs)] ^= 0x01;
+    CHECK_HR(VaultOpen(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, tampered.data(), (DWORD)tampered.size(), &accounts, &cchAccounts),
+        HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH));
+    tampered = vault;
+    tampered[sizeof(VAULT_FILE_HEADER)] ^= 0x80;
+    CHECK_HR(VaultOpen(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, tampered.data(), (DWORD)tampered.size(), &accounts, &cchAccounts),
+        HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH));
+
+    // 长度与头部不符、截断到不足一个头部的文件在派生密钥之前拒绝
+    tampered = vault;
+    tampered.push_back(0);
+    CHECK_HR(VaultOpen(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, tampered.data(), (DWORD)tampered.size(), &accounts, &cchAccounts),
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    CHECK(!VaultIsSealed(vault.data(), sizeof(VAULT_FILE_HEADER)));
+}
+
+TEST(VaultSealRoundTrip)
+{
+    VAULT_KDF_PARAMS params = { VAULT_KDF_MIN_LOG2N, VAULT_KDF_DEFAULT_BLOCK, VAULT_KDF_DEFAULT_LANES };
+    BYTE* pbVault = nullptr;
+    DWORD cbVault = 0;
+    CHECK_HR(VaultSeal(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, &params, 250, c_rgchAccounts, ARRAYSIZE(c_rgchAccounts) - 1, &pbVault, &cbVault), S_OK);
+    CHECK_EQ(cbVault, sizeof(VAULT_FILE_HEADER) + sizeof(c_rgchAccounts) - sizeof(WCHAR) + POLY1305_TAG_SIZE);
+    if (pbVault)
+    {
+        SecretString accounts;
+        DWORD cchAccounts = 0;
+        CHECK_HR(VaultOpen(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, pbVault, cbVault, &accounts, &cchAccounts), S_OK);
+        CHECK_EQ(cchAccounts, ARRAYSIZE(c_rgchAccounts) - 1);
+        CHECK(!accounts.IsEmpty() && (memcmp(accounts.Get(), c_rgchAccounts, cchAccounts * sizeof(WCHAR)) == 0));
+        CHECK(FAILED(VaultOpen(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 2, pbVault, cbVault, &accounts, &cchAccounts)));
+        CHECK(accounts.IsEmpty());
+        CoTaskMemFree(pbVault);
+    }
+
+    // 每次生成使用新的盐和随机数
+    BYTE* pbOther = nullptr;
+    DWORD cbOther = 0;
+    CHECK_HR(VaultSeal(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, &params, 250, c_rgchAccounts, ARRAYSIZE(c_rgchAccounts) - 1, &pbVault, &cbVault), S_OK);
+    CHECK_HR(VaultSeal(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, &params, 250, c_rgchAccounts, ARRAYSIZE(c_rgchAccounts) - 1, &pbOther, &cbOther), S_OK);
+    if (pbVault && pbOther)
+    {
+        const VAULT_FILE_HEADER* pFirst = (const VAULT_FILE_HEADER*)pbVault;
+        const VAULT_FILE_HEADER* pSecond = (const VAULT_FILE_HEADER*)pbOther;
+        CHECK(memcmp(pFirst->rgbSalt, pSecond->rgbSalt, VAULT_SALT_SIZE) != 0);
+        CHECK(memcmp(pFirst->rgbNonce, pSecond->rgbNonce, CHACHA20_NONCE_SIZE) != 0);
+    }
+    CoTaskMemFree(pbVault);
+    CoTaskMemFree(pbOther);
+
+    CHECK_HR(VaultSeal(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, &params, 250, c_rgchAccounts, 0, &pbVault, &cbVault), E_INVALIDARG);
+    CHECK(!pbVault);
+}
+
+static const WCHAR c_szHostSecret[] = L"P@ssw0rd!";
+
+// 主机密钥 = HMAC-SHA256(主密钥, "WinUnlock.HostKey" || 大写主机名)；部署工具和 DLL 必须得到相同的结果
+TEST(HostKeyDerivation)
+{
+    std::vector<BYTE> masterKey = Sequence(0x00, CONFIG_MASTER_KEY_MIN_SIZE);
+    std::vector<BYTE> expected = ParseHex("c221fa598cb5c5e61721f06e8d5b7d041b9ba100a1115de8c3b1762bdea5a3c5");
+    BYTE rgbHostKey[CONFIG_HOST_KEY_SIZE];
+    CHECK_HR(ConfigDeriveHostKey(masterKey.data(), (DWORD)masterKey.size(), L"ws-042.Contoso", rgbHostKey), S_OK);
+    CHECK(memcmp(rgbHostKey, expected.data(), sizeof(rgbHostKey)) == 0);
+    CHECK_HR(ConfigDeriveHostKey(masterKey.data(), (DWORD)masterKey.size(), L"WS-042.CONTOSO", rgbHostKey), S_OK);
+    CHECK(memcmp(rgbHostKey, expected.data(), sizeof(rgbHostKey)) == 0);
+    CHECK_HR(ConfigDeriveHostKey(masterKey.data(), (DWORD)masterKey.size(), L"WS-043.CONTOSO", rgbHostKey), S_OK);
+    CHECK(memcmp(rgbHostKey, expected.data(), sizeof(rgbHostKey)) != 0);
+
+    CHECK_HR(ConfigDeriveHostKey(masterKey.data(), CONFIG_MASTER_KEY_MIN_SIZE - 1, L"WS-042", rgbHostKey), E_INVALIDARG);
+    CHECK_HR(ConfigDeriveHostKey(masterKey.data(), (DWORD)masterKey.size(), L"", rgbHostKey), E_INVALIDARG);
+}
+
+// AES-256-GCM：OpenSSL 以相同的密钥、随机数和附加数据（dwMagic）生成的密封数据
+TEST(HostUnsealReferenceBlob)
+{
+    std::vector<BYTE> hostKey = Sequence(0xa0, CONFIG_HOST_KEY_SIZE);
+    std::vector<BYTE> sealed = ParseHex(
+        "57554853" "101112131415161718191a1b" "1f4ca81859fa0a9f6a067fe815279a9c"
+        "c4b6350ead47c6b2ed795c11eb33d8b4d252");
+    CHECK(ConfigIsHostSealed(sealed.data(), (DWORD)sealed.size()));
+
+    SecretString secret;
+    CHECK_HR(ConfigHostUnseal(hostKey.data(), sealed.data(), (DWORD)sealed.size(), &secret), S_OK);
+    CHECK(!secret.IsEmpty() && !wcscmp(secret.Get(), c_szHostSecret));
+    CHECK_EQ(secret.Length(), ARRAYSIZE(c_szHostSecret) - 1);
+
+    // 密文、随机数、标签任一字节被改动，或换一个主机密钥，都以标签不符失败
+    static const size_t c_rgiTampered[] = { 0, 4, 20, sizeof(CONFIG_HOST_SEAL_HEADER) + 3 };
+    for (size_t iByte : c_rgiTampered)
+    {
+        std::vector<BYTE> tampered = sealed;
+        tampered[iByte] ^= 0x01;
+        SecretString rejected;
+        HRESULT hr = ConfigHostUnseal(hostKey.data(), tampered.data(), (DWORD)tampered.size(), &rejected);
+        CHECK_HR(hr, (iByte == 0) ? HRESULT_FROM_WIN32(ERROR_INVALID_DATA) : HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH));
+        CHECK(rejected.IsEmpty());
+    }
+    hostKey[31] ^= 0x01;
+    SecretString wrongKey;
+    CHECK_HR(ConfigHostUnseal(hostKey.data(), sealed.data(), (DWORD)sealed.size(), &wrongKey), HRESULT_FROM_NT(STATUS_AUTH_TAG_MISMATCH));
+
+    // 密文长度不是 WCHAR 的整数倍
+    sealed.push_back(0);
+    CHECK_HR(ConfigHostUnseal(hostKey.data(), sealed.data(), (DWORD)sealed.size(), &wrongKey), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+}
+
+TEST(HostSealRoundTrip)
+{
+    std::vector<BYTE> hostKey = Sequence(0x5a, CONFIG_HOST_KEY_SIZE);
+    BYTE* pbFirst = nullptr;
+    DWORD cbFirst = 0;
+    BYTE* pbSecond = nullptr;
+    DWORD cbSecond = 0;
+    CHECK_HR(ConfigHostSeal(hostKey.data(), c_szHostSecret, &pbFirst, &cbFirst), S_OK);
+    CHECK_HR(ConfigHostSeal(hostKey.data(), c_szHostSecret, &pbSecond, &cbSecond), S_OK);
+    CHECK_EQ(cbFirst, sizeof(CONFIG_HOST_SEAL_HEADER) + sizeof(c_szHostSecret) - sizeof(WCHAR));
+    if (pbFirst && pbSecond)
+    {
+        // 同一密码的两次密封使用不同的随机数，密文也不同
+        CHECK(memcmp(pbFirst + 4, pbSecond + 4, CONFIG_HOST_SEAL_NONCE_SIZE) != 0);
+        CHECK(memcmp(pbFirst + sizeof(CONFIG_HOST_SEAL_HEADER), pbSecond + sizeof(CONFIG_HOST_SEAL_HEADER), cbFirst - sizeof(CONFIG_HOST_SEAL_HEADER)) != 0);
+        SecretString secret;
+        CHECK_HR(ConfigHostUnseal(hostKey.data(), pbSecond, cbSecond, &secret), S_OK);
+        CHECK(!secret.IsEmpty() && !wcscmp(secret.Get(), c_szHostSecret));
+    }
+    CoTaskMemFree(pbFirst);
+    CoTaskMemFree(pbSecond);
+
+    // 空密码可以密封，结果只有头部
+    CHECK_HR(ConfigHostSeal(hostKey.data(), L"", &pbFirst, &cbFirst), S_OK);
+    CHECK_EQ(cbFirst, sizeof(CONFIG_HOST_SEAL_HEADER));
+    SecretString empty;
+    CHECK_HR(ConfigHostUnseal(hostKey.data(), pbFirst, cbFirst, &empty), S_OK);
+    CHECK_EQ(empty.Length(), 0u);
+    CoTaskMemFree(pbFirst);
+}
+
+// 保险库口令和主机密钥文件只接受 SYSTEM 或管理员拥有的文件
+TEST(KeyFilesRequireTrustedOwner)
+{
+    WinCompatClearFiles();
+    BYTE rgbPassphrase[VAULT_PASSPHRASE_MAX];
+    DWORD cbPassphrase = 0;
+    CHECK_HR(VaultReadPassphrase(rgbPassphrase, &cbPassphrase), HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND));
+
+    CHECK_HR(ConfigFileSave(VAULT_PASSPHRASE_PATH, c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1), S_OK);
+    CHECK_HR(VaultReadPassphrase(rgbPassphrase, &cbPassphrase), S_OK);
+    CHECK_EQ(cbPassphrase, sizeof(c_rgbPassphrase) - 1);
+    CHECK(memcmp(rgbPassphrase, c_rgbPassphrase, cbPassphrase) == 0);
+    CHECK(WinCompatSetFileOwner(VAULT_PASSPHRASE_PATH, L"S-1-5-21-1000-2000-3000-1001"));
+    CHECK_HR(VaultReadPassphrase(rgbPassphrase, &cbPassphrase), HRESULT_FROM_WIN32(ERROR_INVALID_OWNER));
+    CHECK_EQ(cbPassphrase, 0u);
+
+    // 短于下限的口令文件
+    CHECK_HR(ConfigFileSave(VAULT_PASSPHRASE_PATH, c_rgbPassphrase, VAULT_PASSPHRASE_MIN - 1), S_OK);
+    CHECK_HR(VaultReadPassphrase(rgbPassphrase, &cbPassphrase), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+
+    std::vector<BYTE> hostKey = Sequence(0xa0, CONFIG_HOST_KEY_SIZE);
+    BYTE rgbHostKey[CONFIG_HOST_KEY_SIZE];
+    CHECK_HR(ConfigFileSave(CONFIG_HOST_KEY_PATH, hostKey.data(), (DWORD)hostKey.size()), S_OK);
+    CHECK_HR(ConfigReadHostKey(rgbHostKey), S_OK);
+    CHECK(memcmp(rgbHostKey, hostKey.data(), sizeof(rgbHostKey)) == 0);
+    CHECK(WinCompatSetFileOwner(CONFIG_HOST_KEY_PATH, L"S-1-5-21-1000-2000-3000-1001"));
+    CHECK_HR(ConfigReadHostKey(rgbHostKey), HRESULT_FROM_WIN32(ERROR_INVALID_OWNER));
+    CHECK_HR(ConfigFileSave(CONFIG_HOST_KEY_PATH, hostKey.data(), (DWORD)hostKey.size() - 1), S_OK);
+    CHECK_HR(ConfigReadHostKey(rgbHostKey), HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+    WinCompatClearFiles();
+}
+
+BENCH(VaultCryptoBench)
+{
+    std::vector<BYTE> key = Sequence(0x42, CHACHA20_KEY_SIZE);
+    std::vector<BYTE> nonce = Sequence(0x24, CHACHA20_NONCE_SIZE);
+    std::vector<BYTE> data(4096, 0x5A);
+    BYTE rgbTag[POLY1305_TAG_SIZE];
+    BenchRun("ChaCha20 标量 4 KB", 20000, [&](DWORD) {
+        ChaCha20XorScalar(key.data(), nonce.data(), 1, data.data(), data.data(), data.size());
+    });
+    BenchRun("ChaCha20 4 KB", 20000, [&](DWORD) {
+        ChaCha20Xor(key.data(), nonce.data(), 1, data.data(), data.data(), data.size());
+    });
+    BenchRun("ChaCha20-Poly1305 4 KB", 20000, [&](DWORD) {
+        ChaChaPolySeal(key.data(), nonce.data(), nullptr, 0, data.data(), data.data(), data.size(), rgbTag);
+    });
+
+    // 通道数加倍而耗时不变，说明通道在线程池上并行
+    BYTE rgbKey[CHACHA20_KEY_SIZE];
+    VAULT_KDF_PARAMS oneLane = { 12, VAULT_KDF_DEFAULT_BLOCK, 1 };
+    VAULT_KDF_PARAMS lanes = { 12, VAULT_KDF_DEFAULT_BLOCK, VAULT_KDF_DEFAULT_LANES };
+    BenchRun("scrypt N = 2^12, r = 8, p = 1", 20, [&](DWORD) {
+        VaultDeriveKey(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, key.data(), VAULT_SALT_SIZE, &oneLane, rgbKey);
+    });
+    BenchRun("scrypt N = 2^12, r = 8, p = 4", 20, [&](DWORD) {
+        VaultDeriveKey(c_rgbPassphrase, sizeof(c_rgbPassphrase) - 1, key.data(), VAULT_SALT_SIZE, &lanes, rgbKey);
+    });
+}
+
+TEST_MAIN()
@@ -0,0 +1,147 @@
+#pragma once
+
+// Windows SDK credentialprovider.h 中被测代码用到的部分，签名与 SDK 一致
+// （ICredentialProviderCredentialEvents 的方法带 pcpc 参数）
+#define __credentialprovider_h__
+
+#include <windows.h>
+#include <objbase.h>
+#include <unknwn.h>
+
+interface ICredentialProviderCredential;
+
+typedef enum _CREDENTIAL_PROVIDER_USAGE_SCENARIO
+{
+    CPUS_INVALID = 0,
+    CPUS_LOGON,
+    CPUS_UNLOCK_WORKSTATION,
+    CPUS_CHANGE_PASSWORD,
+    CPUS_CREDUI,
+    CPUS_PLAP
+} CREDENTIAL_PROVIDER_USAGE_SCENARIO;
+
+typedef enum _CREDENTIAL_PROVIDER_FIELD_TYPE
+{
+    CPFT_INVALID = 0,
+    CPFT_LARGE_TEXT,
+    CPFT_SMALL_TEXT,
+    CPFT_COMMAND_LINK,
+    CPFT_EDIT_TEXT,
+    CPFT_PASSWORD_TEXT,
+    CPFT_TILE_IMAGE,
+    CPFT_CHECKBOX,
+    CPFT_COMBOBOX,
+    CPFT_SUBMIT_BUTTON
+} CREDENTIAL_PROVIDER_FIELD_TYPE;
+
+typedef enum _CREDENTIAL_PROVIDER_FIELD_STATE
+{
+    CPFS_HIDDEN = 0,
+    CPFS_DISPLAY_IN_SELECTED_TILE,
+    CPFS_DISPLAY_IN_DESELECTED_TILE,
+    CPFS_DISPLAY_IN_BOTH
+} CREDENTIAL_PROVIDER_FIELD_STATE;
+
+typedef enum _CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE
+{
+    CPFIS_NONE = 0,
+    CPFIS_READONLY,
+    CPFIS_DISABLED,
+    CPFIS_FOCUSED
+} CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE;
+
+typedef enum _CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE
+{
+    CPGSR_NO_CREDENTIAL_NOT_FINISHED = 0,
+    CPGSR_NO_CREDENTIAL_FINISHED,
+    CPGSR_RETURN_CREDENTIAL_FINISHED,
+    CPGSR_RETURN_NO_CREDENTIAL_FINISHED
+} CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE;
+
+typedef enum _CREDENTIAL_PROVIDER_STATUS_ICON
+{
+    CPSI_NONE = 0,
+    CPSI_ERROR,
+    CPSI_WARNING,
+    CPSI_SUCCESS
+} CREDENTIAL_PROVIDER_STATUS_ICON;
+
+#define CREDENTIAL_PROVIDER_NO_DEFAULT ((DWORD)-1)
+
+typedef struct _CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR
+{
+    DWORD dwFieldID;
+    CREDENTIAL_PROVIDER_FIELD_TYPE cpft;
+    LPWSTR pszLabel;
+    GUID guidFieldType;
+} CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR;
+
+typedef struct _CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION
+{
+    ULONG ulAuthenticationPackage;
+    GUID clsidCredentialProvider;
+    ULONG cbSerialization;
+    BYTE* rgbSerialization;
+} CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION;
+
+interface ICredentialProviderEvents : public IUnknown
+{
+    virtual HRESULT STDMETHODCALLTYPE CredentialsChanged(UINT_PTR upAdviseContext) = 0;
+};
+
+interface ICredentialProviderCredentialEvents : public IUnknown
+{
+    virtual HRESULT STDMETHODCALLTYPE SetFieldState(ICredentialProviderCredential* pcpc, DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_STATE cpfs) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetFieldInteractiveState(ICredentialProviderCredential* pcpc, DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE cpfis) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetFieldString(ICredentialProviderCredential* pcpc, DWORD dwFieldID, LPCWSTR psz) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetFieldCheckbox(ICredentialProviderCredential* pcpc, DWORD dwFieldID, BOOL bChecked, LPCWSTR pszLabel) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetFieldBitmap(ICredentialProviderCredential* pcpc, DWORD dwFieldID, HBITMAP hbmp) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetFieldComboBoxSelectedItem(ICredentialProviderCredential* pcpc, DWORD dwFieldID, DWORD dwSelectedItem) = 0;
+    virtual HRESULT STDMETHODCALLTYPE DeleteFieldComboBoxItem(ICredentialProviderCredential* pcpc, DWORD dwFieldID, DWORD dwItem) = 0;
+    virtual HRESULT STDMETHODCALLTYPE AppendFieldComboBoxItem(ICredentialProviderCredential* pcpc, DWORD dwFieldID, LPCWSTR pszItem) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetFieldSubmitButton(ICredentialProviderCredential* pcpc, DWORD dwFieldID, DWORD dwAdjacentTo) = 0;
+    virtual HRESULT STDMETHODCALLTYPE OnCreatingWindow(HWND* phwndOwner) = 0;
+};
+
+interface ICredentialProviderCredential : public IUnknown
+{
+    virtual HRESULT STDMETHODCALLTYPE Advise(ICredentialProviderCredentialEvents* pcpce) = 0;
+    virtual HRESULT STDMETHODCALLTYPE UnAdvise() = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetSelected(BOOL* pbAutoLogon) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetDeselected() = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetFieldState(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_STATE* pcpfs, CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE* pcpfis) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetStringValue(DWORD dwFieldID, LPWSTR* ppsz) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetBitmapValue(DWORD dwFieldID, HBITMAP* phbmp) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetCheckboxValue(DWORD dwFieldID, BOOL* pbChecked, LPWSTR* ppszLabel) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetSubmitButtonValue(DWORD dwFieldID, DWORD* pdwAdjacentTo) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetComboBoxValueCount(DWORD dwFieldID, DWORD* pcItems, DWORD* pdwSelectedItem) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetComboBoxValueAt(DWORD dwFieldID, DWORD dwItem, LPWSTR* ppszItem) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetStringValue(DWORD dwFieldID, LPCWSTR psz) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetCheckboxValue(DWORD dwFieldID, BOOL bChecked) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetComboBoxSelectedValue(DWORD dwFieldID, DWORD dwSelectedItem) = 0;
+    virtual HRESULT STDMETHODCALLTYPE CommandLinkClicked(DWORD dwFieldID) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetSerialization(CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr, CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon) = 0;
+    virtual HRESULT STDMETHODCALLTYPE ReportResult(NTSTATUS ntsStatus, NTSTATUS ntsSubstatus, LPWSTR* ppszOptionalStatusText, CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon) = 0;
+};
+
+interface ICredentialProvider : public IUnknown
+{
+    virtual HRESULT STDMETHODCALLTYPE SetUsageScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, DWORD dwFlags) = 0;
+    virtual HRESULT STDMETHODCALLTYPE SetSerialization(const CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs) = 0;
+    virtual HRESULT STDMETHODCALLTYPE Advise(ICredentialProviderEvents* pcpe, UINT_PTR upAdviseContext) = 0;
+    virtual HRESULT STDMETHODCALLTYPE UnAdvise() = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetFieldDescriptorCount(DWORD* pdwCount) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetFieldDescriptorAt(DWORD dwIndex, CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR** ppcpfd) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetCredentialCount(DWORD* pdwCount, DWORD* pdwDefault, BOOL* pbAutoLogonWithDefault) = 0;
+    virtual HRESULT STDMETHODCALLTYPE GetCredentialAt(DWORD dwIndex, ICredentialProviderCredential** ppcpc) = 0;
+};
+
+__declspec(selectany) extern const IID IID_ICredentialProvider = { 0xd27c3481, 0x5a1c, 0x45b2, { 0x8a, 0xaa, 0xc2, 0x0e, 0xbb, 0xe8, 0x22, 0x9e } };
+__declspec(selectany) extern const IID IID_ICredentialProviderCredential = { 0x63913a93, 0x40c1, 0x481a, { 0x81, 0x8d, 0x40, 0x72, 0xff, 0x8c, 0x70, 0xcc } };
+__declspec(selectany) extern const IID IID_ICredentialProviderEvents = { 0x34201e5a, 0xa787, 0x41a3, { 0xa5, 0xa4, 0xbd, 0x6d, 0xcf, 0x2a, 0x85, 0x4e } };
+__declspec(selectany) extern const IID IID_ICredentialProviderCredentialEvents = { 0xfa6fa76b, 0x66b7, 0x4b11, { 0x95, 0xf1, 0x86, 0x17, 0x11, 0x18, 0xe8, 0x16 } };
+
+WINCOMPAT_DEFINE_UUIDOF(ICredentialProvider, IID_ICredentialProvider)
+WINCOMPAT_DEFINE_UUIDOF(ICredentialProviderCredential, IID_ICredentialProviderCredential)
+WINCOMPAT_DEFINE_UUIDOF(ICredentialProviderEvents, IID_ICredentialProviderEvents)
+WINCOMPAT_DEFINE_UUIDOF(ICredentialProviderCredentialEvents, IID_ICredentialProviderCredentialEvents)
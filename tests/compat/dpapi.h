@@ -0,0 +1,23 @@
+#pragma once
+
+#include <windows.h>
+
+// 进程内内存加密：与固定密钥流异或，可逆且改变内容，足以验证加解密配对
+#define CRYPTPROTECTMEMORY_BLOCK_SIZE 16
+#define CRYPTPROTECTMEMORY_SAME_PROCESS 0x00
+
+inline BOOL WinCompatXorMemory(LPVOID pv, DWORD cb)
+{
+    if (cb % CRYPTPROTECTMEMORY_BLOCK_SIZE)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    BYTE* pb = (BYTE*)pv;
+    for (DWORD i = 0; i < cb; i++)
+        pb[i] ^= (BYTE)(0xA5 + i * 31);
+    return TRUE;
+}
+
+inline BOOL CryptProtectMemory(LPVOID pv, DWORD cb, DWORD) { return WinCompatXorMemory(pv, cb); }
+inline BOOL CryptUnprotectMemory(LPVOID pv, DWORD cb, DWORD) { return WinCompatXorMemory(pv, cb); }
@@ -0,0 +1,12 @@
+#pragma once
+
+#include_next <malloc.h>
+#include <stdlib.h>
+
+inline void* _aligned_malloc(size_t cb, size_t cbAlignment)
+{
+    void* pv = nullptr;
+    return posix_memalign(&pv, cbAlignment, cb ? cb : 1) == 0 ? pv : nullptr;
+}
+
+inline void _aligned_free(void* pv) { free(pv); }
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <windows.h>
+#include <winternl.h>
+
+typedef UNICODE_STRING LSA_UNICODE_STRING, *PLSA_UNICODE_STRING;
+
+typedef struct _STRING
+{
+    USHORT Length;
+    USHORT MaximumLength;
+    PCHAR Buffer;
+} STRING, LSA_STRING, *PLSA_STRING;
+
+typedef enum _KERB_LOGON_SUBMIT_TYPE
+{
+    KerbInteractiveLogon = 2,
+    KerbSmartCardLogon = 6,
+    KerbWorkstationUnlockLogon = 7,
+    KerbSmartCardUnlockLogon = 8,
+    KerbProxyLogon = 9,
+    KerbTicketLogon = 10,
+    KerbTicketUnlockLogon = 11,
+    KerbS4ULogon = 12,
+    KerbCertificateLogon = 13,
+    KerbCertificateS4ULogon = 14,
+    KerbCertificateUnlockLogon = 15
+} KERB_LOGON_SUBMIT_TYPE, *PKERB_LOGON_SUBMIT_TYPE;
+
+typedef struct _KERB_INTERACTIVE_LOGON
+{
+    KERB_LOGON_SUBMIT_TYPE MessageType;
+    UNICODE_STRING LogonDomainName;
+    UNICODE_STRING UserName;
+    UNICODE_STRING Password;
+} KERB_INTERACTIVE_LOGON, *PKERB_INTERACTIVE_LOGON;
+
+typedef struct _LUID
+{
+    DWORD LowPart;
+    LONG HighPart;
+} LUID, *PLUID;
+
+typedef struct _KERB_INTERACTIVE_UNLOCK_LOGON
+{
+    KERB_INTERACTIVE_LOGON Logon;
+    LUID LogonId;
+} KERB_INTERACTIVE_UNLOCK_LOGON, *PKERB_INTERACTIVE_UNLOCK_LOGON;
+
+#define NEGOSSP_NAME_A "Negotiate"
+
+// LSA：连接总是成功，Negotiate 包编号固定为 1，其余包返回 STATUS_NO_SUCH_PACKAGE
+#define STATUS_NO_SUCH_PACKAGE ((NTSTATUS)0xC00000FEL)
+
+inline NTSTATUS LsaConnectUntrusted(PHANDLE phLsa)
+{
+    *phLsa = (HANDLE)(ULONG_PTR)1;
+    return STATUS_SUCCESS;
+}
+
+inline NTSTATUS LsaLookupAuthenticationPackage(HANDLE, PLSA_STRING pPackageName, PULONG pulAuthenticationPackage)
+{
+    if ((pPackageName->Length != sizeof(NEGOSSP_NAME_A) - 1) || memcmp(pPackageName->Buffer, NEGOSSP_NAME_A, pPackageName->Length))
+    {
+        return STATUS_NO_SUCH_PACKAGE;
+    }
+    *pulAuthenticationPackage = 1;
+    return STATUS_SUCCESS;
+}
+
+inline NTSTATUS LsaDeregisterLogonProcess(HANDLE) { return STATUS_SUCCESS; }
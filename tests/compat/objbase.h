@@ -0,0 +1,9 @@
+#pragma once
+
+#include <windows.h>
+#include <unknwn.h>
+
+// CoTaskMem 分配映射到 C 运行库堆
+inline LPVOID CoTaskMemAlloc(SIZE_T cb) { return malloc(cb ? cb : 1); }
+inline LPVOID CoTaskMemRealloc(LPVOID pv, SIZE_T cb) { return realloc(pv, cb ? cb : 1); }
+inline void CoTaskMemFree(LPVOID pv) { free(pv); }
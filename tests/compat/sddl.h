@@ -0,0 +1,44 @@
+#pragma once
+
+#include <windows.h>
+
+// 兼容层的 PSID 就是 SID 字符串（见 LookupAccountNameW），两个方向都只复制，结果由 LocalFree 释放
+inline BOOL ConvertSidToStringSidW(PSID pSid, LPWSTR* ppszSid)
+{
+    size_t cb = (wcslen((LPCWSTR)pSid) + 1) * sizeof(WCHAR);
+    *ppszSid = (LPWSTR)malloc(cb);
+    if (!*ppszSid)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    CopyMemory(*ppszSid, pSid, cb);
+    return TRUE;
+}
+
+inline BOOL ConvertStringSidToSidW(LPCWSTR pszSid, PSID* ppSid)
+{
+    *ppSid = nullptr;
+    if ((pszSid[0] != L'S') || (pszSid[1] != L'-'))
+    {
+        SetLastError(ERROR_INVALID_SID);
+        return FALSE;
+    }
+    return ConvertSidToStringSidW((PSID)pszSid, (LPWSTR*)ppSid);
+}
+
+// 内存文件系统不检查访问权限：返回一个可由 LocalFree 释放的占位描述符
+inline BOOL ConvertStringSecurityDescriptorToSecurityDescriptorW(LPCWSTR, DWORD, PSECURITY_DESCRIPTOR* ppSD, PULONG pcbSD)
+{
+    *ppSD = malloc(sizeof(DWORD));
+    if (!*ppSD)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    if (pcbSD)
+    {
+        *pcbSD = sizeof(DWORD);
+    }
+    return TRUE;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <windows.h>
+#include <objbase.h>
+
+// QISearch 的接口表：接口 IID 和接口指针相对对象起始的偏移，以 { 0 } 结尾
+typedef struct
+{
+    const IID* piid;
+    DWORD dwOffset;
+} QITAB, *LPQITAB;
+typedef const QITAB* LPCQITAB;
+
+#define OFFSETOFCLASS(base, derived) ((DWORD)(DWORD_PTR)(static_cast<base*>((derived*)8)) - 8)
+#define QITABENT(Cthis, Ifoo) { &WinCompatUuidOf<Ifoo>(), OFFSETOFCLASS(Ifoo, Cthis) }
+
+// IID_IUnknown 返回表中第一个接口
+inline HRESULT QISearch(void* that, LPCQITAB pqit, REFIID riid, void** ppv)
+{
+    if (!ppv)
+        return E_POINTER;
+    for (LPCQITAB pEntry = pqit; pEntry->piid; pEntry++)
+    {
+        if (IsEqualIID(riid, *pEntry->piid) || IsEqualIID(riid, IID_IUnknown))
+        {
+            IUnknown* punk = (IUnknown*)((BYTE*)that + pEntry->dwOffset);
+            punk->AddRef();
+            *ppv = punk;
+            return S_OK;
+        }
+    }
+    *ppv = nullptr;
+    return E_NOINTERFACE;
+}
+
+// 复制到 CoTaskMemAlloc 分配的缓冲区
+inline HRESULT SHStrDupW(LPCWSTR psz, LPWSTR* ppsz)
+{
+    size_t cb = (wcslen(psz) + 1) * sizeof(WCHAR);
+    *ppsz = (LPWSTR)CoTaskMemAlloc(cb);
+    if (!*ppsz)
+        return E_OUTOFMEMORY;
+    memcpy(*ppsz, psz, cb);
+    return S_OK;
+}
+
+inline BOOL PathRemoveFileSpecW(LPWSTR pszPath)
+{
+    LPWSTR pszSlash = (LPWSTR)wcsrchr(pszPath, L'\\');
+    if (!pszSlash)
+        return FALSE;
+    *pszSlash = 0;
+    return TRUE;
+}
+
+// 去掉最后一个路径分隔符之后的扩展名
+inline void PathRemoveExtensionW(LPWSTR pszPath)
+{
+    LPWSTR pszDot = (LPWSTR)wcsrchr(pszPath, L'.');
+    if (pszDot && !wcschr(pszDot, L'\\'))
+        *pszDot = 0;
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <windows.h>
+#include <stdarg.h>
+
+#define STRSAFE_MAX_CCH 2147483647
+#define STRSAFE_E_INSUFFICIENT_BUFFER ((HRESULT)0x8007007A)
+#define STRSAFE_E_INVALID_PARAMETER ((HRESULT)0x80070057)
+
+// 与 strsafe 相同：缓冲区不足时截断并保证结尾 NUL
+inline HRESULT StringCchCopyNW(LPWSTR pszDest, size_t cchDest, LPCWSTR pszSrc, size_t cchToCopy)
+{
+    if (!cchDest || cchDest > STRSAFE_MAX_CCH)
+        return STRSAFE_E_INVALID_PARAMETER;
+    size_t i = 0;
+    for (; i + 1 < cchDest && i < cchToCopy && pszSrc[i]; i++)
+        pszDest[i] = pszSrc[i];
+    pszDest[i] = 0;
+    return (i < cchToCopy && pszSrc[i]) ? STRSAFE_E_INSUFFICIENT_BUFFER : S_OK;
+}
+
+inline HRESULT StringCchCopyW(LPWSTR pszDest, size_t cchDest, LPCWSTR pszSrc)
+{
+    return StringCchCopyNW(pszDest, cchDest, pszSrc, STRSAFE_MAX_CCH);
+}
+
+inline HRESULT StringCchLengthW(LPCWSTR psz, size_t cchMax, size_t* pcch)
+{
+    size_t cch = wcsnlen(psz, cchMax);
+    if (pcch)
+        *pcch = cch;
+    return cch < cchMax ? S_OK : STRSAFE_E_INVALID_PARAMETER;
+}
+
+// 只支持仓库中用到的 %s（宽字符串）、%u、%lu、%d 和 %%；libc 的宽字符格式化按 32 位 wchar_t 工作，不能直接使用
+inline HRESULT StringCchPrintfW(LPWSTR pszDest, size_t cchDest, LPCWSTR pszFormat, ...)
+{
+    if (!cchDest || cchDest > STRSAFE_MAX_CCH)
+        return STRSAFE_E_INVALID_PARAMETER;
+    va_list args;
+    va_start(args, pszFormat);
+    size_t ich = 0;
+    bool fTruncated = false;
+    auto append = [&](WCHAR ch) {
+        if (ich + 1 < cchDest)
+            pszDest[ich++] = ch;
+        else
+            fTruncated = true;
+    };
+    for (LPCWSTR pch = pszFormat; *pch; pch++)
+    {
+        if (*pch != L'%')
+        {
+            append(*pch);
+            continue;
+        }
+        pch++;
+        if (*pch == L'l')
+            pch++;
+        if (*pch == L's')
+        {
+            for (LPCWSTR psz = va_arg(args, LPCWSTR); *psz; psz++)
+                append(*psz);
+        }
+        else if ((*pch == L'u') || (*pch == L'd'))
+        {
+            long long ll = (*pch == L'u') ? (long long)va_arg(args, unsigned int) : (long long)va_arg(args, int);
+            char sz[24];
+            snprintf(sz, sizeof(sz), "%lld", ll);
+            for (const char* pchNum = sz; *pchNum; pchNum++)
+                append((WCHAR)*pchNum);
+        }
+        else if (*pch == L'%')
+        {
+            append(L'%');
+        }
+        else
+        {
+            va_end(args);
+            return STRSAFE_E_INVALID_PARAMETER;
+        }
+    }
+    va_end(args);
+    pszDest[ich] = 0;
+    return fTruncated ? STRSAFE_E_INSUFFICIENT_BUFFER : S_OK;
+}
+
+// 窄字符版本交给 vsnprintf；Windows 上 long 为 32 位，格式中的 %ld、%lu、%lx 按 32 位参数改写（%lld 不变）
+inline HRESULT StringCchVPrintfExA(LPSTR pszDest, size_t cchDest, LPSTR* ppszDestEnd, size_t* pcchRemaining, DWORD dwFlags, LPCSTR pszFormat, va_list args)
+{
+    if (!cchDest || cchDest > STRSAFE_MAX_CCH || dwFlags)
+        return STRSAFE_E_INVALID_PARAMETER;
+    char szFormat[1024];
+    size_t ich = 0;
+    for (LPCSTR pch = pszFormat; *pch; pch++)
+    {
+        if (ich + 1 >= sizeof(szFormat))
+            return STRSAFE_E_INVALID_PARAMETER;
+        szFormat[ich++] = *pch;
+        if (*pch != '%')
+            continue;
+        while (pch[1] && strchr("-+ #0123456789.*", pch[1]) && (ich + 1 < sizeof(szFormat)))
+            szFormat[ich++] = *++pch;
+        if ((pch[1] == 'l') && pch[2] && strchr("dux", pch[2]))
+            pch++;
+    }
+    szFormat[ich] = 0;
+
+    int cch = vsnprintf(pszDest, cchDest, szFormat, args);
+    if (cch < 0)
+    {
+        pszDest[0] = 0;
+        cch = 0;
+    }
+    size_t cchWritten = ((size_t)cch < cchDest) ? (size_t)cch : cchDest - 1;
+    if (ppszDestEnd)
+        *ppszDestEnd = pszDest + cchWritten;
+    if (pcchRemaining)
+        *pcchRemaining = cchDest - cchWritten;
+    return ((size_t)cch < cchDest) ? S_OK : STRSAFE_E_INSUFFICIENT_BUFFER;
+}
+
+inline HRESULT StringCchPrintfA(LPSTR pszDest, size_t cchDest, LPCSTR pszFormat, ...)
+{
+    va_list args;
+    va_start(args, pszFormat);
+    HRESULT hr = StringCchVPrintfExA(pszDest, cchDest, nullptr, nullptr, 0, pszFormat, args);
+    va_end(args);
+    return hr;
+}
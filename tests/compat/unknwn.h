@@ -0,0 +1,46 @@
+#pragma once
+
+#include <windows.h>
+#include <type_traits>
+
+#define interface struct
+#define STDMETHODCALLTYPE
+#define STDMETHOD(method) virtual HRESULT STDMETHODCALLTYPE method
+#define STDMETHOD_(type, method) virtual type STDMETHODCALLTYPE method
+#define STDMETHODIMP HRESULT STDMETHODCALLTYPE
+#define STDMETHODIMP_(type) type STDMETHODCALLTYPE
+#define IFACEMETHODIMP STDMETHODIMP
+#define IFACEMETHODIMP_(type) STDMETHODIMP_(type)
+#define STDAPI extern "C" HRESULT STDMETHODCALLTYPE
+#define STDAPI_(type) extern "C" type STDMETHODCALLTYPE
+#define PURE = 0
+#define THIS_
+#define THIS void
+#define DECLARE_INTERFACE(iface) interface iface
+#define DECLARE_INTERFACE_(iface, baseiface) interface iface : public baseiface
+
+// 代替 __uuidof：每个接口特化一次，IID_PPV_ARGS 和 QITABENT 通过它取得 IID
+template <typename T> const IID& WinCompatUuidOf();
+#define WINCOMPAT_DEFINE_UUIDOF(type, iid) \
+    template <> inline const IID& WinCompatUuidOf<type>() { return iid; }
+#define IID_PPV_ARGS(ppType) \
+    WinCompatUuidOf<typename std::remove_reference<decltype(**(ppType))>::type>(), reinterpret_cast<void**>(ppType)
+
+interface IUnknown
+{
+    virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) = 0;
+    virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+    virtual ULONG STDMETHODCALLTYPE Release() = 0;
+};
+
+interface IClassFactory : public IUnknown
+{
+    virtual HRESULT STDMETHODCALLTYPE CreateInstance(IUnknown* pUnkOuter, REFIID riid, void** ppvObject) = 0;
+    virtual HRESULT STDMETHODCALLTYPE LockServer(BOOL fLock) = 0;
+};
+
+__declspec(selectany) extern const IID IID_IUnknown = { 0x00000000, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+__declspec(selectany) extern const IID IID_IClassFactory = { 0x00000001, 0x0000, 0x0000, { 0xC0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+
+WINCOMPAT_DEFINE_UUIDOF(IUnknown, IID_IUnknown)
+WINCOMPAT_DEFINE_UUIDOF(IClassFactory, IID_IClassFactory)
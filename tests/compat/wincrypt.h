@@ -0,0 +1,27 @@
+#pragma once
+
+#include <windows.h>
+
+// DPAPI 数据保护：没有本机密钥，加解密一律失败，与读不到保险库文件时的路径相同
+typedef struct _CRYPTOAPI_BLOB
+{
+    DWORD cbData;
+    BYTE* pbData;
+} DATA_BLOB, *PDATA_BLOB;
+
+typedef struct _CRYPTPROTECT_PROMPTSTRUCT CRYPTPROTECT_PROMPTSTRUCT, *PCRYPTPROTECT_PROMPTSTRUCT;
+
+#define CRYPTPROTECT_UI_FORBIDDEN 0x1
+#define CRYPTPROTECT_LOCAL_MACHINE 0x4
+
+inline BOOL CryptProtectData(DATA_BLOB*, LPCWSTR, DATA_BLOB*, PVOID, CRYPTPROTECT_PROMPTSTRUCT*, DWORD, DATA_BLOB*)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+inline BOOL CryptUnprotectData(DATA_BLOB*, LPWSTR*, DATA_BLOB*, PVOID, CRYPTPROTECT_PROMPTSTRUCT*, DWORD, DATA_BLOB*)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
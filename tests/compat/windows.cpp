@@ -0,0 +1,3224 @@
+// tests/compat/windows.h 中非内联函数的实现
+
+#include <windows.h>
+#include <bcrypt.h>
+#include <wtsapi32.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// ---------------------------------------------------------------------------
+// 最近错误
+// ---------------------------------------------------------------------------
+
+static thread_local DWORD t_dwLastError = ERROR_SUCCESS;
+
+DWORD GetLastError()
+{
+    return t_dwLastError;
+}
+
+void SetLastError(DWORD dwError)
+{
+    t_dwLastError = dwError;
+}
+
+// ---------------------------------------------------------------------------
+// 虚拟内存
+// ---------------------------------------------------------------------------
+
+// 区域前多映射一页记录大小，VirtualFree(MEM_RELEASE) 不带大小也能整体解除映射
+LPVOID VirtualAlloc(LPVOID pv, SIZE_T cb, DWORD flAllocationType, DWORD flProtect)
+{
+    UNREFERENCED_PARAMETER(flAllocationType);
+    UNREFERENCED_PARAMETER(flProtect);
+    if (pv)
+    {
+        // 已保留的区域在映射时就已可读写
+        return pv;
+    }
+    SIZE_T cbPage = (SIZE_T)sysconf(_SC_PAGESIZE);
+    BYTE* pb = (BYTE*)mmap(nullptr, cb + cbPage, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pb == (BYTE*)MAP_FAILED)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    *(SIZE_T*)pb = cb + cbPage;
+    return pb + cbPage;
+}
+
+BOOL VirtualFree(LPVOID pv, SIZE_T cb, DWORD dwFreeType)
+{
+    UNREFERENCED_PARAMETER(cb);
+    if (!pv || !(dwFreeType & MEM_RELEASE))
+    {
+        return pv != nullptr;
+    }
+    BYTE* pb = (BYTE*)pv - sysconf(_SC_PAGESIZE);
+    return munmap(pb, *(SIZE_T*)pb) == 0;
+}
+
+static std::atomic<DWORD> s_dwVirtualLockError(ERROR_SUCCESS);
+
+// ASan / TSan 把 mlock 拦截为空操作，直接发起系统调用才能真正锁定
+
+BOOL VirtualLock(LPVOID pv, SIZE_T cb)
+{
+    DWORD dwError = s_dwVirtualLockError.load();
+    if (dwError == ERROR_SUCCESS)
+    {
+        if (syscall(SYS_mlock, pv, cb) == 0)
+        {
+            return TRUE;
+        }
+        dwError = ((errno == ENOMEM) || (errno == EPERM) || (errno == EAGAIN)) ? ERROR_WORKING_SET_QUOTA : ERROR_INVALID_PARAMETER;
+    }
+    SetLastError(dwError);
+    return FALSE;
+}
+
+BOOL VirtualUnlock(LPVOID pv, SIZE_T cb)
+{
+    if (syscall(SYS_munlock, pv, cb) != 0)
+    {
+        SetLastError(ERROR_NOT_LOCKED);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void WinCompatSetVirtualLockError(DWORD dwError)
+{
+    s_dwVirtualLockError.store(dwError);
+}
+
+SIZE_T WinCompatGetLockedBytes()
+{
+    SIZE_T cbLocked = 0;
+    FILE* pFile = fopen("/proc/self/status", "r");
+    if (pFile)
+    {
+        char szLine[256];
+        unsigned long long ullKb = 0;
+        while (fgets(szLine, sizeof(szLine), pFile))
+        {
+            if (sscanf(szLine, "VmLck: %llu kB", &ullKb) == 1)
+            {
+                cbLocked = (SIZE_T)ullKb * 1024;
+                break;
+            }
+        }
+        fclose(pFile);
+    }
+    return cbLocked;
+}
+
+void GetSystemInfo(LPSYSTEM_INFO pInfo)
+{
+    ZeroMemory(pInfo, sizeof(*pInfo));
+    pInfo->dwPageSize = (DWORD)sysconf(_SC_PAGESIZE);
+    pInfo->dwAllocationGranularity = 65536;
+    pInfo->dwNumberOfProcessors = (DWORD)sysconf(_SC_NPROCESSORS_ONLN);
+}
+
+// ---------------------------------------------------------------------------
+// SRW 锁
+// ---------------------------------------------------------------------------
+
+static inline LONG_PTR volatile* SrwState(PSRWLOCK p)
+{
+    return (LONG_PTR volatile*)&p->Ptr;
+}
+
+BOOLEAN TryAcquireSRWLockExclusive(PSRWLOCK p)
+{
+    LONG_PTR expected = 0;
+    return __atomic_compare_exchange_n(SrwState(p), &expected, (LONG_PTR)-1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+BOOLEAN TryAcquireSRWLockShared(PSRWLOCK p)
+{
+    LONG_PTR state = __atomic_load_n(SrwState(p), __ATOMIC_RELAXED);
+    while (state >= 0)
+    {
+        if (__atomic_compare_exchange_n(SrwState(p), &state, state + 1, true, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        {
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void AcquireSRWLockExclusive(PSRWLOCK p)
+{
+    for (unsigned cSpin = 0; !TryAcquireSRWLockExclusive(p); cSpin++)
+    {
+        if (cSpin < 64)
+            YieldProcessor();
+        else
+            std::this_thread::yield();
+    }
+}
+
+void AcquireSRWLockShared(PSRWLOCK p)
+{
+    for (unsigned cSpin = 0; !TryAcquireSRWLockShared(p); cSpin++)
+    {
+        if (cSpin < 64)
+            YieldProcessor();
+        else
+            std::this_thread::yield();
+    }
+}
+
+void ReleaseSRWLockExclusive(PSRWLOCK p)
+{
+    __atomic_store_n(SrwState(p), 0, __ATOMIC_RELEASE);
+}
+
+void ReleaseSRWLockShared(PSRWLOCK p)
+{
+    __atomic_sub_fetch(SrwState(p), 1, __ATOMIC_RELEASE);
+}
+
+// ---------------------------------------------------------------------------
+// SLIST
+// ---------------------------------------------------------------------------
+
+static void SListLock(PSLIST_HEADER p)
+{
+    while (__atomic_exchange_n(&p->lLock, 1, __ATOMIC_ACQUIRE))
+    {
+        YieldProcessor();
+    }
+}
+
+static void SListUnlock(PSLIST_HEADER p)
+{
+    __atomic_store_n(&p->lLock, 0, __ATOMIC_RELEASE);
+}
+
+PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER p, PSLIST_ENTRY pEntry)
+{
+    SListLock(p);
+    PSLIST_ENTRY pFirst = p->Next;
+    pEntry->Next = pFirst;
+    p->Next = pEntry;
+    p->Depth++;
+    SListUnlock(p);
+    return pFirst;
+}
+
+PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER p)
+{
+    SListLock(p);
+    PSLIST_ENTRY pFirst = p->Next;
+    if (pFirst)
+    {
+        p->Next = pFirst->Next;
+        p->Depth--;
+    }
+    SListUnlock(p);
+    return pFirst;
+}
+
+PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER p)
+{
+    SListLock(p);
+    PSLIST_ENTRY pFirst = p->Next;
+    p->Next = nullptr;
+    p->Depth = 0;
+    SListUnlock(p);
+    return pFirst;
+}
+
+USHORT QueryDepthSList(PSLIST_HEADER p)
+{
+    return __atomic_load_n(&p->Depth, __ATOMIC_ACQUIRE);
+}
+
+// ---------------------------------------------------------------------------
+// 一次性初始化
+// ---------------------------------------------------------------------------
+
+static std::mutex s_initOnceLock;
+
+BOOL InitOnceExecuteOnce(PINIT_ONCE pInitOnce, PINIT_ONCE_FN pfnInit, PVOID pvParameter, LPVOID* ppvContext)
+{
+    std::lock_guard<std::mutex> guard(s_initOnceLock);
+    if ((ULONG_PTR)pInitOnce->Ptr == 1)
+    {
+        return TRUE;
+    }
+    if ((ULONG_PTR)pInitOnce->Ptr == 2)
+    {
+        return FALSE;
+    }
+    BOOL fOk = pfnInit(pInitOnce, pvParameter, ppvContext);
+    pInitOnce->Ptr = (PVOID)(ULONG_PTR)(fOk ? 1 : 2);
+    return fOk;
+}
+
+// ---------------------------------------------------------------------------
+// 事件和线程句柄
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    const DWORD c_dwEventMagic = 0x45564e54;     // "EVNT"
+    const DWORD c_dwThreadMagic = 0x54485244;    // "THRD"
+    const DWORD c_dwFileMagic = 0x454c4946;      // "FILE"，见“文件”一节
+    const DWORD c_dwMappingMagic = 0x5050414d;   // "MAPP"
+    const DWORD c_dwPipeMagic = 0x45504950;      // "PIPE"，见“命名管道”一节
+    const DWORD c_dwTokenMagic = 0x4e4b4f54;     // "TOKN"，见“账户”一节
+
+    struct WaitObject
+    {
+        DWORD dwMagic;
+        std::mutex lock;
+        std::condition_variable cv;
+        bool fManualReset;
+        bool fSignaled;
+    };
+
+    struct ThreadObject : WaitObject
+    {
+        LPTHREAD_START_ROUTINE pfn;
+        LPVOID pv;
+        DWORD dwExitCode;
+        LONG cRef;
+    };
+
+    bool Consume(WaitObject* p)
+    {
+        if (!p->fSignaled)
+            return false;
+        if (!p->fManualReset)
+            p->fSignaled = false;
+        return true;
+    }
+
+    void ReleaseThreadObject(ThreadObject* p)
+    {
+        if (InterlockedDecrement(&p->cRef) == 0)
+            delete p;
+    }
+
+    // 任一对象变为触发状态时递增并广播，WaitForMultipleObjects 据此等待而不必轮询
+    // 不析构：进程退出时分离的线程（线程池回调、重叠 I/O）可能仍在触发事件
+    struct SignalState
+    {
+        std::mutex lock;
+        std::condition_variable cv;
+        ULONGLONG ullGeneration = 0;
+    };
+
+    SignalState& Signals()
+    {
+        static SignalState* s_pSignals = new SignalState();
+        return *s_pSignals;
+    }
+
+    void NotifySignaled()
+    {
+        SignalState& signals = Signals();
+        std::lock_guard<std::mutex> guard(signals.lock);
+        signals.ullGeneration++;
+        signals.cv.notify_all();
+    }
+}
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES psa, BOOL fManualReset, BOOL fInitialState, LPCWSTR pszName)
+{
+    UNREFERENCED_PARAMETER(psa);
+    UNREFERENCED_PARAMETER(pszName);
+    WaitObject* p = new(std::nothrow) WaitObject();
+    if (!p)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    p->dwMagic = c_dwEventMagic;
+    p->fManualReset = fManualReset != FALSE;
+    p->fSignaled = fInitialState != FALSE;
+    return p;
+}
+
+BOOL SetEvent(HANDLE h)
+{
+    WaitObject* p = (WaitObject*)h;
+    // 持锁通知：等待方被唤醒后可能立即 CloseHandle
+    {
+        std::lock_guard<std::mutex> guard(p->lock);
+        p->fSignaled = true;
+        p->cv.notify_all();
+    }
+    NotifySignaled();
+    return TRUE;
+}
+
+BOOL ResetEvent(HANDLE h)
+{
+    WaitObject* p = (WaitObject*)h;
+    std::lock_guard<std::mutex> guard(p->lock);
+    p->fSignaled = false;
+    return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE h, DWORD dwMilliseconds)
+{
+    WaitObject* p = (WaitObject*)h;
+    std::unique_lock<std::mutex> guard(p->lock);
+    if (dwMilliseconds == INFINITE)
+    {
+        p->cv.wait(guard, [p] { return p->fSignaled; });
+    }
+    else if (!p->cv.wait_for(guard, std::chrono::milliseconds(dwMilliseconds), [p] { return p->fSignaled; }))
+    {
+        return WAIT_TIMEOUT;
+    }
+    Consume(p);
+    return WAIT_OBJECT_0;
+}
+
+DWORD WaitForMultipleObjects(DWORD cHandles, const HANDLE* rgh, BOOL fWaitAll, DWORD dwMilliseconds)
+{
+    // 逐个检查后等待任一对象触发再重新检查；先记下触发计数再检查，检查之后的触发不会错过
+    ULONGLONG ullDeadline = (dwMilliseconds == INFINITE) ? MAXULONGLONG : GetTickCount64() + dwMilliseconds;
+    for (;;)
+    {
+        ULONGLONG ullGeneration;
+        {
+            std::lock_guard<std::mutex> guard(Signals().lock);
+            ullGeneration = Signals().ullGeneration;
+        }
+        DWORD cSignaled = 0;
+        for (DWORD i = 0; i < cHandles; i++)
+        {
+            WaitObject* p = (WaitObject*)rgh[i];
+            std::lock_guard<std::mutex> guard(p->lock);
+            if (p->fSignaled)
+            {
+                if (!fWaitAll)
+                {
+                    Consume(p);
+                    return WAIT_OBJECT_0 + i;
+                }
+                cSignaled++;
+            }
+        }
+        if (fWaitAll && cSignaled == cHandles)
+        {
+            for (DWORD i = 0; i < cHandles; i++)
+            {
+                WaitObject* p = (WaitObject*)rgh[i];
+                std::lock_guard<std::mutex> guard(p->lock);
+                Consume(p);
+            }
+            return WAIT_OBJECT_0;
+        }
+        ULONGLONG ullNow = GetTickCount64();
+        if (ullNow >= ullDeadline)
+        {
+            return WAIT_TIMEOUT;
+        }
+        SignalState& signals = Signals();
+        std::unique_lock<std::mutex> guard(signals.lock);
+        auto fChanged = [&signals, ullGeneration] { return signals.ullGeneration != ullGeneration; };
+        if (dwMilliseconds == INFINITE)
+        {
+            signals.cv.wait(guard, fChanged);
+        }
+        else
+        {
+            signals.cv.wait_for(guard, std::chrono::milliseconds(ullDeadline - ullNow), fChanged);
+        }
+    }
+}
+
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES psa, SIZE_T cbStack, LPTHREAD_START_ROUTINE pfn, LPVOID pv, DWORD dwFlags, LPDWORD pdwThreadId)
+{
+    UNREFERENCED_PARAMETER(psa);
+    UNREFERENCED_PARAMETER(cbStack);
+    UNREFERENCED_PARAMETER(dwFlags);
+    ThreadObject* p = new(std::nothrow) ThreadObject();
+    if (!p)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    p->dwMagic = c_dwThreadMagic;
+    p->fManualReset = true;
+    p->fSignaled = false;
+    p->pfn = pfn;
+    p->pv = pv;
+    p->dwExitCode = STILL_ACTIVE;
+    p->cRef = 2;
+    std::thread([p] {
+        DWORD dwExitCode = p->pfn(p->pv);
+        {
+            std::lock_guard<std::mutex> guard(p->lock);
+            p->dwExitCode = dwExitCode;
+            p->fSignaled = true;
+        }
+        p->cv.notify_all();
+        NotifySignaled();
+        ReleaseThreadObject(p);
+    }).detach();
+    if (pdwThreadId)
+    {
+        *pdwThreadId = 0;
+    }
+    return p;
+}
+
+static void CloseFileObject(HANDLE h);
+static void CloseMappingObject(HANDLE h);
+static void ClosePipeObject(HANDLE h);
+static void CloseTokenObject(HANDLE h);
+
+BOOL CloseHandle(HANDLE h)
+{
+    if (!h || h == INVALID_HANDLE_VALUE)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+    WaitObject* p = (WaitObject*)h;
+    if (p->dwMagic == c_dwThreadMagic)
+    {
+        ReleaseThreadObject(static_cast<ThreadObject*>(p));
+    }
+    else if (p->dwMagic == c_dwFileMagic)
+    {
+        CloseFileObject(h);
+    }
+    else if (p->dwMagic == c_dwMappingMagic)
+    {
+        CloseMappingObject(h);
+    }
+    else if (p->dwMagic == c_dwPipeMagic)
+    {
+        ClosePipeObject(h);
+    }
+    else if (p->dwMagic == c_dwTokenMagic)
+    {
+        CloseTokenObject(h);
+    }
+    else
+    {
+        delete p;
+    }
+    return TRUE;
+}
+
+BOOL GetComputerNameW(LPWSTR pszBuffer, LPDWORD pcchBuffer)
+{
+    static const WCHAR c_szComputerName[] = L"WINUNLOCK-TEST";
+    if (*pcchBuffer < ARRAYSIZE(c_szComputerName))
+    {
+        *pcchBuffer = ARRAYSIZE(c_szComputerName);
+        SetLastError(ERROR_BUFFER_OVERFLOW);
+        return FALSE;
+    }
+    CopyMemory(pszBuffer, c_szComputerName, sizeof(c_szComputerName));
+    *pcchBuffer = ARRAYSIZE(c_szComputerName) - 1;
+    return TRUE;
+}
+
+void Sleep(DWORD dwMilliseconds)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(dwMilliseconds));
+}
+
+BOOL SwitchToThread()
+{
+    std::this_thread::yield();
+    return TRUE;
+}
+
+DWORD GetCurrentThreadId()
+{
+    static volatile LONG s_lNextId = 0;
+    static thread_local DWORD t_dwId = 0;
+    if (!t_dwId)
+    {
+        t_dwId = (DWORD)InterlockedIncrement(&s_lNextId) * 4;
+    }
+    return t_dwId;
+}
+
+DWORD GetCurrentProcessId()
+{
+    return (DWORD)getpid();
+}
+
+// ---------------------------------------------------------------------------
+// 线程池
+// ---------------------------------------------------------------------------
+
+BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK pfn, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+    UNREFERENCED_PARAMETER(pcbe);
+    try
+    {
+        std::thread([pfn, pv] { pfn(nullptr, pv); }).detach();
+    }
+    catch (...)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+// 工作对象：cQueued 为已提交但回调尚未开始的次数，撤销时提高 ullCancel，之前提交的回调不再执行
+struct _TP_WORK
+{
+    PTP_WORK_CALLBACK pfn;
+    PVOID pv;
+    std::mutex lock;
+    std::condition_variable cv;
+    DWORD cQueued = 0;
+    DWORD cRunning = 0;
+    ULONGLONG ullCancel = 0;
+    bool fClosed = false;
+};
+
+static void ThreadpoolWorkCallback(PTP_WORK pwk, ULONGLONG ullCancel)
+{
+    std::unique_lock<std::mutex> guard(pwk->lock);
+    pwk->cQueued--;
+    if (pwk->ullCancel == ullCancel)
+    {
+        pwk->cRunning++;
+        guard.unlock();
+        pwk->pfn(nullptr, pwk->pv, pwk);
+        guard.lock();
+        pwk->cRunning--;
+    }
+    pwk->cv.notify_all();
+    bool fDelete = pwk->fClosed && !pwk->cQueued && !pwk->cRunning;
+    guard.unlock();
+    if (fDelete)
+    {
+        delete pwk;
+    }
+}
+
+PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK pfnwk, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+    UNREFERENCED_PARAMETER(pcbe);
+    PTP_WORK pwk = new(std::nothrow) _TP_WORK();
+    if (!pwk)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    pwk->pfn = pfnwk;
+    pwk->pv = pv;
+    return pwk;
+}
+
+void SubmitThreadpoolWork(PTP_WORK pwk)
+{
+    std::lock_guard<std::mutex> guard(pwk->lock);
+    pwk->cQueued++;
+    std::thread(ThreadpoolWorkCallback, pwk, pwk->ullCancel).detach();
+}
+
+void WaitForThreadpoolWorkCallbacks(PTP_WORK pwk, BOOL fCancelPendingCallbacks)
+{
+    std::unique_lock<std::mutex> guard(pwk->lock);
+    if (fCancelPendingCallbacks)
+    {
+        pwk->ullCancel++;
+    }
+    pwk->cv.wait(guard, [pwk] { return !pwk->cQueued && !pwk->cRunning; });
+}
+
+void CloseThreadpoolWork(PTP_WORK pwk)
+{
+    std::unique_lock<std::mutex> guard(pwk->lock);
+    pwk->fClosed = true;
+    bool fDelete = !pwk->cQueued && !pwk->cRunning;
+    guard.unlock();
+    if (fDelete)
+    {
+        delete pwk;
+    }
+}
+
+namespace
+{
+    // 到期时间换算为距现在的毫秒数：负数为相对时间（100ns），其余为绝对时间
+    ULONGLONG DueTimeToMs(const FILETIME* pft)
+    {
+        LONGLONG llDue = (LONGLONG)(((ULONGLONG)pft->dwHighDateTime << 32) | pft->dwLowDateTime);
+        if (llDue < 0)
+        {
+            return (ULONGLONG)(-llDue + 9999) / 10000;
+        }
+        FILETIME ftNow;
+        GetSystemTimeAsFileTime(&ftNow);
+        LONGLONG llNow = (LONGLONG)(((ULONGLONG)ftNow.dwHighDateTime << 32) | ftNow.dwLowDateTime);
+        return (llDue > llNow) ? (ULONGLONG)(llDue - llNow + 9999) / 10000 : 0;
+    }
+}
+
+// 等待对象：专用线程同时等待目标对象和内部的撤销事件；更换或撤销目标时触发撤销事件，
+// 并等到线程不再等待原对象，调用方随后关闭原对象是安全的
+struct _TP_WAIT
+{
+    PTP_WAIT_CALLBACK pfn;
+    PVOID pv;
+    HANDLE hCancel;
+    std::mutex lock;
+    std::condition_variable cv;
+    HANDLE hObject = nullptr;
+    ULONGLONG ullDeadline = MAXULONGLONG;
+    ULONGLONG ullGeneration = 0;
+    ULONGLONG ullWaitingGeneration = 0;
+    bool fInWait = false;
+    bool fRunning = false;
+    bool fClosing = false;
+    std::thread thread;
+};
+
+static void ThreadpoolWaitLoop(PTP_WAIT pwa)
+{
+    std::unique_lock<std::mutex> guard(pwa->lock);
+    for (;;)
+    {
+        pwa->cv.wait(guard, [pwa] { return pwa->fClosing || pwa->hObject; });
+        if (pwa->fClosing)
+        {
+            break;
+        }
+        HANDLE rgh[2] = { pwa->hObject, pwa->hCancel };
+        ULONGLONG ullDeadline = pwa->ullDeadline;
+        ULONGLONG ullNow = GetTickCount64();
+        DWORD dwTimeout = (ullDeadline == MAXULONGLONG) ? INFINITE : (DWORD)((ullDeadline > ullNow) ? ullDeadline - ullNow : 0);
+        pwa->ullWaitingGeneration = pwa->ullGeneration;
+        pwa->fInWait = true;
+        guard.unlock();
+        DWORD dwWait = WaitForMultipleObjects(2, rgh, FALSE, dwTimeout);
+        guard.lock();
+        pwa->fInWait = false;
+        pwa->cv.notify_all();
+        if (pwa->ullGeneration != pwa->ullWaitingGeneration)
+        {
+            // 目标已更换：把消耗掉的触发还给原对象（更换方仍在等待本线程，原对象尚未关闭）
+            if (dwWait == WAIT_OBJECT_0)
+            {
+                SetEvent(rgh[0]);
+            }
+            continue;
+        }
+        if ((dwWait == WAIT_OBJECT_0 + 1) || pwa->fClosing)
+        {
+            continue;
+        }
+        pwa->hObject = nullptr;
+        pwa->fRunning = true;
+        guard.unlock();
+        pwa->pfn(nullptr, pwa->pv, pwa, (dwWait == WAIT_OBJECT_0) ? WAIT_OBJECT_0 : WAIT_TIMEOUT);
+        guard.lock();
+        pwa->fRunning = false;
+        pwa->cv.notify_all();
+    }
+}
+
+PTP_WAIT CreateThreadpoolWait(PTP_WAIT_CALLBACK pfnwa, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+    UNREFERENCED_PARAMETER(pcbe);
+    PTP_WAIT pwa = new(std::nothrow) _TP_WAIT();
+    if (!pwa)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    pwa->pfn = pfnwa;
+    pwa->pv = pv;
+    pwa->hCancel = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    pwa->thread = std::thread(ThreadpoolWaitLoop, pwa);
+    return pwa;
+}
+
+void SetThreadpoolWait(PTP_WAIT pwa, HANDLE h, PFILETIME pftTimeout)
+{
+    std::unique_lock<std::mutex> guard(pwa->lock);
+    pwa->hObject = h;
+    pwa->ullDeadline = (h && pftTimeout) ? GetTickCount64() + DueTimeToMs(pftTimeout) : MAXULONGLONG;
+    ULONGLONG ullGeneration = ++pwa->ullGeneration;
+    pwa->cv.notify_all();
+    if (pwa->fInWait && (pwa->thread.get_id() != std::this_thread::get_id()))
+    {
+        SetEvent(pwa->hCancel);
+        pwa->cv.wait(guard, [pwa, ullGeneration] { return !pwa->fInWait || (pwa->ullWaitingGeneration == ullGeneration); });
+    }
+}
+
+void WaitForThreadpoolWaitCallbacks(PTP_WAIT pwa, BOOL fCancelPendingCallbacks)
+{
+    if (fCancelPendingCallbacks)
+    {
+        SetThreadpoolWait(pwa, nullptr, nullptr);
+    }
+    std::unique_lock<std::mutex> guard(pwa->lock);
+    pwa->cv.wait(guard, [pwa] { return !pwa->fRunning; });
+}
+
+void CloseThreadpoolWait(PTP_WAIT pwa)
+{
+    {
+        std::lock_guard<std::mutex> guard(pwa->lock);
+        pwa->fClosing = true;
+        pwa->cv.notify_all();
+    }
+    SetEvent(pwa->hCancel);
+    pwa->thread.join();
+    CloseHandle(pwa->hCancel);
+    delete pwa;
+}
+
+// 计时器对象：专用线程等到到期时间后调用回调，周期计时器随后按周期重新设置
+struct _TP_TIMER
+{
+    PTP_TIMER_CALLBACK pfn;
+    PVOID pv;
+    std::mutex lock;
+    std::condition_variable cv;
+    bool fSet = false;
+    std::chrono::steady_clock::time_point due;
+    DWORD msPeriod = 0;
+    bool fRunning = false;
+    bool fClosing = false;
+    std::thread thread;
+};
+
+static void ThreadpoolTimerLoop(PTP_TIMER pti)
+{
+    std::unique_lock<std::mutex> guard(pti->lock);
+    for (;;)
+    {
+        if (pti->fClosing)
+        {
+            break;
+        }
+        if (!pti->fSet)
+        {
+            pti->cv.wait(guard);
+            continue;
+        }
+        if (pti->cv.wait_until(guard, pti->due) != std::cv_status::timeout)
+        {
+            continue;
+        }
+        if (!pti->fSet || pti->fClosing || (std::chrono::steady_clock::now() < pti->due))
+        {
+            continue;
+        }
+        if (pti->msPeriod)
+        {
+            pti->due += std::chrono::milliseconds(pti->msPeriod);
+        }
+        else
+        {
+            pti->fSet = false;
+        }
+        pti->fRunning = true;
+        guard.unlock();
+        pti->pfn(nullptr, pti->pv, pti);
+        guard.lock();
+        pti->fRunning = false;
+        pti->cv.notify_all();
+    }
+}
+
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK pfnti, PVOID pv, PTP_CALLBACK_ENVIRON pcbe)
+{
+    UNREFERENCED_PARAMETER(pcbe);
+    PTP_TIMER pti = new(std::nothrow) _TP_TIMER();
+    if (!pti)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    pti->pfn = pfnti;
+    pti->pv = pv;
+    pti->thread = std::thread(ThreadpoolTimerLoop, pti);
+    return pti;
+}
+
+void SetThreadpoolTimer(PTP_TIMER pti, PFILETIME pftDueTime, DWORD msPeriod, DWORD msWindowLength)
+{
+    UNREFERENCED_PARAMETER(msWindowLength);
+    std::lock_guard<std::mutex> guard(pti->lock);
+    pti->fSet = pftDueTime != nullptr;
+    if (pftDueTime)
+    {
+        pti->due = std::chrono::steady_clock::now() + std::chrono::milliseconds(DueTimeToMs(pftDueTime));
+        pti->msPeriod = msPeriod;
+    }
+    pti->cv.notify_all();
+}
+
+BOOL IsThreadpoolTimerSet(PTP_TIMER pti)
+{
+    std::lock_guard<std::mutex> guard(pti->lock);
+    return pti->fSet;
+}
+
+void WaitForThreadpoolTimerCallbacks(PTP_TIMER pti, BOOL fCancelPendingCallbacks)
+{
+    std::unique_lock<std::mutex> guard(pti->lock);
+    if (fCancelPendingCallbacks)
+    {
+        pti->fSet = false;
+        pti->cv.notify_all();
+    }
+    pti->cv.wait(guard, [pti] { return !pti->fRunning; });
+}
+
+void CloseThreadpoolTimer(PTP_TIMER pti)
+{
+    {
+        std::lock_guard<std::mutex> guard(pti->lock);
+        pti->fClosing = true;
+        pti->cv.notify_all();
+    }
+    pti->thread.join();
+    delete pti;
+}
+
+namespace
+{
+    struct WaitRegistration
+    {
+        std::atomic<bool> fStop{ false };
+        std::thread thread;
+    };
+}
+
+BOOL RegisterWaitForSingleObject(PHANDLE phNewWaitObject, HANDLE hObject, WAITORTIMERCALLBACK pfn, PVOID pvContext, ULONG dwMilliseconds, ULONG dwFlags)
+{
+    WaitRegistration* pWait = new(std::nothrow) WaitRegistration();
+    if (!pWait)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return FALSE;
+    }
+    // 分段等待，注销时最多 10ms 内退出
+    pWait->thread = std::thread([pWait, hObject, pfn, pvContext, dwMilliseconds, dwFlags] {
+        ULONGLONG ullStart = GetTickCount64();
+        while (!pWait->fStop.load())
+        {
+            if (WaitForSingleObject(hObject, 10) == WAIT_OBJECT_0)
+            {
+                pfn(pvContext, FALSE);
+            }
+            else if ((dwMilliseconds == INFINITE) || (GetTickCount64() - ullStart < dwMilliseconds))
+            {
+                continue;
+            }
+            else
+            {
+                pfn(pvContext, TRUE);
+            }
+            if (dwFlags & WT_EXECUTEONLYONCE)
+            {
+                break;
+            }
+            ullStart = GetTickCount64();
+        }
+    });
+    *phNewWaitObject = pWait;
+    return TRUE;
+}
+
+BOOL UnregisterWaitEx(HANDLE hWaitHandle, HANDLE hCompletionEvent)
+{
+    WaitRegistration* pWait = (WaitRegistration*)hWaitHandle;
+    pWait->fStop.store(true);
+    if ((hCompletionEvent == INVALID_HANDLE_VALUE) && (pWait->thread.get_id() != std::this_thread::get_id()))
+    {
+        pWait->thread.join();
+        delete pWait;
+    }
+    else
+    {
+        // 不等待时注册对象随进程存在，测试中只会少量发生
+        pWait->thread.detach();
+        if (hCompletionEvent && (hCompletionEvent != INVALID_HANDLE_VALUE))
+        {
+            SetEvent(hCompletionEvent);
+        }
+    }
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// 计时
+// ---------------------------------------------------------------------------
+
+ULONGLONG GetTickCount64()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ULONGLONG)ts.tv_sec * 1000 + (ULONGLONG)ts.tv_nsec / 1000000;
+}
+
+BOOL QueryPerformanceCounter(LARGE_INTEGER* pli)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    pli->QuadPart = (LONGLONG)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return TRUE;
+}
+
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* pli)
+{
+    pli->QuadPart = 1000000000;
+    return TRUE;
+}
+
+static SYSTEMTIME s_stFixedLocal;
+static volatile LONG s_fFixedLocal = FALSE;
+
+void WinCompatSetLocalTime(const SYSTEMTIME* pst)
+{
+    if (pst)
+    {
+        s_stFixedLocal = *pst;
+        WriteRelease(&s_fFixedLocal, TRUE);
+    }
+    else
+    {
+        WriteRelease(&s_fFixedLocal, FALSE);
+    }
+}
+
+static void TimespecToSystemTime(const struct timespec& ts, bool fLocal, LPSYSTEMTIME pst)
+{
+    struct tm tm;
+    if (fLocal)
+        localtime_r(&ts.tv_sec, &tm);
+    else
+        gmtime_r(&ts.tv_sec, &tm);
+    pst->wYear = (WORD)(tm.tm_year + 1900);
+    pst->wMonth = (WORD)(tm.tm_mon + 1);
+    pst->wDayOfWeek = (WORD)tm.tm_wday;
+    pst->wDay = (WORD)tm.tm_mday;
+    pst->wHour = (WORD)tm.tm_hour;
+    pst->wMinute = (WORD)tm.tm_min;
+    pst->wSecond = (WORD)tm.tm_sec;
+    pst->wMilliseconds = (WORD)(ts.tv_nsec / 1000000);
+}
+
+void GetLocalTime(LPSYSTEMTIME pst)
+{
+    if (ReadAcquire(&s_fFixedLocal))
+    {
+        *pst = s_stFixedLocal;
+        return;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    TimespecToSystemTime(ts, true, pst);
+}
+
+void GetSystemTime(LPSYSTEMTIME pst)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    TimespecToSystemTime(ts, false, pst);
+}
+
+void GetSystemTimeAsFileTime(LPFILETIME pft)
+{
+    // FILETIME 以 1601-01-01 起的 100ns 为单位
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ULONGLONG ull = ((ULONGLONG)ts.tv_sec + 11644473600ull) * 10000000 + (ULONGLONG)ts.tv_nsec / 100;
+    pft->dwLowDateTime = (DWORD)ull;
+    pft->dwHighDateTime = (DWORD)(ull >> 32);
+}
+
+// ---------------------------------------------------------------------------
+// 命名管道
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    // 句柄关闭后，仍在等待的重叠 I/O 线程继续持有状态，套接字在两者都释放后才关闭
+    struct PipeState
+    {
+        std::mutex lock;
+        int fdListen = -1;      // 只有服务端有
+        int fdConn = -1;
+        int fdCancel = -1;      // eventfd：CancelIoEx 写入，唤醒等待中的 I/O 线程
+        bool fPending = false;  // 有未完成的重叠操作
+
+        ~PipeState()
+        {
+            for (int fd : { fdListen, fdConn, fdCancel })
+            {
+                if (fd >= 0)
+                    close(fd);
+            }
+        }
+    };
+
+    struct PipeObject
+    {
+        DWORD dwMagic;
+        std::shared_ptr<PipeState> pState;
+    };
+
+    enum PipeOp
+    {
+        PIPE_OP_CONNECT,
+        PIPE_OP_READ,
+        PIPE_OP_WRITE,
+    };
+
+    bool IsPipeHandle(HANDLE h)
+    {
+        return h && (h != INVALID_HANDLE_VALUE) && (((PipeObject*)h)->dwMagic == c_dwPipeMagic);
+    }
+
+    // \\.\pipe\名称 -> 抽象命名空间中的 "winunlock-compat.<进程号>.名称"；不是管道名时返回 false
+    bool PipeAddress(LPCWSTR pszName, sockaddr_un* pAddr, socklen_t* pcbAddr)
+    {
+        static const WCHAR c_szPrefix[] = L"\\\\.\\pipe\\";
+        const size_t cchPrefix = ARRAYSIZE(c_szPrefix) - 1;
+        if (_wcsnicmp(pszName, c_szPrefix, cchPrefix))
+        {
+            return false;
+        }
+
+        ZeroMemory(pAddr, sizeof(*pAddr));
+        pAddr->sun_family = AF_UNIX;
+        char* pszPath = pAddr->sun_path + 1;
+        size_t cchMax = sizeof(pAddr->sun_path) - 1;
+        size_t cch = (size_t)snprintf(pszPath, cchMax, "winunlock-compat.%d.", (int)getpid());
+        for (LPCWSTR pch = pszName + cchPrefix; *pch && (cch < cchMax); pch++)
+        {
+            pszPath[cch++] = (*pch < 0x80) ? (char)*pch : '_';
+        }
+        *pcbAddr = (socklen_t)(offsetof(sockaddr_un, sun_path) + 1 + cch);
+        return true;
+    }
+
+    HANDLE NewPipeObject(const std::shared_ptr<PipeState>& pState)
+    {
+        PipeObject* pPipe = new(std::nothrow) PipeObject();
+        if (!pPipe)
+        {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return INVALID_HANDLE_VALUE;
+        }
+        pPipe->dwMagic = c_dwPipeMagic;
+        pPipe->pState = pState;
+        return pPipe;
+    }
+
+    // 在 pState->lock 下不阻塞地尝试一次操作，套接字未就绪时返回 ERROR_IO_PENDING
+    DWORD PipeTryIo(PipeState* pState, PipeOp op, void* pv, DWORD cb, DWORD* pcb)
+    {
+        *pcb = 0;
+        if (op == PIPE_OP_CONNECT)
+        {
+            if (pState->fdConn >= 0)
+            {
+                return ERROR_PIPE_CONNECTED;
+            }
+            int fd = accept4(pState->fdListen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? ERROR_IO_PENDING : ERROR_PIPE_NOT_CONNECTED;
+            }
+            pState->fdConn = fd;
+            return ERROR_SUCCESS;
+        }
+
+        if (pState->fdConn < 0)
+        {
+            return ERROR_PIPE_NOT_CONNECTED;
+        }
+        ssize_t cbDone = (op == PIPE_OP_READ) ?
+            recv(pState->fdConn, pv, cb, MSG_DONTWAIT | MSG_TRUNC) :
+            send(pState->fdConn, pv, cb, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (cbDone < 0)
+        {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+            {
+                return ERROR_IO_PENDING;
+            }
+            // 对方已关闭：写入与 Windows 相同为 ERROR_NO_DATA，读取为 ERROR_BROKEN_PIPE
+            return (op == PIPE_OP_WRITE) ? ERROR_NO_DATA : ERROR_BROKEN_PIPE;
+        }
+        if (op == PIPE_OP_WRITE)
+        {
+            *pcb = (DWORD)cbDone;
+            return ERROR_SUCCESS;
+        }
+        if (!cbDone && cb)
+        {
+            return ERROR_BROKEN_PIPE;
+        }
+        // MSG_TRUNC 使 recv 返回整条消息的长度
+        *pcb = ((DWORD)cbDone < cb) ? (DWORD)cbDone : cb;
+        return ((DWORD)cbDone > cb) ? ERROR_MORE_DATA : ERROR_SUCCESS;
+    }
+
+    // 等待套接字就绪；被 CancelIoEx 唤醒时返回 false。句柄已关闭时立即返回，由 PipeTryIo 报告错误
+    bool PipeWaitReady(PipeState* pState, PipeOp op)
+    {
+        pollfd rgfd[2] = {};
+        {
+            std::lock_guard<std::mutex> guard(pState->lock);
+            rgfd[0].fd = (op == PIPE_OP_CONNECT) ? pState->fdListen : pState->fdConn;
+        }
+        if (rgfd[0].fd < 0)
+        {
+            return true;
+        }
+        rgfd[0].events = (op == PIPE_OP_WRITE) ? POLLOUT : POLLIN;
+        rgfd[1].fd = pState->fdCancel;
+        rgfd[1].events = POLLIN;
+        while ((poll(rgfd, ARRAYSIZE(rgfd), -1) < 0) && (errno == EINTR))
+        {
+        }
+        return !(rgfd[1].revents & POLLIN);
+    }
+
+    // 结果与事件在事件的锁内一起发布：GetOverlappedResult 在同一把锁下读取结果，
+    // 看到完成时这里已不再访问事件，调用方随即 CloseHandle 也是安全的
+    void CompleteOverlapped(LPOVERLAPPED pov, DWORD dwError, DWORD cb)
+    {
+        WaitObject* p = (WaitObject*)pov->hEvent;
+        if (!p)
+        {
+            __atomic_store_n(&pov->InternalHigh, (ULONG_PTR)cb, __ATOMIC_RELAXED);
+            __atomic_store_n(&pov->Internal, (ULONG_PTR)dwError, __ATOMIC_RELEASE);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> guard(p->lock);
+            __atomic_store_n(&pov->InternalHigh, (ULONG_PTR)cb, __ATOMIC_RELAXED);
+            __atomic_store_n(&pov->Internal, (ULONG_PTR)dwError, __ATOMIC_RELEASE);
+            p->fSignaled = true;
+            p->cv.notify_all();
+        }
+        NotifySignaled();
+    }
+
+    // 同步句柄阻塞到完成；重叠操作不能立即完成时交给一个线程，返回 FALSE 和 ERROR_IO_PENDING
+    BOOL PipeIo(HANDLE h, PipeOp op, void* pv, DWORD cb, LPDWORD pcb, LPOVERLAPPED pov)
+    {
+        std::shared_ptr<PipeState> pState = ((PipeObject*)h)->pState;
+        DWORD cbDone = 0;
+        DWORD dwError = ERROR_SUCCESS;
+        {
+            std::lock_guard<std::mutex> guard(pState->lock);
+            if (pov && pState->fPending)
+            {
+                SetLastError(ERROR_BUSY);
+                return FALSE;
+            }
+            dwError = PipeTryIo(pState.get(), op, pv, cb, &cbDone);
+            pState->fPending = pov && (dwError == ERROR_IO_PENDING);
+        }
+        while (!pov && (dwError == ERROR_IO_PENDING))
+        {
+            PipeWaitReady(pState.get(), op);
+            std::lock_guard<std::mutex> guard(pState->lock);
+            dwError = PipeTryIo(pState.get(), op, pv, cb, &cbDone);
+        }
+        if (pcb)
+        {
+            *pcb = cbDone;
+        }
+
+        if (dwError == ERROR_IO_PENDING)
+        {
+            __atomic_store_n(&pov->Internal, (ULONG_PTR)ERROR_IO_PENDING, __ATOMIC_RELAXED);
+            __atomic_store_n(&pov->InternalHigh, (ULONG_PTR)0, __ATOMIC_RELAXED);
+            if (pov->hEvent)
+            {
+                ResetEvent(pov->hEvent);
+            }
+            try
+            {
+                std::thread([pState, op, pv, cb, pov] {
+                    DWORD cbDone = 0;
+                    DWORD dwError = ERROR_IO_PENDING;
+                    while (dwError == ERROR_IO_PENDING)
+                    {
+                        bool fReady = PipeWaitReady(pState.get(), op);
+                        std::lock_guard<std::mutex> guard(pState->lock);
+                        dwError = fReady ? PipeTryIo(pState.get(), op, pv, cb, &cbDone) : ERROR_OPERATION_ABORTED;
+                        if (dwError != ERROR_IO_PENDING)
+                        {
+                            // 取消与完成同时发生时清掉取消计数，不影响下一次操作
+                            eventfd_t ullIgnored;
+                            eventfd_read(pState->fdCancel, &ullIgnored);
+                            pState->fPending = false;
+                        }
+                    }
+                    CompleteOverlapped(pov, dwError, cbDone);
+                }).detach();
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> guard(pState->lock);
+                pState->fPending = false;
+                SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+                return FALSE;
+            }
+            SetLastError(ERROR_IO_PENDING);
+            return FALSE;
+        }
+
+        if (pov)
+        {
+            CompleteOverlapped(pov, dwError, cbDone);
+        }
+        if (dwError != ERROR_SUCCESS)
+        {
+            SetLastError(dwError);
+            return FALSE;
+        }
+        return TRUE;
+    }
+
+    HANDLE OpenPipeClient(const sockaddr_un* pAddr, socklen_t cbAddr)
+    {
+        std::shared_ptr<PipeState> pState = std::make_shared<PipeState>();
+        pState->fdConn = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        pState->fdCancel = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if ((pState->fdConn < 0) || (pState->fdCancel < 0))
+        {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return INVALID_HANDLE_VALUE;
+        }
+        if (connect(pState->fdConn, (const sockaddr*)pAddr, cbAddr) != 0)
+        {
+            SetLastError((errno == EAGAIN) ? ERROR_PIPE_BUSY : ERROR_FILE_NOT_FOUND);
+            return INVALID_HANDLE_VALUE;
+        }
+        return NewPipeObject(pState);
+    }
+}
+
+HANDLE CreateNamedPipeW(LPCWSTR pszName, DWORD dwOpenMode, DWORD dwPipeMode, DWORD nMaxInstances, DWORD cbOutBuffer, DWORD cbInBuffer, DWORD dwDefaultTimeOut, LPSECURITY_ATTRIBUTES psa)
+{
+    UNREFERENCED_PARAMETER(dwPipeMode);
+    UNREFERENCED_PARAMETER(nMaxInstances);
+    UNREFERENCED_PARAMETER(cbOutBuffer);
+    UNREFERENCED_PARAMETER(cbInBuffer);
+    UNREFERENCED_PARAMETER(dwDefaultTimeOut);
+    UNREFERENCED_PARAMETER(psa);
+
+    sockaddr_un addr;
+    socklen_t cbAddr = 0;
+    if (!PipeAddress(pszName, &addr, &cbAddr))
+    {
+        SetLastError(ERROR_INVALID_NAME);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    std::shared_ptr<PipeState> pState = std::make_shared<PipeState>();
+    pState->fdListen = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    pState->fdCancel = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if ((pState->fdListen < 0) || (pState->fdCancel < 0))
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return INVALID_HANDLE_VALUE;
+    }
+    if (bind(pState->fdListen, (const sockaddr*)&addr, cbAddr) != 0)
+    {
+        SetLastError((errno != EADDRINUSE) ? ERROR_INVALID_NAME :
+            (dwOpenMode & FILE_FLAG_FIRST_PIPE_INSTANCE) ? ERROR_ACCESS_DENIED : ERROR_PIPE_BUSY);
+        return INVALID_HANDLE_VALUE;
+    }
+    if (listen(pState->fdListen, 4) != 0)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return INVALID_HANDLE_VALUE;
+    }
+    return NewPipeObject(pState);
+}
+
+BOOL ConnectNamedPipe(HANDLE hPipe, LPOVERLAPPED pov)
+{
+    // 与 Windows 相同：重叠方式下立即连上（客户端已在队列中）时返回 FALSE 和 ERROR_PIPE_CONNECTED
+    BOOL fConnected = PipeIo(hPipe, PIPE_OP_CONNECT, nullptr, 0, nullptr, pov);
+    if (fConnected && pov)
+    {
+        SetLastError(ERROR_PIPE_CONNECTED);
+        return FALSE;
+    }
+    return fConnected;
+}
+
+BOOL DisconnectNamedPipe(HANDLE hPipe)
+{
+    PipeState* pState = ((PipeObject*)hPipe)->pState.get();
+    std::lock_guard<std::mutex> guard(pState->lock);
+    if (pState->fdConn >= 0)
+    {
+        close(pState->fdConn);
+        pState->fdConn = -1;
+    }
+    return TRUE;
+}
+
+BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED pov, LPDWORD pcbTransferred, BOOL fWait)
+{
+    UNREFERENCED_PARAMETER(hFile);
+    DWORD dwError = (DWORD)__atomic_load_n(&pov->Internal, __ATOMIC_ACQUIRE);
+    if (pov->hEvent)
+    {
+        // 见 CompleteOverlapped：在事件的锁内读取结果
+        WaitObject* p = (WaitObject*)pov->hEvent;
+        std::unique_lock<std::mutex> guard(p->lock);
+        dwError = (DWORD)__atomic_load_n(&pov->Internal, __ATOMIC_ACQUIRE);
+        while (fWait && (dwError == ERROR_IO_PENDING))
+        {
+            p->cv.wait(guard);
+            dwError = (DWORD)__atomic_load_n(&pov->Internal, __ATOMIC_ACQUIRE);
+        }
+    }
+    *pcbTransferred = (DWORD)__atomic_load_n(&pov->InternalHigh, __ATOMIC_RELAXED);
+    if (dwError != ERROR_SUCCESS)
+    {
+        SetLastError((dwError == ERROR_IO_PENDING) ? ERROR_IO_INCOMPLETE : dwError);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED pov)
+{
+    UNREFERENCED_PARAMETER(pov);
+    if (IsPipeHandle(hFile))
+    {
+        PipeState* pState = ((PipeObject*)hFile)->pState.get();
+        std::lock_guard<std::mutex> guard(pState->lock);
+        if (pState->fPending)
+        {
+            eventfd_write(pState->fdCancel, 1);
+            return TRUE;
+        }
+    }
+    SetLastError(ERROR_NOT_FOUND);
+    return FALSE;
+}
+
+// 未完成的重叠操作随句柄关闭而取消，与 Windows 相同
+// 与 Windows 相同，关闭句柄即关闭管道实例：套接字在这里关闭，不等仍持有状态的 I/O 线程退出，
+// 否则管道名在 CloseHandle 返回后仍被占用，客户端还会连到已关闭的实例上
+static void ClosePipeObject(HANDLE h)
+{
+    PipeObject* pPipe = (PipeObject*)h;
+    CancelIoEx(h, nullptr);
+    {
+        PipeState* pState = pPipe->pState.get();
+        std::lock_guard<std::mutex> guard(pState->lock);
+        for (int* pfd : { &pState->fdListen, &pState->fdConn })
+        {
+            if (*pfd >= 0)
+            {
+                close(*pfd);
+                *pfd = -1;
+            }
+        }
+    }
+    delete pPipe;
+}
+
+// ---------------------------------------------------------------------------
+// 文件
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    const char16_t c_szSystemSid[] = u"S-1-5-18";
+
+    struct FileData
+    {
+        std::vector<BYTE> rgb;
+        ULONGLONG ullWriteTime;
+        std::u16string owner;       // SID 字符串
+    };
+
+    struct FileObject
+    {
+        DWORD dwMagic;
+        std::shared_ptr<FileData> pData;
+        ULONGLONG ullPointer;
+        bool fWrite;
+    };
+
+    // 全部文件共用一把锁；句柄在文件被删除或替换后仍指向原内容，与 Windows 上已打开的句柄相同
+    std::mutex s_fileLock;
+    std::map<std::u16string, std::shared_ptr<FileData>> s_files;
+    ULONGLONG s_ullFileClock = 0;
+    DWORD s_dwFileError = ERROR_SUCCESS;
+
+    std::u16string FileKey(LPCWSTR pszPath)
+    {
+        std::u16string key;
+        for (LPCWSTR pch = pszPath; *pch; pch++)
+        {
+            WCHAR ch = *pch;
+            key.push_back((char16_t)(((ch >= L'A') && (ch <= L'Z')) ? (ch - L'A' + L'a') : ch));
+        }
+        return key;
+    }
+
+    // 每次写入推进一个时钟单位，保证时间戳比较能看出修改
+    void TouchFile(FileData* pData)
+    {
+        pData->ullWriteTime = ++s_ullFileClock;
+    }
+}
+
+void WinCompatClearFiles()
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    s_files.clear();
+}
+
+void WinCompatSetFileError(DWORD dwError)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    s_dwFileError = dwError;
+}
+
+BOOL WinCompatSetFileOwner(LPCWSTR pszPath, LPCWSTR pszOwnerSid)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    auto it = s_files.find(FileKey(pszPath));
+    if (it == s_files.end())
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return FALSE;
+    }
+    it->second->owner = (const char16_t*)pszOwnerSid;
+    return TRUE;
+}
+
+static bool GetSectionOwner(HANDLE h, std::u16string* pOwner);
+
+DWORD GetSecurityInfo(HANDLE handle, SE_OBJECT_TYPE objectType, SECURITY_INFORMATION securityInfo, PSID* ppsidOwner, PSID* ppsidGroup, PVOID* ppDacl, PVOID* ppSacl, PSECURITY_DESCRIPTOR* ppSD)
+{
+    UNREFERENCED_PARAMETER(ppsidGroup);
+    UNREFERENCED_PARAMETER(ppDacl);
+    UNREFERENCED_PARAMETER(ppSacl);
+    if ((securityInfo != OWNER_SECURITY_INFORMATION) || !ppsidOwner || !ppSD || !handle || (handle == INVALID_HANDLE_VALUE))
+    {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    std::u16string owner;
+    DWORD dwMagic = ((FileObject*)handle)->dwMagic;
+    if ((objectType == SE_FILE_OBJECT) && (dwMagic == c_dwFileMagic))
+    {
+        std::lock_guard<std::mutex> guard(s_fileLock);
+        owner = ((FileObject*)handle)->pData->owner;
+    }
+    else if ((objectType != SE_KERNEL_OBJECT) || (dwMagic != c_dwMappingMagic) || !GetSectionOwner(handle, &owner))
+    {
+        return ERROR_NOT_SUPPORTED;
+    }
+
+    size_t cb = (owner.size() + 1) * sizeof(WCHAR);
+    *ppSD = malloc(cb);
+    if (!*ppSD)
+    {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+    CopyMemory(*ppSD, owner.c_str(), cb);
+    *ppsidOwner = *ppSD;
+    return ERROR_SUCCESS;
+}
+
+BOOL IsWellKnownSid(PSID pSid, WELL_KNOWN_SID_TYPE type)
+{
+    LPCWSTR pszSid = (type == WinLocalSystemSid) ? L"S-1-5-18" :
+        (type == WinBuiltinAdministratorsSid) ? L"S-1-5-32-544" :
+        (type == WinWorldSid) ? L"S-1-1-0" : L"S-1-0-0";
+    return !wcscmp((LPCWSTR)pSid, pszSid);
+}
+
+HANDLE CreateFileW(LPCWSTR pszPath, DWORD dwAccess, DWORD dwShare, LPSECURITY_ATTRIBUTES psa, DWORD dwDisposition, DWORD dwFlags, HANDLE hTemplate)
+{
+    UNREFERENCED_PARAMETER(dwShare);
+    UNREFERENCED_PARAMETER(psa);
+    UNREFERENCED_PARAMETER(dwFlags);
+    UNREFERENCED_PARAMETER(hTemplate);
+
+    sockaddr_un addr;
+    socklen_t cbAddr = 0;
+    if (PipeAddress(pszPath, &addr, &cbAddr))
+    {
+        return OpenPipeClient(&addr, cbAddr);
+    }
+
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    if (s_dwFileError != ERROR_SUCCESS)
+    {
+        SetLastError(s_dwFileError);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    std::u16string key = FileKey(pszPath);
+    auto it = s_files.find(key);
+    bool fExists = (it != s_files.end());
+    if ((fExists && (dwDisposition == CREATE_NEW)) || (!fExists && (dwDisposition == OPEN_EXISTING)))
+    {
+        SetLastError(fExists ? ERROR_FILE_EXISTS : ERROR_FILE_NOT_FOUND);
+        return INVALID_HANDLE_VALUE;
+    }
+
+    FileObject* pFile = new(std::nothrow) FileObject();
+    if (!pFile)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return INVALID_HANDLE_VALUE;
+    }
+    pFile->dwMagic = c_dwFileMagic;
+    pFile->ullPointer = 0;
+    pFile->fWrite = (dwAccess & GENERIC_WRITE) != 0;
+    if (!fExists || (dwDisposition == CREATE_ALWAYS))
+    {
+        pFile->pData = std::make_shared<FileData>();
+        pFile->pData->owner = fExists ? it->second->owner : c_szSystemSid;
+        TouchFile(pFile->pData.get());
+        s_files[key] = pFile->pData;
+    }
+    else
+    {
+        pFile->pData = it->second;
+    }
+    SetLastError((fExists && ((dwDisposition == OPEN_ALWAYS) || (dwDisposition == CREATE_ALWAYS))) ? ERROR_ALREADY_EXISTS : ERROR_SUCCESS);
+    return pFile;
+}
+
+static void CloseFileObject(HANDLE h)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    delete (FileObject*)h;
+}
+
+BOOL ReadFile(HANDLE hFile, LPVOID pv, DWORD cb, LPDWORD pcbRead, LPOVERLAPPED pov)
+{
+    if (IsPipeHandle(hFile))
+    {
+        return PipeIo(hFile, PIPE_OP_READ, pv, cb, pcbRead, pov);
+    }
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    FileObject* pFile = (FileObject*)hFile;
+    const std::vector<BYTE>& rgb = pFile->pData->rgb;
+    DWORD cbRead = 0;
+    if (pFile->ullPointer < rgb.size())
+    {
+        ULONGLONG cbLeft = rgb.size() - pFile->ullPointer;
+        cbRead = (cb < cbLeft) ? cb : (DWORD)cbLeft;
+        memcpy(pv, rgb.data() + pFile->ullPointer, cbRead);
+        pFile->ullPointer += cbRead;
+    }
+    if (pcbRead)
+    {
+        *pcbRead = cbRead;
+    }
+    return TRUE;
+}
+
+BOOL WriteFile(HANDLE hFile, LPCVOID pv, DWORD cb, LPDWORD pcbWritten, LPOVERLAPPED pov)
+{
+    if (IsPipeHandle(hFile))
+    {
+        return PipeIo(hFile, PIPE_OP_WRITE, (void*)pv, cb, pcbWritten, pov);
+    }
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    FileObject* pFile = (FileObject*)hFile;
+    if (pcbWritten)
+    {
+        *pcbWritten = 0;
+    }
+    if (!pFile->fWrite)
+    {
+        SetLastError(ERROR_ACCESS_DENIED);
+        return FALSE;
+    }
+    if (s_dwFileError != ERROR_SUCCESS)
+    {
+        SetLastError(s_dwFileError);
+        return FALSE;
+    }
+    std::vector<BYTE>& rgb = pFile->pData->rgb;
+    if (rgb.size() < pFile->ullPointer + cb)
+    {
+        rgb.resize(pFile->ullPointer + cb);
+    }
+    memcpy(rgb.data() + pFile->ullPointer, pv, cb);
+    pFile->ullPointer += cb;
+    TouchFile(pFile->pData.get());
+    if (pcbWritten)
+    {
+        *pcbWritten = cb;
+    }
+    return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistance, PLARGE_INTEGER pliNewPointer, DWORD dwMoveMethod)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    FileObject* pFile = (FileObject*)hFile;
+    LONGLONG llBase = (dwMoveMethod == FILE_BEGIN) ? 0 :
+        (dwMoveMethod == FILE_CURRENT) ? (LONGLONG)pFile->ullPointer : (LONGLONG)pFile->pData->rgb.size();
+    if (llBase + liDistance.QuadPart < 0)
+    {
+        SetLastError(ERROR_NEGATIVE_SEEK);
+        return FALSE;
+    }
+    pFile->ullPointer = (ULONGLONG)(llBase + liDistance.QuadPart);
+    if (pliNewPointer)
+    {
+        pliNewPointer->QuadPart = (LONGLONG)pFile->ullPointer;
+    }
+    return TRUE;
+}
+
+BOOL SetEndOfFile(HANDLE hFile)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    FileObject* pFile = (FileObject*)hFile;
+    if (!pFile->fWrite)
+    {
+        SetLastError(ERROR_ACCESS_DENIED);
+        return FALSE;
+    }
+    pFile->pData->rgb.resize(pFile->ullPointer);
+    TouchFile(pFile->pData.get());
+    return TRUE;
+}
+
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER pliSize)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    pliSize->QuadPart = (LONGLONG)((FileObject*)hFile)->pData->rgb.size();
+    return TRUE;
+}
+
+BOOL FlushFileBuffers(HANDLE hFile)
+{
+    // 管道：写入的消息已在对方的接收队列中，不会因断开连接而丢失
+    if (IsPipeHandle(hFile))
+    {
+        return TRUE;
+    }
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    if (s_dwFileError != ERROR_SUCCESS)
+    {
+        SetLastError(s_dwFileError);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+BOOL MoveFileExW(LPCWSTR pszExisting, LPCWSTR pszNew, DWORD dwFlags)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    auto itFrom = s_files.find(FileKey(pszExisting));
+    if (itFrom == s_files.end())
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return FALSE;
+    }
+    std::u16string keyTo = FileKey(pszNew);
+    if (!(dwFlags & MOVEFILE_REPLACE_EXISTING) && s_files.count(keyTo))
+    {
+        SetLastError(ERROR_ALREADY_EXISTS);
+        return FALSE;
+    }
+    std::shared_ptr<FileData> pData = itFrom->second;
+    s_files.erase(itFrom);
+    s_files[keyTo] = pData;
+    return TRUE;
+}
+
+BOOL DeleteFileW(LPCWSTR pszPath)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    if (!s_files.erase(FileKey(pszPath)))
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+namespace
+{
+    // 文件映射的 pSnapshot 为创建时内容的快照；命名区段的 fdSection 为 POSIX 共享内存对象
+    struct MappingObject
+    {
+        DWORD dwMagic;
+        std::shared_ptr<std::vector<BYTE>> pSnapshot;
+        int fdSection;
+        SIZE_T cbSection;
+    };
+
+    // 映射视图起始地址 -> 快照（或区段映射的长度）；视图可以比映射句柄活得久
+    struct MappedView
+    {
+        std::shared_ptr<std::vector<BYTE>> pSnapshot;
+        SIZE_T cbSection;
+    };
+
+    std::map<const void*, MappedView> s_views;
+
+    // 区段名的命名空间在进程启动时确定，fork 出的子进程沿用父进程的，能打开父进程创建的区段
+    const int s_nSectionNamespace = (int)getpid();
+
+    // 本进程创建的区段名，退出时删除；子进程不删除父进程创建的区段
+    struct CreatedSections
+    {
+        std::mutex lock;
+        std::vector<std::string> names;
+    };
+
+    CreatedSections& Sections()
+    {
+        static CreatedSections* s_pSections = new CreatedSections();
+        return *s_pSections;
+    }
+
+    void UnlinkCreatedSections()
+    {
+        if ((int)getpid() != s_nSectionNamespace)
+        {
+            return;
+        }
+        CreatedSections& sections = Sections();
+        std::lock_guard<std::mutex> guard(sections.lock);
+        for (const std::string& name : sections.names)
+        {
+            shm_unlink(name.c_str());
+        }
+        sections.names.clear();
+    }
+
+    // Global\名称、Local\名称 -> "/winunlock-compat.<命名空间>.Global_名称"
+    std::string SectionName(LPCWSTR pszName)
+    {
+        char szPrefix[48];
+        snprintf(szPrefix, sizeof(szPrefix), "/winunlock-compat.%d.", s_nSectionNamespace);
+        std::string name = szPrefix;
+        for (LPCWSTR pch = pszName; *pch && (name.size() < 200); pch++)
+        {
+            name.push_back(((*pch < 0x80) && (*pch != L'\\') && (*pch != L'/')) ? (char)*pch : '_');
+        }
+        return name;
+    }
+
+    HANDLE NewSectionObject(int fd)
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            SetLastError(ERROR_INVALID_HANDLE);
+            return nullptr;
+        }
+        MappingObject* pMapping = new(std::nothrow) MappingObject();
+        if (!pMapping)
+        {
+            close(fd);
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return nullptr;
+        }
+        pMapping->dwMagic = c_dwMappingMagic;
+        pMapping->fdSection = fd;
+        pMapping->cbSection = (SIZE_T)st.st_size;
+        return pMapping;
+    }
+}
+
+// hFile 为 INVALID_HANDLE_VALUE 时创建或打开命名区段（必须有名称），已存在时 GetLastError 为 ERROR_ALREADY_EXISTS
+HANDLE CreateFileMappingW(HANDLE hFile, LPSECURITY_ATTRIBUTES psa, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR pszName)
+{
+    UNREFERENCED_PARAMETER(psa);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        if (!pszName || (flProtect != PAGE_READWRITE) || dwMaximumSizeHigh || !dwMaximumSizeLow)
+        {
+            SetLastError(ERROR_NOT_SUPPORTED);
+            return nullptr;
+        }
+        std::string name = SectionName(pszName);
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+        if (fd >= 0)
+        {
+            if (ftruncate(fd, dwMaximumSizeLow) != 0)
+            {
+                close(fd);
+                shm_unlink(name.c_str());
+                SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+                return nullptr;
+            }
+            CreatedSections& sections = Sections();
+            {
+                std::lock_guard<std::mutex> guard(sections.lock);
+                if (sections.names.empty())
+                {
+                    atexit(UnlinkCreatedSections);
+                }
+                sections.names.push_back(name);
+            }
+            HANDLE h = NewSectionObject(fd);
+            if (h)
+            {
+                SetLastError(ERROR_SUCCESS);
+            }
+            return h;
+        }
+        if ((errno != EEXIST) || ((fd = shm_open(name.c_str(), O_RDWR, 0)) < 0))
+        {
+            SetLastError(ERROR_ACCESS_DENIED);
+            return nullptr;
+        }
+        HANDLE h = NewSectionObject(fd);
+        if (h)
+        {
+            SetLastError(ERROR_ALREADY_EXISTS);
+        }
+        return h;
+    }
+
+    if (!hFile || (flProtect != PAGE_READONLY))
+    {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    FileObject* pFile = (FileObject*)hFile;
+    if (pFile->pData->rgb.empty())
+    {
+        // 与 Windows 相同：不能映射空文件
+        SetLastError(ERROR_FILE_INVALID);
+        return nullptr;
+    }
+    MappingObject* pMapping = new(std::nothrow) MappingObject();
+    if (!pMapping)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return nullptr;
+    }
+    pMapping->dwMagic = c_dwMappingMagic;
+    pMapping->pSnapshot = std::make_shared<std::vector<BYTE>>(pFile->pData->rgb);
+    pMapping->fdSection = -1;
+    pMapping->cbSection = 0;
+    return pMapping;
+}
+
+HANDLE OpenFileMappingW(DWORD dwDesiredAccess, BOOL fInheritHandle, LPCWSTR pszName)
+{
+    UNREFERENCED_PARAMETER(dwDesiredAccess);
+    UNREFERENCED_PARAMETER(fInheritHandle);
+    int fd = shm_open(SectionName(pszName).c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return nullptr;
+    }
+    return NewSectionObject(fd);
+}
+
+BOOL WinCompatSetSectionOwner(LPCWSTR pszName, LPCWSTR pszOwnerSid)
+{
+    int fd = shm_open(SectionName(pszName).c_str(), O_RDWR, 0);
+    if (fd < 0)
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return FALSE;
+    }
+    bool fTrusted = !wcscmp(pszOwnerSid, L"S-1-5-18") || !wcscmp(pszOwnerSid, L"S-1-5-32-544");
+    int nResult = fchmod(fd, fTrusted ? 0600 : 0644);
+    close(fd);
+    return nResult == 0;
+}
+
+// 所有者记录在共享内存对象的权限位中，其余进程也能看到：只有本用户可访问时为 SYSTEM，否则为普通用户
+static bool GetSectionOwner(HANDLE h, std::u16string* pOwner)
+{
+    MappingObject* pMapping = (MappingObject*)h;
+    struct stat st;
+    if ((pMapping->fdSection < 0) || (fstat(pMapping->fdSection, &st) != 0))
+    {
+        return false;
+    }
+    *pOwner = (st.st_mode & 077) ? u"S-1-5-21-1-2-3-1001" : u"S-1-5-18";
+    return true;
+}
+
+static void CloseMappingObject(HANDLE h)
+{
+    MappingObject* pMapping = (MappingObject*)h;
+    if (pMapping->fdSection >= 0)
+    {
+        close(pMapping->fdSection);
+    }
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    delete pMapping;
+}
+
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T cbMap)
+{
+    MappingObject* pMapping = (MappingObject*)hMapping;
+    if (!hMapping || dwFileOffsetHigh || dwFileOffsetLow ||
+        ((pMapping->fdSection < 0) && (dwDesiredAccess != FILE_MAP_READ)))
+    {
+        SetLastError(ERROR_NOT_SUPPORTED);
+        return nullptr;
+    }
+
+    if (pMapping->fdSection >= 0)
+    {
+        SIZE_T cbView = cbMap ? cbMap : pMapping->cbSection;
+        if (cbView > pMapping->cbSection)
+        {
+            SetLastError(ERROR_ACCESS_DENIED);
+            return nullptr;
+        }
+        int nProt = PROT_READ | ((dwDesiredAccess & FILE_MAP_WRITE) ? PROT_WRITE : 0);
+        void* pv = mmap(nullptr, cbView, nProt, MAP_SHARED, pMapping->fdSection, 0);
+        if (pv == MAP_FAILED)
+        {
+            SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> guard(s_fileLock);
+        s_views[pv] = MappedView{ nullptr, cbView };
+        return pv;
+    }
+
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    s_views[pMapping->pSnapshot->data()] = MappedView{ pMapping->pSnapshot, 0 };
+    return pMapping->pSnapshot->data();
+}
+
+BOOL UnmapViewOfFile(LPCVOID pv)
+{
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    auto it = s_views.find(pv);
+    if (it == s_views.end())
+    {
+        SetLastError(ERROR_INVALID_ADDRESS);
+        return FALSE;
+    }
+    if (!it->second.pSnapshot)
+    {
+        munmap((void*)pv, it->second.cbSection);
+    }
+    s_views.erase(it);
+    return TRUE;
+}
+
+BOOL GetFileAttributesExW(LPCWSTR pszPath, GET_FILEEX_INFO_LEVELS level, LPVOID pvInfo)
+{
+    UNREFERENCED_PARAMETER(level);
+    std::lock_guard<std::mutex> guard(s_fileLock);
+    auto it = s_files.find(FileKey(pszPath));
+    if (it == s_files.end())
+    {
+        SetLastError(ERROR_FILE_NOT_FOUND);
+        return FALSE;
+    }
+    WIN32_FILE_ATTRIBUTE_DATA* pfad = (WIN32_FILE_ATTRIBUTE_DATA*)pvInfo;
+    ZeroMemory(pfad, sizeof(*pfad));
+    pfad->dwFileAttributes = FILE_ATTRIBUTE_NORMAL;
+    pfad->ftLastWriteTime.dwLowDateTime = (DWORD)it->second->ullWriteTime;
+    pfad->ftLastWriteTime.dwHighDateTime = (DWORD)(it->second->ullWriteTime >> 32);
+    ULONGLONG cb = it->second->rgb.size();
+    pfad->nFileSizeLow = (DWORD)cb;
+    pfad->nFileSizeHigh = (DWORD)(cb >> 32);
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// 注册表
+// ---------------------------------------------------------------------------
+
+// 键句柄记录根键和完整路径；值以“根键 路径|值名”为键保存，路径和值名不区分大小写。
+// 键在其下（或子键下）有值时存在
+struct HKEY__
+{
+    char16_t chRoot;
+    std::u16string path;
+};
+
+namespace
+{
+    struct RegistryValue
+    {
+        DWORD dwType;
+        std::vector<BYTE> rgb;
+    };
+
+    // RegNotifyChangeKeyValue 的一次性注册
+    struct RegistryNotify
+    {
+        HKEY hkey;
+        std::u16string path;
+        bool fWatchSubtree;
+        HANDLE hEvent;
+    };
+
+    std::mutex s_registryLock;
+    std::map<std::u16string, RegistryValue> s_registry;
+    std::vector<RegistryNotify> s_registryNotifies;
+
+    bool IsPredefinedKey(HKEY hkey)
+    {
+        return ((ULONG_PTR)hkey & ~(ULONG_PTR)0xff) == ((ULONG_PTR)HKEY_CLASSES_ROOT & ~(ULONG_PTR)0xff);
+    }
+
+    // hkey\pszSubKey 的路径，首字符为根键
+    std::u16string RegistryPath(HKEY hkey, LPCWSTR pszSubKey)
+    {
+        std::u16string path;
+        if (IsPredefinedKey(hkey))
+        {
+            path.push_back((char16_t)((ULONG_PTR)hkey & 0xff));
+        }
+        else
+        {
+            path.push_back(hkey->chRoot);
+            path += hkey->path;
+        }
+        if (pszSubKey && *pszSubKey)
+        {
+            if (path.size() > 1)
+            {
+                path.push_back(u'\\');
+            }
+            path += FileKey(pszSubKey);
+        }
+        return path;
+    }
+
+    std::u16string RegistryKey(HKEY hkey, LPCWSTR pszSubKey, LPCWSTR pszValue)
+    {
+        std::u16string key = RegistryPath(hkey, pszSubKey);
+        key.push_back(u'|');
+        key += FileKey(pszValue ? pszValue : L"");
+        return key;
+    }
+
+    bool RegistryKeyExists(const std::u16string& path)
+    {
+        if (path.size() == 1)
+        {
+            return true;
+        }
+        for (const auto& entry : s_registry)
+        {
+            const std::u16string& key = entry.first;
+            if ((key.size() > path.size()) && (key.compare(0, path.size(), path) == 0) &&
+                ((key[path.size()] == u'|') || (key[path.size()] == u'\\')))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // 写入 path 下的值：触发监视该键（或监视子树的上级键）的通知，每个注册只触发一次
+    void NotifyRegistryChange(const std::u16string& path)
+    {
+        for (size_t i = 0; i < s_registryNotifies.size(); )
+        {
+            const RegistryNotify& notify = s_registryNotifies[i];
+            bool fMatch = (notify.path == path) ||
+                (notify.fWatchSubtree && (path.size() > notify.path.size()) &&
+                 (path.compare(0, notify.path.size(), notify.path) == 0) && (path[notify.path.size()] == u'\\'));
+            if (fMatch)
+            {
+                SetEvent(notify.hEvent);
+                s_registryNotifies.erase(s_registryNotifies.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+
+    DWORD RegistryTypeFlag(DWORD dwType)
+    {
+        switch (dwType)
+        {
+        case REG_NONE: return RRF_RT_REG_NONE;
+        case REG_SZ: return RRF_RT_REG_SZ;
+        case REG_EXPAND_SZ: return RRF_RT_REG_EXPAND_SZ;
+        case REG_BINARY: return RRF_RT_REG_BINARY;
+        case REG_DWORD: return RRF_RT_REG_DWORD;
+        case REG_MULTI_SZ: return RRF_RT_REG_MULTI_SZ;
+        case REG_QWORD: return RRF_RT_REG_QWORD;
+        }
+        return 0;
+    }
+}
+
+void WinCompatSetRegistryValue(HKEY hkey, LPCWSTR pszSubKey, LPCWSTR pszValue, DWORD dwType, const void* pv, DWORD cb)
+{
+    std::lock_guard<std::mutex> guard(s_registryLock);
+    std::u16string key = RegistryKey(hkey, pszSubKey, pszValue);
+    if (!pv)
+    {
+        s_registry.erase(key);
+    }
+    else
+    {
+        RegistryValue& value = s_registry[key];
+        value.dwType = dwType;
+        value.rgb.assign((const BYTE*)pv, (const BYTE*)pv + cb);
+    }
+    NotifyRegistryChange(RegistryPath(hkey, pszSubKey));
+}
+
+void WinCompatClearRegistry()
+{
+    std::lock_guard<std::mutex> guard(s_registryLock);
+    s_registry.clear();
+}
+
+LSTATUS RegOpenKeyExW(HKEY hkey, LPCWSTR pszSubKey, DWORD dwOptions, REGSAM samDesired, PHKEY phkResult)
+{
+    UNREFERENCED_PARAMETER(dwOptions);
+    UNREFERENCED_PARAMETER(samDesired);
+    std::lock_guard<std::mutex> guard(s_registryLock);
+    std::u16string path = RegistryPath(hkey, pszSubKey);
+    if (!RegistryKeyExists(path))
+    {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    HKEY hkeyResult = new(std::nothrow) HKEY__();
+    if (!hkeyResult)
+    {
+        return ERROR_NOT_ENOUGH_MEMORY;
+    }
+    hkeyResult->chRoot = path[0];
+    hkeyResult->path = path.substr(1);
+    *phkResult = hkeyResult;
+    return ERROR_SUCCESS;
+}
+
+// 关闭键时撤销其上尚未触发的通知
+LSTATUS RegCloseKey(HKEY hkey)
+{
+    if (IsPredefinedKey(hkey))
+    {
+        return ERROR_SUCCESS;
+    }
+    {
+        std::lock_guard<std::mutex> guard(s_registryLock);
+        for (size_t i = 0; i < s_registryNotifies.size(); )
+        {
+            if (s_registryNotifies[i].hkey == hkey)
+            {
+                s_registryNotifies.erase(s_registryNotifies.begin() + i);
+            }
+            else
+            {
+                i++;
+            }
+        }
+    }
+    delete hkey;
+    return ERROR_SUCCESS;
+}
+
+// 只支持异步通知：键下的值被写入或删除时触发 hEvent
+LSTATUS RegNotifyChangeKeyValue(HKEY hkey, BOOL fWatchSubtree, DWORD dwNotifyFilter, HANDLE hEvent, BOOL fAsynchronous)
+{
+    if (!fAsynchronous || !hEvent || !(dwNotifyFilter & REG_NOTIFY_CHANGE_LAST_SET))
+    {
+        return ERROR_INVALID_PARAMETER;
+    }
+    std::lock_guard<std::mutex> guard(s_registryLock);
+    RegistryNotify notify;
+    notify.hkey = hkey;
+    notify.path = RegistryPath(hkey, nullptr);
+    notify.fWatchSubtree = fWatchSubtree != FALSE;
+    notify.hEvent = hEvent;
+    s_registryNotifies.push_back(notify);
+    return ERROR_SUCCESS;
+}
+
+LSTATUS RegGetValueW(HKEY hkey, LPCWSTR pszSubKey, LPCWSTR pszValue, DWORD dwFlags, LPDWORD pdwType, PVOID pvData, LPDWORD pcbData)
+{
+    std::lock_guard<std::mutex> guard(s_registryLock);
+    auto it = s_registry.find(RegistryKey(hkey, pszSubKey, pszValue));
+    if (it == s_registry.end())
+    {
+        return ERROR_FILE_NOT_FOUND;
+    }
+    const RegistryValue& value = it->second;
+    if (!(dwFlags & RegistryTypeFlag(value.dwType)))
+    {
+        return ERROR_UNSUPPORTED_TYPE;
+    }
+    if (pdwType)
+    {
+        *pdwType = value.dwType;
+    }
+    DWORD cb = (DWORD)value.rgb.size();
+    if (pvData && (!pcbData || (*pcbData < cb)))
+    {
+        if (pcbData)
+        {
+            *pcbData = cb;
+        }
+        return ERROR_MORE_DATA;
+    }
+    if (pvData)
+    {
+        CopyMemory(pvData, value.rgb.data(), cb);
+    }
+    if (pcbData)
+    {
+        *pcbData = cb;
+    }
+    return ERROR_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// 账户
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    struct Account
+    {
+        std::u16string sid;
+        std::u16string domain;
+        std::u16string name;
+    };
+
+    std::mutex s_accountLock;
+    std::vector<Account> s_accounts;
+
+    // 复制到调用方缓冲区；不够大时返回所需字符数（含 NUL）并失败
+    bool CopyAccountString(const std::u16string& str, LPWSTR psz, LPDWORD pcch)
+    {
+        DWORD cchNeeded = (DWORD)str.size() + 1;
+        if (!psz || (*pcch < cchNeeded))
+        {
+            *pcch = cchNeeded;
+            return false;
+        }
+        CopyMemory(psz, str.c_str(), cchNeeded * sizeof(WCHAR));
+        *pcch = cchNeeded - 1;
+        return true;
+    }
+}
+
+void WinCompatSetAccount(LPCWSTR pszSid, LPCWSTR pszDomain, LPCWSTR pszName)
+{
+    std::lock_guard<std::mutex> guard(s_accountLock);
+    s_accounts.push_back({ (const char16_t*)pszSid, (const char16_t*)pszDomain, (const char16_t*)pszName });
+}
+
+void WinCompatClearAccounts()
+{
+    std::lock_guard<std::mutex> guard(s_accountLock);
+    s_accounts.clear();
+}
+
+BOOL LookupAccountNameW(LPCWSTR pszSystemName, LPCWSTR pszAccountName, PSID pSid, LPDWORD pcbSid, LPWSTR pszDomain, LPDWORD pcchDomain, PSID_NAME_USE peUse)
+{
+    UNREFERENCED_PARAMETER(pszSystemName);
+    std::lock_guard<std::mutex> guard(s_accountLock);
+    LPCWSTR pszSeparator = wcschr(pszAccountName, L'\\');
+    LPCWSTR pszName = pszSeparator ? pszSeparator + 1 : pszAccountName;
+    for (const Account& account : s_accounts)
+    {
+        if (_wcsicmp(pszName, (LPCWSTR)account.name.c_str()) ||
+            (pszSeparator && ((account.domain.size() != (size_t)(pszSeparator - pszAccountName)) ||
+                _wcsnicmp(pszAccountName, (LPCWSTR)account.domain.c_str(), account.domain.size()))))
+        {
+            continue;
+        }
+
+        DWORD cchSid = *pcbSid / sizeof(WCHAR);
+        bool fSid = CopyAccountString(account.sid, (LPWSTR)pSid, &cchSid);
+        *pcbSid = (fSid ? cchSid + 1 : cchSid) * sizeof(WCHAR);
+        if (!CopyAccountString(account.domain, pszDomain, pcchDomain) || !fSid)
+        {
+            SetLastError(ERROR_INSUFFICIENT_BUFFER);
+            return FALSE;
+        }
+        *peUse = SidTypeUser;
+        return TRUE;
+    }
+    SetLastError(ERROR_NONE_MAPPED);
+    return FALSE;
+}
+
+BOOL LookupAccountSidW(LPCWSTR pszSystemName, PSID pSid, LPWSTR pszName, LPDWORD pcchName, LPWSTR pszDomain, LPDWORD pcchDomain, PSID_NAME_USE peUse)
+{
+    UNREFERENCED_PARAMETER(pszSystemName);
+    std::lock_guard<std::mutex> guard(s_accountLock);
+    for (const Account& account : s_accounts)
+    {
+        if (wcscmp((LPCWSTR)pSid, (LPCWSTR)account.sid.c_str()))
+        {
+            continue;
+        }
+
+        bool fName = CopyAccountString(account.name, pszName, pcchName);
+        if (!CopyAccountString(account.domain, pszDomain, pcchDomain) || !fName)
+        {
+            SetLastError(ERROR_INSUFFICIENT_BUFFER);
+            return FALSE;
+        }
+        *peUse = SidTypeUser;
+        return TRUE;
+    }
+    SetLastError(ERROR_NONE_MAPPED);
+    return FALSE;
+}
+
+namespace
+{
+    // 令牌只记录用户 SID，与其他句柄一样以 dwMagic 开头
+    struct TokenObject
+    {
+        DWORD dwMagic;
+        std::u16string sid;
+    };
+
+    std::u16string s_sessionUserSid;
+}
+
+static void CloseTokenObject(HANDLE h)
+{
+    delete (TokenObject*)h;
+}
+
+void WinCompatSetSessionUser(LPCWSTR pszSid)
+{
+    std::lock_guard<std::mutex> guard(s_accountLock);
+    s_sessionUserSid = pszSid ? (const char16_t*)pszSid : u"";
+}
+
+BOOL WTSQueryUserToken(ULONG SessionId, PHANDLE phToken)
+{
+    UNREFERENCED_PARAMETER(SessionId);
+    std::lock_guard<std::mutex> guard(s_accountLock);
+    if (s_sessionUserSid.empty())
+    {
+        SetLastError(ERROR_NO_TOKEN);
+        return FALSE;
+    }
+    TokenObject* pToken = new TokenObject;
+    pToken->dwMagic = c_dwTokenMagic;
+    pToken->sid = s_sessionUserSid;
+    *phToken = pToken;
+    return TRUE;
+}
+
+BOOL GetTokenInformation(HANDLE hToken, TOKEN_INFORMATION_CLASS tokenInformationClass, LPVOID pvInformation, DWORD cbInformation, PDWORD pcbReturned)
+{
+    TokenObject* pToken = (TokenObject*)hToken;
+    if (!pToken || (pToken->dwMagic != c_dwTokenMagic) || (tokenInformationClass != TokenUser))
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    DWORD cbSid = (DWORD)(pToken->sid.size() + 1) * sizeof(WCHAR);
+    *pcbReturned = sizeof(TOKEN_USER) + cbSid;
+    if (cbInformation < *pcbReturned)
+    {
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+    TOKEN_USER* pTokenUser = (TOKEN_USER*)pvInformation;
+    pTokenUser->User.Sid = pTokenUser + 1;
+    pTokenUser->User.Attributes = 0;
+    CopyMemory(pTokenUser + 1, pToken->sid.c_str(), cbSid);
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// 资源
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    struct StringResource
+    {
+        WORD wBlock;
+        WORD wLanguage;
+        const void* pv;
+        DWORD cb;
+    };
+
+    StringResource s_rgResources[32];
+    DWORD s_cResources = 0;
+}
+
+void WinCompatSetStringResource(WORD wBlock, WORD wLanguage, const void* pv, DWORD cb)
+{
+    if (s_cResources < ARRAYSIZE(s_rgResources))
+    {
+        s_rgResources[s_cResources++] = { wBlock, wLanguage, pv, cb };
+    }
+}
+
+void WinCompatClearResources()
+{
+    s_cResources = 0;
+}
+
+HRSRC FindResourceExW(HMODULE hModule, LPCWSTR pszType, LPCWSTR pszName, WORD wLanguage)
+{
+    UNREFERENCED_PARAMETER(hModule);
+    if (pszType == RT_STRING)
+    {
+        for (DWORD i = 0; i < s_cResources; i++)
+        {
+            if ((s_rgResources[i].wBlock == (WORD)(ULONG_PTR)pszName) && (s_rgResources[i].wLanguage == wLanguage))
+            {
+                return (HRSRC)&s_rgResources[i];
+            }
+        }
+    }
+    SetLastError(ERROR_RESOURCE_LANG_NOT_FOUND);
+    return nullptr;
+}
+
+HGLOBAL LoadResource(HMODULE hModule, HRSRC hResInfo)
+{
+    UNREFERENCED_PARAMETER(hModule);
+    return hResInfo ? (HGLOBAL)((StringResource*)hResInfo)->pv : nullptr;
+}
+
+LPVOID LockResource(HGLOBAL hResData)
+{
+    return hResData;
+}
+
+DWORD SizeofResource(HMODULE hModule, HRSRC hResInfo)
+{
+    UNREFERENCED_PARAMETER(hModule);
+    return hResInfo ? ((StringResource*)hResInfo)->cb : 0;
+}
+
+// ---------------------------------------------------------------------------
+// BCrypt：SHA-256、HMAC、PBKDF2 和 AES-GCM 的直接实现，按 FIPS 180-4、RFC 2104、RFC 8018 和 SP 800-38D
+// ---------------------------------------------------------------------------
+
+namespace
+{
+    enum class Algorithm
+    {
+        Sha256,
+        Aes,
+    };
+
+    struct AlgorithmObject
+    {
+        Algorithm algorithm;
+        bool fHmac;
+        bool fGcm;
+    };
+
+    const ULONG c_cbSha256 = 32;
+    const ULONG c_cbSha256Block = 64;
+
+    struct Sha256
+    {
+        DWORD rgdwState[8];
+        BYTE rgbBlock[c_cbSha256Block];
+        ULONGLONG cbTotal;
+    };
+
+    const DWORD c_rgdwSha256K[64] =
+    {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+    };
+
+    inline DWORD Rotr32(DWORD dw, int n)
+    {
+        return (dw >> n) | (dw << (32 - n));
+    }
+
+    void Sha256Init(Sha256* p)
+    {
+        static const DWORD c_rgdwInit[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+        memcpy(p->rgdwState, c_rgdwInit, sizeof(c_rgdwInit));
+        p->cbTotal = 0;
+    }
+
+    void Sha256Compress(Sha256* p, const BYTE* pb)
+    {
+        DWORD w[64];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = ((DWORD)pb[i * 4] << 24) | ((DWORD)pb[i * 4 + 1] << 16) | ((DWORD)pb[i * 4 + 2] << 8) | pb[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; i++)
+        {
+            DWORD s0 = Rotr32(w[i - 15], 7) ^ Rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            DWORD s1 = Rotr32(w[i - 2], 17) ^ Rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        DWORD a = p->rgdwState[0], b = p->rgdwState[1], c = p->rgdwState[2], d = p->rgdwState[3];
+        DWORD e = p->rgdwState[4], f = p->rgdwState[5], g = p->rgdwState[6], h = p->rgdwState[7];
+        for (int i = 0; i < 64; i++)
+        {
+            DWORD t1 = h + (Rotr32(e, 6) ^ Rotr32(e, 11) ^ Rotr32(e, 25)) + ((e & f) ^ (~e & g)) + c_rgdwSha256K[i] + w[i];
+            DWORD t2 = (Rotr32(a, 2) ^ Rotr32(a, 13) ^ Rotr32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        p->rgdwState[0] += a;
+        p->rgdwState[1] += b;
+        p->rgdwState[2] += c;
+        p->rgdwState[3] += d;
+        p->rgdwState[4] += e;
+        p->rgdwState[5] += f;
+        p->rgdwState[6] += g;
+        p->rgdwState[7] += h;
+    }
+
+    void Sha256Update(Sha256* p, const BYTE* pb, ULONG cb)
+    {
+        ULONG cbBuffered = (ULONG)(p->cbTotal % c_cbSha256Block);
+        p->cbTotal += cb;
+        if (cbBuffered)
+        {
+            ULONG cbCopy = min(cb, c_cbSha256Block - cbBuffered);
+            memcpy(p->rgbBlock + cbBuffered, pb, cbCopy);
+            pb += cbCopy;
+            cb -= cbCopy;
+            if (cbBuffered + cbCopy < c_cbSha256Block)
+            {
+                return;
+            }
+            Sha256Compress(p, p->rgbBlock);
+        }
+        for (; cb >= c_cbSha256Block; pb += c_cbSha256Block, cb -= c_cbSha256Block)
+        {
+            Sha256Compress(p, pb);
+        }
+        memcpy(p->rgbBlock, pb, cb);
+    }
+
+    void Sha256Final(Sha256* p, BYTE* pbDigest)
+    {
+        ULONGLONG cBits = p->cbTotal * 8;
+        static const BYTE c_rgbPad[c_cbSha256Block] = { 0x80 };
+        ULONG cbBuffered = (ULONG)(p->cbTotal % c_cbSha256Block);
+        Sha256Update(p, c_rgbPad, (cbBuffered < 56) ? 56 - cbBuffered : 120 - cbBuffered);
+        BYTE rgbLength[8];
+        for (int i = 0; i < 8; i++)
+        {
+            rgbLength[i] = (BYTE)(cBits >> (56 - i * 8));
+        }
+        Sha256Update(p, rgbLength, sizeof(rgbLength));
+        for (int i = 0; i < 8; i++)
+        {
+            pbDigest[i * 4] = (BYTE)(p->rgdwState[i] >> 24);
+            pbDigest[i * 4 + 1] = (BYTE)(p->rgdwState[i] >> 16);
+            pbDigest[i * 4 + 2] = (BYTE)(p->rgdwState[i] >> 8);
+            pbDigest[i * 4 + 3] = (BYTE)p->rgdwState[i];
+        }
+    }
+
+    // HMAC 的内外两层在吸收填充后的状态；每条消息从副本开始
+    struct HashObject
+    {
+        Sha256 inner;
+        Sha256 outer;
+        bool fHmac;
+    };
+
+    void HmacInit(HashObject* p, const BYTE* pbKey, ULONG cbKey)
+    {
+        BYTE rgbKey[c_cbSha256Block] = {};
+        if (cbKey > c_cbSha256Block)
+        {
+            Sha256Init(&p->inner);
+            Sha256Update(&p->inner, pbKey, cbKey);
+            Sha256Final(&p->inner, rgbKey);
+        }
+        else
+        {
+            memcpy(rgbKey, pbKey, cbKey);
+        }
+        BYTE rgbPad[c_cbSha256Block];
+        for (ULONG i = 0; i < c_cbSha256Block; i++)
+        {
+            rgbPad[i] = rgbKey[i] ^ 0x36;
+        }
+        Sha256Init(&p->inner);
+        Sha256Update(&p->inner, rgbPad, sizeof(rgbPad));
+        for (ULONG i = 0; i < c_cbSha256Block; i++)
+        {
+            rgbPad[i] = rgbKey[i] ^ 0x5c;
+        }
+        Sha256Init(&p->outer);
+        Sha256Update(&p->outer, rgbPad, sizeof(rgbPad));
+        p->fHmac = true;
+        SecureZeroMemory(rgbKey, sizeof(rgbKey));
+        SecureZeroMemory(rgbPad, sizeof(rgbPad));
+    }
+
+    void HashFinal(HashObject* p, BYTE* pbDigest)
+    {
+        Sha256Final(&p->inner, pbDigest);
+        if (p->fHmac)
+        {
+            Sha256Update(&p->outer, pbDigest, c_cbSha256);
+            Sha256Final(&p->outer, pbDigest);
+        }
+    }
+
+    // AES：只需要加密方向（GCM 以计数器模式使用分组密码）
+    const BYTE c_rgbAesSbox[256] =
+    {
+        0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+        0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+        0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+        0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+        0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+        0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+        0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+        0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+        0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+        0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+        0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+        0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+        0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+        0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+        0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+        0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+    };
+
+    struct KeyObject
+    {
+        BYTE rgbRoundKeys[240];
+        int cRounds;
+    };
+
+    inline BYTE AesXtime(BYTE b)
+    {
+        return (BYTE)((b << 1) ^ ((b & 0x80) ? 0x1b : 0));
+    }
+
+    void AesExpandKey(KeyObject* p, const BYTE* pbKey, ULONG cbKey)
+    {
+        const ULONG cWordsKey = cbKey / 4;
+        p->cRounds = (int)cWordsKey + 6;
+        const ULONG cWords = 4 * (p->cRounds + 1);
+        BYTE* pw = p->rgbRoundKeys;
+        memcpy(pw, pbKey, cbKey);
+        BYTE bRcon = 1;
+        for (ULONG i = cWordsKey; i < cWords; i++)
+        {
+            BYTE t[4] = { pw[(i - 1) * 4], pw[(i - 1) * 4 + 1], pw[(i - 1) * 4 + 2], pw[(i - 1) * 4 + 3] };
+            if ((i % cWordsKey) == 0)
+            {
+                BYTE b = t[0];
+                t[0] = (BYTE)(c_rgbAesSbox[t[1]] ^ bRcon);
+                t[1] = c_rgbAesSbox[t[2]];
+                t[2] = c_rgbAesSbox[t[3]];
+                t[3] = c_rgbAesSbox[b];
+                bRcon = AesXtime(bRcon);
+            }
+            else if ((cWordsKey > 6) && ((i % cWordsKey) == 4))
+            {
+                for (int j = 0; j < 4; j++)
+                {
+                    t[j] = c_rgbAesSbox[t[j]];
+                }
+            }
+            for (int j = 0; j < 4; j++)
+            {
+                pw[i * 4 + j] = pw[(i - cWordsKey) * 4 + j] ^ t[j];
+            }
+        }
+    }
+
+    void AesEncryptBlock(const KeyObject* p, const BYTE* pbIn, BYTE* pbOut)
+    {
+        BYTE s[16];
+        for (int i = 0; i < 16; i++)
+        {
+            s[i] = pbIn[i] ^ p->rgbRoundKeys[i];
+        }
+        for (int iRound = 1; iRound <= p->cRounds; iRound++)
+        {
+            // SubBytes 与 ShiftRows：状态按列存放，第 r 行左移 r 列
+            BYTE t[16];
+            for (int c = 0; c < 4; c++)
+            {
+                for (int r = 0; r < 4; r++)
+                {
+                    t[c * 4 + r] = c_rgbAesSbox[s[((c + r) % 4) * 4 + r]];
+                }
+            }
+            if (iRound < p->cRounds)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    BYTE* pc = t + c * 4;
+                    BYTE bAll = pc[0] ^ pc[1] ^ pc[2] ^ pc[3];
+                    BYTE b0 = pc[0];
+                    pc[0] ^= bAll ^ AesXtime(pc[0] ^ pc[1]);
+                    pc[1] ^= bAll ^ AesXtime(pc[1] ^ pc[2]);
+                    pc[2] ^= bAll ^ AesXtime(pc[2] ^ pc[3]);
+                    pc[3] ^= bAll ^ AesXtime(pc[3] ^ b0);
+                }
+            }
+            for (int i = 0; i < 16; i++)
+            {
+                s[i] = t[i] ^ p->rgbRoundKeys[iRound * 16 + i];
+            }
+        }
+        memcpy(pbOut, s, sizeof(s));
+    }
+
+    // GHASH：GF(2^128) 上按位的乘法（SP 800-38D 算法 1），分组按大端解释
+    struct Gf128
+    {
+        ULONGLONG ullHigh;
+        ULONGLONG ullLow;
+    };
+
+    Gf128 Gf128Load(const BYTE* pb)
+    {
+        Gf128 x = { 0, 0 };
+        for (int i = 0; i < 8; i++)
+        {
+            x.ullHigh = (x.ullHigh << 8) | pb[i];
+            x.ullLow = (x.ullLow << 8) | pb[8 + i];
+        }
+        return x;
+    }
+
+    void Gf128Store(Gf128 x, BYTE* pb)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            pb[i] = (BYTE)(x.ullHigh >> (56 - i * 8));
+            pb[8 + i] = (BYTE)(x.ullLow >> (56 - i * 8));
+        }
+    }
+
+    Gf128 Gf128Multiply(Gf128 x, Gf128 y)
+    {
+        Gf128 z = { 0, 0 };
+        Gf128 v = y;
+        for (int i = 0; i < 128; i++)
+        {
+            ULONGLONG ullBit = (i < 64) ? (x.ullHigh >> (63 - i)) & 1 : (x.ullLow >> (127 - i)) & 1;
+            if (ullBit)
+            {
+                z.ullHigh ^= v.ullHigh;
+                z.ullLow ^= v.ullLow;
+            }
+            bool fCarry = v.ullLow & 1;
+            v.ullLow = (v.ullLow >> 1) | (v.ullHigh << 63);
+            v.ullHigh >>= 1;
+            if (fCarry)
+            {
+                v.ullHigh ^= 0xe100000000000000ull;
+            }
+        }
+        return z;
+    }
+
+    void GhashUpdate(Gf128* pY, Gf128 h, const BYTE* pb, ULONGLONG cb)
+    {
+        for (; cb; )
+        {
+            BYTE rgbBlock[16] = {};
+            ULONG cbBlock = (ULONG)min(cb, (ULONGLONG)sizeof(rgbBlock));
+            memcpy(rgbBlock, pb, cbBlock);
+            Gf128 x = Gf128Load(rgbBlock);
+            pY->ullHigh ^= x.ullHigh;
+            pY->ullLow ^= x.ullLow;
+            *pY = Gf128Multiply(*pY, h);
+            pb += cbBlock;
+            cb -= cbBlock;
+        }
+    }
+
+    // 计数器从 J0 + 1 开始，J0 = 随机数 || 0^31 || 1
+    void GcmCtr(const KeyObject* pKey, const BYTE* pbJ0, const BYTE* pbIn, BYTE* pbOut, ULONG cb)
+    {
+        BYTE rgbCounter[16];
+        memcpy(rgbCounter, pbJ0, sizeof(rgbCounter));
+        DWORD dwCounter = ((DWORD)pbJ0[12] << 24) | ((DWORD)pbJ0[13] << 16) | ((DWORD)pbJ0[14] << 8) | pbJ0[15];
+        for (ULONG i = 0; i < cb; i += 16)
+        {
+            dwCounter++;
+            rgbCounter[12] = (BYTE)(dwCounter >> 24);
+            rgbCounter[13] = (BYTE)(dwCounter >> 16);
+            rgbCounter[14] = (BYTE)(dwCounter >> 8);
+            rgbCounter[15] = (BYTE)dwCounter;
+            BYTE rgbStream[16];
+            AesEncryptBlock(pKey, rgbCounter, rgbStream);
+            for (ULONG j = 0; (j < 16) && (i + j < cb); j++)
+            {
+                pbOut[i + j] = pbIn[i + j] ^ rgbStream[j];
+            }
+        }
+    }
+
+    void GcmTag(const KeyObject* pKey, const BYTE* pbJ0, const BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO* pInfo,
+        const BYTE* pbCipher, ULONG cbCipher, BYTE* pbTag)
+    {
+        static const BYTE c_rgbZero[16] = {};
+        BYTE rgbH[16];
+        AesEncryptBlock(pKey, c_rgbZero, rgbH);
+        Gf128 h = Gf128Load(rgbH);
+        Gf128 y = { 0, 0 };
+        GhashUpdate(&y, h, pInfo->pbAuthData, pInfo->cbAuthData);
+        GhashUpdate(&y, h, pbCipher, cbCipher);
+        Gf128 lengths = { (ULONGLONG)pInfo->cbAuthData * 8, (ULONGLONG)cbCipher * 8 };
+        y.ullHigh ^= lengths.ullHigh;
+        y.ullLow ^= lengths.ullLow;
+        y = Gf128Multiply(y, h);
+
+        BYTE rgbS[16];
+        BYTE rgbEncryptedJ0[16];
+        Gf128Store(y, rgbS);
+        AesEncryptBlock(pKey, pbJ0, rgbEncryptedJ0);
+        for (int i = 0; i < 16; i++)
+        {
+            pbTag[i] = rgbS[i] ^ rgbEncryptedJ0[i];
+        }
+    }
+
+    NTSTATUS GcmCheckArguments(BCRYPT_KEY_HANDLE hKey, ULONG cbInput, PVOID pPaddingInfo, PUCHAR pbOutput, ULONG cbOutput, BYTE* pbJ0)
+    {
+        const BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO* pInfo = (const BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO*)pPaddingInfo;
+        if (!hKey || !pInfo || (pInfo->cbSize != sizeof(*pInfo)) || (pInfo->cbNonce != 12) ||
+            (pInfo->cbTag < 12) || (pInfo->cbTag > 16) || (pInfo->cbAuthData && !pInfo->pbAuthData))
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+        if (pInfo->dwFlags)
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+        if (pbOutput && (cbOutput < cbInput))
+        {
+            return STATUS_BUFFER_TOO_SMALL;
+        }
+        memcpy(pbJ0, pInfo->pbNonce, 12);
+        pbJ0[12] = 0;
+        pbJ0[13] = 0;
+        pbJ0[14] = 0;
+        pbJ0[15] = 1;
+        return STATUS_SUCCESS;
+    }
+}
+
+NTSTATUS BCryptGenRandom(BCRYPT_ALG_HANDLE hAlgorithm, PUCHAR pbBuffer, ULONG cbBuffer, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(hAlgorithm);
+    UNREFERENCED_PARAMETER(dwFlags);
+    static std::atomic<ULONGLONG> s_ullSeed{ 0 };
+    ULONGLONG ull = s_ullSeed.fetch_add(0x9e3779b97f4a7c15ull) ^ (ULONGLONG)(ULONG_PTR)pbBuffer ^ GetTickCount64();
+    for (ULONG i = 0; i < cbBuffer; i++)
+    {
+        ull = ull * 6364136223846793005ull + 1442695040888963407ull;
+        pbBuffer[i] = (UCHAR)(ull >> 56);
+    }
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptOpenAlgorithmProvider(BCRYPT_ALG_HANDLE* phAlgorithm, LPCWSTR pszAlgId, LPCWSTR pszImplementation, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(pszImplementation);
+    *phAlgorithm = nullptr;
+    Algorithm algorithm;
+    if (wcscmp(pszAlgId, BCRYPT_SHA256_ALGORITHM) == 0)
+    {
+        algorithm = Algorithm::Sha256;
+    }
+    else if ((wcscmp(pszAlgId, BCRYPT_AES_ALGORITHM) == 0) && !(dwFlags & BCRYPT_ALG_HANDLE_HMAC_FLAG))
+    {
+        algorithm = Algorithm::Aes;
+    }
+    else
+    {
+        return STATUS_NOT_FOUND;
+    }
+    AlgorithmObject* p = new(std::nothrow) AlgorithmObject{ algorithm, (dwFlags & BCRYPT_ALG_HANDLE_HMAC_FLAG) != 0, false };
+    if (!p)
+    {
+        return STATUS_NO_MEMORY;
+    }
+    *phAlgorithm = p;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptCloseAlgorithmProvider(BCRYPT_ALG_HANDLE hAlgorithm, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(dwFlags);
+    delete (AlgorithmObject*)hAlgorithm;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptSetProperty(BCRYPT_HANDLE hObject, LPCWSTR pszProperty, PUCHAR pbInput, ULONG cbInput, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(cbInput);
+    UNREFERENCED_PARAMETER(dwFlags);
+    AlgorithmObject* p = (AlgorithmObject*)hObject;
+    if (!p || (p->algorithm != Algorithm::Aes) || (wcscmp(pszProperty, BCRYPT_CHAINING_MODE) != 0) ||
+        (wcscmp((LPCWSTR)pbInput, BCRYPT_CHAIN_MODE_GCM) != 0))
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+    p->fGcm = true;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptCreateHash(BCRYPT_ALG_HANDLE hAlgorithm, BCRYPT_HASH_HANDLE* phHash, PUCHAR pbHashObject, ULONG cbHashObject, PUCHAR pbSecret, ULONG cbSecret, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(pbHashObject);
+    UNREFERENCED_PARAMETER(cbHashObject);
+    UNREFERENCED_PARAMETER(dwFlags);
+    const AlgorithmObject* pAlgorithm = (const AlgorithmObject*)hAlgorithm;
+    if (!pAlgorithm || (pAlgorithm->algorithm != Algorithm::Sha256))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    HashObject* p = new(std::nothrow) HashObject();
+    if (!p)
+    {
+        return STATUS_NO_MEMORY;
+    }
+    if (pAlgorithm->fHmac)
+    {
+        HmacInit(p, pbSecret, cbSecret);
+    }
+    else
+    {
+        Sha256Init(&p->inner);
+    }
+    *phHash = p;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptHashData(BCRYPT_HASH_HANDLE hHash, PUCHAR pbInput, ULONG cbInput, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(dwFlags);
+    Sha256Update(&((HashObject*)hHash)->inner, pbInput, cbInput);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptFinishHash(BCRYPT_HASH_HANDLE hHash, PUCHAR pbOutput, ULONG cbOutput, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(dwFlags);
+    if (cbOutput != c_cbSha256)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    HashFinal((HashObject*)hHash, pbOutput);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptDestroyHash(BCRYPT_HASH_HANDLE hHash)
+{
+    HashObject* p = (HashObject*)hHash;
+    SecureZeroMemory(p, sizeof(*p));
+    delete p;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptDeriveKeyPBKDF2(BCRYPT_ALG_HANDLE hPrf, PUCHAR pbPassword, ULONG cbPassword, PUCHAR pbSalt, ULONG cbSalt,
+    ULONGLONG cIterations, PUCHAR pbDerivedKey, ULONG cbDerivedKey, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(dwFlags);
+    const AlgorithmObject* pAlgorithm = (const AlgorithmObject*)hPrf;
+    if (!pAlgorithm || (pAlgorithm->algorithm != Algorithm::Sha256) || !pAlgorithm->fHmac || !cIterations)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    HashObject keyed;
+    HmacInit(&keyed, pbPassword, cbPassword);
+    for (ULONG iBlock = 1; cbDerivedKey; iBlock++)
+    {
+        BYTE rgbIndex[4] = { (BYTE)(iBlock >> 24), (BYTE)(iBlock >> 16), (BYTE)(iBlock >> 8), (BYTE)iBlock };
+        BYTE rgbU[c_cbSha256];
+        BYTE rgbT[c_cbSha256];
+        HashObject hash = keyed;
+        Sha256Update(&hash.inner, pbSalt, cbSalt);
+        Sha256Update(&hash.inner, rgbIndex, sizeof(rgbIndex));
+        HashFinal(&hash, rgbU);
+        memcpy(rgbT, rgbU, sizeof(rgbT));
+        for (ULONGLONG i = 1; i < cIterations; i++)
+        {
+            hash = keyed;
+            Sha256Update(&hash.inner, rgbU, sizeof(rgbU));
+            HashFinal(&hash, rgbU);
+            for (ULONG j = 0; j < c_cbSha256; j++)
+            {
+                rgbT[j] ^= rgbU[j];
+            }
+        }
+        ULONG cbCopy = min(cbDerivedKey, c_cbSha256);
+        memcpy(pbDerivedKey, rgbT, cbCopy);
+        pbDerivedKey += cbCopy;
+        cbDerivedKey -= cbCopy;
+        SecureZeroMemory(&hash, sizeof(hash));
+        SecureZeroMemory(rgbU, sizeof(rgbU));
+        SecureZeroMemory(rgbT, sizeof(rgbT));
+    }
+    SecureZeroMemory(&keyed, sizeof(keyed));
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptGenerateSymmetricKey(BCRYPT_ALG_HANDLE hAlgorithm, BCRYPT_KEY_HANDLE* phKey, PUCHAR pbKeyObject, ULONG cbKeyObject, PUCHAR pbSecret, ULONG cbSecret, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(pbKeyObject);
+    UNREFERENCED_PARAMETER(cbKeyObject);
+    UNREFERENCED_PARAMETER(dwFlags);
+    const AlgorithmObject* pAlgorithm = (const AlgorithmObject*)hAlgorithm;
+    if (!pAlgorithm || (pAlgorithm->algorithm != Algorithm::Aes) || ((cbSecret != 16) && (cbSecret != 24) && (cbSecret != 32)))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    if (!pAlgorithm->fGcm)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+    KeyObject* p = new(std::nothrow) KeyObject();
+    if (!p)
+    {
+        return STATUS_NO_MEMORY;
+    }
+    AesExpandKey(p, pbSecret, cbSecret);
+    *phKey = p;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptEncrypt(BCRYPT_KEY_HANDLE hKey, PUCHAR pbInput, ULONG cbInput, PVOID pPaddingInfo, PUCHAR pbIV, ULONG cbIV,
+    PUCHAR pbOutput, ULONG cbOutput, ULONG* pcbResult, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(pbIV);
+    UNREFERENCED_PARAMETER(cbIV);
+    UNREFERENCED_PARAMETER(dwFlags);
+    BYTE rgbJ0[16];
+    NTSTATUS status = GcmCheckArguments(hKey, cbInput, pPaddingInfo, pbOutput, cbOutput, rgbJ0);
+    if (!BCRYPT_SUCCESS(status))
+    {
+        return status;
+    }
+    *pcbResult = cbInput;
+    if (!pbOutput)
+    {
+        return STATUS_SUCCESS;
+    }
+    const KeyObject* pKey = (const KeyObject*)hKey;
+    BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO* pInfo = (BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO*)pPaddingInfo;
+    GcmCtr(pKey, rgbJ0, pbInput, pbOutput, cbInput);
+    BYTE rgbTag[16];
+    GcmTag(pKey, rgbJ0, pInfo, pbOutput, cbInput, rgbTag);
+    memcpy(pInfo->pbTag, rgbTag, pInfo->cbTag);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptDecrypt(BCRYPT_KEY_HANDLE hKey, PUCHAR pbInput, ULONG cbInput, PVOID pPaddingInfo, PUCHAR pbIV, ULONG cbIV,
+    PUCHAR pbOutput, ULONG cbOutput, ULONG* pcbResult, ULONG dwFlags)
+{
+    UNREFERENCED_PARAMETER(pbIV);
+    UNREFERENCED_PARAMETER(cbIV);
+    UNREFERENCED_PARAMETER(dwFlags);
+    BYTE rgbJ0[16];
+    NTSTATUS status = GcmCheckArguments(hKey, cbInput, pPaddingInfo, pbOutput, cbOutput, rgbJ0);
+    if (!BCRYPT_SUCCESS(status))
+    {
+        return status;
+    }
+    *pcbResult = cbInput;
+    if (!pbOutput)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    // 先验证标签再解密，验证失败时输出缓冲区不含明文
+    const KeyObject* pKey = (const KeyObject*)hKey;
+    const BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO* pInfo = (const BCRYPT_AUTHENTICATED_CIPHER_MODE_INFO*)pPaddingInfo;
+    BYTE rgbTag[16];
+    GcmTag(pKey, rgbJ0, pInfo, pbInput, cbInput, rgbTag);
+    BYTE bDiff = 0;
+    for (ULONG i = 0; i < pInfo->cbTag; i++)
+    {
+        bDiff |= rgbTag[i] ^ pInfo->pbTag[i];
+    }
+    if (bDiff)
+    {
+        *pcbResult = 0;
+        return STATUS_AUTH_TAG_MISMATCH;
+    }
+    GcmCtr(pKey, rgbJ0, pbInput, pbOutput, cbInput);
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS BCryptDestroyKey(BCRYPT_KEY_HANDLE hKey)
+{
+    KeyObject* p = (KeyObject*)hKey;
+    SecureZeroMemory(p, sizeof(*p));
+    delete p;
+    return STATUS_SUCCESS;
+}
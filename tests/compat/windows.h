@@ -0,0 +1,1095 @@
+#pragma once
+
+// 可移植测试用的 Win32 兼容层
+//
+// 只覆盖被测源文件实际用到的类型和函数，使它们在 Linux/GCC 下不经修改即可编译：
+// 锁、原子操作、SLIST、事件、线程池、计时和 CoTaskMem 有可用的实现；
+// 文件、命名管道和注册表值有进程内的实现，其余系统服务一律返回失败，被测代码按“未配置”处理。
+// 需以 -fshort-wchar 编译，使 wchar_t 与 WCHAR 一样是 16 位，L"" 字面量可直接使用。
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+#include <limits.h>
+#include <new>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if __SIZEOF_WCHAR_T__ != 2
+#error "tests/compat 需要 -fshort-wchar"
+#endif
+
+// ---------------------------------------------------------------------------
+// 基本类型
+// ---------------------------------------------------------------------------
+
+#define _WIN64 1
+#define WINAPI
+#define CALLBACK
+#define APIENTRY
+#define NTAPI
+#define WINAPIV
+#define __stdcall
+#define __cdecl
+#define IN
+#define OUT
+#define OPTIONAL
+#define CONST const
+#define VOID void
+#define FORCEINLINE inline __attribute__((always_inline))
+#define __forceinline FORCEINLINE
+#define DECLSPEC_CACHEALIGN __attribute__((aligned(64)))
+#define __declspec(x) __declspec_##x
+#define __declspec_selectany __attribute__((weak))
+#define __declspec_noinline __attribute__((noinline))
+#define __declspec_novtable
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+#define ARRAYSIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define _countof(a) ARRAYSIZE(a)
+
+typedef int BOOL;
+typedef unsigned char BOOLEAN;
+typedef unsigned char BYTE, UCHAR;
+typedef char CHAR;
+typedef short SHORT;
+typedef unsigned short WORD, USHORT;
+typedef int INT, LONG;
+typedef unsigned int UINT, DWORD, ULONG;
+typedef long long LONGLONG, LONG64, INT64;
+typedef unsigned long long ULONGLONG, ULONG64, DWORD64, UINT64;
+typedef intptr_t INT_PTR, LONG_PTR, SSIZE_T;
+typedef uintptr_t UINT_PTR, ULONG_PTR, DWORD_PTR, SIZE_T;
+typedef float FLOAT;
+typedef wchar_t WCHAR;
+typedef LONG HRESULT;
+typedef LONG NTSTATUS;
+typedef WORD LANGID;
+typedef DWORD LCID;
+
+typedef void* PVOID;
+typedef void* LPVOID;
+typedef const void* LPCVOID;
+typedef BYTE* PBYTE;
+typedef BYTE* LPBYTE;
+typedef const BYTE* PCBYTE;
+typedef BOOL* PBOOL;
+typedef DWORD* PDWORD;
+typedef DWORD* LPDWORD;
+typedef LONG* PLONG;
+typedef ULONG* PULONG;
+typedef UCHAR* PUCHAR;
+typedef USHORT* PUSHORT;
+typedef CHAR* PSTR;
+typedef CHAR* LPSTR;
+typedef const CHAR* PCSTR;
+typedef const CHAR* LPCSTR;
+typedef WCHAR* PWSTR;
+typedef WCHAR* LPWSTR;
+typedef WCHAR* PWCHAR;
+typedef const WCHAR* PCWSTR;
+typedef const WCHAR* LPCWSTR;
+typedef const WCHAR* PCWCH;
+typedef PWSTR* PZPWSTR;
+typedef PWSTR PZZWSTR;
+typedef PCWSTR PCZZWSTR;
+
+typedef void* HANDLE;
+typedef HANDLE* PHANDLE;
+typedef struct HKEY__* HKEY;
+typedef HKEY* PHKEY;
+typedef struct HINSTANCE__* HINSTANCE;
+typedef HINSTANCE HMODULE;
+typedef struct HBITMAP__* HBITMAP;
+typedef struct HWND__* HWND;
+typedef struct HRSRC__* HRSRC;
+typedef HANDLE HGLOBAL;
+typedef HANDLE HLOCAL;
+typedef PVOID PSID;
+typedef PVOID PSECURITY_DESCRIPTOR;
+typedef DWORD SECURITY_INFORMATION;
+typedef DWORD ACCESS_MASK;
+typedef DWORD REGSAM;
+typedef LONG LSTATUS;
+
+#define TRUE 1
+#define FALSE 0
+#define INVALID_HANDLE_VALUE ((HANDLE)(LONG_PTR)-1)
+#define MAXDWORD 0xffffffffu
+#define MAXLONG 0x7fffffff
+#define MAXULONG 0xffffffffu
+#define MAXSHORT 0x7fff
+#define MAXWORD 0xffff
+#define MAXBYTE 0xff
+#define MAXLONGLONG 0x7fffffffffffffffll
+#define MAXLONG64 MAXLONGLONG
+#define MAXULONGLONG 0xffffffffffffffffull
+#define MAXUSHORT 0xffff
+#define INFINITE 0xffffffffu
+#define MAX_PATH 260
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#define LOWORD(l) ((WORD)(((DWORD_PTR)(l)) & 0xffff))
+#define HIWORD(l) ((WORD)((((DWORD_PTR)(l)) >> 16) & 0xffff))
+#define LOBYTE(w) ((BYTE)(((DWORD_PTR)(w)) & 0xff))
+#define MAKEWORD(a, b) ((WORD)(((BYTE)(a)) | ((WORD)((BYTE)(b))) << 8))
+#define MAKELONG(a, b) ((LONG)(((WORD)(a)) | ((DWORD)((WORD)(b))) << 16))
+#define FIELD_OFFSET(type, field) ((LONG)offsetof(type, field))
+#define CONTAINING_RECORD(address, type, field) ((type*)((PCHAR)(address) - offsetof(type, field)))
+typedef CHAR* PCHAR;
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        DWORD LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+typedef union _ULARGE_INTEGER
+{
+    struct
+    {
+        DWORD LowPart;
+        DWORD HighPart;
+    };
+    ULONGLONG QuadPart;
+} ULARGE_INTEGER, *PULARGE_INTEGER;
+
+typedef struct _FILETIME
+{
+    DWORD dwLowDateTime;
+    DWORD dwHighDateTime;
+} FILETIME, *PFILETIME, *LPFILETIME;
+
+typedef struct _SYSTEMTIME
+{
+    WORD wYear;
+    WORD wMonth;
+    WORD wDayOfWeek;
+    WORD wDay;
+    WORD wHour;
+    WORD wMinute;
+    WORD wSecond;
+    WORD wMilliseconds;
+} SYSTEMTIME, *PSYSTEMTIME, *LPSYSTEMTIME;
+
+typedef struct _GUID
+{
+    DWORD Data1;
+    WORD Data2;
+    WORD Data3;
+    BYTE Data4[8];
+} GUID;
+typedef GUID IID;
+typedef GUID CLSID;
+typedef const GUID& REFGUID;
+typedef const IID& REFIID;
+typedef const CLSID& REFCLSID;
+
+inline bool operator==(const GUID& a, const GUID& b) { return memcmp(&a, &b, sizeof(GUID)) == 0; }
+inline bool operator!=(const GUID& a, const GUID& b) { return !(a == b); }
+inline BOOL IsEqualGUID(REFGUID a, REFGUID b) { return a == b; }
+#define IsEqualIID(a, b) IsEqualGUID(a, b)
+#define IsEqualCLSID(a, b) IsEqualGUID(a, b)
+
+// ---------------------------------------------------------------------------
+// 错误码
+// ---------------------------------------------------------------------------
+
+#define S_OK ((HRESULT)0)
+#define S_FALSE ((HRESULT)1)
+#define E_NOTIMPL ((HRESULT)0x80004001)
+#define E_NOINTERFACE ((HRESULT)0x80004002)
+#define E_POINTER ((HRESULT)0x80004003)
+#define E_ABORT ((HRESULT)0x80004004)
+#define E_PENDING ((HRESULT)0x8000000A)
+#define E_BOUNDS ((HRESULT)0x8000000B)
+#define E_CHANGED_STATE ((HRESULT)0x8000000C)
+#define E_FAIL ((HRESULT)0x80004005)
+#define E_UNEXPECTED ((HRESULT)0x8000FFFF)
+#define E_ACCESSDENIED ((HRESULT)0x80070005)
+#define E_HANDLE ((HRESULT)0x80070006)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000E)
+#define E_INVALIDARG ((HRESULT)0x80070057)
+#define E_NOT_SUFFICIENT_BUFFER ((HRESULT)0x8007007A)
+#define E_NOT_VALID_STATE ((HRESULT)0x8007139F)
+#define CLASS_E_NOAGGREGATION ((HRESULT)0x80040110)
+#define CLASS_E_CLASSNOTAVAILABLE ((HRESULT)0x80040111)
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+#define HRESULT_CODE(hr) ((hr) & 0xFFFF)
+#define HRESULT_FACILITY(hr) (((hr) >> 16) & 0x1fff)
+#define FACILITY_WIN32 7
+#define FACILITY_NT_BIT 0x10000000
+#define HRESULT_FROM_NT(x) ((HRESULT)((x) | FACILITY_NT_BIT))
+#define FACILITY_ITF 4
+#define SEVERITY_ERROR 1
+#define MAKE_HRESULT(sev, fac, code) ((HRESULT)(((unsigned long)(sev) << 31) | ((unsigned long)(fac) << 16) | ((unsigned long)(code))))
+
+inline HRESULT HRESULT_FROM_WIN32(unsigned long x)
+{
+    return (HRESULT)(x) <= 0 ? (HRESULT)(x) : (HRESULT)(((x) & 0x0000FFFF) | (FACILITY_WIN32 << 16) | 0x80000000);
+}
+
+#define NO_ERROR 0L
+#define ERROR_SUCCESS 0L
+#define ERROR_INVALID_FUNCTION 1L
+#define ERROR_FILE_NOT_FOUND 2L
+#define ERROR_PATH_NOT_FOUND 3L
+#define ERROR_ACCESS_DENIED 5L
+#define ERROR_INVALID_HANDLE 6L
+#define ERROR_NOT_ENOUGH_MEMORY 8L
+#define ERROR_BAD_FORMAT 11L
+#define ERROR_INVALID_DATA 13L
+#define ERROR_OUTOFMEMORY 14L
+#define ERROR_NOT_READY 21L
+#define ERROR_CRC 23L
+#define ERROR_READ_FAULT 30L
+#define ERROR_BAD_LENGTH 24L
+#define ERROR_SHARING_VIOLATION 32L
+#define ERROR_HANDLE_EOF 38L
+#define ERROR_NOT_SUPPORTED 50L
+#define ERROR_FILE_EXISTS 80L
+#define ERROR_INVALID_PARAMETER 87L
+#define ERROR_BROKEN_PIPE 109L
+#define ERROR_BUFFER_OVERFLOW 111L
+#define ERROR_DISK_FULL 112L
+#define ERROR_INSUFFICIENT_BUFFER 122L
+#define ERROR_INVALID_NAME 123L
+#define ERROR_NEGATIVE_SEEK 131L
+#define ERROR_NOT_LOCKED 158L
+#define ERROR_BUSY 170L
+#define ERROR_ALREADY_EXISTS 183L
+#define ERROR_FILE_TOO_LARGE 223L
+#define ERROR_PIPE_BUSY 231L
+#define ERROR_NO_DATA 232L
+#define ERROR_PIPE_NOT_CONNECTED 233L
+#define ERROR_MORE_DATA 234L
+#define ERROR_NO_MORE_ITEMS 259L
+#define ERROR_INVALID_ADDRESS 487L
+#define ERROR_ARITHMETIC_OVERFLOW 534L
+#define ERROR_PIPE_CONNECTED 535L
+#define ERROR_OPERATION_ABORTED 995L
+#define ERROR_IO_INCOMPLETE 996L
+#define ERROR_IO_PENDING 997L
+#define ERROR_FILE_INVALID 1006L
+#define ERROR_NO_TOKEN 1008L
+#define ERROR_NO_UNICODE_TRANSLATION 1113L
+#define ERROR_NOT_FOUND 1168L
+#define ERROR_CANCELLED 1223L
+#define ERROR_REQUEST_ABORTED 1235L
+#define ERROR_RETRY 1237L
+#define ERROR_ACCESS_DISABLED_BY_POLICY 1260L
+#define ERROR_REVISION_MISMATCH 1306L
+#define ERROR_INVALID_OWNER 1307L
+#define ERROR_NO_SUCH_USER 1317L
+#define ERROR_LOGON_FAILURE 1326L
+#define ERROR_PASSWORD_EXPIRED 1330L
+#define ERROR_ACCOUNT_DISABLED 1331L
+#define ERROR_NONE_MAPPED 1332L
+#define ERROR_INVALID_SID 1337L
+#define ERROR_INTERNAL_ERROR 1359L
+#define ERROR_FILE_CORRUPT 1392L
+#define ERROR_WORKING_SET_QUOTA 1453L
+#define ERROR_TIMEOUT 1460L
+#define ERROR_UNSUPPORTED_TYPE 1630L
+#define ERROR_RESOURCE_DATA_NOT_FOUND 1812L
+#define ERROR_RESOURCE_TYPE_NOT_FOUND 1813L
+#define ERROR_RESOURCE_NAME_NOT_FOUND 1814L
+#define ERROR_RESOURCE_LANG_NOT_FOUND 1815L
+#define ERROR_ACCOUNT_LOCKED_OUT 1909L
+#define ERROR_INVALID_STATE 5023L
+#define ERROR_DECRYPTION_FAILED 6000L
+
+#define STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+
+// ---------------------------------------------------------------------------
+// 字符串：GCC 的 <wchar.h> 函数按 32 位 wchar_t 实现，这里换成 16 位版本
+// ---------------------------------------------------------------------------
+
+namespace wincompat
+{
+    inline size_t wcslen(const wchar_t* psz)
+    {
+        const wchar_t* p = psz;
+        while (*p)
+            p++;
+        return (size_t)(p - psz);
+    }
+
+    inline size_t wcsnlen(const wchar_t* psz, size_t cchMax)
+    {
+        size_t cch = 0;
+        while (cch < cchMax && psz[cch])
+            cch++;
+        return cch;
+    }
+
+    inline int wcsncmp(const wchar_t* a, const wchar_t* b, size_t n)
+    {
+        for (; n; n--, a++, b++)
+        {
+            if (*a != *b)
+                return (unsigned short)*a < (unsigned short)*b ? -1 : 1;
+            if (!*a)
+                return 0;
+        }
+        return 0;
+    }
+
+    inline int wcscmp(const wchar_t* a, const wchar_t* b) { return wincompat::wcsncmp(a, b, (size_t)-1); }
+
+    inline wchar_t lower(wchar_t ch) { return (ch >= L'A' && ch <= L'Z') ? (wchar_t)(ch + (L'a' - L'A')) : ch; }
+
+    inline int wcsnicmp(const wchar_t* a, const wchar_t* b, size_t n)
+    {
+        for (; n; n--, a++, b++)
+        {
+            wchar_t ca = lower(*a);
+            wchar_t cb = lower(*b);
+            if (ca != cb)
+                return (unsigned short)ca < (unsigned short)cb ? -1 : 1;
+            if (!ca)
+                return 0;
+        }
+        return 0;
+    }
+
+    inline int wcsicmp(const wchar_t* a, const wchar_t* b) { return wincompat::wcsnicmp(a, b, (size_t)-1); }
+
+    inline int wmemcmp(const wchar_t* a, const wchar_t* b, size_t n)
+    {
+        for (; n; n--, a++, b++)
+        {
+            if (*a != *b)
+                return (unsigned short)*a < (unsigned short)*b ? -1 : 1;
+        }
+        return 0;
+    }
+
+    inline wchar_t* wmemcpy(wchar_t* d, const wchar_t* s, size_t n) { return (wchar_t*)memcpy(d, s, n * sizeof(wchar_t)); }
+    inline wchar_t* wmemmove(wchar_t* d, const wchar_t* s, size_t n) { return (wchar_t*)memmove(d, s, n * sizeof(wchar_t)); }
+
+    inline wchar_t* wmemset(wchar_t* d, wchar_t ch, size_t n)
+    {
+        for (size_t i = 0; i < n; i++)
+            d[i] = ch;
+        return d;
+    }
+
+    inline const wchar_t* wcschr(const wchar_t* psz, wchar_t ch)
+    {
+        for (;; psz++)
+        {
+            if (*psz == ch)
+                return psz;
+            if (!*psz)
+                return nullptr;
+        }
+    }
+
+    inline const wchar_t* wcsrchr(const wchar_t* psz, wchar_t ch)
+    {
+        const wchar_t* pLast = nullptr;
+        for (;; psz++)
+        {
+            if (*psz == ch)
+                pLast = psz;
+            if (!*psz)
+                return pLast;
+        }
+    }
+
+    inline int towlower(int ch) { return lower((wchar_t)ch); }
+    inline int towupper(int ch) { return (ch >= L'a' && ch <= L'z') ? ch - (L'a' - L'A') : ch; }
+    inline int iswspace(int ch) { return ch == L' ' || (ch >= L'\t' && ch <= L'\r'); }
+    inline int iswdigit(int ch) { return ch >= L'0' && ch <= L'9'; }
+}
+
+#define wcslen wincompat::wcslen
+#define wcsnlen wincompat::wcsnlen
+#define wcscmp wincompat::wcscmp
+#define wcsncmp wincompat::wcsncmp
+#define _wcsicmp wincompat::wcsicmp
+#define _wcsnicmp wincompat::wcsnicmp
+#define wmemcmp wincompat::wmemcmp
+#define wmemcpy wincompat::wmemcpy
+#define wmemmove wincompat::wmemmove
+#define wmemset wincompat::wmemset
+#define wcschr wincompat::wcschr
+#define wcsrchr wincompat::wcsrchr
+#define towlower wincompat::towlower
+#define towupper wincompat::towupper
+#define iswspace wincompat::iswspace
+#define iswdigit wincompat::iswdigit
+
+#define lstrlenW(psz) ((int)wcslen(psz))
+
+// ---------------------------------------------------------------------------
+// 内存
+// ---------------------------------------------------------------------------
+
+#define ZeroMemory(p, cb) memset((p), 0, (cb))
+#define RtlZeroMemory ZeroMemory
+#define FillMemory(p, cb, v) memset((p), (v), (cb))
+#define CopyMemory(d, s, cb) memcpy((d), (s), (cb))
+#define MoveMemory(d, s, cb) memmove((d), (s), (cb))
+
+inline PVOID SecureZeroMemory(PVOID p, SIZE_T cb)
+{
+    volatile BYTE* pb = (volatile BYTE*)p;
+    while (cb--)
+        *pb++ = 0;
+    return p;
+}
+
+#define HEAP_ZERO_MEMORY 0x00000008
+inline HANDLE GetProcessHeap() { return (HANDLE)1; }
+inline LPVOID HeapAlloc(HANDLE, DWORD dwFlags, SIZE_T cb) { return (dwFlags & HEAP_ZERO_MEMORY) ? calloc(1, cb ? cb : 1) : malloc(cb ? cb : 1); }
+inline LPVOID HeapReAlloc(HANDLE, DWORD, LPVOID p, SIZE_T cb) { return realloc(p, cb); }
+inline BOOL HeapFree(HANDLE, DWORD, LPVOID p) { free(p); return TRUE; }
+
+inline HLOCAL LocalFree(HLOCAL h) { free(h); return nullptr; }
+
+#define MEM_COMMIT 0x00001000
+#define MEM_RESERVE 0x00002000
+#define MEM_RELEASE 0x00008000
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+
+LPVOID VirtualAlloc(LPVOID pv, SIZE_T cb, DWORD flAllocationType, DWORD flProtect);
+BOOL VirtualFree(LPVOID pv, SIZE_T cb, DWORD dwFreeType);
+// 以 mlock / munlock 实现；超出 RLIMIT_MEMLOCK 时与 Windows 超出工作集配额相同，以 ERROR_WORKING_SET_QUOTA 失败
+BOOL VirtualLock(LPVOID pv, SIZE_T cb);
+BOOL VirtualUnlock(LPVOID pv, SIZE_T cb);
+
+// dwError 不为 ERROR_SUCCESS 时，之后的 VirtualLock 以该错误失败
+void WinCompatSetVirtualLockError(DWORD dwError);
+// 进程当前锁定在物理内存中的字节数（/proc/self/status 中的 VmLck）
+SIZE_T WinCompatGetLockedBytes();
+
+typedef struct _SYSTEM_INFO
+{
+    WORD wProcessorArchitecture;
+    WORD wReserved;
+    DWORD dwPageSize;
+    LPVOID lpMinimumApplicationAddress;
+    LPVOID lpMaximumApplicationAddress;
+    DWORD_PTR dwActiveProcessorMask;
+    DWORD dwNumberOfProcessors;
+    DWORD dwProcessorType;
+    DWORD dwAllocationGranularity;
+    WORD wProcessorLevel;
+    WORD wProcessorRevision;
+} SYSTEM_INFO, *LPSYSTEM_INFO;
+
+void GetSystemInfo(LPSYSTEM_INFO pInfo);
+
+// ---------------------------------------------------------------------------
+// 原子操作
+// ---------------------------------------------------------------------------
+
+#define MemoryBarrier() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define YieldProcessor() __builtin_ia32_pause()
+
+inline LONG InterlockedIncrement(LONG volatile* p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedDecrement(LONG volatile* p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchange(LONG volatile* p, LONG v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedExchangeAdd(LONG volatile* p, LONG v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedAdd(LONG volatile* p, LONG v) { return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedOr(LONG volatile* p, LONG v) { return __atomic_fetch_or(p, v, __ATOMIC_SEQ_CST); }
+inline LONG InterlockedAnd(LONG volatile* p, LONG v) { return __atomic_fetch_and(p, v, __ATOMIC_SEQ_CST); }
+
+inline LONG InterlockedCompareExchange(LONG volatile* p, LONG v, LONG cmp)
+{
+    __atomic_compare_exchange_n(p, &cmp, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return cmp;
+}
+
+inline LONG64 InterlockedIncrement64(LONG64 volatile* p) { return __atomic_add_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedDecrement64(LONG64 volatile* p) { return __atomic_sub_fetch(p, 1, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchange64(LONG64 volatile* p, LONG64 v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedExchangeAdd64(LONG64 volatile* p, LONG64 v) { return __atomic_fetch_add(p, v, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedAdd64(LONG64 volatile* p, LONG64 v) { return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST); }
+inline LONG64 InterlockedOr64(LONG64 volatile* p, LONG64 v) { return __atomic_fetch_or(p, v, __ATOMIC_SEQ_CST); }
+
+inline LONG64 InterlockedCompareExchange64(LONG64 volatile* p, LONG64 v, LONG64 cmp)
+{
+    __atomic_compare_exchange_n(p, &cmp, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return cmp;
+}
+
+inline PVOID InterlockedExchangePointer(PVOID volatile* p, PVOID v) { return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST); }
+
+inline PVOID InterlockedCompareExchangePointer(PVOID volatile* p, PVOID v, PVOID cmp)
+{
+    __atomic_compare_exchange_n(p, &cmp, v, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return cmp;
+}
+
+inline LONG ReadAcquire(LONG const volatile* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline LONG ReadNoFence(LONG const volatile* p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+inline LONG64 ReadAcquire64(LONG64 const volatile* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline LONG64 ReadNoFence64(LONG64 const volatile* p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+inline PVOID ReadPointerAcquire(PVOID const volatile* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+inline PVOID ReadPointerNoFence(PVOID const volatile* p) { return __atomic_load_n(p, __ATOMIC_RELAXED); }
+inline void WriteRelease(LONG volatile* p, LONG v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+inline void WriteNoFence(LONG volatile* p, LONG v) { __atomic_store_n(p, v, __ATOMIC_RELAXED); }
+inline void WriteRelease64(LONG64 volatile* p, LONG64 v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+inline void WriteNoFence64(LONG64 volatile* p, LONG64 v) { __atomic_store_n(p, v, __ATOMIC_RELAXED); }
+inline void WritePointerRelease(PVOID volatile* p, PVOID v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+
+inline BOOLEAN BitScanReverse(DWORD* pIndex, DWORD dwMask)
+{
+    if (!dwMask)
+        return FALSE;
+    *pIndex = 31 - __builtin_clz(dwMask);
+    return TRUE;
+}
+
+inline BOOLEAN BitScanForward(DWORD* pIndex, DWORD dwMask)
+{
+    if (!dwMask)
+        return FALSE;
+    *pIndex = __builtin_ctz(dwMask);
+    return TRUE;
+}
+
+// ---------------------------------------------------------------------------
+// SRW 锁：state 为 -1 表示独占，正数为共享持有者个数
+// ---------------------------------------------------------------------------
+
+typedef struct _RTL_SRWLOCK
+{
+    PVOID Ptr;
+} SRWLOCK, *PSRWLOCK;
+
+#define SRWLOCK_INIT { nullptr }
+
+inline void InitializeSRWLock(PSRWLOCK p) { p->Ptr = nullptr; }
+void AcquireSRWLockExclusive(PSRWLOCK p);
+void AcquireSRWLockShared(PSRWLOCK p);
+BOOLEAN TryAcquireSRWLockExclusive(PSRWLOCK p);
+BOOLEAN TryAcquireSRWLockShared(PSRWLOCK p);
+void ReleaseSRWLockExclusive(PSRWLOCK p);
+void ReleaseSRWLockShared(PSRWLOCK p);
+
+typedef struct _RTL_CRITICAL_SECTION
+{
+    SRWLOCK lock;
+} CRITICAL_SECTION, *LPCRITICAL_SECTION;
+
+inline void InitializeCriticalSection(LPCRITICAL_SECTION p) { InitializeSRWLock(&p->lock); }
+inline void DeleteCriticalSection(LPCRITICAL_SECTION) {}
+inline void EnterCriticalSection(LPCRITICAL_SECTION p) { AcquireSRWLockExclusive(&p->lock); }
+inline void LeaveCriticalSection(LPCRITICAL_SECTION p) { ReleaseSRWLockExclusive(&p->lock); }
+
+// ---------------------------------------------------------------------------
+// SLIST：用自旋锁保护的单链表实现，语义（后进先出、批量取出）与系统版本一致
+// ---------------------------------------------------------------------------
+
+#define MEMORY_ALLOCATION_ALIGNMENT 16
+
+typedef struct _SLIST_ENTRY
+{
+    struct _SLIST_ENTRY* Next;
+} __attribute__((aligned(16))) SLIST_ENTRY, *PSLIST_ENTRY;
+
+typedef struct _SLIST_HEADER
+{
+    PSLIST_ENTRY Next;
+    LONG lLock;
+    USHORT Depth;
+} __attribute__((aligned(16))) SLIST_HEADER, *PSLIST_HEADER;
+
+inline void InitializeSListHead(PSLIST_HEADER p)
+{
+    p->Next = nullptr;
+    p->lLock = 0;
+    p->Depth = 0;
+}
+
+PSLIST_ENTRY InterlockedPushEntrySList(PSLIST_HEADER p, PSLIST_ENTRY pEntry);
+PSLIST_ENTRY InterlockedPopEntrySList(PSLIST_HEADER p);
+PSLIST_ENTRY InterlockedFlushSList(PSLIST_HEADER p);
+USHORT QueryDepthSList(PSLIST_HEADER p);
+
+// ---------------------------------------------------------------------------
+// 一次性初始化
+// ---------------------------------------------------------------------------
+
+typedef union _RTL_RUN_ONCE
+{
+    PVOID Ptr;
+} INIT_ONCE, *PINIT_ONCE, *LPINIT_ONCE;
+
+#define INIT_ONCE_STATIC_INIT { nullptr }
+
+typedef BOOL (CALLBACK* PINIT_ONCE_FN)(PINIT_ONCE InitOnce, PVOID Parameter, PVOID* Context);
+BOOL InitOnceExecuteOnce(PINIT_ONCE pInitOnce, PINIT_ONCE_FN pfnInit, PVOID pvParameter, LPVOID* ppvContext);
+
+// ---------------------------------------------------------------------------
+// 事件、等待和线程
+// ---------------------------------------------------------------------------
+
+#define WAIT_OBJECT_0 0x00000000u
+#define WAIT_ABANDONED 0x00000080u
+#define WAIT_TIMEOUT 0x00000102u
+#define WAIT_FAILED 0xFFFFFFFFu
+#define STILL_ACTIVE 259
+
+typedef struct _SECURITY_ATTRIBUTES
+{
+    DWORD nLength;
+    LPVOID lpSecurityDescriptor;
+    BOOL bInheritHandle;
+} SECURITY_ATTRIBUTES, *PSECURITY_ATTRIBUTES, *LPSECURITY_ATTRIBUTES;
+
+HANDLE CreateEventW(LPSECURITY_ATTRIBUTES psa, BOOL fManualReset, BOOL fInitialState, LPCWSTR pszName);
+inline HANDLE OpenEventW(DWORD, BOOL, LPCWSTR) { return nullptr; }
+BOOL SetEvent(HANDLE h);
+BOOL ResetEvent(HANDLE h);
+DWORD WaitForSingleObject(HANDLE h, DWORD dwMilliseconds);
+DWORD WaitForMultipleObjects(DWORD cHandles, const HANDLE* rgh, BOOL fWaitAll, DWORD dwMilliseconds);
+BOOL CloseHandle(HANDLE h);
+
+typedef DWORD (WINAPI* LPTHREAD_START_ROUTINE)(LPVOID pvParameter);
+HANDLE CreateThread(LPSECURITY_ATTRIBUTES psa, SIZE_T cbStack, LPTHREAD_START_ROUTINE pfn, LPVOID pv, DWORD dwFlags, LPDWORD pdwThreadId);
+
+void Sleep(DWORD dwMilliseconds);
+BOOL SwitchToThread();
+DWORD GetCurrentThreadId();
+DWORD GetCurrentProcessId();
+inline BOOL ProcessIdToSessionId(DWORD, DWORD* pdwSessionId) { *pdwSessionId = 1; return TRUE; }
+
+// 计算机名固定为 WINUNLOCK-TEST
+#define MAX_COMPUTERNAME_LENGTH 15
+BOOL GetComputerNameW(LPWSTR pszBuffer, LPDWORD pcchBuffer);
+
+// 线程最近一次错误（被测代码只在失败路径上读取）
+DWORD GetLastError();
+void SetLastError(DWORD dwError);
+
+// ---------------------------------------------------------------------------
+// 线程池：每个回调一个分离线程，足以验证回调语义
+// ---------------------------------------------------------------------------
+
+typedef struct _TP_CALLBACK_INSTANCE TP_CALLBACK_INSTANCE, *PTP_CALLBACK_INSTANCE;
+typedef struct _TP_POOL TP_POOL, *PTP_POOL;
+typedef struct _TP_CLEANUP_GROUP TP_CLEANUP_GROUP, *PTP_CLEANUP_GROUP;
+typedef struct _TP_TIMER TP_TIMER, *PTP_TIMER;
+typedef struct _TP_WORK TP_WORK, *PTP_WORK;
+typedef struct _TP_WAIT TP_WAIT, *PTP_WAIT;
+typedef struct _TP_IO TP_IO, *PTP_IO;
+typedef DWORD TP_WAIT_RESULT;
+
+typedef struct _TP_CALLBACK_ENVIRON
+{
+    PTP_POOL Pool;
+    PVOID RaceDll;
+} TP_CALLBACK_ENVIRON, *PTP_CALLBACK_ENVIRON;
+
+typedef void (CALLBACK* PTP_SIMPLE_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context);
+typedef void (CALLBACK* PTP_TIMER_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_TIMER Timer);
+typedef void (CALLBACK* PTP_WORK_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WORK Work);
+typedef void (CALLBACK* PTP_WAIT_CALLBACK)(PTP_CALLBACK_INSTANCE Instance, PVOID Context, PTP_WAIT Wait, TP_WAIT_RESULT WaitResult);
+
+inline void InitializeThreadpoolEnvironment(PTP_CALLBACK_ENVIRON p) { p->Pool = nullptr; p->RaceDll = nullptr; }
+inline void DestroyThreadpoolEnvironment(PTP_CALLBACK_ENVIRON) {}
+inline void SetThreadpoolCallbackLibrary(PTP_CALLBACK_ENVIRON p, PVOID mod) { p->RaceDll = mod; }
+inline void SetThreadpoolCallbackRunsLong(PTP_CALLBACK_ENVIRON) {}
+BOOL TrySubmitThreadpoolCallback(PTP_SIMPLE_CALLBACK pfn, PVOID pv, PTP_CALLBACK_ENVIRON pcbe);
+
+// 工作对象：每次提交一个线程，回调可以并行执行；Close 之后对象在最后一个回调返回时释放
+PTP_WORK CreateThreadpoolWork(PTP_WORK_CALLBACK pfnwk, PVOID pv, PTP_CALLBACK_ENVIRON pcbe);
+void SubmitThreadpoolWork(PTP_WORK pwk);
+void WaitForThreadpoolWorkCallbacks(PTP_WORK pwk, BOOL fCancelPendingCallbacks);
+void CloseThreadpoolWork(PTP_WORK pwk);
+
+// 等待和计时器对象：每个对象一个专用线程，回调在该线程上串行执行。
+// pftTimeout/pftDueTime 为负数时是相对时间，否则是绝对时间（与 GetSystemTimeAsFileTime 比较）；
+// 设置新的等待对象或撤销后，不再等待原对象；Close 须在回调之外调用
+PTP_WAIT CreateThreadpoolWait(PTP_WAIT_CALLBACK pfnwa, PVOID pv, PTP_CALLBACK_ENVIRON pcbe);
+void SetThreadpoolWait(PTP_WAIT pwa, HANDLE h, PFILETIME pftTimeout);
+void WaitForThreadpoolWaitCallbacks(PTP_WAIT pwa, BOOL fCancelPendingCallbacks);
+void CloseThreadpoolWait(PTP_WAIT pwa);
+PTP_TIMER CreateThreadpoolTimer(PTP_TIMER_CALLBACK pfnti, PVOID pv, PTP_CALLBACK_ENVIRON pcbe);
+void SetThreadpoolTimer(PTP_TIMER pti, PFILETIME pftDueTime, DWORD msPeriod, DWORD msWindowLength);
+BOOL IsThreadpoolTimerSet(PTP_TIMER pti);
+void WaitForThreadpoolTimerCallbacks(PTP_TIMER pti, BOOL fCancelPendingCallbacks);
+void CloseThreadpoolTimer(PTP_TIMER pti);
+
+// 等待注册：每个注册一个专用线程，回调在该线程上串行执行
+#define WT_EXECUTEDEFAULT 0x00000000
+#define WT_EXECUTEONLYONCE 0x00000008
+#define WT_EXECUTELONGFUNCTION 0x00000010
+typedef void (CALLBACK* WAITORTIMERCALLBACK)(PVOID pvContext, BOOLEAN fTimedOut);
+BOOL RegisterWaitForSingleObject(PHANDLE phNewWaitObject, HANDLE hObject, WAITORTIMERCALLBACK pfn, PVOID pvContext, ULONG dwMilliseconds, ULONG dwFlags);
+// hCompletionEvent 为 INVALID_HANDLE_VALUE 时等待正在执行的回调结束
+BOOL UnregisterWaitEx(HANDLE hWaitHandle, HANDLE hCompletionEvent);
+
+// ---------------------------------------------------------------------------
+// 计时
+// ---------------------------------------------------------------------------
+
+ULONGLONG GetTickCount64();
+inline DWORD GetTickCount() { return (DWORD)GetTickCount64(); }
+BOOL QueryPerformanceCounter(LARGE_INTEGER* pli);
+BOOL QueryPerformanceFrequency(LARGE_INTEGER* pli);
+void GetLocalTime(LPSYSTEMTIME pst);
+void GetSystemTime(LPSYSTEMTIME pst);
+void GetSystemTimeAsFileTime(LPFILETIME pft);
+#define GetSystemTimePreciseAsFileTime GetSystemTimeAsFileTime
+
+inline LONG CompareFileTime(const FILETIME* a, const FILETIME* b)
+{
+    ULONGLONG ullA = ((ULONGLONG)a->dwHighDateTime << 32) | a->dwLowDateTime;
+    ULONGLONG ullB = ((ULONGLONG)b->dwHighDateTime << 32) | b->dwLowDateTime;
+    return ullA < ullB ? -1 : (ullA > ullB ? 1 : 0);
+}
+
+// 测试可以把本地时间固定在某一时刻，0 表示使用真实时间
+void WinCompatSetLocalTime(const SYSTEMTIME* pst);
+
+// ---------------------------------------------------------------------------
+// 资源：测试通过 WinCompatSetStringResource 注册 RT_STRING 块
+// ---------------------------------------------------------------------------
+
+#define MAKEINTRESOURCEW(i) ((LPWSTR)((ULONG_PTR)((WORD)(i))))
+#define IS_INTRESOURCE(p) ((((ULONG_PTR)(p)) >> 16) == 0)
+#define RT_STRING MAKEINTRESOURCEW(6)
+#define RT_BITMAP MAKEINTRESOURCEW(2)
+#define RT_RCDATA MAKEINTRESOURCEW(10)
+
+#define LANG_NEUTRAL 0x00
+#define LANG_CHINESE 0x04
+#define LANG_ENGLISH 0x09
+#define LANG_JAPANESE 0x11
+#define LANG_CHINESE_SIMPLIFIED 0x04
+#define LANG_CHINESE_TRADITIONAL 0x7c04
+#define SUBLANG_NEUTRAL 0x00
+#define SUBLANG_DEFAULT 0x01
+#define SUBLANG_SYS_DEFAULT 0x02
+#define SUBLANG_CHINESE_TRADITIONAL 0x01
+#define SUBLANG_CHINESE_SIMPLIFIED 0x02
+#define SUBLANG_CHINESE_HONGKONG 0x03
+#define SUBLANG_ENGLISH_US 0x01
+#define SUBLANG_ENGLISH_UK 0x02
+#define MAKELANGID(p, s) ((WORD)((((WORD)(s)) << 10) | (WORD)(p)))
+#define PRIMARYLANGID(lgid) ((WORD)(lgid) & 0x3ff)
+#define SUBLANGID(lgid) ((WORD)(lgid) >> 10)
+
+// 用户界面语言固定为简体中文（字符串表的默认语言）
+inline LANGID GetUserDefaultUILanguage() { return MAKELANGID(LANG_CHINESE, SUBLANG_CHINESE_SIMPLIFIED); }
+
+HRSRC FindResourceExW(HMODULE hModule, LPCWSTR pszType, LPCWSTR pszName, WORD wLanguage);
+HGLOBAL LoadResource(HMODULE hModule, HRSRC hResInfo);
+LPVOID LockResource(HGLOBAL hResData);
+DWORD SizeofResource(HMODULE hModule, HRSRC hResInfo);
+
+// pv 指向 16 个 [WORD 长度][字符] 组成的字符串块，调用方保证在测试期间有效
+void WinCompatSetStringResource(WORD wBlock, WORD wLanguage, const void* pv, DWORD cb);
+void WinCompatClearResources();
+
+// ---------------------------------------------------------------------------
+// 注册表：只有测试通过 WinCompatSetRegistryValue 写入的值，由 RegOpenKeyExW/RegGetValueW 读取；
+// 其下有值的键才存在，变更通知只支持异步的值写入通知，子键枚举一律返回失败
+// ---------------------------------------------------------------------------
+
+#define HKEY_CLASSES_ROOT ((HKEY)(ULONG_PTR)((LONG)0x80000000))
+#define HKEY_CURRENT_USER ((HKEY)(ULONG_PTR)((LONG)0x80000001))
+#define HKEY_LOCAL_MACHINE ((HKEY)(ULONG_PTR)((LONG)0x80000002))
+#define HKEY_USERS ((HKEY)(ULONG_PTR)((LONG)0x80000003))
+
+#define KEY_QUERY_VALUE 0x0001
+#define KEY_SET_VALUE 0x0002
+#define KEY_ENUMERATE_SUB_KEYS 0x0008
+#define KEY_NOTIFY 0x0010
+#define KEY_READ 0x20019
+#define KEY_WRITE 0x20006
+#define KEY_WOW64_64KEY 0x0100
+
+#define REG_NONE 0
+#define REG_SZ 1
+#define REG_EXPAND_SZ 2
+#define REG_BINARY 3
+#define REG_DWORD 4
+#define REG_MULTI_SZ 7
+#define REG_QWORD 11
+
+#define RRF_RT_REG_NONE 0x00000001
+#define RRF_RT_REG_SZ 0x00000002
+#define RRF_RT_REG_EXPAND_SZ 0x00000004
+#define RRF_RT_REG_BINARY 0x00000008
+#define RRF_RT_REG_DWORD 0x00000010
+#define RRF_RT_REG_MULTI_SZ 0x00000020
+#define RRF_RT_REG_QWORD 0x00000040
+#define RRF_RT_DWORD (RRF_RT_REG_BINARY | RRF_RT_REG_DWORD)
+#define RRF_RT_QWORD (RRF_RT_REG_BINARY | RRF_RT_REG_QWORD)
+#define RRF_RT_ANY 0x0000ffff
+#define RRF_NOEXPAND 0x10000000
+#define RRF_ZEROONFAILURE 0x20000000
+
+#define REG_NOTIFY_CHANGE_NAME 0x00000001
+#define REG_NOTIFY_CHANGE_LAST_SET 0x00000004
+#define REG_NOTIFY_THREAD_AGNOSTIC 0x10000000
+
+LSTATUS RegGetValueW(HKEY hkey, LPCWSTR pszSubKey, LPCWSTR pszValue, DWORD dwFlags, LPDWORD pdwType, PVOID pvData, LPDWORD pcbData);
+LSTATUS RegOpenKeyExW(HKEY hkey, LPCWSTR pszSubKey, DWORD dwOptions, REGSAM samDesired, PHKEY phkResult);
+LSTATUS RegCloseKey(HKEY hkey);
+// 与 RegGetValueW 读取同一份值，不检查类型
+inline LSTATUS RegQueryValueExW(HKEY hkey, LPCWSTR pszValue, LPDWORD, LPDWORD pdwType, LPBYTE pbData, LPDWORD pcbData)
+{
+    return RegGetValueW(hkey, nullptr, pszValue, RRF_RT_ANY, pdwType, pbData, pcbData);
+}
+inline LSTATUS RegEnumKeyExW(HKEY, DWORD, LPWSTR, LPDWORD, LPDWORD, LPWSTR, LPDWORD, PFILETIME) { return ERROR_NO_MORE_ITEMS; }
+// 键（fWatchSubtree 时含子键）下的值被写入或删除时触发 hEvent，只触发一次；关闭键时撤销
+LSTATUS RegNotifyChangeKeyValue(HKEY hkey, BOOL fWatchSubtree, DWORD dwNotifyFilter, HANDLE hEvent, BOOL fAsynchronous);
+
+// 写入 hkey\pszSubKey 下的值（键名和值名不区分大小写），pv 为 nullptr 时删除该值；与配置工具保存一样触发变更通知
+void WinCompatSetRegistryValue(HKEY hkey, LPCWSTR pszSubKey, LPCWSTR pszValue, DWORD dwType, const void* pv, DWORD cb);
+// 删除全部注册表值
+void WinCompatClearRegistry();
+
+// 账户名：测试环境没有登录会话
+inline BOOL GetUserNameW(LPWSTR, LPDWORD)
+{
+    SetLastError(ERROR_NOT_SUPPORTED);
+    return FALSE;
+}
+
+// ---------------------------------------------------------------------------
+// 模块
+// ---------------------------------------------------------------------------
+
+#define GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS 0x00000004
+#define GET_MODULE_HANDLE_EX_FLAG_PIN 0x00000001
+#define GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT 0x00000002
+inline BOOL GetModuleHandleExW(DWORD, LPCWSTR, HMODULE* phModule) { *phModule = nullptr; return FALSE; }
+inline BOOL DisableThreadLibraryCalls(HMODULE) { return TRUE; }
+
+#define DLL_PROCESS_ATTACH 1
+#define DLL_THREAD_ATTACH 2
+#define DLL_THREAD_DETACH 3
+#define DLL_PROCESS_DETACH 0
+
+// ---------------------------------------------------------------------------
+// 文件：进程内的内存文件系统，路径不区分大小写，不检查目录和共享方式；
+// WinCompatSetFileError 让后续的打开和写入以指定错误失败，模拟磁盘故障。
+// 文件的只读映射是创建映射时内容的快照；不以文件为后备的命名区段为 POSIX 共享内存对象，
+// fork 出的子进程能打开父进程创建的区段，创建方退出时删除
+// ---------------------------------------------------------------------------
+
+#define GENERIC_READ 0x80000000u
+#define GENERIC_WRITE 0x40000000u
+#define FILE_WRITE_ATTRIBUTES 0x00000100
+#define FILE_SHARE_READ 0x00000001
+#define FILE_SHARE_WRITE 0x00000002
+#define FILE_SHARE_DELETE 0x00000004
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define FILE_ATTRIBUTE_NORMAL 0x00000080
+#define FILE_FLAG_WRITE_THROUGH 0x80000000u
+#define FILE_FLAG_OVERLAPPED 0x40000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+#define MOVEFILE_REPLACE_EXISTING 0x00000001
+#define MOVEFILE_WRITE_THROUGH 0x00000008
+#define FILE_MAP_READ 0x0004
+#define FILE_MAP_WRITE 0x0002
+#define FILE_MAP_ALL_ACCESS 0x000f001f
+
+typedef struct _OVERLAPPED
+{
+    ULONG_PTR Internal;
+    ULONG_PTR InternalHigh;
+    DWORD Offset;
+    DWORD OffsetHigh;
+    HANDLE hEvent;
+} OVERLAPPED, *LPOVERLAPPED;
+
+HANDLE CreateFileW(LPCWSTR pszPath, DWORD dwAccess, DWORD dwShare, LPSECURITY_ATTRIBUTES psa, DWORD dwDisposition, DWORD dwFlags, HANDLE hTemplate);
+BOOL ReadFile(HANDLE hFile, LPVOID pv, DWORD cb, LPDWORD pcbRead, LPOVERLAPPED pov);
+BOOL WriteFile(HANDLE hFile, LPCVOID pv, DWORD cb, LPDWORD pcbWritten, LPOVERLAPPED pov);
+BOOL SetFilePointerEx(HANDLE hFile, LARGE_INTEGER liDistance, PLARGE_INTEGER pliNewPointer, DWORD dwMoveMethod);
+BOOL SetEndOfFile(HANDLE hFile);
+BOOL GetFileSizeEx(HANDLE hFile, PLARGE_INTEGER pliSize);
+BOOL FlushFileBuffers(HANDLE hFile);
+BOOL MoveFileExW(LPCWSTR pszExisting, LPCWSTR pszNew, DWORD dwFlags);
+BOOL DeleteFileW(LPCWSTR pszPath);
+inline BOOL CreateDirectoryW(LPCWSTR, LPSECURITY_ATTRIBUTES) { return TRUE; }
+
+typedef enum _GET_FILEEX_INFO_LEVELS
+{
+    GetFileExInfoStandard,
+} GET_FILEEX_INFO_LEVELS;
+
+typedef struct _WIN32_FILE_ATTRIBUTE_DATA
+{
+    DWORD dwFileAttributes;
+    FILETIME ftCreationTime;
+    FILETIME ftLastAccessTime;
+    FILETIME ftLastWriteTime;
+    DWORD nFileSizeHigh;
+    DWORD nFileSizeLow;
+} WIN32_FILE_ATTRIBUTE_DATA;
+
+BOOL GetFileAttributesExW(LPCWSTR pszPath, GET_FILEEX_INFO_LEVELS level, LPVOID pvInfo);
+
+// 删除全部文件
+void WinCompatClearFiles();
+// dwError 不为 ERROR_SUCCESS 时，之后的打开和写入以该错误失败
+void WinCompatSetFileError(DWORD dwError);
+// 把已有文件的所有者改为 pszOwnerSid（SID 字符串），模拟普通用户抢先创建的文件；
+// 新建的文件所有者为 SYSTEM，CREATE_ALWAYS 覆盖已有文件时与 Windows 相同保留原所有者
+BOOL WinCompatSetFileOwner(LPCWSTR pszPath, LPCWSTR pszOwnerSid);
+
+HANDLE CreateFileMappingW(HANDLE hFile, LPSECURITY_ATTRIBUTES psa, DWORD flProtect, DWORD dwMaximumSizeHigh, DWORD dwMaximumSizeLow, LPCWSTR pszName);
+
+HANDLE OpenFileMappingW(DWORD dwDesiredAccess, BOOL fInheritHandle, LPCWSTR pszName);
+
+LPVOID MapViewOfFile(HANDLE hMapping, DWORD dwDesiredAccess, DWORD dwFileOffsetHigh, DWORD dwFileOffsetLow, SIZE_T cbMap);
+BOOL UnmapViewOfFile(LPCVOID pv);
+
+// 把已有区段的所有者改为 pszOwnerSid，模拟普通用户抢先创建的区段；新建的区段所有者为 SYSTEM
+BOOL WinCompatSetSectionOwner(LPCWSTR pszName, LPCWSTR pszOwnerSid);
+
+// 不展开环境变量，原样复制；返回值与系统相同，含结尾 NUL
+inline DWORD ExpandEnvironmentStringsW(LPCWSTR pszSrc, LPWSTR pszDst, DWORD cchDst)
+{
+    DWORD cch = (DWORD)wcslen(pszSrc) + 1;
+    if (cch <= cchDst)
+    {
+        memcpy(pszDst, pszSrc, cch * sizeof(WCHAR));
+    }
+    return cch;
+}
+
+// ---------------------------------------------------------------------------
+// 命名管道：\\.\pipe\名称 映射为 Linux 抽象命名空间中的 SOCK_SEQPACKET Unix 套接字，保留消息边界；
+// 套接字名带进程号，管道只在本进程内可见。每个管道名只有一个服务端实例，已被占用时
+// 带 FILE_FLAG_FIRST_PIPE_INSTANCE 与 Windows 相同以 ERROR_ACCESS_DENIED 失败。
+// 客户端在服务端 ConnectNamedPipe 之前也能连上（在监听队列中等待），只在队列满时得到 ERROR_PIPE_BUSY。
+// 重叠 I/O：能立即完成的操作直接完成并触发事件，否则由一个线程等套接字就绪后完成，CancelIoEx 可以取消；
+// 每个句柄同时只能有一个未完成的重叠操作，DisconnectNamedPipe 和 CloseHandle 之前须等它结束。
+// 读取缓冲区小于消息时以 ERROR_MORE_DATA 返回前一部分，剩余部分被丢弃（Windows 上可以继续读取）
+// ---------------------------------------------------------------------------
+
+#define PIPE_ACCESS_INBOUND 0x00000001
+#define PIPE_ACCESS_OUTBOUND 0x00000002
+#define PIPE_ACCESS_DUPLEX 0x00000003
+#define FILE_FLAG_FIRST_PIPE_INSTANCE 0x00080000
+#define PIPE_TYPE_BYTE 0x00000000
+#define PIPE_TYPE_MESSAGE 0x00000004
+#define PIPE_READMODE_BYTE 0x00000000
+#define PIPE_READMODE_MESSAGE 0x00000002
+#define PIPE_WAIT 0x00000000
+#define PIPE_NOWAIT 0x00000001
+#define PIPE_REJECT_REMOTE_CLIENTS 0x00000008
+#define PIPE_UNLIMITED_INSTANCES 255
+
+// 客户端由 CreateFileW 打开管道名；ReadFile、WriteFile、FlushFileBuffers 和 CloseHandle 同时接受管道句柄
+HANDLE CreateNamedPipeW(LPCWSTR pszName, DWORD dwOpenMode, DWORD dwPipeMode, DWORD nMaxInstances, DWORD cbOutBuffer, DWORD cbInBuffer, DWORD dwDefaultTimeOut, LPSECURITY_ATTRIBUTES psa);
+BOOL ConnectNamedPipe(HANDLE hPipe, LPOVERLAPPED pov);
+BOOL DisconnectNamedPipe(HANDLE hPipe);
+// 管道总是消息模式
+inline BOOL SetNamedPipeHandleState(HANDLE, LPDWORD, LPDWORD, LPDWORD) { return TRUE; }
+BOOL GetOverlappedResult(HANDLE hFile, LPOVERLAPPED pov, LPDWORD pcbTransferred, BOOL fWait);
+BOOL CancelIoEx(HANDLE hFile, LPOVERLAPPED pov);
+
+// ---------------------------------------------------------------------------
+// 安全：只有内存文件有所有者（默认 SYSTEM）；账户名与 SID 只在测试注册的账户之间转换
+// ---------------------------------------------------------------------------
+
+#define OWNER_SECURITY_INFORMATION 0x00000001
+#define DACL_SECURITY_INFORMATION 0x00000004
+#define PROTECTED_DACL_SECURITY_INFORMATION 0x80000000u
+#define SDDL_REVISION_1 1
+
+typedef enum _SE_OBJECT_TYPE
+{
+    SE_UNKNOWN_OBJECT_TYPE = 0,
+    SE_FILE_OBJECT,
+    SE_SERVICE,
+    SE_PRINTER,
+    SE_REGISTRY_KEY,
+    SE_LMSHARE,
+    SE_KERNEL_OBJECT
+} SE_OBJECT_TYPE;
+
+typedef enum
+{
+    WinNullSid = 0,
+    WinWorldSid = 1,
+    WinLocalSystemSid = 22,
+    WinBuiltinAdministratorsSid = 26
+} WELL_KNOWN_SID_TYPE;
+
+typedef enum _SID_NAME_USE
+{
+    SidTypeUser = 1,
+    SidTypeGroup,
+    SidTypeDomain
+} SID_NAME_USE, *PSID_NAME_USE;
+
+#define SECURITY_MAX_SID_SIZE 68
+
+// 只支持内存文件句柄（SE_FILE_OBJECT）和命名区段（SE_KERNEL_OBJECT）的 OWNER_SECURITY_INFORMATION；*ppsidOwner 指向 *ppSD 内部，由 LocalFree 释放 *ppSD
+DWORD GetSecurityInfo(HANDLE handle, SE_OBJECT_TYPE objectType, SECURITY_INFORMATION securityInfo, PSID* ppsidOwner, PSID* ppsidGroup, PVOID* ppDacl, PVOID* ppSacl, PSECURITY_DESCRIPTOR* ppSD);
+BOOL IsWellKnownSid(PSID pSid, WELL_KNOWN_SID_TYPE type);
+
+// 账户：只认识测试通过 WinCompatSetAccount 注册的账户，其余返回 ERROR_NONE_MAPPED。
+// PSID 指向以 NUL 结尾的 SID 字符串，sddl.h 中的转换函数直接复制该字符串
+BOOL LookupAccountNameW(LPCWSTR pszSystemName, LPCWSTR pszAccountName, PSID pSid, LPDWORD pcbSid, LPWSTR pszDomain, LPDWORD pcchDomain, PSID_NAME_USE peUse);
+BOOL LookupAccountSidW(LPCWSTR pszSystemName, PSID pSid, LPWSTR pszName, LPDWORD pcchName, LPWSTR pszDomain, LPDWORD pcchDomain, PSID_NAME_USE peUse);
+
+// LookupAccountNameW 接受 "名称" 或 "域\名称"（不区分大小写）
+void WinCompatSetAccount(LPCWSTR pszSid, LPCWSTR pszDomain, LPCWSTR pszName);
+void WinCompatClearAccounts();
+
+// 令牌：只有 WTSQueryUserToken 返回的会话用户令牌，只支持 TokenUser，SID 字符串紧跟在 TOKEN_USER 之后
+typedef enum _TOKEN_INFORMATION_CLASS
+{
+    TokenUser = 1
+} TOKEN_INFORMATION_CLASS;
+
+typedef struct _SID_AND_ATTRIBUTES
+{
+    PSID Sid;
+    DWORD Attributes;
+} SID_AND_ATTRIBUTES;
+
+typedef struct _TOKEN_USER
+{
+    SID_AND_ATTRIBUTES User;
+} TOKEN_USER, *PTOKEN_USER;
+
+BOOL GetTokenInformation(HANDLE hToken, TOKEN_INFORMATION_CLASS tokenInformationClass, LPVOID pvInformation, DWORD cbInformation, PDWORD pcbReturned);
+
+// 设置会话的登录用户（WTSQueryUserToken）；nullptr 表示会话无人登录
+void WinCompatSetSessionUser(LPCWSTR pszSid);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <windows.h>
+
+typedef struct _UNICODE_STRING
+{
+    USHORT Length;
+    USHORT MaximumLength;
+    PWSTR Buffer;
+} UNICODE_STRING, *PUNICODE_STRING;
+
+typedef const UNICODE_STRING* PCUNICODE_STRING;
+
+#define NT_SUCCESS(Status) (((NTSTATUS)(Status)) >= 0)
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <windows.h>
+
+// 会话用户令牌：测试通过 WinCompatSetSessionUser 设置会话的登录用户，未设置时以 ERROR_NO_TOKEN 失败
+BOOL WTSQueryUserToken(ULONG SessionId, PHANDLE phToken);
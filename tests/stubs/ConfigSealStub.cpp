@@ -0,0 +1,26 @@
+#include "pch.h"
+#include "ConfigSeal.h"
+
+// 不测试主机密钥密封的目标不链接 ConfigSeal.cpp：主机密钥密封一律视为不存在（VaultCryptoTest 链接真实实现）
+
+bool ConfigIsHostSealed(const BYTE* pbSealed, DWORD cbSealed)
+{
+    UNREFERENCED_PARAMETER(pbSealed);
+    UNREFERENCED_PARAMETER(cbSealed);
+    return false;
+}
+
+HRESULT ConfigHostUnseal(const BYTE* pbHostKey, const BYTE* pbSealed, DWORD cbSealed, SecretString* pSecret)
+{
+    UNREFERENCED_PARAMETER(pbHostKey);
+    UNREFERENCED_PARAMETER(pbSealed);
+    UNREFERENCED_PARAMETER(cbSealed);
+    UNREFERENCED_PARAMETER(pSecret);
+    return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+}
+
+HRESULT ConfigReadHostKey(BYTE* pbHostKey)
+{
+    UNREFERENCED_PARAMETER(pbHostKey);
+    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+}
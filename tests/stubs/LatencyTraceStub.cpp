@@ -0,0 +1,31 @@
+#include "pch.h"
+#include "LatencyTrace.h"
+
+// 未链接 LatencyTrace.cpp 的测试：跟踪保持关闭，只提供符号
+
+volatile LONG g_fTraceEnabled = FALSE;
+
+void LatencyTraceRecord(TRACE_METHOD method, LONGLONG llEnter, LONGLONG llExit)
+{
+    UNREFERENCED_PARAMETER(method);
+    UNREFERENCED_PARAMETER(llEnter);
+    UNREFERENCED_PARAMETER(llExit);
+}
+
+void LatencyTraceInitialize()
+{
+}
+
+void LatencyTraceQueueDump()
+{
+}
+
+void LatencyTraceScenarioBegin(DWORD dwScenario)
+{
+    UNREFERENCED_PARAMETER(dwScenario);
+}
+
+void LatencyTraceScenarioEnd(DWORD dwScenario)
+{
+    UNREFERENCED_PARAMETER(dwScenario);
+}
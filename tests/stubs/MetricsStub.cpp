@@ -0,0 +1,31 @@
+#include "pch.h"
+#include "Metrics.h"
+
+// 未链接 Metrics.cpp 的测试：指标保持关闭，只提供符号
+
+volatile LONG g_fMetricsEnabled = FALSE;
+
+void MetricsRecordDuration(METRIC_HISTOGRAM histogram, LONGLONG llTicks)
+{
+    UNREFERENCED_PARAMETER(histogram);
+    UNREFERENCED_PARAMETER(llTicks);
+}
+
+void MetricsRecordFetchFailure()
+{
+}
+
+void MetricsInitialize()
+{
+}
+
+void MetricsRecordResult(DWORD dwScenario, RESULT_KIND kind)
+{
+    UNREFERENCED_PARAMETER(dwScenario);
+    UNREFERENCED_PARAMETER(kind);
+}
+
+void MetricsRecordConfigReload(DWORD dwGeneration)
+{
+    UNREFERENCED_PARAMETER(dwGeneration);
+}
@@ -0,0 +1,18 @@
+#include "pch.h"
+#include "TileImage.h"
+
+// TileImage.cpp 依赖 WIC 和 GDI，不在测试中编译：相当于未配置磁贴图像
+
+void TileImageWarmup()
+{
+}
+
+HRESULT TileImageCreateBitmap(HBITMAP* phbmp)
+{
+    *phbmp = nullptr;
+    return S_FALSE;
+}
+
+void TileImageCleanup()
+{
+}
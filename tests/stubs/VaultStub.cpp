@@ -0,0 +1,29 @@
+#include "pch.h"
+#include "Vault.h"
+
+// 不测试口令保险库的目标不链接 Vault.cpp 和 VaultCrypto.cpp：保险库一律视为不存在（VaultCryptoTest 链接真实实现）
+
+bool VaultIsSealed(const BYTE* pbFile, DWORD cbFile)
+{
+    UNREFERENCED_PARAMETER(pbFile);
+    UNREFERENCED_PARAMETER(cbFile);
+    return false;
+}
+
+HRESULT VaultOpen(const BYTE* pbPassphrase, DWORD cbPassphrase, const BYTE* pbVault, DWORD cbVault, SecretString* pAccounts, DWORD* pcchAccounts)
+{
+    UNREFERENCED_PARAMETER(pbPassphrase);
+    UNREFERENCED_PARAMETER(cbPassphrase);
+    UNREFERENCED_PARAMETER(pbVault);
+    UNREFERENCED_PARAMETER(cbVault);
+    UNREFERENCED_PARAMETER(pAccounts);
+    UNREFERENCED_PARAMETER(pcchAccounts);
+    return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+}
+
+HRESULT VaultReadPassphrase(BYTE* pbPassphrase, DWORD* pcbPassphrase)
+{
+    UNREFERENCED_PARAMETER(pbPassphrase);
+    UNREFERENCED_PARAMETER(pcbPassphrase);
+    return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+}
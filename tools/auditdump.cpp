@@ -0,0 +1,461 @@
+// WinUnlock 审计日志工具
+//
+// 读取 winunlock.dll 写出的审计日志（格式见 AuditLog.h），按条件过滤后以文本、CSV 或 JSON Lines 输出；
+// /bench 直接编译 DLL 的 AuditLog.cpp，多线程入队并测量每次入队的耗时和组提交的批量大小。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. auditdump.cpp ..\AuditLog.cpp ..\ConfigFormat.cpp ..\ConfigFile.cpp ..\ConfigSeal.cpp ..\SecretArena.cpp advapi32.lib ole32.lib shlwapi.lib
+//
+// 用法：
+//   auditdump [/all] [/account 账户] [/since 时间] [/failed | /succeeded] [/csv | /json] [日志文件]
+//     /all      同时读取轮转出的旧文件（audit.<n>.log），按从旧到新的顺序输出
+//     /account  只输出账户键（SID 字符串或用户名）与之相同的记录，不区分大小写
+//     /since    只输出该本地时间之后的记录，格式 yyyy-mm-dd 或 yyyy-mm-ddThh:mm
+//   auditdump /bench [/threads 线程数] [/count 记录数]
+
+#include "pch.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "AuditLog.h"
+
+enum OUTPUT_FORMAT
+{
+    OF_TEXT,
+    OF_CSV,
+    OF_JSON,
+};
+
+struct AUDIT_FILTER
+{
+    PCWSTR pszAccount;
+    ULONGLONG ullSince;
+    int iOutcome;           // 0 全部，-1 只输出失败，1 只输出成功
+};
+
+static void Usage()
+{
+    fwprintf(stderr, L"用法：auditdump [/all] [/account 账户] [/since 时间] [/failed | /succeeded] [/csv | /json] [日志文件]\n");
+    fwprintf(stderr, L"用法：auditdump /bench [/threads 线程数] [/count 记录数]\n");
+}
+
+// 读取一个日志文件的全部记录；校验失败的记录计入 pcCorrupt，末尾不完整的记录忽略
+static bool ReadAuditFile(PCWSTR pszPath, std::vector<AUDIT_RECORD>& records, DWORD* pcCorrupt)
+{
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    bool fResult = false;
+    LARGE_INTEGER liSize;
+    AUDIT_FILE_HEADER header = { 0 };
+    DWORD cbRead = 0;
+    if (GetFileSizeEx(hFile, &liSize) && (liSize.QuadPart <= AUDIT_FILE_MAX_SIZE) &&
+        ReadFile(hFile, &header, sizeof(header), &cbRead, nullptr) && (cbRead == sizeof(header)) &&
+        (header.dwMagic == AUDIT_FILE_MAGIC) && (header.wVersion == AUDIT_FILE_VERSION) &&
+        (header.cbRecord == sizeof(AUDIT_RECORD)))
+    {
+        DWORD cRecords = (DWORD)((liSize.QuadPart - sizeof(header)) / sizeof(AUDIT_RECORD));
+        std::vector<AUDIT_RECORD> file(cRecords);
+        DWORD cbRecords = cRecords * sizeof(AUDIT_RECORD);
+        if (!cbRecords || (ReadFile(hFile, file.data(), cbRecords, &cbRead, nullptr) && (cbRead == cbRecords)))
+        {
+            for (const AUDIT_RECORD& record : file)
+            {
+                if (AuditRecordIsValid(&record))
+                {
+                    records.push_back(record);
+                }
+                else
+                {
+                    (*pcCorrupt)++;
+                }
+            }
+            fResult = true;
+        }
+    }
+    CloseHandle(hFile);
+    return fResult;
+}
+
+// 轮转文件名：audit.log -> audit.<n>.log
+static void GetRotatedPath(PCWSTR pszPath, DWORD dwIndex, PWSTR pszRotated, size_t cchRotated)
+{
+    WCHAR szStem[MAX_PATH];
+    wcsncpy_s(szStem, pszPath, _TRUNCATE);
+    PathRemoveExtensionW(szStem);
+    StringCchPrintfW(pszRotated, cchRotated, L"%s.%lu.log", szStem, dwIndex);
+}
+
+static PCSTR ScenarioName(WORD wScenario)
+{
+    switch (wScenario)
+    {
+    case CPUS_LOGON:
+        return "logon";
+    case CPUS_UNLOCK_WORKSTATION:
+        return "unlock";
+    case CPUS_CHANGE_PASSWORD:
+        return "changepassword";
+    case CPUS_CREDUI:
+        return "credui";
+    default:
+        return "?";
+    }
+}
+
+static std::string ToUtf8(PCWSTR psz)
+{
+    std::string result;
+    int cb = WideCharToMultiByte(CP_UTF8, 0, psz, -1, nullptr, 0, nullptr, nullptr);
+    if (cb > 1)
+    {
+        result.resize(cb - 1);
+        WideCharToMultiByte(CP_UTF8, 0, psz, -1, &result[0], cb, nullptr, nullptr);
+    }
+    return result;
+}
+
+static std::string JsonEscape(const std::string& s)
+{
+    std::string result;
+    for (char ch : s)
+    {
+        if ((ch == '"') || (ch == '\\'))
+        {
+            result.push_back('\\');
+            result.push_back(ch);
+        }
+        else if ((unsigned char)ch < 0x20)
+        {
+            char sz[8];
+            sprintf_s(sz, "\\u%04x", (unsigned char)ch);
+            result += sz;
+        }
+        else
+        {
+            result.push_back(ch);
+        }
+    }
+    return result;
+}
+
+static std::string CsvEscape(const std::string& s)
+{
+    if (s.find_first_of(",\"\r\n") == std::string::npos)
+    {
+        return s;
+    }
+    std::string result = "\"";
+    for (char ch : s)
+    {
+        if (ch == '"')
+        {
+            result.push_back('"');
+        }
+        result.push_back(ch);
+    }
+    result.push_back('"');
+    return result;
+}
+
+// UTC FILETIME -> 本地时间 "yyyy-mm-dd hh:mm:ss.fff"
+static std::string FormatTime(ULONGLONG ullTime, char chSeparator)
+{
+    FILETIME ft = { (DWORD)ullTime, (DWORD)(ullTime >> 32) };
+    SYSTEMTIME stUtc;
+    SYSTEMTIME stLocal;
+    char sz[32] = "?";
+    if (FileTimeToSystemTime(&ft, &stUtc) && SystemTimeToTzSpecificLocalTime(nullptr, &stUtc, &stLocal))
+    {
+        sprintf_s(sz, "%04u-%02u-%02u%c%02u:%02u:%02u.%03u", stLocal.wYear, stLocal.wMonth, stLocal.wDay, chSeparator,
+            stLocal.wHour, stLocal.wMinute, stLocal.wSecond, stLocal.wMilliseconds);
+    }
+    return sz;
+}
+
+// 本地时间 "yyyy-mm-dd" 或 "yyyy-mm-ddThh:mm" -> UTC FILETIME
+static bool ParseSince(PCWSTR psz, ULONGLONG* pullTime)
+{
+    SYSTEMTIME stLocal = { 0 };
+    SYSTEMTIME stUtc;
+    FILETIME ft;
+    int cFields = swscanf_s(psz, L"%hu-%hu-%huT%hu:%hu", &stLocal.wYear, &stLocal.wMonth, &stLocal.wDay, &stLocal.wHour, &stLocal.wMinute);
+    if (((cFields != 3) && (cFields != 5)) ||
+        !TzSpecificLocalTimeToSystemTime(nullptr, &stLocal, &stUtc) || !SystemTimeToFileTime(&stUtc, &ft))
+    {
+        return false;
+    }
+    *pullTime = ((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return true;
+}
+
+static bool MatchFilter(const AUDIT_RECORD& record, const AUDIT_FILTER& filter)
+{
+    if (record.ullTime < filter.ullSince)
+    {
+        return false;
+    }
+    // 丢弃记录不属于任何账户，只受时间条件限制
+    if (record.wKind == AUDIT_KIND_DROPPED)
+    {
+        return true;
+    }
+    if (filter.pszAccount && (_wcsicmp(record.szAccount, filter.pszAccount) != 0))
+    {
+        return false;
+    }
+    return (filter.iOutcome == 0) || ((filter.iOutcome < 0) == (record.ntsStatus < 0));
+}
+
+static void PrintRecord(const AUDIT_RECORD& record, OUTPUT_FORMAT format)
+{
+    std::string account = ToUtf8(record.szAccount);
+    PCSTR pszKind = (record.wKind == AUDIT_KIND_DROPPED) ? "dropped" : "result";
+    switch (format)
+    {
+    case OF_CSV:
+        printf("%s,%llu,%lu,%lu,%s,%s,%s,0x%08lx,0x%08lx,%lu,%lu,%lu\n", FormatTime(record.ullTime, 'T').c_str(),
+            record.ullSequence, record.dwSessionId, record.dwProcessId, pszKind, ScenarioName(record.wScenario),
+            CsvEscape(account).c_str(), (ULONG)record.ntsStatus, (ULONG)record.ntsSubstatus,
+            record.dwSerializeUs, record.dwLogonUs, record.cDropped);
+        break;
+
+    case OF_JSON:
+        printf("{\"time\":\"%s\",\"sequence\":%llu,\"session\":%lu,\"pid\":%lu,\"kind\":\"%s\",\"scenario\":\"%s\","
+            "\"account\":\"%s\",\"status\":\"0x%08lx\",\"substatus\":\"0x%08lx\",\"serialize_us\":%lu,\"logon_us\":%lu,\"dropped\":%lu}\n",
+            FormatTime(record.ullTime, 'T').c_str(), record.ullSequence, record.dwSessionId, record.dwProcessId, pszKind,
+            ScenarioName(record.wScenario), JsonEscape(account).c_str(), (ULONG)record.ntsStatus, (ULONG)record.ntsSubstatus,
+            record.dwSerializeUs, record.dwLogonUs, record.cDropped);
+        break;
+
+    default:
+        if (record.wKind == AUDIT_KIND_DROPPED)
+        {
+            printf("%s  dropped %lu records (queue full or write failed)\n", FormatTime(record.ullTime, ' ').c_str(), record.cDropped);
+        }
+        else
+        {
+            printf("%s  %-6s %-8s 0x%08lx/0x%08lx %10.1f %10.1f  %s\n", FormatTime(record.ullTime, ' ').c_str(),
+                ScenarioName(record.wScenario), (record.ntsStatus < 0) ? "failed" : "ok",
+                (ULONG)record.ntsStatus, (ULONG)record.ntsSubstatus,
+                record.dwSerializeUs / 1000.0, record.dwLogonUs / 1000.0, account.c_str());
+        }
+        break;
+    }
+}
+
+struct BENCH_THREAD
+{
+    DWORD cRecords;
+    LONGLONG llTicks;
+};
+
+static DWORD WINAPI BenchThread(PVOID pvContext)
+{
+    BENCH_THREAD* pThread = (BENCH_THREAD*)pvContext;
+    LARGE_INTEGER liBegin;
+    LARGE_INTEGER liEnd;
+    QueryPerformanceCounter(&liBegin);
+    for (DWORD i = 0; i < pThread->cRecords; i++)
+    {
+        AuditLogRecordResult(CPUS_UNLOCK_WORKSTATION, L"S-1-5-21-1004336348-1177238915-682003330-1001", 0, 0,
+            liBegin.QuadPart, liBegin.QuadPart, liBegin.QuadPart);
+    }
+    QueryPerformanceCounter(&liEnd);
+    pThread->llTicks += liEnd.QuadPart - liBegin.QuadPart;
+    return 0;
+}
+
+// 每轮各线程合计入队 AUDIT_QUEUE_SIZE 条后等待写入方清空队列，只统计入队循环的耗时
+static int RunBench(DWORD cThreads, DWORD cRecords)
+{
+    WCHAR szPath[MAX_PATH];
+    WCHAR szRotated[MAX_PATH];
+    GetTempPathW(ARRAYSIZE(szPath), szPath);
+    StringCchCatW(szPath, ARRAYSIZE(szPath), L"winunlock-audit-bench.log");
+    DeleteFileW(szPath);
+    for (DWORD i = 1; i <= AUDIT_FILE_KEEP; i++)
+    {
+        GetRotatedPath(szPath, i, szRotated, ARRAYSIZE(szRotated));
+        DeleteFileW(szRotated);
+    }
+
+    HRESULT hr = AuditLogStart(szPath);
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法启动审计日志: 0x%08lx\n", hr);
+        return 1;
+    }
+
+    std::vector<BENCH_THREAD> threads(cThreads, BENCH_THREAD{ AUDIT_QUEUE_SIZE / cThreads, 0 });
+    std::vector<HANDLE> handles(cThreads);
+    DWORD cRounds = max(1UL, cRecords / (threads[0].cRecords * cThreads));
+    for (DWORD iRound = 0; iRound < cRounds; iRound++)
+    {
+        for (DWORD i = 0; i < cThreads; i++)
+        {
+            handles[i] = CreateThread(nullptr, 0, BenchThread, &threads[i], 0, nullptr);
+            if (!handles[i])
+            {
+                fwprintf(stderr, L"无法创建线程: %lu\n", GetLastError());
+                return 1;
+            }
+        }
+        WaitForMultipleObjects(cThreads, handles.data(), TRUE, INFINITE);
+        for (HANDLE hThread : handles)
+        {
+            CloseHandle(hThread);
+        }
+        AuditLogFlush();
+    }
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    LONGLONG llTicks = 0;
+    for (const BENCH_THREAD& thread : threads)
+    {
+        llTicks += thread.llTicks;
+    }
+    AUDIT_STATS stats;
+    AuditLogGetStats(&stats);
+
+    printf("threads %lu, rounds %lu\n", cThreads, cRounds);
+    printf("enqueue:  %.1f ns/record (mean over %lld records)\n",
+        (double)llTicks * 1e9 / (double)liFrequency.QuadPart / (double)max(stats.cEnqueued, 1LL), stats.cEnqueued);
+    printf("written:  %lld records in %lld batches (%.1f records per FlushFileBuffers), dropped %lld\n",
+        stats.cWritten, stats.cBatches, (double)stats.cWritten / (double)max(stats.cBatches, 1LL), stats.cDropped);
+
+    // 读回全部文件校验
+    std::vector<AUDIT_RECORD> records;
+    DWORD cCorrupt = 0;
+    for (DWORD i = AUDIT_FILE_KEEP; i >= 1; i--)
+    {
+        GetRotatedPath(szPath, i, szRotated, ARRAYSIZE(szRotated));
+        ReadAuditFile(szRotated, records, &cCorrupt);
+    }
+    ReadAuditFile(szPath, records, &cCorrupt);
+    printf("verify:   %zu valid, %lu corrupt (%ls)\n", records.size(), cCorrupt, szPath);
+    return cCorrupt ? 1 : 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    WCHAR szPath[MAX_PATH] = { 0 };
+    ExpandEnvironmentStringsW(AUDIT_FILE_PATH, szPath, ARRAYSIZE(szPath));
+    AUDIT_FILTER filter = { nullptr, 0, 0 };
+    OUTPUT_FORMAT format = OF_TEXT;
+    bool fAll = false;
+    bool fBench = false;
+    DWORD cThreads = 4;
+    DWORD cRecords = 16384;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (_wcsicmp(argv[i], L"/all") == 0)
+        {
+            fAll = true;
+        }
+        else if ((_wcsicmp(argv[i], L"/account") == 0) && (i + 1 < argc))
+        {
+            filter.pszAccount = argv[++i];
+        }
+        else if ((_wcsicmp(argv[i], L"/since") == 0) && (i + 1 < argc))
+        {
+            if (!ParseSince(argv[++i], &filter.ullSince))
+            {
+                fwprintf(stderr, L"无效的时间：%s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (_wcsicmp(argv[i], L"/failed") == 0)
+        {
+            filter.iOutcome = -1;
+        }
+        else if (_wcsicmp(argv[i], L"/succeeded") == 0)
+        {
+            filter.iOutcome = 1;
+        }
+        else if (_wcsicmp(argv[i], L"/csv") == 0)
+        {
+            format = OF_CSV;
+        }
+        else if (_wcsicmp(argv[i], L"/json") == 0)
+        {
+            format = OF_JSON;
+        }
+        else if (_wcsicmp(argv[i], L"/bench") == 0)
+        {
+            fBench = true;
+        }
+        else if ((_wcsicmp(argv[i], L"/threads") == 0) && (i + 1 < argc))
+        {
+            cThreads = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/count") == 0) && (i + 1 < argc))
+        {
+            cRecords = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if (argv[i][0] != L'/')
+        {
+            wcsncpy_s(szPath, argv[i], _TRUNCATE);
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+
+    if (fBench)
+    {
+        if (!cThreads || (cThreads > min(AUDIT_QUEUE_SIZE, MAXIMUM_WAIT_OBJECTS)) || !cRecords)
+        {
+            fwprintf(stderr, L"线程数须为 1～%d，记录数不能为 0\n", min(AUDIT_QUEUE_SIZE, MAXIMUM_WAIT_OBJECTS));
+            return 1;
+        }
+        return RunBench(cThreads, cRecords);
+    }
+
+    std::vector<AUDIT_RECORD> records;
+    DWORD cCorrupt = 0;
+    if (fAll)
+    {
+        for (DWORD i = AUDIT_FILE_KEEP; i >= 1; i--)
+        {
+            WCHAR szRotated[MAX_PATH];
+            GetRotatedPath(szPath, i, szRotated, ARRAYSIZE(szRotated));
+            ReadAuditFile(szRotated, records, &cCorrupt);
+        }
+    }
+    if (!ReadAuditFile(szPath, records, &cCorrupt) && records.empty())
+    {
+        fwprintf(stderr, L"无法读取 %s（文件不存在或不是审计日志）: %lu\n", szPath, GetLastError());
+        return 1;
+    }
+
+    SetConsoleOutputCP(CP_UTF8);
+    if (format == OF_CSV)
+    {
+        printf("time,sequence,session,pid,kind,scenario,account,status,substatus,serialize_us,logon_us,dropped\n");
+    }
+    else if (format == OF_TEXT)
+    {
+        printf("%-23s  %-6s %-8s %-21s %10s %10s  %s\n", "time", "scen.", "outcome", "status/substatus", "ser.(ms)", "logon(ms)", "account");
+    }
+    for (const AUDIT_RECORD& record : records)
+    {
+        if (MatchFilter(record, filter))
+        {
+            PrintRecord(record, format);
+        }
+    }
+    if (cCorrupt)
+    {
+        fwprintf(stderr, L"跳过 %lu 条校验失败的记录\n", cCorrupt);
+    }
+    return 0;
+}
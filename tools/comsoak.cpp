@@ -0,0 +1,263 @@
+// WinUnlock COM 对象反复创建测试
+//
+// 直接加载 winunlock.dll（不经 COM 注册），在多个线程上反复执行
+// DllGetClassObject -> CreateInstance -> QueryInterface -> Release，
+// 结束时检查 DllCanUnloadNow 是否返回 S_OK（引用计数是否泄漏），并输出每轮的堆分配次数和私有内存增长。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. comsoak.cpp ole32.lib
+//
+// 用法：
+//   comsoak [/dll 路径] [/threads 线程数] [/cycles 总轮数] [/scenario]
+//     /dll       默认使用注册表中 InprocServer32 指向的 DLL
+//     /cycles    默认 1000000，平均分配到各线程
+//     /scenario  每轮额外调用 SetUsageScenario(CPUS_LOGON) 并枚举全部磁贴，覆盖凭据对象的创建和释放
+
+#include "pch.h"
+#include <psapi.h>
+#include <stdio.h>
+#include <vector>
+#include "CredentialProvider.h"
+#include "ObjectPool.h"
+
+typedef HRESULT(STDAPICALLTYPE* PFN_DLL_GET_CLASS_OBJECT)(REFCLSID, REFIID, void**);
+typedef HRESULT(STDAPICALLTYPE* PFN_DLL_CAN_UNLOAD_NOW)();
+typedef HRESULT(WINAPI* PFN_GET_OBJECT_STATS)(WINUNLOCK_OBJECT_STATS*);
+
+// 预热轮数：首轮创建会初始化字符串表、跟踪缓冲区等只分配一次的数据，不计入统计
+#define COMSOAK_WARMUP_CYCLES 16
+
+struct SOAK_CONTEXT
+{
+    PFN_DLL_GET_CLASS_OBJECT pfnGetClassObject;
+    DWORD cCycles;
+    bool fScenario;
+    volatile LONG cFailed;
+    HRESULT hrFirstFailure;
+};
+
+static HRESULT RunCycle(SOAK_CONTEXT* pContext)
+{
+    IClassFactory* pcf = nullptr;
+    HRESULT hr = pContext->pfnGetClassObject(CLSID_WinUnlockProvider, IID_PPV_ARGS(&pcf));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ICredentialProvider* pcp = nullptr;
+    hr = pcf->CreateInstance(nullptr, IID_PPV_ARGS(&pcp));
+    if (SUCCEEDED(hr))
+    {
+        IUnknown* punk = nullptr;
+        hr = pcp->QueryInterface(IID_PPV_ARGS(&punk));
+        if (SUCCEEDED(hr))
+        {
+            punk->Release();
+        }
+
+        if (SUCCEEDED(hr) && pContext->fScenario)
+        {
+            hr = pcp->SetUsageScenario(CPUS_LOGON, 0);
+            if (SUCCEEDED(hr))
+            {
+                DWORD cCredentials = 0;
+                DWORD dwDefault = 0;
+                BOOL bAutoLogon = FALSE;
+                hr = pcp->GetCredentialCount(&cCredentials, &dwDefault, &bAutoLogon);
+                for (DWORD i = 0; SUCCEEDED(hr) && (i < cCredentials); i++)
+                {
+                    ICredentialProviderCredential* pcpc = nullptr;
+                    hr = pcp->GetCredentialAt(i, &pcpc);
+                    if (SUCCEEDED(hr))
+                    {
+                        pcpc->Release();
+                    }
+                }
+            }
+        }
+        pcp->Release();
+    }
+    pcf->Release();
+    return hr;
+}
+
+static DWORD WINAPI SoakThread(LPVOID pvContext)
+{
+    SOAK_CONTEXT* pContext = (SOAK_CONTEXT*)pvContext;
+    HRESULT hrInit = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+    for (DWORD i = 0; i < pContext->cCycles; i++)
+    {
+        HRESULT hr = RunCycle(pContext);
+        if (FAILED(hr) && (InterlockedIncrement(&pContext->cFailed) == 1))
+        {
+            pContext->hrFirstFailure = hr;
+        }
+    }
+    if (SUCCEEDED(hrInit))
+    {
+        CoUninitialize();
+    }
+    return 0;
+}
+
+// 从 InprocServer32 读取已注册的 DLL 路径
+static bool GetRegisteredDllPath(PWSTR pszPath, DWORD cchPath)
+{
+    WCHAR szClsid[40];
+    WCHAR szKey[80];
+    StringFromGUID2(CLSID_WinUnlockProvider, szClsid, ARRAYSIZE(szClsid));
+    swprintf_s(szKey, L"CLSID\\%s\\InprocServer32", szClsid);
+    DWORD cbPath = cchPath * sizeof(WCHAR);
+    return RegGetValueW(HKEY_CLASSES_ROOT, szKey, nullptr, RRF_RT_REG_SZ, nullptr, pszPath, &cbPath) == ERROR_SUCCESS;
+}
+
+static SIZE_T GetPrivateBytes()
+{
+    PROCESS_MEMORY_COUNTERS_EX pmc = { sizeof(pmc) };
+    return GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*)&pmc, sizeof(pmc)) ? pmc.PrivateUsage : 0;
+}
+
+static void PrintPoolStats(PCWSTR pszName, const OBJECT_POOL_STATS& before, const OBJECT_POOL_STATS& after, DWORD cCycles)
+{
+    LONG cHeapAllocs = after.cHeapAllocs - before.cHeapAllocs;
+    LONG cPoolHits = after.cPoolHits - before.cPoolHits;
+    wprintf(L"%-8s 堆分配 %ld 次（每轮 %.4f），空闲链表命中 %ld 次，未释放 %ld 个\n",
+        pszName, cHeapAllocs, cCycles ? (double)cHeapAllocs / cCycles : 0.0, cPoolHits, after.cLive);
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    WCHAR szDllPath[MAX_PATH] = L"";
+    DWORD cThreads = 4;
+    DWORD cCycles = 1000000;
+    bool fScenario = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((_wcsicmp(argv[i], L"/dll") == 0) && (i + 1 < argc))
+        {
+            wcscpy_s(szDllPath, argv[++i]);
+        }
+        else if ((_wcsicmp(argv[i], L"/threads") == 0) && (i + 1 < argc))
+        {
+            cThreads = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/cycles") == 0) && (i + 1 < argc))
+        {
+            cCycles = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if (_wcsicmp(argv[i], L"/scenario") == 0)
+        {
+            fScenario = true;
+        }
+        else
+        {
+            fwprintf(stderr, L"用法: comsoak [/dll 路径] [/threads 线程数] [/cycles 总轮数] [/scenario]\n");
+            return 1;
+        }
+    }
+    if (!cThreads || (cThreads > MAXIMUM_WAIT_OBJECTS) || !cCycles)
+    {
+        fwprintf(stderr, L"线程数须为 1～%d，轮数不能为 0\n", MAXIMUM_WAIT_OBJECTS);
+        return 1;
+    }
+    if (!szDllPath[0] && !GetRegisteredDllPath(szDllPath, ARRAYSIZE(szDllPath)))
+    {
+        fwprintf(stderr, L"提供程序未注册，请用 /dll 指定 winunlock.dll\n");
+        return 1;
+    }
+
+    HMODULE hDll = LoadLibraryW(szDllPath);
+    if (!hDll)
+    {
+        fwprintf(stderr, L"无法加载 %s: %lu\n", szDllPath, GetLastError());
+        return 1;
+    }
+    SOAK_CONTEXT context = {};
+    context.pfnGetClassObject = (PFN_DLL_GET_CLASS_OBJECT)GetProcAddress(hDll, "DllGetClassObject");
+    PFN_DLL_CAN_UNLOAD_NOW pfnCanUnloadNow = (PFN_DLL_CAN_UNLOAD_NOW)GetProcAddress(hDll, "DllCanUnloadNow");
+    PFN_GET_OBJECT_STATS pfnGetObjectStats = (PFN_GET_OBJECT_STATS)GetProcAddress(hDll, "WinUnlockGetObjectStats");
+    if (!context.pfnGetClassObject || !pfnCanUnloadNow || !pfnGetObjectStats)
+    {
+        fwprintf(stderr, L"%s 缺少所需的导出函数\n", szDllPath);
+        return 1;
+    }
+    context.fScenario = fScenario;
+
+    // 预热
+    context.cCycles = COMSOAK_WARMUP_CYCLES;
+    SoakThread(&context);
+    if (context.cFailed)
+    {
+        fwprintf(stderr, L"创建失败: 0x%08lx\n", context.hrFirstFailure);
+        return 1;
+    }
+
+    WINUNLOCK_OBJECT_STATS statsBefore;
+    pfnGetObjectStats(&statsBefore);
+    SIZE_T cbPrivateBefore = GetPrivateBytes();
+
+    context.cCycles = cCycles / cThreads;
+    LARGE_INTEGER liFrequency;
+    LARGE_INTEGER liStart;
+    LARGE_INTEGER liEnd;
+    QueryPerformanceFrequency(&liFrequency);
+    QueryPerformanceCounter(&liStart);
+
+    std::vector<HANDLE> threads;
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        HANDLE hThread = CreateThread(nullptr, 0, SoakThread, &context, 0, nullptr);
+        if (!hThread)
+        {
+            fwprintf(stderr, L"无法创建线程: %lu\n", GetLastError());
+            break;
+        }
+        threads.push_back(hThread);
+    }
+    WaitForMultipleObjects((DWORD)threads.size(), threads.data(), TRUE, INFINITE);
+    for (HANDLE hThread : threads)
+    {
+        CloseHandle(hThread);
+    }
+    QueryPerformanceCounter(&liEnd);
+    DWORD cTotal = context.cCycles * (DWORD)threads.size();
+
+    double dSeconds = (double)(liEnd.QuadPart - liStart.QuadPart) / liFrequency.QuadPart;
+    wprintf(L"%lu 轮，%lu 个线程，%.2f 秒，每秒 %.0f 轮\n", cTotal, (DWORD)threads.size(), dSeconds, dSeconds > 0 ? cTotal / dSeconds : 0.0);
+    if (context.cFailed)
+    {
+        wprintf(L"失败 %ld 轮，首个错误 0x%08lx\n", context.cFailed, context.hrFirstFailure);
+    }
+
+    // 线程池上的预取可能在最后一次 Release 之后才结束，稍等引用计数归零
+    HRESULT hrUnload = S_FALSE;
+    for (int i = 0; i < 50; i++)
+    {
+        hrUnload = pfnCanUnloadNow();
+        if (hrUnload == S_OK)
+        {
+            break;
+        }
+        Sleep(100);
+    }
+
+    WINUNLOCK_OBJECT_STATS statsAfter;
+    pfnGetObjectStats(&statsAfter);
+    SIZE_T cbPrivateAfter = GetPrivateBytes();
+
+    PrintPoolStats(L"提供程序", statsBefore.providers, statsAfter.providers, cTotal);
+    PrintPoolStats(L"凭据", statsBefore.credentials, statsAfter.credentials, cTotal);
+    wprintf(L"私有内存增长 %lld KB（每轮 %.3f 字节）\n",
+        ((LONGLONG)cbPrivateAfter - (LONGLONG)cbPrivateBefore) / 1024,
+        cTotal ? ((double)cbPrivateAfter - (double)cbPrivateBefore) / cTotal : 0.0);
+    wprintf(L"DllCanUnloadNow: %s（DLL 引用计数 %ld）\n", (hrUnload == S_OK) ? L"S_OK" : L"S_FALSE", statsAfter.cDllRefs);
+
+    bool fLeaked = (hrUnload != S_OK) || statsAfter.providers.cLive || statsAfter.credentials.cLive;
+    if (!fLeaked)
+    {
+        FreeLibrary(hDll);
+    }
+    return (fLeaked || context.cFailed) ? 1 : 0;
+}
@@ -0,0 +1,304 @@
+// WinUnlock 配置快照读取性能及压力测试
+//
+// 直接编译 DLL 的 ConfigSnapshot.cpp（见 ConfigSnapshot.h），多个读取线程不断读取当前快照，
+// 同时一个线程不断发布新快照，检查读取方拿到的快照从未被提前释放、内容前后一致且代数不回退，
+// 并与“共享 SRW 锁保护指针”的读取方式对比每次读取的耗时。不读写注册表，无需管理员权限。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. configbench.cpp ..\ConfigSnapshot.cpp ..\UnlockPolicy.cpp advapi32.lib ole32.lib
+//
+// 用法：
+//   configbench [/threads 读取线程数] [/duration 毫秒] [/interval 微秒]
+//     /interval  两次发布的间隔，默认 100；0 表示不间断发布
+
+#include "pch.h"
+#include <stdio.h>
+#include <vector>
+#include "ConfigSnapshot.h"
+#include "CredentialCache.h"
+
+// 快照内容都由代数推出，读取方据此检查拿到的快照是否完整
+static DWORD ExpectedDeadline(DWORD dwGeneration)
+{
+    return CREDENTIAL_FETCH_DEADLINE_MIN_MS + dwGeneration % 1000;
+}
+
+static DWORD ExpectedRules(DWORD dwGeneration)
+{
+    return dwGeneration % 4;
+}
+
+static HRESULT CreateTestSnapshot(DWORD dwGeneration, ConfigSnapshot** ppSnapshot)
+{
+    static const WCHAR c_szzPolicy[] = L"deny account a\0deny account b\0deny account c\0default allow\0";
+    // 从第 (3 - 规则数) 条开始取，得到 ExpectedRules 条 deny 规则
+    PCWSTR pszzPolicy = c_szzPolicy;
+    for (DWORD i = ExpectedRules(dwGeneration); i < 3; i++)
+    {
+        pszzPolicy += wcslen(pszzPolicy) + 1;
+    }
+    return ConfigSnapshot::Create(dwGeneration, ExpectedDeadline(dwGeneration), pszzPolicy, ppSnapshot);
+}
+
+enum BENCH_MODE
+{
+    BM_EPOCH = 0,       // ConfigReadScope
+    BM_SRWLOCK,         // 共享锁下读取指针，发布方取排他锁替换
+};
+
+struct BENCH_SHARED
+{
+    BENCH_MODE mode;
+    volatile LONG fStop;
+    SRWLOCK lock;
+    ConfigSnapshot* pLocked;    // BM_SRWLOCK 下的当前快照
+    DWORD dwIntervalUs;
+    LONG64 cPublished;
+    DWORD cMaxRetired;
+};
+
+struct BENCH_READER
+{
+    BENCH_SHARED* pShared;
+    LONG64 cReads;
+    LONG64 cErrors;
+    LONG64 llTicks;
+};
+
+// 快照未释放、内容与代数相符且代数不小于上一次读到的
+static bool CheckSnapshot(const ConfigSnapshot* pSnapshot, DWORD* pdwLastGeneration)
+{
+    if (!pSnapshot || !pSnapshot->IsAlive())
+    {
+        return false;
+    }
+    DWORD dwGeneration = pSnapshot->GetGeneration();
+    bool fValid = (pSnapshot->GetFetchDeadline() == ExpectedDeadline(dwGeneration)) &&
+        (pSnapshot->GetPolicy().GetRuleCount() == ExpectedRules(dwGeneration)) &&
+        (dwGeneration >= *pdwLastGeneration);
+    *pdwLastGeneration = dwGeneration;
+    return fValid;
+}
+
+// 每 64 次读取中有一次改用带引用计数的 ConfigSnapshotAcquire，覆盖在作用域之外持有快照的路径
+static DWORD WINAPI ReaderThread(PVOID pvContext)
+{
+    BENCH_READER* pReader = (BENCH_READER*)pvContext;
+    BENCH_SHARED* pShared = pReader->pShared;
+    DWORD dwLastGeneration = 0;
+
+    LARGE_INTEGER liBegin;
+    QueryPerformanceCounter(&liBegin);
+    while (!ReadAcquire(&pShared->fStop))
+    {
+        for (DWORD i = 0; i < 64; i++)
+        {
+            bool fValid;
+            if (pShared->mode == BM_SRWLOCK)
+            {
+                AcquireSRWLockShared(&pShared->lock);
+                fValid = CheckSnapshot(pShared->pLocked, &dwLastGeneration);
+                ReleaseSRWLockShared(&pShared->lock);
+            }
+            else if (i)
+            {
+                ConfigReadScope scope;
+                fValid = CheckSnapshot(scope.Get(), &dwLastGeneration);
+            }
+            else
+            {
+                ConfigSnapshot* pSnapshot = ConfigSnapshotAcquire();
+                fValid = CheckSnapshot(pSnapshot, &dwLastGeneration);
+                if (pSnapshot)
+                {
+                    pSnapshot->Release();
+                }
+            }
+            if (!fValid)
+            {
+                pReader->cErrors++;
+            }
+        }
+        pReader->cReads += 64;
+    }
+    LARGE_INTEGER liEnd;
+    QueryPerformanceCounter(&liEnd);
+    pReader->llTicks = liEnd.QuadPart - liBegin.QuadPart;
+    return 0;
+}
+
+// 按间隔发布新快照，直到读取线程结束
+static DWORD WINAPI PublisherThread(PVOID pvContext)
+{
+    BENCH_SHARED* pShared = (BENCH_SHARED*)pvContext;
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    LONGLONG llInterval = liFrequency.QuadPart * pShared->dwIntervalUs / 1000000;
+
+    DWORD dwGeneration = 1;
+    while (!ReadAcquire(&pShared->fStop))
+    {
+        LARGE_INTEGER liBegin;
+        QueryPerformanceCounter(&liBegin);
+
+        ConfigSnapshot* pSnapshot = nullptr;
+        if (SUCCEEDED(CreateTestSnapshot(++dwGeneration, &pSnapshot)))
+        {
+            if (pShared->mode == BM_SRWLOCK)
+            {
+                AcquireSRWLockExclusive(&pShared->lock);
+                ConfigSnapshot* pOld = pShared->pLocked;
+                pShared->pLocked = pSnapshot;
+                ReleaseSRWLockExclusive(&pShared->lock);
+                pOld->Release();
+            }
+            else
+            {
+                ConfigSnapshotPublish(pSnapshot);
+                CONFIG_SNAPSHOT_STATS stats;
+                ConfigSnapshotGetStats(&stats);
+                pShared->cMaxRetired = max(pShared->cMaxRetired, stats.cRetired);
+            }
+            pShared->cPublished++;
+        }
+
+        LARGE_INTEGER liNow;
+        do
+        {
+            YieldProcessor();
+            QueryPerformanceCounter(&liNow);
+        } while ((liNow.QuadPart - liBegin.QuadPart < llInterval) && !ReadAcquire(&pShared->fStop));
+    }
+    return 0;
+}
+
+static bool RunBench(BENCH_MODE mode, DWORD cThreads, DWORD dwDurationMs, DWORD dwIntervalUs)
+{
+    BENCH_SHARED shared = {};
+    shared.mode = mode;
+    shared.dwIntervalUs = dwIntervalUs;
+    InitializeSRWLock(&shared.lock);
+
+    ConfigSnapshot* pInitial = nullptr;
+    if (FAILED(CreateTestSnapshot(1, &pInitial)))
+    {
+        fwprintf(stderr, L"内存不足\n");
+        return false;
+    }
+    if (mode == BM_SRWLOCK)
+    {
+        shared.pLocked = pInitial;
+    }
+    else
+    {
+        ConfigSnapshotPublish(pInitial);
+    }
+
+    std::vector<BENCH_READER> readers(cThreads);
+    std::vector<HANDLE> handles;
+    for (DWORD i = 0; i < cThreads; i++)
+    {
+        readers[i].pShared = &shared;
+        HANDLE hThread = CreateThread(nullptr, 0, ReaderThread, &readers[i], 0, nullptr);
+        if (hThread)
+        {
+            handles.push_back(hThread);
+        }
+    }
+    HANDLE hPublisher = CreateThread(nullptr, 0, PublisherThread, &shared, 0, nullptr);
+    if (hPublisher)
+    {
+        handles.push_back(hPublisher);
+    }
+    if (!hPublisher || (handles.size() != cThreads + 1))
+    {
+        fwprintf(stderr, L"无法创建线程: %lu\n", GetLastError());
+        InterlockedExchange(&shared.fStop, TRUE);
+        WaitForMultipleObjects((DWORD)handles.size(), handles.data(), TRUE, INFINITE);
+        return false;
+    }
+
+    Sleep(dwDurationMs);
+    InterlockedExchange(&shared.fStop, TRUE);
+    WaitForMultipleObjects((DWORD)handles.size(), handles.data(), TRUE, INFINITE);
+    for (HANDLE hThread : handles)
+    {
+        CloseHandle(hThread);
+    }
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    LONG64 cReads = 0;
+    LONG64 cErrors = 0;
+    double dblNsPerRead = 0;
+    for (const BENCH_READER& reader : readers)
+    {
+        cReads += reader.cReads;
+        cErrors += reader.cErrors;
+        if (reader.cReads)
+        {
+            dblNsPerRead += (double)reader.llTicks * 1e9 / (double)liFrequency.QuadPart / (double)reader.cReads;
+        }
+    }
+    dblNsPerRead /= cThreads;
+
+    if (mode == BM_SRWLOCK)
+    {
+        shared.pLocked->Release();
+        printf("srwlock: %lu readers, %lld reads (%.1f ns/read), %lld publishes, %lld errors\n",
+            cThreads, cReads, dblNsPerRead, shared.cPublished, cErrors);
+    }
+    else
+    {
+        ConfigSnapshotCleanup();
+        CONFIG_SNAPSHOT_STATS stats;
+        ConfigSnapshotGetStats(&stats);
+        printf("epoch:   %lu readers, %lld reads (%.1f ns/read), %lld publishes, %lld reclaimed, max %lu retired, %lld errors\n",
+            cThreads, cReads, dblNsPerRead, shared.cPublished, stats.cReclaimed, shared.cMaxRetired, cErrors);
+    }
+    return cErrors == 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    DWORD cThreads = si.dwNumberOfProcessors;
+    DWORD dwDurationMs = 3000;
+    DWORD dwIntervalUs = 100;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((_wcsicmp(argv[i], L"/threads") == 0) && (i + 1 < argc))
+        {
+            cThreads = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/duration") == 0) && (i + 1 < argc))
+        {
+            dwDurationMs = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/interval") == 0) && (i + 1 < argc))
+        {
+            dwIntervalUs = wcstoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            fwprintf(stderr, L"用法：configbench [/threads 读取线程数] [/duration 毫秒] [/interval 微秒]\n");
+            return 1;
+        }
+    }
+    if (!cThreads || (cThreads >= MAXIMUM_WAIT_OBJECTS))
+    {
+        fwprintf(stderr, L"读取线程数应在 1～%d 之间\n", MAXIMUM_WAIT_OBJECTS - 1);
+        return 1;
+    }
+
+    bool fPassed = RunBench(BM_EPOCH, cThreads, dwDurationMs, dwIntervalUs);
+    fPassed = RunBench(BM_SRWLOCK, cThreads, dwDurationMs, dwIntervalUs) && fPassed;
+    if (!fPassed)
+    {
+        fwprintf(stderr, L"读取到已释放或不完整的快照\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,237 @@
+// WinUnlock 配置变更通知回环测试
+//
+// 模拟配置工具的保存（把 HKLM\SOFTWARE\WinUnlock\Generation 加一），测量从保存到新配置可见的延迟：
+//   默认在本进程内启动 ConfigWatcher（见 ConfigWatch.h），测量保存到回调的耗时；
+//   /session 时改为等待该会话中正在运行的提供程序在指标管道（见 Metrics.h）上报告新的
+//   winunlock_config_generation，即保存到后台重新加载完成的耗时，需开启 MetricsEnabled。
+// 需以管理员身份运行。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. configwatch.cpp ..\ConfigWatch.cpp advapi32.lib
+//
+// 用法：
+//   configwatch [/count 次数] [/interval 毫秒] [/debounce 毫秒] [/session 会话号]
+//     /interval  上一次保存生效后到下一次保存的间隔，默认 1000
+//     /debounce  本进程内测量时的防抖时间，默认 CONFIG_WATCH_DEBOUNCE_MS；0 可测出防抖之外的通知延迟
+
+#include "pch.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "ConfigWatch.h"
+#include "Metrics.h"
+
+HINSTANCE g_hinst = nullptr;
+
+static const WCHAR c_szConfigKey[] = L"SOFTWARE\\WinUnlock";
+
+struct WATCH_CONTEXT
+{
+    HANDLE hChanged;
+    volatile LONG lGeneration;
+};
+
+static void CALLBACK OnConfigChanged(void* pvContext, DWORD dwGeneration)
+{
+    WATCH_CONTEXT* pContext = static_cast<WATCH_CONTEXT*>(pvContext);
+    InterlockedExchange(&pContext->lGeneration, (LONG)dwGeneration);
+    SetEvent(pContext->hChanged);
+}
+
+// 与配置工具相同：读出 Generation 加一后写回
+static HRESULT BumpGeneration(DWORD* pdwGeneration)
+{
+    HKEY hKey;
+    LSTATUS ls = RegCreateKeyExW(HKEY_LOCAL_MACHINE, c_szConfigKey, 0, nullptr, 0, KEY_QUERY_VALUE | KEY_SET_VALUE, nullptr, &hKey, nullptr);
+    if (ls != ERROR_SUCCESS)
+    {
+        return HRESULT_FROM_WIN32(ls);
+    }
+    DWORD dwGeneration = 0;
+    DWORD cbGeneration = sizeof(dwGeneration);
+    if (RegGetValueW(hKey, nullptr, CONFIG_GENERATION_VALUE, RRF_RT_REG_DWORD, nullptr, &dwGeneration, &cbGeneration) != ERROR_SUCCESS)
+    {
+        dwGeneration = 0;
+    }
+    dwGeneration++;
+    ls = RegSetValueExW(hKey, CONFIG_GENERATION_VALUE, 0, REG_DWORD, (const BYTE*)&dwGeneration, sizeof(dwGeneration));
+    RegCloseKey(hKey);
+    *pdwGeneration = dwGeneration;
+    return HRESULT_FROM_WIN32(ls);
+}
+
+// 读取一次指标文本中的 winunlock_config_generation；提供程序尚未重新加载过时返回 false
+static bool ScrapeConfigGeneration(PCWSTR pszPipeName, DWORD* pdwGeneration)
+{
+    HANDLE hPipe = CreateFileW(pszPipeName, GENERIC_READ | FILE_WRITE_ATTRIBUTES, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (hPipe == INVALID_HANDLE_VALUE)
+    {
+        if (GetLastError() == ERROR_PIPE_BUSY)
+        {
+            WaitNamedPipeW(pszPipeName, METRICS_IO_TIMEOUT_MS);
+        }
+        return false;
+    }
+
+    std::string text;
+    DWORD dwMode = PIPE_READMODE_MESSAGE;
+    if (SetNamedPipeHandleState(hPipe, &dwMode, nullptr, nullptr))
+    {
+        char rgch[4096];
+        for (;;)
+        {
+            DWORD cbRead = 0;
+            BOOL fComplete = ReadFile(hPipe, rgch, sizeof(rgch), &cbRead, nullptr);
+            if (!fComplete && (GetLastError() != ERROR_MORE_DATA))
+            {
+                break;
+            }
+            text.append(rgch, cbRead);
+            if (fComplete)
+            {
+                break;
+            }
+        }
+    }
+    CloseHandle(hPipe);
+
+    static const char c_szGauge[] = "\nwinunlock_config_generation ";
+    size_t ich = text.find(c_szGauge);
+    if (ich == std::string::npos)
+    {
+        return false;
+    }
+    *pdwGeneration = strtoul(text.c_str() + ich + sizeof(c_szGauge) - 1, nullptr, 10);
+    return true;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    DWORD cCount = 20;
+    DWORD dwIntervalMs = 1000;
+    DWORD dwDebounceMs = CONFIG_WATCH_DEBOUNCE_MS;
+    DWORD dwSessionId = 0;
+    bool fSession = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((_wcsicmp(argv[i], L"/count") == 0) && (i + 1 < argc))
+        {
+            cCount = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/interval") == 0) && (i + 1 < argc))
+        {
+            dwIntervalMs = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/debounce") == 0) && (i + 1 < argc))
+        {
+            dwDebounceMs = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/session") == 0) && (i + 1 < argc))
+        {
+            dwSessionId = wcstoul(argv[++i], nullptr, 10);
+            fSession = true;
+        }
+        else
+        {
+            fwprintf(stderr, L"用法：configwatch [/count 次数] [/interval 毫秒] [/debounce 毫秒] [/session 会话号]\n");
+            return 1;
+        }
+    }
+    if (!cCount)
+    {
+        cCount = 1;
+    }
+
+    g_hinst = GetModuleHandleW(nullptr);
+    WATCH_CONTEXT context = { CreateEventW(nullptr, FALSE, FALSE, nullptr), 0 };
+    ConfigWatcher watcher;
+    WCHAR szPipeName[64];
+    if (fSession)
+    {
+        StringCchPrintfW(szPipeName, ARRAYSIZE(szPipeName), METRICS_PIPE_FORMAT, dwSessionId);
+    }
+    else
+    {
+        // 先确保配置键存在，否则 Start 返回 S_FALSE 不监听
+        DWORD dwGeneration;
+        HRESULT hr = BumpGeneration(&dwGeneration);
+        if (SUCCEEDED(hr))
+        {
+            hr = watcher.Start(OnConfigChanged, &context, dwDebounceMs);
+        }
+        if (hr != S_OK)
+        {
+            fwprintf(stderr, L"无法监听配置键（需要管理员权限）: 0x%08lx\n", hr);
+            return 1;
+        }
+    }
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    std::vector<double> latencies;
+    DWORD dwTimeoutMs = (fSession ? CONFIG_WATCH_DEBOUNCE_MS : dwDebounceMs) + 10000;
+
+    for (DWORD i = 0; i < cCount; i++)
+    {
+        DWORD dwGeneration = 0;
+        LARGE_INTEGER liBegin;
+        QueryPerformanceCounter(&liBegin);
+        HRESULT hr = BumpGeneration(&dwGeneration);
+        if (FAILED(hr))
+        {
+            fwprintf(stderr, L"无法写入 Generation（需要管理员权限）: 0x%08lx\n", hr);
+            return 1;
+        }
+
+        bool fVisible = false;
+        ULONGLONG ullStart = GetTickCount64();
+        if (fSession)
+        {
+            // 提供程序重新加载后才更新该值；轮询间隔 1 毫秒，读取本身的耗时计入延迟
+            DWORD dwSeen = 0;
+            while (!fVisible && (GetTickCount64() - ullStart < dwTimeoutMs))
+            {
+                fVisible = ScrapeConfigGeneration(szPipeName, &dwSeen) && (dwSeen == dwGeneration);
+                if (!fVisible)
+                {
+                    Sleep(1);
+                }
+            }
+        }
+        else
+        {
+            while (!fVisible && (WaitForSingleObject(context.hChanged, dwTimeoutMs) == WAIT_OBJECT_0))
+            {
+                fVisible = ((DWORD)context.lGeneration == dwGeneration);
+            }
+        }
+
+        LARGE_INTEGER liEnd;
+        QueryPerformanceCounter(&liEnd);
+        if (fVisible)
+        {
+            latencies.push_back((double)(liEnd.QuadPart - liBegin.QuadPart) * 1000.0 / (double)liFrequency.QuadPart);
+        }
+        else
+        {
+            fwprintf(stderr, L"第 %lu 次保存（Generation %lu）在 %lu 毫秒内未生效\n", i + 1, dwGeneration, dwTimeoutMs);
+            return 1;
+        }
+
+        if (dwIntervalMs && (i + 1 < cCount))
+        {
+            Sleep(dwIntervalMs);
+        }
+    }
+    watcher.Stop();
+    CloseHandle(context.hChanged);
+
+    std::sort(latencies.begin(), latencies.end());
+    printf("saves %zu, save-to-visible p50 %.2f ms, p99 %.2f ms, max %.2f ms%s\n", latencies.size(),
+        latencies[latencies.size() / 2], latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)], latencies.back(),
+        fSession ? " (provider reload)" : "");
+    return 0;
+}
@@ -0,0 +1,396 @@
+// WinUnlock 登录流程模拟及序列化耗时测试
+//
+// 直接加载 winunlock.dll（不经 COM 注册、不需要 LogonUI），按 LogonUI 的调用顺序反复驱动提供程序和凭据：
+// DllGetClassObject -> CreateInstance -> SetUsageScenario -> Advise -> GetFieldDescriptorCount/GetFieldDescriptorAt
+// -> GetCredentialCount -> GetCredentialAt -> SetSelected -> GetSerialization -> ReportResult，
+// 分别输出 CPUS_LOGON 和 CPUS_UNLOCK_WORKSTATION 从 SetUsageScenario 到 GetSerialization 返回的耗时分位数。
+// 磁贴未自动提交时与 LogonUI 相同，等待 CredentialsChanged 后重新查询一次。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. logonsim.cpp ole32.lib shlwapi.lib
+//
+// 用法：
+//   logonsim [/dll 路径] [/iterations 轮数] [/wait 毫秒] [/noreport]
+//     /dll         默认使用注册表中 InprocServer32 指向的 DLL
+//     /iterations  每个场景的轮数，默认 2000
+//     /wait        未自动提交时等待 CredentialsChanged 的时间，默认 1000
+//     /noreport    不调用 ReportResult（默认以 STATUS_SUCCESS 报告，会写入审计日志和结果缓存）
+
+#include "pch.h"
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "CredentialProvider.h"
+#include "LatencyTrace.h"
+
+typedef HRESULT(STDAPICALLTYPE* PFN_DLL_GET_CLASS_OBJECT)(REFCLSID, REFIID, void**);
+
+// 预热轮数：首轮会初始化字符串表、配置快照等只加载一次的数据，不计入统计
+#define LOGONSIM_WARMUP_ITERATIONS 16
+
+#define LOGONSIM_STATUS_SUCCESS ((NTSTATUS)0x00000000L)
+
+// LogonUI 一侧的 ICredentialProviderEvents：记录通知并唤醒等待的模拟线程
+class SimEvents : public ICredentialProviderEvents
+{
+public:
+    SimEvents() : _cRef(1), _cNotifications(0)
+    {
+        _hChanged = CreateEventW(nullptr, FALSE, FALSE, nullptr);
+    }
+
+    ~SimEvents()
+    {
+        if (_hChanged)
+        {
+            CloseHandle(_hChanged);
+        }
+    }
+
+    IFACEMETHODIMP_(ULONG) AddRef()
+    {
+        return InterlockedIncrement(&_cRef);
+    }
+
+    IFACEMETHODIMP_(ULONG) Release()
+    {
+        // 栈上对象，不随引用计数释放
+        return InterlockedDecrement(&_cRef);
+    }
+
+    IFACEMETHODIMP QueryInterface(REFIID riid, void** ppv)
+    {
+        static const QITAB qit[] =
+        {
+            QITABENT(SimEvents, ICredentialProviderEvents),
+            { 0 },
+        };
+        return QISearch(this, qit, riid, ppv);
+    }
+
+    IFACEMETHODIMP CredentialsChanged(UINT_PTR upAdviseContext)
+    {
+        UNREFERENCED_PARAMETER(upAdviseContext);
+        InterlockedIncrement(&_cNotifications);
+        SetEvent(_hChanged);
+        return S_OK;
+    }
+
+    bool IsValid() const
+    {
+        return _hChanged != nullptr;
+    }
+
+    void Reset()
+    {
+        ResetEvent(_hChanged);
+    }
+
+    bool Wait(DWORD dwMilliseconds)
+    {
+        return WaitForSingleObject(_hChanged, dwMilliseconds) == WAIT_OBJECT_0;
+    }
+
+    LONG GetNotifications() const
+    {
+        return _cNotifications;
+    }
+
+private:
+    volatile LONG _cRef;
+    volatile LONG _cNotifications;
+    HANDLE _hChanged;
+};
+
+struct SIM_CONTEXT
+{
+    PFN_DLL_GET_CLASS_OBJECT pfnGetClassObject;
+    DWORD dwWaitMs;
+    bool fReport;
+};
+
+// 一个场景的统计
+struct SIM_RESULT
+{
+    std::vector<double> serializeMs;    // 返回凭据的轮次，SetUsageScenario 到 GetSerialization 返回
+    DWORD cSerialized;
+    DWORD cNotFinished;                 // 未返回凭据（等待解锁信号、自动解锁已关闭等）
+    DWORD cNoTile;
+    DWORD cRequeried;                   // 收到 CredentialsChanged 后重新查询的轮次
+    DWORD cFailed;
+    HRESULT hrFirstFailure;
+};
+
+static void FreeFieldDescriptor(CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* pcpfd)
+{
+    if (pcpfd)
+    {
+        CoTaskMemFree(pcpfd->pszLabel);
+        CoTaskMemFree(pcpfd);
+    }
+}
+
+// 与 LogonUI 相同：枚举磁贴并选中默认磁贴，返回选中的凭据
+static HRESULT SelectCredential(ICredentialProvider* pcp, ICredentialProviderCredential** ppcpc, BOOL* pbAutoLogon)
+{
+    *ppcpc = nullptr;
+    *pbAutoLogon = FALSE;
+
+    DWORD cCredentials = 0;
+    DWORD dwDefault = CREDENTIAL_PROVIDER_NO_DEFAULT;
+    BOOL bAutoLogonWithDefault = FALSE;
+    HRESULT hr = pcp->GetCredentialCount(&cCredentials, &dwDefault, &bAutoLogonWithDefault);
+    if (FAILED(hr) || !cCredentials)
+    {
+        return hr;
+    }
+
+    ICredentialProviderCredential* pcpc = nullptr;
+    hr = pcp->GetCredentialAt((dwDefault < cCredentials) ? dwDefault : 0, &pcpc);
+    if (SUCCEEDED(hr))
+    {
+        BOOL bAutoLogon = FALSE;
+        hr = pcpc->SetSelected(&bAutoLogon);
+        if (SUCCEEDED(hr))
+        {
+            *ppcpc = pcpc;
+            *pbAutoLogon = bAutoLogon || bAutoLogonWithDefault;
+        }
+        else
+        {
+            pcpc->Release();
+        }
+    }
+    return hr;
+}
+
+static HRESULT RunIteration(const SIM_CONTEXT* pContext, CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, SimEvents* pEvents, SIM_RESULT* pResult)
+{
+    IClassFactory* pcf = nullptr;
+    HRESULT hr = pContext->pfnGetClassObject(CLSID_WinUnlockProvider, IID_PPV_ARGS(&pcf));
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ICredentialProvider* pcp = nullptr;
+    hr = pcf->CreateInstance(nullptr, IID_PPV_ARGS(&pcp));
+    pcf->Release();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    pEvents->Reset();
+    LARGE_INTEGER liStart;
+    QueryPerformanceCounter(&liStart);
+    hr = pcp->SetUsageScenario(cpus, 0);
+    if (SUCCEEDED(hr))
+    {
+        hr = pcp->Advise(pEvents, (UINT_PTR)cpus);
+    }
+
+    DWORD cFields = 0;
+    if (SUCCEEDED(hr))
+    {
+        hr = pcp->GetFieldDescriptorCount(&cFields);
+    }
+    for (DWORD i = 0; SUCCEEDED(hr) && (i < cFields); i++)
+    {
+        CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* pcpfd = nullptr;
+        hr = pcp->GetFieldDescriptorAt(i, &pcpfd);
+        FreeFieldDescriptor(pcpfd);
+    }
+
+    ICredentialProviderCredential* pcpc = nullptr;
+    BOOL bAutoLogon = FALSE;
+    if (SUCCEEDED(hr))
+    {
+        hr = SelectCredential(pcp, &pcpc, &bAutoLogon);
+    }
+
+    // 快照未在期限内就绪时磁贴先按“不自动解锁”显示，预取完成后提供程序通知 LogonUI 重新查询
+    if (SUCCEEDED(hr) && !bAutoLogon && pContext->dwWaitMs && pEvents->Wait(pContext->dwWaitMs))
+    {
+        pResult->cRequeried++;
+        if (pcpc)
+        {
+            pcpc->Release();
+            pcpc = nullptr;
+        }
+        hr = SelectCredential(pcp, &pcpc, &bAutoLogon);
+    }
+
+    if (SUCCEEDED(hr) && !pcpc)
+    {
+        pResult->cNoTile++;
+    }
+    else if (SUCCEEDED(hr))
+    {
+        CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE cpgsr = CPGSR_NO_CREDENTIAL_NOT_FINISHED;
+        CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION cpcs = { 0 };
+        PWSTR pszStatus = nullptr;
+        CREDENTIAL_PROVIDER_STATUS_ICON cpsi = CPSI_NONE;
+        hr = pcpc->GetSerialization(&cpgsr, &cpcs, &pszStatus, &cpsi);
+        LARGE_INTEGER liEnd;
+        QueryPerformanceCounter(&liEnd);
+        CoTaskMemFree(pszStatus);
+
+        if (SUCCEEDED(hr) && (cpgsr == CPGSR_RETURN_CREDENTIAL_FINISHED))
+        {
+            LARGE_INTEGER liFrequency;
+            QueryPerformanceFrequency(&liFrequency);
+            pResult->serializeMs.push_back((double)(liEnd.QuadPart - liStart.QuadPart) * 1000.0 / liFrequency.QuadPart);
+            pResult->cSerialized++;
+
+            // 序列化缓冲区含密码，释放前清零
+            if (cpcs.rgbSerialization)
+            {
+                SecureZeroMemory(cpcs.rgbSerialization, cpcs.cbSerialization);
+                CoTaskMemFree(cpcs.rgbSerialization);
+            }
+
+            if (pContext->fReport)
+            {
+                PWSTR pszResult = nullptr;
+                CREDENTIAL_PROVIDER_STATUS_ICON cpsiResult = CPSI_NONE;
+                pcpc->ReportResult(LOGONSIM_STATUS_SUCCESS, LOGONSIM_STATUS_SUCCESS, &pszResult, &cpsiResult);
+                CoTaskMemFree(pszResult);
+            }
+        }
+        else if (SUCCEEDED(hr))
+        {
+            pResult->cNotFinished++;
+        }
+    }
+
+    if (pcpc)
+    {
+        pcpc->SetDeselected();
+        pcpc->Release();
+    }
+    pcp->UnAdvise();
+    pcp->Release();
+    return hr;
+}
+
+static void RunScenario(const SIM_CONTEXT* pContext, CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, PCWSTR pszName, DWORD cIterations, SimEvents* pEvents)
+{
+    SIM_RESULT warmup = {};
+    for (DWORD i = 0; i < LOGONSIM_WARMUP_ITERATIONS; i++)
+    {
+        RunIteration(pContext, cpus, pEvents, &warmup);
+    }
+
+    SIM_RESULT result = {};
+    result.serializeMs.reserve(cIterations);
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        HRESULT hr = RunIteration(pContext, cpus, pEvents, &result);
+        if (FAILED(hr) && (result.cFailed++ == 0))
+        {
+            result.hrFirstFailure = hr;
+        }
+    }
+
+    wprintf(L"%s：%lu 轮，返回凭据 %lu，未返回凭据 %lu，没有磁贴 %lu，重新查询 %lu，失败 %lu\n",
+        pszName, cIterations, result.cSerialized, result.cNotFinished, result.cNoTile, result.cRequeried, result.cFailed);
+    if (result.cFailed)
+    {
+        wprintf(L"  首个错误 0x%08lx\n", result.hrFirstFailure);
+    }
+    if (!result.serializeMs.empty())
+    {
+        std::sort(result.serializeMs.begin(), result.serializeMs.end());
+        wprintf(L"  到序列化的耗时（毫秒）: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+            TracePercentile(result.serializeMs.data(), result.serializeMs.size(), 0.50),
+            TracePercentile(result.serializeMs.data(), result.serializeMs.size(), 0.90),
+            TracePercentile(result.serializeMs.data(), result.serializeMs.size(), 0.99), result.serializeMs.back());
+    }
+}
+
+// 从 InprocServer32 读取已注册的 DLL 路径
+static bool GetRegisteredDllPath(PWSTR pszPath, DWORD cchPath)
+{
+    WCHAR szClsid[40];
+    WCHAR szKey[80];
+    StringFromGUID2(CLSID_WinUnlockProvider, szClsid, ARRAYSIZE(szClsid));
+    swprintf_s(szKey, L"CLSID\\%s\\InprocServer32", szClsid);
+    DWORD cbPath = cchPath * sizeof(WCHAR);
+    return RegGetValueW(HKEY_CLASSES_ROOT, szKey, nullptr, RRF_RT_REG_SZ, nullptr, pszPath, &cbPath) == ERROR_SUCCESS;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    WCHAR szDllPath[MAX_PATH] = L"";
+    DWORD cIterations = 2000;
+    SIM_CONTEXT context = {};
+    context.dwWaitMs = 1000;
+    context.fReport = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((_wcsicmp(argv[i], L"/dll") == 0) && (i + 1 < argc))
+        {
+            wcscpy_s(szDllPath, argv[++i]);
+        }
+        else if ((_wcsicmp(argv[i], L"/iterations") == 0) && (i + 1 < argc))
+        {
+            cIterations = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/wait") == 0) && (i + 1 < argc))
+        {
+            context.dwWaitMs = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if (_wcsicmp(argv[i], L"/noreport") == 0)
+        {
+            context.fReport = false;
+        }
+        else
+        {
+            fwprintf(stderr, L"用法: logonsim [/dll 路径] [/iterations 轮数] [/wait 毫秒] [/noreport]\n");
+            return 1;
+        }
+    }
+    if (!cIterations)
+    {
+        fwprintf(stderr, L"轮数不能为 0\n");
+        return 1;
+    }
+    if (!szDllPath[0] && !GetRegisteredDllPath(szDllPath, ARRAYSIZE(szDllPath)))
+    {
+        fwprintf(stderr, L"提供程序未注册，请用 /dll 指定 winunlock.dll\n");
+        return 1;
+    }
+
+    HRESULT hrInit = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+    HMODULE hDll = LoadLibraryW(szDllPath);
+    if (!hDll)
+    {
+        fwprintf(stderr, L"无法加载 %s: %lu\n", szDllPath, GetLastError());
+        return 1;
+    }
+    context.pfnGetClassObject = (PFN_DLL_GET_CLASS_OBJECT)GetProcAddress(hDll, "DllGetClassObject");
+    if (!context.pfnGetClassObject)
+    {
+        fwprintf(stderr, L"%s 缺少 DllGetClassObject\n", szDllPath);
+        return 1;
+    }
+
+    SimEvents events;
+    if (!events.IsValid())
+    {
+        fwprintf(stderr, L"无法创建事件: %lu\n", GetLastError());
+        return 1;
+    }
+    RunScenario(&context, CPUS_LOGON, L"CPUS_LOGON", cIterations, &events);
+    RunScenario(&context, CPUS_UNLOCK_WORKSTATION, L"CPUS_UNLOCK_WORKSTATION", cIterations, &events);
+    wprintf(L"CredentialsChanged 共 %ld 次\n", events.GetNotifications());
+
+    // 线程池上的预取可能仍持有提供程序，不卸载 DLL，由进程退出回收
+    if (SUCCEEDED(hrInit))
+    {
+        CoUninitialize();
+    }
+    return 0;
+}
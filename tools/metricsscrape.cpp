@@ -0,0 +1,122 @@
+// WinUnlock 指标读取工具
+//
+// 连接 winunlock.dll 的指标管道（见 Metrics.h），把 Prometheus 文本原样输出到标准输出，
+// 可由采集代理的文本文件收集器或脚本调用；/repeat 反复读取并输出每次读取的耗时。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. metricsscrape.cpp
+//
+// 用法：
+//   metricsscrape [/session 会话号] [/repeat 次数]
+//     /session  默认为本工具所在会话；控制台登录界面通常是会话 1
+
+#include "pch.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "Metrics.h"
+
+// 以消息模式读取一条完整的指标文本，读完即关闭连接
+static HRESULT Scrape(PCWSTR pszPipeName, std::string& text)
+{
+    text.clear();
+    if (!WaitNamedPipeW(pszPipeName, METRICS_IO_TIMEOUT_MS))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    HANDLE hPipe = CreateFileW(pszPipeName, GENERIC_READ | FILE_WRITE_ATTRIBUTES, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+    if (hPipe == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    DWORD dwMode = PIPE_READMODE_MESSAGE;
+    if (!SetNamedPipeHandleState(hPipe, &dwMode, nullptr, nullptr))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    char rgch[4096];
+    while (SUCCEEDED(hr))
+    {
+        DWORD cbRead = 0;
+        BOOL fComplete = ReadFile(hPipe, rgch, sizeof(rgch), &cbRead, nullptr);
+        DWORD dwError = fComplete ? ERROR_SUCCESS : GetLastError();
+        if (!fComplete && (dwError != ERROR_MORE_DATA))
+        {
+            hr = HRESULT_FROM_WIN32(dwError);
+            break;
+        }
+        text.append(rgch, cbRead);
+        if (fComplete)
+        {
+            break;
+        }
+    }
+    CloseHandle(hPipe);
+    return hr;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    DWORD dwSessionId = 0;
+    ProcessIdToSessionId(GetCurrentProcessId(), &dwSessionId);
+    DWORD cRepeat = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((_wcsicmp(argv[i], L"/session") == 0) && (i + 1 < argc))
+        {
+            dwSessionId = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/repeat") == 0) && (i + 1 < argc))
+        {
+            cRepeat = wcstoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            fwprintf(stderr, L"用法：metricsscrape [/session 会话号] [/repeat 次数]\n");
+            return 1;
+        }
+    }
+
+    WCHAR szPipeName[64];
+    StringCchPrintfW(szPipeName, ARRAYSIZE(szPipeName), METRICS_PIPE_FORMAT, dwSessionId);
+
+    std::string text;
+    if (!cRepeat)
+    {
+        HRESULT hr = Scrape(szPipeName, text);
+        if (FAILED(hr))
+        {
+            fwprintf(stderr, L"无法读取 %s（指标未开启或提供程序未加载）: 0x%08lx\n", szPipeName, hr);
+            return 1;
+        }
+        fwrite(text.data(), 1, text.size(), stdout);
+        return 0;
+    }
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    std::vector<double> durations;
+    for (DWORD i = 0; i < cRepeat; i++)
+    {
+        LARGE_INTEGER liBegin;
+        LARGE_INTEGER liEnd;
+        QueryPerformanceCounter(&liBegin);
+        HRESULT hr = Scrape(szPipeName, text);
+        QueryPerformanceCounter(&liEnd);
+        if (FAILED(hr))
+        {
+            fwprintf(stderr, L"第 %lu 次读取失败: 0x%08lx\n", i + 1, hr);
+            return 1;
+        }
+        durations.push_back((double)(liEnd.QuadPart - liBegin.QuadPart) * 1e6 / (double)liFrequency.QuadPart);
+    }
+    std::sort(durations.begin(), durations.end());
+    printf("scrapes %lu, %zu bytes, p50 %.1f us, p99 %.1f us, max %.1f us\n", cRepeat, text.size(),
+        durations[durations.size() / 2], durations[min(durations.size() - 1, durations.size() * 99 / 100)], durations.back());
+    return 0;
+}
@@ -0,0 +1,1006 @@
+// WinUnlock 批量部署工具
+//
+// 从主机清单为每台主机生成可直接部署的配置文件 <主机名>.bin。密码以主机密钥（由主密钥和主机名派生）密封，
+// 文件格式与 winunlock.dll 读取的 config.bin 相同：打包和密封代码直接编译自 DLL 的 ConfigFormat.cpp / ConfigSeal.cpp。
+// 清单以流方式读取，同一主机的行须相邻；在处理中的主机数有上限，内存占用与清单行数无关。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. provision.cpp ..\ConfigFormat.cpp ..\ConfigFile.cpp ..\ConfigSeal.cpp ..\SecretArena.cpp
+//      advapi32.lib bcrypt.lib crypt32.lib ole32.lib shlwapi.lib
+//
+// 用法：
+//   provision /genmaster 主密钥文件
+//   provision /master 主密钥文件 /in 清单 /out 输出目录 [/keys 密钥目录] [/threads 线程数] [/serial 序号]
+//     /keys     同时写出每台主机的密钥 <主机名>.key，应与配置文件分开分发
+//     /serial   配置序号，默认为当前时间（秒），保证重新部署的配置比旧配置新
+//   provision /hostkey 主密钥文件 主机名 输出文件
+//   provision /install 配置文件 主机密钥文件
+//     在目标主机上（管理员）校验两者匹配后安装到 %ProgramData%\WinUnlock
+//
+// 清单（UTF-8）：
+//   CSV   host,username,password[,sid]，字段可用双引号包围（"" 表示引号），空行、# 开头的行和表头行被忽略
+//   JSON  对象数组或每行一个对象（JSON Lines），字段 host / username / password / sid，值均为字符串
+
+#include "pch.h"
+#include <bcrypt.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include "ConfigFile.h"
+#include "ConfigSeal.h"
+
+// 每个线程最多排队的主机数，限制同时驻留内存的清单行
+#define PROVISION_JOBS_PER_THREAD   4
+
+// 进度输出间隔
+#define PROVISION_PROGRESS_MS       2000
+
+// 主密钥文件大小上限
+#define PROVISION_MASTER_KEY_MAX    4096
+
+static void WipeString(std::string& s)
+{
+    if (!s.empty())
+    {
+        SecureZeroMemory(&s[0], s.size());
+    }
+    s.clear();
+}
+
+static void WipeString(std::wstring& s)
+{
+    if (!s.empty())
+    {
+        SecureZeroMemory(&s[0], s.size() * sizeof(WCHAR));
+    }
+    s.clear();
+}
+
+static HRESULT Utf8ToWide(const std::string& s, std::wstring* pws)
+{
+    pws->clear();
+    if (s.empty())
+    {
+        return S_OK;
+    }
+    int cch = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, s.data(), (int)s.size(), nullptr, 0);
+    if (!cch)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    pws->resize(cch);
+    MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, s.data(), (int)s.size(), &(*pws)[0], cch);
+    return S_OK;
+}
+
+static void AppendUtf8(std::string* ps, DWORD dwCodePoint)
+{
+    if (dwCodePoint < 0x80)
+    {
+        ps->push_back((char)dwCodePoint);
+    }
+    else if (dwCodePoint < 0x800)
+    {
+        ps->push_back((char)(0xC0 | (dwCodePoint >> 6)));
+        ps->push_back((char)(0x80 | (dwCodePoint & 0x3F)));
+    }
+    else if (dwCodePoint < 0x10000)
+    {
+        ps->push_back((char)(0xE0 | (dwCodePoint >> 12)));
+        ps->push_back((char)(0x80 | ((dwCodePoint >> 6) & 0x3F)));
+        ps->push_back((char)(0x80 | (dwCodePoint & 0x3F)));
+    }
+    else
+    {
+        ps->push_back((char)(0xF0 | (dwCodePoint >> 18)));
+        ps->push_back((char)(0x80 | ((dwCodePoint >> 12) & 0x3F)));
+        ps->push_back((char)(0x80 | ((dwCodePoint >> 6) & 0x3F)));
+        ps->push_back((char)(0x80 | (dwCodePoint & 0x3F)));
+    }
+}
+
+static HRESULT ReadFileBytes(PCWSTR pszPath, DWORD cbMax, std::vector<BYTE>* pData)
+{
+    HANDLE hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    LARGE_INTEGER liSize;
+    if (!GetFileSizeEx(hFile, &liSize))
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    else if ((liSize.QuadPart <= 0) || (liSize.QuadPart > cbMax))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    else
+    {
+        pData->resize((size_t)liSize.QuadPart);
+        DWORD cbRead = 0;
+        if (!ReadFile(hFile, pData->data(), (DWORD)pData->size(), &cbRead, nullptr))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+        else if (cbRead != pData->size())
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+    CloseHandle(hFile);
+    return hr;
+}
+
+// 主机名同时用作文件名
+static bool IsValidHostName(const std::wstring& host)
+{
+    if (host.empty() || (host.size() > CONFIG_HOST_NAME_MAX))
+    {
+        return false;
+    }
+    return host.find_first_of(L"\\/:*?\"<>|") == std::wstring::npos;
+}
+
+static ULONGLONG HashHostName(const std::wstring& host)
+{
+    ULONGLONG ullHash = 14695981039346656037ULL;
+    for (WCHAR ch : host)
+    {
+        if ((ch >= L'a') && (ch <= L'z'))
+        {
+            ch -= L'a' - L'A';
+        }
+        ullHash = (ullHash ^ ch) * 1099511628211ULL;
+    }
+    return ullHash;
+}
+
+// 清单
+
+struct INVENTORY_ROW
+{
+    std::wstring host;
+    std::wstring username;
+    std::wstring password;
+    std::wstring sid;
+    DWORD dwLine;
+
+    ~INVENTORY_ROW() { WipeString(password); }
+};
+
+// 流式清单读取：固定大小的读缓冲区，按字节解析 CSV 或 JSON
+class InventoryReader
+{
+public:
+    InventoryReader() :
+        _hFile(INVALID_HANDLE_VALUE),
+        _ib(0),
+        _cb(0),
+        _ullBytesRead(0),
+        _dwLine(1),
+        _fJson(false),
+        _fHeaderChecked(false),
+        _fArrayClosed(false)
+    {
+    }
+
+    ~InventoryReader()
+    {
+        if (_hFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(_hFile);
+        }
+        SecureZeroMemory(_rgb, sizeof(_rgb));
+    }
+
+    HRESULT Open(PCWSTR pszPath)
+    {
+        _hFile = CreateFileW(pszPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (_hFile == INVALID_HANDLE_VALUE)
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+
+        // 跳过 UTF-8 BOM，按第一个非空白字符判断格式
+        if ((_Peek() == 0xEF) && (_Get(), _Peek() == 0xBB) && (_Get(), _Peek() == 0xBF))
+        {
+            _Get();
+        }
+        _SkipWhitespace();
+        _fJson = (_Peek() == '[') || (_Peek() == '{');
+        if (_fJson && (_Peek() == '['))
+        {
+            _Get();
+        }
+        return S_OK;
+    }
+
+    // 读取下一行账户，清单结束返回 S_FALSE
+    HRESULT Next(INVENTORY_ROW* pRow)
+    {
+        return _fJson ? _NextJson(pRow) : _NextCsv(pRow);
+    }
+
+    DWORD GetLine() const { return _dwLine; }
+    ULONGLONG GetBytesRead() const { return _ullBytesRead; }
+
+private:
+    int _Peek()
+    {
+        if (_ib == _cb)
+        {
+            DWORD cbRead = 0;
+            if (!ReadFile(_hFile, _rgb, sizeof(_rgb), &cbRead, nullptr) || !cbRead)
+            {
+                return EOF;
+            }
+            _ib = 0;
+            _cb = cbRead;
+            _ullBytesRead += cbRead;
+        }
+        return _rgb[_ib];
+    }
+
+    int _Get()
+    {
+        int c = _Peek();
+        if (c != EOF)
+        {
+            _ib++;
+            if (c == '\n')
+            {
+                _dwLine++;
+            }
+        }
+        return c;
+    }
+
+    void _SkipWhitespace()
+    {
+        for (int c = _Peek(); (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n'); c = _Peek())
+        {
+            _Get();
+        }
+    }
+
+    static HRESULT _Assign(std::string& field, std::wstring* pws)
+    {
+        HRESULT hr = Utf8ToWide(field, pws);
+        WipeString(field);
+        return hr;
+    }
+
+    HRESULT _NextCsv(INVENTORY_ROW* pRow)
+    {
+        std::vector<std::string> fields;
+        for (;;)
+        {
+            if (_Peek() == EOF)
+            {
+                return S_FALSE;
+            }
+
+            pRow->dwLine = _dwLine;
+            fields.assign(1, std::string());
+            bool fInQuotes = false;
+            bool fQuoted = false;
+            for (int c = _Get(); c != EOF; c = _Get())
+            {
+                if (fInQuotes)
+                {
+                    if (c != '"')
+                    {
+                        fields.back().push_back((char)c);
+                    }
+                    else if (_Peek() == '"')
+                    {
+                        fields.back().push_back((char)_Get());
+                    }
+                    else
+                    {
+                        fInQuotes = false;
+                    }
+                }
+                else if ((c == '"') && fields.back().empty())
+                {
+                    fInQuotes = true;
+                    fQuoted = true;
+                }
+                else if (c == ',')
+                {
+                    fields.emplace_back();
+                }
+                else if (c == '\n')
+                {
+                    break;
+                }
+                else if (c != '\r')
+                {
+                    fields.back().push_back((char)c);
+                }
+            }
+            if (fInQuotes)
+            {
+                return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+
+            bool fSkip = ((fields.size() == 1) && fields[0].empty()) || (!fQuoted && !fields[0].empty() && (fields[0][0] == '#'));
+            if (!fSkip && !_fHeaderChecked)
+            {
+                _fHeaderChecked = true;
+                fSkip = (_stricmp(fields[0].c_str(), "host") == 0);
+            }
+            if (!fSkip)
+            {
+                break;
+            }
+        }
+
+        HRESULT hr = ((fields.size() >= 3) && (fields.size() <= 4)) ? S_OK : HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        if (SUCCEEDED(hr))
+        {
+            hr = _Assign(fields[0], &pRow->host);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = _Assign(fields[1], &pRow->username);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = _Assign(fields[2], &pRow->password);
+        }
+        pRow->sid.clear();
+        if (SUCCEEDED(hr) && (fields.size() == 4))
+        {
+            hr = _Assign(fields[3], &pRow->sid);
+        }
+        for (std::string& field : fields)
+        {
+            WipeString(field);
+        }
+        return hr;
+    }
+
+    HRESULT _ReadJsonString(std::string* ps)
+    {
+        ps->clear();
+        if (_Get() != '"')
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        for (;;)
+        {
+            int c = _Get();
+            if ((c == EOF) || (c == '\n'))
+            {
+                return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+            if (c == '"')
+            {
+                return S_OK;
+            }
+            if (c != '\\')
+            {
+                ps->push_back((char)c);
+                continue;
+            }
+
+            c = _Get();
+            switch (c)
+            {
+            case '"':
+            case '\\':
+            case '/':
+                ps->push_back((char)c);
+                break;
+            case 'b':
+                ps->push_back('\b');
+                break;
+            case 'f':
+                ps->push_back('\f');
+                break;
+            case 'n':
+                ps->push_back('\n');
+                break;
+            case 'r':
+                ps->push_back('\r');
+                break;
+            case 't':
+                ps->push_back('\t');
+                break;
+            case 'u':
+            {
+                DWORD dwCodePoint = 0;
+                HRESULT hr = _ReadJsonHex4(&dwCodePoint);
+                if (SUCCEEDED(hr) && (dwCodePoint >= 0xD800) && (dwCodePoint < 0xDC00))
+                {
+                    // 代理对
+                    DWORD dwLow = 0;
+                    hr = ((_Get() == '\\') && (_Get() == 'u')) ? _ReadJsonHex4(&dwLow) : HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                    if (SUCCEEDED(hr) && ((dwLow < 0xDC00) || (dwLow >= 0xE000)))
+                    {
+                        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                    }
+                    dwCodePoint = 0x10000 + ((dwCodePoint - 0xD800) << 10) + (dwLow - 0xDC00);
+                }
+                if (FAILED(hr))
+                {
+                    return hr;
+                }
+                AppendUtf8(ps, dwCodePoint);
+                break;
+            }
+            default:
+                return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+        }
+    }
+
+    HRESULT _ReadJsonHex4(DWORD* pdw)
+    {
+        *pdw = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            int c = _Get();
+            DWORD dwDigit;
+            if ((c >= '0') && (c <= '9'))
+            {
+                dwDigit = c - '0';
+            }
+            else if ((c >= 'a') && (c <= 'f'))
+            {
+                dwDigit = c - 'a' + 10;
+            }
+            else if ((c >= 'A') && (c <= 'F'))
+            {
+                dwDigit = c - 'A' + 10;
+            }
+            else
+            {
+                return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+            *pdw = (*pdw << 4) | dwDigit;
+        }
+        return S_OK;
+    }
+
+    HRESULT _NextJson(INVENTORY_ROW* pRow)
+    {
+        // 对象之间允许逗号；数组结束后只允许空白
+        _SkipWhitespace();
+        while (!_fArrayClosed && (_Peek() == ','))
+        {
+            _Get();
+            _SkipWhitespace();
+        }
+        if (!_fArrayClosed && (_Peek() == ']'))
+        {
+            _Get();
+            _fArrayClosed = true;
+            _SkipWhitespace();
+        }
+        if (_Peek() == EOF)
+        {
+            return S_FALSE;
+        }
+        if (_fArrayClosed || (_Get() != '{'))
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        pRow->dwLine = _dwLine;
+        pRow->host.clear();
+        pRow->username.clear();
+        WipeString(pRow->password);
+        pRow->sid.clear();
+
+        HRESULT hr = S_OK;
+        std::string name;
+        std::string value;
+        _SkipWhitespace();
+        if (_Peek() == '}')
+        {
+            _Get();
+        }
+        else
+        {
+            for (;;)
+            {
+                _SkipWhitespace();
+                hr = _ReadJsonString(&name);
+                if (SUCCEEDED(hr))
+                {
+                    _SkipWhitespace();
+                    hr = (_Get() == ':') ? S_OK : HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                }
+                if (SUCCEEDED(hr))
+                {
+                    _SkipWhitespace();
+                    hr = _ReadJsonString(&value);
+                }
+                if (SUCCEEDED(hr))
+                {
+                    if (name == "host")
+                    {
+                        hr = _Assign(value, &pRow->host);
+                    }
+                    else if (name == "username")
+                    {
+                        hr = _Assign(value, &pRow->username);
+                    }
+                    else if (name == "password")
+                    {
+                        hr = _Assign(value, &pRow->password);
+                    }
+                    else if (name == "sid")
+                    {
+                        hr = _Assign(value, &pRow->sid);
+                    }
+                }
+                if (FAILED(hr))
+                {
+                    break;
+                }
+
+                _SkipWhitespace();
+                int c = _Get();
+                if (c == '}')
+                {
+                    break;
+                }
+                if (c != ',')
+                {
+                    hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                    break;
+                }
+            }
+        }
+        WipeString(value);
+
+        if (SUCCEEDED(hr) && (pRow->host.empty() || pRow->username.empty()))
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        return hr;
+    }
+
+    HANDLE _hFile;
+    BYTE _rgb[64 * 1024];
+    DWORD _ib;
+    DWORD _cb;
+    ULONGLONG _ullBytesRead;
+    DWORD _dwLine;
+    bool _fJson;
+    bool _fHeaderChecked;
+    bool _fArrayClosed;
+};
+
+// 部署
+
+struct PROVISION_CONTEXT
+{
+    std::vector<BYTE> masterKey;
+    PCWSTR pszOutDir;
+    PCWSTR pszKeyDir;       // 可为 nullptr
+    ULONGLONG ullSerial;
+    HANDLE hSlots;          // 信号量，限制排队的主机数
+    volatile LONG64 cHosts;
+    volatile LONG64 cAccounts;
+    volatile LONG cFailed;
+};
+
+struct PROVISION_ACCOUNT
+{
+    std::wstring username;
+    std::wstring sid;
+    std::wstring password;
+};
+
+// 一台主机的全部账户；密码在任务结束时清零
+struct PROVISION_JOB
+{
+    PROVISION_CONTEXT* pContext;
+    std::wstring host;
+    DWORD dwLine;
+    std::vector<PROVISION_ACCOUNT> accounts;
+
+    ~PROVISION_JOB()
+    {
+        for (PROVISION_ACCOUNT& account : accounts)
+        {
+            WipeString(account.password);
+        }
+    }
+};
+
+static HRESULT ProvisionHost(PROVISION_JOB* pJob)
+{
+    PROVISION_CONTEXT* pContext = pJob->pContext;
+    BYTE rgbHostKey[CONFIG_HOST_KEY_SIZE];
+    HRESULT hr = ConfigDeriveHostKey(pContext->masterKey.data(), (DWORD)pContext->masterKey.size(), pJob->host.c_str(), rgbHostKey);
+
+    ConfigBuilder builder;
+    builder.SetFlags(CONFIG_FLAG_AUTO_UNLOCK_ENABLED);
+    builder.SetSerial(pContext->ullSerial);
+    for (size_t i = 0; SUCCEEDED(hr) && (i < pJob->accounts.size()); i++)
+    {
+        const PROVISION_ACCOUNT& account = pJob->accounts[i];
+        BYTE* pbSealed = nullptr;
+        DWORD cbSealed = 0;
+        hr = ConfigHostSeal(rgbHostKey, account.password.c_str(), &pbSealed, &cbSealed);
+        if (SUCCEEDED(hr))
+        {
+            hr = builder.AddAccount(account.username.c_str(), account.sid.c_str(), pbSealed, cbSealed);
+            CoTaskMemFree(pbSealed);
+        }
+    }
+
+    WCHAR szPath[MAX_PATH];
+    if (SUCCEEDED(hr))
+    {
+        BYTE* pb = nullptr;
+        DWORD cb = 0;
+        hr = builder.Build(&pb, &cb);
+        if (SUCCEEDED(hr))
+        {
+            hr = StringCchPrintfW(szPath, ARRAYSIZE(szPath), L"%s\\%s.bin", pContext->pszOutDir, pJob->host.c_str());
+            if (SUCCEEDED(hr))
+            {
+                hr = ConfigFileSave(szPath, pb, cb);
+            }
+            CoTaskMemFree(pb);
+        }
+    }
+    if (SUCCEEDED(hr) && pContext->pszKeyDir)
+    {
+        hr = StringCchPrintfW(szPath, ARRAYSIZE(szPath), L"%s\\%s.key", pContext->pszKeyDir, pJob->host.c_str());
+        if (SUCCEEDED(hr))
+        {
+            hr = ConfigFileSave(szPath, rgbHostKey, sizeof(rgbHostKey));
+        }
+    }
+    SecureZeroMemory(rgbHostKey, sizeof(rgbHostKey));
+    return hr;
+}
+
+static void CALLBACK ProvisionCallback(PTP_CALLBACK_INSTANCE pInstance, PVOID pvContext)
+{
+    UNREFERENCED_PARAMETER(pInstance);
+    PROVISION_JOB* pJob = static_cast<PROVISION_JOB*>(pvContext);
+    PROVISION_CONTEXT* pContext = pJob->pContext;
+
+    HRESULT hr = ProvisionHost(pJob);
+    if (SUCCEEDED(hr))
+    {
+        InterlockedIncrement64(&pContext->cHosts);
+        InterlockedAdd64(&pContext->cAccounts, (LONG64)pJob->accounts.size());
+    }
+    else
+    {
+        InterlockedIncrement(&pContext->cFailed);
+        fwprintf(stderr, L"\n第 %lu 行，主机 %s：0x%08lX\n", pJob->dwLine, pJob->host.c_str(), hr);
+    }
+
+    delete pJob;
+    ReleaseSemaphore(pContext->hSlots, 1, nullptr);
+}
+
+static int Provision(PCWSTR pszMasterKey, PCWSTR pszInventory, PCWSTR pszOutDir, PCWSTR pszKeyDir, DWORD cThreads, ULONGLONG ullSerial)
+{
+    PROVISION_CONTEXT context = {};
+    context.pszOutDir = pszOutDir;
+    context.pszKeyDir = pszKeyDir;
+    context.ullSerial = ullSerial;
+
+    HRESULT hr = ReadFileBytes(pszMasterKey, PROVISION_MASTER_KEY_MAX, &context.masterKey);
+    if (SUCCEEDED(hr) && (context.masterKey.size() < CONFIG_MASTER_KEY_MIN_SIZE))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法读取主密钥 %s：0x%08lX\n", pszMasterKey, hr);
+        return 1;
+    }
+
+    InventoryReader reader;
+    hr = reader.Open(pszInventory);
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法打开清单 %s：0x%08lX\n", pszInventory, hr);
+        return 1;
+    }
+
+    // 主机在系统线程池的私有池中并行处理，信号量限制排队的主机数
+    LONG cSlots = (LONG)(cThreads * PROVISION_JOBS_PER_THREAD);
+    context.hSlots = CreateSemaphoreW(nullptr, cSlots, cSlots, nullptr);
+    PTP_POOL pPool = CreateThreadpool(nullptr);
+    PTP_CLEANUP_GROUP pCleanup = CreateThreadpoolCleanupGroup();
+    if (!context.hSlots || !pPool || !pCleanup)
+    {
+        fwprintf(stderr, L"无法创建线程池：%lu\n", GetLastError());
+        return 1;
+    }
+    SetThreadpoolThreadMaximum(pPool, cThreads);
+    SetThreadpoolThreadMinimum(pPool, 1);
+
+    TP_CALLBACK_ENVIRON env;
+    InitializeThreadpoolEnvironment(&env);
+    SetThreadpoolCallbackPool(&env, pPool);
+    SetThreadpoolCallbackCleanupGroup(&env, pCleanup, nullptr);
+
+    ULONGLONG ullStart = GetTickCount64();
+    ULONGLONG ullNextProgress = ullStart + PROVISION_PROGRESS_MS;
+    ULONGLONG cRows = 0;
+    std::unordered_set<ULONGLONG> seenHosts;
+    PROVISION_JOB* pJob = nullptr;
+    INVENTORY_ROW row;
+
+    for (;;)
+    {
+        hr = reader.Next(&row);
+        if (FAILED(hr))
+        {
+            fwprintf(stderr, L"\n清单第 %lu 行格式错误：0x%08lX\n", row.dwLine, hr);
+            break;
+        }
+
+        // 换主机或清单结束时提交上一台主机
+        if (pJob && ((hr == S_FALSE) || (_wcsicmp(pJob->host.c_str(), row.host.c_str()) != 0)))
+        {
+            WaitForSingleObject(context.hSlots, INFINITE);
+            if (!TrySubmitThreadpoolCallback(ProvisionCallback, pJob, &env))
+            {
+                hr = HRESULT_FROM_WIN32(GetLastError());
+                fwprintf(stderr, L"\n无法提交主机 %s：0x%08lX\n", pJob->host.c_str(), hr);
+                ReleaseSemaphore(context.hSlots, 1, nullptr);
+                delete pJob;
+                pJob = nullptr;
+                break;
+            }
+            pJob = nullptr;
+        }
+        if (hr == S_FALSE)
+        {
+            hr = S_OK;
+            break;
+        }
+
+        cRows++;
+        if (!pJob)
+        {
+            if (!IsValidHostName(row.host))
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                fwprintf(stderr, L"\n清单第 %lu 行主机名无效：%s\n", row.dwLine, row.host.c_str());
+                break;
+            }
+            if (!seenHosts.insert(HashHostName(row.host)).second)
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                fwprintf(stderr, L"\n清单第 %lu 行：主机 %s 再次出现，同一主机的行须相邻\n", row.dwLine, row.host.c_str());
+                break;
+            }
+
+            pJob = new(std::nothrow) PROVISION_JOB();
+            if (!pJob)
+            {
+                hr = E_OUTOFMEMORY;
+                break;
+            }
+            pJob->pContext = &context;
+            pJob->host = row.host;
+            pJob->dwLine = row.dwLine;
+        }
+
+        pJob->accounts.emplace_back();
+        PROVISION_ACCOUNT& account = pJob->accounts.back();
+        account.username.swap(row.username);
+        account.sid.swap(row.sid);
+        account.password.swap(row.password);
+
+        ULONGLONG ullNow = GetTickCount64();
+        if (ullNow >= ullNextProgress)
+        {
+            ullNextProgress = ullNow + PROVISION_PROGRESS_MS;
+            double dSeconds = (ullNow - ullStart) / 1000.0;
+            fwprintf(stderr, L"\r已读取 %I64u 行（%.1f MB），已生成 %I64d 台主机，%.0f 行/秒",
+                cRows, reader.GetBytesRead() / 1048576.0, context.cHosts, cRows / dSeconds);
+        }
+    }
+    delete pJob;
+
+    // 等待已提交的主机全部完成
+    CloseThreadpoolCleanupGroupMembers(pCleanup, FALSE, nullptr);
+    CloseThreadpoolCleanupGroup(pCleanup);
+    DestroyThreadpoolEnvironment(&env);
+    CloseThreadpool(pPool);
+    CloseHandle(context.hSlots);
+    SecureZeroMemory(context.masterKey.data(), context.masterKey.size());
+
+    double dSeconds = max(GetTickCount64() - ullStart, 1ULL) / 1000.0;
+    wprintf(L"\n%I64u 行，%I64d 台主机 / %I64d 个账户已生成，%ld 台失败，耗时 %.2f 秒（%.0f 台/秒，%.0f 账户/秒）\n",
+        cRows, context.cHosts, context.cAccounts, context.cFailed, dSeconds,
+        context.cHosts / dSeconds, context.cAccounts / dSeconds);
+    return (SUCCEEDED(hr) && !context.cFailed) ? 0 : 1;
+}
+
+// 其他命令
+
+static int GenerateMasterKey(PCWSTR pszPath)
+{
+    BYTE rgbKey[CONFIG_MASTER_KEY_MIN_SIZE];
+    HRESULT hr = BCRYPT_SUCCESS(BCryptGenRandom(nullptr, rgbKey, sizeof(rgbKey), BCRYPT_USE_SYSTEM_PREFERRED_RNG)) ? S_OK : E_FAIL;
+    if (SUCCEEDED(hr))
+    {
+        hr = ConfigFileSave(pszPath, rgbKey, sizeof(rgbKey));
+    }
+    SecureZeroMemory(rgbKey, sizeof(rgbKey));
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法生成主密钥：0x%08lX\n", hr);
+        return 1;
+    }
+    wprintf(L"主密钥已写入 %s\n", pszPath);
+    return 0;
+}
+
+static int WriteHostKey(PCWSTR pszMasterKey, PCWSTR pszHost, PCWSTR pszPath)
+{
+    std::vector<BYTE> masterKey;
+    BYTE rgbHostKey[CONFIG_HOST_KEY_SIZE];
+    HRESULT hr = ReadFileBytes(pszMasterKey, PROVISION_MASTER_KEY_MAX, &masterKey);
+    if (SUCCEEDED(hr))
+    {
+        hr = ConfigDeriveHostKey(masterKey.data(), (DWORD)masterKey.size(), pszHost, rgbHostKey);
+        SecureZeroMemory(masterKey.data(), masterKey.size());
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = ConfigFileSave(pszPath, rgbHostKey, sizeof(rgbHostKey));
+        SecureZeroMemory(rgbHostKey, sizeof(rgbHostKey));
+    }
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法生成主机密钥：0x%08lX\n", hr);
+        return 1;
+    }
+    return 0;
+}
+
+// 在目标主机上安装：先校验密钥能解封全部账户，再写入密钥和配置文件
+static int Install(PCWSTR pszConfig, PCWSTR pszHostKey)
+{
+    std::vector<BYTE> config;
+    std::vector<BYTE> hostKey;
+    HRESULT hr = ReadFileBytes(pszConfig, CONFIG_FILE_MAX_SIZE, &config);
+    if (SUCCEEDED(hr))
+    {
+        hr = ReadFileBytes(pszHostKey, CONFIG_HOST_KEY_SIZE, &hostKey);
+    }
+    if (SUCCEEDED(hr) && (hostKey.size() != CONFIG_HOST_KEY_SIZE))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    ConfigView view;
+    if (SUCCEEDED(hr))
+    {
+        hr = view.Attach(config.data(), config.size());
+    }
+    for (DWORD i = 0; SUCCEEDED(hr) && (i < view.GetAccountCount()); i++)
+    {
+        CONFIG_ACCOUNT_VIEW account;
+        view.GetAccount(i, &account);
+        if (ConfigIsHostSealed(account.pbSealed, account.cbSealed))
+        {
+            SecretString password;
+            hr = ConfigHostUnseal(hostKey.data(), account.pbSealed, account.cbSealed, &password);
+        }
+    }
+    view.Detach();
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"配置文件与主机密钥不匹配或已损坏：0x%08lX\n", hr);
+        return 1;
+    }
+
+    // 先写密钥，提供程序不会看到无法解封的新配置
+    WCHAR szPath[MAX_PATH];
+    DWORD cch = ExpandEnvironmentStringsW(CONFIG_HOST_KEY_PATH, szPath, ARRAYSIZE(szPath));
+    hr = (cch && (cch <= ARRAYSIZE(szPath))) ? ConfigFileSave(szPath, hostKey.data(), (DWORD)hostKey.size()) : HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    SecureZeroMemory(hostKey.data(), hostKey.size());
+    if (SUCCEEDED(hr))
+    {
+        hr = GetConfigFilePath(szPath, ARRAYSIZE(szPath));
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = ConfigFileSave(szPath, config.data(), (DWORD)config.size());
+    }
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"安装失败（需要管理员权限）：0x%08lX\n", hr);
+        return 1;
+    }
+    wprintf(L"已安装到 %s\n", szPath);
+    return 0;
+}
+
+static void Usage()
+{
+    fwprintf(stderr,
+        L"用法：\n"
+        L"  provision /genmaster 主密钥文件\n"
+        L"  provision /master 主密钥文件 /in 清单 /out 输出目录 [/keys 密钥目录] [/threads 线程数] [/serial 序号]\n"
+        L"  provision /hostkey 主密钥文件 主机名 输出文件\n"
+        L"  provision /install 配置文件 主机密钥文件\n");
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    if ((argc == 3) && (_wcsicmp(argv[1], L"/genmaster") == 0))
+    {
+        return GenerateMasterKey(argv[2]);
+    }
+    if ((argc == 5) && (_wcsicmp(argv[1], L"/hostkey") == 0))
+    {
+        return WriteHostKey(argv[2], argv[3], argv[4]);
+    }
+    if ((argc == 4) && (_wcsicmp(argv[1], L"/install") == 0))
+    {
+        return Install(argv[2], argv[3]);
+    }
+
+    PCWSTR pszMasterKey = nullptr;
+    PCWSTR pszInventory = nullptr;
+    PCWSTR pszOutDir = nullptr;
+    PCWSTR pszKeyDir = nullptr;
+    DWORD cThreads = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+    ULONGLONG ullSerial = (((ULONGLONG)ft.dwHighDateTime << 32) | ft.dwLowDateTime) / 10000000;
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (_wcsicmp(argv[i], L"/master") == 0)
+        {
+            pszMasterKey = argv[i + 1];
+        }
+        else if (_wcsicmp(argv[i], L"/in") == 0)
+        {
+            pszInventory = argv[i + 1];
+        }
+        else if (_wcsicmp(argv[i], L"/out") == 0)
+        {
+            pszOutDir = argv[i + 1];
+        }
+        else if (_wcsicmp(argv[i], L"/keys") == 0)
+        {
+            pszKeyDir = argv[i + 1];
+        }
+        else if (_wcsicmp(argv[i], L"/threads") == 0)
+        {
+            cThreads = wcstoul(argv[i + 1], nullptr, 10);
+        }
+        else if (_wcsicmp(argv[i], L"/serial") == 0)
+        {
+            ullSerial = _wcstoui64(argv[i + 1], nullptr, 10);
+        }
+        else
+        {
+            Usage();
+            return 1;
+        }
+    }
+    if (!pszMasterKey || !pszInventory || !pszOutDir || !cThreads || !(argc % 2))
+    {
+        Usage();
+        return 1;
+    }
+    return Provision(pszMasterKey, pszInventory, pszOutDir, pszKeyDir, cThreads, ullSerial);
+}
@@ -0,0 +1,299 @@
+// WinUnlock 跨会话共享缓存诊断及多进程压力测试
+//
+// 直接编译 DLL 的 SharedCache.cpp（见 SharedCache.h）：
+//   默认打开本机的共享区段，显示配置区的时间戳和最近的刷新者、各账户的决策记录；
+//   /stress 时改用本进程私有的区段名，启动若干读取子进程（模拟各会话的 LogonUI），
+//   本进程不断发布大小不一的配置内容和决策记录，读取方检查读到的配置能通过校验且与时间戳一致、
+//   决策记录各字段出自同一次写入，并报告每次读取的耗时、重试和放弃次数。
+// 区段只允许 SYSTEM 和管理员访问，需以管理员身份运行。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. sharedcache.cpp ..\SharedCache.cpp ..\ConfigFormat.cpp advapi32.lib ole32.lib
+//
+// 用法：
+//   sharedcache
+//   sharedcache /stress [/readers 读取进程数] [/duration 毫秒]
+
+#include "pch.h"
+#include <stdio.h>
+#include <vector>
+#include "ConfigFormat.h"
+#include "SharedCache.h"
+
+#define STRESS_KEYS 16
+
+// 测试内容都由序号推出，读取方据此检查拿到的内容是否出自同一次写入
+static ULONGLONG StressKeyHash(DWORD dwKey)
+{
+    return 0x5743000000000000ULL | (dwKey + 1);
+}
+
+static ULONGLONG StressRetryTick(ULONGLONG ullUpdateTick, DWORD dwGeneration)
+{
+    return ullUpdateTick * 3 + dwGeneration;
+}
+
+// 账户数和密封数据长度随序号变化，配置区内容的长度不断改变
+static HRESULT BuildStressConfig(ULONGLONG ullSerial, BYTE** ppb, DWORD* pcb)
+{
+    static BYTE s_rgbSealed[4096];
+    ConfigBuilder builder;
+    builder.SetFlags(CONFIG_FLAG_AUTO_UNLOCK_ENABLED);
+    builder.SetSerial(ullSerial);
+
+    HRESULT hr = S_OK;
+    DWORD cAccounts = (DWORD)(ullSerial % 8) + 1;
+    for (DWORD i = 0; (i < cAccounts) && SUCCEEDED(hr); i++)
+    {
+        WCHAR szUsername[32];
+        StringCchPrintfW(szUsername, ARRAYSIZE(szUsername), L"user%lu", i);
+        FillMemory(s_rgbSealed, sizeof(s_rgbSealed), (BYTE)(ullSerial + i));
+        hr = builder.AddAccount(szUsername, L"", s_rgbSealed, (DWORD)((ullSerial * 37 + i * 101) % (sizeof(s_rgbSealed) - 16)) + 16);
+    }
+    return SUCCEEDED(hr) ? builder.Build(ppb, pcb) : hr;
+}
+
+static int RunReader(PCWSTR pszName, DWORD dwDurationMs)
+{
+    SharedCache cache;
+    HRESULT hr = cache.Open(pszName, false);
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法打开区段 %s: 0x%08X\n", pszName, hr);
+        return 1;
+    }
+
+    LONG64 cReads = 0;
+    LONG64 cErrors = 0;
+    ULONGLONG ullLastSerial = 0;
+    LARGE_INTEGER liFrequency, liBegin, liNow;
+    QueryPerformanceFrequency(&liFrequency);
+    QueryPerformanceCounter(&liBegin);
+    ULONGLONG ullEnd = GetTickCount64() + dwDurationMs;
+    while (GetTickCount64() < ullEnd)
+    {
+        for (DWORD i = 0; i < 64; i++, cReads++)
+        {
+            if (i % 4)
+            {
+                SHARED_CACHE_DECISION decision;
+                hr = cache.ReadDecision(StressKeyHash(i % STRESS_KEYS), &decision);
+                if ((hr == S_OK) &&
+                    ((decision.ullRetryTick != StressRetryTick(decision.ullUpdateTick, decision.dwGeneration)) ||
+                    (decision.fBlocked != (decision.dwGeneration & 1))))
+                {
+                    cErrors++;
+                }
+                continue;
+            }
+
+            BYTE* pb = nullptr;
+            DWORD cb = 0;
+            ULONGLONG ullWriteTime = 0;
+            ULONGLONG cbFile = 0;
+            if (SUCCEEDED(cache.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile)))
+            {
+                // 写入时间戳即序号；序号不应回退
+                ConfigView view;
+                if (FAILED(view.Attach(pb, cb)) || (view.GetSerial() != ullWriteTime) || (cbFile != cb) ||
+                    (view.GetAccountCount() != (DWORD)(ullWriteTime % 8) + 1) || (ullWriteTime < ullLastSerial))
+                {
+                    cErrors++;
+                }
+                ullLastSerial = ullWriteTime;
+                view.Detach();
+                CoTaskMemFree(pb);
+            }
+        }
+    }
+    QueryPerformanceCounter(&liNow);
+
+    SHARED_CACHE_STATS stats;
+    cache.GetStats(&stats);
+    printf("reader %lu: %lld reads (%.1f ns/read), %lld config hits, %lld retries, %lld abandoned, %lld errors\n",
+        GetCurrentProcessId(), cReads,
+        cReads ? (double)(liNow.QuadPart - liBegin.QuadPart) * 1e9 / (double)liFrequency.QuadPart / (double)cReads : 0.0,
+        stats.cConfigHits, stats.cReadRetries, stats.cReadAbandoned, cErrors);
+    return cErrors ? 1 : 0;
+}
+
+static int RunStress(DWORD cReaders, DWORD dwDurationMs)
+{
+    WCHAR szName[64];
+    StringCchPrintfW(szName, ARRAYSIZE(szName), L"Local\\WinUnlock.SharedCacheTest.%lu", GetCurrentProcessId());
+    SharedCache cache;
+    HRESULT hr = cache.Open(szName, false);
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法创建区段: 0x%08X\n", hr);
+        return 1;
+    }
+
+    // 先发布一份配置，读取方一开始就能命中
+    ULONGLONG ullSerial = 1;
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    if (FAILED(BuildStressConfig(ullSerial, &pb, &cb)) || FAILED(cache.PublishConfig(ullSerial, cb, pb, cb)))
+    {
+        fwprintf(stderr, L"无法发布配置\n");
+        return 1;
+    }
+    CoTaskMemFree(pb);
+
+    WCHAR szExe[MAX_PATH];
+    GetModuleFileNameW(nullptr, szExe, ARRAYSIZE(szExe));
+    std::vector<HANDLE> processes;
+    for (DWORD i = 0; i < cReaders; i++)
+    {
+        WCHAR szCommandLine[MAX_PATH + 128];
+        StringCchPrintfW(szCommandLine, ARRAYSIZE(szCommandLine), L"\"%s\" /reader %s %lu", szExe, szName, dwDurationMs);
+        STARTUPINFOW si = { sizeof(si) };
+        PROCESS_INFORMATION pi;
+        if (!CreateProcessW(szExe, szCommandLine, nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi))
+        {
+            fwprintf(stderr, L"无法启动读取进程: %lu\n", GetLastError());
+            break;
+        }
+        CloseHandle(pi.hThread);
+        processes.push_back(pi.hProcess);
+    }
+
+    // 读取方全部退出前不断发布：配置和决策交替写入，决策的时刻用递增的计数代替
+    LONG64 cConfigs = 0;
+    LONG64 cDecisions = 0;
+    while (!processes.empty() && (WaitForMultipleObjects((DWORD)processes.size(), processes.data(), TRUE, 0) == WAIT_TIMEOUT))
+    {
+        ullSerial++;
+        if (SUCCEEDED(BuildStressConfig(ullSerial, &pb, &cb)))
+        {
+            if (cache.PublishConfig(ullSerial, cb, pb, cb) == S_OK)
+            {
+                cConfigs++;
+            }
+            CoTaskMemFree(pb);
+        }
+        for (DWORD i = 0; i < STRESS_KEYS; i++)
+        {
+            DWORD dwGeneration = (DWORD)ullSerial + i;
+            cache.PublishDecision(StressKeyHash(i), dwGeneration, StressRetryTick(ullSerial, dwGeneration), (dwGeneration & 1) != 0, ullSerial);
+            cDecisions++;
+        }
+    }
+
+    bool fPassed = (processes.size() == cReaders);
+    for (HANDLE hProcess : processes)
+    {
+        DWORD dwExitCode = 1;
+        GetExitCodeProcess(hProcess, &dwExitCode);
+        fPassed = fPassed && (dwExitCode == 0);
+        CloseHandle(hProcess);
+    }
+
+    SHARED_CACHE_STATS stats;
+    cache.GetStats(&stats);
+    printf("writer: %lld configs, %lld decisions, %lld writes skipped\n", cConfigs, cDecisions, stats.cWritesSkipped);
+    if (!fPassed)
+    {
+        fwprintf(stderr, L"读取到不完整的内容或读取进程失败\n");
+        return 1;
+    }
+    return 0;
+}
+
+static int Dump()
+{
+    SharedCache cache;
+    HRESULT hr = cache.Open(SHARED_CACHE_SECTION_NAME, true);
+    if (FAILED(hr))
+    {
+        fwprintf(stderr, L"无法打开共享区段: 0x%08X\n", hr);
+        return 1;
+    }
+
+    const SHARED_CACHE_HEADER* pHeader = cache.GetHeader();
+    ULONGLONG ullNow = GetTickCount64();
+    printf("section:  magic 0x%08lX, version %lu, %lu bytes, write lock %s\n",
+        pHeader->dwMagic, pHeader->dwVersion, pHeader->cbSection, pHeader->llWriteLock ? "held" : "free");
+
+    BYTE* pb = nullptr;
+    DWORD cb = 0;
+    ULONGLONG ullWriteTime = 0;
+    ULONGLONG cbFile = 0;
+    hr = cache.ReadConfig(&pb, &cb, &ullWriteTime, &cbFile);
+    if (SUCCEEDED(hr))
+    {
+        FILETIME ft;
+        ft.dwLowDateTime = (DWORD)ullWriteTime;
+        ft.dwHighDateTime = (DWORD)(ullWriteTime >> 32);
+        SYSTEMTIME st;
+        FileTimeToSystemTime(&ft, &st);
+        ConfigView view;
+        bool fValid = SUCCEEDED(view.Attach(pb, cb));
+        printf("config:   %lu bytes, written %04u-%02u-%02u %02u:%02u:%02u UTC, serial %llu, %lu accounts%s\n",
+            cb, st.wYear, st.wMonth, st.wDay, st.wHour, st.wMinute, st.wSecond,
+            fValid ? view.GetSerial() : 0, fValid ? view.GetAccountCount() : 0, fValid ? "" : " (invalid)");
+        printf("          refreshed by process %lu, %llu ms ago\n",
+            pHeader->dwRefresherProcessId, ullNow - pHeader->ullConfigRefreshTick);
+        view.Detach();
+        CoTaskMemFree(pb);
+    }
+    else
+    {
+        printf("config:   none (0x%08X)\n", hr);
+    }
+
+    for (DWORD i = 0; i < SHARED_CACHE_DECISIONS; i++)
+    {
+        SHARED_CACHE_DECISION decision;
+        if (cache.ReadDecision(pHeader->rgDecisions[i].ullKeyHash, &decision) == S_OK)
+        {
+            printf("decision: key %016llX, generation %lu, %s, retry in %lld ms, updated %llu ms ago\n",
+                decision.ullKeyHash, decision.dwGeneration, decision.fBlocked ? "blocked" : "allowed",
+                (decision.ullRetryTick > ullNow) ? (LONGLONG)(decision.ullRetryTick - ullNow) : 0,
+                ullNow - decision.ullUpdateTick);
+        }
+    }
+    return 0;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    if ((argc == 4) && (_wcsicmp(argv[1], L"/reader") == 0))
+    {
+        return RunReader(argv[2], wcstoul(argv[3], nullptr, 10));
+    }
+
+    bool fStress = false;
+    DWORD cReaders = 4;
+    DWORD dwDurationMs = 3000;
+    for (int i = 1; i < argc; i++)
+    {
+        if (_wcsicmp(argv[i], L"/stress") == 0)
+        {
+            fStress = true;
+        }
+        else if ((_wcsicmp(argv[i], L"/readers") == 0) && (i + 1 < argc))
+        {
+            cReaders = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/duration") == 0) && (i + 1 < argc))
+        {
+            dwDurationMs = wcstoul(argv[++i], nullptr, 10);
+        }
+        else
+        {
+            fwprintf(stderr, L"用法：sharedcache [/stress [/readers 读取进程数] [/duration 毫秒]]\n");
+            return 1;
+        }
+    }
+    if (!fStress)
+    {
+        return Dump();
+    }
+    if (!cReaders || (cReaders > MAXIMUM_WAIT_OBJECTS))
+    {
+        fwprintf(stderr, L"读取进程数应在 1～%d 之间\n", MAXIMUM_WAIT_OBJECTS);
+        return 1;
+    }
+    return RunStress(cReaders, dwDurationMs);
+}
@@ -0,0 +1,101 @@
+// WinUnlock 跟踪文件解析工具
+//
+// 读取 winunlock.dll 写出的跟踪文件，输出每个方法的调用次数和耗时分位数。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. tracedump.cpp advapi32.lib
+//
+// 用法：
+//   tracedump [/dump] [跟踪文件路径]
+//     /dump  先通知正在运行的提供程序立即写出跟踪文件（需要管理员权限）
+
+#include <windows.h>
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "LatencyTrace.h"
+
+int wmain(int argc, wchar_t* argv[])
+{
+    bool fDump = false;
+    WCHAR szPath[MAX_PATH] = { 0 };
+    ExpandEnvironmentStringsW(TRACE_FILE_PATH, szPath, ARRAYSIZE(szPath));
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (_wcsicmp(argv[i], L"/dump") == 0)
+        {
+            fDump = true;
+        }
+        else
+        {
+            wcsncpy_s(szPath, argv[i], _TRUNCATE);
+        }
+    }
+
+    if (fDump)
+    {
+        HANDLE hEvent = OpenEventW(EVENT_MODIFY_STATE, FALSE, TRACE_DUMP_EVENT);
+        if (!hEvent)
+        {
+            fwprintf(stderr, L"无法打开转储事件（跟踪未开启或提供程序未加载）: %lu\n", GetLastError());
+            return 1;
+        }
+        SetEvent(hEvent);
+        CloseHandle(hEvent);
+        Sleep(500);
+    }
+
+    HANDLE hFile = CreateFileW(szPath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        fwprintf(stderr, L"无法打开 %s: %lu\n", szPath, GetLastError());
+        return 1;
+    }
+
+    TRACE_FILE_HEADER header = { 0 };
+    DWORD cbRead = 0;
+    if (!ReadFile(hFile, &header, sizeof(header), &cbRead, nullptr) || (cbRead != sizeof(header)) ||
+        !TraceFileHeaderIsValid(header))
+    {
+        fwprintf(stderr, L"无效的跟踪文件\n");
+        CloseHandle(hFile);
+        return 1;
+    }
+
+    std::vector<TRACE_RECORD> records(header.cRecords);
+    DWORD cbRecords = header.cRecords * sizeof(TRACE_RECORD);
+    if (cbRecords && (!ReadFile(hFile, records.data(), cbRecords, &cbRead, nullptr) || (cbRead != cbRecords)))
+    {
+        fwprintf(stderr, L"跟踪文件被截断\n");
+        CloseHandle(hFile);
+        return 1;
+    }
+    CloseHandle(hFile);
+
+    // 按方法分组，单位微秒
+    std::vector<double> durations[TM_NUM_METHODS];
+    for (const TRACE_RECORD& record : records)
+    {
+        if ((record.wMethod < TM_NUM_METHODS) && (record.llExit >= record.llEnter))
+        {
+            durations[record.wMethod].push_back((double)(record.llExit - record.llEnter) * 1e6 / (double)header.llFrequency);
+        }
+    }
+
+    printf("%-36s %8s %10s %10s %10s %10s\n", "method", "count", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    for (DWORD i = 0; i < TM_NUM_METHODS; i++)
+    {
+        std::vector<double>& values = durations[i];
+        if (values.empty())
+        {
+            continue;
+        }
+        std::sort(values.begin(), values.end());
+        printf("%-36s %8zu %10.1f %10.1f %10.1f %10.1f\n", TraceMethodName(i), values.size(),
+            TracePercentile(values.data(), values.size(), 0.50), TracePercentile(values.data(), values.size(), 0.90),
+            TracePercentile(values.data(), values.size(), 0.99), values.back());
+    }
+
+    return 0;
+}
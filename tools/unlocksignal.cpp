@@ -0,0 +1,205 @@
+// WinUnlock 外部解锁信号发送工具
+//
+// 模拟配套代理，向指定会话的提供程序发送一次“立即解锁”信号，或反复发送以测量往返耗时。
+// 默认从 HKLM\SOFTWARE\WinUnlock\SignalKey 读取密钥（需要管理员权限）。
+//
+// 编译（VS 开发者命令提示符）：
+//   cl /EHsc /O2 /I.. unlocksignal.cpp advapi32.lib bcrypt.lib
+//
+// 用法：
+//   unlocksignal [/session 会话号] [/key 十六进制密钥] [/bench 次数]
+//     /session  目标会话，默认为当前控制台会话
+//     /bench    连续发送指定次数，输出从连接到收到确认的耗时分位数
+
+#include <windows.h>
+#include <bcrypt.h>
+#include <stdio.h>
+#include <vector>
+#include <algorithm>
+#include "UnlockSignal.h"
+#include "LatencyTrace.h"
+
+static bool ParseHexKey(const wchar_t* psz, BYTE* pbKey, DWORD* pcbKey)
+{
+    size_t cch = wcslen(psz);
+    if ((cch % 2) || (cch / 2 > UNLOCK_SIGNAL_KEY_MAX))
+    {
+        return false;
+    }
+    for (size_t i = 0; i < cch / 2; i++)
+    {
+        unsigned int b = 0;
+        if (swscanf_s(psz + 2 * i, L"%2x", &b) != 1)
+        {
+            return false;
+        }
+        pbKey[i] = (BYTE)b;
+    }
+    *pcbKey = (DWORD)(cch / 2);
+    return true;
+}
+
+static bool ComputeMac(const BYTE* pbKey, DWORD cbKey, const BYTE* pbChallenge, UNLOCK_SIGNAL_MESSAGE* pMessage)
+{
+    BCRYPT_ALG_HANDLE hAlg = nullptr;
+    NTSTATUS status = BCryptOpenAlgorithmProvider(&hAlg, BCRYPT_SHA256_ALGORITHM, nullptr, BCRYPT_ALG_HANDLE_HMAC_FLAG);
+    if (!BCRYPT_SUCCESS(status))
+    {
+        return false;
+    }
+    BCRYPT_HASH_HANDLE hHash = nullptr;
+    status = BCryptCreateHash(hAlg, &hHash, nullptr, 0, (PUCHAR)pbKey, cbKey, 0);
+    if (BCRYPT_SUCCESS(status))
+    {
+        BCryptHashData(hHash, (PUCHAR)pbChallenge, UNLOCK_SIGNAL_CHALLENGE_SIZE, 0);
+        BCryptHashData(hHash, (PUCHAR)&pMessage->dwVersion, sizeof(pMessage->dwVersion), 0);
+        BCryptHashData(hHash, (PUCHAR)&pMessage->dwSessionId, sizeof(pMessage->dwSessionId), 0);
+        status = BCryptFinishHash(hHash, pMessage->rgbMac, sizeof(pMessage->rgbMac), 0);
+        BCryptDestroyHash(hHash);
+    }
+    BCryptCloseAlgorithmProvider(hAlg, 0);
+    return BCRYPT_SUCCESS(status);
+}
+
+// 完成一次挑战应答，返回提供程序回复的 HRESULT
+static HRESULT SendSignal(DWORD dwSessionId, const BYTE* pbKey, DWORD cbKey)
+{
+    WCHAR szPipeName[64];
+    swprintf_s(szPipeName, UNLOCK_SIGNAL_PIPE_FORMAT, dwSessionId);
+
+    HANDLE hPipe = INVALID_HANDLE_VALUE;
+    for (;;)
+    {
+        hPipe = CreateFileW(szPipeName, GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+        if ((hPipe != INVALID_HANDLE_VALUE) || (GetLastError() != ERROR_PIPE_BUSY))
+        {
+            break;
+        }
+        if (!WaitNamedPipeW(szPipeName, UNLOCK_SIGNAL_IO_TIMEOUT_MS))
+        {
+            break;
+        }
+    }
+    if (hPipe == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    DWORD dwMode = PIPE_READMODE_MESSAGE;
+    SetNamedPipeHandleState(hPipe, &dwMode, nullptr, nullptr);
+
+    HRESULT hr = E_FAIL;
+    BYTE rgbChallenge[UNLOCK_SIGNAL_CHALLENGE_SIZE];
+    DWORD cb = 0;
+    if (ReadFile(hPipe, rgbChallenge, sizeof(rgbChallenge), &cb, nullptr) && (cb == sizeof(rgbChallenge)))
+    {
+        UNLOCK_SIGNAL_MESSAGE message = { UNLOCK_SIGNAL_VERSION, dwSessionId };
+        HRESULT hrResult = E_FAIL;
+        if (ComputeMac(pbKey, cbKey, rgbChallenge, &message) &&
+            WriteFile(hPipe, &message, sizeof(message), &cb, nullptr) &&
+            ReadFile(hPipe, &hrResult, sizeof(hrResult), &cb, nullptr) && (cb == sizeof(hrResult)))
+        {
+            hr = hrResult;
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+    else
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+    CloseHandle(hPipe);
+    return hr;
+}
+
+int wmain(int argc, wchar_t* argv[])
+{
+    DWORD dwSessionId = WTSGetActiveConsoleSessionId();
+    DWORD cBench = 0;
+    BYTE rgbKey[UNLOCK_SIGNAL_KEY_MAX] = { 0 };
+    DWORD cbKey = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((_wcsicmp(argv[i], L"/session") == 0) && (i + 1 < argc))
+        {
+            dwSessionId = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/bench") == 0) && (i + 1 < argc))
+        {
+            cBench = wcstoul(argv[++i], nullptr, 10);
+        }
+        else if ((_wcsicmp(argv[i], L"/key") == 0) && (i + 1 < argc))
+        {
+            if (!ParseHexKey(argv[++i], rgbKey, &cbKey))
+            {
+                fwprintf(stderr, L"密钥格式无效\n");
+                return 1;
+            }
+        }
+        else
+        {
+            fwprintf(stderr, L"用法: unlocksignal [/session 会话号] [/key 十六进制密钥] [/bench 次数]\n");
+            return 1;
+        }
+    }
+
+    if (!cbKey)
+    {
+        cbKey = sizeof(rgbKey);
+        LSTATUS ls = RegGetValueW(HKEY_LOCAL_MACHINE, L"SOFTWARE\\WinUnlock", L"SignalKey", RRF_RT_REG_BINARY, nullptr, rgbKey, &cbKey);
+        if (ls != ERROR_SUCCESS)
+        {
+            fwprintf(stderr, L"无法读取 SignalKey: %ld\n", ls);
+            return 1;
+        }
+    }
+    if (cbKey < UNLOCK_SIGNAL_KEY_MIN)
+    {
+        fwprintf(stderr, L"密钥至少需要 %d 字节\n", UNLOCK_SIGNAL_KEY_MIN);
+        return 1;
+    }
+
+    if (!cBench)
+    {
+        HRESULT hr = SendSignal(dwSessionId, rgbKey, cbKey);
+        SecureZeroMemory(rgbKey, sizeof(rgbKey));
+        wprintf(L"会话 %lu: 0x%08lx\n", dwSessionId, hr);
+        return SUCCEEDED(hr) ? 0 : 1;
+    }
+
+    LARGE_INTEGER liFrequency;
+    QueryPerformanceFrequency(&liFrequency);
+    std::vector<double> latencies;
+    latencies.reserve(cBench);
+    DWORD cFailed = 0;
+    for (DWORD i = 0; i < cBench; i++)
+    {
+        LARGE_INTEGER liStart;
+        LARGE_INTEGER liEnd;
+        QueryPerformanceCounter(&liStart);
+        HRESULT hr = SendSignal(dwSessionId, rgbKey, cbKey);
+        QueryPerformanceCounter(&liEnd);
+        if (SUCCEEDED(hr))
+        {
+            latencies.push_back((liEnd.QuadPart - liStart.QuadPart) * 1000.0 / liFrequency.QuadPart);
+        }
+        else
+        {
+            cFailed++;
+        }
+    }
+    SecureZeroMemory(rgbKey, sizeof(rgbKey));
+
+    wprintf(L"成功 %zu 次，失败 %lu 次\n", latencies.size(), cFailed);
+    if (!latencies.empty())
+    {
+        std::sort(latencies.begin(), latencies.end());
+        wprintf(L"往返耗时（毫秒）: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+            TracePercentile(latencies.data(), latencies.size(), 0.50), TracePercentile(latencies.data(), latencies.size(), 0.90),
+            TracePercentile(latencies.data(), latencies.size(), 0.99), latencies.back());
+    }
+    return cFailed ? 1 : 0;
+}